@@ -0,0 +1,132 @@
+//File: broadcast_bench.c
+
+//Description: Benchmark of one tracker file table broadcast.  Compares the old way, where every
+// peer's send converts the whole table to an array again, with encoding the packet once into a
+// shared pktBuf_t that is written to every peer.  Peers are descriptors on /dev/null, so the
+// numbers are the tracker's own CPU and allocations, not the network.  Allocations are counted
+// by wrapping malloc.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -O2 -pthread -o broadcast_bench broadcast_bench.c ../common/pkt.c ../common/merkle.c ../common/filecodec.c ../common/peerid.c ../common/filetable.c ../common/filedelta.c
+
+//To run (defaults to 1000 peers and 50000 files):
+// ./broadcast_bench [peerNum] [fileNum]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <assert.h>
+
+#include "../common/pkt.h"
+
+
+static long mallocCount = 0;
+static long mallocBytes = 0;
+
+extern void* __libc_malloc(size_t size);
+
+//count every allocation made while benchmarking
+void* malloc(size_t size) {
+  __atomic_add_fetch(&mallocCount, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&mallocBytes, size, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+static double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double cpu_ms() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3;
+}
+
+//the per peer send the tracker used before: header field by field, then a fresh array of the table
+static int bench_oldSendPkt(int fd, ptp_tracker_t* pkt) {
+  if (write(fd, &(pkt -> type), sizeof(int)) < 0) return -1;
+  if (write(fd, &(pkt -> heartbeatinterval), sizeof(int)) < 0) return -1;
+  if (write(fd, &(pkt -> piece_len), sizeof(int)) < 0) return -1;
+  if (write(fd, &(pkt -> ackVersion), sizeof(unsigned long)) < 0) return -1;
+  if (write(fd, &(pkt -> epoch), sizeof(unsigned long)) < 0) return -1;
+  if (write(fd, &(pkt -> baseEpoch), sizeof(unsigned long)) < 0) return -1;
+  if (write(fd, &(pkt -> filetablesize), sizeof(int)) < 0) return -1;
+  if (write(fd, &(pkt -> deltasize), sizeof(int)) < 0) return -1;
+
+  if (pkt -> filetablesize > 0) {
+    int totalBytes = (pkt -> filetablesize) * sizeof(fileEntry_t);
+    char* buf = filetable_convertFileEntriesToArray(pkt -> filetableHeadPtr, pkt -> filetablesize, NULL);
+    int ret = write(fd, buf, totalBytes);
+    free(buf);
+    if (ret < 0) return -1;
+  }
+  return 1;
+}
+
+static void bench_report(const char* label, double wall, double cpu, long allocs, long bytes) {
+  printf("%-16s wall=%.1fms  cpu=%.1fms  mallocs=%ld  malloced=%.1fMB\n",
+      label, wall, cpu, allocs, bytes / (1024.0 * 1024.0));
+}
+
+int main(int argc, char** argv) {
+  int peerNum = argc > 1 ? atoi(argv[1]) : 1000;
+  int fileNum = argc > 2 ? atoi(argv[2]) : 50000;
+
+  fileTable_t* table = filetable_init();
+  peerIdMap_t* ids = peerid_init();
+  int holder = peerid_intern(ids, "10.0.0.1");
+  int i;
+  for (i = 0; i < fileNum; i++) {
+    fileEntry_t* entry = calloc(1, sizeof(fileEntry_t));
+    sprintf(entry -> file_name, "dir/file_%d.txt", i);
+    entry -> size = i;
+    entry -> timestamp = i;
+    filetable_addHolder(entry, holder, table -> filetable_mutex);
+    filetable_appendFileEntry(table, entry);
+  }
+
+  int* fds = malloc(peerNum * sizeof(int));
+  for (i = 0; i < peerNum; i++) {
+    fds[i] = open("/dev/null", O_WRONLY);
+    assert(fds[i] >= 0);
+  }
+
+  ptp_tracker_t pkt;
+  pkt_config_trackerPkt(&pkt, HEARTBEAT_INTERVAL, PIECE_LENGTH, table -> size, table -> head);
+  printf("broadcast of %d files (%.1fMB) to %d peers\n", fileNum, fileNum * sizeof(fileEntry_t) / (1024.0 * 1024.0), peerNum);
+
+  //old: convert the table once per peer
+  long allocs0 = mallocCount, bytes0 = mallocBytes;
+  double wall0 = now_ms(), cpu0 = cpu_ms();
+  for (i = 0; i < peerNum; i++) {
+    assert(bench_oldSendPkt(fds[i], &pkt) > 0);
+  }
+  bench_report("per-peer", now_ms() - wall0, cpu_ms() - cpu0, mallocCount - allocs0, mallocBytes - bytes0);
+
+  //new: encode once, every peer sends the same buffer
+  allocs0 = mallocCount;
+  bytes0 = mallocBytes;
+  wall0 = now_ms();
+  cpu0 = cpu_ms();
+  pktBuf_t* buf = pkt_tracker_encodePkt(&pkt, ids);
+  for (i = 0; i < peerNum; i++) {
+    pkt_buf_retain(buf);
+    assert(pkt_sendBuf(fds[i], buf) > 0);
+    pkt_buf_release(buf);
+  }
+  pkt_buf_release(buf);
+  bench_report("serialize-once", now_ms() - wall0, cpu_ms() - cpu0, mallocCount - allocs0, mallocBytes - bytes0);
+
+  for (i = 0; i < peerNum; i++) close(fds[i]);
+  free(fds);
+  filetable_destroy(table);
+  peerid_destroy(ids);
+  return 0;
+}
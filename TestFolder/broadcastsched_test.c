@@ -0,0 +1,172 @@
+//File: broadcastsched_test.c
+
+//Description: File that unit tests the functions in broadcastsched.c.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -ggdb -pthread -o test broadcastsched_test.c ../tracker/broadcastsched.c ../tracker/metrics.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "../tracker/broadcastsched.h"
+#include "../tracker/metrics.h"
+
+
+static int flushes;
+static unsigned long lastFlush;       // when the latest flush ran, in ns
+static unsigned long maxGap;          // longest a request waited for the flush after it
+
+static void count_flush() {
+  __atomic_add_fetch(&flushes, 1, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&lastFlush, metrics_now(), __ATOMIC_SEQ_CST);
+}
+
+static void reset() {
+  flushes = 0;
+  lastFlush = 0;
+  maxGap = 0;
+}
+
+void test_broadcastsched_burst() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "broadcastsched_request (burst)");
+  reset();
+
+  assert(broadcastsched_init(-1, 10, count_flush) == NULL);
+  assert(broadcastsched_init(50, 10, count_flush) == NULL);
+  assert(broadcastsched_init(50, 100, NULL) == NULL);
+
+  //a burst inside one window is a single broadcast, after the window
+  broadcastSched_t* sched = broadcastsched_init(50, 500, count_flush);
+  unsigned long start = metrics_now();
+  int i;
+  for (i = 0; i < 500; i++) {
+    broadcastsched_request(sched);
+  }
+  assert(flushes == 0);
+  usleep(150000);
+  assert(flushes == 1);
+  assert(lastFlush - start >= 50000000UL);
+
+  unsigned long requests, done;
+  broadcastsched_stats(sched, &requests, &done);
+  assert(requests == 500 && done == 1);
+  printf("Successfully coalesced %lu requests into %lu broadcast.\n", requests, done);
+
+  //a later request opens a new batch
+  broadcastsched_request(sched);
+  usleep(150000);
+  assert(flushes == 2);
+  broadcastsched_destroy(sched);
+  assert(flushes == 2);
+  printf("SUCCESS!!\n");
+}
+
+void test_broadcastsched_maxDelay() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "broadcastsched_request (max delay)");
+  reset();
+
+  //requests every 10ms never leave the 50ms window quiet, the max delay ends each batch
+  broadcastSched_t* sched = broadcastsched_init(50, 120, count_flush);
+  unsigned long start = metrics_now();
+  unsigned long lastRequest = 0;
+  int i;
+  for (i = 0; i < 60; i++) {
+    unsigned long now = metrics_now();
+    unsigned long flushed = __atomic_load_n(&lastFlush, __ATOMIC_SEQ_CST);
+    unsigned long since = now - (flushed > start ? flushed : start);
+    if (since > maxGap) maxGap = since;
+    lastRequest = metrics_now();
+    broadcastsched_request(sched);
+    usleep(10000);
+  }
+  unsigned long elapsedMs = (metrics_now() - start) / 1000000UL;
+  int during = __atomic_load_n(&flushes, __ATOMIC_SEQ_CST);
+  printf("%d broadcasts in %lums, longest without one %lums\n", during, elapsedMs, maxGap / 1000000UL);
+  assert(during >= (int) (elapsedMs / 120) - 1);
+  assert(during <= (int) (elapsedMs / 100) + 1);
+  //scheduling slack on a loaded machine aside, no request waits much over the max delay
+  assert(maxGap < 250000000UL);
+
+  //the batch still open goes out on destroy
+  broadcastsched_destroy(sched);
+  assert(flushes <= during + 1);
+  assert(lastFlush > lastRequest);
+  printf("SUCCESS!!\n");
+}
+
+void test_broadcastsched_immediate() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "broadcastsched_request (window 0)");
+  reset();
+
+  //no window: every request broadcasts before it returns
+  broadcastSched_t* sched = broadcastsched_init(0, 0, count_flush);
+  int i;
+  for (i = 0; i < 10; i++) {
+    broadcastsched_request(sched);
+    assert(flushes == i + 1);
+  }
+  unsigned long requests, done;
+  broadcastsched_stats(sched, &requests, &done);
+  assert(requests == 10 && done == 10);
+  broadcastsched_destroy(sched);
+  assert(flushes == 10);
+  printf("SUCCESS!!\n");
+}
+
+static void* request_thread(void* arg) {
+  broadcastSched_t* sched = (broadcastSched_t*) arg;
+  int i;
+  for (i = 0; i < 1000; i++) {
+    broadcastsched_request(sched);
+  }
+  return NULL;
+}
+
+void test_broadcastsched_metrics() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "broadcastsched metrics");
+  reset();
+  metrics_init();
+
+  //requests from many threads at once, as from the tracker's workers
+  broadcastSched_t* sched = broadcastsched_init(30, 300, count_flush);
+  pthread_t threads[4];
+  int i;
+  for (i = 0; i < 4; i++) {
+    pthread_create(&threads[i], NULL, request_thread, sched);
+  }
+  for (i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  //let the last batch end by its window rather than by the destroy
+  usleep(100000);
+  broadcastsched_destroy(sched);
+
+  metricsSlot_t* total = (metricsSlot_t*) malloc(sizeof(metricsSlot_t));
+  metrics_collect(total);
+  assert(total -> counters[METRIC_BROADCAST_REQUESTS] == 4000);
+  metricsHist_t* batch = &(total -> hists[METRIC_HIST_BROADCAST_BATCH]);
+  assert(batch -> count == (unsigned long) flushes);
+  assert(batch -> sum == 4000);
+  printf("coalescing ratio %.0f (%d broadcasts)\n", 4000.0 / flushes, flushes);
+  assert(total -> hists[METRIC_HIST_BROADCAST_DELAY].max >= 30000000UL);
+  free(total);
+  metrics_destroy();
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions for the broadcast scheduler.
+int main() {
+  test_broadcastsched_burst();
+  test_broadcastsched_maxDelay();
+  test_broadcastsched_immediate();
+  test_broadcastsched_metrics();
+  return 0;
+}
@@ -0,0 +1,171 @@
+//File: changelog_test.c
+
+//Description: File that unit tests the functions in changelog.c.
+
+//To compile:
+// gcc -Wall -pedantic -std=c99 -ggdb -pthread -o test changelog_test.c ../common/changelog.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "../common/changelog.h"
+#include "../common/filedelta.h"
+
+
+void test_changelog_init() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "changelog_init");
+
+  changeLog_t* log = changelog_init(4);
+  assert(log -> epoch == 0);
+  assert(log -> capacity == 4);
+  assert(log -> count == 0);
+  assert(log -> mutex != NULL);
+  assert(changelog_getEpoch(log) == 0);
+  changelog_destroy(log);
+  printf("SUCCESS!!\n");
+}
+
+void test_changelog_record() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "changelog_record");
+
+  changeLog_t* log = changelog_init(3);
+  assert(changelog_record(log, DELTA_ADD, "a.txt") == 1);
+  assert(changelog_record(log, DELTA_ADD, "b.txt") == 2);
+  assert(changelog_record(log, DELTA_ADD, "c.txt") == 3);
+  assert(log -> count == 3 && log -> start == 0);
+  printf("Successfully recorded changes with increasing epochs.\n");
+
+  //the ring is full, the oldest change is forgotten
+  assert(changelog_record(log, DELTA_MODIFY, "d.txt") == 4);
+  assert(log -> count == 3 && log -> start == 1);
+  assert(log -> records[log -> start].epoch == 2);
+  printf("Successfully overwrote the oldest change.\n");
+
+  changelog_destroy(log);
+  printf("SUCCESS!!\n");
+}
+
+void test_changelog_since() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "changelog_since");
+
+  changeLog_t* log = changelog_init(4);
+  int num;
+  unsigned long epoch;
+
+  assert(changelog_since(log, 0, &num, &epoch) == NULL);
+  assert(num == 0 && epoch == 0);
+  printf("Successfully returned nothing for an empty log.\n");
+
+  changelog_record(log, DELTA_ADD, "b.txt");     //1
+  changelog_record(log, DELTA_ADD, "a.txt");     //2
+  changelog_record(log, DELTA_MODIFY, "b.txt");  //3
+
+  changeRecord_t* records = changelog_since(log, 0, &num, &epoch);
+  assert(num == 2 && epoch == 3);
+  assert(strcmp(records[0].file_name, "a.txt") == 0 && records[0].epoch == 2);
+  assert(strcmp(records[1].file_name, "b.txt") == 0 && records[1].epoch == 3);
+  assert(records[1].op == DELTA_MODIFY);
+  free(records);
+  printf("Successfully kept only the latest change of every file.\n");
+
+  records = changelog_since(log, 2, &num, &epoch);
+  assert(num == 1 && epoch == 3);
+  assert(strcmp(records[0].file_name, "b.txt") == 0);
+  free(records);
+
+  assert(changelog_since(log, 3, &num, &epoch) == NULL && num == 0);
+  printf("Successfully returned only the changes after the given epoch.\n");
+
+  //push epochs 1 and 2 out of the ring
+  changelog_record(log, DELTA_DELETE, "a.txt");  //4
+  changelog_record(log, DELTA_ADD, "c.txt");     //5
+  changelog_record(log, DELTA_ADD, "d.txt");     //6
+  assert(changelog_since(log, 1, &num, &epoch) == NULL);
+  assert(num == -1 && epoch == 6);
+  printf("Successfully reported a peer outside the changelog window.\n");
+
+  //changes from epoch 3 on are still there
+  records = changelog_since(log, 2, &num, &epoch);
+  assert(num == 4);
+  assert(strcmp(records[0].file_name, "a.txt") == 0 && records[0].op == DELTA_DELETE);
+  free(records);
+  printf("Successfully returned changes at the edge of the window.\n");
+
+  changelog_destroy(log);
+  printf("SUCCESS!!\n");
+}
+
+void test_changelog_between() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "changelog_between");
+
+  changeLog_t* log = changelog_init(4);
+  int num;
+
+  changelog_record(log, DELTA_ADD, "b.txt");     //1
+  changelog_record(log, DELTA_ADD, "a.txt");     //2
+  changelog_record(log, DELTA_MODIFY, "b.txt");  //3
+  changelog_record(log, DELTA_ADD, "c.txt");     //4
+
+  //b.txt changed again after untilEpoch, its earlier change is still reported
+  changeRecord_t* records = changelog_between(log, 0, 2, &num);
+  assert(num == 2);
+  assert(strcmp(records[0].file_name, "a.txt") == 0 && records[0].epoch == 2);
+  assert(strcmp(records[1].file_name, "b.txt") == 0 && records[1].epoch == 1);
+  free(records);
+  printf("Successfully left out the changes after untilEpoch.\n");
+
+  records = changelog_between(log, 1, 3, &num);
+  assert(num == 2);
+  assert(strcmp(records[1].file_name, "b.txt") == 0 && records[1].epoch == 3);
+  free(records);
+
+  assert(changelog_between(log, 3, 3, &num) == NULL && num == 0);
+  records = changelog_between(log, 3, 100, &num);
+  assert(num == 1 && strcmp(records[0].file_name, "c.txt") == 0);
+  free(records);
+  printf("Successfully clamped the range to the log.\n");
+
+  changelog_record(log, DELTA_ADD, "d.txt");     //5
+  assert(changelog_between(log, 0, 3, &num) == NULL && num == -1);
+  printf("Successfully reported a range outside the changelog window.\n");
+
+  changelog_destroy(log);
+  printf("SUCCESS!!\n");
+}
+
+
+//Main function to test all of the functions for the change log.
+void test_changelog_restore() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "changelog_restore");
+
+  changeLog_t* log = changelog_init(4);
+  changelog_restore(log, 41);
+  assert(changelog_getEpoch(log) == 41);
+  assert(changelog_record(log, DELTA_ADD, "a.txt") == 42);
+  printf("Successfully continued numbering after a restored epoch.\n");
+
+  //changes before the restored epoch are gone, a peer behind it needs a full snapshot
+  int num;
+  changeRecord_t* records = changelog_between(log, 41, 42, &num);
+  assert(num == 1 && records[0].epoch == 42);
+  free(records);
+  assert(changelog_between(log, 40, 42, &num) == NULL && num == -1);
+  changelog_destroy(log);
+  printf("SUCCESS!!\n");
+}
+
+int main() {
+  test_changelog_init();
+  test_changelog_record();
+  test_changelog_since();
+  test_changelog_between();
+  test_changelog_restore();
+}
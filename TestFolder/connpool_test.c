@@ -0,0 +1,195 @@
+//File: connpool_test.c
+
+//Description: File that unit tests the functions in connpool.c against a listening socket on loopback: reuse,
+// the cap per peer, idle eviction, and connections the other end closed
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -ggdb -pthread -o test connpool_test.c ../peer/connpool.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <assert.h>
+
+#include "../peer/connpool.h"
+
+
+static int listenfd;
+static int port;
+
+
+/* a socket listening on loopback, connections complete in its backlog without being accepted */
+static void start_listening() {
+  listenfd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrLen = sizeof(addr);
+  assert(bind(listenfd, (struct sockaddr*) &addr, sizeof(addr)) == 0 && listen(listenfd, 16) == 0);
+  getsockname(listenfd, (struct sockaddr*) &addr, &addrLen);
+  port = ntohs(addr.sin_port);
+}
+
+static unsigned long now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+typedef struct getter{
+  connPool_t* pool;
+  poolConn_t* conn;
+}getter_t;
+
+/* leases a connection, waiting up to 5s */
+static void* get_conn(void* arg) {
+  getter_t* getter = (getter_t*) arg;
+  getter -> conn = connpool_get(getter -> pool, "127.0.0.1", port, 5000, NULL);
+  return NULL;
+}
+
+
+
+void test_connpool_reuse() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "connpool_get / connpool_put");
+
+  connPool_t* pool = connpool_init(2, 10000, 1000);
+  poolConn_t* conn = connpool_get(pool, "127.0.0.1", port, 0, NULL);
+  assert(conn != NULL && conn -> uses == 1 && pool -> opened == 1 && pool -> reused == 0);
+  int fd = conn -> fd;
+
+  //given back, the same connection is leased again
+  connpool_put(pool, conn, 1);
+  assert(pool -> peers -> idleNum == 1 && pool -> peers -> openNum == 1);
+  conn = connpool_get(pool, "127.0.0.1", port, 0, NULL);
+  assert(conn != NULL && conn -> fd == fd && conn -> uses == 2);
+  assert(pool -> opened == 1 && pool -> reused == 1 && pool -> leased == 2);
+
+  char buf[512];
+  assert(connpool_format(pool, buf, sizeof(buf)) > 0);
+  assert(strstr(buf, "counter connections_reused 1\n") != NULL && strstr(buf, "gauge connection_reuse_pct 50\n") != NULL);
+  assert(connpool_format(pool, buf, 10) == -1);
+
+  //one given back broken is closed
+  connpool_put(pool, conn, 0);
+  assert(pool -> peers -> idleNum == 0 && pool -> peers -> openNum == 0);
+
+  //nobody listening
+  assert(connpool_get(pool, "127.0.0.1", 1, 0, NULL) == NULL);
+  assert(connpool_get(pool, "not an ip", port, 0, NULL) == NULL);
+  connpool_destroy(pool);
+  printf("SUCCESS!!\n");
+}
+
+void test_connpool_cap() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "connpool_get (per peer cap)");
+
+  connPool_t* pool = connpool_init(2, 10000, 1000);
+  poolConn_t* a = connpool_get(pool, "127.0.0.1", port, 0, NULL);
+  poolConn_t* b = connpool_get(pool, "127.0.0.1", port, 0, NULL);
+  assert(a != NULL && b != NULL && a -> fd != b -> fd);
+
+  //a third waits, and gives up
+  unsigned long start = now_ms();
+  assert(connpool_get(pool, "127.0.0.1", port, 100, NULL) == NULL);
+  assert(now_ms() - start >= 90);
+  int cancel = 1;
+  assert(connpool_get(pool, "127.0.0.1", port, 5000, &cancel) == NULL);
+
+  //or gets the first one given back
+  getter_t getter;
+  getter.pool = pool;
+  getter.conn = NULL;
+  pthread_t thread;
+  pthread_create(&thread, NULL, get_conn, &getter);
+  usleep(50000);
+  connpool_put(pool, a, 1);
+  pthread_join(thread, NULL);
+  assert(getter.conn == a && pool -> opened == 2 && pool -> reused == 1);
+
+  connpool_put(pool, getter.conn, 1);
+  connpool_put(pool, b, 1);
+  assert(pool -> peers -> idleNum == 2);
+  connpool_destroy(pool);
+  printf("SUCCESS!!\n");
+}
+
+void test_connpool_evict() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "connpool_evictIdle");
+
+  connPool_t* pool = connpool_init(4, 100, 1000);
+  poolConn_t* a = connpool_get(pool, "127.0.0.1", port, 0, NULL);
+  poolConn_t* b = connpool_get(pool, "127.0.0.1", port, 0, NULL);
+  connpool_put(pool, a, 1);
+  connpool_put(pool, b, 1);
+
+  //idle for less than idleMs they stay, for longer they go
+  assert(connpool_evictIdle(pool, now_ms()) == 0);
+  assert(connpool_evictIdle(pool, now_ms() + 200) == 2);
+  assert(pool -> evicted == 2 && pool -> peers -> openNum == 0 && pool -> peers -> idle == NULL);
+
+  //eviction comes with the next lease too
+  a = connpool_get(pool, "127.0.0.1", port, 0, NULL);
+  connpool_put(pool, a, 1);
+  usleep(150000);
+  a = connpool_get(pool, "127.0.0.1", port, 0, NULL);
+  assert(a != NULL && a -> uses == 1 && pool -> evicted == 3 && pool -> reused == 0);
+  connpool_put(pool, a, 1);
+
+  //with idleMs 0 nothing is kept
+  pool -> idleMs = 0;
+  a = connpool_get(pool, "127.0.0.1", port, 0, NULL);
+  connpool_put(pool, a, 1);
+  assert(pool -> peers -> openNum == 0);
+  connpool_destroy(pool);
+  printf("SUCCESS!!\n");
+}
+
+void test_connpool_broken() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "connpool_get (closed by the other end)");
+
+  //drain what earlier tests left in the backlog
+  int fd;
+  struct timeval tv = {0, 100000};
+  setsockopt(listenfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  while ((fd = accept(listenfd, NULL, NULL)) >= 0) close(fd);
+
+  connPool_t* pool = connpool_init(4, 10000, 1000);
+  poolConn_t* a = connpool_get(pool, "127.0.0.1", port, 0, NULL);
+  connpool_put(pool, a, 1);
+  fd = accept(listenfd, NULL, NULL);
+  assert(fd >= 0);
+  close(fd);
+  usleep(50000);
+
+  //it is dropped for a new one
+  a = connpool_get(pool, "127.0.0.1", port, 0, NULL);
+  assert(a != NULL && a -> uses == 1);
+  assert(pool -> broken == 1 && pool -> opened == 2 && pool -> reused == 0 && pool -> peers -> openNum == 1);
+  connpool_put(pool, a, 1);
+  connpool_destroy(pool);
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions of the connection pool.
+int main() {
+  start_listening();
+  test_connpool_reuse();
+  test_connpool_cap();
+  test_connpool_evict();
+  test_connpool_broken();
+  close(listenfd);
+  return 0;
+}
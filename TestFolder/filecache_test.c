@@ -0,0 +1,178 @@
+//File: filecache_test.c
+
+//Description: File that unit tests the functions in filecache.c on files in a temporary directory: reuse of an
+// open file, invalidation with a lease out, files replaced or modified under the same path, and eviction
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -ggdb -pthread -o test filecache_test.c ../peer/filecache.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "../peer/filecache.h"
+
+
+static char dir[] = "/tmp/filecache_testXXXXXX";
+
+
+/* the path of a file in the test directory */
+static void make_path(const char* name, char* path) {
+  snprintf(path, 512, "%s/%s", dir, name);
+}
+
+/* a file holding text */
+static void write_file(const char* name, const char* text) {
+  char path[512];
+  make_path(name, path);
+  FILE* file = fopen(path, "w");
+  assert(file != NULL && fputs(text, file) >= 0);
+  fclose(file);
+}
+
+/* whether the file leased holds text */
+static int holds(cachedFile_t* file, const char* text) {
+  char buf[64];
+  ssize_t n = pread(file -> fd, buf, sizeof(buf), 0);
+  return n == (ssize_t) strlen(text) && memcmp(buf, text, n) == 0;
+}
+
+/* whether fd is open */
+static int is_open(int fd) {
+  return fcntl(fd, F_GETFD) != -1;
+}
+
+
+
+void test_filecache_open() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filecache_open / filecache_release");
+
+  fileCache_t* cache = filecache_init(4, 10000);
+  char path[512];
+  make_path("a", path);
+  write_file("a", "first");
+  cachedFile_t* a = filecache_open(cache, path);
+  assert(a != NULL && a -> size == 5 && holds(a, "first") && cache -> misses == 1);
+
+  //leased again, by two at once, it is the same file
+  cachedFile_t* b = filecache_open(cache, path);
+  assert(b == a && a -> refs == 2 && cache -> hits == 1 && cache -> num == 1);
+  filecache_release(cache, a);
+  filecache_release(cache, b);
+  int fd = a -> fd;
+  assert(a -> refs == 0 && is_open(fd));
+  a = filecache_open(cache, path);
+  assert(a -> fd == fd && cache -> hits == 2 && cache -> misses == 1);
+  filecache_release(cache, a);
+
+  char buf[512];
+  assert(filecache_format(cache, buf, sizeof(buf)) > 0);
+  assert(strstr(buf, "counter open_file_hits 2\n") != NULL && strstr(buf, "gauge open_files 1\n") != NULL);
+  assert(filecache_format(cache, buf, 10) == -1);
+
+  //nothing there, or not a regular file
+  make_path("none", path);
+  assert(filecache_open(cache, path) == NULL);
+  assert(filecache_open(cache, dir) == NULL);
+  assert(cache -> num == 1);
+  filecache_destroy(cache);
+  assert(!is_open(fd));
+  printf("SUCCESS!!\n");
+}
+
+void test_filecache_invalidate() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filecache_invalidate");
+
+  fileCache_t* cache = filecache_init(4, 10000);
+  char path[512];
+  char tmp[512];
+  make_path("a", path);
+  make_path("a.tmp", tmp);
+  write_file("a", "first");
+  cachedFile_t* old = filecache_open(cache, path);
+  assert(old != NULL && holds(old, "first"));
+
+  //replaced, and the change reported: the lease out still reads the old version, the next one the new
+  write_file("a.tmp", "second");
+  assert(rename(tmp, path) == 0);
+  assert(filecache_invalidate(cache, path) == 1 && cache -> invalidated == 1 && cache -> num == 0);
+  assert(is_open(old -> fd) && holds(old, "first"));
+  cachedFile_t* new = filecache_open(cache, path);
+  assert(new != NULL && new != old && holds(new, "second"));
+  int fd = old -> fd;
+  filecache_release(cache, old);
+  assert(!is_open(fd) || fd == new -> fd);
+  filecache_release(cache, new);
+  assert(filecache_invalidate(cache, tmp) == 0);
+
+  //replaced and not reported: found by the check of the path
+  cache -> checkMs = 0;
+  write_file("a.tmp", "third");
+  assert(rename(tmp, path) == 0);
+  new = filecache_open(cache, path);
+  assert(new != NULL && holds(new, "third") && cache -> invalidated == 2);
+  filecache_release(cache, new);
+
+  //modified in place, a different size
+  write_file("a", "fourth!");
+  new = filecache_open(cache, path);
+  assert(new != NULL && new -> size == 7 && cache -> invalidated == 3);
+  filecache_release(cache, new);
+
+  //deleted
+  unlink(path);
+  assert(filecache_open(cache, path) == NULL && cache -> invalidated == 4 && cache -> num == 0);
+  filecache_destroy(cache);
+  printf("SUCCESS!!\n");
+}
+
+void test_filecache_evict() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filecache_open (least recently used evicted)");
+
+  fileCache_t* cache = filecache_init(2, 10000);
+  char a[512], b[512], c[512];
+  make_path("a", a);
+  make_path("b", b);
+  make_path("c", c);
+  write_file("a", "a");
+  write_file("b", "b");
+  write_file("c", "c");
+
+  filecache_release(cache, filecache_open(cache, a));
+  cachedFile_t* leased = filecache_open(cache, b);
+  filecache_release(cache, filecache_open(cache, a));
+
+  //b is the least recently used, dropped though leased, and closed once given back
+  filecache_release(cache, filecache_open(cache, c));
+  assert(cache -> evicted == 1 && cache -> num == 2 && !leased -> cached);
+  assert(holds(leased, "b"));
+  int fd = leased -> fd;
+  filecache_release(cache, leased);
+  assert(!is_open(fd));
+  filecache_release(cache, filecache_open(cache, a));
+  assert(cache -> hits == 2 && cache -> misses == 3);
+
+  filecache_destroy(cache);
+  unlink(a);
+  unlink(b);
+  unlink(c);
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions of the file cache.
+int main() {
+  assert(mkdtemp(dir) != NULL);
+  test_filecache_open();
+  test_filecache_invalidate();
+  test_filecache_evict();
+  rmdir(dir);
+  return 0;
+}
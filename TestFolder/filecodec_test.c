@@ -0,0 +1,268 @@
+//File: filecodec_test.c
+
+//Description: File that unit tests the functions in filecodec.c, and the packets pkt.c builds with it.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -ggdb -pthread -o test filecodec_test.c ../common/filecodec.c ../common/peerid.c ../common/pkt.c ../common/merkle.c ../common/filedelta.c ../common/filetable.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "../common/filecodec.h"
+#include "../common/pkt.h"
+
+
+static char* peerIps[] = {"10.0.0.1", "10.0.0.2", "192.168.1.77", "172.16.254.3", "192.123.342.212"};
+static peerIdMap_t* senderIds;     // ids of the encoding side
+static peerIdMap_t* receiverIds;   // ids of the decoding side, handed out in another order
+static pthread_mutex_t mockMutex = PTHREAD_MUTEX_INITIALIZER;
+
+//Function to create a list of mock entries held by a few of the peers above.
+fileEntry_t* create_mock_entries(int num) {
+  fileEntry_t dummy;
+  dummy.next = NULL;
+  fileEntry_t* tail = &dummy;
+  int i, j;
+  for (i = 0; i < num; i++) {
+    fileEntry_t* entry = calloc(1, sizeof(fileEntry_t));
+    sprintf(entry -> file_name, "dir%d/file%d.txt", i % 7, i);
+    entry -> size = i * 4099;
+    entry -> timestamp = 1476000000 + i;
+    for (j = 0; j < 1 + i % 3; j++) {
+      filetable_addHolder(entry, peerid_lookup(senderIds, peerIps[(i + j) % 5]), &mockMutex);
+    }
+    tail -> next = entry;
+    tail = entry;
+  }
+  return dummy.next;
+}
+
+void free_entries(fileEntry_t* entry) {
+  while (entry != NULL) {
+    fileEntry_t* next = entry -> next;
+    filetable_freeEntry(entry);
+    entry = next;
+  }
+}
+
+//a is encoded with senderIds, b decoded with receiverIds: the same holders by ip
+void assert_same_entry(fileEntry_t* a, fileEntry_t* b) {
+  assert(strcmp(a -> file_name, b -> file_name) == 0);
+  assert(a -> size == b -> size);
+  assert(a -> timestamp == b -> timestamp);
+  assert(a -> peerNum == b -> peerNum);
+  char ip[IP_LEN];
+  int id;
+  for (id = filetable_nextHolder(a, 0); id >= 0; id = filetable_nextHolder(a, id + 1)) {
+    assert(peerid_getIp(senderIds, id, ip) == 1);
+    assert(filetable_hasHolder(b, peerid_lookup(receiverIds, ip)));
+  }
+}
+
+//encode lists into a malloced body
+char* encode_body(fileEntry_t* entries, int entryNum, fileDelta_t* deltas, int deltaNum, int* len) {
+  fileCodec_t* codec = filecodec_init(senderIds);
+  *len = filecodec_measure(codec, entries, entryNum, deltas, deltaNum);
+  char* buf = malloc(*len + 1);
+  assert(filecodec_encode(codec, buf, entries, entryNum, deltas, deltaNum) == buf + *len);
+  filecodec_destroy(codec);
+  return buf;
+}
+
+void test_filecodec_roundTrip() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filecodec_encode / filecodec_decode");
+
+  fileEntry_t* entries = create_mock_entries(100);
+  entries -> size = -1;   //sizes are zigzag encoded, negatives survive
+
+  fileDelta_t deltas[3];
+  memset(deltas, 0, sizeof(deltas));
+  deltas[0].op = DELTA_ADD;
+  deltas[0].entry = *(entries -> next);
+  deltas[1].op = DELTA_MODIFY;
+  deltas[1].entry = *(entries -> next -> next);
+  deltas[2].op = DELTA_DELETE;
+  strcpy(deltas[2].entry.file_name, "gone.txt");
+  deltas[0].next = &deltas[1];
+  deltas[1].next = &deltas[2];
+
+  int len;
+  char* buf = encode_body(entries, 100, deltas, 3, &len);
+
+  fileEntry_t* decoded;
+  fileDelta_t* decodedDeltas;
+  assert(filecodec_decode(buf, len, 100, &decoded, 3, &decodedDeltas, receiverIds) == 1);
+
+  fileEntry_t* a = entries;
+  fileEntry_t* b = decoded;
+  int n = 0;
+  while (a != NULL) {
+    assert_same_entry(a, b);
+    assert(b -> next == NULL || b -> next -> prev == b);
+    a = a -> next;
+    b = b -> next;
+    n ++;
+  }
+  assert(b == NULL && n == 100);
+  printf("Successfully decoded 100 entries, ips that are not dotted quads included.\n");
+
+  fileDelta_t* delta = decodedDeltas;
+  int i;
+  for (i = 0; i < 3; i++) {
+    assert(delta -> op == deltas[i].op);
+    assert_same_entry(&(deltas[i].entry), &(delta -> entry));
+    delta = delta -> next;
+  }
+  assert(delta == NULL);
+  printf("Successfully decoded the deltas, DELETE carries only its name.\n");
+
+  free(buf);
+  free_entries(decoded);
+  filedelta_freeList(decodedDeltas);
+  free_entries(entries);
+  printf("SUCCESS!!\n");
+}
+
+void test_filecodec_empty() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filecodec_measure (no entries)");
+
+  fileCodec_t* codec = filecodec_init(senderIds);
+  assert(filecodec_measure(codec, NULL, 0, NULL, 0) == 0);
+  filecodec_destroy(codec);
+
+  fileEntry_t* entries;
+  fileDelta_t* deltas;
+  assert(filecodec_decode(NULL, 0, 0, &entries, 0, &deltas, receiverIds) == 1);
+  assert(entries == NULL && deltas == NULL);
+  printf("SUCCESS!!\n");
+}
+
+void test_filecodec_malformed() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filecodec_decode (malformed bodies)");
+
+  fileEntry_t* entries = create_mock_entries(20);
+  int len;
+  char* buf = encode_body(entries, 20, NULL, 0, &len);
+  fileEntry_t* decoded;
+  fileDelta_t* deltas;
+
+  //every truncation is rejected
+  int cut;
+  for (cut = 0; cut < len; cut++) {
+    assert(filecodec_decode(buf, cut, 20, &decoded, 0, &deltas, receiverIds) == -1);
+    assert(decoded == NULL && deltas == NULL);
+  }
+
+  //so are trailing bytes and a count that does not match the body
+  buf[len] = 0;
+  assert(filecodec_decode(buf, len + 1, 20, &decoded, 0, &deltas, receiverIds) == -1);
+  assert(filecodec_decode(buf, len, 21, &decoded, 0, &deltas, receiverIds) == -1);
+  assert(filecodec_decode(buf, len, 19, &decoded, 0, &deltas, receiverIds) == -1);
+
+  //and a holder id past the dictionary (last byte is the last entry's last id)
+  char saved = buf[len - 1];
+  buf[len - 1] = 100;
+  assert(filecodec_decode(buf, len, 20, &decoded, 0, &deltas, receiverIds) == -1);
+  buf[len - 1] = saved;
+
+  assert(filecodec_decode(buf, len, 20, &decoded, 0, &deltas, receiverIds) == 1);
+  free_entries(decoded);
+  free(buf);
+  free_entries(entries);
+  printf("SUCCESS!!\n");
+}
+
+void test_filecodec_size() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filecodec_measure (size against raw fileEntry_t)");
+
+  int num = 10000;
+  fileEntry_t* entries = create_mock_entries(num);
+  fileCodec_t* codec = filecodec_init(senderIds);
+  long compact = filecodec_measure(codec, entries, num, NULL, 0);
+  filecodec_destroy(codec);
+  long raw = (long) num * sizeof(fileEntry_t);
+
+  printf("%d entries: raw %ld bytes, compact %ld bytes (%.1fx smaller)\n", num, raw, compact, raw / (double) compact);
+  assert(compact * 5 <= raw);
+  free_entries(entries);
+  printf("SUCCESS!!\n");
+}
+
+void test_pkt_roundTrip() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "pkt_tracker_encodePkt / pkt_peer_recvPkt, pkt_peer_encodePkt / pkt_peer_decodePkt");
+
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  fileEntry_t* entries = create_mock_entries(50);
+
+  //tracker -> peer
+  ptp_tracker_t update;
+  pkt_config_trackerPkt(&update, HEARTBEAT_INTERVAL, PIECE_LENGTH, 50, entries);
+  update.epoch = 42;
+  pkt_config_trackerShard(&update, 2, 3);
+  assert(pkt_tracker_sendPkt(fds[0], &update, senderIds) == 1);
+
+  ptp_tracker_t received;
+  assert(pkt_peer_recvPkt(fds[1], &received, receiverIds) == 1);
+  assert(received.type == TRACKER_FILETABLE && received.epoch == 42 && received.filetablesize == 50);
+  assert(received.shard == 2 && received.shardNum == 3);
+  assert_same_entry(entries -> next, received.filetableHeadPtr -> next);
+  free_entries(received.filetableHeadPtr);
+  printf("Successfully received a tracker packet.\n");
+
+  //peer -> tracker, framed the way the reactor does
+  ptp_peer_t reg;
+  memset(&reg, 0, sizeof(reg));
+  pkt_config_peerPkt(&reg, REGISTER, "10.0.0.1", 3000, 50, entries);
+  pkt_config_peerShard(&reg, 1, 4);
+  pktBuf_t* buf = pkt_peer_encodePkt(&reg, senderIds);
+  assert(pkt_peer_frameLen(buf -> data, 10) == 0);
+  assert(pkt_peer_frameLen(buf -> data, buf -> len) == buf -> len);
+
+  ptp_peer_t decoded;
+  assert(pkt_peer_decodePkt(buf -> data, &decoded) == 1);
+  assert(decoded.type == REGISTER && decoded.port == 3000 && decoded.filetablesize == 50);
+  assert(decoded.shard == 1 && decoded.shardNum == 4);
+  assert(strcmp(decoded.peer_ip, "10.0.0.1") == 0);
+  //the tracker credits only the sender, holders in the body are left out
+  assert(strcmp(decoded.filetableHeadPtr -> next -> file_name, entries -> next -> file_name) == 0);
+  assert(decoded.filetableHeadPtr -> next -> peerNum == 0);
+  free_entries(decoded.filetableHeadPtr);
+  pkt_buf_release(buf);
+  printf("Successfully decoded a peer packet.\n");
+
+  free_entries(entries);
+  close(fds[0]);
+  close(fds[1]);
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions for the codec.
+int main() {
+  senderIds = peerid_init();
+  receiverIds = peerid_init();
+  int i;
+  for (i = 0; i < 5; i++) {
+    peerid_intern(senderIds, peerIps[i]);
+  }
+  peerid_intern(receiverIds, "10.9.9.9");   //so the two sides disagree on every id
+  test_filecodec_roundTrip();
+  test_filecodec_empty();
+  test_filecodec_malformed();
+  test_filecodec_size();
+  test_pkt_roundTrip();
+  peerid_destroy(senderIds);
+  peerid_destroy(receiverIds);
+  return 0;
+}
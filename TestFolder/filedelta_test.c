@@ -0,0 +1,245 @@
+//File: filedelta_test.c
+
+//Description: File that unit tests the functions in filedelta.c.
+
+//To compile:
+// gcc -Wall -pedantic -std=c99 -ggdb -pthread -o test filedelta_test.c ../common/filedelta.c ../common/filetable.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <assert.h>
+
+#include "../common/filedelta.h"
+
+
+//Function to create a mock file entry based on the given filename and size.
+fileEntry_t* create_mock_file_entry(char* filename, int size){
+  fileEntry_t* entry = calloc(1, sizeof(fileEntry_t));
+  entry -> size = size;
+  memcpy(entry -> file_name, filename, strlen(filename) + 1);
+  entry -> timestamp = (unsigned)time(NULL);
+  return entry;
+}
+
+void test_filedelta_initLog() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filedelta_initLog");
+
+  fileDeltaLog_t* log = filedelta_initLog();
+  assert(log -> version == 0);
+  assert(log -> ackedVersion == 0);
+  assert(log -> head == NULL);
+  assert(log -> tail == NULL);
+  assert(log -> size == 0);
+  assert(log -> mutex != NULL);
+  filedelta_destroyLog(log);
+  printf("SUCCESS!!\n");
+}
+
+void test_filedelta_record() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filedelta_record");
+
+  fileDeltaLog_t* log = filedelta_initLog();
+  fileEntry_t* a = create_mock_file_entry("a.txt", 1);
+  fileEntry_t* b = create_mock_file_entry("b.txt", 2);
+
+  assert(filedelta_record(log, DELTA_ADD, a) == 1);
+  assert(filedelta_record(log, DELTA_ADD, b) == 2);
+  assert(log -> size == 2);
+  assert(log -> head -> version == 1 && log -> tail -> version == 2);
+  printf("Successfully recorded changes with increasing versions.\n");
+
+  //a second change to a.txt replaces the pending one and moves to the end
+  a -> size = 11;
+  assert(filedelta_record(log, DELTA_MODIFY, a) == 3);
+  assert(log -> size == 2);
+  assert(strcmp(log -> head -> entry.file_name, "b.txt") == 0);
+  assert(strcmp(log -> tail -> entry.file_name, "a.txt") == 0);
+  assert(log -> tail -> op == DELTA_MODIFY && log -> tail -> entry.size == 11);
+  printf("Successfully kept only the latest change of a file.\n");
+
+  assert(filedelta_record(log, DELTA_DELETE, b) == 4);
+  assert(log -> size == 2);
+  assert(log -> tail -> op == DELTA_DELETE);
+
+  filetable_freeEntry(a);
+  filetable_freeEntry(b);
+  filedelta_destroyLog(log);
+  printf("SUCCESS!!\n");
+}
+
+void test_filedelta_ack() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filedelta_ack");
+
+  fileDeltaLog_t* log = filedelta_initLog();
+  fileEntry_t* a = create_mock_file_entry("a.txt", 1);
+  fileEntry_t* b = create_mock_file_entry("b.txt", 2);
+  fileEntry_t* c = create_mock_file_entry("c.txt", 3);
+  filedelta_record(log, DELTA_ADD, a);
+  filedelta_record(log, DELTA_ADD, b);
+  filedelta_record(log, DELTA_ADD, c);
+
+  assert(filedelta_ack(log, 2) == 2);
+  assert(log -> ackedVersion == 2);
+  assert(log -> size == 1);
+  assert(strcmp(log -> head -> entry.file_name, "c.txt") == 0);
+  printf("Successfully dropped acknowledged changes.\n");
+
+  assert(filedelta_ack(log, 1) == -1);
+  assert(filedelta_ack(log, 9) == -1);
+  assert(log -> size == 1);
+  printf("Successfully ignored stale and future acks.\n");
+
+  assert(filedelta_ack(log, 3) == 1);
+  assert(log -> size == 0 && log -> head == NULL && log -> tail == NULL);
+  assert(filedelta_record(log, DELTA_MODIFY, a) == 4);
+  assert(log -> head == log -> tail);
+  printf("Successfully emptied the log and recorded again.\n");
+
+  filetable_freeEntry(a);
+  filetable_freeEntry(b);
+  filetable_freeEntry(c);
+  filedelta_destroyLog(log);
+  printf("SUCCESS!!\n");
+}
+
+void test_filedelta_getPending() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filedelta_getPending");
+
+  fileDeltaLog_t* log = filedelta_initLog();
+  fileEntry_t* a = create_mock_file_entry("a.txt", 1);
+  fileEntry_t* b = create_mock_file_entry("b.txt", 2);
+  int num;
+  unsigned long base, version;
+
+  assert(filedelta_getPending(log, &num, &base, &version) == NULL);
+  assert(num == 0 && base == 0 && version == 0);
+
+  filedelta_record(log, DELTA_ADD, a);
+  filedelta_ack(log, 1);
+  filedelta_record(log, DELTA_ADD, b);
+  filedelta_record(log, DELTA_DELETE, a);
+
+  fileDelta_t* pending = filedelta_getPending(log, &num, &base, &version);
+  assert(num == 2 && base == 1 && version == 3);
+  assert(strcmp(pending -> entry.file_name, "b.txt") == 0);
+  assert(pending -> next -> op == DELTA_DELETE);
+  assert(pending -> next -> next == NULL);
+  assert(pending != log -> head);
+  printf("Successfully copied the pending changes and versions.\n");
+
+  //round trip through the wire format
+  char* buf = filedelta_convertDeltasToArray(pending, num);
+  fileDelta_t* decoded = filedelta_convertArrayToDeltas(buf, num);
+  assert(decoded -> op == DELTA_ADD && decoded -> entry.size == 2);
+  assert(strcmp(decoded -> next -> entry.file_name, "a.txt") == 0);
+  assert(decoded -> next -> op == DELTA_DELETE);
+  assert(decoded -> next -> next == NULL);
+  printf("Successfully converted the changes to an array and back.\n");
+
+  free(buf);
+  filedelta_freeList(decoded);
+  filedelta_freeList(pending);
+  filetable_freeEntry(a);
+  filetable_freeEntry(b);
+  filedelta_destroyLog(log);
+  printf("SUCCESS!!\n");
+}
+
+void test_filedelta_apply() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filedelta_apply");
+
+  fileTable_t* table = filetable_init();
+  filetable_appendFileEntry(table, create_mock_file_entry("a.txt", 1));
+  filetable_appendFileEntry(table, create_mock_file_entry("b.txt", 2));
+
+  //modify a.txt (with a new holder), delete b.txt, add c.txt
+  fileDeltaLog_t* log = filedelta_initLog();
+  fileEntry_t* a = create_mock_file_entry("a.txt", 10);
+  filetable_addHolder(a, 7, table -> filetable_mutex);
+  fileEntry_t* b = create_mock_file_entry("b.txt", 2);
+  fileEntry_t* c = create_mock_file_entry("c.txt", 3);
+  filedelta_record(log, DELTA_MODIFY, a);
+  filedelta_record(log, DELTA_DELETE, b);
+  filedelta_record(log, DELTA_ADD, c);
+  int num;
+  unsigned long base, version;
+  fileDelta_t* pending = filedelta_getPending(log, &num, &base, &version);
+
+  assert(filedelta_apply(table, pending) == 3);
+  assert(table -> size == 2);
+  fileEntry_t* res = filetable_searchFileByName(table, "a.txt");
+  assert(res -> size == 10 && res -> peerNum == 1);
+  assert(filetable_hasHolder(res, 7));
+  assert(filetable_searchFileByName(table, "b.txt") == NULL);
+  assert(filetable_searchFileByName(table, "c.txt") != NULL);
+  printf("Successfully applied modify, delete and add.\n");
+
+  //the whole state travels with every delta, applying again changes nothing
+  assert(filedelta_apply(table, pending) == 2);
+  assert(table -> size == 2);
+  assert(table -> head -> next -> next == NULL);
+  printf("Successfully applied the same changes twice.\n");
+
+  filedelta_freeList(pending);
+  filetable_freeEntry(a);
+  filetable_freeEntry(b);
+  filetable_freeEntry(c);
+  filedelta_destroyLog(log);
+  filetable_destroy(table);
+  printf("SUCCESS!!\n");
+}
+
+
+//Main function to test all of the functions for the delta log.
+void test_filedelta_fromChanges() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filedelta_fromChanges");
+
+  fileTable_t* table = filetable_init();
+  filetable_appendFileEntry(table, create_mock_file_entry("kept.txt", 7));
+  pthread_mutex_lock(table -> filetable_mutex);
+  filetable_publishSnapshotLocked(table, 2);
+  pthread_mutex_unlock(table -> filetable_mutex);
+
+  changeRecord_t changes[2];
+  memset(changes, 0, sizeof(changes));
+  changes[0].epoch = 1;
+  changes[0].op = DELTA_ADD;
+  strcpy(changes[0].file_name, "kept.txt");
+  changes[1].epoch = 2;
+  changes[1].op = DELTA_ADD;
+  strcpy(changes[1].file_name, "gone.txt");
+
+  fileSnapshot_t* snapshot = filetable_acquireSnapshot(table);
+  fileDelta_t* deltas = filedelta_fromChanges(snapshot, changes, 2);
+  filetable_releaseSnapshot(snapshot);
+
+  //a file still in the snapshot carries its state there, one that left it is a delete
+  assert(deltas -> op == DELTA_MODIFY && deltas -> version == 1);
+  assert(strcmp(deltas -> entry.file_name, "kept.txt") == 0 && deltas -> entry.size == 7);
+  assert(deltas -> entry.next == NULL && deltas -> entry.prev == NULL);
+  assert(deltas -> next -> op == DELTA_DELETE && deltas -> next -> version == 2);
+  assert(strcmp(deltas -> next -> entry.file_name, "gone.txt") == 0);
+  assert(deltas -> next -> next == NULL);
+
+  filedelta_freeList(deltas);
+  filetable_destroy(table);
+  printf("SUCCESS!!\n");
+}
+
+int main() {
+  test_filedelta_initLog();
+  test_filedelta_record();
+  test_filedelta_ack();
+  test_filedelta_getPending();
+  test_filedelta_apply();
+  test_filedelta_fromChanges();
+}
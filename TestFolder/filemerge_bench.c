@@ -0,0 +1,248 @@
+//File: filemerge_bench.c
+
+//Description: Times the tracker reconciling a FILEUPDATE of N files against a table of N files with D differences
+// (see filemerge.c).  The old way, as handshake used to do it: the packet's entries put in a table of their own,
+// every one of them looked up in tracker's fileTable and synced, then every entry of tracker's fileTable looked up in
+// the packet's.  The new way: the packet's entries sorted in a Merkle tree, merged with the tree of tracker's
+// table in one pass, only the changes applied.  The tracker's tree is timed both as found cached (warm) and built
+// for the occasion (cold, the first FILEUPDATE after a publish).  Both ways apply changes the way tracker.c does,
+// and must end with the same table and changelog.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -O2 -pthread -o filemerge_bench filemerge_bench.c ../common/filemerge.c ../common/merkle.c ../common/filetable.c ../common/changelog.c
+
+//To run:
+// ./filemerge_bench [-n files] [-d differences] [-r runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "../common/filemerge.h"
+#include "../common/changelog.h"
+#include "../common/filedelta.h"
+
+#define BENCH_HOLDERS 4   // peers holding every file of the tracker, the reporting peer is the first
+#define BENCH_LOG_CAP (1 << 16)
+
+
+static double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static fileEntry_t* make_entry(const char* name, int size, unsigned long timestamp) {
+  fileEntry_t* entry = (fileEntry_t*) calloc(1, sizeof(fileEntry_t));
+  snprintf(entry -> file_name, FILE_NAME_MAX_LEN, "%s", name);
+  entry -> size = size;
+  entry -> timestamp = timestamp;
+  return entry;
+}
+
+static void free_list(fileEntry_t* head) {
+  while (head != NULL) {
+    fileEntry_t* next = head -> next;
+    filetable_freeEntry(head);
+    head = next;
+  }
+}
+
+/* the tracker's table: fileNum files held by every bench peer, published */
+static fileTable_t* make_tracker(int fileNum) {
+  fileTable_t* table = filetable_init();
+  char name[FILE_NAME_MAX_LEN];
+  int i, h;
+  for (i = 0; i < fileNum; i++) {
+    snprintf(name, sizeof(name), "projects/p%d/src/module%d/file%d.c", i % 97, i % 1013, i);
+    fileEntry_t* entry = make_entry(name, 1000 + i % 50000, 1434000000UL + i);
+    for (h = 0; h < BENCH_HOLDERS; h++) {
+      filetable_addHolderLocked(entry, h);
+    }
+    filetable_appendFileEntry(table, entry);
+  }
+  pthread_mutex_lock(table -> filetable_mutex);
+  filetable_publishSnapshotLocked(table, 0);
+  pthread_mutex_unlock(table -> filetable_mutex);
+  return table;
+}
+
+/* the peer's FILEUPDATE: the same files but for diffNum differences, a third modified, deleted and added each */
+static fileEntry_t* make_update(int fileNum, int diffNum) {
+  fileEntry_t dummy;
+  fileEntry_t* tail = &dummy;
+  char name[FILE_NAME_MAX_LEN];
+  int i;
+  for (i = 0; i < fileNum; i++) {
+    int d = (diffNum > 0 && i % (fileNum / diffNum) == 0) ? i / (fileNum / diffNum) : -1;
+    if (d >= 0 && d < diffNum && d % 3 == 1) continue;
+    snprintf(name, sizeof(name), "projects/p%d/src/module%d/file%d.c", i % 97, i % 1013, i);
+    fileEntry_t* entry = make_entry(name, 1000 + i % 50000, 1434000000UL + i);
+    if (d >= 0 && d < diffNum && d % 3 == 0) entry -> timestamp += 60;
+    tail -> next = entry;
+    tail = entry;
+  }
+  for (i = 0; i < diffNum; i++) {
+    if (i % 3 != 2) continue;
+    snprintf(name, sizeof(name), "projects/new/file%d.c", i);
+    fileEntry_t* entry = make_entry(name, 10, 1435000000UL);
+    tail -> next = entry;
+    tail = entry;
+  }
+  tail -> next = NULL;
+  return dummy.next;
+}
+
+/* tracker.c's syncFileEntry */
+static int sync_entry(fileTable_t* table, changeLog_t* log, fileEntry_t* entry, int peerId) {
+  fileEntry_t* res = filetable_searchFileByName(table, entry -> file_name);
+  if (res == NULL) {
+    fileEntry_t* newEntry = (fileEntry_t*) malloc(sizeof(fileEntry_t));
+    memcpy(newEntry, entry, sizeof(fileEntry_t));
+    newEntry -> next = NULL;
+    newEntry -> holders = NULL;
+    newEntry -> peerNum = 0;
+    filetable_addHolder(newEntry, peerId, table -> filetable_mutex);
+    filetable_appendFileEntry(table, newEntry);
+    changelog_record(log, DELTA_ADD, entry -> file_name);
+    return 1;
+  }
+  if (entry -> timestamp > res -> timestamp) {
+    filetable_updateFile(res, entry, table -> filetable_mutex);
+    changelog_record(log, DELTA_MODIFY, entry -> file_name);
+    return 1;
+  }
+  if (entry -> timestamp == res -> timestamp) {
+    if (filetable_addHolder(res, peerId, table -> filetable_mutex) > 0) {
+      changelog_record(log, DELTA_MODIFY, entry -> file_name);
+      return 1;
+    }
+    return -1;
+  }
+  changelog_record(log, DELTA_MODIFY, entry -> file_name);
+  return 1;
+}
+
+/* the nested lookups handshake did before, the update's entries are consumed */
+static void reconcile_nested(fileTable_t* table, changeLog_t* log, fileEntry_t* update) {
+  fileTable_t* pktTable = filetable_init();
+  while (update != NULL) {
+    fileEntry_t* next = update -> next;
+    filetable_appendFileEntry(pktTable, update);
+    update = next;
+  }
+  fileEntry_t* iter;
+  for (iter = pktTable -> head; iter != NULL; iter = iter -> next) {
+    sync_entry(table, log, iter, 0);
+  }
+  fileSnapshot_t* snapshot = filetable_acquireSnapshot(table);
+  for (iter = snapshot -> head; iter != NULL; iter = iter -> next) {
+    if (filetable_searchFileByName(pktTable, iter -> file_name) == NULL && filetable_deleteFileEntryByName(table, iter -> file_name) > 0) {
+      changelog_record(log, DELTA_DELETE, iter -> file_name);
+    }
+  }
+  filetable_releaseSnapshot(snapshot);
+  filetable_destroy(pktTable);
+}
+
+/* the merge, tracker.c's applyChangeSet; tree is the tracker's, built here if NULL */
+static fileChangeSet_t* reconcile_merge(fileTable_t* table, changeLog_t* log, fileEntry_t* update, merkleTree_t* tree) {
+  int built = (tree == NULL);
+  fileSnapshot_t* snapshot = NULL;
+  if (built) {
+    snapshot = filetable_acquireSnapshot(table);
+    tree = merkle_build(snapshot -> head);
+  }
+  merkleTree_t* pktTree = merkle_build(update);
+  fileChangeSet_t* set = filemerge_init();
+  filemerge_diff(set, pktTree, tree, MERKLE_ROOT, 0);
+  int i;
+  for (i = 0; i < set -> size; i++) {
+    fileEntry_t* entry = set -> changes[i].entry;
+    if (set -> changes[i].op == FILEMERGE_DELETED) {
+      if (filetable_deleteFileEntryByName(table, entry -> file_name) > 0) {
+        changelog_record(log, DELTA_DELETE, entry -> file_name);
+      }
+    } else {
+      sync_entry(table, log, entry, 0);
+    }
+  }
+  merkle_destroy(pktTree);
+  if (built) {
+    merkle_destroy(tree);
+    filetable_releaseSnapshot(snapshot);
+  }
+  free_list(update);
+  return set;
+}
+
+
+int main(int argc, char* argv[]) {
+  int fileNum = 100000;
+  int diffNum = 100;
+  int runs = 5;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:d:r:h")) != -1) {
+    switch (opt) {
+      case 'n': fileNum = atoi(optarg); break;
+      case 'd': diffNum = atoi(optarg); break;
+      case 'r': runs = atoi(optarg); break;
+      default:
+        printf("usage: %s [-n files (100000)] [-d differences (100)] [-r runs (5)]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (fileNum <= 0 || diffNum < 0 || diffNum > fileNum || runs <= 0) {
+    printf("%s: error: %d files, %d differences, %d runs\n", __func__, fileNum, diffNum, runs);
+    return 1;
+  }
+
+  double nested = 0, warm = 0, cold = 0;
+  unsigned long epochs[3] = {0, 0, 0};
+  int sizes[3] = {0, 0, 0};
+  fileChangeSet_t* last = NULL;
+  int r, way;
+  for (r = 0; r < runs; r++) {
+    for (way = 0; way < 3; way++) {
+      fileTable_t* table = make_tracker(fileNum);
+      changeLog_t* log = changelog_init(BENCH_LOG_CAP);
+      fileEntry_t* update = make_update(fileNum, diffNum);
+      fileSnapshot_t* snapshot = filetable_acquireSnapshot(table);
+      merkleTree_t* tree = (way == 1) ? merkle_build(snapshot -> head) : NULL;
+
+      double start = now_ms();
+      if (way == 0) {
+        reconcile_nested(table, log, update);
+      } else {
+        filemerge_destroy(last);
+        last = reconcile_merge(table, log, update, tree);
+      }
+      double took = now_ms() - start;
+      if (way == 0) nested += took;
+      if (way == 1) warm += took;
+      if (way == 2) cold += took;
+
+      epochs[way] = changelog_getEpoch(log);
+      sizes[way] = table -> size;
+      merkle_destroy(tree);
+      filetable_releaseSnapshot(snapshot);
+      changelog_destroy(log);
+      filetable_destroy(table);
+    }
+    //every way makes the same changes
+    assert(epochs[0] == epochs[1] && epochs[1] == epochs[2]);
+    assert(sizes[0] == sizes[1] && sizes[1] == sizes[2]);
+  }
+
+  printf("%d files, %d differences: %d added, %d updated, %d holders, %d stale, %d deleted, %d unchanged\n", fileNum, diffNum,
+    last -> counts[FILEMERGE_ADDED], last -> counts[FILEMERGE_UPDATED], last -> counts[FILEMERGE_HOLDER],
+    last -> counts[FILEMERGE_STALE], last -> counts[FILEMERGE_DELETED], last -> same);
+  printf("nested lookups:       %8.2fms\n", nested / runs);
+  printf("merge, tree cached:   %8.2fms (%.1fx)\n", warm / runs, nested / warm);
+  printf("merge, tree built:    %8.2fms (%.1fx)\n", cold / runs, nested / cold);
+  filemerge_destroy(last);
+  return 0;
+}
@@ -0,0 +1,291 @@
+//File: filemerge_test.c
+
+//Description: File that unit tests the functions in filemerge.c
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -ggdb -pthread -o test filemerge_test.c ../common/filemerge.c ../common/merkle.c ../common/filetable.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../common/filemerge.h"
+#include "../common/peerid.h"
+
+
+#define TABLE_SIZE 3000
+#define PEER_ID 5
+
+
+static fileEntry_t* make_entry(const char* name, int size, unsigned long timestamp) {
+  fileEntry_t* entry = (fileEntry_t*) calloc(1, sizeof(fileEntry_t));
+  snprintf(entry -> file_name, FILE_NAME_MAX_LEN, "%s", name);
+  entry -> size = size;
+  entry -> timestamp = timestamp;
+  return entry;
+}
+
+/* the op file n of the tables below is expected to get: every seventh file differs in a way of its own */
+static int expected_op(int n) {
+  switch (n % 7) {
+    case 1: return FILEMERGE_UPDATED;
+    case 2: return FILEMERGE_STALE;
+    case 3: return FILEMERGE_HOLDER;
+    case 4: return FILEMERGE_DELETED;
+    default: return -1;
+  }
+}
+
+/* the tracker's table: files 0 .. TABLE_SIZE - 1, held by the peer but for the HOLDER ones */
+static fileTable_t* make_tracker(void) {
+  fileTable_t* table = filetable_init();
+  char name[FILE_NAME_MAX_LEN];
+  int n;
+  for (n = 0; n < TABLE_SIZE; n++) {
+    snprintf(name, sizeof(name), "dir%d/file%d.txt", n % 37, n);
+    fileEntry_t* entry = make_entry(name, n, 1000 + n);
+    if (expected_op(n) != FILEMERGE_HOLDER) {
+      filetable_addHolder(entry, PEER_ID, table -> filetable_mutex);
+    }
+    filetable_addHolder(entry, PEER_ID + 1, table -> filetable_mutex);
+    filetable_appendFileEntry(table, entry);
+  }
+  return table;
+}
+
+/* the peer's table: the same files, backwards, newer or older for some, without the DELETED ones, and TABLE_SIZE / 10 new files */
+static fileTable_t* make_peer(void) {
+  fileTable_t* table = filetable_init();
+  char name[FILE_NAME_MAX_LEN];
+  int n;
+  for (n = TABLE_SIZE - 1; n >= 0; n--) {
+    int op = expected_op(n);
+    if (op == FILEMERGE_DELETED) continue;
+    snprintf(name, sizeof(name), "dir%d/file%d.txt", n % 37, n);
+    unsigned long timestamp = 1000 + n;
+    if (op == FILEMERGE_UPDATED) timestamp += 5;
+    if (op == FILEMERGE_STALE) timestamp -= 5;
+    filetable_appendFileEntry(table, make_entry(name, n, timestamp));
+  }
+  for (n = 0; n < TABLE_SIZE / 10; n++) {
+    snprintf(name, sizeof(name), "new/file%d.txt", n);
+    filetable_appendFileEntry(table, make_entry(name, n, 5000));
+  }
+  return table;
+}
+
+
+
+void test_filemerge_diff() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filemerge_diff");
+
+  fileTable_t* tracker = make_tracker();
+  fileTable_t* peer = make_peer();
+  merkleTree_t* ours = merkle_build(tracker -> head);
+  merkleTree_t* theirs = merkle_build(peer -> head);
+
+  //every file once, in one change or counted as the same
+  fileChangeSet_t* set = filemerge_init();
+  filemerge_diff(set, theirs, ours, MERKLE_ROOT, PEER_ID);
+  int expected[FILEMERGE_OP_NUM] = {0};
+  int n, i;
+  for (n = 0; n < TABLE_SIZE; n++) {
+    if (expected_op(n) >= 0) expected[expected_op(n)]++;
+  }
+  expected[FILEMERGE_ADDED] = TABLE_SIZE / 10;
+  for (i = 0; i < FILEMERGE_OP_NUM; i++) {
+    assert(set -> counts[i] == expected[i]);
+  }
+  assert(set -> size == expected[0] + expected[1] + expected[2] + expected[3] + expected[4]);
+  assert(set -> same == TABLE_SIZE - expected[FILEMERGE_UPDATED] - expected[FILEMERGE_STALE] - expected[FILEMERGE_HOLDER] - expected[FILEMERGE_DELETED]);
+
+  //each change is the right one, about the right side's entry, in name hash order
+  unsigned long last = 0;
+  for (i = 0; i < set -> size; i++) {
+    fileChange_t* change = &(set -> changes[i]);
+    unsigned long key = merkle_nameHash(change -> entry -> file_name);
+    assert(key >= last);
+    last = key;
+    if (change -> op == FILEMERGE_ADDED) {
+      assert(strncmp(change -> entry -> file_name, "new/", 4) == 0);
+      assert(filetable_searchFileByName(peer, change -> entry -> file_name) == change -> entry);
+      continue;
+    }
+    sscanf(strchr(change -> entry -> file_name, '/'), "/file%d.txt", &n);
+    assert(change -> op == expected_op(n));
+    fileTable_t* side = (change -> op == FILEMERGE_DELETED) ? tracker : peer;
+    assert(filetable_searchFileByName(side, change -> entry -> file_name) == change -> entry);
+  }
+  filemerge_destroy(set);
+
+  //a connection without a peer id is never made a holder
+  set = filemerge_init();
+  filemerge_diff(set, theirs, ours, MERKLE_ROOT, PEERID_NONE);
+  assert(set -> counts[FILEMERGE_HOLDER] == 0);
+  assert(set -> size == expected[0] + expected[1] + expected[3] + expected[4]);
+  filemerge_destroy(set);
+
+  //the same tables agree on everything
+  set = filemerge_init();
+  filemerge_diff(set, ours, ours, MERKLE_ROOT, PEER_ID + 1);
+  assert(set -> size == 0 && set -> same == TABLE_SIZE);
+  filemerge_destroy(set);
+
+  //against an empty table: everything added, or everything deleted
+  merkleTree_t* empty = merkle_build(NULL);
+  set = filemerge_init();
+  filemerge_diff(set, theirs, empty, MERKLE_ROOT, PEER_ID);
+  assert(set -> size == theirs -> size && set -> counts[FILEMERGE_ADDED] == theirs -> size);
+  filemerge_destroy(set);
+  set = filemerge_init();
+  filemerge_diff(set, empty, ours, MERKLE_ROOT, PEER_ID);
+  assert(set -> size == TABLE_SIZE && set -> counts[FILEMERGE_DELETED] == TABLE_SIZE);
+  filemerge_destroy(set);
+  merkle_destroy(empty);
+
+  merkle_destroy(ours);
+  merkle_destroy(theirs);
+  filetable_destroy(tracker);
+  filetable_destroy(peer);
+  printf("SUCCESS!!\n");
+}
+
+void test_filemerge_nodes() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filemerge_diff (one node)");
+
+  fileTable_t* tracker = make_tracker();
+  fileTable_t* peer = make_peer();
+  merkleTree_t* ours = merkle_build(tracker -> head);
+  merkleTree_t* theirs = merkle_build(peer -> head);
+  fileChangeSet_t* whole = filemerge_init();
+  filemerge_diff(whole, theirs, ours, MERKLE_ROOT, PEER_ID);
+
+  //the children of the root split the changes between them, in the same order
+  fileChangeSet_t* set = filemerge_init();
+  int c, i;
+  for (c = 0; c < MERKLE_FANOUT; c++) {
+    unsigned long child = merkle_nodeId(1, c);
+    int before = set -> size;
+    filemerge_diff(set, theirs, ours, child, PEER_ID);
+    for (i = before; i < set -> size; i++) {
+      assert(merkle_contains(child, set -> changes[i].entry -> file_name));
+    }
+  }
+  assert(set -> size == whole -> size && set -> same == whole -> same);
+  for (i = 0; i < set -> size; i++) {
+    assert(set -> changes[i].op == whole -> changes[i].op && set -> changes[i].entry == whole -> changes[i].entry);
+  }
+  filemerge_destroy(set);
+  filemerge_destroy(whole);
+
+  merkle_destroy(ours);
+  merkle_destroy(theirs);
+  filetable_destroy(tracker);
+  filetable_destroy(peer);
+  printf("SUCCESS!!\n");
+}
+
+void test_filemerge_collisions() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filemerge_diff (colliding name hashes)");
+
+  //64 bit collisions are not found by chance, the trees are made up with every key equal
+  fileEntry_t* a = make_entry("a", 1, 10);
+  fileEntry_t* b = make_entry("b", 1, 10);
+  fileEntry_t* bNewer = make_entry("b", 1, 20);
+  fileEntry_t* c = make_entry("c", 1, 10);
+  unsigned long keys[2] = {42, 42};
+  unsigned long sums[3] = {0, 0, 0};
+  fileEntry_t* theirEntries[2] = {bNewer, a};
+  fileEntry_t* ourEntries[2] = {b, c};
+  merkleTree_t theirs = {2, keys, sums, theirEntries, 0};
+  merkleTree_t ours = {2, keys, sums, ourEntries, 0};
+
+  fileChangeSet_t* set = filemerge_init();
+  filemerge_diff(set, &theirs, &ours, MERKLE_ROOT, PEER_ID);
+  assert(set -> size == 3);
+  assert(set -> changes[0].op == FILEMERGE_UPDATED && set -> changes[0].entry == bNewer);
+  assert(set -> changes[1].op == FILEMERGE_ADDED && set -> changes[1].entry == a);
+  assert(set -> changes[2].op == FILEMERGE_DELETED && set -> changes[2].entry == c);
+  filemerge_destroy(set);
+
+  free(a);
+  free(b);
+  free(bNewer);
+  free(c);
+  printf("SUCCESS!!\n");
+}
+
+void test_filemerge_held() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filemerge_held (a peer reconnecting with unchanged files)");
+
+  //the peer disconnected: it is no longer a holder of anything, its files did not change meanwhile
+  fileTable_t* tracker = make_tracker();
+  filetable_deleteHolderFromAllEntries(tracker, PEER_ID);
+  fileTable_t* peer = filetable_init();
+  fileEntry_t* iter;
+  for (iter = tracker -> head; iter != NULL; iter = iter -> next) {
+    filetable_appendFileEntry(peer, make_entry(iter -> file_name, iter -> size, iter -> timestamp));
+  }
+  merkleTree_t* ours = merkle_build(tracker -> head);
+  merkleTree_t* theirs = merkle_build(peer -> head);
+
+  //the roots agree, so the exchange settles nothing: only the agreeing node tells the peer holds every file
+  merkleNode_t root;
+  merkle_node(theirs, MERKLE_ROOT, &root);
+  assert(merkle_agrees(ours, &root));
+  fileChangeSet_t* set = filemerge_init();
+  filemerge_held(set, ours, MERKLE_ROOT, PEER_ID);
+  assert(set -> size == TABLE_SIZE && set -> counts[FILEMERGE_HOLDER] == TABLE_SIZE && set -> same == 0);
+  int i;
+  for (i = 0; i < set -> size; i++) {
+    assert(filetable_searchFileByName(tracker, set -> changes[i].entry -> file_name) == set -> changes[i].entry);
+    filetable_addHolder(set -> changes[i].entry, PEER_ID, tracker -> filetable_mutex);
+  }
+  filemerge_destroy(set);
+
+  //listed again: nothing left to do, the same as a full merge finds
+  set = filemerge_init();
+  filemerge_held(set, ours, MERKLE_ROOT, PEER_ID);
+  assert(set -> size == 0 && set -> same == TABLE_SIZE);
+  filemerge_destroy(set);
+  set = filemerge_init();
+  filemerge_diff(set, theirs, ours, MERKLE_ROOT, PEER_ID);
+  assert(set -> size == 0 && set -> same == TABLE_SIZE);
+  filemerge_destroy(set);
+
+  //one node only, and never for a connection without a peer id
+  unsigned long child = merkle_nodeId(1, 3);
+  int num;
+  merkle_nodeEntries(ours, child, &num);
+  set = filemerge_init();
+  filemerge_held(set, ours, child, PEER_ID + 2);
+  assert(set -> size == num);
+  for (i = 0; i < set -> size; i++) {
+    assert(merkle_contains(child, set -> changes[i].entry -> file_name));
+  }
+  filemerge_destroy(set);
+  set = filemerge_init();
+  filemerge_held(set, ours, MERKLE_ROOT, PEERID_NONE);
+  assert(set -> size == 0);
+  filemerge_destroy(set);
+
+  merkle_destroy(ours);
+  merkle_destroy(theirs);
+  filetable_destroy(tracker);
+  filetable_destroy(peer);
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions for merging file tables.
+int main() {
+  test_filemerge_diff();
+  test_filemerge_nodes();
+  test_filemerge_collisions();
+  test_filemerge_held();
+  return 0;
+}
@@ -0,0 +1,94 @@
+//File: filetable_bench.c
+
+//Description: Micro-benchmark of file table lookups by name.  Builds tables of 10k, 100k and 1M
+// entries and times hits, misses, deletes and re-appends through the name index.  A sample of
+// linear list walks (filetable_searchFileByNameWithoutMutex) is timed for comparison.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -O2 -pthread -o filetable_bench filetable_bench.c ../common/filetable.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <assert.h>
+
+#include "../common/filetable.h"
+
+#define LINEAR_SAMPLES 200
+
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static fileEntry_t* create_entry(char* filename, int size) {
+  fileEntry_t* entry = calloc(1, sizeof(fileEntry_t));
+  entry -> size = size;
+  strcpy(entry -> file_name, filename);
+  entry -> timestamp = (unsigned) time(NULL);
+  return entry;
+}
+
+static void bench_table(int num) {
+  char name[FILE_NAME_MAX_LEN];
+  fileTable_t* table = filetable_init();
+  int i;
+  double t;
+
+  t = now_ns();
+  for (i = 0; i < num; i++) {
+    sprintf(name, "dir%d/file%d.txt", i % 97, i);
+    filetable_appendFileEntry(table, create_entry(name, i));
+  }
+  double appendNs = (now_ns() - t) / num;
+
+  //look every file up in a scrambled order so the list order does not help
+  t = now_ns();
+  for (i = 0; i < num; i++) {
+    int k = (int)(((long long) i * 7919) % num);
+    sprintf(name, "dir%d/file%d.txt", k % 97, k);
+    fileEntry_t* file = filetable_searchFileByName(table, name);
+    assert(file != NULL && file -> size == k);
+  }
+  double hitNs = (now_ns() - t) / num;
+
+  t = now_ns();
+  for (i = 0; i < num; i++) {
+    sprintf(name, "missing/file%d.txt", i);
+    assert(filetable_searchFileByName(table, name) == NULL);
+  }
+  double missNs = (now_ns() - t) / num;
+
+  t = now_ns();
+  for (i = 0; i < LINEAR_SAMPLES; i++) {
+    int k = (int)(((long long) i * 7919) % num);
+    sprintf(name, "dir%d/file%d.txt", k % 97, k);
+    assert(filetable_searchFileByNameWithoutMutex(table -> head, name) != NULL);
+  }
+  double linearNs = (now_ns() - t) / LINEAR_SAMPLES;
+
+  //delete and re-add half of the table, the pattern of a tracker reconciling updates
+  t = now_ns();
+  for (i = 0; i < num; i += 2) {
+    sprintf(name, "dir%d/file%d.txt", i % 97, i);
+    assert(filetable_deleteFileEntryByName(table, name) == 1);
+    filetable_appendFileEntry(table, create_entry(name, i));
+  }
+  double churnNs = (now_ns() - t) / ((num + 1) / 2);
+
+  printf("%8d entries: append %6.0fns  hit %6.0fns  miss %6.0fns  delete+append %6.0fns  | linear walk %10.0fns\n",
+      num, appendNs, hitNs, missNs, churnNs, linearNs);
+
+  filetable_destroy(table);
+}
+
+int main() {
+  bench_table(10000);
+  bench_table(100000);
+  bench_table(1000000);
+  return 0;
+}
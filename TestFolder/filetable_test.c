@@ -25,6 +25,9 @@
 #include <assert.h>
 
 #include "../common/filetable.h"
+#include "../common/peerid.h"
+
+#define MOCK_HOLDER_NUM 5000   // holders of one file, far more than the sets start with room for
 
 
 
@@ -37,6 +40,7 @@ fileEntry_t* create_mock_file_entry(char* filename, int size){
   entry -> timestamp = (unsigned)time(NULL);
   entry -> next = NULL;
   entry -> peerNum = 0;
+  entry -> holders = NULL;
   return entry;
 }
 
@@ -47,22 +51,13 @@ entries.  test1.txt is the head and test3.txt is the tail.
 */
 
 fileTable_t* createMockFileTable() {
-	fileTable_t* tablePtr = (fileTable_t*) malloc(sizeof(fileTable_t));
-	tablePtr -> head = NULL;
-	tablePtr -> tail = NULL;
-	tablePtr -> size = 0;
-
-	//create the mutex for the table
-	pthread_mutex_t* mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
-	pthread_mutex_init(mutex, NULL);
-	tablePtr -> filetable_mutex = mutex;
+	//the table keeps a name index next to the list, so build it through the API
+	fileTable_t* tablePtr = filetable_init();
 
   //add the mock test files
-  tablePtr -> head = create_mock_file_entry("test1.txt", 12345);
-  tablePtr -> head -> next = create_mock_file_entry("test2.txt", 6789);
-  tablePtr -> head -> next -> next = create_mock_file_entry("test3.txt", 1111111);
-  tablePtr -> tail = tablePtr -> head -> next -> next;
-  tablePtr -> size = 3;
+  filetable_appendFileEntry(tablePtr, create_mock_file_entry("test1.txt", 12345));
+  filetable_appendFileEntry(tablePtr, create_mock_file_entry("test2.txt", 6789));
+  filetable_appendFileEntry(tablePtr, create_mock_file_entry("test3.txt", 1111111));
   return tablePtr;
 }
 
@@ -187,15 +182,7 @@ void test_filetable_appendFileEntry() {
   printf("Function: %s\n", "filetable_appendFileEntry");
 
   //create empty filetable
-  fileTable_t* tablePtr = (fileTable_t*) malloc(sizeof(fileTable_t));
-  tablePtr -> head = NULL;
-  tablePtr -> tail = NULL;
-  tablePtr -> size = 0;
-  
-  //create the mutex for the table
-  pthread_mutex_t* mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
-  pthread_mutex_init(mutex, NULL);
-  tablePtr -> filetable_mutex = mutex;
+  fileTable_t* tablePtr = filetable_init();
 
   //Test add files to an empty table
   assert(tablePtr -> head == NULL);
@@ -270,113 +257,255 @@ void test_filetable_updateFile() {
   printf("SUCCESS\n");
 }
 
-void test_filetable_AddIp2Iplist() {
+void test_filetable_addHolder() {
   printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
-  printf("Function: %s\n", "filetable_AddIp2Iplist");
+  printf("Function: %s\n", "filetable_addHolder");
 
   fileTable_t* filetable = createMockFileTable();
   fileEntry_t* entry = filetable -> head;
 
   assert(entry -> peerNum == 0);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.1", filetable -> filetable_mutex) == 1);
+  assert(filetable_addHolder(entry, 1, filetable -> filetable_mutex) == 1);
   assert(entry -> peerNum == 1);
-  printf("Successfully added an ip address to the list.\n");
+  assert(filetable_hasHolder(entry, 1) && !filetable_hasHolder(entry, 0));
+  printf("Successfully added a holder.\n");
 
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.1", filetable -> filetable_mutex) == -1);
+  assert(filetable_addHolder(entry, 1, filetable -> filetable_mutex) == -1);
   assert(entry -> peerNum == 1);
-  printf("Successfully did not add a duplicate ip address to the list.\n");
-
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.2", filetable -> filetable_mutex) == 1);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.3", filetable -> filetable_mutex) == 1);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.4", filetable -> filetable_mutex) == 1);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.5", filetable -> filetable_mutex) == 1);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.6", filetable -> filetable_mutex) == 1);
-  assert(entry -> peerNum == 6);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.7", filetable -> filetable_mutex) == 1);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.8", filetable -> filetable_mutex) == 1);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.9", filetable -> filetable_mutex) == 1);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.10", filetable -> filetable_mutex) == 1);
-  assert(entry -> peerNum == 10);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.11", filetable -> filetable_mutex) == -1);
-  assert(entry -> peerNum == 10);
+  printf("Successfully did not add a duplicate holder.\n");
+
+  //far past the old limit of 1024 holders, the set grows with the ids
+  int id;
+  for (id = 2; id < MOCK_HOLDER_NUM; id++) {
+    assert(filetable_addHolder(entry, id, filetable -> filetable_mutex) == 1);
+  }
+  assert(entry -> peerNum == MOCK_HOLDER_NUM - 1);
+  assert(entry -> holders -> words * FILETABLE_HOLDER_BITS >= MOCK_HOLDER_NUM);
+  assert(filetable_hasHolder(entry, MOCK_HOLDER_NUM - 1) && !filetable_hasHolder(entry, MOCK_HOLDER_NUM));
+  assert(filetable_addHolder(entry, PEERID_NONE, filetable -> filetable_mutex) == -1);
+  assert(entry -> peerNum == MOCK_HOLDER_NUM - 1);
+  assert(filetable_hasHolder(filetable -> tail, 1) == 0 && filetable -> tail -> holders == NULL);
   filetable_destroy(filetable);
-  printf("Successfully did not add over the max number of entries.\n");
+  printf("Successfully added %d holders and rejected ids out of range.\n", MOCK_HOLDER_NUM - 1);
 
   printf("SUCCESS!!\n");
 }
 
-void test_filetable_deleteIpfromIplist() {
+void test_filetable_nextHolder() {
   printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
-  printf("Function: %s\n", "filetable_deleteIpfromIplist");
+  printf("Function: %s\n", "filetable_nextHolder");
+
+  fileTable_t* filetable = createMockFileTable();
+  fileEntry_t* entry = filetable -> head;
+  assert(filetable_nextHolder(entry, 0) == -1);
+
+  int ids[] = {0, 5, 63, 64, 200, MOCK_HOLDER_NUM - 1};
+  int num = sizeof(ids) / sizeof(ids[0]);
+  int i;
+  for (i = num - 1; i >= 0; i--) {
+    assert(filetable_addHolder(entry, ids[i], filetable -> filetable_mutex) == 1);
+  }
+
+  //holders come back in id order
+  int id;
+  i = 0;
+  for (id = filetable_nextHolder(entry, 0); id >= 0; id = filetable_nextHolder(entry, id + 1)) {
+    assert(id == ids[i++]);
+  }
+  assert(i == num);
+  assert(filetable_nextHolder(entry, 65) == 200);
+  assert(filetable_nextHolder(entry, 201) == MOCK_HOLDER_NUM - 1);
+  assert(filetable_nextHolder(entry, MOCK_HOLDER_NUM) == -1);
+  filetable_destroy(filetable);
+  printf("Successfully walked holders across words.\n");
+
+  printf("SUCCESS!!\n");
+}
+
+void test_filetable_deleteHolder() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filetable_deleteHolder");
 
   fileTable_t* filetable = createMockFileTable();
   fileEntry_t* entry = filetable -> head;
   
   //Add Things to the Table to Delete Them
-  assert(filetable_AddIp2Iplist(entry, "123.123.123.123", filetable -> filetable_mutex) == 1);
+  assert(filetable_addHolder(entry, 3, filetable -> filetable_mutex) == 1);
   assert(entry -> peerNum == 1);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.2", filetable -> filetable_mutex) == 1);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.4", filetable -> filetable_mutex) == 1);
-  assert(filetable_AddIp2Iplist(entry, "127.110.110.444", filetable -> filetable_mutex) == 1);
+  assert(filetable_addHolder(entry, 7, filetable -> filetable_mutex) == 1);
+  assert(filetable_addHolder(entry, 70, filetable -> filetable_mutex) == 1);
+  assert(filetable_addHolder(entry, 700, filetable -> filetable_mutex) == 1);
   
-  //Try deleting and adding to the tail.
   assert(entry -> peerNum == 4);
-  assert(filetable_deleteIpfromIplist(entry, "127.110.110.444", filetable -> filetable_mutex) == 1);
+  assert(filetable_deleteHolder(entry, 700, filetable -> filetable_mutex) == 1);
   assert(entry -> peerNum == 3);
-  assert(filetable_AddIp2Iplist(entry, "143.0.0.1", filetable -> filetable_mutex) == 1);
+  assert(!filetable_hasHolder(entry, 700));
+  assert(filetable_addHolder(entry, 700, filetable -> filetable_mutex) == 1);
   assert(entry -> peerNum == 4);
-  assert(filetable_deleteIpfromIplist(entry, "143.0.0.1", filetable -> filetable_mutex) == 1);
+  assert(filetable_deleteHolder(entry, 700, filetable -> filetable_mutex) == 1);
   assert(entry -> peerNum == 3);
-  printf("Successfully deleted, added and deleted from the last element in the ip list.\n");
+  printf("Successfully deleted, added and deleted a holder.\n");
 
-
-  //Try deleting an early element and seeing if correctly moves the ip.
-  assert(filetable_deleteIpfromIplist(entry, "123.123.123.123", filetable -> filetable_mutex) == 1);
-  assert(entry -> peerNum == 2);
-  assert(filetable_deleteIpfromIplist(entry, "123.123.123.123", filetable -> filetable_mutex) == -1);
+  assert(filetable_deleteHolder(entry, 3, filetable -> filetable_mutex) == 1);
   assert(entry -> peerNum == 2);
-  assert(filetable_deleteIpfromIplist(entry, "127.0.0.2", filetable -> filetable_mutex) == 1);
-  assert(entry -> peerNum == 1);
-  assert(filetable_AddIp2Iplist(entry, "127.0.0.2", filetable -> filetable_mutex) == 1);
+  assert(filetable_deleteHolder(entry, 3, filetable -> filetable_mutex) == -1);
   assert(entry -> peerNum == 2);
+  assert(filetable_hasHolder(entry, 7) && filetable_hasHolder(entry, 70));
+  printf("Successfully failed to delete a holder twice, the others are untouched.\n");
+
+  //the set goes with the last holder
+  assert(filetable_deleteHolder(entry, 7, filetable -> filetable_mutex) == 1);
+  assert(filetable_deleteHolder(entry, 70, filetable -> filetable_mutex) == 1);
+  assert(entry -> peerNum == 0 && entry -> holders == NULL);
+  assert(filetable_nextHolder(entry, 0) == -1);
   filetable_destroy(filetable);
-  printf("Successfully failed to delete something after being deleted and updated ip list after removal.\n");
+  printf("Successfully dropped the set with the last holder.\n");
 
   printf("SUCCESS!!\n");
 }
 
-void test_filetable_deleteIpfromAllEntries(){
+void test_filetable_deleteHolderFromAllEntries(){
   printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
-  printf("Function: %s\n", "filetable_deleteIpfromAllEntries");
+  printf("Function: %s\n", "filetable_deleteHolderFromAllEntries");
 
   fileTable_t* filetable = createMockFileTable();
   
   fileEntry_t* entry = filetable -> head;
   while (entry != NULL) {
     //Add Things to the Table to Delete Them
-    assert(filetable_AddIp2Iplist(entry, "123.123.123.123", filetable -> filetable_mutex) == 1);
-    assert(filetable_AddIp2Iplist(entry, "127.0.0.2", filetable -> filetable_mutex) == 1);
-    assert(filetable_AddIp2Iplist(entry, "127.0.1.0", filetable -> filetable_mutex) == 1);
+    assert(filetable_addHolder(entry, 12, filetable -> filetable_mutex) == 1);
+    assert(filetable_addHolder(entry, 2, filetable -> filetable_mutex) == 1);
+    assert(filetable_addHolder(entry, 900, filetable -> filetable_mutex) == 1);
     assert(entry -> peerNum == 3);
     entry = entry -> next;
   }
   
-  assert(filetable_deleteIpfromAllEntries(filetable, "123.1.1.1") == -1);
-  printf("Successfully tested nothing deleted for bad ip\n");
+  assert(filetable_deleteHolderFromAllEntries(filetable, 13) == -1);
+  printf("Successfully tested nothing deleted for a peer holding nothing\n");
 
-  assert(filetable_deleteIpfromAllEntries(filetable, "123.123.123.123") == 1);
+  assert(filetable_deleteHolderFromAllEntries(filetable, 12) == 1);
   entry = filetable -> head;
   while (entry != NULL) {
-    assert(entry -> peerNum == 2);
+    assert(entry -> peerNum == 2 && !filetable_hasHolder(entry, 12));
     entry = entry -> next;
   }
-  assert(filetable_deleteIpfromAllEntries(filetable, "123.123.123.123") == -1);
+  assert(filetable_deleteHolderFromAllEntries(filetable, 12) == -1);
   filetable_destroy(filetable);
-  printf("Successfully deleted IP from all IP lists.\n");
+  printf("Successfully deleted the peer from all holders.\n");
 }
 
 
 
+void test_filetable_nameIndex() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filetable name index");
+
+  fileTable_t* filetable = filetable_init();
+  char name[FILE_NAME_MAX_LEN];
+  int i;
+
+  //Grow the index well past its initial capacity
+  for (i = 0; i < 1000; i++) {
+    sprintf(name, "file%d.txt", i);
+    filetable_appendFileEntry(filetable, create_mock_file_entry(name, i));
+  }
+  assert(filetable -> size == 1000);
+  for (i = 0; i < 1000; i++) {
+    sprintf(name, "file%d.txt", i);
+    fileEntry_t* file = filetable_searchFileByName(filetable, name);
+    assert(file != NULL && file -> size == i);
+  }
+  printf("Successfully found every file after growing the index.\n");
+
+  //Delete every other file, the rest must still be found and the order kept
+  for (i = 0; i < 1000; i += 2) {
+    sprintf(name, "file%d.txt", i);
+    assert(filetable_deleteFileEntryByName(filetable, name) == 1);
+    assert(filetable_deleteFileEntryByName(filetable, name) == -1);
+  }
+  assert(filetable -> size == 500);
+  fileEntry_t* iter = filetable -> head;
+  for (i = 1; i < 1000; i += 2) {
+    sprintf(name, "file%d.txt", i);
+    assert(iter != NULL && strcmp(iter -> file_name, name) == 0);
+    assert(filetable_searchFileByName(filetable, name) == iter);
+    iter = iter -> next;
+  }
+  assert(iter == NULL);
+  printf("Successfully kept order and lookups after deletions.\n");
+
+  //Re-adding deleted names reuses tombstoned slots
+  for (i = 0; i < 1000; i += 2) {
+    sprintf(name, "file%d.txt", i);
+    assert(filetable_searchFileByName(filetable, name) == NULL);
+    filetable_appendFileEntry(filetable, create_mock_file_entry(name, i));
+    assert(filetable_searchFileByName(filetable, name) == filetable -> tail);
+  }
+  assert(filetable -> size == 1000);
+  filetable_destroy(filetable);
+  printf("Successfully re-added deleted files.\n");
+
+  printf("SUCCESS!!\n");
+}
+
+void test_filetable_snapshot() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "filetable_publishSnapshotLocked / filetable_acquireSnapshot");
+
+  fileTable_t* filetable = createMockFileTable();
+
+  //a new table is published empty at version 0
+  fileSnapshot_t* empty = filetable_acquireSnapshot(filetable);
+  assert(empty -> epoch == 0 && empty -> size == 0 && empty -> head == NULL);
+  assert(filetable_searchSnapshot(empty, "test1.txt") == NULL);
+
+  pthread_mutex_lock(filetable -> filetable_mutex);
+  filetable_publishSnapshotLocked(filetable, 7);
+  pthread_mutex_unlock(filetable -> filetable_mutex);
+
+  //a reader still holding the old snapshot keeps it
+  assert(empty -> size == 0);
+  filetable_releaseSnapshot(empty);
+
+  fileSnapshot_t* snapshot = filetable_acquireSnapshot(filetable);
+  assert(snapshot -> epoch == 7 && snapshot -> size == 3);
+  assert(strcmp(snapshot -> head -> file_name, "test1.txt") == 0);
+  assert(strcmp(snapshot -> head -> next -> next -> file_name, "test3.txt") == 0);
+  assert(snapshot -> head -> next -> next -> next == NULL);
+  printf("Successfully published the table in order.\n");
+
+  //the snapshot does not see later changes
+  filetable_deleteFileEntryByName(filetable, "test2.txt");
+  fileEntry_t* entry = filetable_searchSnapshot(snapshot, "test2.txt");
+  assert(entry != NULL && entry -> size == 6789);
+  assert(entry != filetable_searchFileByName(filetable, "test2.txt"));
+  assert(filetable_searchSnapshot(snapshot, "test4.txt") == NULL);
+  printf("Successfully kept the snapshot stable while the table changed.\n");
+  filetable_releaseSnapshot(snapshot);
+
+  //holder sets are shared with the snapshot, changing them copies the table's own first
+  entry = filetable -> head;
+  assert(filetable_addHolder(entry, 3, filetable -> filetable_mutex) == 1);
+  pthread_mutex_lock(filetable -> filetable_mutex);
+  filetable_publishSnapshotLocked(filetable, 8);
+  pthread_mutex_unlock(filetable -> filetable_mutex);
+  snapshot = filetable_acquireSnapshot(filetable);
+  fileEntry_t* copy = filetable_searchSnapshot(snapshot, "test1.txt");
+  assert(copy -> holders == entry -> holders && entry -> holders -> refcount == 2);
+
+  assert(filetable_addHolder(entry, MOCK_HOLDER_NUM, filetable -> filetable_mutex) == 1);
+  assert(filetable_deleteHolder(entry, 3, filetable -> filetable_mutex) == 1);
+  assert(copy -> holders != entry -> holders && copy -> holders -> refcount == 1);
+  assert(copy -> peerNum == 1 && filetable_hasHolder(copy, 3) && !filetable_hasHolder(copy, MOCK_HOLDER_NUM));
+  assert(entry -> peerNum == 1 && filetable_hasHolder(entry, MOCK_HOLDER_NUM) && !filetable_hasHolder(entry, 3));
+  printf("Successfully copied a shared holder set before changing it.\n");
+
+  filetable_releaseSnapshot(snapshot);
+  filetable_destroy(filetable);
+  printf("SUCCESS!!\n");
+}
+
+
 //Main function to test all of the functions for the peer table.
 int main() {
 	test_filetable_init();
@@ -385,9 +514,12 @@ int main() {
   test_filetable_deleteFileEntryByName();
   test_filetable_appendFileEntry();
   test_filetable_updateFile();
-  test_filetable_AddIp2Iplist();
-  test_filetable_deleteIpfromIplist();
-  test_filetable_deleteIpfromAllEntries();
+  test_filetable_addHolder();
+  test_filetable_nextHolder();
+  test_filetable_deleteHolder();
+  test_filetable_deleteHolderFromAllEntries();
+  test_filetable_nameIndex();
+  test_filetable_snapshot();
 
   //DOES NOT TEST
   //filetable_printFileTable(fileTable_t* tablePtr)
@@ -0,0 +1,225 @@
+//File: merkle_bench.c
+
+//Description: Measures what a reconnecting peer and the tracker exchange to agree on a large shared table
+// (see merkle.c).  The tracker has N files held by a few peers, the peer has the same files but for D
+// differences (modified, deleted and added files, made while it was away).  Runs the Merkle exchange the way
+// tracker.c and peer.c do, every packet encoded and decoded with pkt.c, and compares the round trips and
+// bytes on the wire with the full exchange a REGISTER used to take (the whole table to the peer, the whole
+// table back as a FILEUPDATE).  Also times building the trees and answering every round.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -O2 -pthread -o merkle_bench merkle_bench.c ../common/merkle.c ../common/pkt.c ../common/filecodec.c ../common/peerid.c ../common/filedelta.c ../common/filetable.c
+
+//To run:
+// ./merkle_bench [-n files] [-d differences]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "../common/merkle.h"
+#include "../common/pkt.h"
+
+#define BENCH_HOLDERS 4   // peers holding every file of the tracker
+
+
+static double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static fileEntry_t* make_entry(const char* name, int size, unsigned long timestamp) {
+  fileEntry_t* entry = (fileEntry_t*) calloc(1, sizeof(fileEntry_t));
+  strncpy(entry -> file_name, name, FILE_NAME_MAX_LEN - 1);
+  entry -> size = size;
+  entry -> timestamp = timestamp;
+  return entry;
+}
+
+static void free_list(fileEntry_t* head) {
+  while (head != NULL) {
+    fileEntry_t* next = head -> next;
+    filetable_freeEntry(head);
+    head = next;
+  }
+}
+
+/* copies of the entries under the settled nodes of a packet, linked for the encoder */
+static fileEntry_t* settled_entries(merkleTree_t* tree, merkleNode_t* nodes, int num, int* size) {
+  fileEntry_t dummy;
+  dummy.next = NULL;
+  fileEntry_t* tail = &dummy;
+  *size = 0;
+  int i, j;
+  for (i = 0; i < num; i++) {
+    if (nodes[i].count != MERKLE_SETTLE) continue;
+    int entryNum;
+    fileEntry_t** entries = merkle_nodeEntries(tree, nodes[i].id, &entryNum);
+    for (j = 0; j < entryNum; j++) {
+      fileEntry_t* copy = (fileEntry_t*) malloc(sizeof(fileEntry_t));
+      memcpy(copy, entries[j], sizeof(fileEntry_t));
+      filetable_retainHolders(copy);
+      copy -> next = NULL;
+      tail -> next = copy;
+      tail = copy;
+      (*size)++;
+    }
+  }
+  return dummy.next;
+}
+
+
+int main(int argc, char* argv[]) {
+  int fileNum = 1000000;
+  int diffNum = 20;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:d:h")) != -1) {
+    switch (opt) {
+      case 'n': fileNum = atoi(optarg); break;
+      case 'd': diffNum = atoi(optarg); break;
+      default:
+        printf("usage: %s [-n files (1000000)] [-d differences (20)]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (fileNum <= 0 || diffNum < 0 || diffNum > fileNum) {
+    printf("%s: error: %d files, %d differences\n", __func__, fileNum, diffNum);
+    return 1;
+  }
+
+  //the tracker's table, every file held by a few peers
+  peerIdMap_t* ids = peerid_init();
+  int holders[BENCH_HOLDERS];
+  char ip[IP_LEN];
+  int i;
+  for (i = 0; i < BENCH_HOLDERS; i++) {
+    snprintf(ip, sizeof(ip), "10.0.%d.%d", i / 250, i % 250 + 1);
+    holders[i] = peerid_intern(ids, ip);
+  }
+  char name[FILE_NAME_MAX_LEN];
+  fileEntry_t trackerDummy, peerDummy;
+  fileEntry_t* trackerTail = &trackerDummy;
+  fileEntry_t* peerTail = &peerDummy;
+  for (i = 0; i < fileNum; i++) {
+    snprintf(name, sizeof(name), "projects/p%d/src/module%d/file%d.c", i % 97, i % 1013, i);
+    fileEntry_t* entry = make_entry(name, 1000 + i % 50000, 1434000000UL + i);
+    int h;
+    for (h = 0; h < BENCH_HOLDERS; h++) {
+      filetable_addHolderLocked(entry, holders[h]);
+    }
+    trackerTail -> next = entry;
+    trackerTail = entry;
+
+    //the peer's copy, a third of the differences are files it modified and a third files it deleted
+    int d = (diffNum > 0 && i % (fileNum / diffNum) == 0) ? i / (fileNum / diffNum) : -1;
+    if (d >= 0 && d < diffNum && d % 3 == 1) continue;
+    fileEntry_t* copy = make_entry(name, entry -> size, entry -> timestamp);
+    if (d >= 0 && d < diffNum && d % 3 == 0) copy -> timestamp += 60;
+    peerTail -> next = copy;
+    peerTail = copy;
+  }
+  //and the rest files it added
+  for (i = 0; i < diffNum; i++) {
+    if (i % 3 != 2) continue;
+    snprintf(name, sizeof(name), "projects/new/file%d.c", i);
+    fileEntry_t* copy = make_entry(name, 10, 1435000000UL);
+    peerTail -> next = copy;
+    peerTail = copy;
+  }
+  trackerTail -> next = NULL;
+  peerTail -> next = NULL;
+
+  double start = now_ms();
+  merkleTree_t* tracker = merkle_build(trackerDummy.next);
+  double trackerBuild = now_ms() - start;
+  start = now_ms();
+  merkleTree_t* peer = merkle_build(peerDummy.next);
+  double peerBuild = now_ms() - start;
+  printf("%d files, %d differences: trees built in %.1fms (tracker) and %.1fms (peer)\n", fileNum, diffNum, trackerBuild, peerBuild);
+
+  //the Merkle exchange: REGISTER with the root, then a MERKLE_SYNC per answer that opened subtrees
+  long upBytes = 0, downBytes = 0;
+  int rounds = 0, settledTotal = 0, entriesUp = 0, entriesDown = 0;
+  double answerMs = 0;
+  merkleNode_t* asked = (merkleNode_t*) malloc(sizeof(merkleNode_t));
+  merkle_node(peer, MERKLE_ROOT, &asked[0]);
+  int askedNum = 1;
+  int type = REGISTER;
+  while (askedNum > 0) {
+    //peer -> tracker
+    int size;
+    fileEntry_t* mine = settled_entries(peer, asked, askedNum, &size);
+    ptp_peer_t up;
+    pkt_config_peerPkt(&up, type, "10.9.9.9", 0, size, mine);
+    pkt_config_peerDelta(&up, 1, 0, 0, NULL);
+    pkt_config_peerNodes(&up, askedNum, asked);
+    pktBuf_t* buf = pkt_peer_encodePkt(&up, NULL);
+    upBytes += buf -> len;
+    entriesUp += size;
+    free_list(mine);
+    ptp_peer_t got;
+    memset(&got, 0, sizeof(ptp_peer_t));
+    assert(pkt_peer_decodePkt(buf -> data, &got) > 0);
+    pkt_buf_release(buf);
+
+    //the tracker answers, with its entries of the settled nodes
+    start = now_ms();
+    merkleNode_t* answer = (merkleNode_t*) malloc(got.nodesize * (1 + MERKLE_FANOUT) * sizeof(merkleNode_t));
+    int answerNum = merkle_expand(tracker, got.nodes, got.nodesize, answer);
+    fileEntry_t* theirs = settled_entries(tracker, got.nodes, got.nodesize, &size);
+    answerMs += now_ms() - start;
+    ptp_tracker_t down;
+    pkt_config_trackerMerkle(&down, 1, answerNum, answer, size, theirs);
+    buf = pkt_tracker_encodePkt(&down, ids);
+    downBytes += buf -> len;
+    entriesDown += size;
+    free_list(theirs);
+    free(answer);
+    free_list(got.filetableHeadPtr);
+    free(got.nodes);
+    rounds++;
+
+    //the peer picks what to ask next
+    ptp_tracker_t reply;
+    memset(&reply, 0, sizeof(ptp_tracker_t));
+    assert(pkt_tracker_decodePkt(buf -> data, &reply, ids) > 0);
+    pkt_buf_release(buf);
+    free(asked);
+    asked = (merkleNode_t*) malloc((reply.nodesize * MERKLE_FANOUT + 1) * sizeof(merkleNode_t));
+    int settleNum;
+    askedNum = merkle_step(peer, reply.nodes, reply.nodesize, asked, &settleNum);
+    settledTotal += settleNum;
+    free_list(reply.filetableHeadPtr);
+    free(reply.nodes);
+    type = MERKLE_SYNC;
+  }
+  free(asked);
+  printf("merkle: %d round trips, %d nodes settled, %d entries up, %d down, %ld bytes up, %ld bytes down, %.2fms answering\n",
+    rounds, settledTotal, entriesUp, entriesDown, upBytes, downBytes, answerMs);
+
+  //the full exchange: the setup packet with the whole table, and the peer's whole table back
+  ptp_tracker_t setup;
+  pkt_config_trackerPkt(&setup, HEARTBEAT_INTERVAL, PIECE_LENGTH, tracker -> size, trackerDummy.next);
+  pktBuf_t* buf = pkt_tracker_encodePkt(&setup, ids);
+  long fullDown = buf -> len;
+  pkt_buf_release(buf);
+  ptp_peer_t update;
+  pkt_config_peerPkt(&update, FILEUPDATE, "10.9.9.9", 0, peer -> size, peerDummy.next);
+  pkt_config_peerDelta(&update, 1, 0, 0, NULL);
+  buf = pkt_peer_encodePkt(&update, NULL);
+  long fullUp = buf -> len;
+  pkt_buf_release(buf);
+  printf("full:   1 round trip, %d entries up, %d down, %ld bytes up, %ld bytes down\n", peer -> size, tracker -> size, fullUp, fullDown);
+  printf("the Merkle exchange sends %.0fx fewer bytes\n", (double) (fullUp + fullDown) / (upBytes + downBytes));
+
+  merkle_destroy(tracker);
+  merkle_destroy(peer);
+  free_list(trackerDummy.next);
+  free_list(peerDummy.next);
+  peerid_destroy(ids);
+  return 0;
+}
@@ -0,0 +1,397 @@
+//File: merkle_test.c
+
+//Description: File that unit tests the functions in merkle.c, and the Merkle nodes pkt.c carries.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -ggdb -pthread -o test merkle_test.c ../common/merkle.c ../common/pkt.c ../common/filecodec.c ../common/peerid.c ../common/filedelta.c ../common/filetable.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../common/merkle.h"
+#include "../common/pkt.h"
+
+
+#define TABLE_SIZE 5000
+
+
+static fileEntry_t* make_entry(const char* name, int size, unsigned long timestamp) {
+  fileEntry_t* entry = (fileEntry_t*) calloc(1, sizeof(fileEntry_t));
+  strncpy(entry -> file_name, name, FILE_NAME_MAX_LEN - 1);
+  entry -> size = size;
+  entry -> timestamp = timestamp;
+  return entry;
+}
+
+/* files 0 .. num - 1 of a table, in the given order of appending */
+static fileTable_t* make_table(int num, int reverse) {
+  fileTable_t* table = filetable_init();
+  char name[FILE_NAME_MAX_LEN];
+  int i;
+  for (i = 0; i < num; i++) {
+    int n = reverse ? num - 1 - i : i;
+    snprintf(name, sizeof(name), "dir%d/file%d.txt", n % 37, n);
+    filetable_appendFileEntry(table, make_entry(name, n * 10, 1000 + n));
+  }
+  return table;
+}
+
+/* whether a file is under one of the settled nodes */
+static int is_settled(merkleNode_t* settled, int num, const char* file_name) {
+  int i;
+  for (i = 0; i < num; i++) {
+    if (merkle_contains(settled[i].id, file_name)) return 1;
+  }
+  return 0;
+}
+
+/**
+ * run a whole exchange between a peer's tree and the tracker's, the way peer.c and tracker.c do
+ * @param  peer      [the peer's tree]
+ * @param  tracker   [the tracker's tree]
+ * @param  settled   [set to the nodes the peer settled, room for TABLE_SIZE * 2]
+ * @param  num       [set to their number]
+ * @param  agreed    [set to the nodes the peer compared that both sides agree on, room for TABLE_SIZE * 2]
+ * @param  agreedNum [set to their number]
+ * @return           [number of round trips]
+ */
+static int run_exchange(merkleTree_t* peer, merkleTree_t* tracker, merkleNode_t* settled, int* num,
+                        merkleNode_t* agreed, int* agreedNum) {
+  *num = 0;
+  *agreedNum = 0;
+  merkleNode_t* asked = (merkleNode_t*) malloc(sizeof(merkleNode_t));
+  merkle_node(peer, MERKLE_ROOT, &asked[0]);
+  int askedNum = 1;
+  int rounds = 0;
+  while (askedNum > 0) {
+    int i;
+    int open = 0;
+    for (i = 0; i < askedNum; i++) {
+      if (asked[i].count == MERKLE_SETTLE) {
+        settled[(*num)++] = asked[i];
+      } else if (merkle_agrees(tracker, &asked[i])) {
+        agreed[(*agreedNum)++] = asked[i];
+      } else {
+        open++;
+      }
+    }
+    merkleNode_t* answer = (merkleNode_t*) malloc(askedNum * (1 + MERKLE_FANOUT) * sizeof(merkleNode_t));
+    int answerNum = merkle_expand(tracker, asked, askedNum, answer);
+    rounds++;
+    assert(answerNum >= askedNum);
+
+    merkleNode_t* next = (merkleNode_t*) malloc((answerNum * MERKLE_FANOUT + 1) * sizeof(merkleNode_t));
+    int settleNum;
+    askedNum = merkle_step(peer, answer, answerNum, next, &settleNum);
+    //nothing compared differed: nothing is left to ask, the tracker tells it is over the same way
+    assert((askedNum == 0) == (open == 0));
+    free(asked);
+    free(answer);
+    asked = next;
+  }
+  free(asked);
+  return rounds;
+}
+
+
+
+void test_merkle_build() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "merkle_build");
+
+  //an empty table
+  merkleTree_t* empty = merkle_build(NULL);
+  merkleNode_t root;
+  merkle_node(empty, MERKLE_ROOT, &root);
+  assert(root.id == MERKLE_ROOT && root.count == 0 && root.digest == 0);
+  merkle_destroy(empty);
+
+  //the order entries were added in does not matter
+  fileTable_t* forward = make_table(TABLE_SIZE, 0);
+  fileTable_t* backward = make_table(TABLE_SIZE, 1);
+  merkleTree_t* a = merkle_build(forward -> head);
+  merkleTree_t* b = merkle_build(backward -> head);
+  merkleNode_t rootA, rootB;
+  merkle_node(a, MERKLE_ROOT, &rootA);
+  merkle_node(b, MERKLE_ROOT, &rootB);
+  assert(rootA.count == TABLE_SIZE && rootB.count == TABLE_SIZE);
+  assert(rootA.digest == rootB.digest);
+  merkle_destroy(b);
+
+  //holders are left out, size and timestamp are not
+  filetable_addHolder(forward -> head, 7, forward -> filetable_mutex);
+  b = merkle_build(forward -> head);
+  merkle_node(b, MERKLE_ROOT, &rootB);
+  assert(rootA.digest == rootB.digest);
+  merkle_destroy(b);
+  forward -> head -> timestamp++;
+  b = merkle_build(forward -> head);
+  merkle_node(b, MERKLE_ROOT, &rootB);
+  assert(rootA.digest != rootB.digest);
+  merkle_destroy(b);
+  forward -> head -> timestamp--;
+  forward -> head -> size++;
+  b = merkle_build(forward -> head);
+  merkle_node(b, MERKLE_ROOT, &rootB);
+  assert(rootA.digest != rootB.digest);
+  merkle_destroy(b);
+
+  merkle_destroy(a);
+  filetable_destroy(forward);
+  filetable_destroy(backward);
+  printf("SUCCESS!!\n");
+}
+
+void test_merkle_nodes() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "merkle_node / merkle_nodeEntries / merkle_contains");
+
+  fileTable_t* table = make_table(TABLE_SIZE, 0);
+  merkleTree_t* tree = merkle_build(table -> head);
+
+  assert(merkle_level(merkle_nodeId(3, 0x5a5)) == 3);
+  assert(merkle_level(MERKLE_ROOT) == 0);
+
+  //every level splits its parent: counts and digests of the children add up to the parent's
+  unsigned long parents[3] = {MERKLE_ROOT, merkle_nodeId(1, 0x9), merkle_nodeId(2, 0x3c)};
+  int p, c;
+  for (p = 0; p < 3; p++) {
+    merkleNode_t parent;
+    merkle_node(tree, parents[p], &parent);
+    int level = merkle_level(parents[p]);
+    unsigned long prefix = parents[p] >> MERKLE_FANOUT_BITS;
+    int count = 0;
+    unsigned long digest = 0;
+    for (c = 0; c < MERKLE_FANOUT; c++) {
+      merkleNode_t child;
+      merkle_node(tree, merkle_nodeId(level + 1, (prefix << MERKLE_FANOUT_BITS) | c), &child);
+      count += child.count;
+      digest += child.digest;
+    }
+    assert(count == parent.count && digest == parent.digest);
+  }
+
+  //a node's entries are exactly the files it contains
+  unsigned long id = merkle_nodeId(2, 0x3c);
+  int num;
+  fileEntry_t** entries = merkle_nodeEntries(tree, id, &num);
+  int i, inside = 0;
+  for (i = 0; i < num; i++) {
+    assert(merkle_contains(id, entries[i] -> file_name));
+  }
+  fileEntry_t* iter;
+  for (iter = table -> head; iter != NULL; iter = iter -> next) {
+    inside += merkle_contains(id, iter -> file_name);
+  }
+  assert(inside == num);
+  printf("node %lx holds %d of %d files\n", id, num, TABLE_SIZE);
+
+  //the deepest level still finds its entry
+  unsigned long hash = merkle_nameHash(table -> head -> file_name);
+  unsigned long leaf = merkle_nodeId(MERKLE_MAX_LEVEL, hash >> (64 - MERKLE_MAX_LEVEL * MERKLE_FANOUT_BITS));
+  entries = merkle_nodeEntries(tree, leaf, &num);
+  assert(num == 1 && entries[0] == table -> head);
+
+  merkle_destroy(tree);
+  filetable_destroy(table);
+  printf("SUCCESS!!\n");
+}
+
+void test_merkle_exchange() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "merkle_expand / merkle_step");
+
+  fileTable_t* trackerTable = make_table(TABLE_SIZE, 0);
+  fileTable_t* peerTable = make_table(TABLE_SIZE, 1);
+  merkleNode_t* settled = (merkleNode_t*) malloc(TABLE_SIZE * 2 * sizeof(merkleNode_t));
+  merkleNode_t* agreed = (merkleNode_t*) malloc(TABLE_SIZE * 2 * sizeof(merkleNode_t));
+  int settledNum, agreedNum;
+
+  //tables in sync: one round, nothing settled, the root agrees
+  merkleTree_t* tracker = merkle_build(trackerTable -> head);
+  merkleTree_t* peer = merkle_build(peerTable -> head);
+  assert(run_exchange(peer, tracker, settled, &settledNum, agreed, &agreedNum) == 1);
+  assert(settledNum == 0);
+  assert(agreedNum == 1 && agreed[0].id == MERKLE_ROOT);
+  merkle_destroy(peer);
+
+  //the peer modified, deleted and added a few files while away
+  char names[15][FILE_NAME_MAX_LEN];
+  char name[FILE_NAME_MAX_LEN];
+  int i;
+  for (i = 0; i < 5; i++) {
+    snprintf(name, sizeof(name), "dir%d/file%d.txt", (i * 997) % 37, i * 997);
+    fileEntry_t* entry = filetable_searchFileByName(peerTable, name);
+    entry -> timestamp += 5;
+    strcpy(names[i], name);
+
+    snprintf(name, sizeof(name), "dir%d/file%d.txt", (i * 997 + 1) % 37, i * 997 + 1);
+    assert(filetable_deleteFileEntryByName(peerTable, name) > 0);
+    strcpy(names[5 + i], name);
+
+    snprintf(name, sizeof(name), "new/file%d.txt", i);
+    filetable_appendFileEntry(peerTable, make_entry(name, 1, 1));
+    strcpy(names[10 + i], name);
+  }
+  peer = merkle_build(peerTable -> head);
+  int rounds = run_exchange(peer, tracker, settled, &settledNum, agreed, &agreedNum);
+
+  //every difference was found, and little else was exchanged
+  for (i = 0; i < 15; i++) {
+    assert(is_settled(settled, settledNum, names[i]));
+  }
+  //every other file is under a node both sides agree on, the tracker can tell the peer holds it
+  fileEntry_t* iter;
+  for (iter = peerTable -> head; iter != NULL; iter = iter -> next) {
+    assert(is_settled(settled, settledNum, iter -> file_name) || is_settled(agreed, agreedNum, iter -> file_name));
+  }
+  for (i = 0; i < agreedNum; i++) {
+    merkleNode_t mine;
+    merkle_node(peer, agreed[i].id, &mine);
+    assert(mine.count > 0 && merkle_agrees(tracker, &mine));
+  }
+  int exchanged = 0;
+  for (i = 0; i < settledNum; i++) {
+    merkleNode_t mine, theirs;
+    merkle_node(peer, settled[i].id, &mine);
+    merkle_node(tracker, settled[i].id, &theirs);
+    assert(mine.count <= MERKLE_SETTLE_ENTRIES || theirs.count <= MERKLE_SETTLE_ENTRIES || mine.count == 0 || theirs.count == 0);
+    exchanged += mine.count + theirs.count;
+  }
+  printf("%d rounds, %d nodes settled, %d entries exchanged for 15 differences in %d files\n", rounds, settledNum, exchanged, TABLE_SIZE);
+  assert(rounds <= 5);
+  assert(settledNum <= 15);
+  assert(exchanged <= 15 * 2 * MERKLE_SETTLE_ENTRIES);
+
+  //the tracker replacing its entries of the settled nodes with the peer's (a FILEUPDATE limited to them) agrees with the peer
+  iter = trackerTable -> head;
+  while (iter != NULL) {
+    fileEntry_t* next = iter -> next;
+    if (is_settled(settled, settledNum, iter -> file_name)) {
+      filetable_deleteFileEntryByName(trackerTable, iter -> file_name);
+    }
+    iter = next;
+  }
+  for (iter = peerTable -> head; iter != NULL; iter = iter -> next) {
+    if (is_settled(settled, settledNum, iter -> file_name)) {
+      filetable_appendFileEntry(trackerTable, make_entry(iter -> file_name, iter -> size, iter -> timestamp));
+    }
+  }
+  merkle_destroy(tracker);
+  tracker = merkle_build(trackerTable -> head);
+  merkleNode_t rootPeer, rootTracker;
+  merkle_node(peer, MERKLE_ROOT, &rootPeer);
+  merkle_node(tracker, MERKLE_ROOT, &rootTracker);
+  assert(rootPeer.count == rootTracker.count && rootPeer.digest == rootTracker.digest);
+  assert(run_exchange(peer, tracker, settled, &settledNum, agreed, &agreedNum) == 1);
+
+  //subtrees a peer has nothing of are settled right away instead of descended into
+  merkle_destroy(peer);
+  fileTable_t* other = filetable_init();
+  filetable_appendFileEntry(other, make_entry("only/mine.txt", 1, 1));
+  peer = merkle_build(other -> head);
+  rounds = run_exchange(peer, tracker, settled, &settledNum, agreed, &agreedNum);
+  printf("a peer with 1 file: %d rounds, %d nodes settled\n", rounds, settledNum);
+  assert(settledNum >= MERKLE_FANOUT - 1);
+  assert(is_settled(settled, settledNum, "only/mine.txt"));
+  for (iter = trackerTable -> head; iter != NULL; iter = iter -> next) {
+    assert(is_settled(settled, settledNum, iter -> file_name));
+  }
+
+  //a tracker with nothing yet: the root differs without a child on the tracker's side, the peer settles its own
+  merkleTree_t* empty = merkle_build(NULL);
+  rounds = run_exchange(peer, empty, settled, &settledNum, agreed, &agreedNum);
+  assert(rounds == 2 && agreedNum == 0);
+  assert(is_settled(settled, settledNum, "only/mine.txt"));
+  merkle_destroy(empty);
+
+  merkle_destroy(peer);
+  merkle_destroy(tracker);
+  filetable_destroy(other);
+  filetable_destroy(peerTable);
+  filetable_destroy(trackerTable);
+  free(settled);
+  free(agreed);
+  printf("SUCCESS!!\n");
+}
+
+void test_merkle_pkt() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "Merkle nodes in pkt_peer_encodePkt / pkt_tracker_encodePkt");
+
+  fileTable_t* table = make_table(20, 0);
+  merkleTree_t* tree = merkle_build(table -> head);
+  merkleNode_t nodes[3];
+  merkle_node(tree, MERKLE_ROOT, &nodes[0]);
+  merkle_node(tree, merkle_nodeId(1, 0xf), &nodes[1]);
+  merkle_node(tree, merkle_nodeId(MERKLE_MAX_LEVEL, 0x123456789abcdefUL), &nodes[2]);
+  nodes[2].count = MERKLE_SETTLE;
+
+  //peer -> tracker, entries and nodes in one body
+  ptp_peer_t reg;
+  memset(&reg, 0, sizeof(ptp_peer_t));
+  pkt_config_peerPkt(&reg, MERKLE_SYNC, "10.0.0.1", 3000, table -> size, table -> head);
+  pkt_config_peerNodes(&reg, 3, nodes);
+  pktBuf_t* buf = pkt_peer_encodePkt(&reg, NULL);
+  assert(pkt_peer_frameLen(buf -> data, buf -> len) == buf -> len);
+  ptp_peer_t decoded;
+  memset(&decoded, 0, sizeof(ptp_peer_t));
+  assert(pkt_peer_decodePkt(buf -> data, &decoded) > 0);
+  assert(decoded.type == MERKLE_SYNC && decoded.filetablesize == 20 && decoded.nodesize == 3);
+  int i;
+  for (i = 0; i < 3; i++) {
+    assert(decoded.nodes[i].id == nodes[i].id && decoded.nodes[i].count == nodes[i].count && decoded.nodes[i].digest == nodes[i].digest);
+  }
+  assert(strcmp(decoded.filetableHeadPtr -> file_name, table -> head -> file_name) == 0);
+  free(decoded.nodes);
+  fileEntry_t* iter = decoded.filetableHeadPtr;
+  while (iter != NULL) {
+    fileEntry_t* next = iter -> next;
+    free(iter);
+    iter = next;
+  }
+
+  //a node count below MERKLE_SETTLE is malformed
+  int bad = -5;
+  memcpy(buf -> data + buf -> len - sizeof(int), &bad, sizeof(int));
+  memset(&decoded, 0, sizeof(ptp_peer_t));
+  assert(pkt_peer_decodePkt(buf -> data, &decoded) < 0);
+  assert(decoded.filetableHeadPtr == NULL);
+  pkt_buf_release(buf);
+
+  //tracker -> peer, nodes only
+  ptp_tracker_t answer;
+  pkt_config_trackerMerkle(&answer, 42, 2, nodes, 0, NULL);
+  buf = pkt_tracker_encodePkt(&answer, NULL);
+  assert(pkt_tracker_frameLen(buf -> data, buf -> len) == buf -> len);
+  ptp_tracker_t got;
+  memset(&got, 0, sizeof(ptp_tracker_t));
+  assert(pkt_tracker_decodePkt(buf -> data, &got, NULL) > 0);
+  assert(got.type == TRACKER_MERKLE && got.epoch == 42 && got.nodesize == 2 && got.filetablesize == 0);
+  assert(got.nodes[1].id == nodes[1].id && got.nodes[1].digest == nodes[1].digest);
+  free(got.nodes);
+  pkt_buf_release(buf);
+
+  //packets without nodes are unchanged but for the count
+  pkt_config_trackerAck(&answer, TRACKER_ACK, 7);
+  buf = pkt_tracker_encodePkt(&answer, NULL);
+  memset(&got, 0, sizeof(ptp_tracker_t));
+  assert(pkt_tracker_decodePkt(buf -> data, &got, NULL) > 0);
+  assert(got.nodesize == 0 && got.nodes == NULL && got.ackVersion == 7);
+  pkt_buf_release(buf);
+
+  merkle_destroy(tree);
+  filetable_destroy(table);
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions for the Merkle trees.
+int main() {
+  test_merkle_build();
+  test_merkle_nodes();
+  test_merkle_exchange();
+  test_merkle_pkt();
+  return 0;
+}
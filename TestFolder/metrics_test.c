@@ -0,0 +1,153 @@
+//File: metrics_test.c
+
+//Description: File that unit tests the functions in metrics.c.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -ggdb -pthread -o test metrics_test.c ../tracker/metrics.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "../tracker/metrics.h"
+
+#define THREAD_NUM 40        // more than METRICS_MAX_THREADS, the last ones share a slot
+#define PER_THREAD 20000
+
+
+static metricsSlot_t total;
+
+void test_metrics_disabled() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "metrics before metrics_init");
+
+  //recording without metrics is a no-op
+  metrics_count(METRIC_BROADCASTS, 1);
+  metrics_record(METRIC_HIST_SEND, 100);
+  metrics_setGauge(METRIC_GAUGE_FILES, 3);
+  assert(metrics_collect(&total) == -1);
+  char buf[64];
+  assert(metrics_format(buf, sizeof(buf)) == -1);
+  assert(metrics_dump("/tmp/metrics_test_none.txt") == -1);
+  printf("SUCCESS!!\n");
+}
+
+void test_metrics_percentile() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "metrics_percentile");
+
+  assert(metrics_init() == 1);
+  assert(metrics_init() == -1);
+
+  //uniform 1 .. 100000
+  unsigned long i;
+  for (i = 1; i <= 100000; i++) {
+    metrics_record(METRIC_HIST_RECONCILE, i);
+  }
+  //small values are exact, a huge one lands in the last bucket
+  metrics_record(METRIC_HIST_SEND, 7);
+  metrics_record(METRIC_HIST_SEND, 1UL << 50);
+
+  assert(metrics_collect(&total) == 1);
+  metricsHist_t* h = &(total.hists[METRIC_HIST_RECONCILE]);
+  assert(h -> count == 100000);
+  assert(h -> max == 100000);
+  assert(h -> sum == 100000UL * 100001 / 2);
+  double qs[4] = {0.5, 0.9, 0.99, 0.999};
+  int q;
+  for (q = 0; q < 4; q++) {
+    unsigned long p = metrics_percentile(h, qs[q]);
+    double expected = qs[q] * 100000;
+    printf("p%g = %lu (exact %.0f)\n", qs[q] * 100, p, expected);
+    assert(p >= expected && p <= expected * 1.04);
+  }
+  assert(metrics_percentile(h, 1.0) == 100000);
+
+  metricsHist_t* send = &(total.hists[METRIC_HIST_SEND]);
+  assert(metrics_percentile(send, 0.5) == 7);
+  assert(metrics_percentile(send, 1.0) == 1UL << 50);
+  assert(metrics_percentile(&(total.hists[METRIC_HIST_MONITOR]), 0.5) == 0);
+  metrics_destroy();
+  printf("SUCCESS!!\n");
+}
+
+static void* record_thread(void* arg) {
+  int i;
+  for (i = 0; i < PER_THREAD; i++) {
+    metrics_count(METRIC_SENT_BYTES, 3);
+    metrics_record(METRIC_HIST_ENCODE, 1000 + i);
+  }
+  return NULL;
+}
+
+void test_metrics_threads() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "metrics_collect");
+
+  assert(metrics_init() == 1);
+  pthread_t threads[THREAD_NUM];
+  int i;
+  for (i = 0; i < THREAD_NUM; i++) {
+    pthread_create(&threads[i], NULL, record_thread, NULL);
+  }
+  for (i = 0; i < THREAD_NUM; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  //every thread counted, also the ones sharing the last slot
+  assert(metrics_collect(&total) == THREAD_NUM);
+  assert(total.counters[METRIC_SENT_BYTES] == 3UL * PER_THREAD * THREAD_NUM);
+  assert(total.hists[METRIC_HIST_ENCODE].count == (unsigned long) PER_THREAD * THREAD_NUM);
+  assert(total.hists[METRIC_HIST_ENCODE].max == 1000 + PER_THREAD - 1);
+  printf("Successfully summed %d threads.\n", THREAD_NUM);
+
+  //a new init starts from zero, threads that recorded before get new slots
+  metrics_destroy();
+  assert(metrics_init() == 1);
+  metrics_count(METRIC_SENT_BYTES, 1);
+  assert(metrics_collect(&total) == 1);
+  assert(total.counters[METRIC_SENT_BYTES] == 1);
+  metrics_destroy();
+  printf("SUCCESS!!\n");
+}
+
+void test_metrics_dump() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "metrics_dump");
+
+  assert(metrics_init() == 1);
+  metrics_count(METRIC_PKT_REGISTER, 3);
+  metrics_setGauge(METRIC_GAUGE_PEERS, 42);
+  metrics_record(METRIC_HIST_BROADCAST, 5000);
+
+  char buf[64];
+  assert(metrics_format(buf, sizeof(buf)) == -1);
+
+  const char* path = "/tmp/metrics_test.txt";
+  assert(metrics_dump(path) == 1);
+  FILE* file = fopen(path, "r");
+  assert(file != NULL);
+  char text[8192];
+  int len = (int) fread(text, 1, sizeof(text) - 1, file);
+  text[len] = '\0';
+  fclose(file);
+  printf("%s", text);
+  assert(strstr(text, "counter pkt_register 3\n") != NULL);
+  assert(strstr(text, "gauge peers 42\n") != NULL);
+  assert(strstr(text, "hist broadcast_ns count 1 mean 5000 p50 5000") != NULL);
+  assert(strstr(text, "hist send_ns count 0 ") != NULL);
+  remove(path);
+  metrics_destroy();
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions for the metrics.
+int main() {
+  test_metrics_disabled();
+  test_metrics_percentile();
+  test_metrics_threads();
+  test_metrics_dump();
+  return 0;
+}
@@ -0,0 +1,148 @@
+//File: peerid_test.c
+
+//Description: File that unit tests the functions in peerid.c.
+
+//To compile:
+// gcc -Wall -pedantic -std=c99 -ggdb -pthread -o test peerid_test.c ../common/peerid.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../common/peerid.h"
+
+
+void test_peerid_intern() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "peerid_intern");
+
+  peerIdMap_t* map = peerid_init();
+  assert(peerid_lookup(map, "10.0.0.1") == PEERID_NONE);
+
+  int a = peerid_intern(map, "10.0.0.1");
+  int b = peerid_intern(map, "10.0.0.2");
+  assert(a == 0 && b == 1);
+  assert(peerid_intern(map, "10.0.0.1") == a);
+  assert(peerid_lookup(map, "10.0.0.2") == b);
+  assert(map -> num == 2);
+  printf("Successfully handed out dense ids, the same ip keeps its id.\n");
+
+  char ip[IP_LEN];
+  assert(peerid_getIp(map, b, ip) == 1 && strcmp(ip, "10.0.0.2") == 0);
+  assert(peerid_getIp(map, 7, ip) == -1);
+  assert(peerid_getIp(map, PEERID_NONE, ip) == -1);
+  peerid_destroy(map);
+  printf("SUCCESS!!\n");
+}
+
+void test_peerid_release() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "peerid_release");
+
+  peerIdMap_t* map = peerid_init();
+  int a = peerid_intern(map, "10.0.0.1");
+  peerid_intern(map, "10.0.0.1");
+
+  //freed only with the last reference
+  peerid_release(map, a);
+  assert(peerid_lookup(map, "10.0.0.1") == a);
+  peerid_release(map, a);
+  assert(peerid_lookup(map, "10.0.0.1") == PEERID_NONE);
+  assert(map -> num == 0);
+  peerid_release(map, PEERID_NONE);
+  printf("Successfully freed an id with its last reference.\n");
+
+  //ids never used come before freed ones
+  assert(peerid_intern(map, "10.0.0.9") == 1);
+  peerid_destroy(map);
+  printf("SUCCESS!!\n");
+}
+
+void test_peerid_grow() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "peerid_intern (past the ids there is room for)");
+
+  peerIdMap_t* map = peerid_init();
+  char ip[IP_LEN];
+  int i;
+  int num = 8 * PEERID_INIT_CAP + 5000;
+  for (i = 0; i < num; i++) {
+    sprintf(ip, "10.%d.%d.1", i / 256, i % 256);
+    assert(peerid_intern(map, ip) == i);
+  }
+  assert(map -> num == num && map -> cap >= num);
+  printf("Successfully handed out %d dense ids, growing the map.\n", num);
+
+  //freed ids come back oldest first, before the map grows again
+  int cap = map -> cap;
+  peerid_release(map, 40);
+  peerid_release(map, 3);
+  peerid_release(map, 4500);
+  while (map -> next < cap) {
+    sprintf(ip, "12.%d.%d.1", map -> next / 256, map -> next % 256);
+    assert(peerid_intern(map, ip) == map -> next - 1);
+  }
+  assert(peerid_intern(map, "11.0.0.1") == 40);
+  assert(peerid_intern(map, "11.0.0.2") == 3);
+  assert(peerid_intern(map, "11.0.0.3") == 4500);
+  assert(map -> cap == cap);
+  assert(peerid_intern(map, "11.0.0.4") == cap && map -> cap == 2 * cap);
+  printf("Successfully reused freed ids in the order they were freed.\n");
+
+  //every remaining ip is still found after the index shifted entries around and was rebuilt
+  for (i = 0; i < num; i++) {
+    if (i == 40 || i == 3 || i == 4500) continue;
+    sprintf(ip, "10.%d.%d.1", i / 256, i % 256);
+    assert(peerid_lookup(map, ip) == i);
+  }
+  assert(peerid_lookup(map, "11.0.0.2") == 3);
+  assert(peerid_getIp(map, cap, ip) == 1 && strcmp(ip, "11.0.0.4") == 0);
+  assert(peerid_getIp(map, cap + 1, ip) == -1);
+  peerid_destroy(map);
+  printf("SUCCESS!!\n");
+}
+
+void test_peerid_churn() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "peerid_intern / peerid_release (churn)");
+
+  //peers keep coming and going, the index must stay consistent with the ids
+  peerIdMap_t* map = peerid_init();
+  int ids[256];
+  char ip[IP_LEN];
+  int i, round;
+  for (i = 0; i < 256; i++) {
+    sprintf(ip, "192.168.0.%d", i);
+    ids[i] = peerid_intern(map, ip);
+  }
+  srand(7);
+  for (round = 0; round < 20000; round++) {
+    i = rand() % 256;
+    sprintf(ip, "192.168.0.%d", i);
+    if (ids[i] == PEERID_NONE) {
+      ids[i] = peerid_intern(map, ip);
+      assert(ids[i] != PEERID_NONE);
+    } else {
+      assert(peerid_lookup(map, ip) == ids[i]);
+      peerid_release(map, ids[i]);
+      ids[i] = PEERID_NONE;
+      assert(peerid_lookup(map, ip) == PEERID_NONE);
+    }
+  }
+  for (i = 0; i < 256; i++) {
+    sprintf(ip, "192.168.0.%d", i);
+    assert(peerid_lookup(map, ip) == ids[i]);
+  }
+  peerid_destroy(map);
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions for the peer id map.
+int main() {
+  test_peerid_intern();
+  test_peerid_release();
+  test_peerid_grow();
+  test_peerid_churn();
+  return 0;
+}
@@ -37,16 +37,8 @@
 */
 
 peerEntry_t* create_mock_peer_entry(char* ip, int sockfd){
-  // Allocate memory for the entry.
-  peerEntry_t* peerEntry = (peerEntry_t*)malloc(sizeof(peerEntry_t));
-
-  // Set initial fields for the entry.
-  memcpy(peerEntry->ip, ip, IP_LEN);
-  peerEntry->sockfd = sockfd;
-  peerEntry->timestamp = getCurrentTime();
-  peerEntry->next = NULL;
-
-  return peerEntry;
+  //entries go through peertable_createEntry so their alive timer is set up
+  return peertable_createEntry(ip, sockfd);
 }
 
 /*
@@ -55,22 +47,12 @@ size 3 with files test1.txt -> test2.txt -> test3.txt as the mock file
 entries.  test1.txt is the head and test3.txt is the tail.
 */
 peerTable_t* create_mock_peertable() {
-	peerTable_t* peertable = (peerTable_t*) malloc(sizeof(peerTable_t));
-	peertable -> head = NULL;
-	peertable -> tail = NULL;
-	peertable -> size = 0;
-
-  //create the mutex for the table
-  pthread_mutex_t* mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
-  pthread_mutex_init(mutex, NULL);
-  peertable -> peertable_mutex = mutex;
+	peerTable_t* peertable = peertable_init();
 
   //add the mock test files
-  peertable -> head = create_mock_peer_entry("192.123.342.212", 2);
-  peertable -> head -> next = create_mock_peer_entry("127.000.0.1", 3);
-  peertable -> head -> next -> next = create_mock_peer_entry("123.456.789.92", 4);
-  peertable -> tail = peertable -> head -> next -> next;
-  peertable -> size = 3;
+  peertable_addEntry(peertable, create_mock_peer_entry("192.123.342.212", 2));
+  peertable_addEntry(peertable, create_mock_peer_entry("127.000.0.1", 3));
+  peertable_addEntry(peertable, create_mock_peer_entry("123.456.789.92", 4));
   return peertable;
 }
 
@@ -83,6 +65,7 @@ void test_peertable_init() {
 	assert(peertable -> tail == NULL);
 	assert(peertable -> size == 0);
   assert(peertable -> peertable_mutex != NULL);
+  assert(peertable -> liveness != NULL);
 	printf("SUCCESS!!\n");
 
   peertable_destroy(peertable);
@@ -128,20 +111,34 @@ void test_peertable_searchEntryByIp() {
   printf("SUCCESS\n");
 }
 
+void test_peertable_searchEntryBySockfd() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "peertable_searchEntryBySockfd");
+
+  peerTable_t* peertable = create_mock_peertable();
+
+  //Test connections in the table
+  assert(peertable_searchEntryBySockfd(peertable, 2) == peertable -> head);
+  assert(peertable_searchEntryBySockfd(peertable, 3) == peertable -> head -> next);
+  assert(peertable_searchEntryBySockfd(peertable, 4) == peertable -> tail);
+  printf("Successfully found connections in the table.\n");
+
+  //Test connections not in the table
+  assert(peertable_searchEntryBySockfd(peertable, -1) == NULL);
+  assert(peertable_searchEntryBySockfd(peertable, 5) == NULL);
+  printf("Successfully did not find connections not in the table.\n");
+
+  peertable_destroy(peertable);
+  peertable = NULL;
+  printf("SUCCESS!!\n");
+}
+
 void test_peertable_addEntry() {
   printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
   printf("Function: %s\n", "peertable_addEntry");
 
   //create empty filetable
-  peerTable_t* peertable = (peerTable_t*) malloc(sizeof(peerTable_t));
-  peertable -> head = NULL;
-  peertable -> tail = NULL;
-  peertable -> size = 0;
-
-  //create the mutex for the table
-  pthread_mutex_t* mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
-  pthread_mutex_init(mutex, NULL);
-  peertable -> peertable_mutex = mutex;
+  peerTable_t* peertable = peertable_init();
 
   //Test add files to an empty table
   assert(peertable -> head == NULL);
@@ -161,6 +158,14 @@ void test_peertable_addEntry() {
   assert(peertable -> size == 2);
   printf("Successfully added files to empty table.\n");
 
+  //every entry holds the id of its ip, an ip already in the table shares it
+  assert(entry1 -> id == 0 && entry2 -> id == 1);
+  assert(peerid_lookup(peertable -> ids, "222.222.111.222") == entry2 -> id);
+  peerEntry_t* again = create_mock_peer_entry("999.999.999.999", 9);
+  peertable_addEntry(peertable, again);
+  assert(again -> id == entry1 -> id);
+  printf("Successfully gave the entries their peer ids.\n");
+
   peertable_destroy(peertable);
   peertable = NULL;
 
@@ -193,6 +198,7 @@ void test_peertable_deleteEntryByIp() {
   assert(peertable -> head == peer);
   assert(peertable_deleteEntryByIp(peertable, "192.123.342.212") == 1);
   assert(peertable_searchEntryByIp(peertable, "192.123.342.212") == NULL);
+  assert(peerid_lookup(peertable -> ids, "192.123.342.212") == PEERID_NONE);
   peer = peertable_searchEntryByIp(peertable, "127.000.0.1");
   assert(peertable -> head == peer);
   assert(peertable -> size == 2);
@@ -234,6 +240,64 @@ void test_peertable_deleteEntryByIp() {
   printf("SUCCESS\n");
 }
 
+void test_peertable_removeEntryLocked() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "peertable_removeEntryLocked");
+
+  peerTable_t* peertable = create_mock_peertable();
+  int shared = -1;
+
+  //a second entry of the same ip, e.g. a peer that registered again before its old connection closed
+  pthread_mutex_lock(peertable -> peertable_mutex);
+  peerEntry_t* old = peertable_searchEntryByIpLocked(peertable, "127.000.0.1");
+  peerEntry_t* again = create_mock_peer_entry("127.000.0.1", 7);
+  peertable_addEntryLocked(peertable, again);
+  assert(again -> id == old -> id);
+  assert(peertable_searchEntryBySockfdLocked(peertable, 7) == again);
+  pthread_mutex_unlock(peertable -> peertable_mutex);
+  assert(peertable -> size == 4 && peertable -> tail == again);
+
+  //the old entry goes, the one left keeps the ip's id
+  pthread_mutex_lock(peertable -> peertable_mutex);
+  assert(peertable_removeEntryLocked(peertable, old, &shared) == old);
+  pthread_mutex_unlock(peertable -> peertable_mutex);
+  assert(shared == 1);
+  int id = old -> id;
+  peertable_freeEntry(peertable, old);
+  assert(peertable -> size == 3);
+  assert(peertable_searchEntryBySockfd(peertable, 3) == NULL);
+  assert(peertable_searchEntryByIp(peertable, "127.000.0.1") == again);
+  assert(peerid_lookup(peertable -> ids, "127.000.0.1") == id);
+  printf("Successfully removed an entry sharing its ip.\n");
+
+  //the last entry of the ip is the tail, removing it frees the id only with the entry
+  pthread_mutex_lock(peertable -> peertable_mutex);
+  assert(peertable_removeEntryLocked(peertable, again, &shared) == again);
+  pthread_mutex_unlock(peertable -> peertable_mutex);
+  assert(shared == 0);
+  assert(peertable -> size == 2);
+  assert(peertable -> tail == peertable_searchEntryByIp(peertable, "123.456.789.92"));
+  assert(peertable -> tail -> next == NULL);
+  assert(peerid_lookup(peertable -> ids, "127.000.0.1") == id);
+  peertable_freeEntry(peertable, again);
+  assert(peerid_lookup(peertable -> ids, "127.000.0.1") == PEERID_NONE);
+  printf("Successfully removed the last entry of an ip.\n");
+
+  //the head, then the only entry left
+  pthread_mutex_lock(peertable -> peertable_mutex);
+  peerEntry_t* head = peertable -> head;
+  peertable_freeEntry(peertable, peertable_removeEntryLocked(peertable, head, NULL));
+  assert(peertable -> head == peertable -> tail && peertable -> size == 1);
+  peertable_freeEntry(peertable, peertable_removeEntryLocked(peertable, peertable -> head, &shared));
+  pthread_mutex_unlock(peertable -> peertable_mutex);
+  assert(shared == 0);
+  assert(peertable -> head == NULL && peertable -> tail == NULL && peertable -> size == 0);
+  peertable_destroy(peertable);
+  printf("Successfully emptied the peer table.\n");
+
+  printf("SUCCESS\n");
+}
+
 void test_peertable_refreshTimestamp() {
   printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
   printf("Function: %s\n", "peertable_refreshTimestamp");
@@ -244,9 +308,11 @@ void test_peertable_refreshTimestamp() {
 
   unsigned long timestamp = peer -> timestamp;
 
-  assert(peertable_refreshTimestamp(peer) == 1);
+  assert(peertable_refreshTimestamp(peertable, peer) == 1);
   assert(timestamp != peer -> timestamp);
   assert(peer -> timestamp == getCurrentTime());
+  assert(peer -> aliveTimer.scheduled == 1);
+  assert(peer -> aliveTimer.expire == peer -> timestamp + DEAD_PEER_TIMEOUT + 1);
   peertable_destroy(peertable);
   peertable = NULL;
   printf("Successfully updated the timestamp.\n");
@@ -254,12 +320,51 @@ void test_peertable_refreshTimestamp() {
   printf("SUCCESS!!\n");
 }
 
+void test_peertable_expireDead() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "peertable_expireDead");
+
+  peerTable_t* peertable = create_mock_peertable();
+  unsigned long now = getCurrentTime();
+
+  //nobody is dead before DEAD_PEER_TIMEOUT has passed
+  assert(peertable_expireDead(peertable, now + DEAD_PEER_TIMEOUT - 1) == NULL);
+
+  //a refreshed peer outlives the others
+  peerEntry_t* alive = peertable_searchEntryByIp(peertable, "127.000.0.1");
+  alive -> timestamp = now + DEAD_PEER_TIMEOUT - 1;
+  pthread_mutex_lock(peertable -> peertable_mutex);
+  timerwheel_schedule(peertable -> liveness, &(alive -> aliveTimer), alive -> timestamp + DEAD_PEER_TIMEOUT + 1);
+  pthread_mutex_unlock(peertable -> peertable_mutex);
+
+  int dead = 0;
+  timerNode_t* node = peertable_expireDead(peertable, now + DEAD_PEER_TIMEOUT + 1);
+  while (node != NULL) {
+    assert((peerEntry_t*) node -> data != alive);
+    dead ++;
+    node = node -> next;
+  }
+  assert(dead == 2);
+  printf("Successfully expired only the dead peers.\n");
+
+  //a deleted peer never fires
+  assert(peertable_deleteEntryByIp(peertable, "127.000.0.1") == 1);
+  assert(peertable -> liveness -> count == 0);
+  assert(peertable_expireDead(peertable, now + 10 * DEAD_PEER_TIMEOUT) == NULL);
+
+  peertable_destroy(peertable);
+  printf("SUCCESS!!\n");
+}
+
 //Main function to test all of the functions for the peer table.
 int main() {
 	test_peertable_init();
   test_peertable_createEntry();
   test_peertable_searchEntryByIp();
+  test_peertable_searchEntryBySockfd();
   test_peertable_addEntry();
   test_peertable_deleteEntryByIp();
+  test_peertable_removeEntryLocked();
   test_peertable_refreshTimestamp();
+  test_peertable_expireDead();
 }
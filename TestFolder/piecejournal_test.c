@@ -0,0 +1,165 @@
+//File: piecejournal_test.c
+
+//Description: File that unit tests the functions in piecejournal.c on journals in a temporary directory: the pieces
+// recorded found again for the same version of a file, a new journal for any other version, and removal
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -ggdb -o test piecejournal_test.c ../peer/piecejournal.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "../peer/piecejournal.h"
+#include "../peer/piecesched.h"
+
+
+#define PIECE_LEN 1024
+#define SIZE (200 * PIECE_LEN + 5)
+
+
+static char dir[] = "/tmp/piecejournal_testXXXXXX";
+static char path[512];
+
+
+/* whether a file is at path */
+static int exists(const char* path) {
+  struct stat st;
+  return stat(path, &st) == 0;
+}
+
+/* whether none of the words of a bitmap has a bit set */
+static int empty(const unsigned long* bitmap, int words) {
+  int i;
+  for (i = 0; i < words; i++) {
+    if (bitmap[i] != 0) return 0;
+  }
+  return 1;
+}
+
+
+
+void test_piecejournal_record() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "piecejournal_open / piecejournal_record");
+
+  //nothing there: a new journal, nothing recorded
+  unsigned long* done = (unsigned long*) 1;
+  pieceJournal_t* journal = piecejournal_open(path, "a.bin", SIZE, 7, PIECE_LEN, &done);
+  assert(journal != NULL && done == NULL && journal -> header.pieceNum == 201);
+  assert(journal -> words == PIECESCHED_WORDS(201));
+  int words = journal -> words;
+
+  unsigned long* bitmap = (unsigned long*) calloc(words, sizeof(unsigned long));
+  bitmap[0] = 0x5;
+  bitmap[words - 1] = 1UL << (200 % (8 * sizeof(unsigned long)));
+  assert(piecejournal_record(journal, bitmap) == 1 && journal -> records == 1);
+  piecejournal_close(journal, 0);
+  assert(exists(path));
+
+  //the same version: the pieces recorded
+  journal = piecejournal_open(path, "a.bin", SIZE, 7, PIECE_LEN, &done);
+  assert(journal != NULL && done != NULL);
+  assert(memcmp(done, bitmap, words * sizeof(unsigned long)) == 0);
+  free(done);
+
+  //more of them, recorded over the ones before
+  bitmap[1] = ~0UL;
+  assert(piecejournal_record(journal, bitmap) == 1);
+  piecejournal_close(journal, 0);
+  journal = piecejournal_open(path, "a.bin", SIZE, 7, PIECE_LEN, &done);
+  assert(done != NULL && memcmp(done, bitmap, words * sizeof(unsigned long)) == 0);
+  free(done);
+  piecejournal_close(journal, 0);
+  free(bitmap);
+  printf("SUCCESS!!\n");
+}
+
+void test_piecejournal_version() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "piecejournal_open (another version)");
+
+  unsigned long* done;
+  pieceJournal_t* journal = piecejournal_open(path, "a.bin", SIZE, 7, PIECE_LEN, &done);
+  assert(done != NULL && !empty(done, journal -> words));
+  free(done);
+  piecejournal_close(journal, 0);
+
+  //a newer timestamp, another size, other pieces or another name: none of what was recorded holds
+  journal = piecejournal_open(path, "a.bin", SIZE, 8, PIECE_LEN, &done);
+  assert(journal != NULL && done == NULL);
+  piecejournal_close(journal, 0);
+  journal = piecejournal_open(path, "a.bin", SIZE, 8, PIECE_LEN, &done);
+  assert(done != NULL && empty(done, journal -> words));
+  free(done);
+  piecejournal_close(journal, 0);
+
+  journal = piecejournal_open(path, "a.bin", SIZE + 1, 8, PIECE_LEN, &done);
+  assert(done == NULL);
+  piecejournal_close(journal, 0);
+  journal = piecejournal_open(path, "a.bin", SIZE + 1, 8, 2 * PIECE_LEN, &done);
+  assert(done == NULL && journal -> header.pieceNum == 101);
+  piecejournal_close(journal, 0);
+  journal = piecejournal_open(path, "b.bin", SIZE + 1, 8, 2 * PIECE_LEN, &done);
+  assert(done == NULL);
+  piecejournal_close(journal, 0);
+
+  //a journal that is not one, or cut short
+  FILE* file = fopen(path, "w");
+  assert(file != NULL && fputs("not a journal", file) >= 0);
+  fclose(file);
+  journal = piecejournal_open(path, "b.bin", SIZE + 1, 8, 2 * PIECE_LEN, &done);
+  assert(journal != NULL && done == NULL);
+  assert(truncate(path, sizeof(pieceJournalHeader_t) + 1) == 0);
+  piecejournal_close(journal, 0);
+  journal = piecejournal_open(path, "b.bin", SIZE + 1, 8, 2 * PIECE_LEN, &done);
+  assert(journal != NULL && done == NULL);
+  piecejournal_close(journal, 0);
+  printf("SUCCESS!!\n");
+}
+
+void test_piecejournal_close() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "piecejournal_open (anew) / piecejournal_close");
+
+  unsigned long* done;
+  pieceJournal_t* journal = piecejournal_open(path, "c.bin", SIZE, 9, PIECE_LEN, NULL);
+  unsigned long* bitmap = (unsigned long*) calloc(journal -> words, sizeof(unsigned long));
+  bitmap[0] = 0x3;
+  assert(piecejournal_record(journal, bitmap) == 1);
+  piecejournal_close(journal, 0);
+
+  //started anew though it is the same version
+  journal = piecejournal_open(path, "c.bin", SIZE, 9, PIECE_LEN, NULL);
+  piecejournal_close(journal, 0);
+  journal = piecejournal_open(path, "c.bin", SIZE, 9, PIECE_LEN, &done);
+  assert(done != NULL && empty(done, journal -> words));
+  free(done);
+
+  //removed, the download done
+  piecejournal_close(journal, 1);
+  assert(!exists(path));
+  piecejournal_close(NULL, 1);
+
+  //cannot be written
+  char bad[600];
+  snprintf(bad, sizeof(bad), "%s/none/c.bin%s", dir, PIECEJOURNAL_EXT);
+  assert(piecejournal_open(bad, "c.bin", SIZE, 9, PIECE_LEN, &done) == NULL);
+  free(bitmap);
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions of the piece journal.
+int main() {
+  assert(mkdtemp(dir) != NULL);
+  snprintf(path, sizeof(path), "%s/a.bin%s%s", dir, PIECEJOURNAL_EXT, PARTIAL_FILE_EXT);
+  test_piecejournal_record();
+  test_piecejournal_version();
+  test_piecejournal_close();
+  rmdir(dir);
+  return 0;
+}
@@ -0,0 +1,182 @@
+//File: piecesched_bench.c
+
+//Description: Times claiming and completing every piece of a download from 1, 2, 4 .. up to N threads at once,
+// with piecesched.c against the queue it replaced (one malloced entry per piece, taken off and put back under a
+// mutex, as p2p/pieceList.c did).  Every thread is a provider with the whole file; one claim in F is failed and
+// retried.  The claims per second of the queue should flatten or drop as threads are added, those of the
+// scheduler keep up with the cores there are.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -O2 -pthread -o piecesched_bench piecesched_bench.c ../peer/piecesched.c
+
+//To run:
+// ./piecesched_bench [-n pieces] [-t most threads] [-f fail one in]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "../peer/piecesched.h"
+
+
+typedef struct queueEntry{
+  int piece;
+  struct queueEntry* next;
+}queueEntry_t;
+
+typedef struct queue{
+  queueEntry_t* head;
+  queueEntry_t* tail;
+  pthread_mutex_t mutex;
+}queue_t;
+
+typedef struct worker{
+  queue_t* queue;
+  pieceSched_t* sched;
+  int failOneIn;
+  unsigned int seed;
+  long claims;
+}worker_t;
+
+
+/* puts piece at the tail of the queue, in an entry of its own */
+static void queue_add(queue_t* queue, int piece) {
+  queueEntry_t* entry = (queueEntry_t*) malloc(sizeof(queueEntry_t));
+  entry -> piece = piece;
+  entry -> next = NULL;
+  pthread_mutex_lock(&(queue -> mutex));
+  if (queue -> tail == NULL) {
+    queue -> head = entry;
+  } else {
+    queue -> tail -> next = entry;
+  }
+  queue -> tail = entry;
+  pthread_mutex_unlock(&(queue -> mutex));
+}
+
+/* the piece at the head of the queue, -1 when empty */
+static int queue_take(queue_t* queue) {
+  pthread_mutex_lock(&(queue -> mutex));
+  queueEntry_t* entry = queue -> head;
+  if (entry != NULL) {
+    queue -> head = entry -> next;
+    if (queue -> head == NULL) queue -> tail = NULL;
+  }
+  pthread_mutex_unlock(&(queue -> mutex));
+  if (entry == NULL) return -1;
+  int piece = entry -> piece;
+  free(entry);
+  return piece;
+}
+
+static void* queue_worker(void* arg) {
+  worker_t* worker = (worker_t*) arg;
+  int piece;
+  while ((piece = queue_take(worker -> queue)) >= 0) {
+    worker -> claims++;
+    if (rand_r(&(worker -> seed)) % worker -> failOneIn == 0) {
+      queue_add(worker -> queue, piece);
+    }
+  }
+  return NULL;
+}
+
+static void* sched_worker(void* arg) {
+  worker_t* worker = (worker_t*) arg;
+  pieceSched_t* sched = worker -> sched;
+  int slot = piecesched_addProvider(sched, NULL);
+  assert(slot >= 0);
+  int piece;
+  while ((piece = piecesched_claim(sched, slot, 1)) != PIECESCHED_FINISHED) {
+    if (piece == PIECESCHED_WAIT) continue;
+    worker -> claims++;
+    if (rand_r(&(worker -> seed)) % worker -> failOneIn == 0) {
+      piecesched_fail(sched, slot, piece);
+    } else {
+      piecesched_complete(sched, slot, piece);
+    }
+  }
+  piecesched_removeProvider(sched, slot);
+  return NULL;
+}
+
+/* runs threadNum workers over pieceNum pieces, the queue or the scheduler, and gives the claims per second */
+static double run(int useSched, int pieceNum, int threadNum, int failOneIn) {
+  queue_t queue;
+  pieceSched_t* sched = NULL;
+  int i;
+  if (useSched) {
+    sched = piecesched_init((long) pieceNum * 1024, 1024, threadNum, 4, 60000);
+  } else {
+    queue.head = NULL;
+    queue.tail = NULL;
+    pthread_mutex_init(&(queue.mutex), NULL);
+  }
+  worker_t* workers = (worker_t*) calloc(threadNum, sizeof(worker_t));
+  pthread_t* threads = (pthread_t*) calloc(threadNum, sizeof(pthread_t));
+
+  unsigned long start = piecesched_now();
+  if (!useSched) {
+    for (i = 0; i < pieceNum; i++) {
+      queue_add(&queue, i);
+    }
+  }
+  for (i = 0; i < threadNum; i++) {
+    workers[i].queue = &queue;
+    workers[i].sched = sched;
+    workers[i].failOneIn = failOneIn;
+    workers[i].seed = i + 1;
+    pthread_create(&threads[i], NULL, useSched ? sched_worker : queue_worker, &workers[i]);
+  }
+  long claims = 0;
+  for (i = 0; i < threadNum; i++) {
+    pthread_join(threads[i], NULL);
+    claims += workers[i].claims;
+  }
+  double took = (piecesched_now() - start + 1) / 1000.0;
+
+  if (useSched) {
+    assert(sched -> doneNum == pieceNum);
+    piecesched_destroy(sched);
+  } else {
+    pthread_mutex_destroy(&(queue.mutex));
+  }
+  assert(claims >= pieceNum);
+  free(workers);
+  free(threads);
+  return claims / took;
+}
+
+
+int main(int argc, char* argv[]) {
+  int pieceNum = 1000000;
+  int maxThreads = 16;
+  int failOneIn = 20;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:t:f:h")) != -1) {
+    switch (opt) {
+      case 'n': pieceNum = atoi(optarg); break;
+      case 't': maxThreads = atoi(optarg); break;
+      case 'f': failOneIn = atoi(optarg); break;
+      default:
+        printf("usage: %s [-n pieces (1000000)] [-t most threads (16)] [-f fail one in (20)]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (pieceNum <= 0 || maxThreads <= 0 || failOneIn <= 0) {
+    printf("%s: error: %d pieces, %d threads, fail one in %d\n", __func__, pieceNum, maxThreads, failOneIn);
+    return 1;
+  }
+
+  printf("%d pieces, one claim in %d failed, %ld cores\n", pieceNum, failOneIn, sysconf(_SC_NPROCESSORS_ONLN));
+  printf("threads   queue claims/s   sched claims/s   speedup\n");
+  int threadNum;
+  for (threadNum = 1; threadNum <= maxThreads; threadNum *= 2) {
+    double queued = run(0, pieceNum, threadNum, failOneIn);
+    double scheduled = run(1, pieceNum, threadNum, failOneIn);
+    printf("%7d  %15.0f  %15.0f  %7.2fx\n", threadNum, queued, scheduled, scheduled / queued);
+  }
+  return 0;
+}
@@ -0,0 +1,301 @@
+//File: piecesched_test.c
+
+//Description: File that unit tests the functions in piecesched.c
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -ggdb -pthread -o test piecesched_test.c ../peer/piecesched.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "../peer/piecesched.h"
+
+
+#define PIECE_LEN 1000
+#define PIECE_NUM 200
+#define FILE_SIZE (PIECE_LEN * (PIECE_NUM - 1) + 123)   // the last piece is short
+#define THREAD_NUM 6
+#define BIG_PIECE_NUM 200000
+
+
+/* a bitmap of the pieces from .. to - 1 */
+static unsigned long* make_bitmap(int from, int to) {
+  unsigned long* bitmap = (unsigned long*) calloc(PIECESCHED_WORDS(PIECE_NUM), sizeof(unsigned long));
+  int i;
+  for (i = from; i < to; i++) {
+    bitmap[i / PIECESCHED_BITS] |= 1UL << (i % PIECESCHED_BITS);
+  }
+  return bitmap;
+}
+
+
+
+void test_piecesched_sizes() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "piecesched_pieceSize");
+
+  pieceSched_t* sched = piecesched_init(FILE_SIZE, PIECE_LEN, 4, 4, 1000);
+  assert(sched -> pieceNum == PIECE_NUM);
+  assert(piecesched_pieceSize(sched, 0) == PIECE_LEN);
+  assert(piecesched_pieceSize(sched, PIECE_NUM - 2) == PIECE_LEN);
+  assert(piecesched_pieceSize(sched, PIECE_NUM - 1) == 123);
+  piecesched_destroy(sched);
+
+  //an empty file is done from the start
+  sched = piecesched_init(0, PIECE_LEN, 4, 4, 1000);
+  assert(sched -> pieceNum == 0);
+  int slot = piecesched_addProvider(sched, NULL);
+  assert(piecesched_claim(sched, slot, 0) == PIECESCHED_FINISHED);
+  piecesched_destroy(sched);
+  printf("SUCCESS!!\n");
+}
+
+void test_piecesched_rarest() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "piecesched_claim (rarest first)");
+
+  pieceSched_t* sched = piecesched_init(FILE_SIZE, PIECE_LEN, 4, PIECE_NUM, 1000);
+  //a has everything, b the first half, c the first quarter: the second half is rarest, then the second quarter
+  unsigned long* half = make_bitmap(0, PIECE_NUM / 2);
+  unsigned long* quarter = make_bitmap(0, PIECE_NUM / 4);
+  int a = piecesched_addProvider(sched, NULL);
+  int b = piecesched_addProvider(sched, half);
+  int c = piecesched_addProvider(sched, quarter);
+  assert(a >= 0 && b >= 0 && c >= 0 && sched -> activeNum == 3);
+
+  int i;
+  for (i = 0; i < PIECE_NUM / 2; i++) {
+    assert(piecesched_claim(sched, a, 0) == PIECE_NUM / 2 + i);
+  }
+  for (i = 0; i < PIECE_NUM / 4; i++) {
+    assert(piecesched_claim(sched, b, 0) == PIECE_NUM / 4 + i);
+  }
+  for (i = 0; i < PIECE_NUM / 4; i++) {
+    assert(piecesched_claim(sched, c, 0) == i);
+  }
+  //nothing left to take for anyone, every piece once
+  assert(piecesched_claim(sched, a, 0) == PIECESCHED_WAIT);
+  assert(piecesched_claim(sched, b, 0) == PIECESCHED_WAIT);
+  for (i = 0; i < PIECE_NUM; i++) {
+    assert(sched -> owner[i] >= 0);
+  }
+
+  free(half);
+  free(quarter);
+  piecesched_destroy(sched);
+  printf("SUCCESS!!\n");
+}
+
+void test_piecesched_outstanding() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "piecesched_claim / piecesched_complete");
+
+  pieceSched_t* sched = piecesched_init(FILE_SIZE, PIECE_LEN, 2, 3, 1000);
+  int a = piecesched_addProvider(sched, NULL);
+  int b = piecesched_addProvider(sched, NULL);
+  int first[3];
+  int i;
+  for (i = 0; i < 3; i++) {
+    first[i] = piecesched_claim(sched, a, 0);
+    assert(first[i] >= 0);
+  }
+  //at its limit until it delivers one
+  assert(piecesched_claim(sched, a, 0) == PIECESCHED_WAIT);
+  assert(piecesched_claim(sched, b, 0) >= 0);
+  assert(piecesched_complete(sched, a, first[1]) == 1);
+  assert(piecesched_claim(sched, a, 0) >= 0);
+  assert(sched -> providers[a].outstanding == 3 && sched -> providers[a].received == 1);
+  assert(PIECESCHED_HAS(sched -> have, first[1]) && !PIECESCHED_HAS(sched -> have, first[0]));
+
+  //downloading everything, two at a time
+  int done = 1;
+  while (1) {
+    int slot = (done % 2) ? a : b;
+    int piece = piecesched_claim(sched, slot, 0);
+    if (piece == PIECESCHED_FINISHED) break;
+    if (piece == PIECESCHED_WAIT) {
+      //at its limit, deliver the oldest
+      piece = sched -> providers[slot].pieces[0];
+    }
+    done += piecesched_complete(sched, slot, piece);
+  }
+  assert(done == PIECE_NUM && sched -> doneNum == PIECE_NUM);
+  unsigned long* have = piecesched_copyHave(sched);
+  for (i = 0; i < PIECE_NUM; i++) {
+    assert(PIECESCHED_HAS(have, i));
+  }
+  free(have);
+  assert(piecesched_wait(sched, 1000) == PIECESCHED_FINISHED);
+  piecesched_destroy(sched);
+  printf("SUCCESS!!\n");
+}
+
+void test_piecesched_handBack() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "piecesched_fail / piecesched_reapStalled / piecesched_removeProvider");
+
+  pieceSched_t* sched = piecesched_init(FILE_SIZE, PIECE_LEN, 3, 4, 1000);
+  int a = piecesched_addProvider(sched, NULL);
+  int b = piecesched_addProvider(sched, NULL);
+
+  //a failed piece is the next one taken, by anyone
+  int p = piecesched_claim(sched, a, 0);
+  piecesched_fail(sched, a, p);
+  assert(sched -> owner[p] == PIECESCHED_MISSING && sched -> providers[a].outstanding == 0);
+  assert(piecesched_claim(sched, b, 0) == p);
+
+  //b stalls: its piece goes to a, and whoever delivers first has it done
+  unsigned long now = piecesched_now();
+  assert(piecesched_reapStalled(sched, now) == 0);
+  assert(piecesched_reapStalled(sched, now + 2000) == 1);
+  assert(sched -> providers[b].stalls == 1 && sched -> providers[b].outstanding == 1);
+  assert(piecesched_claim(sched, a, 0) == p);
+  assert(piecesched_reapStalled(sched, piecesched_now()) == 0);
+  assert(piecesched_complete(sched, a, p) == 1);
+  assert(piecesched_complete(sched, b, p) == 0);
+  assert(sched -> providers[b].outstanding == 0);
+
+  //a leaves with pieces it was asked for, b takes them first
+  int left[3];
+  int i;
+  for (i = 0; i < 3; i++) {
+    left[i] = piecesched_claim(sched, a, 0);
+  }
+  piecesched_removeProvider(sched, a);
+  assert(sched -> activeNum == 1);
+  int taken = 0;
+  for (i = 0; i < 3; i++) {
+    int piece = piecesched_claim(sched, b, 0);
+    assert(piece == left[0] || piece == left[1] || piece == left[2]);
+    taken |= 1 << ((piece == left[0]) ? 0 : (piece == left[1]) ? 1 : 2);
+  }
+  assert(taken == 7);
+
+  //its slot is free for another provider, which counts in availability again
+  int c = piecesched_addProvider(sched, NULL);
+  assert(c == a && sched -> activeNum == 2 && sched -> wholeNum + sched -> availability[0] == 2);
+  int d = piecesched_addProvider(sched, NULL);
+  assert(d >= 0 && piecesched_addProvider(sched, NULL) == -1);
+  piecesched_removeProvider(sched, d);
+  piecesched_removeProvider(sched, d);
+  assert(sched -> activeNum == 2 && sched -> wholeNum + sched -> availability[0] == 2);
+
+  //waiting for a piece nobody has times out
+  piecesched_removeProvider(sched, b);
+  piecesched_removeProvider(sched, c);
+  unsigned long* none = make_bitmap(0, 0);
+  int e = piecesched_addProvider(sched, none);
+  assert(piecesched_claim(sched, e, 20) == PIECESCHED_WAIT);
+  assert(piecesched_wait(sched, 20) == 1);
+  free(none);
+  piecesched_destroy(sched);
+  printf("SUCCESS!!\n");
+}
+
+
+typedef struct claimer{
+  pieceSched_t* sched;
+  int* holding;        // providers holding each piece at the moment
+  int exclusive;       // nobody else may hold a piece held
+  unsigned int seed;
+  long done;           // pieces it completed first
+}claimer_t;
+
+/* a provider thread: claims, fails one piece in ten, completes the others, until every piece is done */
+static void* claim_all(void* arg) {
+  claimer_t* claimer = (claimer_t*) arg;
+  pieceSched_t* sched = claimer -> sched;
+  unsigned long* bitmap = NULL;
+  if (rand_r(&(claimer -> seed)) % 3 == 0) {
+    bitmap = (unsigned long*) calloc(PIECESCHED_WORDS(BIG_PIECE_NUM), sizeof(unsigned long));
+    int i;
+    for (i = 0; i < BIG_PIECE_NUM; i += 2) {
+      bitmap[i / PIECESCHED_BITS] |= 1UL << (i % PIECESCHED_BITS);
+    }
+  }
+  int slot = piecesched_addProvider(sched, bitmap);
+  free(bitmap);
+  assert(slot >= 0);
+  int piece;
+  while ((piece = piecesched_claim(sched, slot, 5)) != PIECESCHED_FINISHED) {
+    if (piece == PIECESCHED_WAIT) continue;
+    int before = __atomic_fetch_add(&(claimer -> holding[piece]), 1, __ATOMIC_SEQ_CST);
+    assert(!claimer -> exclusive || before == 0);
+    __atomic_sub_fetch(&(claimer -> holding[piece]), 1, __ATOMIC_SEQ_CST);
+    if (rand_r(&(claimer -> seed)) % 10 == 0) {
+      piecesched_fail(sched, slot, piece);
+    } else {
+      claimer -> done += piecesched_complete(sched, slot, piece);
+    }
+  }
+  piecesched_removeProvider(sched, slot);
+  return NULL;
+}
+
+/* stalls every piece assigned, until every piece is done */
+static void* reap_all(void* arg) {
+  pieceSched_t* sched = (pieceSched_t*) arg;
+  while (piecesched_wait(sched, 1) != PIECESCHED_FINISHED) {
+    piecesched_reapStalled(sched, piecesched_now() + 1000);
+  }
+  return NULL;
+}
+
+void test_piecesched_threads() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "piecesched_claim (threads)");
+
+  int round;
+  for (round = 0; round < 2; round++) {
+    //first every piece held by one provider at a time, then with every piece stalling and handed on
+    pieceSched_t* sched = piecesched_init((long) BIG_PIECE_NUM * PIECE_LEN, PIECE_LEN, THREAD_NUM, 8, 1000);
+    int* holding = (int*) calloc(BIG_PIECE_NUM, sizeof(int));
+    claimer_t claimers[THREAD_NUM];
+    pthread_t threads[THREAD_NUM];
+    pthread_t reaper;
+    int i;
+    for (i = 0; i < THREAD_NUM; i++) {
+      claimers[i].sched = sched;
+      claimers[i].holding = holding;
+      claimers[i].exclusive = (round == 0);
+      claimers[i].seed = i + 1;
+      claimers[i].done = 0;
+      pthread_create(&threads[i], NULL, claim_all, &claimers[i]);
+    }
+    if (round == 1) {
+      pthread_create(&reaper, NULL, reap_all, sched);
+    }
+    long done = 0;
+    for (i = 0; i < THREAD_NUM; i++) {
+      pthread_join(threads[i], NULL);
+      done += claimers[i].done;
+    }
+    if (round == 1) {
+      pthread_join(reaper, NULL);
+    }
+
+    //every piece done once
+    assert(done == BIG_PIECE_NUM && sched -> doneNum == BIG_PIECE_NUM && sched -> activeNum == 0);
+    unsigned long* have = piecesched_copyHave(sched);
+    for (i = 0; i < BIG_PIECE_NUM; i++) {
+      assert(PIECESCHED_HAS(have, i) && sched -> owner[i] == PIECESCHED_DONE);
+    }
+    free(have);
+    free(holding);
+    piecesched_destroy(sched);
+  }
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions for scheduling piece downloads.
+int main() {
+  test_piecesched_sizes();
+  test_piecesched_rarest();
+  test_piecesched_outstanding();
+  test_piecesched_handBack();
+  test_piecesched_threads();
+  return 0;
+}
@@ -0,0 +1,252 @@
+//File: pipeline_bench.c
+
+//Description: Times downloading one file from one peer through a proxy adding D ms of round trip, as on a link
+// between two hosts, with the provider sending at most R bytes per second.  The downloader keeps at most 1
+// request outstanding (a piece per round trip, as the READY/SEND/SUCCESS lockstep of p2pcommuicate.c did), 4
+// (the fixed window transfer.c had) and TRANSFER_MAX_WINDOW, the window then sized to the rate (see
+// transfer_window).  With one request the time is set by the round trip, with the adaptive window by R: near
+// R MB/s, however long the round trip.  Every download is checked against the original file.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -O2 -pthread -o pipeline_bench pipeline_bench.c ../peer/transfer.c ../peer/piecesched.c ../peer/connpool.c ../peer/filecache.c ../peer/piecejournal.c
+
+//To run:
+// ./pipeline_bench [-s file MB] [-r provider MB/s] [-d round trip ms] [-p piece KB]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <assert.h>
+
+#include "../peer/transfer.h"
+
+
+#define PROXY_CHUNK (64 * 1024)
+
+
+static char srcDir[] = "/tmp/pipeline_benchsrcXXXXXX";
+static char dstDir[] = "/tmp/pipeline_benchdstXXXXXX";
+
+
+/* bytes read from one end, to be written to the other once due */
+typedef struct chunk{
+  unsigned long due;
+  int len;                  // 0 once the end read from closed
+  char* data;
+  struct chunk* next;
+}chunk_t;
+
+/* one direction of a proxied connection: a thread reads, another writes half a round trip later */
+typedef struct pipe{
+  int from;
+  int to;
+  unsigned long delayMs;
+  chunk_t* head;
+  chunk_t* tail;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+}pipe_t;
+
+typedef struct proxy{
+  int listenfd;
+  int upstreamPort;
+  unsigned long delayMs;    // each way
+}proxy_t;
+
+
+static unsigned long now_ms() {
+  return piecesched_now();
+}
+
+/* a listening socket on loopback, its port in port */
+static int listen_any(int* port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrLen = sizeof(addr);
+  assert(bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0 && listen(fd, 16) == 0);
+  getsockname(fd, (struct sockaddr*) &addr, &addrLen);
+  *port = ntohs(addr.sin_port);
+  return fd;
+}
+
+static void* pipe_read(void* arg) {
+  pipe_t* p = (pipe_t*) arg;
+  while (1) {
+    chunk_t* chunk = (chunk_t*) malloc(sizeof(chunk_t));
+    chunk -> data = (char*) malloc(PROXY_CHUNK);
+    ssize_t n = recv(p -> from, chunk -> data, PROXY_CHUNK, 0);
+    chunk -> len = (n > 0) ? (int) n : 0;
+    chunk -> due = now_ms() + p -> delayMs;
+    chunk -> next = NULL;
+    pthread_mutex_lock(&(p -> mutex));
+    if (p -> tail == NULL) p -> head = chunk;
+    else p -> tail -> next = chunk;
+    p -> tail = chunk;
+    pthread_cond_signal(&(p -> cond));
+    pthread_mutex_unlock(&(p -> mutex));
+    if (n <= 0) break;
+  }
+  return NULL;
+}
+
+static void* pipe_write(void* arg) {
+  pipe_t* p = (pipe_t*) arg;
+  int open = 1;
+  while (open) {
+    pthread_mutex_lock(&(p -> mutex));
+    while (p -> head == NULL) pthread_cond_wait(&(p -> cond), &(p -> mutex));
+    chunk_t* chunk = p -> head;
+    p -> head = chunk -> next;
+    if (p -> head == NULL) p -> tail = NULL;
+    pthread_mutex_unlock(&(p -> mutex));
+
+    unsigned long now = now_ms();
+    if (chunk -> due > now) usleep((chunk -> due - now) * 1000);
+    if (chunk -> len == 0 || send(p -> to, chunk -> data, chunk -> len, MSG_NOSIGNAL) != chunk -> len) {
+      shutdown(p -> to, SHUT_WR);
+      shutdown(p -> from, SHUT_RD);
+      open = 0;
+    }
+    free(chunk -> data);
+    free(chunk);
+  }
+  return NULL;
+}
+
+/* forwards every connection accepted to the upstream port, each way delayMs later */
+static void* proxy_accept(void* arg) {
+  proxy_t* proxy = (proxy_t*) arg;
+  int fd;
+  while ((fd = accept(proxy -> listenfd, NULL, NULL)) >= 0) {
+    int up = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(proxy -> upstreamPort);
+    assert(connect(up, (struct sockaddr*) &addr, sizeof(addr)) == 0);
+
+    pipe_t* pipes = (pipe_t*) calloc(2, sizeof(pipe_t));
+    int i;
+    for (i = 0; i < 2; i++) {
+      pipes[i].from = (i == 0) ? fd : up;
+      pipes[i].to = (i == 0) ? up : fd;
+      pipes[i].delayMs = proxy -> delayMs;
+      pthread_mutex_init(&(pipes[i].mutex), NULL);
+      pthread_cond_init(&(pipes[i].cond), NULL);
+      pthread_t thread;
+      pthread_create(&thread, NULL, pipe_read, &pipes[i]);
+      pthread_detach(thread);
+      pthread_create(&thread, NULL, pipe_write, &pipes[i]);
+      pthread_detach(thread);
+    }
+  }
+  return NULL;
+}
+
+/* a file of size bytes of noise under dir */
+static char* make_file(const char* dir, const char* name, long size) {
+  char* data = (char*) malloc(size);
+  long i;
+  for (i = 0; i < size; i++) {
+    data[i] = (char) (rand() >> 7);
+  }
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE* file = fopen(path, "w");
+  assert(file != NULL && fwrite(data, 1, size, file) == (size_t) size);
+  fclose(file);
+  return data;
+}
+
+/* whether the file under dir holds exactly data */
+static int same_file(const char* dir, const char* name, const char* data, long size) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return 0;
+  char* got = (char*) malloc(size + 1);
+  long n = fread(got, 1, size + 1, file);
+  fclose(file);
+  int same = (n == size && memcmp(got, data, size) == 0);
+  free(got);
+  return same;
+}
+
+
+int main(int argc, char* argv[]) {
+  long sizeMb = 16;
+  long rateMb = 32;
+  int rttMs = 40;
+  int pieceKb = 64;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:r:d:p:h")) != -1) {
+    switch (opt) {
+      case 's': sizeMb = atol(optarg); break;
+      case 'r': rateMb = atol(optarg); break;
+      case 'd': rttMs = atoi(optarg); break;
+      case 'p': pieceKb = atoi(optarg); break;
+      default:
+        printf("usage: %s [-s file MB (16)] [-r provider MB/s (32)] [-d round trip ms (40)] [-p piece KB (64)]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (sizeMb <= 0 || rateMb <= 0 || rttMs < 0 || pieceKb <= 0) {
+    printf("%s: error: %ldMB, %ldMB/s, %dms, %dKB pieces\n", __func__, sizeMb, rateMb, rttMs, pieceKb);
+    return 1;
+  }
+  assert(mkdtemp(srcDir) != NULL && mkdtemp(dstDir) != NULL);
+
+  long size = sizeMb * 1024 * 1024;
+  char* data = make_file(srcDir, "bench.bin", size);
+  transfer_t* provider = transfer_init(srcDir, pieceKb * 1024, rateMb * 1024 * 1024);
+  proxy_t proxy;
+  proxy.upstreamPort = transfer_listen(provider, 0);
+  proxy.delayMs = rttMs / 2;
+  transferProvider_t addr;
+  strcpy(addr.ip, "127.0.0.1");
+  proxy.listenfd = listen_any(&(addr.port));
+  pthread_t accepter;
+  pthread_create(&accepter, NULL, proxy_accept, &proxy);
+
+  printf("%ldMB file, %dKB pieces, provider at %ldMB/s, %dms round trip\n", sizeMb, pieceKb, rateMb, rttMs);
+  printf("most requests     time    MB/s  requests  batches\n");
+  int windows[3] = {1, TRANSFER_WINDOW, TRANSFER_MAX_WINDOW};
+  int i;
+  for (i = 0; i < 3; i++) {
+    transfer_t* peer = transfer_init(dstDir, pieceKb * 1024, 0);
+    peer -> maxWindow = windows[i];
+    unsigned long start = now_ms();
+    assert(transfer_download(peer, "bench.bin", size, 0, &addr, 1) == 1);
+    double took = (now_ms() - start) / 1000.0;
+    assert(same_file(dstDir, "bench.bin", data, size));
+    printf("%13d  %6.2fs  %6.1f  %8ld  %7ld\n", windows[i], took, sizeMb / took, peer -> requests, peer -> requestBatches);
+    transfer_destroy(peer);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/bench.bin", dstDir);
+    unlink(path);
+  }
+
+  //the proxy's threads end with the connections, the process with them
+  shutdown(proxy.listenfd, SHUT_RDWR);
+  pthread_join(accepter, NULL);
+  close(proxy.listenfd);
+  transfer_destroy(provider);
+  char path[512];
+  snprintf(path, sizeof(path), "%s/bench.bin", srcDir);
+  unlink(path);
+  rmdir(srcDir);
+  rmdir(dstDir);
+  free(data);
+  return 0;
+}
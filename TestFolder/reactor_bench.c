@@ -0,0 +1,220 @@
+//File: reactor_bench.c
+
+//Description: Benchmark of the tracker's epoll reactor.  Simulates a swarm of peers on loopback,
+// every peer connects, sends REGISTER and waits for the setup packet.  Reports handshake latency
+// (REGISTER sent -> setup received) for the reactor and for the old one-thread-per-peer model.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -O2 -pthread -o reactor_bench reactor_bench.c ../tracker/reactor.c ../tracker/metrics.c ../common/pkt.c ../common/merkle.c ../common/filecodec.c ../common/peerid.c ../common/filetable.c ../common/filedelta.c
+
+//To run (defaults to 5000 peers):
+// ./reactor_bench [peerNum]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <assert.h>
+
+#include "../common/pkt.h"
+#include "../tracker/reactor.h"
+
+#define SETUP_PKT_LEN (6 * sizeof(int) + 3 * sizeof(unsigned long))   // header only, the table is empty
+
+
+static double now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void* a, const void* b) {
+  double x = *(double*) a, y = *(double*) b;
+  return (x > y) - (x < y);
+}
+
+//answer a REGISTER with the same (empty table) setup packet the tracker sends
+static void bench_onPacket(int connfd, ptp_peer_t* pkt) {
+  if (pkt -> type == REGISTER) {
+    ptp_tracker_t setup;
+    pkt_config_trackerPkt(&setup, HEARTBEAT_INTERVAL, PIECE_LENGTH, 0, NULL);
+    pkt_tracker_sendPkt(connfd, &setup, NULL);
+  }
+}
+
+//the old model: one blocking thread per peer
+static void* bench_handshakeThread(void* arg) {
+  int connfd = (int)(long) arg;
+  ptp_peer_t pkt;
+  char buf[1 << 12];
+  int len = 0;
+
+  while (1) {
+    int n = recv(connfd, buf + len, sizeof(buf) - len, 0);
+    if (n <= 0) break;
+    len += n;
+    int frameLen = pkt_peer_frameLen(buf, len);
+    if (frameLen > 0 && len >= frameLen) {
+      pkt_peer_decodePkt(buf, &pkt);
+      bench_onPacket(connfd, &pkt);
+      memmove(buf, buf + frameLen, len - frameLen);
+      len -= frameLen;
+    }
+  }
+  close(connfd);
+  return NULL;
+}
+
+static void* bench_threadPerPeerAccept(void* arg) {
+  int listenfd = (int)(long) arg;
+  while (1) {
+    int connfd = accept(listenfd, NULL, NULL);
+    if (connfd < 0) continue;
+    pthread_t t;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&t, &attr, bench_handshakeThread, (void*)(long) connfd) != 0) {
+      close(connfd);
+    }
+    pthread_attr_destroy(&attr);
+  }
+  return NULL;
+}
+
+static void* bench_reactorAccept(void* arg) {
+  reactor_run((reactor_t*) arg);
+  return NULL;
+}
+
+static int bench_listen(struct sockaddr_in* addr) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(addr, 0, sizeof(*addr));
+  addr -> sin_family = AF_INET;
+  addr -> sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr -> sin_port = 0;
+  assert(bind(fd, (struct sockaddr*) addr, sizeof(*addr)) == 0);
+  assert(listen(fd, 65535) == 0);
+  socklen_t len = sizeof(*addr);
+  getsockname(fd, (struct sockaddr*) addr, &len);
+  return fd;
+}
+
+/*
+  Connect peerNum simulated peers to addr, fire all REGISTERs and wait for every setup packet.
+  Prints latency percentiles.
+*/
+static void bench_swarm(const char* label, struct sockaddr_in* addr, int peerNum) {
+  int* fds = malloc(peerNum * sizeof(int));
+  int* got = calloc(peerNum, sizeof(int));
+  double* start = malloc(peerNum * sizeof(double));
+  double* latency = malloc(peerNum * sizeof(double));
+  int i;
+
+  for (i = 0; i < peerNum; i++) {
+    fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fds[i] >= 0);
+    if (connect(fds[i], (struct sockaddr*) addr, sizeof(*addr)) < 0) {
+      printf("connect %d failed: %s\n", i, strerror(errno));
+      exit(1);
+    }
+  }
+
+  int epfd = epoll_create1(0);
+  for (i = 0; i < peerNum; i++) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev);
+  }
+
+  ptp_peer_t reg;
+  memset(&reg, 0, sizeof(reg));
+  pkt_config_peerPkt(&reg, REGISTER, "127.0.0.1", 0, 0, NULL);
+
+  double t0 = now_us();
+  for (i = 0; i < peerNum; i++) {
+    start[i] = now_us();
+    pkt_peer_sendPkt(fds[i], &reg, NULL);
+  }
+
+  int done = 0;
+  struct epoll_event events[256];
+  char buf[SETUP_PKT_LEN];
+  while (done < peerNum) {
+    int n = epoll_wait(epfd, events, 256, 10000);
+    if (n <= 0) {
+      printf("%s: timed out with %d/%d handshakes done\n", label, done, peerNum);
+      break;
+    }
+    int k;
+    for (k = 0; k < n; k++) {
+      int idx = events[k].data.u32;
+      int r = recv(fds[idx], buf, SETUP_PKT_LEN - got[idx], 0);
+      if (r <= 0) continue;
+      got[idx] += r;
+      if (got[idx] == (int) SETUP_PKT_LEN) {
+        latency[done++] = now_us() - start[idx];
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fds[idx], NULL);
+      }
+    }
+  }
+  double total = now_us() - t0;
+
+  qsort(latency, done, sizeof(double), cmp_double);
+  if (done > 0) {
+    printf("%-16s peers=%d  total=%.1fms  handshakes/s=%.0f  p50=%.0fus  p99=%.0fus  max=%.0fus\n",
+        label, done, total / 1e3, done / (total / 1e6),
+        latency[done / 2], latency[(int)(done * 0.99)], latency[done - 1]);
+  }
+
+  for (i = 0; i < peerNum; i++) close(fds[i]);
+  close(epfd);
+  free(fds);
+  free(got);
+  free(start);
+  free(latency);
+}
+
+int main(int argc, char** argv) {
+  int peerNum = argc > 1 ? atoi(argv[1]) : 5000;
+
+  //every simulated peer costs two descriptors (client + tracker side)
+  struct rlimit rl;
+  getrlimit(RLIMIT_NOFILE, &rl);
+  rl.rlim_cur = rl.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &rl);
+  if (rl.rlim_cur < (rlim_t)(2 * peerNum + 64)) {
+    peerNum = (rl.rlim_cur - 64) / 2;
+    printf("descriptor limit too low, using %d peers\n", peerNum);
+  }
+
+  struct sockaddr_in addr;
+
+  //reactor
+  int listenfd = bench_listen(&addr);
+  reactor_t* reactor = reactor_init(listenfd, TRACKER_WORKER_NUM, bench_onPacket, NULL, NULL);
+  assert(reactor_start(reactor) > 0);
+  pthread_t acceptThread;
+  pthread_create(&acceptThread, NULL, bench_reactorAccept, reactor);
+  bench_swarm("reactor", &addr, peerNum);
+
+  //thread per peer
+  int listenfd2 = bench_listen(&addr);
+  pthread_t acceptThread2;
+  pthread_create(&acceptThread2, NULL, bench_threadPerPeerAccept, (void*)(long) listenfd2);
+  bench_swarm("thread-per-peer", &addr, peerNum);
+
+  return 0;
+}
@@ -0,0 +1,144 @@
+//File: reactor_test.c
+
+//Description: File that unit tests the outbound queues of reactor.c: table broadcasts superseding
+// each other, the per-connection budget and the drain callback.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -ggdb -pthread -o test reactor_test.c ../tracker/reactor.c ../tracker/metrics.c ../common/pkt.c ../common/merkle.c ../common/filecodec.c ../common/peerid.c ../common/filetable.c ../common/filedelta.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <assert.h>
+
+#include "../common/pkt.h"
+#include "../tracker/reactor.h"
+
+#define TEST_MSG_LEN (64 * 1024)
+
+static int drainedFd = -1;
+
+static void test_onPacket(int connfd, ptp_peer_t* pkt) {
+}
+
+static void test_onDrained(int connfd) {
+  __atomic_store_n(&drainedFd, connfd, __ATOMIC_RELEASE);
+}
+
+static pktBuf_t* test_makeBuf(char fill) {
+  pktBuf_t* buf = (pktBuf_t*) malloc(sizeof(pktBuf_t) + TEST_MSG_LEN);
+  buf -> refcount = 1;
+  buf -> len = TEST_MSG_LEN;
+  memset(buf -> data, fill, TEST_MSG_LEN);
+  return buf;
+}
+
+static peerConn_t* test_conn(reactor_t* reactor, int fd) {
+  pthread_mutex_lock(&(reactor -> connsMutex));
+  peerConn_t* conn = reactor -> conns[fd];
+  pthread_mutex_unlock(&(reactor -> connsMutex));
+  return conn;
+}
+
+static long test_outBytes(peerConn_t* conn) {
+  pthread_mutex_lock(&(conn -> outMutex));
+  long bytes = conn -> outBytes;
+  pthread_mutex_unlock(&(conn -> outMutex));
+  return bytes;
+}
+
+//the remote end never reads: broadcasts pile up until the socket is full, then replace each other
+void test_reactor_send_coalesce(reactor_t* reactor, int fd) {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "reactor_send (coalesce)");
+
+  peerConn_t* conn = test_conn(reactor, fd);
+  assert(conn != NULL);
+
+  int i;
+  for (i = 0; i < 64; i++) {
+    pktBuf_t* buf = test_makeBuf('a' + i % 26);
+    assert(reactor_send(reactor, fd, buf, REACTOR_MSG_TABLE) == REACTOR_SEND_OK);
+    assert(buf -> refcount >= 1);
+    pkt_buf_release(buf);
+  }
+
+  //at most the message partly on the wire plus the latest one are still queued
+  assert(test_outBytes(conn) <= 2 * TEST_MSG_LEN);
+  printf("SUCCESS!!\n");
+}
+
+//with a budget smaller than two messages the next broadcast is dropped
+void test_reactor_send_overflow(reactor_t* reactor, int fd) {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "reactor_send (overflow)");
+
+  peerConn_t* conn = test_conn(reactor, fd);
+  reactor -> outBudget = TEST_MSG_LEN;
+
+  //control messages are never dropped
+  pktBuf_t* ctrl = test_makeBuf('c');
+  assert(reactor_send(reactor, fd, ctrl, REACTOR_MSG_CONTROL) == REACTOR_SEND_OK);
+  pkt_buf_release(ctrl);
+
+  pktBuf_t* buf = test_makeBuf('z');
+  assert(reactor_send(reactor, fd, buf, REACTOR_MSG_TABLE) == REACTOR_SEND_OVERFLOW);
+  assert(buf -> refcount == 1);
+  pkt_buf_release(buf);
+
+  pthread_mutex_lock(&(conn -> outMutex));
+  assert(conn -> overflowed == 1);
+  pthread_mutex_unlock(&(conn -> outMutex));
+  printf("SUCCESS!!\n");
+}
+
+//once the remote end reads everything, the worker reports the drained connection
+void test_reactor_drain(reactor_t* reactor, int fd, int remote) {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "reactor onDrained");
+
+  peerConn_t* conn = test_conn(reactor, fd);
+  char sink[TEST_MSG_LEN];
+  while (__atomic_load_n(&drainedFd, __ATOMIC_ACQUIRE) != fd) {
+    if (recv(remote, sink, sizeof(sink), MSG_DONTWAIT) <= 0) usleep(1000);
+  }
+  assert(test_outBytes(conn) == 0);
+
+  //the connection is back under budget
+  pktBuf_t* buf = test_makeBuf('y');
+  assert(reactor_send(reactor, fd, buf, REACTOR_MSG_TABLE) == REACTOR_SEND_OK);
+  pkt_buf_release(buf);
+  printf("SUCCESS!!\n");
+}
+
+void test_reactor_send_closed(reactor_t* reactor) {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "reactor_send (unknown connection)");
+
+  pktBuf_t* buf = test_makeBuf('x');
+  assert(reactor_send(reactor, 100000, buf, REACTOR_MSG_CONTROL) == REACTOR_SEND_FAIL);
+  assert(buf -> refcount == 1);
+  pkt_buf_release(buf);
+  printf("SUCCESS!!\n");
+}
+
+int main() {
+  int sv[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+  int sndbuf = TEST_MSG_LEN;
+  setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+  reactor_t* reactor = reactor_init(-1, 1, test_onPacket, NULL, test_onDrained);
+  assert(reactor != NULL);
+  assert(reactor_start(reactor) > 0);
+  assert(reactor_addConnection(reactor, sv[0]) > 0);
+
+  test_reactor_send_coalesce(reactor, sv[0]);
+  test_reactor_send_overflow(reactor, sv[0]);
+  test_reactor_drain(reactor, sv[0], sv[1]);
+  test_reactor_send_closed(reactor);
+  return 0;
+}
@@ -0,0 +1,153 @@
+//File: sendfile_bench.c
+
+//Description: Measures the CPU a provider spends per GB served over loopback, with pieces sent by sendfile
+// (zeroCopy, see transfer_sendPiece) and read into a buffer then sent, as before.  The provider runs in a child
+// process so that its CPU time (user and system, from wait4) is counted apart from the downloader's; it serves
+// one file of S MB, downloaded N times in each mode.  Every download is checked against the original file.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -O2 -pthread -o sendfile_bench sendfile_bench.c ../peer/transfer.c ../peer/piecesched.c ../peer/connpool.c ../peer/filecache.c ../peer/piecejournal.c
+
+//To run:
+// ./sendfile_bench [-s file MB] [-n downloads] [-p piece KB]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <assert.h>
+
+#include "../peer/transfer.h"
+
+
+static char srcDir[] = "/tmp/sendfile_benchsrcXXXXXX";
+static char dstDir[] = "/tmp/sendfile_benchdstXXXXXX";
+
+
+/* a file of size bytes of noise under dir */
+static char* make_file(const char* dir, const char* name, long size) {
+  char* data = (char*) malloc(size);
+  long i;
+  for (i = 0; i < size; i++) {
+    data[i] = (char) (rand() >> 7);
+  }
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE* file = fopen(path, "w");
+  assert(file != NULL && fwrite(data, 1, size, file) == (size_t) size);
+  fclose(file);
+  return data;
+}
+
+/* whether the file under dir holds exactly data */
+static int same_file(const char* dir, const char* name, const char* data, long size) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return 0;
+  char* got = (char*) malloc(size + 1);
+  long n = fread(got, 1, size + 1, file);
+  fclose(file);
+  int same = (n == size && memcmp(got, data, size) == 0);
+  free(got);
+  return same;
+}
+
+static double seconds(struct timeval tv) {
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* serve the file from a child process, download it num times, and print the child's CPU time
+   @param zeroCopy [the provider's transfer -> zeroCopy] */
+static void run(int zeroCopy, const char* data, long size, int pieceLen, int num) {
+  int portPipe[2];
+  int stopPipe[2];
+  assert(pipe(portPipe) == 0 && pipe(stopPipe) == 0);
+  pid_t child = fork();
+  assert(child >= 0);
+  if (child == 0) {
+    //the provider: serves until the parent closes its end of stopPipe
+    close(portPipe[0]);
+    close(stopPipe[1]);
+    transfer_t* provider = transfer_init(srcDir, pieceLen, 0);
+    provider -> zeroCopy = zeroCopy;
+    int port = transfer_listen(provider, 0);
+    assert(write(portPipe[1], &port, sizeof(port)) == sizeof(port));
+    char c;
+    while (read(stopPipe[0], &c, 1) > 0);
+    assert(provider -> zeroCopied == (zeroCopy ? provider -> uploaded : 0));
+    transfer_destroy(provider);
+    _exit(0);
+  }
+  close(portPipe[1]);
+  close(stopPipe[0]);
+  transferProvider_t addr;
+  strcpy(addr.ip, "127.0.0.1");
+  assert(read(portPipe[0], &(addr.port), sizeof(addr.port)) == sizeof(addr.port));
+  close(portPipe[0]);
+
+  transfer_t* peer = transfer_init(dstDir, pieceLen, 0);
+  unsigned long start = piecesched_now();
+  int i;
+  for (i = 0; i < num; i++) {
+    assert(transfer_download(peer, "bench.bin", size, 0, &addr, 1) == 1);
+  }
+  double took = (piecesched_now() - start) / 1000.0;
+  assert(same_file(dstDir, "bench.bin", data, size));
+  transfer_destroy(peer);
+  char path[512];
+  snprintf(path, sizeof(path), "%s/bench.bin", dstDir);
+  unlink(path);
+
+  close(stopPipe[1]);
+  int status;
+  struct rusage usage;
+  assert(wait4(child, &status, 0, &usage) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  double gb = (double) size * num / (1024.0 * 1024 * 1024);
+  double user = seconds(usage.ru_utime);
+  double sys = seconds(usage.ru_stime);
+  printf("%-9s  %6.2fs  %7.1f  %8.3fs  %8.3fs  %8.3fs\n", zeroCopy ? "sendfile" : "buffered", took,
+    size * num / (1024.0 * 1024) / took, user / gb, sys / gb, (user + sys) / gb);
+}
+
+
+int main(int argc, char* argv[]) {
+  long sizeMb = 64;
+  int num = 16;
+  int pieceKb = 256;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:n:p:h")) != -1) {
+    switch (opt) {
+      case 's': sizeMb = atol(optarg); break;
+      case 'n': num = atoi(optarg); break;
+      case 'p': pieceKb = atoi(optarg); break;
+      default:
+        printf("usage: %s [-s file MB (64)] [-n downloads (16)] [-p piece KB (256)]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (sizeMb <= 0 || num <= 0 || pieceKb <= 0) {
+    printf("%s: error: %ldMB, %d downloads, %dKB pieces\n", __func__, sizeMb, num, pieceKb);
+    return 1;
+  }
+  assert(mkdtemp(srcDir) != NULL && mkdtemp(dstDir) != NULL);
+
+  long size = sizeMb * 1024 * 1024;
+  char* data = make_file(srcDir, "bench.bin", size);
+  printf("%ldMB file served %d times, %dKB pieces, provider CPU per GB served\n", sizeMb, num, pieceKb);
+  printf("mode         time     MB/s      user    system     total\n");
+  run(0, data, size, pieceKb * 1024, num);
+  run(1, data, size, pieceKb * 1024, num);
+
+  char path[512];
+  snprintf(path, sizeof(path), "%s/bench.bin", srcDir);
+  unlink(path);
+  rmdir(srcDir);
+  rmdir(dstDir);
+  free(data);
+  return 0;
+}
@@ -0,0 +1,324 @@
+//File: shard_bench.c
+
+//Description: Loopback harness for a sharded tracker.  Starts the tracker binary as 1 shard and then as
+// 4 shards on this machine, each shard on its own port and in its own process.  A swarm of simulated peers
+// registers with every shard, then each peer keeps adding files: every round its new files are routed to
+// their owning shards (see shardmap.c) as FILEUPDATE_DELTA packets, and the round ends once every shard
+// involved acknowledged them.  Broadcasts of the shards are received and acknowledged like a real peer does.
+// Reports the aggregate update throughput (files applied per second) and round latency for both layouts.
+
+//To compile (build the tracker first with make in the top directory):
+// gcc -Wall -pedantic -std=gnu99 -O2 -pthread -o shard_bench shard_bench.c ../common/shardmap.c ../common/pkt.c ../common/merkle.c ../common/filecodec.c ../common/peerid.c ../common/filetable.c ../common/filedelta.c
+
+//To run (defaults to 32 peers, 60 rounds of 16 files each):
+// ./shard_bench [trackerPath] [peerNum] [roundNum] [batch]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <assert.h>
+
+#include "../common/pkt.h"
+#include "../common/shardmap.h"
+
+#define MAX_SHARDS 4
+
+
+static char trackerPath[PATH_MAX];
+static int peerNum = 32;
+static int roundNum = 60;
+static int batch = 16;
+
+typedef struct benchPeer{
+  int index;
+  int shardNum;
+  int basePort;
+  shardMap_t* map;
+  int conns[MAX_SHARDS];
+  double* latencies;         // per round, in us
+  pthread_barrier_t* ready;  // every peer registered
+  pthread_barrier_t* start;  // the clock started
+}benchPeer_t;
+
+
+static double now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void* a, const void* b) {
+  double x = *(const double*) a, y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+static void free_tracker_pkt(ptp_tracker_t* pkt) {
+  fileEntry_t* iter = pkt -> filetableHeadPtr;
+  while (iter != NULL) {
+    fileEntry_t* next = iter -> next;
+    free(iter);
+    iter = next;
+  }
+  filedelta_freeList(pkt -> deltaHeadPtr);
+  pkt -> filetableHeadPtr = NULL;
+  pkt -> deltaHeadPtr = NULL;
+}
+
+/* connect to a shard on loopback, retrying while the tracker process is still starting */
+static int connect_shard(int port) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+
+  int attempt;
+  for (attempt = 0; attempt < 500; attempt++) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0) {
+      //acks and updates are small back to back writes, do not let them wait for each other
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      return fd;
+    }
+    close(fd);
+    usleep(10000);
+  }
+  printf("connect to port %d failed: %s\n", port, strerror(errno));
+  return -1;
+}
+
+/**
+ * handle one packet from a shard the way a peer does
+ * @return [the packet's type, -1 if the connection broke]
+ */
+static int handle_shard_pkt(int conn, char* ip, peerIdMap_t* ids, fileDeltaLog_t* log) {
+  ptp_tracker_t pkt;
+  memset(&pkt, 0, sizeof(pkt));
+  if (pkt_peer_recvPkt(conn, &pkt, ids) < 0) return -1;
+
+  if (pkt.type == TRACKER_ACK) {
+    filedelta_ack(log, pkt.ackVersion);
+  } else if (pkt.type == TRACKER_FILETABLE || pkt.type == TRACKER_DELTA) {
+    //acknowledge the epoch, so the shard's next broadcast to us only carries newer changes
+    ptp_peer_t ack;
+    memset(&ack, 0, sizeof(ack));
+    pkt_config_peerPkt(&ack, EPOCH_ACK, ip, 0, 0, NULL);
+    ack.ackedEpoch = pkt.epoch;
+    pkt_peer_sendPkt(conn, &ack, NULL);
+  }
+  free_tracker_pkt(&pkt);
+  return pkt.type;
+}
+
+static void* bench_peer(void* arg) {
+  benchPeer_t* peer = (benchPeer_t*) arg;
+  int shardNum = peer -> shardNum;
+  char ip[IP_LEN];
+  memset(ip, 0, IP_LEN);
+  sprintf(ip, "10.9.%d.%d", peer -> index / 250, peer -> index % 250 + 1);
+  peerIdMap_t* ids = peerid_init();
+  fileDeltaLog_t* logs[MAX_SHARDS];
+
+  //register with every shard and take its setup packet
+  int s;
+  for (s = 0; s < shardNum; s++) {
+    logs[s] = filedelta_initLog();
+    peer -> conns[s] = connect_shard(peer -> basePort + s);
+    assert(peer -> conns[s] >= 0);
+    ptp_peer_t reg;
+    memset(&reg, 0, sizeof(reg));
+    pkt_config_peerPkt(&reg, REGISTER, ip, 0, 0, NULL);
+    reg.tableVersion = 0;
+    pkt_config_peerShard(&reg, s, shardNum);
+    assert(pkt_peer_sendPkt(peer -> conns[s], &reg, NULL) > 0);
+    assert(handle_shard_pkt(peer -> conns[s], ip, ids, logs[s]) == TRACKER_FILETABLE);
+  }
+  pthread_barrier_wait(peer -> ready);
+  pthread_barrier_wait(peer -> start);
+
+  fileEntry_t entry;
+  memset(&entry, 0, sizeof(entry));
+  double lastKeepalive = now_us();
+  int r, k;
+  for (r = 0; r < roundNum; r++) {
+    double begin = now_us();
+
+    //long runs must not be taken for dead peers
+    if (begin - lastKeepalive > HEARTBEAT_INTERVAL * 1e6) {
+      for (s = 0; s < shardNum; s++) {
+        ptp_peer_t alive;
+        memset(&alive, 0, sizeof(alive));
+        pkt_config_peerPkt(&alive, KEEPALIVE, ip, 0, 0, NULL);
+        pkt_peer_sendPkt(peer -> conns[s], &alive, NULL);
+      }
+      lastKeepalive = begin;
+    }
+
+    //route every new file to its shard
+    for (k = 0; k < batch; k++) {
+      snprintf(entry.file_name, FILE_NAME_MAX_LEN, "peer%d/dir%d/file%d.txt", peer -> index, r % 8, r * batch + k);
+      entry.size = 1000 + k;
+      entry.timestamp = r + 1;
+      s = shardmap_owner(peer -> map, entry.file_name);
+      filedelta_record(logs[s], DELTA_ADD, &entry);
+    }
+
+    //one FILEUPDATE_DELTA per shard with changes
+    int waiting = 0;
+    int pending[MAX_SHARDS];
+    for (s = 0; s < shardNum; s++) {
+      int num;
+      unsigned long base, version;
+      fileDelta_t* deltas = filedelta_getPending(logs[s], &num, &base, &version);
+      pending[s] = num > 0;
+      if (num > 0) {
+        ptp_peer_t update;
+        memset(&update, 0, sizeof(update));
+        pkt_config_peerPkt(&update, FILEUPDATE_DELTA, ip, 0, 0, NULL);
+        pkt_config_peerDelta(&update, version, base, num, deltas);
+        assert(pkt_peer_sendPkt(peer -> conns[s], &update, ids) > 0);
+        waiting ++;
+      }
+      filedelta_freeList(deltas);
+    }
+
+    //the round is done once every shard applied its part, broadcasts keep arriving meanwhile
+    struct pollfd fds[MAX_SHARDS];
+    for (s = 0; s < shardNum; s++) {
+      fds[s].fd = peer -> conns[s];
+      fds[s].events = POLLIN;
+    }
+    while (waiting > 0) {
+      assert(poll(fds, shardNum, 10000) > 0);
+      for (s = 0; s < shardNum; s++) {
+        if (!(fds[s].revents & POLLIN)) continue;
+        int type = handle_shard_pkt(peer -> conns[s], ip, ids, logs[s]);
+        assert(type > 0);
+        if (type == TRACKER_ACK && pending[s] && logs[s] -> size == 0) {
+          pending[s] = 0;
+          waiting --;
+        }
+      }
+    }
+    peer -> latencies[r] = now_us() - begin;
+  }
+
+  for (s = 0; s < shardNum; s++) {
+    close(peer -> conns[s]);
+    filedelta_destroyLog(logs[s]);
+  }
+  peerid_destroy(ids);
+  return NULL;
+}
+
+/* start the shards as tracker processes working in dir, quiet */
+static void start_shards(pid_t* pids, int shardNum, int basePort, const char* dir) {
+  int s;
+  for (s = 0; s < shardNum; s++) {
+    pids[s] = fork();
+    assert(pids[s] >= 0);
+    if (pids[s] == 0) {
+      if (chdir(dir) < 0) _exit(1);
+      int devnull = open("/dev/null", O_WRONLY);
+      dup2(devnull, STDOUT_FILENO);
+      char shard[16], num[16], port[16];
+      sprintf(shard, "%d", s);
+      sprintf(num, "%d", shardNum);
+      sprintf(port, "%d", basePort);
+      execl(trackerPath, "tracker", shard, num, port, (char*) NULL);
+      _exit(1);
+    }
+  }
+}
+
+static void bench_layout(int shardNum, int basePort) {
+  char dir[] = "/tmp/shard_benchXXXXXX";
+  assert(mkdtemp(dir) != NULL);
+  pid_t pids[MAX_SHARDS];
+  start_shards(pids, shardNum, basePort, dir);
+
+  shardMap_t* map = shardmap_init(shardNum);
+  pthread_barrier_t ready, start;
+  pthread_barrier_init(&ready, NULL, peerNum + 1);
+  pthread_barrier_init(&start, NULL, peerNum + 1);
+  benchPeer_t* peers = (benchPeer_t*) calloc(peerNum, sizeof(benchPeer_t));
+  pthread_t* threads = (pthread_t*) malloc(peerNum * sizeof(pthread_t));
+  int i;
+  for (i = 0; i < peerNum; i++) {
+    peers[i].index = i;
+    peers[i].shardNum = shardNum;
+    peers[i].basePort = basePort;
+    peers[i].map = map;
+    peers[i].latencies = (double*) malloc(roundNum * sizeof(double));
+    peers[i].ready = &ready;
+    peers[i].start = &start;
+    pthread_create(&threads[i], NULL, bench_peer, &peers[i]);
+  }
+
+  pthread_barrier_wait(&ready);
+  double begin = now_us();
+  pthread_barrier_wait(&start);
+  for (i = 0; i < peerNum; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  double elapsed = now_us() - begin;
+
+  int total = peerNum * roundNum;
+  double* all = (double*) malloc(total * sizeof(double));
+  for (i = 0; i < peerNum; i++) {
+    memcpy(all + i * roundNum, peers[i].latencies, roundNum * sizeof(double));
+    free(peers[i].latencies);
+  }
+  qsort(all, total, sizeof(double), cmp_double);
+  long files = (long) total * batch;
+  printf("shards=%d  peers=%d  files=%ld  total=%.1fms  files/s=%.0f  round p50=%.0fus  p99=%.0fus  max=%.0fus\n",
+         shardNum, peerNum, files, elapsed / 1e3, files / (elapsed / 1e6),
+         all[total / 2], all[total * 99 / 100], all[total - 1]);
+
+  for (i = 0; i < shardNum; i++) {
+    kill(pids[i], SIGKILL);
+    waitpid(pids[i], NULL, 0);
+  }
+  char cmd[64];
+  sprintf(cmd, "rm -rf %s", dir);
+  assert(system(cmd) == 0);
+  free(all);
+  free(peers);
+  free(threads);
+  pthread_barrier_destroy(&ready);
+  pthread_barrier_destroy(&start);
+  shardmap_destroy(map);
+}
+
+int main(int argc, char** argv) {
+  const char* path = argc > 1 ? argv[1] : "../tracker/tracker";
+  if (argc > 2) peerNum = atoi(argv[2]);
+  if (argc > 3) roundNum = atoi(argv[3]);
+  if (argc > 4) batch = atoi(argv[4]);
+  if (realpath(path, trackerPath) == NULL || access(trackerPath, X_OK) < 0) {
+    printf("tracker binary %s not found, build it with make first\n", path);
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  //ports away from HANDSHAKE_PORT, so a tracker running here is left alone
+  int basePort = 20000 + (getpid() % 1000) * 10;
+  bench_layout(1, basePort);
+  bench_layout(MAX_SHARDS, basePort + 1);
+  return 0;
+}
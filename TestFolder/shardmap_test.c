@@ -0,0 +1,194 @@
+//File: shardmap_test.c
+
+//Description: File that unit tests the functions in shardmap.c.
+
+//To compile:
+// gcc -Wall -pedantic -std=c99 -ggdb -pthread -o test shardmap_test.c ../common/shardmap.c ../common/filetable.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../common/shardmap.h"
+
+#define NAME_NUM 100000
+
+
+static fileEntry_t* make_entry(const char* name, unsigned long timestamp) {
+  fileEntry_t* entry = (fileEntry_t*) calloc(1, sizeof(fileEntry_t));
+  strncpy(entry -> file_name, name, FILE_NAME_MAX_LEN - 1);
+  entry -> timestamp = timestamp;
+  return entry;
+}
+
+void test_shardmap_owner() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "shardmap_owner");
+
+  assert(shardmap_init(0) == NULL);
+
+  shardMap_t* single = shardmap_init(1);
+  assert(shardmap_owner(single, "a/b.txt") == 0);
+  shardmap_destroy(single);
+
+  //every shard gets a fair share of the paths
+  shardMap_t* map = shardmap_init(4);
+  assert(map -> pointNum == 4 * SHARDMAP_VNODES);
+  int counts[4] = {0, 0, 0, 0};
+  char name[FILE_NAME_MAX_LEN];
+  int i;
+  for (i = 0; i < NAME_NUM; i++) {
+    sprintf(name, "dir%d/file%d.txt", i % 97, i);
+    int shard = shardmap_owner(map, name);
+    assert(shard >= 0 && shard < 4);
+    counts[shard] ++;
+  }
+  for (i = 0; i < 4; i++) {
+    printf("shard %d owns %d of %d paths\n", i, counts[i], NAME_NUM);
+    assert(counts[i] > NAME_NUM / 4 * 7 / 10 && counts[i] < NAME_NUM / 4 * 13 / 10);
+  }
+
+  //the same shard count always gives the same owners
+  shardMap_t* again = shardmap_init(4);
+  for (i = 0; i < 1000; i++) {
+    sprintf(name, "dir%d/file%d.txt", i % 97, i);
+    assert(shardmap_owner(map, name) == shardmap_owner(again, name));
+  }
+  shardmap_destroy(again);
+  shardmap_destroy(map);
+  printf("SUCCESS!!\n");
+}
+
+void test_shardmap_grow() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "shardmap_owner (adding a shard)");
+
+  //a fifth shard only takes paths over, the others keep theirs
+  shardMap_t* four = shardmap_init(4);
+  shardMap_t* five = shardmap_init(5);
+  char name[FILE_NAME_MAX_LEN];
+  int moved = 0;
+  int i;
+  for (i = 0; i < NAME_NUM; i++) {
+    sprintf(name, "dir%d/file%d.txt", i % 97, i);
+    int before = shardmap_owner(four, name);
+    int after = shardmap_owner(five, name);
+    if (before != after) {
+      assert(after == 4);
+      moved ++;
+    }
+  }
+  printf("%d of %d paths moved to the new shard\n", moved, NAME_NUM);
+  assert(moved > NAME_NUM / 5 * 7 / 10 && moved < NAME_NUM / 5 * 13 / 10);
+  shardmap_destroy(four);
+  shardmap_destroy(five);
+  printf("SUCCESS!!\n");
+}
+
+void test_shardmap_selectEntries() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "shardmap_selectEntries");
+
+  shardMap_t* map = shardmap_init(3);
+  fileTable_t* table = filetable_init();
+  char name[FILE_NAME_MAX_LEN];
+  int i;
+  for (i = 0; i < 300; i++) {
+    sprintf(name, "file%d", i);
+    filetable_appendFileEntry(table, make_entry(name, i));
+  }
+
+  //the shards' selections split the table, in its order
+  int total = 0;
+  int shard;
+  for (shard = 0; shard < 3; shard++) {
+    int num;
+    fileEntry_t* owned = shardmap_selectEntries(map, shard, table -> head, &num);
+    assert(num > 0);
+    total += num;
+    int seen = 0;
+    unsigned long last = 0;
+    while (owned != NULL) {
+      fileEntry_t* next = owned -> next;
+      assert(shardmap_owner(map, owned -> file_name) == shard);
+      assert(seen == 0 || owned -> timestamp > last);
+      last = owned -> timestamp;
+      seen ++;
+      free(owned);
+      owned = next;
+    }
+    assert(seen == num);
+  }
+  assert(total == 300);
+  assert(table -> size == 300);
+
+  int num;
+  assert(shardmap_selectEntries(map, 0, NULL, &num) == NULL && num == 0);
+  filetable_destroy(table);
+  shardmap_destroy(map);
+  printf("SUCCESS!!\n");
+}
+
+void test_shardmap_mergeTable() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "shardmap_mergeTable");
+
+  shardMap_t* map = shardmap_init(2);
+  fileTable_t* view = filetable_init();
+
+  //each shard's full table, as broadcast
+  char name[FILE_NAME_MAX_LEN];
+  fileEntry_t* lists[2] = {NULL, NULL};
+  int sizes[2] = {0, 0};
+  int i;
+  for (i = 0; i < 100; i++) {
+    sprintf(name, "file%d", i);
+    int shard = shardmap_owner(map, name);
+    fileEntry_t* entry = make_entry(name, 1);
+    entry -> next = lists[shard];
+    lists[shard] = entry;
+    sizes[shard] ++;
+  }
+  assert(shardmap_mergeTable(map, 0, view, lists[0]) == sizes[0]);
+  assert(shardmap_mergeTable(map, 1, view, lists[1]) == sizes[1]);
+  assert(view -> size == 100);
+  printf("Successfully merged the tables of both shards.\n");
+
+  //shard 0 now lists a newer file0 only (plus a file it does not own), shard 1's files stay
+  int owner0 = shardmap_owner(map, "file0");
+  char foreign[FILE_NAME_MAX_LEN];
+  i = 0;
+  do {
+    sprintf(foreign, "other%d", i++);
+  } while (shardmap_owner(map, foreign) == owner0);
+  fileEntry_t* update = make_entry("file0", 5);
+  update -> next = make_entry(foreign, 5);
+  assert(shardmap_mergeTable(map, owner0, view, update) == 1);
+  assert(view -> size == sizes[1 - owner0] + 1);
+  assert(filetable_searchFileByName(view, "file0") -> timestamp == 5);
+  assert(filetable_searchFileByName(view, foreign) == NULL);
+  for (i = 0; i < 100; i++) {
+    sprintf(name, "file%d", i);
+    if (shardmap_owner(map, name) != owner0) {
+      assert(filetable_searchFileByName(view, name) != NULL);
+    }
+  }
+  printf("Successfully replaced one shard's part of the view.\n");
+
+  //an empty table clears the shard's part
+  assert(shardmap_mergeTable(map, owner0, view, NULL) == 0);
+  assert(view -> size == sizes[1 - owner0]);
+  filetable_destroy(view);
+  shardmap_destroy(map);
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions for the shard map.
+int main() {
+  test_shardmap_owner();
+  test_shardmap_grow();
+  test_shardmap_selectEntries();
+  test_shardmap_mergeTable();
+  return 0;
+}
@@ -0,0 +1,214 @@
+//File: snapshot_bench.c
+
+//Description: Contention benchmark of the tracker's file table.  64 updater threads keep changing
+// entries while a few reader threads serialize the whole table, as broadcasts and setup packets do.
+// Compares readers that hold filetable_mutex while encoding with readers that encode a published
+// copy-on-write snapshot.  Snapshot updaters publish once per batch, like one FILEUPDATE used to,
+// and a publish is skipped when a concurrent one already covered the batch.  Windowed updaters never
+// publish: one thread does every TRACKER_BROADCAST_WINDOW_MS, like the tracker's broadcast does now.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -O2 -pthread -o snapshot_bench snapshot_bench.c ../common/pkt.c ../common/merkle.c ../common/filecodec.c ../common/peerid.c ../common/filetable.c ../common/filedelta.c
+
+//To run (defaults to 64 updaters, 4 readers, 20000 files, 16 updates per published batch):
+// ./snapshot_bench [updaterNum] [readerNum] [fileNum] [batch]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <assert.h>
+
+#include "../common/pkt.h"
+
+#define BENCH_MUTEX 0      // readers lock the table
+#define BENCH_SNAPSHOT 1   // updaters publish a snapshot after every batch
+#define BENCH_WINDOWED 2   // a publisher thread publishes a snapshot once per broadcast window
+
+#define BENCH_SECONDS 2
+#define BENCH_MAX_SAMPLES 100000
+
+static fileTable_t* table;
+static int fileNum = 20000;
+static int batch = 16;
+static int mode = BENCH_MUTEX;
+static volatile int running = 0;
+static unsigned long epoch = 0;   // every update bumps it after the change, like the tracker's changelog
+
+typedef struct benchThread {
+  pthread_t tid;
+  unsigned int seed;
+  long ops;
+  double* samples;   // readers: latency of every encode (us)
+  int sampleNum;
+} benchThread_t;
+
+static double now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void* a, const void* b) {
+  double x = *(double*) a, y = *(double*) b;
+  return (x > y) - (x < y);
+}
+
+//change random entries, as syncFileEntry does for a FILEUPDATE
+static void* bench_updater(void* arg) {
+  benchThread_t* self = (benchThread_t*) arg;
+  char name[FILE_NAME_MAX_LEN];
+  fileEntry_t update;
+  memset(&update, 0, sizeof(update));
+
+  while (running) {
+    int i;
+    for (i = 0; i < batch; i++) {
+      sprintf(name, "file%d.txt", rand_r(&(self -> seed)) % fileNum);
+      fileEntry_t* entry = filetable_searchFileByName(table, name);
+      memcpy(update.file_name, name, FILE_NAME_MAX_LEN);
+      update.size = rand_r(&(self -> seed));
+      update.timestamp = self -> ops;
+      filetable_updateFile(entry, &update, table -> filetable_mutex);
+      __atomic_add_fetch(&epoch, 1, __ATOMIC_SEQ_CST);
+      self -> ops ++;
+    }
+    if (mode == BENCH_SNAPSHOT) {
+      pthread_mutex_lock(table -> filetable_mutex);
+      filetable_publishSnapshotLocked(table, __atomic_load_n(&epoch, __ATOMIC_SEQ_CST));
+      pthread_mutex_unlock(table -> filetable_mutex);
+    }
+  }
+  return NULL;
+}
+
+//serialize the whole table, as a broadcast or a setup packet does
+static void* bench_reader(void* arg) {
+  benchThread_t* self = (benchThread_t*) arg;
+  ptp_tracker_t pkt;
+
+  while (running) {
+    double start = now_us();
+    pktBuf_t* buf;
+    if (mode != BENCH_MUTEX) {
+      fileSnapshot_t* snapshot = filetable_acquireSnapshot(table);
+      pkt_config_trackerPkt(&pkt, HEARTBEAT_INTERVAL, PIECE_LENGTH, snapshot -> size, snapshot -> head);
+      buf = pkt_tracker_encodePkt(&pkt, NULL);
+      filetable_releaseSnapshot(snapshot);
+    } else {
+      pthread_mutex_lock(table -> filetable_mutex);
+      pkt_config_trackerPkt(&pkt, HEARTBEAT_INTERVAL, PIECE_LENGTH, table -> size, table -> head);
+      buf = pkt_tracker_encodePkt(&pkt, NULL);
+      pthread_mutex_unlock(table -> filetable_mutex);
+    }
+    pkt_buf_release(buf);
+
+    if (self -> sampleNum < BENCH_MAX_SAMPLES) {
+      self -> samples[self -> sampleNum ++] = now_us() - start;
+    }
+    self -> ops ++;
+  }
+  return NULL;
+}
+
+//publish what changed once per window, as the tracker's broadcast does
+static void* bench_publisher(void* arg) {
+  while (running) {
+    usleep(TRACKER_BROADCAST_WINDOW_MS * 1000);
+    pthread_mutex_lock(table -> filetable_mutex);
+    filetable_publishSnapshotLocked(table, __atomic_load_n(&epoch, __ATOMIC_SEQ_CST));
+    pthread_mutex_unlock(table -> filetable_mutex);
+  }
+  return NULL;
+}
+
+static void bench_run(const char* label, int updaterNum, int readerNum) {
+  benchThread_t* updaters = (benchThread_t*) calloc(updaterNum, sizeof(benchThread_t));
+  benchThread_t* readers = (benchThread_t*) calloc(readerNum, sizeof(benchThread_t));
+
+  running = 1;
+  int i;
+  for (i = 0; i < updaterNum; i++) {
+    updaters[i].seed = i + 1;
+    pthread_create(&(updaters[i].tid), NULL, bench_updater, &updaters[i]);
+  }
+  for (i = 0; i < readerNum; i++) {
+    readers[i].samples = (double*) malloc(BENCH_MAX_SAMPLES * sizeof(double));
+    pthread_create(&(readers[i].tid), NULL, bench_reader, &readers[i]);
+  }
+  pthread_t publisher;
+  if (mode == BENCH_WINDOWED) {
+    pthread_create(&publisher, NULL, bench_publisher, NULL);
+  }
+
+  sleep(BENCH_SECONDS);
+  running = 0;
+
+  long updates = 0, reads = 0;
+  int sampleNum = 0;
+  for (i = 0; i < updaterNum; i++) {
+    pthread_join(updaters[i].tid, NULL);
+    updates += updaters[i].ops;
+  }
+  for (i = 0; i < readerNum; i++) {
+    pthread_join(readers[i].tid, NULL);
+    reads += readers[i].ops;
+    sampleNum += readers[i].sampleNum;
+  }
+  if (mode == BENCH_WINDOWED) {
+    pthread_join(publisher, NULL);
+  }
+
+  double* samples = (double*) malloc((sampleNum + 1) * sizeof(double));
+  int n = 0;
+  for (i = 0; i < readerNum; i++) {
+    memcpy(samples + n, readers[i].samples, readers[i].sampleNum * sizeof(double));
+    n += readers[i].sampleNum;
+    free(readers[i].samples);
+  }
+  qsort(samples, n, sizeof(double), cmp_double);
+
+  printf("%-9s updaters=%d readers=%d files=%d  updates/s=%.0f  encodes/s=%.1f  encode p50=%.0fus p99=%.0fus\n",
+         label, updaterNum, readerNum, fileNum,
+         updates / (double) BENCH_SECONDS, reads / (double) BENCH_SECONDS,
+         n > 0 ? samples[n / 2] : 0, n > 0 ? samples[(int)(n * 0.99)] : 0);
+
+  free(samples);
+  free(updaters);
+  free(readers);
+}
+
+int main(int argc, char** argv) {
+  int updaterNum = argc > 1 ? atoi(argv[1]) : 64;
+  int readerNum = argc > 2 ? atoi(argv[2]) : 4;
+  if (argc > 3) fileNum = atoi(argv[3]);
+  if (argc > 4) batch = atoi(argv[4]);
+
+  table = filetable_init();
+  char name[FILE_NAME_MAX_LEN];
+  int i;
+  for (i = 0; i < fileNum; i++) {
+    fileEntry_t* entry = (fileEntry_t*) calloc(1, sizeof(fileEntry_t));
+    sprintf(name, "file%d.txt", i);
+    memcpy(entry -> file_name, name, FILE_NAME_MAX_LEN);
+    entry -> size = i;
+    filetable_appendFileEntry(table, entry);
+  }
+  pthread_mutex_lock(table -> filetable_mutex);
+  filetable_publishSnapshotLocked(table, 0);
+  pthread_mutex_unlock(table -> filetable_mutex);
+
+  mode = BENCH_MUTEX;
+  bench_run("mutex", updaterNum, readerNum);
+
+  mode = BENCH_SNAPSHOT;
+  bench_run("snapshot", updaterNum, readerNum);
+
+  mode = BENCH_WINDOWED;
+  bench_run("windowed", updaterNum, readerNum);
+
+  filetable_destroy(table);
+  return 0;
+}
@@ -0,0 +1,380 @@
+//File: statestore_test.c
+
+//Description: File that unit tests the functions in statestore.c: tables written by one store come
+// back the same through another, torn and stale change logs are handled, and how long a restart takes.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -ggdb -pthread -o test statestore_test.c ../tracker/statestore.c ../common/filetable.c ../common/peertable.c ../common/peerid.c ../common/timerwheel.c ../common/changelog.c ../common/filedelta.c ../common/filecodec.c ../common/utils.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "../tracker/statestore.h"
+#include "../common/filedelta.h"
+#include "../common/utils.h"
+
+
+static char* peerIps[] = {"10.0.0.1", "10.0.0.2", "192.168.1.77"};
+
+//the tables a tracker runs with
+typedef struct mockTracker{
+  fileTable_t* files;
+  peerTable_t* peers;
+  changeLog_t* log;
+  stateStore_t* store;
+}mockTracker_t;
+
+mockTracker_t* start_tracker(char* dir) {
+  mockTracker_t* tracker = calloc(1, sizeof(mockTracker_t));
+  tracker -> files = filetable_init();
+  tracker -> peers = peertable_init();
+  tracker -> log = changelog_init(CHANGELOG_CAPACITY);
+  tracker -> store = statestore_open(dir);
+  assert(tracker -> store != NULL);
+  assert(statestore_load(tracker -> store, tracker -> files, tracker -> peers) == 1);
+  changelog_restore(tracker -> log, tracker -> store -> epoch);
+  return tracker;
+}
+
+void stop_tracker(mockTracker_t* tracker) {
+  statestore_close(tracker -> store);
+  changelog_destroy(tracker -> log);
+  peertable_destroy(tracker -> peers);
+  filetable_destroy(tracker -> files);
+  free(tracker);
+}
+
+//what publishFileTable does
+void publish(mockTracker_t* tracker) {
+  pthread_mutex_lock(tracker -> files -> filetable_mutex);
+  filetable_publishSnapshotLocked(tracker -> files, changelog_getEpoch(tracker -> log));
+  pthread_mutex_unlock(tracker -> files -> filetable_mutex);
+  assert(statestore_appendChanges(tracker -> store, tracker -> files, tracker -> log, tracker -> peers) == 1);
+}
+
+void register_peer(mockTracker_t* tracker, char* ip, int sockfd, unsigned long version) {
+  //createEntry copies IP_LEN bytes
+  char peerIp[IP_LEN];
+  memset(peerIp, 0, IP_LEN);
+  strcpy(peerIp, ip);
+  peerEntry_t* peer = peertable_createEntry(peerIp, sockfd);
+  peertable_addEntry(tracker -> peers, peer);
+  peer -> tableVersion = version;
+  assert(statestore_appendPeer(tracker -> store, STATESTORE_PEER, ip, version) == 1);
+}
+
+//add num files, file i held by those of the first 1 + i % 3 peers that are registered
+void add_files(mockTracker_t* tracker, int from, int num) {
+  int i, j;
+  for (i = from; i < from + num; i++) {
+    fileEntry_t* entry = calloc(1, sizeof(fileEntry_t));
+    sprintf(entry -> file_name, "dir%d/file%d.txt", i % 7, i);
+    entry -> size = i * 4099;
+    entry -> timestamp = 1476000000 + i;
+    for (j = 0; j < 1 + i % 3; j++) {
+      peerEntry_t* peer = peertable_searchEntryByIp(tracker -> peers, peerIps[j]);
+      if (peer != NULL) filetable_addHolder(entry, peer -> id, tracker -> files -> filetable_mutex);
+    }
+    filetable_appendFileEntry(tracker -> files, entry);
+    changelog_record(tracker -> log, DELTA_ADD, entry -> file_name);
+  }
+}
+
+//the two trackers have the same files, held by the same peers (by ip), and the same peers
+void assert_same_tables(mockTracker_t* a, mockTracker_t* b) {
+  assert(a -> files -> size == b -> files -> size);
+  fileEntry_t* entry = a -> files -> head;
+  char ip[IP_LEN];
+  while (entry != NULL) {
+    fileEntry_t* other = filetable_searchFileByName(b -> files, entry -> file_name);
+    assert(other != NULL);
+    assert(other -> size == entry -> size && other -> timestamp == entry -> timestamp);
+    assert(other -> peerNum == entry -> peerNum);
+    int id;
+    for (id = filetable_nextHolder(entry, 0); id >= 0; id = filetable_nextHolder(entry, id + 1)) {
+      assert(peerid_getIp(a -> peers -> ids, id, ip) == 1);
+      assert(filetable_hasHolder(other, peerid_lookup(b -> peers -> ids, ip)));
+    }
+    entry = entry -> next;
+  }
+
+  assert(a -> peers -> size == b -> peers -> size);
+  peerEntry_t* peer = a -> peers -> head;
+  while (peer != NULL) {
+    peerEntry_t* other = peertable_searchEntryByIp(b -> peers, peer -> ip);
+    assert(other != NULL && other -> tableVersion == peer -> tableVersion);
+    //restored peers have no connection until they register again
+    assert(other -> sockfd == -1);
+    peer = peer -> next;
+  }
+}
+
+char* make_dir() {
+  char* dir = strdup("/tmp/statestoreXXXXXX");
+  assert(mkdtemp(dir) != NULL);
+  return dir;
+}
+
+void remove_dir(char* dir) {
+  char path[STATESTORE_PATH_LEN + 32];
+  sprintf(path, "%s/tables.snap", dir);
+  unlink(path);
+  sprintf(path, "%s/tables.log", dir);
+  unlink(path);
+  rmdir(dir);
+  free(dir);
+}
+
+long file_size(char* dir, char* name) {
+  char path[STATESTORE_PATH_LEN + 32];
+  sprintf(path, "%s/%s", dir, name);
+  struct stat st;
+  return stat(path, &st) == 0 ? (long) st.st_size : -1;
+}
+
+void test_statestore_log() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "statestore_appendChanges / statestore_appendPeer / statestore_load");
+
+  char* dir = make_dir();
+  mockTracker_t* tracker = start_tracker(dir);
+  assert(tracker -> store -> epoch == 0 && tracker -> files -> size == 0);
+  printf("Successfully started empty from an empty directory.\n");
+
+  int i;
+  for (i = 0; i < 3; i++) register_peer(tracker, peerIps[i], 10 + i, 5 + i);
+  add_files(tracker, 0, 30);
+  publish(tracker);
+
+  //a modify, a delete and a peer leaving, each in its own batch
+  fileEntry_t* entry = filetable_searchFileByName(tracker -> files, "dir1/file8.txt");
+  entry -> size = 1;
+  changelog_record(tracker -> log, DELTA_MODIFY, entry -> file_name);
+  publish(tracker);
+  assert(filetable_deleteFileEntryByName(tracker -> files, "dir2/file9.txt") > 0);
+  changelog_record(tracker -> log, DELTA_DELETE, "dir2/file9.txt");
+  publish(tracker);
+  peerEntry_t* gone = peertable_searchEntryByIp(tracker -> peers, "10.0.0.2");
+  filetable_deleteHolderFromAllEntries(tracker -> files, gone -> id);
+  peertable_deleteEntryByIp(tracker -> peers, "10.0.0.2");
+  assert(statestore_appendPeer(tracker -> store, STATESTORE_PEER_GONE, "10.0.0.2", 0) == 1);
+  peertable_searchEntryByIp(tracker -> peers, "10.0.0.1") -> tableVersion = 9;
+  assert(statestore_appendPeer(tracker -> store, STATESTORE_PEER, "10.0.0.1", 9) == 1);
+  assert(file_size(dir, "tables.snap") == -1);
+
+  mockTracker_t* restarted = start_tracker(dir);
+  assert(restarted -> store -> epoch == changelog_getEpoch(tracker -> log));
+  assert_same_tables(tracker, restarted);
+  assert(peertable_searchEntryByIp(restarted -> peers, "10.0.0.2") == NULL);
+  assert(changelog_record(restarted -> log, DELTA_ADD, "next.txt") == changelog_getEpoch(tracker -> log) + 1);
+  printf("Successfully replayed the change log, epochs go on from the restored table.\n");
+
+  stop_tracker(restarted);
+  stop_tracker(tracker);
+  remove_dir(dir);
+  printf("SUCCESS!!\n");
+}
+
+void test_statestore_snapshot() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "statestore_writeSnapshot");
+
+  char* dir = make_dir();
+  mockTracker_t* tracker = start_tracker(dir);
+  int i;
+  for (i = 0; i < 3; i++) register_peer(tracker, peerIps[i], 10 + i, 5 + i);
+  add_files(tracker, 0, 40);
+  publish(tracker);
+
+  assert(statestore_writeSnapshot(tracker -> store, tracker -> files, tracker -> peers) == 1);
+  assert(tracker -> store -> logBytes == 0 && tracker -> store -> generation == 1);
+  assert(file_size(dir, "tables.log") == (long) sizeof(stateLogHeader_t));
+  printf("Successfully folded the change log into a snapshot.\n");
+
+  //more changes on top of the snapshot
+  add_files(tracker, 40, 10);
+  publish(tracker);
+
+  mockTracker_t* restarted = start_tracker(dir);
+  assert(restarted -> store -> generation == 1);
+  assert(restarted -> store -> epoch == changelog_getEpoch(tracker -> log));
+  assert_same_tables(tracker, restarted);
+  printf("Successfully loaded the snapshot and the log after it.\n");
+
+  //the maintenance tick folds the log once the interval has passed
+  assert(statestore_maintain(restarted -> store, restarted -> files, restarted -> peers, getCurrentTime()) == 0);
+  assert(statestore_maintain(restarted -> store, restarted -> files, restarted -> peers, getCurrentTime() + TRACKER_SNAPSHOT_INTERVAL) == 1);
+  assert(restarted -> store -> generation == 2 && restarted -> store -> logBytes == 0);
+
+  stop_tracker(restarted);
+  stop_tracker(tracker);
+  remove_dir(dir);
+  printf("SUCCESS!!\n");
+}
+
+void test_statestore_manyPeers() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "statestore_writeSnapshot (more peers than ids to start with)");
+
+  //a file held by thousands of peers, every holder is kept through the snapshot and the log after it
+  int num = 3000;
+  char* dir = make_dir();
+  mockTracker_t* tracker = start_tracker(dir);
+  fileEntry_t* entry = calloc(1, sizeof(fileEntry_t));
+  strcpy(entry -> file_name, "popular.bin");
+  entry -> size = 7;
+  entry -> timestamp = 1476000000;
+  filetable_appendFileEntry(tracker -> files, entry);
+  changelog_record(tracker -> log, DELTA_ADD, entry -> file_name);
+
+  char ip[IP_LEN];
+  int i;
+  for (i = 0; i < num; i++) {
+    sprintf(ip, "172.16.%d.%d", i / 256, i % 256);
+    register_peer(tracker, ip, -1, 1);
+    peerEntry_t* peer = peertable_searchEntryByIp(tracker -> peers, ip);
+    assert(peer -> id == i);
+    assert(filetable_addHolder(entry, peer -> id, tracker -> files -> filetable_mutex) == 1);
+    if (i == num / 2) {
+      changelog_record(tracker -> log, DELTA_MODIFY, entry -> file_name);
+      publish(tracker);
+      assert(statestore_writeSnapshot(tracker -> store, tracker -> files, tracker -> peers) == 1);
+    }
+  }
+  changelog_record(tracker -> log, DELTA_MODIFY, entry -> file_name);
+  publish(tracker);
+  assert(entry -> peerNum == num);
+
+  mockTracker_t* restarted = start_tracker(dir);
+  assert_same_tables(tracker, restarted);
+  assert(filetable_searchFileByName(restarted -> files, "popular.bin") -> peerNum == num);
+  printf("Successfully restored a file with %d holders.\n", num);
+
+  stop_tracker(restarted);
+  stop_tracker(tracker);
+  remove_dir(dir);
+  printf("SUCCESS!!\n");
+}
+
+void test_statestore_tornLog() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "statestore_load (torn last record)");
+
+  char* dir = make_dir();
+  mockTracker_t* tracker = start_tracker(dir);
+  register_peer(tracker, peerIps[0], 10, 1);
+  add_files(tracker, 0, 5);
+  publish(tracker);
+  long good = file_size(dir, "tables.log");
+  register_peer(tracker, peerIps[1], 11, 2);
+  stop_tracker(tracker);
+
+  //the crash cut the last record short
+  char path[STATESTORE_PATH_LEN + 32];
+  sprintf(path, "%s/tables.log", dir);
+  assert(truncate(path, file_size(dir, "tables.log") - 3) == 0);
+
+  tracker = start_tracker(dir);
+  assert(tracker -> files -> size == 5 && tracker -> peers -> size == 1);
+  assert(file_size(dir, "tables.log") == good);
+  printf("Successfully dropped the torn record and cut the log back.\n");
+
+  //what is appended next is found by the next restart
+  register_peer(tracker, peerIps[2], 12, 3);
+  stop_tracker(tracker);
+  tracker = start_tracker(dir);
+  assert(tracker -> peers -> size == 2);
+  assert(peertable_searchEntryByIp(tracker -> peers, peerIps[2]) -> tableVersion == 3);
+  stop_tracker(tracker);
+  remove_dir(dir);
+  printf("SUCCESS!!\n");
+}
+
+void test_statestore_staleLog() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "statestore_load (log older than the snapshot)");
+
+  char* dir = make_dir();
+  mockTracker_t* tracker = start_tracker(dir);
+  register_peer(tracker, peerIps[0], 10, 1);
+  assert(statestore_appendPeer(tracker -> store, STATESTORE_PEER_GONE, peerIps[0], 0) == 1);
+  register_peer(tracker, peerIps[1], 11, 1);
+  add_files(tracker, 0, 1);
+  publish(tracker);
+
+  //keep the log as it was before the snapshot
+  char path[STATESTORE_PATH_LEN + 32];
+  sprintf(path, "%s/tables.log", dir);
+  long size = file_size(dir, "tables.log");
+  char* old = malloc(size);
+  FILE* file = fopen(path, "r");
+  assert(fread(old, 1, size, file) == (size_t) size);
+  fclose(file);
+
+  assert(statestore_writeSnapshot(tracker -> store, tracker -> files, tracker -> peers) == 1);
+  stop_tracker(tracker);
+
+  //the crash came after the rename, before the log was emptied
+  file = fopen(path, "w");
+  assert(fwrite(old, 1, size, file) == (size_t) size);
+  fclose(file);
+  free(old);
+
+  tracker = start_tracker(dir);
+  assert(peertable_searchEntryByIp(tracker -> peers, peerIps[0]) != NULL);
+  assert(tracker -> files -> size == 1 && tracker -> store -> logBytes == 0);
+  stop_tracker(tracker);
+  remove_dir(dir);
+  printf("Successfully ignored a log written before the snapshot.\n");
+  printf("SUCCESS!!\n");
+}
+
+double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+void test_statestore_restartTime() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "statestore_load (restart time)");
+
+  int num = 100000;
+  char* dir = make_dir();
+  mockTracker_t* tracker = start_tracker(dir);
+  int i;
+  for (i = 0; i < 3; i++) register_peer(tracker, peerIps[i], 10 + i, 1);
+  add_files(tracker, 0, num - 1000);
+  publish(tracker);
+  assert(statestore_writeSnapshot(tracker -> store, tracker -> files, tracker -> peers) == 1);
+  add_files(tracker, num - 1000, 1000);
+  publish(tracker);
+
+  double start = now_ms();
+  mockTracker_t* restarted = start_tracker(dir);
+  double elapsed = now_ms() - start;
+  assert(restarted -> files -> size == num);
+  printf("%d files restored in %.1fms (snapshot %.1fMB, log %.1fKB)\n", num, elapsed,
+    file_size(dir, "tables.snap") / (1024.0 * 1024.0), file_size(dir, "tables.log") / 1024.0);
+
+  stop_tracker(restarted);
+  stop_tracker(tracker);
+  remove_dir(dir);
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions for the state store.
+int main() {
+  test_statestore_log();
+  test_statestore_snapshot();
+  test_statestore_manyPeers();
+  test_statestore_tornLog();
+  test_statestore_staleLog();
+  test_statestore_restartTime();
+  return 0;
+}
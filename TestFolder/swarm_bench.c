@@ -0,0 +1,834 @@
+//File: swarm_bench.c
+
+//Description: Load generator for the tracker.  Opens one loopback connection per simulated peer (thousands
+// of them, driven by a few epoll threads), registers every peer and syncs its initial files, then replays
+// file churn for a fixed time: updates arrive at a target rate (steady, poisson or in bursts), each changes
+// a few files of a random peer picked by a uniform or zipf distribution over the peer's file slots (an absent
+// file is added, a present one modified or deleted), and goes out as a FILEUPDATE_DELTA the way a real peer
+// sends it.  Peers send KEEPALIVEs and acknowledge every broadcast with EPOCH_ACK.  They sync their files with
+// deltas only, also after a TRACKER_RESYNC: the tracker takes a full FILEUPDATE as the whole shared table, so
+// one from a peer holding just its own files would delete everybody else's.
+// Every changed entry carries its send time as timestamp, so each peer receiving it in a broadcast records
+// the fan-out latency (update sent -> broadcast received).  Reports update throughput, ack and fan-out latency
+// percentiles every second and overall, and the tracker's memory (RSS) and CPU time, so regressions show
+// up before a rollout.  Exits with 2 if a limit given with -L or -M is exceeded.
+
+//To compile (build the tracker first with make in the top directory):
+// gcc -Wall -pedantic -std=gnu99 -O2 -pthread -o swarm_bench swarm_bench.c ../common/pkt.c ../common/merkle.c ../common/filecodec.c ../common/peerid.c ../common/filetable.c ../common/filedelta.c ../tracker/metrics.c -lm
+
+//To run (starts ../tracker/tracker in a temporary directory, defaults in usage()):
+// ./swarm_bench [-t trackerPath | -p port [-P trackerPid]] [-n peers] [-T threads] [-d seconds] [-r updates/s]
+//               [-b files/update] [-f files/peer] [-D uniform|zipf] [-A steady|poisson|burst] [-x delete%]
+//               [-w windowMs] [-L fanoutP99Ms] [-M rssGrowthMB]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <limits.h>
+#include <stddef.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <assert.h>
+
+#include "../common/pkt.h"
+#include "../tracker/metrics.h"
+
+#define SWARM_MAX_THREADS 16
+#define SWARM_RECV_BUF 4096         // initial receive buffer of a peer, grown to the largest frame
+#define SWARM_EVENTS 256
+#define SWARM_SYNC_TIMEOUT 120      // in seconds, for every peer to register and sync its initial files
+
+#define DIST_UNIFORM 0
+#define DIST_ZIPF 1
+#define ARRIVAL_STEADY 0
+#define ARRIVAL_POISSON 1
+#define ARRIVAL_BURST 2
+
+#define PHASE_SYNC 0                // peers register and send their initial files, no churn
+#define PHASE_RUN 1                 // churn is replayed and measured
+#define PHASE_STOP 2
+
+
+/* one simulated peer, owned by one worker thread once registered */
+typedef struct swarmPeer{
+  int index;
+  int conn;
+  char ip[IP_LEN];
+  fileDeltaLog_t* log;         // changes the tracker has not acknowledged
+  unsigned long* stamps;       // per file slot, timestamp of the file's current version, 0 = no such file
+  int files;                   // slots holding a file
+  unsigned long inflight;      // table version of the update waiting for its TRACKER_ACK, 0 if none
+  int inflightFiles;
+  unsigned long sentAt;        // when it was sent, in us
+  unsigned long appliedEpoch;  // latest tracker epoch acknowledged
+  unsigned long seenStamp;     // newest change received in a broadcast
+  unsigned long nextKeepalive; // in us
+  int registered;              // setup packet received
+  int synced;                  // initial files acknowledged
+  char* in;                    // bytes received, not yet a whole packet
+  int inLen;
+  int inCap;
+}swarmPeer_t;
+
+/* a thread driving a share of the peers, its counters are read by the reporter while it runs */
+typedef struct swarmWorker{
+  int id;
+  pthread_t thread;
+  int epfd;
+  swarmPeer_t* peers;
+  int peerNum;
+  unsigned short seed[3];
+  unsigned long updatesSent;
+  unsigned long updatesAcked;
+  unsigned long filesAcked;
+  unsigned long broadcasts;
+  unsigned long fullTables;    // broadcasts carrying the whole table, the peer fell behind the change log
+  unsigned long recvBytes;
+  unsigned long resyncs;
+  unsigned long disconnects;
+  unsigned long maxLag;        // longest an update started after its planned time, in us
+  metricsHist_t* fanout;       // in us
+  metricsHist_t* ackRtt;       // in us
+}swarmWorker_t;
+
+
+static char trackerPath[PATH_MAX];
+static int port = 0;
+static pid_t trackerPid = 0;
+static int peerNum = 1000;
+static int threadNum = 4;
+static int duration = 20;
+static double rate = 200;
+static int batch = 4;
+static int filesPerPeer = 8;
+static int slotNum;                // file slots per peer, files come and go within them
+static int dist = DIST_UNIFORM;
+static int arrival = ARRIVAL_POISSON;
+static int deletePct = 10;
+static long windowMs = -1;         // -1: the tracker's default
+static double fanoutLimitMs = 0;
+static double rssLimitMB = 0;
+
+static double* zipfCdf;            // slot i is picked with probability proportional to 1 / (i + 1)
+static struct timespec benchStart;
+static int phase = PHASE_SYNC;
+static unsigned long measureStart; // changes stamped before it are not measured
+static int syncedPeers;
+static swarmWorker_t workers[SWARM_MAX_THREADS];
+
+
+/* microseconds since the bench started, never 0 */
+static unsigned long now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec - benchStart.tv_sec) * 1000000UL + ts.tv_nsec / 1000 - benchStart.tv_nsec / 1000 + 1;
+}
+
+static void usage(const char* name) {
+  printf("usage: %s [-t trackerPath | -p port [-P trackerPid]] [-n peers] [-T threads] [-d seconds] [-r updates/s]\n"
+         "       [-b files/update] [-f files/peer] [-D uniform|zipf] [-A steady|poisson|burst] [-x delete%%]\n"
+         "       [-w windowMs] [-L fanoutP99Ms] [-M rssGrowthMB]\n"
+         "defaults: -t ../tracker/tracker -n %d -T %d -d %d -r %.0f -b %d -f %d -D uniform -A poisson -x %d\n",
+         name, peerNum, threadNum, duration, rate, batch, filesPerPeer, deletePct);
+}
+
+/* a value of /proc/<pid>/status in kB (VmRSS, VmHWM), -1 if unknown */
+static long proc_status_kb(pid_t pid, const char* field) {
+  if (pid <= 0) return -1;
+  char path[64], line[256];
+  sprintf(path, "/proc/%d/status", (int) pid);
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return -1;
+  long kb = -1;
+  int len = strlen(field);
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (strncmp(line, field, len) == 0 && line[len] == ':') {
+      kb = atol(line + len + 1);
+      break;
+    }
+  }
+  fclose(file);
+  return kb;
+}
+
+/* user + system CPU time of a process in ms, -1 if unknown */
+static long proc_cpu_ms(pid_t pid) {
+  if (pid <= 0) return -1;
+  char path[64], buf[1024];
+  sprintf(path, "/proc/%d/stat", (int) pid);
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return -1;
+  int len = fread(buf, 1, sizeof(buf) - 1, file);
+  fclose(file);
+  buf[len > 0 ? len : 0] = '\0';
+  //fields after the command name, which may itself hold spaces: state is field 3, utime 14, stime 15
+  char* iter = strrchr(buf, ')');
+  if (iter == NULL) return -1;
+  unsigned long utime, stime;
+  if (sscanf(iter + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) return -1;
+  return (long) ((utime + stime) * 1000 / sysconf(_SC_CLK_TCK));
+}
+
+static void free_tracker_pkt(ptp_tracker_t* pkt) {
+  fileEntry_t* iter = pkt -> filetableHeadPtr;
+  while (iter != NULL) {
+    fileEntry_t* next = iter -> next;
+    free(iter);
+    iter = next;
+  }
+  filedelta_freeList(pkt -> deltaHeadPtr);
+  pkt -> filetableHeadPtr = NULL;
+  pkt -> deltaHeadPtr = NULL;
+}
+
+static void slot_name(swarmPeer_t* peer, int slot, char* name) {
+  snprintf(name, FILE_NAME_MAX_LEN, "swarm/peer%d/file%d.dat", peer -> index, slot);
+}
+
+/* file slot whose file changes next */
+static int pick_slot(swarmWorker_t* worker) {
+  if (dist == DIST_UNIFORM) return (int) (erand48(worker -> seed) * slotNum);
+  double u = erand48(worker -> seed);
+  int lo = 0, hi = slotNum - 1;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (zipfCdf[mid] < u) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+/* time from one update to the next of a worker, in us */
+static double next_gap(swarmWorker_t* worker, double workerRate) {
+  if (arrival == ARRIVAL_POISSON) return -log(1.0 - erand48(worker -> seed)) * 1e6 / workerRate;
+  return 1e6 / workerRate;
+}
+
+/**
+ * send the peer's pending changes, the way send_file_update_packet does
+ * @return [1 if sent, 0 if there was nothing to send, -1 if the connection broke]
+ */
+static int send_update(swarmWorker_t* worker, swarmPeer_t* peer) {
+  int num;
+  unsigned long base, version;
+  fileDelta_t* pending = filedelta_getPending(peer -> log, &num, &base, &version);
+  int ret = 0;
+  if (num > 0) {
+    ptp_peer_t pkt;
+    memset(&pkt, 0, sizeof(pkt));
+    pkt_config_peerPkt(&pkt, FILEUPDATE_DELTA, peer -> ip, 0, 0, NULL);
+    pkt_config_peerDelta(&pkt, version, base, num, pending);
+    ret = pkt_peer_sendPkt(peer -> conn, &pkt, NULL);
+  }
+  filedelta_freeList(pending);
+  if (ret <= 0) return ret;
+
+  peer -> inflight = version;
+  peer -> inflightFiles = num;
+  peer -> sentAt = now_us();
+  if (__atomic_load_n(&phase, __ATOMIC_RELAXED) == PHASE_RUN) __atomic_add_fetch(&(worker -> updatesSent), 1, __ATOMIC_RELAXED);
+  return 1;
+}
+
+/**
+ * the tracker lost track of the peer's versions (TRACKER_RESYNC): send every file the peer has on top of
+ * the version the tracker knows.  A real peer sends a full FILEUPDATE, but the tracker takes that as the
+ * whole shared table and would delete every other peer's files
+ * @return [1 if sent, -1 if the connection broke]
+ */
+static int send_resync(swarmWorker_t* worker, swarmPeer_t* peer, unsigned long trackerVersion) {
+  int num;
+  unsigned long base, version;
+  filedelta_freeList(filedelta_getPending(peer -> log, &num, &base, &version));
+
+  fileDelta_t* head = NULL;
+  int i;
+  for (i = slotNum - 1; i >= 0; i--) {
+    if (peer -> stamps[i] == 0) continue;
+    fileDelta_t* delta = (fileDelta_t*) calloc(1, sizeof(fileDelta_t));
+    delta -> op = DELTA_ADD;
+    delta -> version = version;
+    slot_name(peer, i, delta -> entry.file_name);
+    delta -> entry.size = 1000 + i;
+    delta -> entry.timestamp = peer -> stamps[i];
+    delta -> next = head;
+    head = delta;
+  }
+  ptp_peer_t pkt;
+  memset(&pkt, 0, sizeof(pkt));
+  pkt_config_peerPkt(&pkt, FILEUPDATE_DELTA, peer -> ip, 0, 0, NULL);
+  pkt_config_peerDelta(&pkt, version, trackerVersion, peer -> files, head);
+  int ret = pkt_peer_sendPkt(peer -> conn, &pkt, NULL);
+  filedelta_freeList(head);
+  if (ret < 0) return -1;
+
+  peer -> inflight = version;
+  peer -> inflightFiles = peer -> files;
+  peer -> sentAt = now_us();
+  if (__atomic_load_n(&phase, __ATOMIC_RELAXED) == PHASE_RUN) __atomic_add_fetch(&(worker -> updatesSent), 1, __ATOMIC_RELAXED);
+  return 1;
+}
+
+static void send_simple(swarmPeer_t* peer, int type, unsigned long ackedEpoch) {
+  ptp_peer_t pkt;
+  memset(&pkt, 0, sizeof(pkt));
+  pkt_config_peerPkt(&pkt, type, peer -> ip, 0, 0, NULL);
+  pkt.ackedEpoch = ackedEpoch;
+  pkt_peer_sendPkt(peer -> conn, &pkt, NULL);
+}
+
+/* change batch files of the peer, sent at once unless an update of it is still waiting for its ack */
+static void churn(swarmWorker_t* worker, swarmPeer_t* peer) {
+  fileEntry_t entry;
+  memset(&entry, 0, sizeof(entry));
+  unsigned long now = now_us();
+  int k;
+  for (k = 0; k < batch; k++) {
+    int slot = pick_slot(worker);
+    slot_name(peer, slot, entry.file_name);
+    entry.size = 1000 + slot;
+    //a file changed twice in the same microsecond must still look newer to the tracker
+    entry.timestamp = now > peer -> stamps[slot] ? now : peer -> stamps[slot] + 1;
+    if (peer -> stamps[slot] == 0) {
+      peer -> stamps[slot] = entry.timestamp;
+      peer -> files ++;
+      filedelta_record(peer -> log, DELTA_ADD, &entry);
+    } else if (erand48(worker -> seed) * 100 < deletePct) {
+      peer -> stamps[slot] = 0;
+      peer -> files --;
+      filedelta_record(peer -> log, DELTA_DELETE, &entry);
+    } else {
+      peer -> stamps[slot] = entry.timestamp;
+      filedelta_record(peer -> log, DELTA_MODIFY, &entry);
+    }
+  }
+  //like a real peer whose changes pile up while the tracker is busy, they go out together with the next ack
+  if (peer -> inflight == 0) {
+    send_update(worker, peer);
+  }
+}
+
+/* a change of another peer arrived, stamped with its send time */
+static void record_fanout(swarmWorker_t* worker, swarmPeer_t* peer, fileEntry_t* entry, unsigned long now, int overlap) {
+  if (__atomic_load_n(&phase, __ATOMIC_ACQUIRE) != PHASE_RUN || entry -> timestamp < measureStart) return;
+  //a broadcast overlapping the last one repeats its changes, count only those newer than everything seen
+  if (overlap && entry -> timestamp <= peer -> seenStamp) return;
+  if (entry -> timestamp > now) return;
+  metrics_histAdd(worker -> fanout, now - entry -> timestamp);
+}
+
+/* handle one packet from the tracker */
+static int handle_pkt(swarmWorker_t* worker, swarmPeer_t* peer, ptp_tracker_t* pkt) {
+  unsigned long now = now_us();
+  if (pkt -> type == TRACKER_ACK) {
+    filedelta_ack(peer -> log, pkt -> ackVersion);
+    if (peer -> inflight > 0 && pkt -> ackVersion >= peer -> inflight) {
+      if (__atomic_load_n(&phase, __ATOMIC_RELAXED) == PHASE_RUN) {
+        metrics_histAdd(worker -> ackRtt, now - peer -> sentAt);
+        __atomic_add_fetch(&(worker -> updatesAcked), 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&(worker -> filesAcked), peer -> inflightFiles, __ATOMIC_RELAXED);
+      }
+      peer -> inflight = 0;
+      if (!peer -> synced) {
+        peer -> synced = 1;
+        __atomic_add_fetch(&syncedPeers, 1, __ATOMIC_RELAXED);
+      }
+      //whatever changed meanwhile
+      if (send_update(worker, peer) < 0) return -1;
+    }
+  } else if (pkt -> type == TRACKER_RESYNC) {
+    __atomic_add_fetch(&(worker -> resyncs), 1, __ATOMIC_RELAXED);
+    if (send_resync(worker, peer, pkt -> ackVersion) < 0) return -1;
+  } else if (pkt -> type == TRACKER_FILETABLE || pkt -> type == TRACKER_DELTA) {
+    if (!peer -> registered) {
+      //the setup packet: announce the files we start with
+      peer -> registered = 1;
+      if (send_update(worker, peer) < 0) return -1;
+    } else {
+      __atomic_add_fetch(&(worker -> broadcasts), 1, __ATOMIC_RELAXED);
+      unsigned long newest = peer -> seenStamp;
+      if (pkt -> type == TRACKER_FILETABLE) {
+        __atomic_add_fetch(&(worker -> fullTables), 1, __ATOMIC_RELAXED);
+        fileEntry_t* iter;
+        for (iter = pkt -> filetableHeadPtr; iter != NULL; iter = iter -> next) {
+          record_fanout(worker, peer, iter, now, 1);
+          if (iter -> timestamp > newest) newest = iter -> timestamp;
+        }
+      } else {
+        int overlap = pkt -> baseEpoch < peer -> appliedEpoch;
+        fileDelta_t* iter;
+        for (iter = pkt -> deltaHeadPtr; iter != NULL; iter = iter -> next) {
+          if (iter -> op == DELTA_DELETE) continue;
+          record_fanout(worker, peer, &(iter -> entry), now, overlap);
+          if (iter -> entry.timestamp > newest) newest = iter -> entry.timestamp;
+        }
+      }
+      peer -> seenStamp = newest;
+    }
+    if (pkt -> epoch > peer -> appliedEpoch) peer -> appliedEpoch = pkt -> epoch;
+    send_simple(peer, EPOCH_ACK, peer -> appliedEpoch);
+  }
+  return 1;
+}
+
+/**
+ * read what arrived for a peer and handle every whole packet
+ * @return [1 if the connection is fine, -1 if it broke]
+ */
+static int drain_peer(swarmWorker_t* worker, swarmPeer_t* peer) {
+  while (1) {
+    if (peer -> inLen == peer -> inCap) {
+      peer -> inCap *= 2;
+      peer -> in = (char*) realloc(peer -> in, peer -> inCap);
+    }
+    ssize_t n = recv(peer -> conn, peer -> in + peer -> inLen, peer -> inCap - peer -> inLen, MSG_DONTWAIT);
+    if (n == 0) return -1;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+      return -1;
+    }
+    peer -> inLen += n;
+    __atomic_add_fetch(&(worker -> recvBytes), n, __ATOMIC_RELAXED);
+
+    int offset = 0;
+    while (1) {
+      int frameLen = pkt_tracker_frameLen(peer -> in + offset, peer -> inLen - offset);
+      if (frameLen < 0) return -1;
+      if (frameLen == 0 || frameLen > peer -> inLen - offset) {
+        //a large frame needs the buffer to hold it whole
+        while (frameLen > peer -> inCap) {
+          peer -> inCap *= 2;
+        }
+        if (peer -> inCap > peer -> inLen) peer -> in = (char*) realloc(peer -> in, peer -> inCap);
+        break;
+      }
+      ptp_tracker_t pkt;
+      memset(&pkt, 0, sizeof(pkt));
+      //holders are left out, a peer of the swarm never downloads
+      if (pkt_tracker_decodePkt(peer -> in + offset, &pkt, NULL) < 0) return -1;
+      int ret = handle_pkt(worker, peer, &pkt);
+      free_tracker_pkt(&pkt);
+      if (ret < 0) return -1;
+      offset += frameLen;
+    }
+    memmove(peer -> in, peer -> in + offset, peer -> inLen - offset);
+    peer -> inLen -= offset;
+  }
+}
+
+static void* swarm_worker(void* arg) {
+  swarmWorker_t* worker = (swarmWorker_t*) arg;
+  struct epoll_event events[SWARM_EVENTS];
+  double workerRate = rate / threadNum;
+  double nextOp = 0;         // planned time of the next update, in us
+  int burstLeft = 0;         // updates left in the current burst
+  unsigned long nextSweep = 0;
+
+  while (__atomic_load_n(&phase, __ATOMIC_ACQUIRE) != PHASE_STOP) {
+    int running = __atomic_load_n(&phase, __ATOMIC_ACQUIRE) == PHASE_RUN;
+    unsigned long now = now_us();
+    if (running && nextOp == 0) nextOp = now;
+
+    //replay the updates that are due, behind schedule they go out back to back
+    while (running && nextOp <= now && worker -> peerNum > 0) {
+      unsigned long lag = now - (unsigned long) nextOp;
+      if (lag > worker -> maxLag) __atomic_store_n(&(worker -> maxLag), lag, __ATOMIC_RELAXED);
+      swarmPeer_t* peer = &(worker -> peers[(int) (erand48(worker -> seed) * worker -> peerNum)]);
+      if (peer -> synced && peer -> conn >= 0) churn(worker, peer);
+
+      if (arrival == ARRIVAL_BURST) {
+        //a second's worth of updates at once, then quiet until the next second
+        if (burstLeft == 0) burstLeft = workerRate < 1.5 ? 1 : (int) (workerRate + 0.5);
+        if (-- burstLeft == 0) nextOp += 1e6;
+      } else {
+        nextOp += next_gap(worker, workerRate);
+      }
+    }
+
+    //peers that are not heard from for DEAD_PEER_TIMEOUT are dropped by the tracker
+    if (now >= nextSweep) {
+      int i;
+      for (i = 0; i < worker -> peerNum; i++) {
+        swarmPeer_t* peer = &(worker -> peers[i]);
+        if (peer -> registered && peer -> conn >= 0 && now >= peer -> nextKeepalive) {
+          send_simple(peer, KEEPALIVE, 0);
+          peer -> nextKeepalive += HEARTBEAT_INTERVAL * 1000000UL;
+        }
+      }
+      nextSweep = now + 1000000UL;
+    }
+
+    int timeout = 100;
+    if (running && nextOp > now && (nextOp - now) / 1000 < timeout) timeout = (int) ((nextOp - now) / 1000);
+    int n = epoll_wait(worker -> epfd, events, SWARM_EVENTS, timeout);
+    int i;
+    for (i = 0; i < n; i++) {
+      swarmPeer_t* peer = (swarmPeer_t*) events[i].data.ptr;
+      if (peer -> conn < 0) continue;
+      if (drain_peer(worker, peer) < 0) {
+        printf("peer %d lost its connection to the tracker\n", peer -> index);
+        epoll_ctl(worker -> epfd, EPOLL_CTL_DEL, peer -> conn, NULL);
+        close(peer -> conn);
+        peer -> conn = -1;
+        __atomic_add_fetch(&(worker -> disconnects), 1, __ATOMIC_RELAXED);
+      }
+    }
+  }
+  return NULL;
+}
+
+/* connect a peer to the tracker on loopback, retrying while the tracker process is still starting */
+static int connect_tracker() {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+
+  int attempt;
+  for (attempt = 0; attempt < 500; attempt++) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) break;
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0) {
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      return fd;
+    }
+    close(fd);
+    usleep(10000);
+  }
+  printf("connect to port %d failed: %s\n", port, strerror(errno));
+  return -1;
+}
+
+/* start the tracker in dir, quiet */
+static pid_t start_tracker(const char* dir) {
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    if (chdir(dir) < 0) _exit(1);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    char window[16], portArg[16];
+    sprintf(window, "%ld", windowMs);
+    sprintf(portArg, "%d", port);
+    if (windowMs >= 0) {
+      execl(trackerPath, "tracker", "-w", window, "0", "1", portArg, (char*) NULL);
+    } else {
+      execl(trackerPath, "tracker", "0", "1", portArg, (char*) NULL);
+    }
+    _exit(1);
+  }
+  return pid;
+}
+
+/* every worker's histogram summed into total */
+static void collect_hist(metricsHist_t* total, int fanout) {
+  memset(total, 0, sizeof(metricsHist_t));
+  int w;
+  for (w = 0; w < threadNum; w++) {
+    metrics_histMerge(total, fanout ? workers[w].fanout : workers[w].ackRtt);
+  }
+}
+
+static unsigned long collect_counter(size_t offset) {
+  unsigned long sum = 0;
+  int w;
+  for (w = 0; w < threadNum; w++) {
+    sum += __atomic_load_n((unsigned long*) ((char*) &workers[w] + offset), __ATOMIC_RELAXED);
+  }
+  return sum;
+}
+
+#define COUNTER(field) collect_counter(offsetof(swarmWorker_t, field))
+
+static double ms(unsigned long us) {
+  return us / 1e3;
+}
+
+int main(int argc, char** argv) {
+  const char* path = "../tracker/tracker";
+  int opt;
+  while ((opt = getopt(argc, argv, "t:p:P:n:T:d:r:b:f:D:A:x:w:L:M:h")) != -1) {
+    switch (opt) {
+      case 't': path = optarg; break;
+      case 'p': port = atoi(optarg); break;
+      case 'P': trackerPid = atoi(optarg); break;
+      case 'n': peerNum = atoi(optarg); break;
+      case 'T': threadNum = atoi(optarg); break;
+      case 'd': duration = atoi(optarg); break;
+      case 'r': rate = atof(optarg); break;
+      case 'b': batch = atoi(optarg); break;
+      case 'f': filesPerPeer = atoi(optarg); break;
+      case 'D': dist = strcmp(optarg, "zipf") == 0 ? DIST_ZIPF : DIST_UNIFORM; break;
+      case 'A':
+        arrival = strcmp(optarg, "steady") == 0 ? ARRIVAL_STEADY : (strcmp(optarg, "burst") == 0 ? ARRIVAL_BURST : ARRIVAL_POISSON);
+        break;
+      case 'x': deletePct = atoi(optarg); break;
+      case 'w': windowMs = atol(optarg); break;
+      case 'L': fanoutLimitMs = atof(optarg); break;
+      case 'M': rssLimitMB = atof(optarg); break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+  if (peerNum <= 0 || threadNum <= 0 || threadNum > SWARM_MAX_THREADS || duration <= 0 || rate <= 0
+      || batch <= 0 || filesPerPeer <= 0 || deletePct < 0 || deletePct > 100) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (threadNum > peerNum) threadNum = peerNum;
+  slotNum = 2 * filesPerPeer;
+  signal(SIGPIPE, SIG_IGN);
+  clock_gettime(CLOCK_MONOTONIC, &benchStart);
+
+  //one descriptor per peer here, and as many in the tracker started below
+  struct rlimit lim;
+  getrlimit(RLIMIT_NOFILE, &lim);
+  lim.rlim_cur = lim.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &lim);
+  if ((long) lim.rlim_cur < peerNum + 64) {
+    printf("%d peers need more than the %ld open files allowed\n", peerNum, (long) lim.rlim_cur);
+    return 1;
+  }
+
+  char dir[] = "/tmp/swarm_benchXXXXXX";
+  int spawned = port == 0;
+  if (spawned) {
+    if (realpath(path, trackerPath) == NULL || access(trackerPath, X_OK) < 0) {
+      printf("tracker binary %s not found, build it with make first\n", path);
+      return 1;
+    }
+    //a port away from HANDSHAKE_PORT, so a tracker running here is left alone
+    port = 21000 + getpid() % 1000;
+    assert(mkdtemp(dir) != NULL);
+    trackerPid = start_tracker(dir);
+  }
+
+  zipfCdf = (double*) malloc(slotNum * sizeof(double));
+  double sum = 0;
+  int i;
+  for (i = 0; i < slotNum; i++) {
+    sum += 1.0 / (i + 1);
+    zipfCdf[i] = sum;
+  }
+  for (i = 0; i < slotNum; i++) {
+    zipfCdf[i] /= sum;
+  }
+
+  //every peer starts with files in its first slots, they are known to the tracker before churn starts
+  swarmPeer_t* peers = (swarmPeer_t*) calloc(peerNum, sizeof(swarmPeer_t));
+  fileEntry_t entry;
+  memset(&entry, 0, sizeof(entry));
+  for (i = 0; i < peerNum; i++) {
+    swarmPeer_t* peer = &peers[i];
+    peer -> index = i;
+    peer -> conn = -1;
+    sprintf(peer -> ip, "10.%d.%d.%d", 100 + i / 62500, (i / 250) % 250, i % 250 + 1);
+    peer -> log = filedelta_initLog();
+    peer -> stamps = (unsigned long*) calloc(slotNum, sizeof(unsigned long));
+    int k;
+    for (k = 0; k < filesPerPeer; k++) {
+      slot_name(peer, k, entry.file_name);
+      entry.size = 1000 + k;
+      entry.timestamp = 1;
+      peer -> stamps[k] = 1;
+      filedelta_record(peer -> log, DELTA_ADD, &entry);
+    }
+    peer -> files = filesPerPeer;
+    peer -> inCap = SWARM_RECV_BUF;
+    peer -> in = (char*) malloc(peer -> inCap);
+  }
+
+  int per = (peerNum + threadNum - 1) / threadNum;
+  int w;
+  for (w = 0; w < threadNum; w++) {
+    swarmWorker_t* worker = &workers[w];
+    worker -> id = w;
+    worker -> epfd = epoll_create1(0);
+    worker -> peers = peers + w * per;
+    worker -> peerNum = (w + 1) * per > peerNum ? peerNum - w * per : per;
+    worker -> seed[0] = 0x330e;
+    worker -> seed[1] = (unsigned short) w;
+    worker -> seed[2] = (unsigned short) getpid();
+    worker -> fanout = (metricsHist_t*) calloc(1, sizeof(metricsHist_t));
+    worker -> ackRtt = (metricsHist_t*) calloc(1, sizeof(metricsHist_t));
+    pthread_create(&(worker -> thread), NULL, swarm_worker, worker);
+  }
+
+  //register the peers in waves, its worker takes each peer's setup packet and sends the peer's initial files
+  //a wave's files fit in the tracker's change log, joining all at once would send most of them full tables
+  int wave = CHANGELOG_CAPACITY / 2 / filesPerPeer;
+  if (wave < 1) wave = 1;
+  long rssStart = proc_status_kb(trackerPid, "VmRSS");
+  unsigned long begin = now_us();
+  int connected = 0;
+  while (connected < peerNum) {
+    int end = connected + wave < peerNum ? connected + wave : peerNum;
+    for (i = connected; i < end; i++) {
+      swarmPeer_t* peer = &peers[i];
+      int conn = connect_tracker();
+      if (conn < 0) break;
+      peer -> nextKeepalive = begin + (unsigned long) (HEARTBEAT_INTERVAL * 1e6 * i / peerNum);
+      ptp_peer_t reg;
+      memset(&reg, 0, sizeof(reg));
+      pkt_config_peerPkt(&reg, REGISTER, peer -> ip, 0, 0, NULL);
+      pkt_config_peerShard(&reg, 0, 1);
+      peer -> conn = conn;
+      assert(pkt_peer_sendPkt(conn, &reg, NULL) > 0);
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.ptr = peer;
+      epoll_ctl(workers[i / per].epfd, EPOLL_CTL_ADD, conn, &event);
+    }
+    connected = i;
+    while (__atomic_load_n(&syncedPeers, __ATOMIC_RELAXED) < connected && now_us() - begin < SWARM_SYNC_TIMEOUT * 1000000UL) {
+      usleep(1000);
+    }
+    if (connected < end || __atomic_load_n(&syncedPeers, __ATOMIC_RELAXED) < connected) break;
+  }
+  //let the broadcasts of the last wave go out before measuring
+  unsigned long received = COUNTER(recvBytes);
+  int quiet = 0;
+  while (quiet < 20 && now_us() - begin < SWARM_SYNC_TIMEOUT * 1000000UL) {
+    usleep(10000);
+    unsigned long now = COUNTER(recvBytes);
+    quiet = now == received ? quiet + 1 : 0;
+    received = now;
+  }
+  unsigned long synced = now_us();
+  int syncedNum = __atomic_load_n(&syncedPeers, __ATOMIC_RELAXED);
+  long rssSynced = proc_status_kb(trackerPid, "VmRSS");
+  long cpuStart = proc_cpu_ms(trackerPid);
+  printf("swarm: %d peers (%d threads) on port %d, %d files each, %.0f updates/s of %d files, %s slots, %s arrivals, %d%% deletes\n",
+         connected, threadNum, port, filesPerPeer, rate, batch, dist == DIST_ZIPF ? "zipf" : "uniform",
+         arrival == ARRIVAL_STEADY ? "steady" : (arrival == ARRIVAL_BURST ? "burst" : "poisson"), deletePct);
+  printf("%d peers registered and synced their initial files in %.0fms (waves of %d), tracker rss %ldkB -> %ldkB\n",
+         syncedNum, ms(synced - begin), wave, rssStart, rssSynced);
+
+  //replay churn, a line per second
+  measureStart = now_us();
+  __atomic_store_n(&phase, PHASE_RUN, __ATOMIC_RELEASE);
+  metricsHist_t* fanout = (metricsHist_t*) malloc(sizeof(metricsHist_t));
+  metricsHist_t* prevFanout = (metricsHist_t*) calloc(1, sizeof(metricsHist_t));
+  metricsHist_t* interval = (metricsHist_t*) malloc(sizeof(metricsHist_t));
+  unsigned long prevAcked = 0, prevFiles = 0, prevBroadcasts = 0;
+  long rssPeak = rssSynced;
+  int t;
+  for (t = 1; t <= duration; t++) {
+    unsigned long wake = measureStart + t * 1000000UL;
+    unsigned long now = now_us();
+    if (wake > now) usleep(wake - now);
+
+    unsigned long acked = COUNTER(updatesAcked);
+    unsigned long files = COUNTER(filesAcked);
+    unsigned long broadcasts = COUNTER(broadcasts);
+    collect_hist(fanout, 1);
+    //the second's own fan-out: the buckets filled since the last line
+    memcpy(interval, fanout, sizeof(metricsHist_t));
+    interval -> count -= prevFanout -> count;
+    int b;
+    for (b = 0; b < METRICS_HIST_BUCKETS; b++) {
+      interval -> buckets[b] -= prevFanout -> buckets[b];
+    }
+    memcpy(prevFanout, fanout, sizeof(metricsHist_t));
+    long rss = proc_status_kb(trackerPid, "VmRSS");
+    if (rss > rssPeak) rssPeak = rss;
+    printf("t=%2ds  acked/s=%-6lu files/s=%-7lu broadcasts/s=%-7lu fanout p50=%.1fms p99=%.1fms  rss=%ldkB\n",
+           t, acked - prevAcked, files - prevFiles, broadcasts - prevBroadcasts,
+           ms(metrics_percentile(interval, 0.5)), ms(metrics_percentile(interval, 0.99)), rss);
+    prevAcked = acked;
+    prevFiles = files;
+    prevBroadcasts = broadcasts;
+  }
+  unsigned long elapsed = now_us() - measureStart;
+  long cpuEnd = proc_cpu_ms(trackerPid);
+  long rssEnd = proc_status_kb(trackerPid, "VmRSS");
+  long hwm = proc_status_kb(trackerPid, "VmHWM");
+  __atomic_store_n(&phase, PHASE_STOP, __ATOMIC_RELEASE);
+  for (w = 0; w < threadNum; w++) {
+    pthread_join(workers[w].thread, NULL);
+  }
+
+  //the summary
+  double secs = elapsed / 1e6;
+  unsigned long sent = COUNTER(updatesSent), acked = COUNTER(updatesAcked), files = COUNTER(filesAcked);
+  unsigned long broadcasts = COUNTER(broadcasts);
+  unsigned long maxLag = 0;
+  for (w = 0; w < threadNum; w++) {
+    if (workers[w].maxLag > maxLag) maxLag = workers[w].maxLag;
+  }
+  long liveFiles = 0;
+  for (i = 0; i < peerNum; i++) {
+    liveFiles += peers[i].files;
+  }
+  printf("throughput: %lu updates sent, %lu acked (%.0f/s), %.0f files/s, %lu resyncs, %lu disconnects, generator lag max %.1fms\n",
+         sent, acked, acked / secs, files / secs, COUNTER(resyncs), COUNTER(disconnects), ms(maxLag));
+  printf("broadcasts: %lu received (%.0f/s, %.1f per peer per s), %lu full tables, %.1fMB/s from the tracker\n",
+         broadcasts, broadcasts / secs, broadcasts / secs / connected, COUNTER(fullTables), COUNTER(recvBytes) / secs / 1e6);
+  metricsHist_t* rtt = interval;
+  collect_hist(rtt, 0);
+  printf("update ack:   count %lu  p50 %.2fms  p99 %.2fms  max %.2fms\n", rtt -> count,
+         ms(metrics_percentile(rtt, 0.5)), ms(metrics_percentile(rtt, 0.99)), ms(rtt -> max));
+  collect_hist(fanout, 1);
+  double fanoutP99 = ms(metrics_percentile(fanout, 0.99));
+  printf("fan-out:      count %lu  p50 %.2fms  p90 %.2fms  p99 %.2fms  p99.9 %.2fms  max %.2fms\n", fanout -> count,
+         ms(metrics_percentile(fanout, 0.5)), ms(metrics_percentile(fanout, 0.9)), fanoutP99,
+         ms(metrics_percentile(fanout, 0.999)), ms(fanout -> max));
+  double growthMB = (rssEnd - rssSynced) / 1024.0;
+  printf("tracker:      rss %ldkB -> %ldkB (%+.1fMB, peak %ldkB, hwm %ldkB), %ld live files, cpu %ldms (%.2fms per update)\n",
+         rssSynced, rssEnd, growthMB, rssPeak, hwm, liveFiles, cpuEnd - cpuStart,
+         acked > 0 ? (double) (cpuEnd - cpuStart) / acked : 0.0);
+
+  int exceeded = 0;
+  if (fanoutLimitMs > 0 && fanoutP99 > fanoutLimitMs) {
+    printf("REGRESSION: fan-out p99 %.2fms over the limit of %.2fms\n", fanoutP99, fanoutLimitMs);
+    exceeded = 1;
+  }
+  if (rssLimitMB > 0 && rssEnd >= 0 && growthMB > rssLimitMB) {
+    printf("REGRESSION: tracker rss grew %.1fMB, over the limit of %.1fMB\n", growthMB, rssLimitMB);
+    exceeded = 1;
+  }
+  if (syncedNum < peerNum) {
+    printf("REGRESSION: only %d of %d peers registered and synced\n", syncedNum, peerNum);
+    exceeded = 1;
+  }
+
+  if (spawned) {
+    kill(trackerPid, SIGKILL);
+    waitpid(trackerPid, NULL, 0);
+    char cmd[64];
+    sprintf(cmd, "rm -rf %s", dir);
+    assert(system(cmd) == 0);
+  }
+  for (i = 0; i < peerNum; i++) {
+    if (peers[i].conn >= 0) close(peers[i].conn);
+    filedelta_destroyLog(peers[i].log);
+    free(peers[i].stamps);
+    free(peers[i].in);
+  }
+  for (w = 0; w < threadNum; w++) {
+    close(workers[w].epfd);
+    free(workers[w].fanout);
+    free(workers[w].ackRtt);
+  }
+  free(peers);
+  free(zipfCdf);
+  free(fanout);
+  free(prevFanout);
+  free(interval);
+  return exceeded ? 2 : 0;
+}
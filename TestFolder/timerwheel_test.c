@@ -0,0 +1,127 @@
+//File: timerwheel_test.c
+
+//Description: File that unit tests the functions in timerwheel.c.
+
+//To compile:
+// gcc -Wall -pedantic -std=c99 -ggdb -o test timerwheel_test.c ../common/timerwheel.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../common/timerwheel.h"
+
+
+//number of timers in a list of fired timers
+static int count_fired(timerNode_t* node) {
+  int n = 0;
+  while (node != NULL) {
+    n ++;
+    node = node -> next;
+  }
+  return n;
+}
+
+void test_timerwheel_init() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "timerwheel_init");
+
+  timerWheel_t* wheel = timerwheel_init(1000);
+  assert(wheel -> now == 1000);
+  assert(wheel -> count == 0);
+  assert(timerwheel_advance(wheel, 5000) == NULL);
+  assert(wheel -> now == 5000);
+  timerwheel_destroy(wheel);
+  printf("SUCCESS!!\n");
+}
+
+void test_timerwheel_fireOnTime() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "timerwheel_advance (fires exactly at expiry)");
+
+  //delays in every level of the wheel, and past its range
+  unsigned long delays[] = {1, 2, 63, 64, 65, 100, 4095, 4096, 4097, 70000, 262143, 262144, 20000000};
+  int num = sizeof(delays) / sizeof(delays[0]);
+  unsigned long start = 1234567;
+
+  int i;
+  for (i = 0; i < num; i++) {
+    timerWheel_t* wheel = timerwheel_init(start);
+    timerNode_t node;
+    timerwheel_initNode(&node, &delays[i]);
+    timerwheel_schedule(wheel, &node, start + delays[i]);
+    assert(wheel -> count == 1);
+
+    assert(timerwheel_advance(wheel, start + delays[i] - 1) == NULL);
+    timerNode_t* fired = timerwheel_advance(wheel, start + delays[i]);
+    assert(fired == &node);
+    assert(fired -> data == &delays[i]);
+    assert(fired -> next == NULL);
+    assert(node.scheduled == 0);
+    assert(wheel -> count == 0);
+    timerwheel_destroy(wheel);
+  }
+  printf("Successfully fired %d timers on their tick.\n", num);
+  printf("SUCCESS!!\n");
+}
+
+void test_timerwheel_reschedule() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "timerwheel_schedule (reschedule)");
+
+  timerWheel_t* wheel = timerwheel_init(0);
+  timerNode_t node;
+  timerwheel_initNode(&node, NULL);
+
+  //keep pushing the expiry back like a KEEPALIVE would: it never fires
+  unsigned long now;
+  for (now = 0; now < 1000; now += 30) {
+    assert(timerwheel_advance(wheel, now) == NULL);
+    timerwheel_schedule(wheel, &node, now + 91);
+  }
+  assert(wheel -> count == 1);
+  assert(timerwheel_advance(wheel, node.expire - 1) == NULL);
+  assert(timerwheel_advance(wheel, node.expire) == &node);
+
+  //a timer already due fires on the next tick
+  timerwheel_schedule(wheel, &node, 3);
+  assert(timerwheel_advance(wheel, wheel -> now + 1) == &node);
+  timerwheel_destroy(wheel);
+  printf("SUCCESS!!\n");
+}
+
+void test_timerwheel_cancel() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "timerwheel_cancel");
+
+  timerWheel_t* wheel = timerwheel_init(0);
+  timerNode_t nodes[100];
+  int i;
+  for (i = 0; i < 100; i++) {
+    timerwheel_initNode(&nodes[i], NULL);
+    timerwheel_schedule(wheel, &nodes[i], 10 + i * 50);
+  }
+  assert(wheel -> count == 100);
+
+  //cancel every other timer, cancelling twice is harmless
+  for (i = 0; i < 100; i += 2) {
+    timerwheel_cancel(wheel, &nodes[i]);
+    timerwheel_cancel(wheel, &nodes[i]);
+  }
+  assert(wheel -> count == 50);
+
+  assert(count_fired(timerwheel_advance(wheel, 10 + 99 * 50)) == 50);
+  assert(wheel -> count == 0);
+  timerwheel_destroy(wheel);
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test all of the functions for the timer wheel.
+int main() {
+  test_timerwheel_init();
+  test_timerwheel_fireOnTime();
+  test_timerwheel_reschedule();
+  test_timerwheel_cancel();
+  return 0;
+}
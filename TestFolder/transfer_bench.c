@@ -0,0 +1,171 @@
+//File: transfer_bench.c
+
+//Description: Times downloading one file over loopback from 1, 2, 4 .. up to N peers at once (see transfer.c).  Every
+// provider sends at most R bytes per second on a connection, as a remote peer behind its own uplink would, so
+// the download can only get faster by spreading the pieces over more providers: the time should drop near
+// linearly with their number.  Then F small files are downloaded one after the other from one provider, over
+// a new connection each (idleMs 0) and over pooled ones: the pooled run skips a handshake per file.  Every
+// download is checked against the original file.
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -O2 -pthread -o transfer_bench transfer_bench.c ../peer/transfer.c ../peer/piecesched.c ../peer/connpool.c ../peer/filecache.c ../peer/piecejournal.c
+
+//To run:
+// ./transfer_bench [-s file MB] [-r provider MB/s] [-n most providers] [-p piece KB] [-f small files] [-k small file KB]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "../peer/transfer.h"
+
+
+static char srcDir[] = "/tmp/transfer_benchsrcXXXXXX";
+static char dstDir[] = "/tmp/transfer_benchdstXXXXXX";
+
+
+/* a file of size bytes of noise under dir */
+static char* make_file(const char* dir, const char* name, long size) {
+  char* data = (char*) malloc(size);
+  long i;
+  for (i = 0; i < size; i++) {
+    data[i] = (char) (rand() >> 7);
+  }
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE* file = fopen(path, "w");
+  assert(file != NULL && fwrite(data, 1, size, file) == (size_t) size);
+  fclose(file);
+  return data;
+}
+
+/* downloads num small files one after the other from the provider, with connections kept idleMs */
+static void small_files(transferProvider_t* addr, int num, long size, int pieceKb, unsigned long idleMs) {
+  transfer_t* peer = transfer_init(dstDir, pieceKb * 1024, 0);
+  peer -> pool -> idleMs = idleMs;
+  char name[64];
+  char path[512];
+  int i;
+  unsigned long start = piecesched_now();
+  for (i = 0; i < num; i++) {
+    snprintf(name, sizeof(name), "small%d.bin", i);
+    assert(transfer_download(peer, name, size, 0, addr, 1) == 1);
+  }
+  double took = (piecesched_now() - start) / 1000.0;
+  long reusePct = (peer -> pool -> leased > 0) ? peer -> pool -> reused * 100 / peer -> pool -> leased : 0;
+  printf("%-8s  %6.2fs  %8.0f  %11ld  %9ld%%\n", idleMs > 0 ? "pooled" : "fresh", took, num / took, peer -> pool -> opened, reusePct);
+  transfer_destroy(peer);
+  for (i = 0; i < num; i++) {
+    snprintf(path, sizeof(path), "%s/small%d.bin", dstDir, i);
+    unlink(path);
+  }
+}
+
+/* whether the file under dir holds exactly data */
+static int same_file(const char* dir, const char* name, const char* data, long size) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return 0;
+  char* got = (char*) malloc(size + 1);
+  long n = fread(got, 1, size + 1, file);
+  fclose(file);
+  int same = (n == size && memcmp(got, data, size) == 0);
+  free(got);
+  return same;
+}
+
+
+int main(int argc, char* argv[]) {
+  long sizeMb = 32;
+  long rateMb = 8;
+  int maxProviders = 8;
+  int pieceKb = 256;
+  int smallNum = 2000;
+  int smallKb = 4;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:r:n:p:f:k:h")) != -1) {
+    switch (opt) {
+      case 's': sizeMb = atol(optarg); break;
+      case 'r': rateMb = atol(optarg); break;
+      case 'n': maxProviders = atoi(optarg); break;
+      case 'p': pieceKb = atoi(optarg); break;
+      case 'f': smallNum = atoi(optarg); break;
+      case 'k': smallKb = atoi(optarg); break;
+      default:
+        printf("usage: %s [-s file MB (32)] [-r provider MB/s (8)] [-n most providers (8)] [-p piece KB (256)] "
+               "[-f small files (2000)] [-k small file KB (4)]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (sizeMb <= 0 || rateMb <= 0 || maxProviders <= 0 || maxProviders > TRANSFER_MAX_PROVIDERS || pieceKb <= 0
+      || smallNum < 0 || smallKb <= 0) {
+    printf("%s: error: %ldMB, %ldMB/s, %d providers, %dKB pieces\n", __func__, sizeMb, rateMb, maxProviders, pieceKb);
+    return 1;
+  }
+  assert(mkdtemp(srcDir) != NULL && mkdtemp(dstDir) != NULL);
+
+  long size = sizeMb * 1024 * 1024;
+  char* data = make_file(srcDir, "bench.bin", size);
+  transfer_t* providers[TRANSFER_MAX_PROVIDERS];
+  transferProvider_t addrs[TRANSFER_MAX_PROVIDERS];
+  int i, num;
+  for (i = 0; i < maxProviders; i++) {
+    providers[i] = transfer_init(srcDir, pieceKb * 1024, rateMb * 1024 * 1024);
+    strcpy(addrs[i].ip, "127.0.0.1");
+    addrs[i].port = transfer_listen(providers[i], 0);
+    assert(addrs[i].port > 0);
+  }
+
+  printf("%ldMB file, %dKB pieces, every provider at %ldMB/s\n", sizeMb, pieceKb, rateMb);
+  printf("providers     time    MB/s   speedup  reassigned\n");
+  double single = 0;
+  for (num = 1; num <= maxProviders; num *= 2) {
+    transfer_t* peer = transfer_init(dstDir, pieceKb * 1024, 0);
+    unsigned long start = piecesched_now();
+    assert(transfer_download(peer, "bench.bin", size, 0, addrs, num) == 1);
+    double took = (piecesched_now() - start) / 1000.0;
+    assert(same_file(dstDir, "bench.bin", data, size));
+    if (num == 1) single = took;
+    printf("%9d  %6.2fs  %6.1f  %7.2fx  %10ld\n", num, took, sizeMb / took, single / took, peer -> reassigned);
+    transfer_destroy(peer);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/bench.bin", dstDir);
+    unlink(path);
+  }
+
+  for (i = 0; i < maxProviders; i++) {
+    transfer_destroy(providers[i]);
+  }
+
+  //small files, from a provider without a rate limit
+  char path[512];
+  if (smallNum > 0) {
+    char name[64];
+    for (i = 0; i < smallNum; i++) {
+      snprintf(name, sizeof(name), "small%d.bin", i);
+      free(make_file(srcDir, name, smallKb * 1024));
+    }
+    transfer_t* provider = transfer_init(srcDir, pieceKb * 1024, 0);
+    strcpy(addrs[0].ip, "127.0.0.1");
+    addrs[0].port = transfer_listen(provider, 0);
+    printf("\n%d files of %dKB, one provider\n", smallNum, smallKb);
+    printf("conns        time   files/s  connections  reused\n");
+    small_files(&addrs[0], smallNum, smallKb * 1024, pieceKb, 0);
+    small_files(&addrs[0], smallNum, smallKb * 1024, pieceKb, CONNPOOL_IDLE_MS);
+    transfer_destroy(provider);
+    for (i = 0; i < smallNum; i++) {
+      snprintf(path, sizeof(path), "%s/small%d.bin", srcDir, i);
+      unlink(path);
+    }
+  }
+  snprintf(path, sizeof(path), "%s/bench.bin", srcDir);
+  unlink(path);
+  rmdir(srcDir);
+  rmdir(dstDir);
+  free(data);
+  return 0;
+}
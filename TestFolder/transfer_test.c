@@ -0,0 +1,522 @@
+//File: transfer_test.c
+
+//Description: File that tests the downloads of transfer.c over loopback: from several peers at once, with one
+// of them stalling, from peers without the file, many files over the same pooled connections, a download cut
+// short then resumed, a file in a subdirectory, and names leading out of the shared directory refused
+
+//To compile:
+// gcc -Wall -pedantic -std=gnu99 -ggdb -pthread -o test transfer_test.c ../peer/transfer.c ../peer/piecesched.c ../peer/connpool.c ../peer/filecache.c ../peer/piecejournal.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <libgen.h>
+#include <assert.h>
+
+#include "../peer/transfer.h"
+
+
+#define PIECE_LEN (64 * 1024)
+#define FILE_SIZE (3 * 1024 * 1024 + 777)
+#define PROVIDER_NUM 3
+#define SMALL_FILE_NUM 20
+
+
+static char srcDir[] = "/tmp/transfer_srcXXXXXX";
+static char dstDir[] = "/tmp/transfer_dstXXXXXX";
+
+
+/* a file of size bytes of noise under dir */
+static char* make_file(const char* dir, const char* name, long size) {
+  char* data = (char*) malloc(size);
+  long i;
+  for (i = 0; i < size; i++) {
+    data[i] = (char) (rand() >> 7);
+  }
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE* file = fopen(path, "w");
+  assert(file != NULL && fwrite(data, 1, size, file) == (size_t) size);
+  fclose(file);
+  return data;
+}
+
+/* whether the file under dir holds exactly data */
+static int same_file(const char* dir, const char* name, const char* data, long size) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return 0;
+  char* got = (char*) malloc(size + 1);
+  long n = fread(got, 1, size + 1, file);
+  fclose(file);
+  int same = (n == size && memcmp(got, data, size) == 0);
+  free(got);
+  return same;
+}
+
+static int file_exists(const char* dir, const char* name) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  return access(path, F_OK) == 0;
+}
+
+/* when the file was last modified, -1 if it is not there */
+static long file_mtime(const char* dir, const char* name) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  struct stat st;
+  return (stat(path, &st) == 0) ? (long) st.st_mtime : -1;
+}
+
+static void remove_file(const char* dir, const char* name) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  unlink(path);
+}
+
+/* the bytes num providers uploaded, waiting up to 1s for them to reach least: a serving thread counts a piece
+   after sending it, maybe after the download it went to returned */
+static long uploaded_atLeast(transfer_t** providers, int num, long least) {
+  long uploaded = 0;
+  int i, j;
+  for (i = 0; i < 100; i++) {
+    uploaded = 0;
+    for (j = 0; j < num; j++) {
+      uploaded += __atomic_load_n(&(providers[j] -> uploaded), __ATOMIC_ACQUIRE);
+    }
+    if (uploaded >= least) break;
+    usleep(10000);
+  }
+  return uploaded;
+}
+
+/* A provider answering the HAVE_REQ and then never sending a piece, on the listening socket given */
+static void* stalled_provider(void* arg) {
+  int listenfd = (int) (long) arg;
+  int fd = accept(listenfd, NULL, NULL);
+  transferMsg_t msg;
+  if (recv(fd, &msg, sizeof(msg), MSG_WAITALL) == sizeof(msg)) {
+    msg.type = TRANSFER_HAVE;
+    msg.len = 0;
+    send(fd, &msg, sizeof(msg), 0);
+    //requests are read and left unanswered until the downloader hangs up
+    while (recv(fd, &msg, sizeof(msg), MSG_WAITALL) > 0);
+  }
+  close(fd);
+  return NULL;
+}
+
+/* what a provider cut short serves, and served */
+typedef struct cutProvider{
+  int listenfd;
+  const char* data;
+  long size;
+  int pieces;               // pieces sent before hanging up
+  long sent;                // bytes of them
+}cutProvider_t;
+
+/* A provider answering the HAVE_REQ with the whole file, sending the first pieces asked of it, then hanging up
+   while more are asked */
+static void* cut_provider(void* arg) {
+  cutProvider_t* cut = (cutProvider_t*) arg;
+  int fd = accept(cut -> listenfd, NULL, NULL);
+  transferMsg_t msg;
+  cut -> sent = 0;
+  if (recv(fd, &msg, sizeof(msg), MSG_WAITALL) == sizeof(msg)) {
+    msg.type = TRANSFER_HAVE;
+    msg.len = 0;
+    send(fd, &msg, sizeof(msg), 0);
+    int i;
+    for (i = 0; i < cut -> pieces && recv(fd, &msg, sizeof(msg), MSG_WAITALL) == sizeof(msg); i++) {
+      long offset = (long) msg.piece * PIECE_LEN;
+      msg.type = TRANSFER_PIECE;
+      msg.len = (int) (cut -> size - offset < PIECE_LEN ? cut -> size - offset : PIECE_LEN);
+      send(fd, &msg, sizeof(msg), 0);
+      send(fd, cut -> data + offset, msg.len, 0);
+      cut -> sent += msg.len;
+    }
+    //hung up on its side only: closed with requests unread, the pieces sent could be reset on the way
+    shutdown(fd, SHUT_WR);
+    while (recv(fd, &msg, sizeof(msg), MSG_WAITALL) > 0);
+  }
+  close(fd);
+  return NULL;
+}
+
+/* a listening socket on a free loopback port, the port in addr */
+static int listen_loopback(transferProvider_t* addr) {
+  int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in sin;
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(sin);
+  assert(bind(listenfd, (struct sockaddr*) &sin, sizeof(sin)) == 0 && listen(listenfd, 4) == 0);
+  getsockname(listenfd, (struct sockaddr*) &sin, &len);
+  strcpy(addr -> ip, "127.0.0.1");
+  addr -> port = ntohs(sin.sin_port);
+  return listenfd;
+}
+
+
+/* a plain client connected to a provider, to send it what a peer would not */
+static int connect_loopback(transferProvider_t* addr) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in sin;
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sin.sin_port = htons(addr -> port);
+  assert(connect(fd, (struct sockaddr*) &sin, sizeof(sin)) == 0);
+  return fd;
+}
+
+/* the type of the answer to a request for the first piece or the pieces had of a file, any bitmap after it read */
+static int ask(int fd, int type, const char* name, long size) {
+  transferMsg_t msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.type = type;
+  strncpy(msg.file_name, name, FILE_NAME_MAX_LEN - 1);
+  msg.size = size;
+  msg.pieceLen = PIECE_LEN;
+  msg.piece = 0;
+  assert(send(fd, &msg, sizeof(msg), 0) == sizeof(msg));
+  assert(recv(fd, &msg, sizeof(msg), MSG_WAITALL) == sizeof(msg));
+  if (msg.type == TRANSFER_PIECE || (msg.type == TRANSFER_HAVE && msg.len > 0)) {
+    char* rest = malloc(msg.len);
+    assert(recv(fd, rest, msg.len, MSG_WAITALL) == msg.len);
+    free(rest);
+  }
+  return msg.type;
+}
+
+
+void test_transfer_download() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "transfer_download");
+
+  char* data = make_file(srcDir, "file.bin", FILE_SIZE);
+  transfer_t* providers[PROVIDER_NUM];
+  transferProvider_t addrs[PROVIDER_NUM];
+  int i;
+  for (i = 0; i < PROVIDER_NUM; i++) {
+    providers[i] = transfer_init(srcDir, PIECE_LEN, 0);
+    strcpy(addrs[i].ip, "127.0.0.1");
+    addrs[i].port = transfer_listen(providers[i], 0);
+    assert(addrs[i].port > 0);
+  }
+
+  //every provider gives some of the pieces
+  transfer_t* peer = transfer_init(dstDir, PIECE_LEN, 0);
+  assert(transfer_download(peer, "file.bin", FILE_SIZE, 0, addrs, PROVIDER_NUM) == 1);
+  assert(same_file(dstDir, "file.bin", data, FILE_SIZE));
+  assert(!file_exists(dstDir, "file.bin" PARTIAL_FILE_EXT));
+  assert(peer -> downloaded >= FILE_SIZE);
+  assert(uploaded_atLeast(providers, PROVIDER_NUM, FILE_SIZE) == FILE_SIZE);
+  for (i = 0; i < PROVIDER_NUM; i++) {
+    assert(__atomic_load_n(&(providers[i] -> uploaded), __ATOMIC_RELAXED) > 0);
+    assert(__atomic_load_n(&(providers[i] -> zeroCopied), __ATOMIC_RELAXED) == __atomic_load_n(&(providers[i] -> uploaded), __ATOMIC_RELAXED));
+  }
+
+  //requests go out several to a send
+  long pieceNum = (FILE_SIZE + PIECE_LEN - 1) / PIECE_LEN;
+  assert(peer -> requests >= pieceNum && peer -> requestBatches < peer -> requests);
+
+  //a longer older version is overwritten, one request at a time, from a provider reading pieces into a buffer
+  char* longer = make_file(dstDir, "file.bin", FILE_SIZE + 5000);
+  long requests = peer -> requests;
+  long batches = peer -> requestBatches;
+  long zeroCopied = __atomic_load_n(&(providers[0] -> zeroCopied), __ATOMIC_ACQUIRE);
+  long uploaded = __atomic_load_n(&(providers[0] -> uploaded), __ATOMIC_RELAXED);
+  peer -> maxWindow = 1;
+  __atomic_store_n(&(providers[0] -> zeroCopy), 0, __ATOMIC_RELAXED);
+  assert(transfer_download(peer, "file.bin", FILE_SIZE, 0, addrs, 1) == 1);
+  assert(same_file(dstDir, "file.bin", data, FILE_SIZE));
+  assert(peer -> requests - requests == pieceNum && peer -> requestBatches - batches == pieceNum);
+  assert(uploaded_atLeast(providers, 1, uploaded + FILE_SIZE) == uploaded + FILE_SIZE);
+  assert(__atomic_load_n(&(providers[0] -> zeroCopied), __ATOMIC_ACQUIRE) == zeroCopied);
+  peer -> maxWindow = TRANSFER_MAX_WINDOW;
+  __atomic_store_n(&(providers[0] -> zeroCopy), 1, __ATOMIC_RELAXED);
+  free(longer);
+
+  //a file of another size, or none at all, is not downloaded, and what was there is left as it was
+  assert(transfer_download(peer, "file.bin", FILE_SIZE + 1, 0, addrs, PROVIDER_NUM) == -1);
+  assert(same_file(dstDir, "file.bin", data, FILE_SIZE) && !file_exists(dstDir, "file.bin" PARTIAL_FILE_EXT));
+  assert(transfer_download(peer, "nothing.bin", 10, 0, addrs, PROVIDER_NUM) == -1);
+  assert(transfer_download(peer, "nothing.bin", 10, 0, addrs, 0) == -1);
+  assert(!file_exists(dstDir, "nothing.bin") && !file_exists(dstDir, "nothing.bin" PARTIAL_FILE_EXT));
+
+  transfer_destroy(peer);
+  for (i = 0; i < PROVIDER_NUM; i++) {
+    transfer_destroy(providers[i]);
+  }
+  remove_file(srcDir, "file.bin");
+  remove_file(dstDir, "file.bin");
+  remove_file(dstDir, "nothing.bin");
+  free(data);
+  printf("SUCCESS!!\n");
+}
+
+void test_transfer_stalled() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "transfer_download (a stalled provider)");
+
+  char* data = make_file(srcDir, "stall.bin", FILE_SIZE);
+  transfer_t* provider = transfer_init(srcDir, PIECE_LEN, 0);
+  transferProvider_t addrs[2];
+  strcpy(addrs[0].ip, "127.0.0.1");
+  addrs[0].port = transfer_listen(provider, 0);
+
+  int listenfd = listen_loopback(&addrs[1]);
+  pthread_t staller;
+  pthread_create(&staller, NULL, stalled_provider, (void*) (long) listenfd);
+
+  //the pieces asked of the stalled provider are asked of the other one after stallMs, well before the io timeout
+  transfer_t* peer = transfer_init(dstDir, PIECE_LEN, 0);
+  peer -> stallMs = 200;
+  unsigned long start = piecesched_now();
+  assert(transfer_download(peer, "stall.bin", FILE_SIZE, 0, addrs, 2) == 1);
+  assert(piecesched_now() - start < TRANSFER_IO_TIMEOUT_MS);
+  assert(same_file(dstDir, "stall.bin", data, FILE_SIZE));
+  assert(peer -> reassigned > 0);
+
+  pthread_join(staller, NULL);
+  close(listenfd);
+  transfer_destroy(peer);
+  transfer_destroy(provider);
+  remove_file(srcDir, "stall.bin");
+  remove_file(dstDir, "stall.bin");
+  free(data);
+  printf("SUCCESS!!\n");
+}
+
+void test_transfer_pool() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "transfer_download (pooled connections)");
+
+  char* data[SMALL_FILE_NUM];
+  char name[64];
+  int i;
+  for (i = 0; i < SMALL_FILE_NUM; i++) {
+    snprintf(name, sizeof(name), "small%d.bin", i);
+    data[i] = make_file(srcDir, name, 1000 + i * 100);
+  }
+  transfer_t* providers[2];
+  transferProvider_t addrs[2];
+  for (i = 0; i < 2; i++) {
+    providers[i] = transfer_init(srcDir, PIECE_LEN, 0);
+    strcpy(addrs[i].ip, "127.0.0.1");
+    addrs[i].port = transfer_listen(providers[i], 0);
+  }
+
+  //one connection to each provider carries every file
+  transfer_t* peer = transfer_init(dstDir, PIECE_LEN, 0);
+  for (i = 0; i < SMALL_FILE_NUM; i++) {
+    snprintf(name, sizeof(name), "small%d.bin", i);
+    assert(transfer_download(peer, name, 1000 + i * 100, 0, addrs, 2) == 1);
+    assert(same_file(dstDir, name, data[i], 1000 + i * 100));
+  }
+  assert(peer -> pool -> opened == 2);
+  assert(peer -> pool -> reused == 2 * (SMALL_FILE_NUM - 1));
+  char buf[1024];
+  assert(transfer_format(peer, buf, sizeof(buf)) > 0);
+  assert(strstr(buf, "gauge connection_reuse_pct 95\n") != NULL && strstr(buf, "gauge connections_idle 2\n") != NULL);
+
+  //a provider closing idle connections on its side costs a new connection, not the download
+  providers[0] -> ioTimeoutMs = 100;
+  transfer_destroy(providers[0]);
+  providers[0] = transfer_init(srcDir, PIECE_LEN, 0);
+  providers[0] -> ioTimeoutMs = 100;
+  assert(transfer_listen(providers[0], addrs[0].port) == addrs[0].port);
+  assert(transfer_download(peer, "small0.bin", 1000, 0, addrs, 1) == 1);
+  assert(peer -> pool -> broken == 1 && peer -> pool -> opened == 3);
+  usleep(300000);
+  assert(transfer_download(peer, "small1.bin", 1100, 0, addrs, 1) == 1);
+  assert(peer -> pool -> broken == 2 && peer -> pool -> opened == 4);
+
+  transfer_destroy(peer);
+  for (i = 0; i < 2; i++) {
+    transfer_destroy(providers[i]);
+  }
+  for (i = 0; i < SMALL_FILE_NUM; i++) {
+    snprintf(name, sizeof(name), "small%d.bin", i);
+    remove_file(srcDir, name);
+    remove_file(dstDir, name);
+    free(data[i]);
+  }
+  printf("SUCCESS!!\n");
+}
+
+void test_transfer_resume() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "transfer_download (resumed from the piece journal)");
+
+  char* data = make_file(srcDir, "resume.bin", FILE_SIZE);
+  transfer_t* provider = transfer_init(srcDir, PIECE_LEN, 0);
+  transferProvider_t addr;
+  strcpy(addr.ip, "127.0.0.1");
+  addr.port = transfer_listen(provider, 0);
+  cutProvider_t cut;
+  transferProvider_t cutAddr;
+  cut.listenfd = listen_loopback(&cutAddr);
+  cut.data = data;
+  cut.size = FILE_SIZE;
+  cut.pieces = 5;
+  pthread_t cutter;
+
+  //cut short: the pieces written stay in the partial file, and the journal names them
+  transfer_t* peer = transfer_init(dstDir, PIECE_LEN, 0);
+  pthread_create(&cutter, NULL, cut_provider, &cut);
+  assert(transfer_download(peer, "resume.bin", FILE_SIZE, 1, &cutAddr, 1) == -1);
+  pthread_join(cutter, NULL);
+  assert(cut.sent > 0 && !file_exists(dstDir, "resume.bin"));
+  assert(file_exists(dstDir, "resume.bin" PARTIAL_FILE_EXT) && file_exists(dstDir, "resume.bin" PIECEJOURNAL_EXT PARTIAL_FILE_EXT));
+
+  //a newer version is downloaded whole, and leaves neither behind
+  assert(transfer_download(peer, "resume.bin", FILE_SIZE, 2, &addr, 1) == 1);
+  assert(same_file(dstDir, "resume.bin", data, FILE_SIZE) && peer -> resumed == 0);
+  assert(uploaded_atLeast(&provider, 1, FILE_SIZE) == FILE_SIZE);
+  assert(!file_exists(dstDir, "resume.bin" PARTIAL_FILE_EXT) && !file_exists(dstDir, "resume.bin" PIECEJOURNAL_EXT PARTIAL_FILE_EXT));
+
+  //cut short again, then tried again from another provider: only the pieces missing are asked for
+  pthread_create(&cutter, NULL, cut_provider, &cut);
+  assert(transfer_download(peer, "resume.bin", FILE_SIZE, 3, &cutAddr, 1) == -1);
+  pthread_join(cutter, NULL);
+  assert(same_file(dstDir, "resume.bin", data, FILE_SIZE));
+  long uploaded = __atomic_load_n(&(provider -> uploaded), __ATOMIC_ACQUIRE);
+  assert(transfer_download(peer, "resume.bin", FILE_SIZE, 3, &addr, 1) == 1);
+  assert(same_file(dstDir, "resume.bin", data, FILE_SIZE));
+  assert(peer -> resumed == cut.pieces);
+  //dated with the tracker's timestamp, the version it lists
+  assert(file_mtime(dstDir, "resume.bin") == 3);
+  assert(uploaded_atLeast(&provider, 1, uploaded + FILE_SIZE - cut.sent) == uploaded + FILE_SIZE - cut.sent);
+  assert(!file_exists(dstDir, "resume.bin" PARTIAL_FILE_EXT) && !file_exists(dstDir, "resume.bin" PIECEJOURNAL_EXT PARTIAL_FILE_EXT));
+  char buf[1024];
+  assert(transfer_format(peer, buf, sizeof(buf)) > 0 && strstr(buf, "counter pieces_resumed 5\n") != NULL);
+
+  close(cut.listenfd);
+  transfer_destroy(peer);
+  transfer_destroy(provider);
+  remove_file(srcDir, "resume.bin");
+  remove_file(dstDir, "resume.bin");
+  free(data);
+  printf("SUCCESS!!\n");
+}
+
+void test_transfer_names() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "transfer_serve (names out of the shared directory)");
+
+  //a file next to the provider's directory, reached from it through ".."
+  char* data = make_file(srcDir, "inside.bin", 5000);
+  char* secret = make_file(dstDir, "secret.bin", 5000);
+  char dstCopy[sizeof(dstDir)];
+  strcpy(dstCopy, dstDir);
+  char outside[FILE_NAME_MAX_LEN];
+  snprintf(outside, sizeof(outside), "../%s/secret.bin", basename(dstCopy));
+  char absolute[FILE_NAME_MAX_LEN];
+  snprintf(absolute, sizeof(absolute), "%s/secret.bin", dstDir);
+
+  transfer_t* provider = transfer_init(srcDir, PIECE_LEN, 0);
+  transferProvider_t addr;
+  strcpy(addr.ip, "127.0.0.1");
+  addr.port = transfer_listen(provider, 0);
+  int fd = connect_loopback(&addr);
+  assert(ask(fd, TRANSFER_HAVE_REQ, "inside.bin", 5000) == TRANSFER_HAVE);
+  assert(ask(fd, TRANSFER_REQUEST, "inside.bin", 5000) == TRANSFER_PIECE);
+
+  //every one of them is answered with an error, on the same connection
+  const char* names[] = {outside, absolute, "../x", "/etc/passwd", "a//b", "a/./b", "a/../../x", "a/..", "inside.bin/", ".", "..", ""};
+  int i;
+  for (i = 0; i < (int) (sizeof(names) / sizeof(names[0])); i++) {
+    assert(ask(fd, TRANSFER_HAVE_REQ, names[i], 5000) == TRANSFER_ERROR);
+    assert(ask(fd, TRANSFER_REQUEST, names[i], 5000) == TRANSFER_ERROR);
+  }
+  assert(ask(fd, TRANSFER_HAVE_REQ, "inside.bin", 5000) == TRANSFER_HAVE);
+  close(fd);
+  assert(__atomic_load_n(&(provider -> uploaded), __ATOMIC_RELAXED) == 5000);
+  printf("Successfully refused to serve names leading out of the shared directory.\n");
+
+  //nor is such a name downloaded into
+  transfer_t* peer = transfer_init(dstDir, PIECE_LEN, 0);
+  assert(transfer_download(peer, "../inside.bin", 5000, 0, &addr, 1) == -1);
+  assert(transfer_download(peer, "", 0, 0, &addr, 1) == -1);
+  assert(same_file(dstDir, "secret.bin", secret, 5000));
+  printf("Successfully refused to download into them.\n");
+
+  transfer_destroy(peer);
+  transfer_destroy(provider);
+  remove_file(srcDir, "inside.bin");
+  remove_file(dstDir, "secret.bin");
+  free(data);
+  free(secret);
+  printf("SUCCESS!!\n");
+}
+
+void test_transfer_subdir() {
+  printf("~~~~~~~~~Testing Function~~~~~~~~~~~~\n");
+  printf("Function: %s\n", "transfer_download (a file in a subdirectory)");
+
+  //named the way the file monitor reports it, the directories are only on the provider's side
+  char path[512];
+  snprintf(path, sizeof(path), "%s/sub", srcDir);
+  assert(mkdir(path, 0755) == 0);
+  snprintf(path, sizeof(path), "%s/sub/deep", srcDir);
+  assert(mkdir(path, 0755) == 0);
+  char* data = make_file(srcDir, "sub/deep/file.bin", 3 * PIECE_LEN + 10);
+
+  transfer_t* provider = transfer_init(srcDir, PIECE_LEN, 0);
+  transferProvider_t addr;
+  strcpy(addr.ip, "127.0.0.1");
+  addr.port = transfer_listen(provider, 0);
+  int fd = connect_loopback(&addr);
+  assert(ask(fd, TRANSFER_HAVE_REQ, "sub/deep/file.bin", 3 * PIECE_LEN + 10) == TRANSFER_HAVE);
+  close(fd);
+
+  //the missing directories are created, the file ends up in them
+  transfer_t* peer = transfer_init(dstDir, PIECE_LEN, 0);
+  assert(transfer_download(peer, "sub/deep/file.bin", 3 * PIECE_LEN + 10, 0, &addr, 1) == 1);
+  assert(same_file(dstDir, "sub/deep/file.bin", data, 3 * PIECE_LEN + 10));
+  assert(!file_exists(dstDir, "sub/deep/file.bin" PARTIAL_FILE_EXT));
+
+  //and again, with the directories already there
+  remove_file(dstDir, "sub/deep/file.bin");
+  assert(transfer_download(peer, "sub/deep/file.bin", 3 * PIECE_LEN + 10, 0, &addr, 1) == 1);
+  assert(same_file(dstDir, "sub/deep/file.bin", data, 3 * PIECE_LEN + 10));
+
+  transfer_destroy(peer);
+  transfer_destroy(provider);
+  const char* dirs[] = {srcDir, dstDir};
+  int i;
+  for (i = 0; i < 2; i++) {
+    remove_file(dirs[i], "sub/deep/file.bin");
+    snprintf(path, sizeof(path), "%s/sub/deep", dirs[i]);
+    rmdir(path);
+    snprintf(path, sizeof(path), "%s/sub", dirs[i]);
+    rmdir(path);
+  }
+  free(data);
+  printf("SUCCESS!!\n");
+}
+
+//Main function to test downloading files between peers.
+int main() {
+  assert(mkdtemp(srcDir) != NULL && mkdtemp(dstDir) != NULL);
+  test_transfer_download();
+  test_transfer_stalled();
+  test_transfer_pool();
+  test_transfer_resume();
+  test_transfer_names();
+  test_transfer_subdir();
+  rmdir(srcDir);
+  rmdir(dstDir);
+  return 0;
+}
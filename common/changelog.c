@@ -0,0 +1,176 @@
+/* File: changelog.c
+   Description: Tracker side log of recent file table changes.  Every change gets the next
+   		global epoch, broadcasts then only carry the files changed since the epoch a peer
+   		last acknowledged.  The log is a fixed size ring, a peer that fell further behind than
+   		the ring reaches gets a full snapshot instead.  Unit tested in the testing directory
+   		with changelog_test.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "changelog.h"
+
+/* Function to initialize an empty change log at epoch 0.  The ring buffer of
+	capacity records and a mutex lock are malloced for the log.
+
+	@return the pointer to the changeLog_t that is created.
+*/
+changeLog_t* changelog_init(int capacity) {
+  assert(capacity > 0);
+
+  changeLog_t* log = (changeLog_t*) malloc(sizeof(changeLog_t));
+  log -> epoch = 0;
+  log -> records = (changeRecord_t*) calloc(capacity, sizeof(changeRecord_t));
+  log -> capacity = capacity;
+  log -> start = 0;
+  log -> count = 0;
+
+  //create the mutex for the log
+  pthread_mutex_t* mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(mutex, NULL);
+  log -> mutex = mutex;
+
+  return log;
+}
+
+/**
+ * Record that a file changed, under the next epoch.  Overwrites the oldest record when the ring is full.
+ * @param  log        [the change log]
+ * @param  op         [DELTA_ADD, DELTA_MODIFY or DELTA_DELETE]
+ * @param  file_name  [the file that changed]
+ * @return            [the epoch of this change]
+ */
+unsigned long changelog_record(changeLog_t* log, int op, char* file_name) {
+  pthread_mutex_lock(log -> mutex);
+
+  int slot;
+  if (log -> count < log -> capacity) {
+    slot = (log -> start + log -> count) % log -> capacity;
+    log -> count ++;
+  } else {
+    //forget the oldest change
+    slot = log -> start;
+    log -> start = (log -> start + 1) % log -> capacity;
+  }
+
+  changeRecord_t* record = &(log -> records[slot]);
+  record -> epoch = ++(log -> epoch);
+  record -> op = op;
+  strncpy(record -> file_name, file_name, FILE_NAME_MAX_LEN - 1);
+  record -> file_name[FILE_NAME_MAX_LEN - 1] = '\0';
+
+  unsigned long epoch = log -> epoch;
+  pthread_mutex_unlock(log -> mutex);
+  return epoch;
+}
+
+/**
+ * Continue numbering after an epoch restored from disk, so epochs stay increasing across restarts.
+ * Only for an empty log: the changes before epoch are gone, anyone behind it gets a full snapshot.
+ * @param  log   [the change log, nothing recorded yet]
+ * @param  epoch [epoch of the restored table]
+ */
+void changelog_restore(changeLog_t* log, unsigned long epoch) {
+  pthread_mutex_lock(log -> mutex);
+  assert(log -> count == 0);
+  log -> epoch = epoch;
+  pthread_mutex_unlock(log -> mutex);
+}
+
+/**
+ * @param  log [the change log]
+ * @return     [the current epoch of the table]
+ */
+unsigned long changelog_getEpoch(changeLog_t* log) {
+  pthread_mutex_lock(log -> mutex);
+  unsigned long epoch = log -> epoch;
+  pthread_mutex_unlock(log -> mutex);
+  return epoch;
+}
+
+static int changelog_compareNames(const void* a, const void* b) {
+  return strcmp(((changeRecord_t*) a) -> file_name, ((changeRecord_t*) b) -> file_name);
+}
+
+/**
+ * Collect the files changed after sinceEpoch, each file once (its latest change).
+ * @param  log         [the change log]
+ * @param  sinceEpoch  [epoch the caller already has, e.g. the one a peer last acknowledged]
+ * @param  num         [out: number of records returned, -1 if the log no longer reaches back to sinceEpoch]
+ * @param  epoch       [out: the epoch the records bring the caller to]
+ * @return             [malloced array of records sorted by file name, NULL if none or if the log does not reach back]
+ */
+changeRecord_t* changelog_since(changeLog_t* log, unsigned long sinceEpoch, int* num, unsigned long* epoch) {
+  *epoch = changelog_getEpoch(log);
+  return changelog_between(log, sinceEpoch, *epoch, num);
+}
+
+/**
+ * Collect the files changed after sinceEpoch up to untilEpoch, each file once (its latest change in that range).
+ * @param  log         [the change log]
+ * @param  sinceEpoch  [epoch the caller already has, e.g. the one a peer last acknowledged]
+ * @param  untilEpoch  [last epoch to include, e.g. the one of a published snapshot of the table]
+ * @param  num         [out: number of records returned, -1 if the log no longer reaches back to sinceEpoch]
+ * @return             [malloced array of records sorted by file name, NULL if none or if the log does not reach back]
+ */
+changeRecord_t* changelog_between(changeLog_t* log, unsigned long sinceEpoch, unsigned long untilEpoch, int* num) {
+  pthread_mutex_lock(log -> mutex);
+  if (untilEpoch > log -> epoch) untilEpoch = log -> epoch;
+
+  if (sinceEpoch >= untilEpoch) {
+    *num = 0;
+    pthread_mutex_unlock(log -> mutex);
+    return NULL;
+  }
+
+  //the changes right after sinceEpoch must still be in the ring
+  unsigned long oldest = log -> count > 0 ? log -> records[log -> start].epoch : log -> epoch + 1;
+  if (sinceEpoch + 1 < oldest) {
+    *num = -1;
+    pthread_mutex_unlock(log -> mutex);
+    return NULL;
+  }
+
+  //epochs in the ring are consecutive, so the wanted records end (log->epoch - untilEpoch) before the newest
+  int wanted = (int)(untilEpoch - sinceEpoch);
+  int skip = (int)(log -> epoch - untilEpoch);
+  changeRecord_t* records = (changeRecord_t*) malloc(wanted * sizeof(changeRecord_t));
+  int i;
+  for (i = 0; i < wanted; i++) {
+    int slot = (log -> start + log -> count - skip - wanted + i) % log -> capacity;
+    memcpy(&(records[i]), &(log -> records[slot]), sizeof(changeRecord_t));
+  }
+  pthread_mutex_unlock(log -> mutex);
+
+  //keep only the latest change of every file, qsort is not stable so compare epochs of equal names
+  qsort(records, wanted, sizeof(changeRecord_t), changelog_compareNames);
+  int unique = 0;
+  for (i = 0; i < wanted; i++) {
+    if (unique > 0 && strcmp(records[unique - 1].file_name, records[i].file_name) == 0) {
+      if (records[i].epoch > records[unique - 1].epoch) {
+        memcpy(&(records[unique - 1]), &(records[i]), sizeof(changeRecord_t));
+      }
+      continue;
+    }
+    if (unique != i) memcpy(&(records[unique]), &(records[i]), sizeof(changeRecord_t));
+    unique ++;
+  }
+
+  *num = unique;
+  return records;
+}
+
+/**
+ * Destroys the log by freeing the ring, the mutex lock, and the log itself.
+ * @param log [the change log]
+ */
+void changelog_destroy(changeLog_t* log) {
+  free(log -> records);
+  pthread_mutex_destroy(log -> mutex);
+  free(log -> mutex);
+  free(log);
+}
@@ -0,0 +1,51 @@
+#ifndef CHANGELOG_H
+#define CHANGELOG_H
+
+#include "constants.h"
+#include <pthread.h>
+
+
+/**
+ * one change to the tracker's file table: the file named file_name changed at epoch
+ * the content is not kept, broadcasts read the current entry (or its absence) from the table
+ */
+typedef struct changeRecord{
+  unsigned long epoch;
+  int op;                              //DELTA_ADD, DELTA_MODIFY or DELTA_DELETE
+  char file_name[FILE_NAME_MAX_LEN];
+}changeRecord_t;
+
+
+
+/**
+ * bounded, in memory log of the most recent changes to the tracker's file table
+ * records live in a ring buffer, once it is full the oldest change is forgotten
+ */
+typedef struct changeLog{
+  unsigned long epoch;        //global epoch of the table, the epoch of the newest change (0 = no change yet)
+  changeRecord_t* records;    //ring buffer
+  int capacity;
+  int start;                  //slot of the oldest record
+  int count;                  //number of records in the ring
+  pthread_mutex_t* mutex;
+}changeLog_t;
+
+
+
+
+changeLog_t* changelog_init(int capacity);
+
+unsigned long changelog_record(changeLog_t* log, int op, char* file_name);
+
+void changelog_restore(changeLog_t* log, unsigned long epoch);
+
+unsigned long changelog_getEpoch(changeLog_t* log);
+
+changeRecord_t* changelog_since(changeLog_t* log, unsigned long sinceEpoch, int* num, unsigned long* epoch);
+
+changeRecord_t* changelog_between(changeLog_t* log, unsigned long sinceEpoch, unsigned long untilEpoch, int* num);
+
+void changelog_destroy(changeLog_t* log);
+
+
+#endif
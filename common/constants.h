@@ -1,4 +1,5 @@
 #define IP_LEN 20
+#define MAX_HOSTNAME_SIZE 256
 // #define MAX_FILE_NUM 1000
 #define FILE_NAME_MAX_LEN 127
 #define MAX_PEER_NUM 10
@@ -6,13 +7,41 @@
 
 //File Monitor
 #define MONITOR_POLL_INTERVAL 1
+#define PARTIAL_FILE_EXT ".part"   // a file being downloaded, under its name with this after it until complete; not monitored
 
 #define HEARTBEAT_INTERVAL 30 // in seconds
-#define PIECE_LENGTH 999 // TODO: define it
+#define PIECE_LENGTH (256 * 1024) // bytes in the pieces files are downloaded from other peers in
 
 #define HANDSHAKE_PORT 99
+#define P2P_PORT 3490           // peers serve their files to each other on it (see peer/transfer.h)
+#define TRACKER_SHARD_NUM 1 // tracker shards sharing the file paths (see shardmap.h), shard i listens on HANDSHAKE_PORT + i
+
+//Tracker
+#define DEAD_PEER_TIMEOUT 90      // in seconds, peer is dead if no KEEPALIVE within this period
+#define MONITOR_ALIVE_INTERVAL 1  // in seconds, how often the tracker fires expired peer timers
+#define TRACKER_WORKER_NUM 4      // number of epoll worker threads owning peer connections
+#define TRACKER_LISTEN_BACKLOG 1024
+#define CHANGELOG_CAPACITY 4096   // changes to the tracker's file table kept for incremental broadcasts
+#define TRACKER_PEER_OUT_BUDGET (32L * 1024 * 1024)   // unsent bytes queued per peer before it is marked for full resync
+#define TRACKER_STATE_DIR "tracker_state"             // snapshot and change log of the tracker's tables, replayed on restart
+#define TRACKER_SNAPSHOT_INTERVAL 60                  // in seconds, how often the change log is folded into a new snapshot
+#define TRACKER_LOG_MAX_BYTES (16L * 1024 * 1024)     // fold the change log earlier once it grows past this
+#define TRACKER_BROADCAST_WINDOW_MS 50                // changes within this quiet time go out in one broadcast, 0 = broadcast every change
+#define TRACKER_BROADCAST_MAX_DELAY_MS 250            // longest a change waits for its broadcast under constant load
+#define TRACKER_METRICS_FILE "metrics.txt"            // counters and latency histograms, rewritten in the state directory
+#define TRACKER_METRICS_INTERVAL 5                    // in seconds, how often the metrics file is rewritten
 
 #define REGISTER 1
 #define KEEPALIVE 2
 #define FILEUPDATE 3
+#define FILEUPDATE_DELTA 4   // only the changes since the version the tracker last acknowledged
+#define EPOCH_ACK 5          // the peer applied the tracker's table up to ackedEpoch
+#define MERKLE_SYNC 6        // next round of a Merkle exchange: nodes to compare, and nodes to settle with their entries
+
+// tracker -> peer packet types
+#define TRACKER_FILETABLE 1  // setup / broadcast carrying the tracker's file table
+#define TRACKER_ACK 2        // the peer's table version in ackVersion has been applied
+#define TRACKER_RESYNC 3     // a gap was detected in the peer's deltas, peer must send a full FILEUPDATE
+#define TRACKER_DELTA 4      // broadcast carrying only the files changed between baseEpoch and epoch
+#define TRACKER_MERKLE 5     // answer to a REGISTER / MERKLE_SYNC carrying Merkle nodes, see merkle.h
 
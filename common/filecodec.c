@@ -0,0 +1,396 @@
+/* File: filecodec.c
+   Description: Compact wire encoding of file entries and deltas, shared by every packet that
+   		carries a file table.  Encoding measures the packet first and then writes straight from
+   		the list into the packet buffer, decoding builds the list straight from the packet,
+   		so no intermediate array of raw fileEntry_t is ever made.  Unit tested in the testing
+   		directory with filecodec_test.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <assert.h>
+
+#include "filecodec.h"
+
+
+/******************** VARINTS ******************/
+
+static int filecodec_varintLen(unsigned long value) {
+  int len = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    len ++;
+  }
+  return len;
+}
+
+static char* filecodec_putVarint(char* out, unsigned long value) {
+  while (value >= 0x80) {
+    *out++ = (char)((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  *out++ = (char) value;
+  return out;
+}
+
+/**
+ * read one varint
+ * @return [position after it, NULL if it runs past end or is too long]
+ */
+static char* filecodec_getVarint(char* in, char* end, unsigned long* value) {
+  unsigned long result = 0;
+  int shift = 0;
+  while (in < end && shift < 64) {
+    unsigned char byte = (unsigned char) *in++;
+    result |= (unsigned long)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return in;
+    }
+    shift += 7;
+  }
+  return NULL;
+}
+
+static unsigned long filecodec_zigzag(int value) {
+  return (unsigned long)(((unsigned int) value << 1) ^ (unsigned int)(value >> 31));
+}
+
+static int filecodec_unzigzag(unsigned long value) {
+  return (int)((unsigned int)(value >> 1) ^ -(unsigned int)(value & 1));
+}
+
+
+/******************** IP DICTIONARY ******************/
+
+/**
+ * packet id of a peer id, adding its ip to the dictionary on first sight
+ * @return [the packet id, FILECODEC_UNKNOWN if the peer id is not in use]
+ */
+static int filecodec_localId(fileCodec_t* codec, int id) {
+  if (id >= codec -> localCap) {
+    int cap = codec -> localCap;
+    while (codec -> localCap <= id) codec -> localCap *= 2;
+    codec -> local = (int*) realloc(codec -> local, codec -> localCap * sizeof(int));
+    for (; cap < codec -> localCap; cap++) {
+      codec -> local[cap] = FILECODEC_UNSEEN;
+    }
+  }
+  if (codec -> local[id] != FILECODEC_UNSEEN) return codec -> local[id];
+
+  if (codec -> ipNum == codec -> ipCap) {
+    codec -> ipCap *= 2;
+    codec -> ips = realloc(codec -> ips, codec -> ipCap * sizeof(*(codec -> ips)));
+  }
+  if (peerid_getIp(codec -> ids, id, codec -> ips[codec -> ipNum]) < 0 || codec -> ips[codec -> ipNum][0] == '\0') {
+    codec -> local[id] = FILECODEC_UNKNOWN;
+  } else {
+    codec -> local[id] = codec -> ipNum ++;
+  }
+  return codec -> local[id];
+}
+
+/**
+ * binary form of an ip, only if it turns back into exactly the same string
+ * @return [1 if addr holds it, 0 if the ip must go as a string]
+ */
+static int filecodec_ipv4(const char* ip, struct in_addr* addr) {
+  char back[INET_ADDRSTRLEN];
+  if (inet_pton(AF_INET, ip, addr) != 1) return 0;
+  if (inet_ntop(AF_INET, addr, back, sizeof(back)) == NULL) return 0;
+  return strcmp(back, ip) == 0;
+}
+
+static int filecodec_ipLen(const char* ip) {
+  struct in_addr addr;
+  if (filecodec_ipv4(ip, &addr)) return 1 + 4;
+  return 1 + (int) strlen(ip);
+}
+
+
+/******************** ENTRIES ******************/
+
+//length of a name as it goes on the wire, never past the end of file_name
+static int filecodec_nameBytes(fileEntry_t* entry) {
+  int len = 0;
+  while (len < FILE_NAME_MAX_LEN - 1 && entry -> file_name[len] != '\0') len ++;
+  return len;
+}
+
+static int filecodec_nameLen(fileEntry_t* entry) {
+  int len = filecodec_nameBytes(entry);
+  return filecodec_varintLen(len) + len;
+}
+
+static int filecodec_entryLen(fileCodec_t* codec, fileEntry_t* entry) {
+  int len = filecodec_nameLen(entry);
+  len += filecodec_varintLen(filecodec_zigzag(entry -> size));
+  len += filecodec_varintLen(entry -> timestamp);
+  int peerNum = 0;
+  int id;
+  for (id = filetable_nextHolder(entry, 0); id >= 0; id = filetable_nextHolder(entry, id + 1)) {
+    int local = filecodec_localId(codec, id);
+    if (local == FILECODEC_UNKNOWN) continue;
+    len += filecodec_varintLen(local);
+    peerNum ++;
+  }
+  len += filecodec_varintLen(peerNum);
+  return len;
+}
+
+static char* filecodec_putName(char* out, fileEntry_t* entry) {
+  int len = filecodec_nameBytes(entry);
+  out = filecodec_putVarint(out, len);
+  memcpy(out, entry -> file_name, len);
+  return out + len;
+}
+
+static char* filecodec_putEntry(fileCodec_t* codec, char* out, fileEntry_t* entry) {
+  out = filecodec_putName(out, entry);
+  out = filecodec_putVarint(out, filecodec_zigzag(entry -> size));
+  out = filecodec_putVarint(out, entry -> timestamp);
+
+  //every holder was resolved while measuring
+  int peerNum = 0;
+  int id;
+  for (id = filetable_nextHolder(entry, 0); id >= 0; id = filetable_nextHolder(entry, id + 1)) {
+    if (codec -> local[id] >= 0) peerNum ++;
+  }
+  out = filecodec_putVarint(out, peerNum);
+  for (id = filetable_nextHolder(entry, 0); id >= 0; id = filetable_nextHolder(entry, id + 1)) {
+    if (codec -> local[id] >= 0) out = filecodec_putVarint(out, codec -> local[id]);
+  }
+  return out;
+}
+
+static char* filecodec_getName(char* in, char* end, fileEntry_t* entry) {
+  unsigned long len;
+  in = filecodec_getVarint(in, end, &len);
+  if (in == NULL || len >= FILE_NAME_MAX_LEN || (unsigned long)(end - in) < len) return NULL;
+  memcpy(entry -> file_name, in, len);
+  entry -> file_name[len] = '\0';
+  return in + len;
+}
+
+/**
+ * read one entry, its holders become the decoding side's peer ids
+ * @param ids [packet id -> peer id of the decoding side, NULL to leave the holders out]
+ */
+static char* filecodec_getEntry(char* in, char* end, fileEntry_t* entry, int* ids, int ipNum) {
+  unsigned long size, timestamp, peerNum, local;
+  in = filecodec_getName(in, end, entry);
+  if (in == NULL) return NULL;
+  if ((in = filecodec_getVarint(in, end, &size)) == NULL) return NULL;
+  if ((in = filecodec_getVarint(in, end, &timestamp)) == NULL) return NULL;
+  if ((in = filecodec_getVarint(in, end, &peerNum)) == NULL || peerNum > (unsigned long) ipNum) return NULL;
+
+  entry -> size = filecodec_unzigzag(size);
+  entry -> timestamp = timestamp;
+  unsigned long i;
+  for (i = 0; i < peerNum; i++) {
+    if ((in = filecodec_getVarint(in, end, &local)) == NULL || local >= (unsigned long) ipNum) return NULL;
+    if (ids == NULL || ids[local] == PEERID_NONE) continue;
+    filetable_addHolderLocked(entry, ids[local]);
+  }
+  return in;
+}
+
+
+/******************** PACKET BODY ******************/
+
+/* Function to create a codec with an empty ip dictionary.  One codec encodes one packet body,
+   holders are resolved through ids (NULL only if the entries have no holders).
+
+	@return the pointer to the fileCodec_t that is created.
+*/
+fileCodec_t* filecodec_init(peerIdMap_t* ids) {
+  fileCodec_t* codec = (fileCodec_t*) malloc(sizeof(fileCodec_t));
+  codec -> ids = ids;
+  codec -> ipNum = 0;
+  codec -> ipCap = 16;
+  codec -> ips = malloc(codec -> ipCap * sizeof(*(codec -> ips)));
+  codec -> localCap = PEERID_INIT_CAP;
+  codec -> local = (int*) malloc(codec -> localCap * sizeof(int));
+  int i;
+  for (i = 0; i < codec -> localCap; i++) {
+    codec -> local[i] = FILECODEC_UNSEEN;
+  }
+  return codec;
+}
+
+/**
+ * First pass: collect the ips the entries and deltas refer to and tell how long their body is.
+ * @param  codec    [a fresh codec]
+ * @param  entries  [list of entries]
+ * @param  entryNum [number of entries to encode]
+ * @param  deltas   [list of deltas]
+ * @param  deltaNum [number of deltas to encode]
+ * @return          [length of the body in bytes]
+ */
+int filecodec_measure(fileCodec_t* codec, fileEntry_t* entries, int entryNum, fileDelta_t* deltas, int deltaNum) {
+  if (entryNum == 0 && deltaNum == 0) return 0;
+
+  long len = 0;
+  int i;
+  fileEntry_t* entry = entries;
+  for (i = 0; i < entryNum && entry != NULL; i++) {
+    len += filecodec_entryLen(codec, entry);
+    entry = entry -> next;
+  }
+  assert(i == entryNum);
+
+  fileDelta_t* delta = deltas;
+  for (i = 0; i < deltaNum && delta != NULL; i++) {
+    len += filecodec_varintLen(delta -> op);
+    len += (delta -> op == DELTA_DELETE) ? filecodec_nameLen(&(delta -> entry)) : filecodec_entryLen(codec, &(delta -> entry));
+    delta = delta -> next;
+  }
+  assert(i == deltaNum);
+
+  len += filecodec_varintLen(codec -> ipNum);
+  for (i = 0; i < codec -> ipNum; i++) {
+    len += filecodec_ipLen(codec -> ips[i]);
+  }
+  assert(len < FILECODEC_MAX_BODY);
+  return (int) len;
+}
+
+/**
+ * Second pass: write the body measured by filecodec_measure, with the same lists.
+ * @param  codec [the codec that measured the lists]
+ * @param  out   [room for the measured length]
+ * @return       [position after the body]
+ */
+char* filecodec_encode(fileCodec_t* codec, char* out, fileEntry_t* entries, int entryNum, fileDelta_t* deltas, int deltaNum) {
+  if (entryNum == 0 && deltaNum == 0) return out;
+
+  out = filecodec_putVarint(out, codec -> ipNum);
+  int i;
+  for (i = 0; i < codec -> ipNum; i++) {
+    struct in_addr addr;
+    if (filecodec_ipv4(codec -> ips[i], &addr)) {
+      *out++ = FILECODEC_IPV4;
+      memcpy(out, &addr, 4);
+      out += 4;
+    } else {
+      int len = (int) strlen(codec -> ips[i]);
+      *out++ = (char) len;
+      memcpy(out, codec -> ips[i], len);
+      out += len;
+    }
+  }
+
+  fileEntry_t* entry = entries;
+  for (i = 0; i < entryNum; i++) {
+    out = filecodec_putEntry(codec, out, entry);
+    entry = entry -> next;
+  }
+
+  fileDelta_t* delta = deltas;
+  for (i = 0; i < deltaNum; i++) {
+    out = filecodec_putVarint(out, delta -> op);
+    out = (delta -> op == DELTA_DELETE) ? filecodec_putName(out, &(delta -> entry)) : filecodec_putEntry(codec, out, &(delta -> entry));
+    delta = delta -> next;
+  }
+  return out;
+}
+
+/**
+ * Decode a body into newly malloced lists of entries and deltas.
+ * @param  buf      [the body]
+ * @param  len      [length of the body]
+ * @param  entryNum [number of entries in it]
+ * @param  entries  [out: list of entries, NULL if none]
+ * @param  deltaNum [number of deltas in it]
+ * @param  deltas   [out: list of deltas, NULL if none]
+ * @param  ids      [holders are interned here, NULL to leave them out (the tracker trusts only the sender)]
+ * @return          [1 if success, -1 if the body is malformed (nothing is returned then)]
+ */
+int filecodec_decode(char* buf, int len, int entryNum, fileEntry_t** entries, int deltaNum, fileDelta_t** deltas, peerIdMap_t* ids) {
+  *entries = NULL;
+  *deltas = NULL;
+  if (entryNum == 0 && deltaNum == 0) return len == 0 ? 1 : -1;
+
+  char* in = buf;
+  char* end = buf + len;
+  unsigned long ipNum;
+  if ((in = filecodec_getVarint(in, end, &ipNum)) == NULL || ipNum > (unsigned long) len) return -1;
+
+  char (*ips)[IP_LEN] = calloc(ipNum > 0 ? ipNum : 1, IP_LEN);
+  unsigned long k;
+  for (k = 0; k < ipNum && in != NULL; k++) {
+    if (in >= end) { in = NULL; break; }
+    int tag = (unsigned char) *in++;
+    if (tag == FILECODEC_IPV4) {
+      if (end - in < 4 || inet_ntop(AF_INET, in, ips[k], IP_LEN) == NULL) { in = NULL; break; }
+      in += 4;
+    } else {
+      if (tag >= IP_LEN || end - in < tag) { in = NULL; break; }
+      memcpy(ips[k], in, tag);
+      in += tag;
+    }
+  }
+
+  //packet id -> our peer id
+  int* peerIds = NULL;
+  if (in != NULL && ids != NULL) {
+    peerIds = (int*) malloc((ipNum > 0 ? ipNum : 1) * sizeof(int));
+    for (k = 0; k < ipNum; k++) {
+      peerIds[k] = peerid_lookup(ids, ips[k]);
+      if (peerIds[k] == PEERID_NONE) peerIds[k] = peerid_intern(ids, ips[k]);
+    }
+  }
+  free(ips);
+
+  fileEntry_t entryDummy;
+  entryDummy.next = NULL;
+  fileEntry_t* entryTail = &entryDummy;
+  int i;
+  for (i = 0; i < entryNum && in != NULL; i++) {
+    fileEntry_t* entry = (fileEntry_t*) calloc(1, sizeof(fileEntry_t));
+    entryTail -> next = entry;
+    entry -> prev = (entryTail == &entryDummy) ? NULL : entryTail;
+    entryTail = entry;
+    in = filecodec_getEntry(in, end, entry, peerIds, (int) ipNum);
+  }
+
+  fileDelta_t deltaDummy;
+  deltaDummy.next = NULL;
+  fileDelta_t* deltaTail = &deltaDummy;
+  for (i = 0; i < deltaNum && in != NULL; i++) {
+    fileDelta_t* delta = (fileDelta_t*) calloc(1, sizeof(fileDelta_t));
+    deltaTail -> next = delta;
+    deltaTail = delta;
+    unsigned long op;
+    if ((in = filecodec_getVarint(in, end, &op)) == NULL || op < DELTA_ADD || op > DELTA_DELETE) {
+      in = NULL;
+      break;
+    }
+    delta -> op = (int) op;
+    in = (op == DELTA_DELETE) ? filecodec_getName(in, end, &(delta -> entry)) : filecodec_getEntry(in, end, &(delta -> entry), peerIds, (int) ipNum);
+  }
+  free(peerIds);
+
+  //everything must be used up exactly
+  if (in == NULL || in != end) {
+    filetable_freeList(entryDummy.next);
+    filedelta_freeList(deltaDummy.next);
+    return -1;
+  }
+
+  *entries = entryDummy.next;
+  *deltas = deltaDummy.next;
+  return 1;
+}
+
+/**
+ * free the codec and its dictionary
+ * @param codec [the codec]
+ */
+void filecodec_destroy(fileCodec_t* codec) {
+  free(codec -> ips);
+  free(codec -> local);
+  free(codec);
+}
@@ -0,0 +1,50 @@
+#ifndef FILECODEC_H
+#define FILECODEC_H
+
+#include "constants.h"
+#include "filetable.h"
+#include "filedelta.h"
+#include "peerid.h"
+
+
+#define FILECODEC_IPV4 0            // dictionary tag: the ip follows as 4 bytes in network order
+#define FILECODEC_MAX_BODY (1 << 30) // larger bodies are rejected as malformed
+#define FILECODEC_UNSEEN -1          // peer id not met yet while measuring
+#define FILECODEC_UNKNOWN -2         // peer id no longer in use, the holder is left out
+
+
+/**
+ * compact, variable length encoding of the entries and deltas of one packet
+ *
+ * body := [ipNum ip*] entry* delta*           (nothing at all if there are no entries and no deltas)
+ * ip    := 0 byte[4]                          (dotted quad that round trips through inet_pton)
+ *        | len byte[len]                      (anything else, 1 <= len < IP_LEN)
+ * entry := nameLen name size timestamp peerNum peerId*
+ * delta := op (name, for DELTA_DELETE | entry)
+ * every number is an unsigned LEB128 varint, size is zigzag encoded first
+ * holders are ids into the packet's ip dictionary, each side maps them to its own peer ids
+ */
+typedef struct fileCodec{
+  peerIdMap_t* ids;      // resolves the holder ids of the entries being encoded
+  char (*ips)[IP_LEN];   // ip dictionary of the packet, a packet id is the position in it
+  int ipNum;
+  int ipCap;
+  int* local;            // peer id -> packet id, FILECODEC_UNSEEN / FILECODEC_UNKNOWN if not in the dictionary
+  int localCap;          // peer ids local has room for, grown to the highest id seen
+}fileCodec_t;
+
+
+
+
+fileCodec_t* filecodec_init(peerIdMap_t* ids);
+
+int filecodec_measure(fileCodec_t* codec, fileEntry_t* entries, int entryNum, fileDelta_t* deltas, int deltaNum);
+
+char* filecodec_encode(fileCodec_t* codec, char* out, fileEntry_t* entries, int entryNum, fileDelta_t* deltas, int deltaNum);
+
+int filecodec_decode(char* buf, int len, int entryNum, fileEntry_t** entries, int deltaNum, fileDelta_t** deltas, peerIdMap_t* ids);
+
+void filecodec_destroy(fileCodec_t* codec);
+
+
+#endif
@@ -0,0 +1,307 @@
+/* File: filedelta.c
+   Description: Peer side log of file table changes for the delta FILEUPDATE protocol.  The peer
+   		records every add/modify/delete with a new table version, sends the changes the tracker
+   		has not acknowledged yet, and drops them once a TRACKER_ACK covers their version.
+   		Unit tested in the testing directory with filedelta_test.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "filedelta.h"
+
+/* Function to initialize an empty delta log at version 0, nothing pending.
+	A mutex lock is malloced for the log.
+
+	@return the pointer to the fileDeltaLog_t that is created.
+*/
+fileDeltaLog_t* filedelta_initLog() {
+  fileDeltaLog_t* log = (fileDeltaLog_t*) malloc(sizeof(fileDeltaLog_t));
+  log -> version = 0;
+  log -> ackedVersion = 0;
+  log -> head = NULL;
+  log -> tail = NULL;
+  log -> size = 0;
+
+  //create the mutex for the log
+  pthread_mutex_t* mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(mutex, NULL);
+  log -> mutex = mutex;
+
+  return log;
+}
+
+/**
+ * Record a change to the peer's file table under a new version.  A pending change for
+ * the same file name is replaced, since only the latest state of a file matters to the tracker.
+ * @param  log    [the delta log]
+ * @param  op     [DELTA_ADD, DELTA_MODIFY or DELTA_DELETE]
+ * @param  entry  [the file after the change, the log shares its holders]
+ * @return        [the new table version]
+ */
+unsigned long filedelta_record(fileDeltaLog_t* log, int op, fileEntry_t* entry) {
+  assert(log != NULL && entry != NULL);
+
+  pthread_mutex_lock(log -> mutex);
+
+  //unlink an older pending change of the same file, if any
+  fileDelta_t* prev = NULL;
+  fileDelta_t* iter = log -> head;
+  while (iter != NULL) {
+    if (strcmp(iter -> entry.file_name, entry -> file_name) == 0) {
+      if (prev == NULL) log -> head = iter -> next;
+      else prev -> next = iter -> next;
+      if (log -> tail == iter) log -> tail = prev;
+      log -> size --;
+      filetable_releaseHolders(&(iter -> entry));
+      free(iter);
+      break;
+    }
+    prev = iter;
+    iter = iter -> next;
+  }
+
+  //append the change with the next version
+  fileDelta_t* delta = (fileDelta_t*) malloc(sizeof(fileDelta_t));
+  delta -> op = op;
+  delta -> version = ++(log -> version);
+  memcpy(&(delta -> entry), entry, sizeof(fileEntry_t));
+  filetable_retainHolders(&(delta -> entry));
+  delta -> entry.next = NULL;
+  delta -> entry.prev = NULL;
+  delta -> next = NULL;
+
+  if (log -> size == 0) {
+    log -> head = delta;
+  } else {
+    log -> tail -> next = delta;
+  }
+  log -> tail = delta;
+  log -> size ++;
+
+  unsigned long version = log -> version;
+  pthread_mutex_unlock(log -> mutex);
+  return version;
+}
+
+/**
+ * The tracker applied everything up to version: drop the changes it covers.
+ * @param  log      [the delta log]
+ * @param  version  [version acknowledged by the tracker]
+ * @return          [number of pending changes dropped, -1 if the ack is stale]
+ */
+int filedelta_ack(fileDeltaLog_t* log, unsigned long version) {
+  pthread_mutex_lock(log -> mutex);
+
+  if (version < log -> ackedVersion || version > log -> version) {
+    pthread_mutex_unlock(log -> mutex);
+    return -1;
+  }
+  log -> ackedVersion = version;
+
+  //pending changes are kept in version order, so the acked ones are a prefix
+  int dropped = 0;
+  while (log -> head != NULL && log -> head -> version <= version) {
+    fileDelta_t* acked = log -> head;
+    log -> head = acked -> next;
+    filetable_releaseHolders(&(acked -> entry));
+    free(acked);
+    log -> size --;
+    dropped ++;
+  }
+  if (log -> head == NULL) log -> tail = NULL;
+
+  pthread_mutex_unlock(log -> mutex);
+  return dropped;
+}
+
+/**
+ * Copy the pending changes to send them in a FILEUPDATE_DELTA.
+ * @param  log          [the delta log]
+ * @param  num          [out: number of changes copied]
+ * @param  baseVersion  [out: version the tracker acknowledged, the changes apply on top of it]
+ * @param  version      [out: version the tracker's view reaches after applying them]
+ * @return              [malloced copy of the pending list, NULL if nothing is pending; free with filedelta_freeList]
+ */
+fileDelta_t* filedelta_getPending(fileDeltaLog_t* log, int* num, unsigned long* baseVersion, unsigned long* version) {
+  pthread_mutex_lock(log -> mutex);
+
+  fileDelta_t dummy;
+  dummy.next = NULL;
+  fileDelta_t* copy = &dummy;
+
+  fileDelta_t* iter = log -> head;
+  while (iter != NULL) {
+    copy -> next = (fileDelta_t*) malloc(sizeof(fileDelta_t));
+    copy = copy -> next;
+    memcpy(copy, iter, sizeof(fileDelta_t));
+    filetable_retainHolders(&(copy -> entry));
+    copy -> next = NULL;
+    iter = iter -> next;
+  }
+
+  *num = log -> size;
+  *baseVersion = log -> ackedVersion;
+  *version = log -> version;
+
+  pthread_mutex_unlock(log -> mutex);
+  return dummy.next;
+}
+
+/**
+ * Free a list of deltas (e.g. from filedelta_getPending or a decoded packet).
+ * @param head [head of the list]
+ */
+void filedelta_freeList(fileDelta_t* head) {
+  while (head != NULL) {
+    fileDelta_t* next = head -> next;
+    filetable_releaseHolders(&(head -> entry));
+    free(head);
+    head = next;
+  }
+}
+
+/**
+ * Destroys the log by freeing every pending change, the mutex lock, and the log itself.
+ * @param log [the delta log]
+ */
+void filedelta_destroyLog(fileDeltaLog_t* log) {
+  filedelta_freeList(log -> head);
+  pthread_mutex_destroy(log -> mutex);
+  free(log -> mutex);
+  free(log);
+}
+
+/**
+ * Apply a list of changes to a table, e.g. a TRACKER_DELTA to the peer's copy of the tracker's table.
+ * Every delta carries the whole latest state of its file, so applying one twice is harmless.
+ * @param  table [the table to change]
+ * @param  head  [list of changes]
+ * @return       [number of changes that altered the table]
+ */
+int filedelta_apply(fileTable_t* table, fileDelta_t* head) {
+  int applied = 0;
+  fileDelta_t* iter = head;
+  while (iter != NULL) {
+    if (iter -> op == DELTA_DELETE) {
+      if (filetable_deleteFileEntryByName(table, iter -> entry.file_name) > 0) applied ++;
+      iter = iter -> next;
+      continue;
+    }
+
+    pthread_mutex_lock(table -> filetable_mutex);
+    fileEntry_t* entry = filetable_searchFileByNameLocked(table, iter -> entry.file_name);
+    if (entry != NULL) {
+      //overwrite everything but the table's own links
+      fileEntry_t* next = entry -> next;
+      fileEntry_t* prev = entry -> prev;
+      filetable_releaseHolders(entry);
+      memcpy(entry, &(iter -> entry), sizeof(fileEntry_t));
+      filetable_retainHolders(entry);
+      entry -> next = next;
+      entry -> prev = prev;
+      pthread_mutex_unlock(table -> filetable_mutex);
+    } else {
+      pthread_mutex_unlock(table -> filetable_mutex);
+      entry = (fileEntry_t*) malloc(sizeof(fileEntry_t));
+      memcpy(entry, &(iter -> entry), sizeof(fileEntry_t));
+      filetable_retainHolders(entry);
+      entry -> next = NULL;
+      entry -> prev = NULL;
+      filetable_appendFileEntry(table, entry);
+    }
+    applied ++;
+    iter = iter -> next;
+  }
+  return applied;
+}
+
+/**
+ * Turn changes recorded in the tracker's changelog into deltas carrying each file's state in a snapshot,
+ * every changed file goes out as DELTA_MODIFY with its entry, or as DELTA_DELETE if it left the table.
+ * @param  table   [snapshot of the table the changes lead to]
+ * @param  changes [changes, oldest first (see changelog_between)]
+ * @param  num     [number of changes]
+ * @return         [list of num deltas, each versioned with the epoch of its change]
+ */
+fileDelta_t* filedelta_fromChanges(fileSnapshot_t* table, changeRecord_t* changes, int num) {
+  fileDelta_t dummy;
+  dummy.next = NULL;
+  fileDelta_t* tail = &dummy;
+  int i;
+  for (i = 0; i < num; i++) {
+    fileDelta_t* delta = (fileDelta_t*) malloc(sizeof(fileDelta_t));
+    fileEntry_t* entry = filetable_searchSnapshot(table, changes[i].file_name);
+    if (entry != NULL) {
+      delta -> op = DELTA_MODIFY;
+      memcpy(&(delta -> entry), entry, sizeof(fileEntry_t));
+      filetable_retainHolders(&(delta -> entry));
+    } else {
+      delta -> op = DELTA_DELETE;
+      memset(&(delta -> entry), 0, sizeof(fileEntry_t));
+      memcpy(delta -> entry.file_name, changes[i].file_name, FILE_NAME_MAX_LEN);
+    }
+    delta -> entry.next = NULL;
+    delta -> entry.prev = NULL;
+    delta -> version = changes[i].epoch;
+    delta -> next = NULL;
+    tail -> next = delta;
+    tail = delta;
+  }
+  return dummy.next;
+}
+
+/******************** ARRAY <==========> LINKEDLIST CONVERSION ******************/
+
+/**
+ * convert a list of deltas into a continous chunk of FILEDELTA_WIRE_LEN records, for ease of sending
+ * @param  head  [head of the list]
+ * @param  num   [number of deltas in the list]
+ * @return       [array chunk]
+ */
+char* filedelta_convertDeltasToArray(fileDelta_t* head, int num) {
+  char* buf = (char*) malloc(num * FILEDELTA_WIRE_LEN);
+
+  fileDelta_t* iter = head;
+  int i = 0;
+  while (iter != NULL && i < num) {
+    memcpy(buf + i * FILEDELTA_WIRE_LEN, &(iter -> op), sizeof(int));
+    memcpy(buf + i * FILEDELTA_WIRE_LEN + sizeof(int), &(iter -> entry), sizeof(fileEntry_t));
+    iter = iter -> next;
+    i++;
+  }
+  return buf;
+}
+
+/**
+ * convert received buffer back to a list of deltas, NULL if buffer is empty
+ * @param  buf  [received buffer]
+ * @param  num  [number of deltas in the buffer]
+ * @return      [head of the list]
+ */
+fileDelta_t* filedelta_convertArrayToDeltas(char* buf, int num) {
+  fileDelta_t dummy;
+  dummy.next = NULL;
+  fileDelta_t* iter = &dummy;
+
+  int i;
+  for (i = 0; i < num; i++) {
+    fileDelta_t* delta = (fileDelta_t*) malloc(sizeof(fileDelta_t));
+    memcpy(&(delta -> op), buf + i * FILEDELTA_WIRE_LEN, sizeof(int));
+    memcpy(&(delta -> entry), buf + i * FILEDELTA_WIRE_LEN + sizeof(int), sizeof(fileEntry_t));
+    delta -> entry.file_name[FILE_NAME_MAX_LEN - 1] = '\0';
+    //the holders stay with the sender
+    delta -> entry.holders = NULL;
+    delta -> entry.peerNum = 0;
+    delta -> entry.next = NULL;
+    delta -> entry.prev = NULL;
+    delta -> version = 0;
+    delta -> next = NULL;
+    iter -> next = delta;
+    iter = delta;
+  }
+  return dummy.next;
+}
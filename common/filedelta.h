@@ -0,0 +1,68 @@
+#ifndef FILEDELTA_H
+#define FILEDELTA_H
+
+#include "constants.h"
+#include "filetable.h"
+#include "changelog.h"
+#include <pthread.h>
+
+
+#define DELTA_ADD 1
+#define DELTA_MODIFY 2
+#define DELTA_DELETE 3
+
+//size of one delta on the wire: op followed by the fileEntry
+#define FILEDELTA_WIRE_LEN (sizeof(int) + sizeof(fileEntry_t))
+
+
+/**
+ * one change to a peer's file table
+ */
+typedef struct fileDelta{
+  int op;                    //DELTA_ADD, DELTA_MODIFY or DELTA_DELETE
+  unsigned long version;     //table version this change produced
+  fileEntry_t entry;         //the file after the change, only file_name is meaningful for DELTA_DELETE
+  struct fileDelta* next;
+}fileDelta_t;
+
+
+
+/**
+ * peer side log of the changes the tracker has not acknowledged yet
+ * every change bumps version, at most one pending change is kept per file name (the latest)
+ */
+typedef struct fileDeltaLog{
+  unsigned long version;       //current version of the peer's file table
+  unsigned long ackedVersion;  //last version the tracker acknowledged
+  fileDelta_t* head;           //pending changes, oldest first
+  fileDelta_t* tail;
+  int size;
+  pthread_mutex_t* mutex;
+}fileDeltaLog_t;
+
+
+
+
+fileDeltaLog_t* filedelta_initLog();
+
+unsigned long filedelta_record(fileDeltaLog_t* log, int op, fileEntry_t* entry);
+
+int filedelta_ack(fileDeltaLog_t* log, unsigned long version);
+
+fileDelta_t* filedelta_getPending(fileDeltaLog_t* log, int* num, unsigned long* baseVersion, unsigned long* version);
+
+void filedelta_freeList(fileDelta_t* head);
+
+void filedelta_destroyLog(fileDeltaLog_t* log);
+
+int filedelta_apply(fileTable_t* table, fileDelta_t* head);
+
+fileDelta_t* filedelta_fromChanges(fileSnapshot_t* table, changeRecord_t* changes, int num);
+
+
+char* filedelta_convertDeltasToArray(fileDelta_t* head, int num);
+
+fileDelta_t* filedelta_convertArrayToDeltas(char* buf, int num);
+
+
+#endif
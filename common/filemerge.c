@@ -0,0 +1,163 @@
+/* File: filemerge.c
+   Description: Reconciles a peer's file table with the tracker's by a single merge of both, sorted by
+   		name hash, into an explicit set of changes.  Unit tested in the testing directory with filemerge_test.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "filemerge.h"
+#include "peerid.h"
+
+
+#define FILEMERGE_INIT_CAP 16
+
+
+/* append one change
+   @param set   [the change set]
+   @param op    [FILEMERGE_ADDED .. FILEMERGE_DELETED]
+   @param entry [the entry it is about] */
+static void filemerge_add(fileChangeSet_t* set, int op, fileEntry_t* entry) {
+  if (set -> size == set -> capacity) {
+    set -> capacity *= 2;
+    set -> changes = (fileChange_t*) realloc(set -> changes, set -> capacity * sizeof(fileChange_t));
+  }
+  set -> changes[set -> size].op = op;
+  set -> changes[set -> size].entry = entry;
+  set -> size++;
+  set -> counts[op]++;
+}
+
+/* the change one file both sides have calls for, the same rules as the tracker's sync of a FILEUPDATE entry
+   @param set    [the change set]
+   @param theirs [the peer's entry]
+   @param ours   [the tracker's entry of the same name]
+   @param peerId [the peer] */
+static void filemerge_compare(fileChangeSet_t* set, fileEntry_t* theirs, fileEntry_t* ours, int peerId) {
+  if (theirs -> timestamp > ours -> timestamp) {
+    filemerge_add(set, FILEMERGE_UPDATED, theirs);
+  } else if (theirs -> timestamp < ours -> timestamp) {
+    filemerge_add(set, FILEMERGE_STALE, theirs);
+  } else if (peerId != PEERID_NONE && !filetable_hasHolder(ours, peerId)) {
+    filemerge_add(set, FILEMERGE_HOLDER, theirs);
+  } else {
+    set -> same++;
+  }
+}
+
+/* the entry of a run of equal name hashes with the given name
+   @param  entries [the run]
+   @param  num     [its length]
+   @param  name    [the name]
+   @return         [the entry, NULL if the run has none] */
+static fileEntry_t* filemerge_findInRun(fileEntry_t** entries, int num, const char* name) {
+  int i;
+  for (i = 0; i < num; i++) {
+    if (strcmp(entries[i] -> file_name, name) == 0) return entries[i];
+  }
+  return NULL;
+}
+
+
+
+/**
+ * an empty change set
+ * @return [the set, freed with filemerge_destroy]
+ */
+fileChangeSet_t* filemerge_init() {
+  fileChangeSet_t* set = (fileChangeSet_t*) calloc(1, sizeof(fileChangeSet_t));
+  set -> capacity = FILEMERGE_INIT_CAP;
+  set -> changes = (fileChange_t*) malloc(set -> capacity * sizeof(fileChange_t));
+  return set;
+}
+
+/**
+ * add the changes the peer's table calls for under one node of both trees (MERKLE_ROOT for whole tables)
+ * Both trees list their entries by name hash, so one pass over the two ranges pairs up every name; names
+ * whose hashes collide are paired by comparing the names of the short runs they form.
+ * Nothing is locked, ours is usually built from a published snapshot of the tracker's table
+ * @param set    [changes are appended to it]
+ * @param theirs [tree of the peer's table]
+ * @param ours   [tree of the tracker's table]
+ * @param id     [the node]
+ * @param peerId [id of the peer, PEERID_NONE if it has none: it is never made a holder]
+ */
+void filemerge_diff(fileChangeSet_t* set, merkleTree_t* theirs, merkleTree_t* ours, unsigned long id, int peerId) {
+  int theirNum, ourNum;
+  fileEntry_t** theirEntries = merkle_nodeEntries(theirs, id, &theirNum);
+  fileEntry_t** ourEntries = merkle_nodeEntries(ours, id, &ourNum);
+  unsigned long* theirKeys = theirs -> keys + (theirEntries - theirs -> entries);
+  unsigned long* ourKeys = ours -> keys + (ourEntries - ours -> entries);
+
+  int i = 0, j = 0;
+  while (i < theirNum || j < ourNum) {
+    if (j == ourNum || (i < theirNum && theirKeys[i] < ourKeys[j])) {
+      filemerge_add(set, FILEMERGE_ADDED, theirEntries[i++]);
+      continue;
+    }
+    if (i == theirNum || ourKeys[j] < theirKeys[i]) {
+      filemerge_add(set, FILEMERGE_DELETED, ourEntries[j++]);
+      continue;
+    }
+
+    //the same hash on both sides, almost always one entry each with the same name
+    unsigned long key = theirKeys[i];
+    int theirEnd = i, ourEnd = j;
+    while (theirEnd < theirNum && theirKeys[theirEnd] == key) theirEnd++;
+    while (ourEnd < ourNum && ourKeys[ourEnd] == key) ourEnd++;
+    if (theirEnd - i == 1 && ourEnd - j == 1 && strcmp(theirEntries[i] -> file_name, ourEntries[j] -> file_name) == 0) {
+      filemerge_compare(set, theirEntries[i], ourEntries[j], peerId);
+    } else {
+      int k;
+      for (k = i; k < theirEnd; k++) {
+        fileEntry_t* match = filemerge_findInRun(ourEntries + j, ourEnd - j, theirEntries[k] -> file_name);
+        if (match == NULL) {
+          filemerge_add(set, FILEMERGE_ADDED, theirEntries[k]);
+        } else {
+          filemerge_compare(set, theirEntries[k], match, peerId);
+        }
+      }
+      for (k = j; k < ourEnd; k++) {
+        if (filemerge_findInRun(theirEntries + i, theirEnd - i, ourEntries[k] -> file_name) == NULL) {
+          filemerge_add(set, FILEMERGE_DELETED, ourEntries[k]);
+        }
+      }
+    }
+    i = theirEnd;
+    j = ourEnd;
+  }
+}
+
+/**
+ * add the changes under a node both trees agree on (see merkle_agrees): the peer has the very entries the tracker
+ * has there, holders aside, so it only has to be made a holder of those that do not list it yet.
+ * Those FILEMERGE_HOLDER changes point to the tracker's entries, which have the peer's name, size and timestamp
+ * @param set    [changes are appended to it]
+ * @param ours   [tree of the tracker's table]
+ * @param id     [the node]
+ * @param peerId [id of the peer, PEERID_NONE if it has none: nothing is added]
+ */
+void filemerge_held(fileChangeSet_t* set, merkleTree_t* ours, unsigned long id, int peerId) {
+  int num;
+  fileEntry_t** entries = merkle_nodeEntries(ours, id, &num);
+  int i;
+  for (i = 0; i < num; i++) {
+    if (peerId != PEERID_NONE && !filetable_hasHolder(entries[i], peerId)) {
+      filemerge_add(set, FILEMERGE_HOLDER, entries[i]);
+    } else {
+      set -> same++;
+    }
+  }
+}
+
+/**
+ * free a change set, not the entries it points to
+ * @param set [the set, may be NULL]
+ */
+void filemerge_destroy(fileChangeSet_t* set) {
+  if (set == NULL) return;
+  free(set -> changes);
+  free(set);
+}
@@ -0,0 +1,53 @@
+#ifndef FILEMERGE_H
+#define FILEMERGE_H
+
+#include "constants.h"
+#include "filetable.h"
+#include "merkle.h"
+
+
+#define FILEMERGE_ADDED 0     // the peer has a file the tracker does not
+#define FILEMERGE_UPDATED 1   // the peer has a newer version of the file
+#define FILEMERGE_HOLDER 2    // same version, the peer is not one of its holders yet
+#define FILEMERGE_STALE 3     // the peer has an older version, it is sent the current one again
+#define FILEMERGE_DELETED 4   // the tracker has a file the peer does not
+#define FILEMERGE_OP_NUM 5
+
+
+/**
+ * one difference between a peer's table and the tracker's
+ * entry is the peer's entry, but for FILEMERGE_DELETED and the changes of filemerge_held where it is the tracker's
+ */
+typedef struct fileChange{
+  int op;
+  fileEntry_t* entry;
+}fileChange_t;
+
+
+
+/**
+ * what it takes to turn the tracker's table into one agreeing with a peer's, found by merging both
+ * tables in name hash order (as kept by their Merkle trees, see merkle.h) in one pass.
+ * Entries that agree are only counted, the changes point into the two trees' entries
+ */
+typedef struct fileChangeSet{
+  int size;
+  int capacity;
+  fileChange_t* changes;               // in name hash order
+  int counts[FILEMERGE_OP_NUM];        // number of changes of each op
+  int same;                            // entries both sides agree on, the peer already a holder
+}fileChangeSet_t;
+
+
+
+
+fileChangeSet_t* filemerge_init();
+
+void filemerge_diff(fileChangeSet_t* set, merkleTree_t* theirs, merkleTree_t* ours, unsigned long id, int peerId);
+
+void filemerge_held(fileChangeSet_t* set, merkleTree_t* ours, unsigned long id, int peerId);
+
+void filemerge_destroy(fileChangeSet_t* set);
+
+
+#endif
@@ -21,12 +21,112 @@
 #include <sys/time.h>
 #include <time.h>
 #include <assert.h>
+#include <sched.h>
 
 #include "filetable.h"
 #include "peertable.h"
 
+/******************** NAME INDEX ******************/
+
+//marks an index slot whose entry was deleted, so probing continues past it
+static fileEntry_t filetable_tombstone;
+#define FILETABLE_TOMBSTONE (&filetable_tombstone)
+
+/**
+ * FNV-1a hash of a file name
+ * @param  filename [name to hash]
+ * @return          [64 bit hash]
+ */
+static unsigned long long filetable_hashName(const char* filename) {
+  unsigned long long hash = 14695981039346656037ULL;
+  while(*filename) {
+    hash ^= (unsigned char) *filename++;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * find the index slot holding the entry with filename, caller holds the table mutex
+ * @param  tablePtr [pointer to the fileTable]
+ * @param  filename [filename]
+ * @return          [slot number if found, -1 if cannot find]
+ */
+static int filetable_indexFind(fileTable_t* tablePtr, const char* filename) {
+  int mask = tablePtr -> indexCap - 1;
+  int slot = (int)(filetable_hashName(filename) & mask);
+
+  while(tablePtr -> index[slot] != NULL) {
+    fileEntry_t* entry = tablePtr -> index[slot];
+    if(entry != FILETABLE_TOMBSTONE && strcmp(entry -> file_name, filename) == 0) {
+      return slot;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return -1;
+}
+
+/**
+ * put an entry into the first free slot of its probe sequence, caller made sure there is room
+ */
+static void filetable_indexPut(fileEntry_t** index, int cap, fileEntry_t* entry) {
+  int mask = cap - 1;
+  int slot = (int)(filetable_hashName(entry -> file_name) & mask);
+  while(index[slot] != NULL && index[slot] != FILETABLE_TOMBSTONE) {
+    slot = (slot + 1) & mask;
+  }
+  index[slot] = entry;
+}
+
+/**
+ * rebuild the index with newCap slots, dropping all tombstones
+ * @param  tablePtr [pointer to the fileTable]
+ * @param  newCap   [new number of slots, power of 2]
+ */
+static void filetable_indexRebuild(fileTable_t* tablePtr, int newCap) {
+  fileEntry_t** newIndex = (fileEntry_t**) calloc(newCap, sizeof(fileEntry_t*));
+
+  fileEntry_t* iter = tablePtr -> head;
+  while(iter != NULL) {
+    filetable_indexPut(newIndex, newCap, iter);
+    iter = iter -> next;
+  }
+
+  free(tablePtr -> index);
+  tablePtr -> index = newIndex;
+  tablePtr -> indexCap = newCap;
+  tablePtr -> indexUsed = tablePtr -> size;
+}
+
+/**
+ * add an entry to the index, growing it first if it is too full, caller holds the table mutex
+ * and the entry is already linked into the list
+ */
+static void filetable_indexInsert(fileTable_t* tablePtr, fileEntry_t* entry) {
+  if((tablePtr -> indexUsed + 1) * 100 > tablePtr -> indexCap * FILETABLE_INDEX_MAX_LOAD) {
+    int newCap = tablePtr -> indexCap;
+    //only grow if live entries need it, otherwise just clean up the tombstones
+    while((tablePtr -> size + 1) * 100 * 2 > newCap * FILETABLE_INDEX_MAX_LOAD) {
+      newCap *= 2;
+    }
+    filetable_indexRebuild(tablePtr, newCap);
+    //the list already contains entry, so the rebuild indexed it
+    return;
+  }
+
+  int mask = tablePtr -> indexCap - 1;
+  int slot = (int)(filetable_hashName(entry -> file_name) & mask);
+  while(tablePtr -> index[slot] != NULL && tablePtr -> index[slot] != FILETABLE_TOMBSTONE) {
+    slot = (slot + 1) & mask;
+  }
+  if(tablePtr -> index[slot] == NULL) tablePtr -> indexUsed ++;
+  tablePtr -> index[slot] = entry;
+}
+
+
 /* Function to initialize a file table.  The head and tail of the filetable will be set to 
-	NULL and the size is 0.  A mutex lock is malloced for the filetable.
+	NULL and the size is 0.  A mutex lock is malloced for the filetable, as well as an
+	empty name index.
 
 	@return the pointer to the fileTable_t that is created.
 */
@@ -42,13 +142,23 @@ fileTable_t* filetable_init() {
 	pthread_mutex_init(mutex, NULL);
 	tablePtr->filetable_mutex = mutex;
 
+	//create the empty name index
+	tablePtr->index = (fileEntry_t**) calloc(FILETABLE_INDEX_INIT_CAP, sizeof(fileEntry_t*));
+	tablePtr->indexCap = FILETABLE_INDEX_INIT_CAP;
+	tablePtr->indexUsed = 0;
+
+	//readers always find a snapshot, the empty table at version 0
+	tablePtr->snapshot = NULL;
+	tablePtr->snapshotReaders = 0;
+	filetable_publishSnapshotLocked(tablePtr, 0);
+
 	return tablePtr;
 }
 
 /**
- * Iterates dest table to check if there exist an fileEntry with filename
+ * Look up the fileEntry with filename in the table's name index.
  * Used the mutex lock for the table.
- * @param  tablePtr      [head of fileEntries in dest fileTable]
+ * @param  tablePtr      [the fileTable]
  * @param  filename  [filename]
  * @return           [pointer to entry if found, NULL if cannot find]
  */
@@ -57,28 +167,28 @@ fileEntry_t* filetable_searchFileByName(fileTable_t* tablePtr, char* filename) {
   if(tablePtr -> size == 0) return NULL;
 
   pthread_mutex_lock(tablePtr -> filetable_mutex);
-  
-  fileEntry_t* iter = tablePtr -> head;
-  while(iter != NULL) {
-
-    //if the entry matches the name, the file is in the table so return that entry
-		if(strcmp(iter -> file_name, filename) == 0){
-      pthread_mutex_unlock(tablePtr -> filetable_mutex);
-			return iter;
-		}
-
-    //otherwise, move to the next file in the table
-		iter = iter -> next;
-	}
-
+  fileEntry_t* res = filetable_searchFileByNameLocked(tablePtr, filename);
   pthread_mutex_unlock(tablePtr -> filetable_mutex);
-	return NULL;
+	return res;
+}
+
+/**
+ * Look up the fileEntry with filename in the table's name index, for callers
+ * already holding the table's mutex.
+ * @param  tablePtr  [the fileTable]
+ * @param  filename  [filename]
+ * @return           [pointer to entry if found, NULL if cannot find]
+ */
+fileEntry_t* filetable_searchFileByNameLocked(fileTable_t* tablePtr, char* filename) {
+  int slot = filetable_indexFind(tablePtr, filename);
+  return slot < 0 ? NULL : tablePtr -> index[slot];
 }
 
 /**
  * Iterates through a file table to check if there exist an fileEntry with filename
- * Does not take advantage of a mutex lock.
- * NOTE: Try to use previous function if possible.
+ * Does not take advantage of a mutex lock, nor of the name index (head may be a list
+ * that is not in any table, e.g. one decoded from a packet).
+ * NOTE: Try to use previous functions if possible.
  * @param  head      [head of fileEntries in dest fileTable]
  * @param  filename  [filename]
  * @return           [pointer to entry if found, NULL if cannot find]
@@ -110,65 +220,35 @@ int filetable_deleteFileEntryByName(fileTable_t* tablePtr, char* filename){
 	if(tablePtr -> size == 0) return -1; //table is zero-size
 
 	pthread_mutex_lock(tablePtr->filetable_mutex);
-	fileEntry_t* file = tablePtr -> head;
-	
-	//check if table head needs to be replaced
-	if(strcmp(file -> file_name, filename) == 0) {
-		
-		//if the head is the only file, updated the head and tail pointers to be NULL
-		if (tablePtr -> size == 1) {
-			tablePtr -> head = NULL;
-			tablePtr -> tail = NULL;
-		}
-
-		//otherwise update the head to be the file after the head
-		else {
-			tablePtr -> head = tablePtr -> head -> next;
-		}
-
-    tablePtr -> size -= 1;
-		
-    free(file);
-    pthread_mutex_unlock(tablePtr->filetable_mutex);
-
-		return 1;
-	}
-
-  //otherwise, the file is either in the list and not the head or is not in the list
-  else {
-    fileEntry_t* prev_file = file;
-    file = file -> next;
-
-    //looping until reach the end of the list or find the file
-    while(file != NULL){
-
-      //if find the file in the list, remove it and update pointers
-      if (strcmp(file -> file_name, filename) == 0) {
-        prev_file -> next = file -> next;
 
-        //if the file is the tail, update the tail to be the previous file in the list
-        if (file == tablePtr -> tail) {
-          tablePtr -> tail = prev_file;
-        }
-
-        tablePtr -> size -= 1;
-
-        free(file);
-        pthread_mutex_unlock(tablePtr -> filetable_mutex);
-
-        return 1;
-      }
-
-      //move the pointers to the next pair of files.
-      prev_file = file;
-      file = file -> next;
-    }
-
-    //if reach here, then the file is not found and return -1
+  //find the file through the index, if it is not there it is not in the list either
+  int slot = filetable_indexFind(tablePtr, filename);
+  if(slot < 0) {
     pthread_mutex_unlock(tablePtr -> filetable_mutex);
     return -1;
+  }
+	fileEntry_t* file = tablePtr -> index[slot];
+  tablePtr -> index[slot] = FILETABLE_TOMBSTONE;
+
+  //unlink the file, updating head and tail if the file was one of them
+  if(file -> prev != NULL) {
+    file -> prev -> next = file -> next;
+  } else {
+    tablePtr -> head = file -> next;
+  }
 
+  if(file -> next != NULL) {
+    file -> next -> prev = file -> prev;
+  } else {
+    tablePtr -> tail = file -> prev;
   }
+
+  tablePtr -> size -= 1;
+
+  filetable_freeEntry(file);
+  pthread_mutex_unlock(tablePtr -> filetable_mutex);
+
+  return 1;
 }
 
 
@@ -182,20 +262,27 @@ void filetable_appendFileEntry(fileTable_t* tablePtr, fileEntry_t* newEntryPtr){
 
 	pthread_mutex_lock(tablePtr -> filetable_mutex);
 
+  newEntryPtr -> next = NULL;
+
   //if the table is empty, set the new file entry to be the head and tail
   if (tablePtr -> size == 0) {
+    newEntryPtr -> prev = NULL;
 		tablePtr -> head = newEntryPtr;
     tablePtr -> tail = newEntryPtr;
 	} 
 
   //otherwise, append the new file entry to the end of the list and make the new file the tail
   else {
+    newEntryPtr -> prev = tablePtr -> tail;
 		tablePtr -> tail -> next = newEntryPtr;
 		tablePtr -> tail = newEntryPtr;
 	}
 
 	tablePtr -> size ++;
 
+  //make the new file reachable by name
+  filetable_indexInsert(tablePtr, newEntryPtr);
+
 	pthread_mutex_unlock(tablePtr -> filetable_mutex);
 	return;
 }
@@ -213,12 +300,12 @@ void filetable_printFileTable(fileTable_t* tablePtr) {
 		time_t rawtime;
 		rawtime = iter->timestamp;
 		
-		printf("--filename: %s \tlastModifiedTime: %s\tfileSize: %u \tpeerIPs: ", 
+		printf("--filename: %s \tlastModifiedTime: %s\tfileSize: %u \tpeerIDs: ", 
 			iter -> file_name, ctime(&rawtime), iter->size);
 		
-		int i = 0;
-		while (i < iter->peerNum) {
-			printf("%s \n", iter->iplist[0]);
+		int id;
+		for (id = filetable_nextHolder(iter, 0); id >= 0; id = filetable_nextHolder(iter, id + 1)) {
+			printf("%d ", id);
 		}
 
 		printf("\n");
@@ -252,114 +339,206 @@ int filetable_updateFile(fileEntry_t* oldEntryPtr, fileEntry_t* newEntryPtr, pth
 	return 1;
 }
 
-/**
- * insert an new peerip into fileEntry's iplist if this is a new peerip, and return 1
- * return -1 if the peerip already exist in the fileEntry's iplist
- * @param  entry [fileEntry whose iplist to be searched and added if needed]		
- * @param  peerip    [peerip to be insert if possible]
- * @param  mutex [mutex of the fileTable to which entry belong]
- * @return       [1 if insert success, -1 if peerip already exist]
- */
-int filetable_AddIp2Iplist(fileEntry_t* entry, char* peerip, pthread_mutex_t* tablemutex) {
-	
-	pthread_mutex_lock(tablemutex);
-	int i = 0;
+/******************** HOLDERS ******************/
 
-  //loop through the list and see if the ip address is already in the list
-	for(; i < entry -> peerNum; i++){
-		
-    //if they match, it is in the list
-    if(strcmp(entry->iplist[i], peerip) == 0){
-			pthread_mutex_unlock(tablemutex);
-			return -1;
-		}
+/* Function to drop a reference to a holder set, freeing it with the last one.
+*/
+static void filetable_releaseHolderSet(holderSet_t* set) {
+	if(set != NULL && __atomic_sub_fetch(&(set -> refcount), 1, __ATOMIC_ACQ_REL) == 0){
+		free(set);
 	}
+}
 
-  //otherwise the ip did not exist before, so if there is additional space 
-  //in the ip list, add the ip to the end of the list
-	if(i < MAX_PEER_NUM){
-		
-		strcpy(entry -> iplist[i], peerip);
-		entry -> peerNum++;
-
-		pthread_mutex_unlock(tablemutex);
-		return 1;
+/**
+ * make the holder set of an entry one only it references, with room for the bit of id
+ * a shared set is copied and a short one grown (at least doubled), the caller holds the table's mutex
+ * @param  entry [the fileEntry]
+ * @param  id    [id of the peer]
+ * @return       [the set, entry's own]
+ */
+static holderSet_t* filetable_ownHolders(fileEntry_t* entry, int id) {
+	holderSet_t* old = entry -> holders;
+	int word = id / FILETABLE_HOLDER_BITS;
+	int words = (old != NULL) ? old -> words : 0;
+	if(word < words && __atomic_load_n(&(old -> refcount), __ATOMIC_ACQUIRE) == 1) return old;
+
+	int newWords = words;
+	if(word >= words) newWords = (word + 1 > 2 * words) ? word + 1 : 2 * words;
+	holderSet_t* set = (holderSet_t*) malloc(sizeof(holderSet_t) + newWords * sizeof(unsigned long));
+	set -> refcount = 1;
+	set -> words = newWords;
+	memset(set -> bits, 0, newWords * sizeof(unsigned long));
+	if(old != NULL){
+		memcpy(set -> bits, old -> bits, words * sizeof(unsigned long));
+		filetable_releaseHolderSet(old);
 	}
-
-	//otherwise, the ipnot does not exist but iplist is full so it could not be added
-	pthread_mutex_unlock(tablemutex);
-	return -1;
+	entry -> holders = set;
+	return set;
 }
 
 /**
- * Delete a peer ip from the ip list of the given entry
- * @param  entry  [file entry you want to remove the ip from]
- * @param  peerip [the ip you want to remove from the list]
- * @param  mutex  [the mutex for the file table the entry is from to avoid errors]
- * @return        [return 1 if deletion happens, -1 if no deletion]
+ * add a peer to the holders of a fileEntry if it is not there yet, the caller holds the table's mutex
+ * @param  entry [fileEntry whose holders to be searched and added to if needed]
+ * @param  id    [id of the peer (see peerid.h)]
+ * @return       [1 if insert success, -1 if the peer already holds the file or the id is invalid]
  */
-int filetable_deleteIpfromIplist(fileEntry_t* entry, char* peerip, pthread_mutex_t* tablemutex) {
+int filetable_addHolderLocked(fileEntry_t* entry, int id) {
+	if(id < 0 || filetable_hasHolder(entry, id)) return -1;
+	holderSet_t* set = filetable_ownHolders(entry, id);
+	set -> bits[id / FILETABLE_HOLDER_BITS] |= 1UL << (id % FILETABLE_HOLDER_BITS);
+	entry -> peerNum ++;
+	return 1;
+}
 
+/**
+ * add a peer to the holders of a fileEntry if it is not there yet
+ * @param  entry      [fileEntry whose holders to be searched and added to if needed]
+ * @param  id         [id of the peer (see peerid.h)]
+ * @param  tablemutex [mutex of the fileTable to which entry belong]
+ * @return            [1 if insert success, -1 if the peer already holds the file or the id is invalid]
+ */
+int filetable_addHolder(fileEntry_t* entry, int id, pthread_mutex_t* tablemutex) {
 	pthread_mutex_lock(tablemutex);
-	int i;
+	int ret = filetable_addHolderLocked(entry, id);
+	pthread_mutex_unlock(tablemutex);
+	return ret;
+}
 
-  //loop through all of the peers in the peer ip list
-	for(i = 0; i < entry->peerNum; i++) {
+/**
+ * tell if a peer holds the file
+ * @param  entry [the fileEntry]
+ * @param  id    [id of the peer]
+ * @return       [1 if it does, 0 otherwise]
+ */
+int filetable_hasHolder(fileEntry_t* entry, int id) {
+	holderSet_t* set = entry -> holders;
+	if(set == NULL || id < 0 || id / FILETABLE_HOLDER_BITS >= (unsigned long) set -> words) return 0;
+	return (set -> bits[id / FILETABLE_HOLDER_BITS] >> (id % FILETABLE_HOLDER_BITS)) & 1;
+}
 
-    //if the peer ip matches the entry in the peer, remove it
-		if(strcmp(peerip, entry->iplist[i]) == 0){
-			
-			// copy the last ip of the iplist into the locaiton and decrement the peer num
-      // since the last ip has moved to the earlier location or has been deleted
-			memcpy(entry -> iplist[i], entry -> iplist[entry->peerNum - 1], IP_LEN);
-      memset(entry -> iplist[entry->peerNum - 1], 0, IP_LEN);
+/**
+ * walk the holders of a file in id order: for(id = nextHolder(e, 0); id >= 0; id = nextHolder(e, id + 1))
+ * @param  entry [the fileEntry]
+ * @param  from  [smallest id to consider]
+ * @return       [the smallest holder id not below from, -1 if there is none]
+ */
+int filetable_nextHolder(fileEntry_t* entry, int from) {
+	holderSet_t* set = entry -> holders;
+	if(from < 0) from = 0;
+	int word = from / FILETABLE_HOLDER_BITS;
+	if(set == NULL || word >= set -> words) return -1;
+
+	//skip whole words of non holders
+	unsigned long bits = set -> bits[word] & (~0UL << (from % FILETABLE_HOLDER_BITS));
+	while(bits == 0){
+		if(++ word == set -> words) return -1;
+		bits = set -> bits[word];
+	}
+	return word * FILETABLE_HOLDER_BITS + __builtin_ctzl(bits);
+}
 
-			entry->peerNum --;
-			pthread_mutex_unlock(tablemutex);
-			return 1;
-		}
+/**
+ * remove a peer from the holders of a fileEntry, the caller holds the table's mutex
+ * the set is dropped with the last holder
+ * @param  entry [fileEntry you want to remove the peer from]
+ * @param  id    [id of the peer]
+ * @return       [1 if deletion happens, -1 if the peer did not hold the file]
+ */
+int filetable_deleteHolderLocked(fileEntry_t* entry, int id) {
+	if(!filetable_hasHolder(entry, id)) return -1;
+	if(entry -> peerNum == 1){
+		filetable_releaseHolders(entry);
+		return 1;
 	}
+	holderSet_t* set = filetable_ownHolders(entry, id);
+	set -> bits[id / FILETABLE_HOLDER_BITS] &= ~(1UL << (id % FILETABLE_HOLDER_BITS));
+	entry -> peerNum --;
+	return 1;
+}
+
+/**
+ * Delete a peer from the holders of the given entry
+ * @param  entry      [file entry you want to remove the peer from]
+ * @param  id         [id of the peer]
+ * @param  tablemutex [the mutex for the file table the entry is from to avoid errors]
+ * @return            [return 1 if deletion happens, -1 if no deletion]
+ */
+int filetable_deleteHolder(fileEntry_t* entry, int id, pthread_mutex_t* tablemutex) {
+	pthread_mutex_lock(tablemutex);
+	int ret = filetable_deleteHolderLocked(entry, id);
 	pthread_mutex_unlock(tablemutex);
-	return -1;
+	return ret;
 }
 
 /**
- * dont call deleteIpfromIplist because mutex would be called mutiple times
- * loop all entries in the table, delete the peerip if any entry has it
- * @param  table  [description]
- * @param  peerip [description]
- * @return        [return 1 if deletion happens, -1 if no deletion]
+ * loop all entries in the table once, removing the peer from every entry that has it
+ * a bit test per entry, no string compares
+ * @param  table [the file table]
+ * @param  id    [id of the peer]
+ * @return       [return 1 if deletion happens, -1 if no deletion]
  */
-int filetable_deleteIpfromAllEntries(fileTable_t* table, char* peerip){
-	if(table->size == 0) return -1;
+int filetable_deleteHolderFromAllEntries(fileTable_t* table, int id){
+	if(table->size == 0 || id < 0) return -1;
+	int deleteHappens = -1;
+
 	pthread_mutex_lock(table->filetable_mutex);
 	fileEntry_t* iter = table->head;
-	int i;
-	int deleteHappens = -1;
 	while(iter != NULL){
-		//loop over all entries in the ip list for the file entry
-		for(i = 0; i < iter->peerNum; i++){
-			
-      //if the ip entry matches, remove it from the list
-      if(strcmp(peerip, iter->iplist[i]) == 0){
-
-        memcpy(iter->iplist[i], iter -> iplist[iter->peerNum - 1], IP_LEN);
-        memset(iter -> iplist[iter->peerNum - 1], 0, IP_LEN);
-        
-				iter->peerNum --;
-				deleteHappens = 1;
-			}
+		if(filetable_deleteHolderLocked(iter, id) > 0){
+			deleteHappens = 1;
 		}
-    iter = iter -> next;
+		iter = iter -> next;
 	}
-
 	pthread_mutex_unlock(table->filetable_mutex);
 	return deleteHappens;
 }
 
+/**
+ * take a reference to the holder set of an entry that was just memcpy'd from another one
+ * the entry copied is either one of a table whose mutex the caller holds, or one nobody changes any more
+ * @param entry [the copy]
+ */
+void filetable_retainHolders(fileEntry_t* entry) {
+	if(entry -> holders != NULL){
+		__atomic_add_fetch(&(entry -> holders -> refcount), 1, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * drop the entry's reference to its holder set, leaving it with no holders
+ * @param entry [the fileEntry]
+ */
+void filetable_releaseHolders(fileEntry_t* entry) {
+	filetable_releaseHolderSet(entry -> holders);
+	entry -> holders = NULL;
+	entry -> peerNum = 0;
+}
+
+/**
+ * free a malloced fileEntry together with its reference to its holders
+ * @param entry [the fileEntry, may be NULL]
+ */
+void filetable_freeEntry(fileEntry_t* entry) {
+	if(entry == NULL) return;
+	filetable_releaseHolderSet(entry -> holders);
+	free(entry);
+}
+
+/**
+ * free a list of malloced fileEntries, e.g. one a packet was decoded into
+ * @param head [first entry of the list, may be NULL]
+ */
+void filetable_freeList(fileEntry_t* head) {
+	while(head != NULL){
+		fileEntry_t* next = head -> next;
+		filetable_freeEntry(head);
+		head = next;
+	}
+}
+
 /**
  * Destroys the filetable by freeing each entry in the filetable,
- * the mutex lock, and the table itself.
+ * the name index, the mutex lock, and the table itself.
  * @param tablePtr [file table pointer]
  */
 void filetable_destroy(fileTable_t *tablePtr){
@@ -374,40 +553,146 @@ void filetable_destroy(fileTable_t *tablePtr){
 		while(iter){
 			fileEntry_t* prev = iter;
 			iter = iter -> next;
-			free(prev);
+			filetable_freeEntry(prev);
 		}
 		pthread_mutex_unlock(tablePtr -> filetable_mutex);
 	}
 
+	filetable_releaseSnapshot(tablePtr->snapshot);
+	free(tablePtr->index);
 	free(tablePtr->filetable_mutex);
   free(tablePtr);
 	return;
 }	
 
+/******************** COPY-ON-WRITE SNAPSHOTS ******************/
+
+/**
+ * Copy the table into a new snapshot holding one reference and make it the one readers get.
+ * The entries' holder sets are shared with the snapshot rather than copied, see filetable_ownHolders.
+ * Nothing is copied if the published snapshot is already at epoch, so writers finishing together
+ * share one copy.  The previous snapshot is dropped by the table once no reader can still be about
+ * to take it, readers already holding it keep it alive until they release it.
+ * Writers serialize on the table's mutex, the caller holds it.
+ * @param  tablePtr [the fileTable]
+ * @param  epoch    [version of the table being published, e.g. the tracker's changelog epoch]
+ */
+void filetable_publishSnapshotLocked(fileTable_t* tablePtr, unsigned long epoch) {
+  if(tablePtr -> snapshot != NULL && tablePtr -> snapshot -> epoch >= epoch && epoch > 0) return;
+
+  fileSnapshot_t* snapshot = (fileSnapshot_t*) malloc(sizeof(fileSnapshot_t));
+  snapshot -> refcount = 1;
+  snapshot -> epoch = epoch;
+  snapshot -> size = tablePtr -> size;
+  snapshot -> entries = (fileEntry_t*) malloc((tablePtr -> size > 0 ? tablePtr -> size : 1) * sizeof(fileEntry_t));
+  snapshot -> head = tablePtr -> size > 0 ? snapshot -> entries : NULL;
+
+  //the index is at most half full, so probing stays short
+  snapshot -> indexCap = FILETABLE_INDEX_INIT_CAP;
+  while(snapshot -> indexCap < 2 * tablePtr -> size) snapshot -> indexCap *= 2;
+  snapshot -> index = (int*) malloc(snapshot -> indexCap * sizeof(int));
+  memset(snapshot -> index, -1, snapshot -> indexCap * sizeof(int));
+
+  int mask = snapshot -> indexCap - 1;
+  fileEntry_t* iter = tablePtr -> head;
+  int i = 0;
+  while(iter != NULL && i < tablePtr -> size) {
+    fileEntry_t* copy = &(snapshot -> entries[i]);
+    memcpy(copy, iter, sizeof(fileEntry_t));
+    filetable_retainHolders(copy);
+    copy -> prev = (i > 0) ? &(snapshot -> entries[i - 1]) : NULL;
+    copy -> next = (i + 1 < tablePtr -> size) ? &(snapshot -> entries[i + 1]) : NULL;
+
+    int slot = (int)(filetable_hashName(copy -> file_name) & mask);
+    while(snapshot -> index[slot] >= 0) slot = (slot + 1) & mask;
+    snapshot -> index[slot] = i;
+
+    iter = iter -> next;
+    i++;
+  }
+  assert(i == tablePtr -> size);
+
+  fileSnapshot_t* old = __atomic_exchange_n(&(tablePtr -> snapshot), snapshot, __ATOMIC_SEQ_CST);
+
+  //a reader that loaded the old pointer takes its reference before leaving snapshotReaders
+  while(__atomic_load_n(&(tablePtr -> snapshotReaders), __ATOMIC_SEQ_CST) != 0) {
+    sched_yield();
+  }
+  filetable_releaseSnapshot(old);
+}
+
+/**
+ * Take a reference to the latest published snapshot, without the table's mutex.
+ * @param  tablePtr [the fileTable]
+ * @return          [the snapshot, release it with filetable_releaseSnapshot]
+ */
+fileSnapshot_t* filetable_acquireSnapshot(fileTable_t* tablePtr) {
+  __atomic_add_fetch(&(tablePtr -> snapshotReaders), 1, __ATOMIC_SEQ_CST);
+  fileSnapshot_t* snapshot = __atomic_load_n(&(tablePtr -> snapshot), __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&(snapshot -> refcount), 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&(tablePtr -> snapshotReaders), 1, __ATOMIC_SEQ_CST);
+  return snapshot;
+}
+
+/**
+ * drop a reference, the snapshot is freed with the last one
+ * @param snapshot [the snapshot, may be NULL]
+ */
+void filetable_releaseSnapshot(fileSnapshot_t* snapshot) {
+  if(snapshot == NULL) return;
+  if(__atomic_sub_fetch(&(snapshot -> refcount), 1, __ATOMIC_ACQ_REL) == 0) {
+    int i;
+    for(i = 0; i < snapshot -> size; i++) {
+      filetable_releaseHolders(&(snapshot -> entries[i]));
+    }
+    free(snapshot -> index);
+    free(snapshot -> entries);
+    free(snapshot);
+  }
+}
+
+/**
+ * Look up the entry with filename in a snapshot.
+ * @param  snapshot  [a snapshot the caller holds]
+ * @param  filename  [filename]
+ * @return           [pointer to the snapshot's entry if found, NULL if cannot find]
+ */
+fileEntry_t* filetable_searchSnapshot(fileSnapshot_t* snapshot, char* filename) {
+  int mask = snapshot -> indexCap - 1;
+  int slot = (int)(filetable_hashName(filename) & mask);
+  while(snapshot -> index[slot] >= 0) {
+    fileEntry_t* entry = &(snapshot -> entries[snapshot -> index[slot]]);
+    if(strcmp(entry -> file_name, filename) == 0) return entry;
+    slot = (slot + 1) & mask;
+  }
+  return NULL;
+}
+
 /******************** ARRAY <==========> LINKEDLIST CONVERSION ******************/
 
 /**
  * conver linkedlist of entries of in the table into continous chunk of array, for ease of sending
  * need to pass tablePtr because we want the tablesize and head/tail information together
  * @param  entry 	[head pointer of linked list of fileEntries in the table]
+ * @param  tablemutex [mutex of the table the list belongs to, NULL if the list is not shared]
  * @return          [array chunk]
  */
 char* filetable_convertFileEntriesToArray(fileEntry_t* entry, int num, pthread_mutex_t* tablemutex){
 	
-	pthread_mutex_lock(tablemutex);
+	if(tablemutex) pthread_mutex_lock(tablemutex);
 	//initialize the array
 	char* buf = (char*) malloc(num * sizeof(fileEntry_t));
 
 	fileEntry_t* iter = entry;
 	int i = 0;
-	while(iter != NULL){
+	while(iter != NULL && i < num){
 		//each time, copy size of fileEntry_t from iter to the array indentified by arrayHead
 		memcpy(buf + i * sizeof(fileEntry_t), iter, sizeof(fileEntry_t));
 		//go to next entry
 		iter = iter-> next;
 		i++;
 	}
-	pthread_mutex_unlock(tablemutex);
+	if(tablemutex) pthread_mutex_unlock(tablemutex);
 	return buf;
 }
 
@@ -438,12 +723,17 @@ fileEntry_t* filetable_convertArrayToFileEntires(char* buf, int num){
 		//create an entry
 		fileEntry_t* entry = (fileEntry_t*) malloc(sizeof(fileEntry_t));
 		memcpy(entry, buf + i * sizeof(fileEntry_t), sizeof(fileEntry_t));
+		//the holders stay with the sender
+		entry -> holders = NULL;
+		entry -> peerNum = 0;
 		entry -> next = NULL;
 		iter -> next = entry;
-		iter = entry -> next;
+		iter = entry;
 	}
 
-	return dummy -> next;
+	fileEntry_t* head = dummy -> next;
+	free(dummy);
+	return head;
 }
 
 
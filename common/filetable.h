@@ -6,6 +6,22 @@
 
 
 
+#define FILETABLE_HOLDER_BITS (8 * sizeof(unsigned long))
+
+
+/**
+ * the peers holding a file, bit i set: the peer with id i (see peerid.h) has it
+ * grown on demand to the highest id set, so an entry costs only a pointer until a peer holds the file
+ * shared copy-on-write: entries copied from one another point at the same set, each with its own
+ * reference, and a set with more than one reference is copied before it is changed
+ */
+typedef struct holderSet{
+  int refcount;             // entries pointing at the set
+  int words;                // words in bits
+  unsigned long bits[];
+}holderSet_t;
+
+
 /**
  * each file is represented as a fileEntry
  */
@@ -15,23 +31,53 @@ typedef struct fileEntry{
  char file_name[FILE_NAME_MAX_LEN]; //the name of the file, must be unique in the same directory
  unsigned long int timestamp;       //the timestamp when the file is modified or created
  struct fileEntry* next;            //pointer to build the linked list
- char iplist[MAX_PEER_NUM][IP_LEN]; //tracker:  this is a list of peers' ips posessing the file
-                                    //peer:     only contains ip of peer itself, put it in iplist[0]
- int peerNum;                       
+ struct fileEntry* prev;            //back pointer, so an entry found through the index is unlinked in O(1)
+ holderSet_t* holders;              //the peers having the file, NULL if none
+                                    //tracker:  every peer posessing the file
+                                    //peer:     only the peer itself
+                                    //an entry memcpy'd into a list of its own takes a reference with filetable_retainHolders
+ int peerNum;                       //number of bits set in holders
 
 }fileEntry_t;
 
 
 
+#define FILETABLE_INDEX_INIT_CAP 16   // initial number of slots in the name index, always a power of 2
+#define FILETABLE_INDEX_MAX_LOAD 70   // grow the index when live + deleted slots exceed this percentage
+
+
+/**
+ * immutable copy of a file table at one point in time, shared by every reader holding a reference
+ * entries sit in one array, still linked through next so list readers work unchanged
+ */
+typedef struct fileSnapshot{
+    int refcount;           // holders of the snapshot (the table while it is current, plus readers)
+    unsigned long epoch;    // version of the table the snapshot reflects, given by the publisher
+    int size;
+    fileEntry_t* head;      // first entry (NULL if empty)
+    fileEntry_t* entries;   // all entries, in the table's order
+    int* index;             // open addressing over entries by file_name, -1 = empty slot
+    int indexCap;
+}fileSnapshot_t;
+
+
+
 /**
  * the file table are defined as a linked list of fileEntries
  * we keep track head, tail and the size of the linkedList
+ * the linked list keeps the order entries were appended in, lookups by file_name go through
+ * an open addressing (linear probing) hash index over the same entries
  */
 typedef struct fileTable{
     fileEntry_t* head;  // header of file table
     fileEntry_t* tail; // tail of file table (for appending operation), make sure tail's next is NULL
     int size; 
     pthread_mutex_t* filetable_mutex; // mutex for the file table
+    fileEntry_t** index; // hash index keyed by file_name: NULL = empty slot, FILETABLE_TOMBSTONE = deleted slot
+    int indexCap;        // number of slots in index
+    int indexUsed;       // number of slots that are not empty (live entries + tombstones)
+    fileSnapshot_t* snapshot; // latest published snapshot, readers take it without the mutex
+    int snapshotReaders;      // readers between loading snapshot and taking their reference
 }fileTable_t;
 
 
@@ -43,6 +89,8 @@ fileEntry_t* filetable_searchFileByName(fileTable_t* tablePtr, char* filename);
 
 fileEntry_t* filetable_searchFileByNameWithoutMutex(fileEntry_t* head, char* filename);
 
+fileEntry_t* filetable_searchFileByNameLocked(fileTable_t* tablePtr, char* filename);
+
 int filetable_deleteFileEntryByName(fileTable_t* tablePtr, char* filename);
 
 void filetable_appendFileEntry(fileTable_t* tablePtr, fileEntry_t* newEntryPtr);
@@ -54,11 +102,35 @@ int filetable_updateFile(fileEntry_t* oldEntryPtr, fileEntry_t* newEntryPtr, pth
 void filetable_destroy(fileTable_t *tablePtr);
 
 
-int filetable_AddIp2Iplist(fileEntry_t* entry, char* peerip, pthread_mutex_t* tablemutex);
+int filetable_addHolder(fileEntry_t* entry, int id, pthread_mutex_t* tablemutex);
+
+int filetable_addHolderLocked(fileEntry_t* entry, int id);
+
+int filetable_hasHolder(fileEntry_t* entry, int id);
+
+int filetable_nextHolder(fileEntry_t* entry, int from);
+
+int filetable_deleteHolderLocked(fileEntry_t* entry, int id);
+
+int filetable_deleteHolder(fileEntry_t* entry, int id, pthread_mutex_t* tablemutex);
+
+int filetable_deleteHolderFromAllEntries(fileTable_t* table, int id);
+
+void filetable_retainHolders(fileEntry_t* entry);
+
+void filetable_releaseHolders(fileEntry_t* entry);
+
+void filetable_freeEntry(fileEntry_t* entry);
+
+void filetable_freeList(fileEntry_t* head);
+
+void filetable_publishSnapshotLocked(fileTable_t* tablePtr, unsigned long epoch);
+
+fileSnapshot_t* filetable_acquireSnapshot(fileTable_t* tablePtr);
 
-int filetable_deleteIpfromIplist(fileEntry_t* entry, char* peerip, pthread_mutex_t* tablemutex);
+void filetable_releaseSnapshot(fileSnapshot_t* snapshot);
 
-int filetable_deleteIpfromAllEntries(fileTable_t* table, char* peerip);
+fileEntry_t* filetable_searchSnapshot(fileSnapshot_t* snapshot, char* filename);
 
 char* filetable_convertFileEntriesToArray(fileEntry_t* entry, int num, pthread_mutex_t* tablemutex);
 
@@ -0,0 +1,442 @@
+/* File: merkle.c
+   Description: Merkle trees over file tables, so a peer reconnecting to the tracker finds the files
+   		their tables disagree on by descending only into the subtrees whose digests differ, instead of
+   		sending the whole table.  Unit tested in the testing directory with merkle_test.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "merkle.h"
+
+
+/* what the tree is sorted by: one entry's name hash, its digest and the entry */
+typedef struct merkleKey{
+  unsigned long key;
+  unsigned long hash;
+  fileEntry_t* entry;
+}merkleKey_t;
+
+
+/* 64 bit finalizer (murmur3), every input bit affects every output bit */
+static unsigned long merkle_mix(unsigned long h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdUL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53UL;
+  h ^= h >> 33;
+  return h;
+}
+
+/* hash of everything both sides must agree on for an entry, holders are the tracker's business */
+static unsigned long merkle_entryHash(fileEntry_t* entry, unsigned long key) {
+  unsigned long hash = key;
+  hash ^= (unsigned int) entry -> size;
+  hash *= 1099511628211UL;
+  hash ^= entry -> timestamp;
+  hash *= 1099511628211UL;
+  return merkle_mix(hash);
+}
+
+static int merkle_compareKeys(const void* a, const void* b) {
+  const merkleKey_t* x = (const merkleKey_t*) a;
+  const merkleKey_t* y = (const merkleKey_t*) b;
+  if (x -> key == y -> key) return 0;
+  return (x -> key < y -> key) ? -1 : 1;
+}
+
+/* sort by key: one pass scatters the keys into buckets by their leading bits, and since hashes spread
+   evenly every bucket is left with a handful of keys, sorted in place.  Keys that collide may end up in
+   any order, no node's count or digest depends on it
+   @param keys [the keys]
+   @param tmp  [room for num keys, where they end up sorted]
+   @param num  [number of keys] */
+static void merkle_sortKeys(merkleKey_t* keys, merkleKey_t* tmp, int num) {
+  int bits = MERKLE_SORT_BITS;
+  while (bits > 1 && (1 << bits) > num) {
+    bits--;
+  }
+  int bucketNum = 1 << bits;
+  int* starts = (int*) calloc(bucketNum + 1, sizeof(int));
+  int i, j;
+  for (i = 0; i < num; i++) {
+    starts[(keys[i].key >> (64 - bits)) + 1]++;
+  }
+  for (i = 0; i < bucketNum; i++) {
+    starts[i + 1] += starts[i];
+  }
+  int* next = (int*) malloc(bucketNum * sizeof(int));
+  memcpy(next, starts, bucketNum * sizeof(int));
+  for (i = 0; i < num; i++) {
+    tmp[next[keys[i].key >> (64 - bits)]++] = keys[i];
+  }
+  free(next);
+
+  for (i = 0; i < bucketNum; i++) {
+    merkleKey_t* bucket = tmp + starts[i];
+    int len = starts[i + 1] - starts[i];
+    if (len > 32) {
+      //names chosen to collide, not worth more than a fallback
+      qsort(bucket, len, sizeof(merkleKey_t), merkle_compareKeys);
+      continue;
+    }
+    for (j = 1; j < len; j++) {
+      merkleKey_t key = bucket[j];
+      int k = j - 1;
+      while (k >= 0 && bucket[k].key > key.key) {
+        bucket[k + 1] = bucket[k];
+        k--;
+      }
+      bucket[k + 1] = key;
+    }
+  }
+  free(starts);
+}
+
+/* the prefix of the name hash a node covers */
+static unsigned long merkle_prefix(unsigned long id) {
+  return id >> MERKLE_FANOUT_BITS;
+}
+
+/* first entry whose key is not below key, within [lo, hi) */
+static int merkle_lowerBound(merkleTree_t* tree, int lo, int hi, unsigned long key) {
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (tree -> keys[mid] < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/* entries [*lo, *hi) the node covers, searched for within [*lo, *hi) as given */
+static void merkle_range(merkleTree_t* tree, unsigned long id, int* lo, int* hi) {
+  int level = merkle_level(id);
+  if (level == 0) return;
+  int shift = 64 - level * MERKLE_FANOUT_BITS;
+  unsigned long first = merkle_prefix(id) << shift;
+  unsigned long last = first + ((1UL << shift) - 1);
+  int start = merkle_lowerBound(tree, *lo, *hi, first);
+  //the last prefix ends where the hashes do, no key lies beyond it
+  int end = (last == ~0UL) ? *hi : merkle_lowerBound(tree, start, *hi, last + 1);
+  *lo = start;
+  *hi = end;
+}
+
+/* count and digest of the entries [lo, hi) */
+static void merkle_fill(merkleTree_t* tree, unsigned long id, int lo, int hi, merkleNode_t* node) {
+  node -> id = id;
+  node -> count = hi - lo;
+  node -> digest = tree -> sums[hi] - tree -> sums[lo];
+}
+
+/* whether child is one of parent's children */
+static int merkle_isChild(unsigned long parent, unsigned long child) {
+  return merkle_level(child) == merkle_level(parent) + 1
+    && merkle_prefix(child) >> MERKLE_FANOUT_BITS == merkle_prefix(parent);
+}
+
+
+
+/**
+ * build the tree of a list of entries
+ * @param  head [first entry of the list, it must outlive the tree and not change while the tree is used]
+ * @return      [the tree, freed with merkle_destroy]
+ */
+merkleTree_t* merkle_build(fileEntry_t* head) {
+  int size = 0;
+  fileEntry_t* iter = head;
+  while (iter != NULL) {
+    size++;
+    iter = iter -> next;
+  }
+
+  //the entries are only read here, in list order, sorting moves their hashes around
+  merkleKey_t* keys = (merkleKey_t*) malloc((size + 1) * sizeof(merkleKey_t));
+  merkleKey_t* tmp = (merkleKey_t*) malloc((size + 1) * sizeof(merkleKey_t));
+  int i = 0;
+  for (iter = head; iter != NULL; iter = iter -> next) {
+    keys[i].key = merkle_nameHash(iter -> file_name);
+    keys[i].hash = merkle_entryHash(iter, keys[i].key);
+    keys[i].entry = iter;
+    i++;
+  }
+  merkle_sortKeys(keys, tmp, size);
+  merkleKey_t* sorted = tmp;
+
+  merkleTree_t* tree = (merkleTree_t*) malloc(sizeof(merkleTree_t));
+  tree -> size = size;
+  tree -> keys = (unsigned long*) malloc((size + 1) * sizeof(unsigned long));
+  tree -> sums = (unsigned long*) malloc((size + 1) * sizeof(unsigned long));
+  tree -> entries = (fileEntry_t**) malloc((size + 1) * sizeof(fileEntry_t*));
+  tree -> epoch = 0;
+
+  //digests add up modulo 2^64, a node's digest is the difference of two running sums
+  tree -> sums[0] = 0;
+  for (i = 0; i < size; i++) {
+    tree -> keys[i] = sorted[i].key;
+    tree -> entries[i] = sorted[i].entry;
+    tree -> sums[i + 1] = tree -> sums[i] + sorted[i].hash;
+  }
+  free(keys);
+  free(tmp);
+  return tree;
+}
+
+/**
+ * the hash entries are placed in the tree by: FNV-1a over the name, then mixed so nearby names spread out
+ * @param  file_name [the name]
+ * @return           [64 bit hash]
+ */
+unsigned long merkle_nameHash(const char* file_name) {
+  unsigned long hash = 14695981039346656037UL;
+  while (*file_name) {
+    hash ^= (unsigned char) *file_name++;
+    hash *= 1099511628211UL;
+  }
+  return merkle_mix(hash);
+}
+
+/**
+ * the id of a node
+ * @param  level  [0 (the root) .. MERKLE_MAX_LEVEL]
+ * @param  prefix [the level * MERKLE_FANOUT_BITS leading bits of the name hashes the node covers]
+ * @return        [the id]
+ */
+unsigned long merkle_nodeId(int level, unsigned long prefix) {
+  assert(level >= 0 && level <= MERKLE_MAX_LEVEL);
+  return (prefix << MERKLE_FANOUT_BITS) | (unsigned long) level;
+}
+
+/**
+ * the level of a node
+ * @param  id [the node]
+ * @return    [0 for the root]
+ */
+int merkle_level(unsigned long id) {
+  return (int) (id & (MERKLE_FANOUT - 1));
+}
+
+/**
+ * whether a file falls under a node
+ * @param  id        [the node]
+ * @param  file_name [the file]
+ * @return           [1 if it does, 0 otherwise]
+ */
+int merkle_contains(unsigned long id, const char* file_name) {
+  int level = merkle_level(id);
+  if (level == 0) return 1;
+  return merkle_nameHash(file_name) >> (64 - level * MERKLE_FANOUT_BITS) == merkle_prefix(id);
+}
+
+/**
+ * this tree's count and digest of a node, which need not have any entries
+ * @param tree [the tree]
+ * @param id   [the node]
+ * @param node [set to the node]
+ */
+void merkle_node(merkleTree_t* tree, unsigned long id, merkleNode_t* node) {
+  int lo = 0, hi = tree -> size;
+  merkle_range(tree, id, &lo, &hi);
+  merkle_fill(tree, id, lo, hi, node);
+}
+
+/**
+ * the entries under a node
+ * @param  tree [the tree]
+ * @param  id   [the node]
+ * @param  num  [set to the number of entries]
+ * @return      [the entries, pointing into the tree, in key order]
+ */
+fileEntry_t** merkle_nodeEntries(merkleTree_t* tree, unsigned long id, int* num) {
+  int lo = 0, hi = tree -> size;
+  merkle_range(tree, id, &lo, &hi);
+  *num = hi - lo;
+  return tree -> entries + lo;
+}
+
+/**
+ * whether this tree has the count and digest the other side compared a node with
+ * @param  tree [the tree]
+ * @param  node [the other side's node, not one to settle]
+ * @return      [1 if both sides have the same entries under it, 0 otherwise]
+ */
+int merkle_agrees(merkleTree_t* tree, merkleNode_t* node) {
+  merkleNode_t ours;
+  merkle_node(tree, node -> id, &ours);
+  return ours.count == node -> count && ours.digest == node -> digest;
+}
+
+/**
+ * answer the nodes the other side asked about (the tracker's half of a round):
+ * every node is echoed with this tree's count and digest, and when they differ from the other side's
+ * it is followed by its children that have entries here (a child left out has none).
+ * Nodes to settle (count MERKLE_SETTLE) are echoed as they are, their entries are up to the caller
+ * @param  tree  [the tree]
+ * @param  asked [the other side's nodes]
+ * @param  num   [number of nodes asked about]
+ * @param  out   [room for num * (1 + MERKLE_FANOUT) nodes]
+ * @return       [number of nodes written to out]
+ */
+int merkle_expand(merkleTree_t* tree, merkleNode_t* asked, int num, merkleNode_t* out) {
+  int n = 0;
+  int i, c;
+  for (i = 0; i < num; i++) {
+    if (asked[i].count == MERKLE_SETTLE) {
+      out[n++] = asked[i];
+      continue;
+    }
+
+    int lo = 0, hi = tree -> size;
+    merkle_range(tree, asked[i].id, &lo, &hi);
+    merkleNode_t* ours = &out[n++];
+    merkle_fill(tree, asked[i].id, lo, hi, ours);
+    int level = merkle_level(asked[i].id);
+    if ((ours -> count == asked[i].count && ours -> digest == asked[i].digest) || level == MERKLE_MAX_LEVEL) {
+      continue;
+    }
+
+    //children split the parent's range, each is searched for within it
+    for (c = 0; c < MERKLE_FANOUT; c++) {
+      unsigned long child = merkle_nodeId(level + 1, (merkle_prefix(asked[i].id) << MERKLE_FANOUT_BITS) | c);
+      int childLo = lo, childHi = hi;
+      merkle_range(tree, child, &childLo, &childHi);
+      if (childHi > childLo) {
+        merkle_fill(tree, child, childLo, childHi, &out[n++]);
+      }
+      lo = childHi;
+    }
+  }
+  return n;
+}
+
+/**
+ * take the other side's answer (see merkle_expand) and pick the nodes to ask about next (the peer's half of a round):
+ * of the children of every echoed node that differs, those that still differ are either compared again
+ * one level down, or settled (count MERKLE_SETTLE) when one side has none of their entries, both sides have
+ * at most MERKLE_SETTLE_ENTRIES, or they are at MERKLE_MAX_LEVEL.  Children that agree and have entries are
+ * compared again as they are, so the other side learns which of its entries this side has too (digests leave
+ * holders out, the tracker credits the peer with them).  The exchange is over once nothing is left to ask,
+ * which is once no node compared in the last round differed
+ * @param  tree      [this side's tree]
+ * @param  theirs    [the other side's answer, echoed settled nodes are skipped]
+ * @param  num       [number of nodes in the answer]
+ * @param  out       [room for num * MERKLE_FANOUT nodes, compared ones carry this side's count and digest]
+ * @param  settleNum [set to the number of settled nodes among them]
+ * @return           [number of nodes written to out]
+ */
+int merkle_step(merkleTree_t* tree, merkleNode_t* theirs, int num, merkleNode_t* out, int* settleNum) {
+  int n = 0;
+  *settleNum = 0;
+  int i = 0;
+  while (i < num) {
+    merkleNode_t* parent = &theirs[i++];
+    //the children the other side has follow their parent, in order
+    int first = i;
+    while (i < num && merkle_isChild(parent -> id, theirs[i].id)) {
+      i++;
+    }
+    if (parent -> count == MERKLE_SETTLE) continue;
+
+    merkleNode_t ours;
+    merkle_node(tree, parent -> id, &ours);
+    int level = merkle_level(parent -> id);
+    if ((ours.count == parent -> count && ours.digest == parent -> digest) || level == MERKLE_MAX_LEVEL) {
+      continue;
+    }
+
+    int next = first;
+    int c;
+    for (c = 0; c < MERKLE_FANOUT; c++) {
+      unsigned long child = merkle_nodeId(level + 1, (merkle_prefix(parent -> id) << MERKLE_FANOUT_BITS) | c);
+      merkleNode_t other;
+      if (next < i && theirs[next].id == child) {
+        other = theirs[next++];
+      } else {
+        other.id = child;
+        other.count = 0;
+        other.digest = 0;
+      }
+      merkleNode_t mine;
+      merkle_node(tree, child, &mine);
+      if (mine.count == other.count && mine.digest == other.digest) {
+        if (mine.count > 0) out[n++] = mine;
+        continue;
+      }
+
+      if (mine.count == 0 || other.count == 0 || level + 1 == MERKLE_MAX_LEVEL
+          || (mine.count <= MERKLE_SETTLE_ENTRIES && other.count <= MERKLE_SETTLE_ENTRIES)) {
+        mine.count = MERKLE_SETTLE;
+        (*settleNum)++;
+      }
+      out[n++] = mine;
+    }
+  }
+  return n;
+}
+
+/**
+ * write nodes in their wire format
+ * @param  out   [room for num * MERKLE_NODE_WIRE_LEN bytes]
+ * @param  nodes [the nodes]
+ * @param  num   [number of nodes]
+ * @return       [first byte after the nodes]
+ */
+char* merkle_encodeNodes(char* out, merkleNode_t* nodes, int num) {
+  int i;
+  for (i = 0; i < num; i++) {
+    memcpy(out, &(nodes[i].id), sizeof(unsigned long));
+    out += sizeof(unsigned long);
+    memcpy(out, &(nodes[i].digest), sizeof(unsigned long));
+    out += sizeof(unsigned long);
+    memcpy(out, &(nodes[i].count), sizeof(int));
+    out += sizeof(int);
+  }
+  return out;
+}
+
+/**
+ * read nodes written by merkle_encodeNodes
+ * @param  buf   [num * MERKLE_NODE_WIRE_LEN bytes]
+ * @param  num   [number of nodes]
+ * @param  nodes [set to a newly malloced array, NULL if num is 0]
+ * @return       [1 if success, -1 if a node is malformed]
+ */
+int merkle_decodeNodes(char* buf, int num, merkleNode_t** nodes) {
+  *nodes = NULL;
+  if (num == 0) return 1;
+
+  merkleNode_t* decoded = (merkleNode_t*) malloc(num * sizeof(merkleNode_t));
+  int i;
+  for (i = 0; i < num; i++) {
+    memcpy(&(decoded[i].id), buf, sizeof(unsigned long));
+    buf += sizeof(unsigned long);
+    memcpy(&(decoded[i].digest), buf, sizeof(unsigned long));
+    buf += sizeof(unsigned long);
+    memcpy(&(decoded[i].count), buf, sizeof(int));
+    buf += sizeof(int);
+    if (merkle_level(decoded[i].id) > MERKLE_MAX_LEVEL || decoded[i].count < MERKLE_SETTLE) {
+      printf("%s: error: node %lx with count %d\n", __func__, decoded[i].id, decoded[i].count);
+      free(decoded);
+      return -1;
+    }
+  }
+  *nodes = decoded;
+  return 1;
+}
+
+/**
+ * free a tree, the entries it was built from are left alone
+ * @param tree [the tree, may be NULL]
+ */
+void merkle_destroy(merkleTree_t* tree) {
+  if (tree == NULL) return;
+  free(tree -> keys);
+  free(tree -> sums);
+  free(tree -> entries);
+  free(tree);
+}
@@ -0,0 +1,76 @@
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include "constants.h"
+#include "filetable.h"
+
+
+#define MERKLE_FANOUT_BITS 4          // a node splits its range of name hashes in 16
+#define MERKLE_FANOUT (1 << MERKLE_FANOUT_BITS)
+#define MERKLE_MAX_LEVEL 15           // deepest level, its nodes cover one 60 bit prefix of the name hash
+#define MERKLE_SETTLE_ENTRIES 16      // a differing node with no more entries than this on both sides is exchanged entry by entry
+#define MERKLE_SETTLE -1              // count of a node whose entries travel with it (see merkleNode_t)
+#define MERKLE_ROOT 0                 // id of the root, covering every entry
+#define MERKLE_SORT_BITS 16           // leading bits of the name hash a tree's build buckets entries by
+#define MERKLE_NODE_WIRE_LEN (2 * sizeof(unsigned long) + sizeof(int))
+
+
+/**
+ * one node of a Merkle tree as exchanged between peer and tracker
+ * count is the number of entries under the node, or MERKLE_SETTLE when the sender's entries of
+ * the node are in the same packet and replace the receiver's
+ */
+typedef struct merkleNode{
+  unsigned long id;      // level in the low MERKLE_FANOUT_BITS bits, the level's prefix of the name hash above them
+  unsigned long digest;  // sum of the hashes of the entries under the node
+  int count;
+}merkleNode_t;
+
+
+/**
+ * Merkle tree over a file table, for anti-entropy between two copies of it
+ * entries are sorted by a 64 bit hash of their name; a node at level l covers the entries whose hashes share
+ * its l * MERKLE_FANOUT_BITS leading bits, so both sides agree on the nodes whatever their table sizes.
+ * A node's digest is the sum of its entries' hashes (of name, size and timestamp, holders left out), so
+ * it is the sum of its children's digests and does not depend on the order the entries were added in.
+ * Only the sorted hashes and their running sums are stored, every node is found by binary search
+ */
+typedef struct merkleTree{
+  int size;
+  unsigned long* keys;     // name hash of every entry, ascending
+  unsigned long* sums;     // sums[i]: sum of the hashes of the first i entries, size + 1 of them
+  fileEntry_t** entries;   // the entries in key order, still owned by the list the tree was built from
+  unsigned long epoch;     // left to the owner, e.g. the epoch of the snapshot the tree reflects
+}merkleTree_t;
+
+
+
+
+merkleTree_t* merkle_build(fileEntry_t* head);
+
+unsigned long merkle_nameHash(const char* file_name);
+
+unsigned long merkle_nodeId(int level, unsigned long prefix);
+
+int merkle_level(unsigned long id);
+
+int merkle_contains(unsigned long id, const char* file_name);
+
+void merkle_node(merkleTree_t* tree, unsigned long id, merkleNode_t* node);
+
+fileEntry_t** merkle_nodeEntries(merkleTree_t* tree, unsigned long id, int* num);
+
+int merkle_agrees(merkleTree_t* tree, merkleNode_t* node);
+
+int merkle_expand(merkleTree_t* tree, merkleNode_t* asked, int num, merkleNode_t* out);
+
+int merkle_step(merkleTree_t* tree, merkleNode_t* theirs, int num, merkleNode_t* out, int* settleNum);
+
+char* merkle_encodeNodes(char* out, merkleNode_t* nodes, int num);
+
+int merkle_decodeNodes(char* buf, int num, merkleNode_t** nodes);
+
+void merkle_destroy(merkleTree_t* tree);
+
+
+#endif
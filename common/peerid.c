@@ -0,0 +1,219 @@
+/* File: peerid.c
+   Description: Interning of peer ip addresses into dense integer ids.  The tracker's peer table
+   		owns one map, file entries name their holders by id, so removing a peer from every
+   		file is a bit test per file instead of string compares.  Unit tested in the testing
+   		directory with peerid_test.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "peerid.h"
+
+
+static unsigned int peerid_hash(const char* ip) {
+  unsigned int hash = 2166136261u;
+  while (*ip) {
+    hash ^= (unsigned char) *ip++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * slot of ip in the index, or of the empty slot ending its probe sequence
+ * @param  map [the map, mutex held]
+ * @param  ip  [the ip]
+ * @return     [slot index]
+ */
+static int peerid_findSlot(peerIdMap_t* map, const char* ip) {
+  int slot = (int)(peerid_hash(ip) % map -> indexCap);
+  while (map -> index[slot] != PEERID_NONE) {
+    if (strcmp(map -> ips[map -> index[slot]], ip) == 0) return slot;
+    slot = (slot + 1) % map -> indexCap;
+  }
+  return slot;
+}
+
+/**
+ * remove the id at slot, shifting later entries of its probe sequence back so no tombstones are needed
+ * @param map  [the map, mutex held]
+ * @param slot [an occupied slot]
+ */
+static void peerid_unindex(peerIdMap_t* map, int slot) {
+  map -> index[slot] = PEERID_NONE;
+  int next = (slot + 1) % map -> indexCap;
+  while (map -> index[next] != PEERID_NONE) {
+    int id = map -> index[next];
+    int home = (int)(peerid_hash(map -> ips[id]) % map -> indexCap);
+    //move it into the hole unless its home lies cyclically in (slot, next]
+    int stays = (slot <= next) ? (slot < home && home <= next) : (slot < home || home <= next);
+    if (!stays) {
+      map -> index[slot] = id;
+      map -> index[next] = PEERID_NONE;
+      slot = next;
+    }
+    next = (next + 1) % map -> indexCap;
+  }
+}
+
+/**
+ * double the ids there is room for and rebuild the index at twice that, called with every id in use
+ * @param map [the map, mutex held]
+ */
+static void peerid_grow(peerIdMap_t* map) {
+  assert(map -> freeNum == 0);
+  int cap = 2 * map -> cap;
+  map -> ips = realloc(map -> ips, (size_t) cap * IP_LEN);
+  map -> refs = (int*) realloc(map -> refs, cap * sizeof(int));
+  memset(map -> refs + map -> cap, 0, (cap - map -> cap) * sizeof(int));
+  map -> freeIds = (int*) realloc(map -> freeIds, cap * sizeof(int));
+  map -> freeHead = 0;
+  map -> cap = cap;
+
+  free(map -> index);
+  map -> indexCap = 2 * cap;
+  map -> index = (int*) malloc(map -> indexCap * sizeof(int));
+  int i;
+  for (i = 0; i < map -> indexCap; i++) {
+    map -> index[i] = PEERID_NONE;
+  }
+  for (i = 0; i < map -> next; i++) {
+    if (map -> refs[i] > 0) map -> index[peerid_findSlot(map, map -> ips[i])] = i;
+  }
+}
+
+/* Function to create an empty map.
+
+	@return the pointer to the peerIdMap_t that is created.
+*/
+peerIdMap_t* peerid_init() {
+  peerIdMap_t* map = (peerIdMap_t*) calloc(1, sizeof(peerIdMap_t));
+  map -> cap = PEERID_INIT_CAP;
+  map -> ips = calloc(map -> cap, IP_LEN);
+  map -> refs = (int*) calloc(map -> cap, sizeof(int));
+  map -> freeIds = (int*) malloc(map -> cap * sizeof(int));
+  map -> indexCap = 2 * map -> cap;
+  map -> index = (int*) malloc(map -> indexCap * sizeof(int));
+  int i;
+  for (i = 0; i < map -> indexCap; i++) {
+    map -> index[i] = PEERID_NONE;
+  }
+
+  pthread_mutex_t* mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(mutex, NULL);
+  map -> mutex = mutex;
+  return map;
+}
+
+/**
+ * take a reference to the id of ip, handing out an id if ip has none
+ * @param  map [the map]
+ * @param  ip  [the ip]
+ * @return     [the id, the map grows when every id it has room for is in use]
+ */
+int peerid_intern(peerIdMap_t* map, const char* ip) {
+  pthread_mutex_lock(map -> mutex);
+  int slot = peerid_findSlot(map, ip);
+  int id = map -> index[slot];
+  if (id == PEERID_NONE) {
+    //ids never used come first, then the one freed longest ago, then the ones growing makes room for
+    if (map -> next == map -> cap && map -> freeNum == 0) {
+      peerid_grow(map);
+      slot = peerid_findSlot(map, ip);
+    }
+    if (map -> next < map -> cap) {
+      id = map -> next ++;
+    } else {
+      id = map -> freeIds[map -> freeHead];
+      map -> freeHead = (map -> freeHead + 1) % map -> cap;
+      map -> freeNum --;
+    }
+    memset(map -> ips[id], 0, IP_LEN);
+    strncpy(map -> ips[id], ip, IP_LEN - 1);
+    map -> index[slot] = id;
+    map -> num ++;
+  }
+  map -> refs[id] ++;
+  pthread_mutex_unlock(map -> mutex);
+  return id;
+}
+
+/**
+ * id of ip, without taking a reference
+ * @param  map [the map]
+ * @param  ip  [the ip]
+ * @return     [the id, PEERID_NONE if ip has none]
+ */
+int peerid_lookup(peerIdMap_t* map, const char* ip) {
+  pthread_mutex_lock(map -> mutex);
+  int id = map -> index[peerid_findSlot(map, ip)];
+  pthread_mutex_unlock(map -> mutex);
+  return id;
+}
+
+/**
+ * drop a reference taken by peerid_intern, the id is freed with the last one
+ * @param map [the map]
+ * @param id  [the id, PEERID_NONE is ignored]
+ */
+void peerid_release(peerIdMap_t* map, int id) {
+  if (id < 0) return;
+  pthread_mutex_lock(map -> mutex);
+  assert(id < map -> next);
+  assert(map -> refs[id] > 0);
+  if (-- map -> refs[id] == 0) {
+    peerid_unindex(map, peerid_findSlot(map, map -> ips[id]));
+    map -> freeIds[(map -> freeHead + map -> freeNum) % map -> cap] = id;
+    map -> freeNum ++;
+    map -> num --;
+  }
+  pthread_mutex_unlock(map -> mutex);
+}
+
+/**
+ * copy the ip of an id
+ * @param  map [the map]
+ * @param  id  [the id]
+ * @param  ip  [out: IP_LEN bytes]
+ * @return     [1 if success, -1 if the id is not in use]
+ */
+int peerid_getIp(peerIdMap_t* map, int id, char* ip) {
+  if (id < 0) return -1;
+  pthread_mutex_lock(map -> mutex);
+  if (id >= map -> next || map -> refs[id] == 0) {
+    pthread_mutex_unlock(map -> mutex);
+    return -1;
+  }
+  memcpy(ip, map -> ips[id], IP_LEN);
+  pthread_mutex_unlock(map -> mutex);
+  return 1;
+}
+
+/**
+ * every id handed out so far is below the bound, to size arrays indexed by id
+ * @param  map [the map]
+ * @return     [one past the highest id ever handed out]
+ */
+int peerid_bound(peerIdMap_t* map) {
+  pthread_mutex_lock(map -> mutex);
+  int bound = map -> next;
+  pthread_mutex_unlock(map -> mutex);
+  return bound;
+}
+
+/**
+ * free the map
+ * @param map [the map]
+ */
+void peerid_destroy(peerIdMap_t* map) {
+  pthread_mutex_destroy(map -> mutex);
+  free(map -> mutex);
+  free(map -> ips);
+  free(map -> refs);
+  free(map -> freeIds);
+  free(map -> index);
+  free(map);
+}
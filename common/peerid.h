@@ -0,0 +1,50 @@
+#ifndef PEERID_H
+#define PEERID_H
+
+#include <pthread.h>
+#include "constants.h"
+
+
+#define PEERID_NONE -1
+#define PEERID_INIT_CAP 64   // ids a new map has room for, doubled whenever they are all in use
+
+
+/**
+ * dense integer ids for peer addresses, so a file's holders are a set of small integers
+ * an id is handed out on the first reference to an ip and freed with the last one;
+ * freed ids are reused oldest first, to keep a stale copy of a holder set valid as long as possible;
+ * the map grows when every id it has room for is in use, so there is no limit on the number of peers
+ */
+typedef struct peerIdMap{
+  char (*ips)[IP_LEN];    // id -> ip
+  int* refs;              // references to each id, 0 = free
+  int* freeIds;           // ring of freed ids, oldest first
+  int cap;                // ids there is room for in ips, refs and freeIds
+  int* index;             // open addressing (linear probing) ip -> id, PEERID_NONE = empty slot
+  int indexCap;           // 2 * cap, so the index is at most half full
+  int freeHead;
+  int freeNum;
+  int next;               // ids below next have been handed out at least once
+  int num;                // ids in use
+  pthread_mutex_t* mutex;
+}peerIdMap_t;
+
+
+
+
+peerIdMap_t* peerid_init();
+
+int peerid_intern(peerIdMap_t* map, const char* ip);
+
+int peerid_lookup(peerIdMap_t* map, const char* ip);
+
+void peerid_release(peerIdMap_t* map, int id);
+
+int peerid_getIp(peerIdMap_t* map, int id, char* ip);
+
+int peerid_bound(peerIdMap_t* map);
+
+void peerid_destroy(peerIdMap_t* map);
+
+
+#endif
@@ -33,6 +33,11 @@ peerTable_t* peertable_init(){
   pthread_mutex_init(mutex, NULL);
   peertable -> peertable_mutex = mutex;
 
+  //one timer per entry, ticking in seconds like the timestamps
+  peertable -> liveness = timerwheel_init(getCurrentTime());
+
+  peertable -> ids = peerid_init();
+
 	return peertable;
 }
 
@@ -49,12 +54,33 @@ peerEntry_t* peertable_createEntry(char* ip, int sockfd){
   // Set initial fields for the entry.
   memcpy(peerEntry->ip, ip, IP_LEN);
   peerEntry -> sockfd = sockfd;
+  peerEntry -> id = PEERID_NONE;
+  peerEntry -> tableVersion = 0;
+  peerEntry -> pendingEpoch = 0;
+  peerEntry -> ackedEpoch = 0;
+  peerEntry -> needResync = 0;
+  peerEntry -> merkleSync = 0;
+  timerwheel_initNode(&(peerEntry -> aliveTimer), peerEntry);
   peerEntry -> timestamp = getCurrentTime();
   peerEntry -> next = NULL;
 
 	return peerEntry;
 }
 
+/**
+ * the first entry with the given ip, the caller holds peertable_mutex
+ * @param  table     [peertable to search]
+ * @param  ip        [ip we are looking for]
+ * @return           [the peerentry_t if the ip is found, NULL otherwise]
+ */
+peerEntry_t* peertable_searchEntryByIpLocked(peerTable_t* table, char* ip) {
+  peerEntry_t* iter = table -> head;
+  while(iter != NULL && strcmp(iter -> ip, ip) != 0) {
+    iter = iter -> next;
+  }
+  return iter;
+}
+
 /**
  * iterate peer table to check if there exist an peerEntry with the same ip
  * @param  table     [peertable to check if the entry exists in]
@@ -84,13 +110,54 @@ peerEntry_t* peertable_searchEntryByIp(peerTable_t* table, char* ip) {
 }
 
 /**
- * Adds a new peer entry to the end of the peer Table.
+ * the entry using the given TCP connection, the caller holds peertable_mutex
+ * @param  table     [peertable to search]
+ * @param  sockfd    [TCP connection between the tracker and the peer]
+ * @return           [the peerentry_t if the connection is found, NULL otherwise]
+ */
+peerEntry_t* peertable_searchEntryBySockfdLocked(peerTable_t* table, int sockfd) {
+  peerEntry_t* iter = table -> head;
+  while(iter != NULL && iter -> sockfd != sockfd) {
+    iter = iter -> next;
+  }
+  return iter;
+}
+
+/**
+ * iterate peer table to check if there exist an peerEntry using the given TCP connection
+ * @param  table     [peertable to check if the entry exists in]
+ * @param  sockfd    [TCP connection between the tracker and the peer]
+ * @return           [the peerentry_t if the connection is found, NULL otherwise]
+ */
+peerEntry_t* peertable_searchEntryBySockfd(peerTable_t* table, int sockfd) {
+
+  if(table->size == 0) return NULL;
+
+  pthread_mutex_lock(table->peertable_mutex);
+
+  peerEntry_t* iter = table->head;
+  while(iter != NULL) {
+
+    //if the entry uses this connection, return it
+    if (iter -> sockfd == sockfd) {
+      pthread_mutex_unlock(table->peertable_mutex);
+      return iter;
+    }
+
+    iter = iter->next;
+  }
+
+  pthread_mutex_unlock(table->peertable_mutex);
+  return NULL;
+}
+
+/**
+ * Adds a new peer entry to the end of the peer Table, the caller holds peertable_mutex.
  * @param  table  [pointer to the peer Table]
  * @param  entry  [pointer to the peer entry to add]
  */
-int peertable_addEntry(peerTable_t* table, peerEntry_t* entry) {
+int peertable_addEntryLocked(peerTable_t* table, peerEntry_t* entry) {
 
-  pthread_mutex_lock(table -> peertable_mutex);
   // when table is empty, add the entry and make it the head and tail
   if (table -> size == 0) {
   	table -> head = entry;
@@ -105,10 +172,79 @@ int peertable_addEntry(peerTable_t* table, peerEntry_t* entry) {
 
   table -> size ++;
 
+  //entries sharing an ip share its id
+  entry -> id = peerid_intern(table -> ids, entry -> ip);
+
+  //the peer is dead unless it refreshes its timestamp within DEAD_PEER_TIMEOUT
+  entry -> next = NULL;
+  timerwheel_schedule(table -> liveness, &(entry -> aliveTimer), entry -> timestamp + DEAD_PEER_TIMEOUT + 1);
+ 	return 1;
+}
+
+/**
+ * Adds a new peer entry to the end of the peer Table.
+ * @param  table  [pointer to the peer Table]
+ * @param  entry  [pointer to the peer entry to add]
+ */
+int peertable_addEntry(peerTable_t* table, peerEntry_t* entry) {
+
+  pthread_mutex_lock(table -> peertable_mutex);
+  peertable_addEntryLocked(table, entry);
   pthread_mutex_unlock(table -> peertable_mutex);
  	return 1;
 }
 
+/**
+ * Takes an entry out of the table, the caller holds peertable_mutex.  The entry keeps its reference to its id,
+ * so the id cannot go to another ip while the caller still uses it: free the entry with peertable_freeEntry.
+ * @param  table  [pointer to the peer Table]
+ * @param  entry  [the entry, in the table]
+ * @param  shared [out (may be NULL): 1 if another entry of the same ip is left in the table, 0 otherwise]
+ * @return [the entry]
+ */
+peerEntry_t* peertable_removeEntryLocked(peerTable_t* table, peerEntry_t* entry, int* shared) {
+
+  peerEntry_t* prev = NULL;
+  peerEntry_t* iter = table -> head;
+  int others = 0;
+  while(iter != NULL) {
+    if (iter == entry) {
+      //unlink it, the tail moves back if it was the tail
+      if (prev == NULL) {
+        table -> head = iter -> next;
+      } else {
+        prev -> next = iter -> next;
+      }
+      if (table -> tail == iter) {
+        table -> tail = prev;
+      }
+      iter = iter -> next;
+      continue;
+    }
+    if (strcmp(iter -> ip, entry -> ip) == 0) {
+      others = 1;
+    }
+    prev = iter;
+    iter = iter -> next;
+  }
+
+  table -> size -= 1;
+  timerwheel_cancel(table -> liveness, &(entry -> aliveTimer));
+  entry -> next = NULL;
+  if (shared != NULL) *shared = others;
+  return entry;
+}
+
+/**
+ * Frees an entry taken out of the table, dropping its reference to its id.
+ * @param  table  [pointer to the peer Table the entry was in]
+ * @param  entry  [the entry]
+ */
+void peertable_freeEntry(peerTable_t* table, peerEntry_t* entry) {
+  peerid_release(table -> ids, entry -> id);
+  free(entry);
+}
+
 /**
  * Removes a table entry given the IP addressof the node to delete.
  * Also, updates the necessary pointers upon deletion.
@@ -139,6 +275,8 @@ int peertable_deleteEntryByIp(peerTable_t *table, char* ip) {
 
     table -> size -= 1;
     
+    timerwheel_cancel(table -> liveness, &(file -> aliveTimer));
+    peerid_release(table -> ids, file -> id);
     free(file);
     pthread_mutex_unlock(table->peertable_mutex);
 
@@ -164,6 +302,8 @@ int peertable_deleteEntryByIp(peerTable_t *table, char* ip) {
 
         table -> size -= 1;
 
+        timerwheel_cancel(table -> liveness, &(file -> aliveTimer));
+        peerid_release(table -> ids, file -> id);
         free(file);
         pthread_mutex_unlock(table -> peertable_mutex);
 
@@ -204,7 +344,9 @@ void peertable_destroy(peerTable_t *table) {
 		pthread_mutex_unlock(table -> peertable_mutex);
 	}
 
-	//free table mutex and table itself
+	//free table mutex, the timer wheel, the peer ids and table itself
+	timerwheel_destroy(table -> liveness);
+	peerid_destroy(table -> ids);
 	free(table -> peertable_mutex);
   free(table);
 
@@ -212,11 +354,12 @@ void peertable_destroy(peerTable_t *table) {
 }
 
 /**
- * Refresh the peerEntry's timestamp to latest time
+ * Refresh the peerEntry's timestamp to latest time, and push its expiry DEAD_PEER_TIMEOUT past it
+ * @param  table [the peer table holding the entry]
  * @param  entry [the entry whose timestamp will be updated]
  * @return       [1 if successful, -1 if fail]
  */
-int peertable_refreshTimestamp(peerEntry_t* entry){
+int peertable_refreshTimestamp(peerTable_t* table, peerEntry_t* entry){
     
   unsigned long curTime = getCurrentTime();
 
@@ -224,15 +367,21 @@ int peertable_refreshTimestamp(peerEntry_t* entry){
   if(entry -> timestamp > curTime) return -1;
   
   //otherwise update the entries time stamp to be the current time
+  pthread_mutex_lock(table -> peertable_mutex);
   entry -> timestamp = curTime;
+  timerwheel_schedule(table -> liveness, &(entry -> aliveTimer), curTime + DEAD_PEER_TIMEOUT + 1);
+  pthread_mutex_unlock(table -> peertable_mutex);
   return 1;
 }
 
-
-
-
-
-
-
-
-
+/**
+ * Collect the peers whose timestamp is more than DEAD_PEER_TIMEOUT before now.  Only expired timers
+ * are visited, live peers cost nothing.  The caller holds peertable_mutex while it walks the list,
+ * the entries stay in the table until the caller removes them.
+ * @param  table [the peer table]
+ * @param  now   [current time]
+ * @return       [the fired aliveTimers linked by next, node->data is the dead peerEntry_t, NULL if none]
+ */
+timerNode_t* peertable_expireDead(peerTable_t* table, unsigned long now){
+  return timerwheel_advance(table -> liveness, now);
+}
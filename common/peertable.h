@@ -1,7 +1,12 @@
+#ifndef PEERTABLE_H
+#define PEERTABLE_H
+
 
 
 #include <pthread.h>
 #include "constants.h"
+#include "timerwheel.h"
+#include "peerid.h"
 
 
 
@@ -17,6 +22,20 @@ typedef struct peerEntry {
                                     //tracker:  latest alive timestamp of this peer
     //TCP connection to this remote peer.
     int sockfd;
+    //tracker: id of ip in the table's peer id map, names this peer in the holders of file entries (PEERID_NONE if out of ids)
+    int id;
+    //tracker: last version of this peer's file table applied (FILEUPDATE / FILEUPDATE_DELTA)
+    unsigned long tableVersion;
+    //tracker: 0, or the epoch of the tracker's file table that must reach the state store before tableVersion is acknowledged
+    unsigned long pendingEpoch;
+    //tracker: last epoch of the tracker's file table this peer acknowledged (EPOCH_ACK)
+    unsigned long ackedEpoch;
+    //tracker: a broadcast was dropped because the peer's outbound queue was over budget, send a full table once it drains
+    int needResync;
+    //tracker: a Merkle exchange with this peer is under way (see merkle.h), broadcasts wait until it is over
+    int merkleSync;
+    //tracker: fires DEAD_PEER_TIMEOUT after the latest timestamp, moved by every refresh
+    timerNode_t aliveTimer;
     //Pointer to the next peer, linked list.
     struct peerEntry *next;
 } peerEntry_t;
@@ -28,6 +47,8 @@ typedef struct peer_peertable{
     peerEntry_t* tail;
     int size;
     pthread_mutex_t* peertable_mutex;
+    timerWheel_t* liveness;   // aliveTimer of every entry in the table, guarded by peertable_mutex
+    peerIdMap_t* ids;         // dense ids of the entries' ips, every entry holds a reference to its id
 }peerTable_t;
 
 
@@ -43,6 +64,16 @@ peerEntry_t* peertable_createEntry(char* ip, int sockfd);
 
 int peertable_addEntry(peerTable_t *table, peerEntry_t* entry);
 
+// The same for a caller holding peertable_mutex.
+int peertable_addEntryLocked(peerTable_t *table, peerEntry_t* entry);
+
+// This method takes an entry out of the table, the caller holds peertable_mutex.  The entry keeps its id
+// until it is freed with peertable_freeEntry.  *shared tells whether another entry of its ip is left.
+peerEntry_t* peertable_removeEntryLocked(peerTable_t *table, peerEntry_t* entry, int* shared);
+
+// This method frees an entry taken out of the table, releasing its id.
+void peertable_freeEntry(peerTable_t *table, peerEntry_t* entry);
+
 
 
 
@@ -56,9 +87,16 @@ void peertable_destroy(peerTable_t *table);
 
 peerEntry_t* peertable_searchEntryByIp(peerTable_t* table, char* ip);
 
+peerEntry_t* peertable_searchEntryByIpLocked(peerTable_t* table, char* ip);
+
+peerEntry_t* peertable_searchEntryBySockfd(peerTable_t* table, int sockfd);
+
+peerEntry_t* peertable_searchEntryBySockfdLocked(peerTable_t* table, int sockfd);
 
 
-int peertable_refreshTimestamp(peerEntry_t* entry);
 
+int peertable_refreshTimestamp(peerTable_t* table, peerEntry_t* entry);
 
+timerNode_t* peertable_expireDead(peerTable_t* table, unsigned long now);
 
+#endif
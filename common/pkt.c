@@ -2,11 +2,14 @@
 #include "peertable.h"
 #include "filetable.h"
 #include "pkt.h"
+#include "filecodec.h"
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
 #include <assert.h>
 
 #include <string.h>
@@ -15,172 +18,434 @@
 
 
 
-/************** SEND and RECV **********************************/
+//size of the fixed part of a peer->tracker packet on the wire:
+//type, peer_ip, port, tableVersion, baseVersion, ackedEpoch, filetablesize, deltasize, bodyLen, nodesize, shard, shardNum
+#define PEER_PKT_HEADER_LEN (8 * sizeof(int) + IP_LEN * sizeof(char) + 3 * sizeof(unsigned long))
 
-int pkt_tracker_recvPkt(int connfd, ptp_peer_t* pkt){
+//offset of filetablesize inside the header
+#define PEER_PKT_SIZES_OFFSET (2 * sizeof(int) + IP_LEN * sizeof(char) + 3 * sizeof(unsigned long))
 
-	int type, port, filetablesize;
-	char* peer_ip = (char*)malloc(IP_LEN * sizeof(char));
-	fileEntry_t* head = NULL;
+//size of the fixed part of a tracker->peer packet on the wire:
+//type, heartbeatinterval, piece_len, ackVersion, epoch, baseEpoch, filetablesize, deltasize, bodyLen, nodesize, shard, shardNum
+#define TRACKER_PKT_HEADER_LEN (9 * sizeof(int) + 3 * sizeof(unsigned long))
 
-	if(recv(connfd, &type, sizeof(int), 0) < 0){
-		printf("err in %s: failed to receive type\n", __func__ );
-		return -1;
-	}
+//offset of filetablesize inside the header
+#define TRACKER_PKT_SIZES_OFFSET (3 * sizeof(int) + 3 * sizeof(unsigned long))
 
-	if(recv(connfd, peer_ip, IP_LEN * sizeof(char), 0) < 0){
-		printf("err in %s: failed to receive peer_ip\n", __func__ );
-		return -1;
-	}
+//the header is followed by bodyLen bytes: entries and deltas encoded by filecodec.c, then nodesize Merkle nodes (merkle.c)
 
-	if(recv(connfd, &port, sizeof(int), 0) < 0){
-		printf("err in %s: failed to receive type\n", __func__ );
+
+
+
+/************** SEND and RECV **********************************/
+
+int pkt_tracker_recvPkt(int connfd, ptp_peer_t* pkt){
+
+	//receive the fixed size header first, it tells how long the rest of the packet is
+	char header[PEER_PKT_HEADER_LEN];
+	if(recv(connfd, header, PEER_PKT_HEADER_LEN, MSG_WAITALL) != (int) PEER_PKT_HEADER_LEN){
+		printf("err in %s: failed to receive header\n", __func__ );
 		return -1;
 	}
 
-	if(recv(connfd, &filetablesize, sizeof(int), 0) < 0){
-		printf("err in %s: failed to receive type\n", __func__ );
+	int frameLen = pkt_peer_frameLen(header, PEER_PKT_HEADER_LEN);
+	if(frameLen < 0){
+		printf("err in %s: malformed header\n", __func__ );
 		return -1;
 	}
 
-
-	if(filetablesize > 0){
-		//total number of bytes needed for buffer
-		int totalBytes = filetablesize * sizeof(fileEntry_t);
-
-		char* buf = (char*) malloc(totalBytes);
-		if(recv(connfd, buf, totalBytes, 0) < 0) {
-			printf("err in %s: failed to receive arraylist of entries\n", __func__);
-			return -1;
-		}
-		head = filetable_convertArrayToFileEntires(buf, filetablesize);
+	char* buf = (char*) malloc(frameLen);
+	memcpy(buf, header, PEER_PKT_HEADER_LEN);
+	int bodyLen = frameLen - PEER_PKT_HEADER_LEN;
+	if(bodyLen > 0 && recv(connfd, buf + PEER_PKT_HEADER_LEN, bodyLen, MSG_WAITALL) != bodyLen) {
+		printf("err in %s: failed to receive entries and deltas\n", __func__);
+		free(buf);
+		return -1;
 	}
 
+	int ret = pkt_peer_decodePkt(buf, pkt);
+	free(buf);
+	return ret;
+}
 
 
+int pkt_peer_sendPkt(int connfd, ptp_peer_t* pkt, peerIdMap_t* ids){
 
-	//assemble the pieces
-	pkt->type = type;
-	memcpy(pkt->peer_ip, peer_ip, IP_LEN * sizeof(char));
-	pkt->port = port;
-	pkt->filetablesize = filetablesize;
-	pkt->filetableHeadPtr = head;
-	return 1;
+	pktBuf_t* buf = pkt_peer_encodePkt(pkt, ids);
+	int ret = pkt_sendBuf(connfd, buf);
+	pkt_buf_release(buf);
+	return ret;
 }
 
+int pkt_tracker_sendPkt(int connfd, ptp_tracker_t* pkt, peerIdMap_t* ids){
 
-int pkt_peer_sendPkt(int connfd, ptp_peer_t* pkt){
-	
+	pktBuf_t* buf = pkt_tracker_encodePkt(pkt, ids);
+	int ret = pkt_sendBuf(connfd, buf);
+	pkt_buf_release(buf);
+	return ret;
+}
 
+int pkt_peer_recvPkt(int connfd, ptp_tracker_t* pkt, peerIdMap_t* ids){
 
-	if(send(connfd, &(pkt->type), sizeof(int), 0) < 0){
-		printf("err in %s: send type failed\n", __func__);
+	//receive the fixed size header first, it tells how long the body is
+	char header[TRACKER_PKT_HEADER_LEN];
+	if(recv(connfd, header, TRACKER_PKT_HEADER_LEN, MSG_WAITALL) != (int) TRACKER_PKT_HEADER_LEN){
+		printf("err in %s: failed to receive header\n", __func__ );
 		return -1;
 	}
 
-
-	if(send(connfd, &(pkt->peer_ip), sizeof(pkt->peer_ip), 0) < 0){
-		printf("err in %s: send peerip failed\n", __func__);
+	int frameLen = pkt_tracker_frameLen(header, TRACKER_PKT_HEADER_LEN);
+	if(frameLen < 0){
+		printf("err in %s: malformed header\n", __func__ );
 		return -1;
 	}
 
-
-	if(send(connfd, &(pkt->port), sizeof(int), 0) < 0){
-		printf("err in %s: send entry number failed\n", __func__);
+	char* buf = (char*) malloc(frameLen);
+	memcpy(buf, header, TRACKER_PKT_HEADER_LEN);
+	int bodyLen = frameLen - TRACKER_PKT_HEADER_LEN;
+	if(bodyLen > 0 && recv(connfd, buf + TRACKER_PKT_HEADER_LEN, bodyLen, MSG_WAITALL) != bodyLen) {
+		printf("err in %s: failed to receive entries and deltas\n", __func__);
+		free(buf);
 		return -1;
 	}
 
+	int ret = pkt_tracker_decodePkt(buf, pkt, ids);
+	free(buf);
+	return ret;
+}
 
-	if(send(connfd, &(pkt->filetablesize), sizeof(int), 0) < 0){
-		printf("err in %s: send filetablesize failed\n", __func__);
-		return -1;
-	}
 
+/************** SHARED ENCODED BUFFERS **********************************/
+
+
+/**
+ * Encode a tracker->peer packet once, in the layout pkt_peer_recvPkt reads, so the same
+ * bytes can be sent to any number of peers.  Entries and deltas are encoded straight from
+ * their lists, no intermediate arrays.
+ * @param  pkt [configured packet, its lists must not change while encoding]
+ * @param  ids [peer ids the holders of the entries refer to]
+ * @return     [buffer holding one reference, release it with pkt_buf_release]
+ */
+pktBuf_t* pkt_tracker_encodePkt(ptp_tracker_t* pkt, peerIdMap_t* ids){
+
+	fileCodec_t* codec = filecodec_init(ids);
+	int codecLen = filecodec_measure(codec, pkt->filetableHeadPtr, pkt->filetablesize, pkt->deltaHeadPtr, pkt->deltasize);
+	int bodyLen = codecLen + pkt->nodesize * MERKLE_NODE_WIRE_LEN;
+
+	int len = TRACKER_PKT_HEADER_LEN + bodyLen;
+	pktBuf_t* buf = (pktBuf_t*) malloc(sizeof(pktBuf_t) + len);
+	buf->refcount = 1;
+	buf->len = len;
+
+	char* iter = buf->data;
+	memcpy(iter, &(pkt->type), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &(pkt->heartbeatinterval), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &(pkt->piece_len), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &(pkt->ackVersion), sizeof(unsigned long));
+	iter += sizeof(unsigned long);
+	memcpy(iter, &(pkt->epoch), sizeof(unsigned long));
+	iter += sizeof(unsigned long);
+	memcpy(iter, &(pkt->baseEpoch), sizeof(unsigned long));
+	iter += sizeof(unsigned long);
+	memcpy(iter, &(pkt->filetablesize), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &(pkt->deltasize), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &bodyLen, sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &(pkt->nodesize), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &(pkt->shard), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &(pkt->shardNum), sizeof(int));
+	iter += sizeof(int);
+
+	iter = filecodec_encode(codec, iter, pkt->filetableHeadPtr, pkt->filetablesize, pkt->deltaHeadPtr, pkt->deltasize);
+	iter = merkle_encodeNodes(iter, pkt->nodes, pkt->nodesize);
+	assert(iter == buf->data + len);
+	filecodec_destroy(codec);
+
+	return buf;
+}
+
+/**
+ * Encode a peer->tracker packet, in the layout pkt_peer_decodePkt reads.
+ * @param  pkt [configured packet, its lists must not change while encoding]
+ * @param  ids [peer ids the holders of the entries refer to]
+ * @return     [buffer holding one reference, release it with pkt_buf_release]
+ */
+pktBuf_t* pkt_peer_encodePkt(ptp_peer_t* pkt, peerIdMap_t* ids){
+
+	fileCodec_t* codec = filecodec_init(ids);
+	int codecLen = filecodec_measure(codec, pkt->filetableHeadPtr, pkt->filetablesize, pkt->deltaHeadPtr, pkt->deltasize);
+	int bodyLen = codecLen + pkt->nodesize * MERKLE_NODE_WIRE_LEN;
+
+	int len = PEER_PKT_HEADER_LEN + bodyLen;
+	pktBuf_t* buf = (pktBuf_t*) malloc(sizeof(pktBuf_t) + len);
+	buf->refcount = 1;
+	buf->len = len;
+
+	char* iter = buf->data;
+	memcpy(iter, &(pkt->type), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, pkt->peer_ip, IP_LEN * sizeof(char));
+	iter += IP_LEN * sizeof(char);
+	memcpy(iter, &(pkt->port), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &(pkt->tableVersion), sizeof(unsigned long));
+	iter += sizeof(unsigned long);
+	memcpy(iter, &(pkt->baseVersion), sizeof(unsigned long));
+	iter += sizeof(unsigned long);
+	memcpy(iter, &(pkt->ackedEpoch), sizeof(unsigned long));
+	iter += sizeof(unsigned long);
+	memcpy(iter, &(pkt->filetablesize), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &(pkt->deltasize), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &bodyLen, sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &(pkt->nodesize), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &(pkt->shard), sizeof(int));
+	iter += sizeof(int);
+	memcpy(iter, &(pkt->shardNum), sizeof(int));
+	iter += sizeof(int);
+
+	iter = filecodec_encode(codec, iter, pkt->filetableHeadPtr, pkt->filetablesize, pkt->deltaHeadPtr, pkt->deltasize);
+	iter = merkle_encodeNodes(iter, pkt->nodes, pkt->nodesize);
+	assert(iter == buf->data + len);
+	filecodec_destroy(codec);
+
+	return buf;
+}
+
+/**
+ * take one more reference to a buffer, e.g. before queueing it for another connection
+ * @param buf [the buffer]
+ */
+void pkt_buf_retain(pktBuf_t* buf){
+	__atomic_add_fetch(&(buf->refcount), 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * drop a reference, the buffer is freed with the last one
+ * @param buf [the buffer, may be NULL]
+ */
+void pkt_buf_release(pktBuf_t* buf){
+	if(buf == NULL) return;
+	if(__atomic_sub_fetch(&(buf->refcount), 1, __ATOMIC_ACQ_REL) == 0){
+		free(buf);
+	}
+}
 
-	if(pkt->filetablesize > 0){
-		int totalBytes = (pkt->filetablesize) * sizeof(fileEntry_t);
-		char* buf = filetable_convertFileEntriesToArray(pkt->filetableHeadPtr, pkt->filetablesize);
-		if(send(connfd, buf, totalBytes, 0) < 0){
-			printf("err in %s: send arraylist of entries failed\n", __func__);
+/**
+ * send a whole encoded buffer, retrying partial writes
+ * @param  connfd [connection to send on]
+ * @param  buf    [the buffer, not released here]
+ * @return        [1 if success, -1 if fails]
+ */
+int pkt_sendBuf(int connfd, pktBuf_t* buf){
+
+	int sent = 0;
+	while(sent < buf->len){
+		ssize_t n = write(connfd, buf->data + sent, buf->len - sent);
+		if(n < 0){
+			if(errno == EINTR) continue;
+			printf("err in %s: send failed\n", __func__);
 			return -1;
 		}
+		sent += n;
 	}
-
 	return 1;
 }
 
-int pkt_tracker_sendPkt(int connfd, ptp_tracker_t* pkt){
-
-	if(send(connfd, &(pkt->heartbeatinterval), sizeof(int), 0) < 0){
-		printf("err in %s: send heartbeatinterval failed\n", __func__);
-		return -1;
-	}
 
+/************** INCREMENTAL FRAMING **********************************/
 
-	if(send(connfd, &(pkt->piece_len), sizeof(int), 0) < 0){
-		printf("err in %s: send piece_len failed\n", __func__);
-		return -1;
-	}
 
+/**
+ * Tell how many bytes the peer->tracker packet at the front of buf occupies on the wire,
+ * so a non-blocking reader knows when a complete packet has arrived
+ * @param  buf [bytes received so far, starting at a packet boundary]
+ * @param  len [number of valid bytes in buf]
+ * @return     [total frame length, 0 if the header itself is incomplete, -1 if the header is malformed]
+ */
+int pkt_peer_frameLen(char* buf, int len){
 
-	if(send(connfd, &(pkt->filetablesize), sizeof(int), 0) < 0){
-		printf("err in %s: send filetablesize failed\n", __func__);
-		return -1;
-	}
+	if(len < (int) PEER_PKT_HEADER_LEN) return 0;
 
+	int filetablesize, deltasize, bodyLen, nodesize;
+	memcpy(&filetablesize, buf + PEER_PKT_SIZES_OFFSET, sizeof(int));
+	memcpy(&deltasize, buf + PEER_PKT_SIZES_OFFSET + sizeof(int), sizeof(int));
+	memcpy(&bodyLen, buf + PEER_PKT_SIZES_OFFSET + 2 * sizeof(int), sizeof(int));
+	memcpy(&nodesize, buf + PEER_PKT_SIZES_OFFSET + 3 * sizeof(int), sizeof(int));
+	if(filetablesize < 0 || deltasize < 0 || bodyLen < 0 || bodyLen > FILECODEC_MAX_BODY) return -1;
+	if(nodesize < 0 || nodesize > (int) (bodyLen / MERKLE_NODE_WIRE_LEN)) return -1;
 
+	return PEER_PKT_HEADER_LEN + bodyLen;
+}
 
-	if(pkt->filetablesize > 0){
-		int totalBytes = (pkt->filetablesize) * sizeof(fileEntry_t);
-		char* buf = filetable_convertFileEntriesToArray(pkt->filetableHeadPtr, pkt->filetablesize);
-		if(send(connfd, buf, totalBytes, 0) < 0){
-			printf("err in %s: send arraylist of entries failed\n", __func__);
-			return -1;
-		}
+/**
+ * Decode one complete peer->tracker packet from buf (see pkt_peer_frameLen), the same layout
+ * pkt_peer_sendPkt puts on the wire
+ * @param  buf [a complete frame]
+ * @param  pkt [packet to fill in, filetableHeadPtr is a newly malloced linked list owned by the caller]
+ * @return     [1 if success, -1 if fails]
+ */
+int pkt_peer_decodePkt(char* buf, ptp_peer_t* pkt){
+
+	char* iter = buf;
+
+	memcpy(&(pkt->type), iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(pkt->peer_ip, iter, IP_LEN * sizeof(char));
+	pkt->peer_ip[IP_LEN - 1] = '\0';
+	iter += IP_LEN * sizeof(char);
+	memcpy(&(pkt->port), iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&(pkt->tableVersion), iter, sizeof(unsigned long));
+	iter += sizeof(unsigned long);
+	memcpy(&(pkt->baseVersion), iter, sizeof(unsigned long));
+	iter += sizeof(unsigned long);
+	memcpy(&(pkt->ackedEpoch), iter, sizeof(unsigned long));
+	iter += sizeof(unsigned long);
+	memcpy(&(pkt->filetablesize), iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&(pkt->deltasize), iter, sizeof(int));
+	iter += sizeof(int);
+	int bodyLen;
+	memcpy(&bodyLen, iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&(pkt->nodesize), iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&(pkt->shard), iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&(pkt->shardNum), iter, sizeof(int));
+	iter += sizeof(int);
+
+	int codecLen = bodyLen - pkt->nodesize * (int) MERKLE_NODE_WIRE_LEN;
+	if(pkt->filetablesize < 0 || pkt->deltasize < 0 || pkt->nodesize < 0 || codecLen < 0) {
+		printf("err in %s: negative filetablesize, deltasize, nodesize or bodyLen\n", __func__);
+		return -1;
 	}
 
+	//holders are not decoded, the tracker only takes the sender as a holder
+	if(filecodec_decode(iter, codecLen, pkt->filetablesize, &(pkt->filetableHeadPtr), pkt->deltasize, &(pkt->deltaHeadPtr), NULL) < 0){
+		printf("err in %s: malformed entries or deltas\n", __func__);
+		return -1;
+	}
+	if(merkle_decodeNodes(iter + codecLen, pkt->nodesize, &(pkt->nodes)) < 0){
+		printf("err in %s: malformed Merkle nodes\n", __func__);
+		filetable_freeList(pkt->filetableHeadPtr);
+		pkt->filetableHeadPtr = NULL;
+		filedelta_freeList(pkt->deltaHeadPtr);
+		pkt->deltaHeadPtr = NULL;
+		return -1;
+	}
 	return 1;
 }
 
-int pkt_peer_recvPkt(int connfd, ptp_tracker_t* pkt){
 
+/**
+ * Tell how many bytes the tracker->peer packet at the front of buf occupies on the wire,
+ * the peer side counterpart of pkt_peer_frameLen
+ * @param  buf [bytes received so far, starting at a packet boundary]
+ * @param  len [number of valid bytes in buf]
+ * @return     [total frame length, 0 if the header itself is incomplete, -1 if the header is malformed]
+ */
+int pkt_tracker_frameLen(char* buf, int len){
 
-	int heartbeatinterval, piece_len, filetablesize;
-	fileEntry_t* head = NULL;
+	if(len < (int) TRACKER_PKT_HEADER_LEN) return 0;
 
-	if(recv(connfd, &heartbeatinterval, sizeof(int), 0) < 0){
-		printf("err in %s: failed to receive heartbeatinterval\n", __func__ );
-		return -1;
-	}
+	int filetablesize, deltasize, bodyLen, nodesize;
+	memcpy(&filetablesize, buf + TRACKER_PKT_SIZES_OFFSET, sizeof(int));
+	memcpy(&deltasize, buf + TRACKER_PKT_SIZES_OFFSET + sizeof(int), sizeof(int));
+	memcpy(&bodyLen, buf + TRACKER_PKT_SIZES_OFFSET + 2 * sizeof(int), sizeof(int));
+	memcpy(&nodesize, buf + TRACKER_PKT_SIZES_OFFSET + 3 * sizeof(int), sizeof(int));
+	if(filetablesize < 0 || deltasize < 0 || bodyLen < 0 || bodyLen > FILECODEC_MAX_BODY) return -1;
+	if(nodesize < 0 || nodesize > (int) (bodyLen / MERKLE_NODE_WIRE_LEN)) return -1;
 
-	if(recv(connfd, &piece_len, sizeof(int), 0) < 0){
-		printf("err in %s: failed to receive piece_len\n", __func__ );
+	return TRACKER_PKT_HEADER_LEN + bodyLen;
+}
+
+/**
+ * Decode one complete tracker->peer packet from buf (see pkt_tracker_frameLen), the same layout
+ * pkt_tracker_encodePkt puts on the wire
+ * @param  buf [a complete frame]
+ * @param  pkt [packet to fill in, its lists are newly malloced and owned by the caller]
+ * @param  ids [peer ids the holders of the entries are interned into, NULL to skip holders]
+ * @return     [1 if success, -1 if fails]
+ */
+int pkt_tracker_decodePkt(char* buf, ptp_tracker_t* pkt, peerIdMap_t* ids){
+
+	int type, heartbeatinterval, piece_len, filetablesize, deltasize, bodyLen, nodesize, shard, shardNum;
+	unsigned long ackVersion, epoch, baseEpoch;
+
+	char* iter = buf;
+	memcpy(&type, iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&heartbeatinterval, iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&piece_len, iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&ackVersion, iter, sizeof(unsigned long));
+	iter += sizeof(unsigned long);
+	memcpy(&epoch, iter, sizeof(unsigned long));
+	iter += sizeof(unsigned long);
+	memcpy(&baseEpoch, iter, sizeof(unsigned long));
+	iter += sizeof(unsigned long);
+	memcpy(&filetablesize, iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&deltasize, iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&bodyLen, iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&nodesize, iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&shard, iter, sizeof(int));
+	iter += sizeof(int);
+	memcpy(&shardNum, iter, sizeof(int));
+	iter += sizeof(int);
+
+	int codecLen = bodyLen - nodesize * (int) MERKLE_NODE_WIRE_LEN;
+	if(filetablesize < 0 || deltasize < 0 || nodesize < 0 || codecLen < 0) {
+		printf("err in %s: negative filetablesize, deltasize, nodesize or bodyLen\n", __func__);
 		return -1;
 	}
 
-	if(recv(connfd, &filetablesize, sizeof(int), 0) < 0){
-		printf("err in %s: failed to receive filetablesize\n", __func__ );
+	fileEntry_t* head = NULL;
+	fileDelta_t* deltaHead = NULL;
+	if(filecodec_decode(iter, codecLen, filetablesize, &head, deltasize, &deltaHead, ids) < 0){
+		printf("err in %s: malformed entries or deltas\n", __func__);
 		return -1;
 	}
-
-
-	if(filetablesize > 0){
-		//total number of bytes needed for buffer
-		int totalBytes = filetablesize * sizeof(fileEntry_t);
-
-		char* buf = (char*) malloc(totalBytes);
-		if(recv(connfd, buf, totalBytes, 0) < 0) {
-			printf("err in %s: failed to receive arraylist of entries\n", __func__);
-			return -1;
-		}
-		head = filetable_convertArrayToFileEntires(buf, filetablesize);
+	merkleNode_t* nodes = NULL;
+	if(merkle_decodeNodes(iter + codecLen, nodesize, &nodes) < 0){
+		printf("err in %s: malformed Merkle nodes\n", __func__);
+		filetable_freeList(head);
+		filedelta_freeList(deltaHead);
+		return -1;
 	}
 
 	//assemble the pieces
+	pkt->type = type;
 	pkt->heartbeatinterval = heartbeatinterval;
 	pkt->piece_len = piece_len;
+	pkt->ackVersion = ackVersion;
+	pkt->epoch = epoch;
+	pkt->baseEpoch = baseEpoch;
 	pkt->filetablesize = filetablesize;
 	pkt->filetableHeadPtr = head;
+	pkt->deltasize = deltasize;
+	pkt->deltaHeadPtr = deltaHead;
+	pkt->nodesize = nodesize;
+	pkt->nodes = nodes;
+	pkt->shard = shard;
+	pkt->shardNum = shardNum;
+	return 1;
 }
 
 
@@ -202,10 +467,20 @@ ptp_peer_t* pkt_create_peerPkt(){
 /********* CONFIGURE ***********************************/
 
 void pkt_config_trackerPkt(ptp_tracker_t* pkt,  int heartbeatinterval, int piece_len, int filetablesize, fileEntry_t* filetableHeadPtr){
+	pkt->type = TRACKER_FILETABLE;
+	pkt->ackVersion = 0;
+	pkt->epoch = 0;
+	pkt->baseEpoch = 0;
 	pkt->heartbeatinterval = heartbeatinterval;
 	pkt->piece_len = piece_len;
 	pkt->filetablesize = filetablesize;
 	pkt->filetableHeadPtr = filetableHeadPtr;
+	pkt->deltasize = 0;
+	pkt->deltaHeadPtr = NULL;
+	pkt->nodesize = 0;
+	pkt->nodes = NULL;
+	pkt->shard = 0;
+	pkt->shardNum = 0;
 }
 
 
@@ -217,4 +492,141 @@ void pkt_config_peerPkt(ptp_peer_t* pkt,  int type, char* peer_ip, int port, int
 	pkt->port = port;
 	pkt->filetablesize = filetablesize;
 	pkt->filetableHeadPtr = filetableHeadPtr;
+	pkt->nodesize = 0;
+	pkt->nodes = NULL;
+	pkt->shard = 0;
+	pkt->shardNum = 0;
+}
+
+
+/**
+ * configure a packet the tracker sends without a file table
+ * @param pkt        [packet to configure]
+ * @param type       [TRACKER_ACK or TRACKER_RESYNC]
+ * @param ackVersion [TRACKER_ACK: the peer's table version that has been applied]
+ */
+void pkt_config_trackerAck(ptp_tracker_t* pkt, int type, unsigned long ackVersion){
+	pkt->type = type;
+	pkt->heartbeatinterval = HEARTBEAT_INTERVAL;
+	pkt->piece_len = PIECE_LENGTH;
+	pkt->ackVersion = ackVersion;
+	pkt->epoch = 0;
+	pkt->baseEpoch = 0;
+	pkt->filetablesize = 0;
+	pkt->filetableHeadPtr = NULL;
+	pkt->deltasize = 0;
+	pkt->deltaHeadPtr = NULL;
+	pkt->nodesize = 0;
+	pkt->nodes = NULL;
+	pkt->shard = 0;
+	pkt->shardNum = 0;
+}
+
+
+
+/**
+ * attach the peer's table versions, and the changes for a FILEUPDATE_DELTA, to a configured packet
+ * @param pkt          [packet configured by pkt_config_peerPkt]
+ * @param tableVersion [version of the peer's table once the packet is applied]
+ * @param baseVersion  [FILEUPDATE_DELTA: version the changes apply on top of]
+ * @param deltasize    [number of changes]
+ * @param deltaHeadPtr [list of changes]
+ */
+void pkt_config_peerDelta(ptp_peer_t* pkt, unsigned long tableVersion, unsigned long baseVersion, int deltasize, fileDelta_t* deltaHeadPtr){
+	pkt->tableVersion = tableVersion;
+	pkt->baseVersion = baseVersion;
+	pkt->deltasize = deltasize;
+	pkt->deltaHeadPtr = deltaHeadPtr;
+}
+
+
+
+/**
+ * configure a broadcast carrying only the files changed since the epoch the peer acknowledged
+ * @param pkt          [packet to configure]
+ * @param baseEpoch    [epoch the changes apply on top of]
+ * @param epoch        [epoch of the tracker's table the peer reaches once they are applied]
+ * @param deltasize    [number of changes]
+ * @param deltaHeadPtr [list of changes, DELTA_DELETE for files no longer in the table]
+ */
+void pkt_config_trackerDelta(ptp_tracker_t* pkt, unsigned long baseEpoch, unsigned long epoch, int deltasize, fileDelta_t* deltaHeadPtr){
+	pkt->type = TRACKER_DELTA;
+	pkt->heartbeatinterval = HEARTBEAT_INTERVAL;
+	pkt->piece_len = PIECE_LENGTH;
+	pkt->ackVersion = 0;
+	pkt->epoch = epoch;
+	pkt->baseEpoch = baseEpoch;
+	pkt->filetablesize = 0;
+	pkt->filetableHeadPtr = NULL;
+	pkt->deltasize = deltasize;
+	pkt->deltaHeadPtr = deltaHeadPtr;
+	pkt->nodesize = 0;
+	pkt->nodes = NULL;
+	pkt->shard = 0;
+	pkt->shardNum = 0;
+}
+
+
+
+/**
+ * configure a round of a Merkle exchange as the tracker answers it
+ * @param pkt              [packet to configure]
+ * @param epoch            [epoch the peer's broadcasts resume from once the exchange is over]
+ * @param nodesize         [number of nodes]
+ * @param nodes            [the tracker's side of the nodes the peer asked about (see merkle_expand)]
+ * @param filetablesize    [number of entries]
+ * @param filetableHeadPtr [the tracker's entries of the nodes the peer settled]
+ */
+void pkt_config_trackerMerkle(ptp_tracker_t* pkt, unsigned long epoch, int nodesize, merkleNode_t* nodes, int filetablesize, fileEntry_t* filetableHeadPtr){
+	pkt->type = TRACKER_MERKLE;
+	pkt->heartbeatinterval = HEARTBEAT_INTERVAL;
+	pkt->piece_len = PIECE_LENGTH;
+	pkt->ackVersion = 0;
+	pkt->epoch = epoch;
+	pkt->baseEpoch = 0;
+	pkt->filetablesize = filetablesize;
+	pkt->filetableHeadPtr = filetableHeadPtr;
+	pkt->deltasize = 0;
+	pkt->deltaHeadPtr = NULL;
+	pkt->nodesize = nodesize;
+	pkt->nodes = nodes;
+	pkt->shard = 0;
+	pkt->shardNum = 0;
+}
+
+
+
+/**
+ * attach Merkle nodes to a configured REGISTER or MERKLE_SYNC
+ * @param pkt      [packet configured by pkt_config_peerPkt, its entries being those of the settled nodes]
+ * @param nodesize [number of nodes]
+ * @param nodes    [the nodes (see merkle_step), REGISTER: the root of the peer's tree]
+ */
+void pkt_config_peerNodes(ptp_peer_t* pkt, int nodesize, merkleNode_t* nodes){
+	pkt->nodesize = nodesize;
+	pkt->nodes = nodes;
+}
+
+
+
+/**
+ * stamp a tracker packet with the shard sending it, so the peer can tell it connected to the tracker it meant to
+ * @param pkt      [packet to configure]
+ * @param shard    [shard of the tracker]
+ * @param shardNum [number of shards the tracker is split into]
+ */
+void pkt_config_trackerShard(ptp_tracker_t* pkt, int shard, int shardNum){
+	pkt->shard = shard;
+	pkt->shardNum = shardNum;
+}
+
+/**
+ * tell the shard a REGISTER or MERKLE_SYNC is sent to which shard the peer takes it for, and how many it takes the tracker to have
+ * @param pkt      [REGISTER or MERKLE_SYNC to configure]
+ * @param shard    [shard the peer connected to]
+ * @param shardNum [number of shards the peer splits its files among]
+ */
+void pkt_config_peerShard(ptp_peer_t* pkt, int shard, int shardNum){
+	pkt->shard = shard;
+	pkt->shardNum = shardNum;
 }
@@ -1,6 +1,11 @@
+#ifndef PKT_H
+#define PKT_H
 
 #include "peertable.h"
 #include "filetable.h"
+#include "filedelta.h"
+#include "peerid.h"
+#include "merkle.h"
 
 
 //client states used in FSM
@@ -15,15 +20,37 @@
 
 /* pkt from tracker to peer */
 typedef struct segment_tracker {
+// TRACKER_FILETABLE, TRACKER_DELTA, TRACKER_ACK, TRACKER_RESYNC or TRACKER_MERKLE
+	int type;
 // time interval that the peer should sending alive message periodically int interval;
 	int heartbeatinterval;
 // piece length
 	int piece_len;
+// TRACKER_ACK: the peer's table version the tracker has applied
+	unsigned long ackVersion;
+// TRACKER_FILETABLE / TRACKER_DELTA: epoch of the tracker's table the peer reaches once the packet is applied
+	unsigned long epoch;
+// TRACKER_DELTA: epoch the changes apply on top of (last one the peer acknowledged)
+	unsigned long baseEpoch;
 
 	int filetablesize;
 
 	fileEntry_t* filetableHeadPtr;//array, by converting linkedlist of fileEntries
 
+// TRACKER_DELTA: files changed since baseEpoch
+	int deltasize;
+
+	fileDelta_t* deltaHeadPtr;
+
+// TRACKER_MERKLE: the tracker's side of the Merkle nodes the peer asked about (see merkle_expand)
+	int nodesize;
+
+	merkleNode_t* nodes;
+
+// shard of the tracker sending the packet and the number of shards the tracker is split into
+	int shard;
+	int shardNum;
+
 } ptp_tracker_t;
 
 
@@ -37,22 +64,73 @@ typedef struct segment_peer {
 	// listening port number in p2p
 	int port;
 
+	// version of the peer's file table once this packet is applied
+	unsigned long tableVersion;
+	// FILEUPDATE_DELTA: version the deltas apply on top of (last one the tracker acknowledged)
+	unsigned long baseVersion;
+	// last epoch of the tracker's table this peer has applied (EPOCH_ACK)
+	unsigned long ackedEpoch;
+
 	int filetablesize;
 
 	fileEntry_t*  filetableHeadPtr;//array, by converting linkedlist of fileEntries
+
+	// FILEUPDATE_DELTA: changes since baseVersion
+	int deltasize;
+
+	fileDelta_t* deltaHeadPtr;
+
+	// REGISTER / MERKLE_SYNC: Merkle nodes of the peer's table to compare or settle (see merkle_step)
+	int nodesize;
+
+	merkleNode_t* nodes;
+
+	// REGISTER / MERKLE_SYNC: shard the peer connected to and the number of shards it takes the tracker to have
+	int shard;
+	int shardNum;
 }ptp_peer_t;
 
 
 
+/* an encoded packet, immutable once built and shared by every connection it is sent on */
+typedef struct pkt_buf {
+	int refcount;	// holders of the buffer, freed when the last one releases it
+	int len;		// bytes in data
+	char data[];	// the packet exactly as it goes on the wire
+} pktBuf_t;
+
+
+
 /****** tracker side APIs ******/
 int pkt_tracker_recvPkt(int connection, ptp_peer_t* pkt);
-int pkt_tracker_sendPkt(int connection, ptp_tracker_t* pkt);
+int pkt_tracker_sendPkt(int connection, ptp_tracker_t* pkt, peerIdMap_t* ids);
+pktBuf_t* pkt_tracker_encodePkt(ptp_tracker_t* pkt, peerIdMap_t* ids);
+
+
+
+/****** shared encoded buffers ******/
+void pkt_buf_retain(pktBuf_t* buf);
+void pkt_buf_release(pktBuf_t* buf);
+int pkt_sendBuf(int connection, pktBuf_t* buf);
+
+
+
+/****** tracker side incremental framing (used by the epoll reactor) ******/
+int pkt_peer_frameLen(char* buf, int len);
+int pkt_peer_decodePkt(char* buf, ptp_peer_t* pkt);
+
+
+
+/****** peer side incremental framing (used by load generators driving many connections) ******/
+int pkt_tracker_frameLen(char* buf, int len);
+int pkt_tracker_decodePkt(char* buf, ptp_tracker_t* pkt, peerIdMap_t* ids);
 
 
 
 /****** peer side receive and send ******/
-int pkt_peer_recvPkt(int connection, ptp_tracker_t* pkt);
-int pkt_peer_sendPkt(int connection, ptp_peer_t* pkt);
+int pkt_peer_recvPkt(int connection, ptp_tracker_t* pkt, peerIdMap_t* ids);
+int pkt_peer_sendPkt(int connection, ptp_peer_t* pkt, peerIdMap_t* ids);
+pktBuf_t* pkt_peer_encodePkt(ptp_peer_t* pkt, peerIdMap_t* ids);
 
 
 
@@ -65,6 +143,15 @@ ptp_peer_t* pkt_create_peerPkt();
 void pkt_config_trackerPkt(ptp_tracker_t* pkt,  int heartbeatinterval, int piece_len, int filetablesize, fileEntry_t* filetableHeadPtr);
 void pkt_config_peerPkt(ptp_peer_t* pkt,  int type, char* peer_ip, int port, int filetablesize, fileEntry_t* filetableHeadPtr);
 
+void pkt_config_trackerAck(ptp_tracker_t* pkt, int type, unsigned long ackVersion);
+void pkt_config_peerDelta(ptp_peer_t* pkt, unsigned long tableVersion, unsigned long baseVersion, int deltasize, fileDelta_t* deltaHeadPtr);
+
+void pkt_config_trackerDelta(ptp_tracker_t* pkt, unsigned long baseEpoch, unsigned long epoch, int deltasize, fileDelta_t* deltaHeadPtr);
 
+void pkt_config_trackerMerkle(ptp_tracker_t* pkt, unsigned long epoch, int nodesize, merkleNode_t* nodes, int filetablesize, fileEntry_t* filetableHeadPtr);
+void pkt_config_peerNodes(ptp_peer_t* pkt, int nodesize, merkleNode_t* nodes);
 
+void pkt_config_trackerShard(ptp_tracker_t* pkt, int shard, int shardNum);
+void pkt_config_peerShard(ptp_peer_t* pkt, int shard, int shardNum);
 
+#endif
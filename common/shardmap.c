@@ -0,0 +1,207 @@
+/* File: shardmap.c
+   Description: Consistent hashing of file paths onto tracker shards.  Each tracker shard owns the
+   		paths that hash into its ranges of the ring, peers send every file change to the shard owning
+   		it and merge what the shards broadcast into one view.  Unit tested in the testing directory
+   		with shardmap_test.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "shardmap.h"
+
+
+/* FNV-1a, with a final mix so that short names differing in one character spread over the whole ring */
+static unsigned int shardmap_hash(const char* str) {
+  unsigned int hash = 2166136261u;
+  while (*str) {
+    hash ^= (unsigned char) *str++;
+    hash *= 16777619u;
+  }
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+static int shardmap_comparePoints(const void* a, const void* b) {
+  const shardPoint_t* x = (const shardPoint_t*) a;
+  const shardPoint_t* y = (const shardPoint_t*) b;
+  if (x -> hash != y -> hash) return (x -> hash < y -> hash) ? -1 : 1;
+  //equal hashes are ordered the same way everywhere
+  return x -> shard - y -> shard;
+}
+
+/* Function to build the ring of shardNum shards.
+
+	@return the pointer to the shardMap_t that is created, NULL if shardNum is not positive.
+*/
+shardMap_t* shardmap_init(int shardNum) {
+  if (shardNum <= 0) {
+    printf("%s: error: %d shards\n", __func__, shardNum);
+    return NULL;
+  }
+
+  shardMap_t* map = (shardMap_t*) malloc(sizeof(shardMap_t));
+  map -> shardNum = shardNum;
+  map -> pointNum = shardNum * SHARDMAP_VNODES;
+  map -> ring = (shardPoint_t*) malloc(map -> pointNum * sizeof(shardPoint_t));
+
+  //a point depends only on its shard and number, so a shard keeps its points whatever the shard count
+  char name[32];
+  int shard, v, i = 0;
+  for (shard = 0; shard < shardNum; shard++) {
+    for (v = 0; v < SHARDMAP_VNODES; v++) {
+      snprintf(name, sizeof(name), "shard-%d#%d", shard, v);
+      map -> ring[i].hash = shardmap_hash(name);
+      map -> ring[i].shard = shard;
+      i++;
+    }
+  }
+  qsort(map -> ring, map -> pointNum, sizeof(shardPoint_t), shardmap_comparePoints);
+  return map;
+}
+
+/**
+ * the shard owning a path
+ * @param  map       [the ring]
+ * @param  file_name [the path]
+ * @return           [shard number, 0 .. shardNum - 1]
+ */
+int shardmap_owner(shardMap_t* map, const char* file_name) {
+  if (map -> shardNum == 1) return 0;
+
+  //first point at or after the hash, past the last point the ring wraps to the first
+  unsigned int hash = shardmap_hash(file_name);
+  int lo = 0, hi = map -> pointNum;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (map -> ring[mid].hash < hash) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == map -> pointNum) lo = 0;
+  return map -> ring[lo].shard;
+}
+
+/**
+ * copy the entries a shard owns out of a list, e.g. to send a shard the part of a full table it owns
+ * @param  map   [the ring]
+ * @param  shard [the shard]
+ * @param  head  [first entry of the list, the caller keeps it from changing]
+ * @param  num   [set to the number of entries copied]
+ * @return       [list of copies in the list's order (NULL if none), to be freed with filetable_freeList]
+ */
+fileEntry_t* shardmap_selectEntries(shardMap_t* map, int shard, fileEntry_t* head, int* num) {
+  fileEntry_t dummy;
+  dummy.next = NULL;
+  fileEntry_t* tail = &dummy;
+  *num = 0;
+
+  fileEntry_t* iter = head;
+  while (iter != NULL) {
+    if (shardmap_owner(map, iter -> file_name) == shard) {
+      fileEntry_t* copy = (fileEntry_t*) malloc(sizeof(fileEntry_t));
+      memcpy(copy, iter, sizeof(fileEntry_t));
+      filetable_retainHolders(copy);
+      copy -> next = NULL;
+      copy -> prev = tail == &dummy ? NULL : tail;
+      tail -> next = copy;
+      tail = copy;
+      (*num)++;
+    }
+    iter = iter -> next;
+  }
+  return dummy.next;
+}
+
+/**
+ * replace the part of a merged table a shard owns with the shard's full table, the other shards' files stay
+ * files the shard no longer lists are deleted, the others are added or overwritten in place
+ * @param  map     [the ring]
+ * @param  shard   [the shard the entries came from]
+ * @param  table   [the merged view of every shard's table]
+ * @param  entries [the shard's table, consumed; entries the shard does not own are dropped]
+ * @return         [number of files the shard owns in the table now]
+ */
+int shardmap_mergeTable(shardMap_t* map, int shard, fileTable_t* table, fileEntry_t* entries) {
+  //index the shard's files by name
+  fileTable_t* shardTable = filetable_init();
+  fileEntry_t* iter = entries;
+  while (iter != NULL) {
+    fileEntry_t* next = iter -> next;
+    if (shardmap_owner(map, iter -> file_name) == shard) {
+      iter -> next = NULL;
+      iter -> prev = NULL;
+      filetable_appendFileEntry(shardTable, iter);
+    } else {
+      printf("%s: error: shard %d sent %s, which it does not own\n", __func__, shard, iter -> file_name);
+      filetable_freeEntry(iter);
+    }
+    iter = next;
+  }
+
+  //the shard's files it no longer lists, collected first as deleting unlinks them
+  int staleNum = 0;
+  char (*stale)[FILE_NAME_MAX_LEN] = NULL;
+  pthread_mutex_lock(table -> filetable_mutex);
+  iter = table -> head;
+  while (iter != NULL) {
+    if (shardmap_owner(map, iter -> file_name) == shard && filetable_searchFileByNameLocked(shardTable, iter -> file_name) == NULL) {
+      stale = realloc(stale, (staleNum + 1) * FILE_NAME_MAX_LEN);
+      memcpy(stale[staleNum ++], iter -> file_name, FILE_NAME_MAX_LEN);
+    }
+    iter = iter -> next;
+  }
+  pthread_mutex_unlock(table -> filetable_mutex);
+
+  int i;
+  for (i = 0; i < staleNum; i++) {
+    filetable_deleteFileEntryByName(table, stale[i]);
+  }
+  free(stale);
+
+  //the rest is the shard's latest state of each file
+  int num = shardTable -> size;
+  iter = shardTable -> head;
+  while (iter != NULL) {
+    pthread_mutex_lock(table -> filetable_mutex);
+    fileEntry_t* entry = filetable_searchFileByNameLocked(table, iter -> file_name);
+    if (entry != NULL) {
+      //overwrite everything but the table's own links
+      fileEntry_t* next = entry -> next;
+      fileEntry_t* prev = entry -> prev;
+      filetable_releaseHolders(entry);
+      memcpy(entry, iter, sizeof(fileEntry_t));
+      filetable_retainHolders(entry);
+      entry -> next = next;
+      entry -> prev = prev;
+      pthread_mutex_unlock(table -> filetable_mutex);
+    } else {
+      pthread_mutex_unlock(table -> filetable_mutex);
+      entry = (fileEntry_t*) malloc(sizeof(fileEntry_t));
+      memcpy(entry, iter, sizeof(fileEntry_t));
+      filetable_retainHolders(entry);
+      entry -> next = NULL;
+      entry -> prev = NULL;
+      filetable_appendFileEntry(table, entry);
+    }
+    iter = iter -> next;
+  }
+  filetable_destroy(shardTable);
+  return num;
+}
+
+/* Function to free the ring.
+*/
+void shardmap_destroy(shardMap_t* map) {
+  if (map == NULL) return;
+  free(map -> ring);
+  free(map);
+}
@@ -0,0 +1,44 @@
+#ifndef SHARDMAP_H
+#define SHARDMAP_H
+
+#include "constants.h"
+#include "filetable.h"
+
+
+#define SHARDMAP_VNODES 64   // points every shard places on the ring, the more the evener the ranges
+
+
+/* one point of the ring, the shard owns the hashes from the previous point up to this one */
+typedef struct shardPoint{
+  unsigned int hash;
+  int shard;
+}shardPoint_t;
+
+
+/**
+ * consistent hashing of file paths onto tracker shards
+ * every shard places SHARDMAP_VNODES points on a ring of 32 bit hashes, a path belongs to the shard of
+ * the first point at or after the path's hash.  Peers and trackers build the same ring from the shard count
+ * alone, and adding a shard only moves the paths that fall into its new ranges
+ */
+typedef struct shardMap{
+  int shardNum;
+  int pointNum;
+  shardPoint_t* ring;   // sorted by hash
+}shardMap_t;
+
+
+
+
+shardMap_t* shardmap_init(int shardNum);
+
+int shardmap_owner(shardMap_t* map, const char* file_name);
+
+fileEntry_t* shardmap_selectEntries(shardMap_t* map, int shard, fileEntry_t* head, int* num);
+
+int shardmap_mergeTable(shardMap_t* map, int shard, fileTable_t* table, fileEntry_t* entries);
+
+void shardmap_destroy(shardMap_t* map);
+
+
+#endif
@@ -0,0 +1,171 @@
+/* File: timerwheel.c
+   Description: Hierarchical timer wheel used by the tracker to detect dead peers.  Every peer
+   		owns one timer, a KEEPALIVE moves it to its new expiry in O(1) and only the timers of
+   		peers that really missed their deadline ever fire.  Unit tested in the testing directory
+   		with timerwheel_test.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "timerwheel.h"
+
+
+/**
+ * unlink a node from whatever slot it is in
+ * @param node [a scheduled node]
+ */
+static void timerwheel_unlink(timerNode_t* node) {
+  node -> prev -> next = node -> next;
+  node -> next -> prev = node -> prev;
+  node -> prev = NULL;
+  node -> next = NULL;
+}
+
+/**
+ * put a node into the slot matching its expiry relative to wheel->now
+ * a node due at wheel->now lands in the finest slot of this tick, which fires right after cascading
+ * @param wheel [the wheel]
+ * @param node  [an unlinked node, node->expire set and not before wheel->now]
+ */
+static void timerwheel_place(timerWheel_t* wheel, timerNode_t* node) {
+  unsigned long expire = node -> expire;
+
+  unsigned long delta = expire - wheel -> now;
+  int level = 0;
+  while (level < TIMERWHEEL_LEVELS - 1 && delta >= (1UL << (TIMERWHEEL_SLOT_BITS * (level + 1)))) {
+    level ++;
+  }
+
+  //beyond the top level's range: park it at the farthest slot, it cascades again from there
+  unsigned long maxDelta = (1UL << (TIMERWHEEL_SLOT_BITS * TIMERWHEEL_LEVELS)) - 1;
+  if (delta > maxDelta) expire = wheel -> now + maxDelta;
+
+  int slot = (expire >> (TIMERWHEEL_SLOT_BITS * level)) & (TIMERWHEEL_SLOTS - 1);
+  timerNode_t* head = &(wheel -> slots[level][slot]);
+  node -> prev = head -> prev;
+  node -> next = head;
+  head -> prev -> next = node;
+  head -> prev = node;
+}
+
+/**
+ * move every timer of a coarse slot down to the level matching its remaining delay
+ * @param wheel [the wheel, wheel->now already at the tick being processed]
+ * @param level [level of the slot, at least 1]
+ * @param slot  [slot index]
+ */
+static void timerwheel_cascade(timerWheel_t* wheel, int level, int slot) {
+  timerNode_t* head = &(wheel -> slots[level][slot]);
+  timerNode_t* node = head -> next;
+  head -> next = head;
+  head -> prev = head;
+  while (node != head) {
+    timerNode_t* next = node -> next;
+    timerwheel_place(wheel, node);
+    node = next;
+  }
+}
+
+/* Function to initialize an empty wheel whose current tick is now.
+
+	@return the pointer to the timerWheel_t that is created.
+*/
+timerWheel_t* timerwheel_init(unsigned long now) {
+  timerWheel_t* wheel = (timerWheel_t*) malloc(sizeof(timerWheel_t));
+  wheel -> now = now;
+  wheel -> count = 0;
+
+  int level, slot;
+  for (level = 0; level < TIMERWHEEL_LEVELS; level++) {
+    for (slot = 0; slot < TIMERWHEEL_SLOTS; slot++) {
+      timerNode_t* head = &(wheel -> slots[level][slot]);
+      head -> next = head;
+      head -> prev = head;
+    }
+  }
+  return wheel;
+}
+
+/**
+ * prepare a timer embedded in its owner, not scheduled yet
+ * @param node [the timer]
+ * @param data [the owner, handed back when the timer fires]
+ */
+void timerwheel_initNode(timerNode_t* node, void* data) {
+  memset(node, 0, sizeof(timerNode_t));
+  node -> data = data;
+}
+
+/**
+ * (re)schedule a timer to fire at tick expire, moving it if it was already scheduled
+ * @param wheel  [the wheel]
+ * @param node   [the timer]
+ * @param expire [absolute tick, a tick already passed fires on the next advance]
+ */
+void timerwheel_schedule(timerWheel_t* wheel, timerNode_t* node, unsigned long expire) {
+  if (node -> scheduled) {
+    timerwheel_unlink(node);
+  } else {
+    node -> scheduled = 1;
+    wheel -> count ++;
+  }
+  //the slot of the current tick has been processed already
+  node -> expire = (expire > wheel -> now) ? expire : wheel -> now + 1;
+  timerwheel_place(wheel, node);
+}
+
+/**
+ * stop a timer, harmless if it is not scheduled
+ * @param wheel [the wheel]
+ * @param node  [the timer]
+ */
+void timerwheel_cancel(timerWheel_t* wheel, timerNode_t* node) {
+  if (!node -> scheduled) return;
+  timerwheel_unlink(node);
+  node -> scheduled = 0;
+  wheel -> count --;
+}
+
+/**
+ * Process every tick up to now, cascading coarse slots as their time comes.
+ * @param  wheel [the wheel]
+ * @param  now   [current tick, earlier than wheel->now is ignored]
+ * @return       [list of the timers that fired (linked by next, no longer scheduled), NULL if none]
+ */
+timerNode_t* timerwheel_advance(timerWheel_t* wheel, unsigned long now) {
+  timerNode_t* expired = NULL;
+
+  while (wheel -> now < now) {
+    wheel -> now ++;
+
+    //a coarse slot comes due whenever all finer indices wrap to 0
+    int level;
+    for (level = 1; level < TIMERWHEEL_LEVELS; level++) {
+      if ((wheel -> now & ((1UL << (TIMERWHEEL_SLOT_BITS * level)) - 1)) != 0) break;
+      timerwheel_cascade(wheel, level, (wheel -> now >> (TIMERWHEEL_SLOT_BITS * level)) & (TIMERWHEEL_SLOTS - 1));
+    }
+
+    //everything in the finest slot of this tick fires
+    timerNode_t* head = &(wheel -> slots[0][wheel -> now & (TIMERWHEEL_SLOTS - 1)]);
+    while (head -> next != head) {
+      timerNode_t* node = head -> next;
+      timerwheel_unlink(node);
+      node -> scheduled = 0;
+      wheel -> count --;
+      node -> next = expired;
+      expired = node;
+    }
+  }
+  return expired;
+}
+
+/**
+ * free the wheel, the timers belong to their owners and are left alone
+ * @param wheel [the wheel]
+ */
+void timerwheel_destroy(timerWheel_t* wheel) {
+  free(wheel);
+}
@@ -0,0 +1,52 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+
+#define TIMERWHEEL_LEVELS 4
+#define TIMERWHEEL_SLOT_BITS 6
+#define TIMERWHEEL_SLOTS (1 << TIMERWHEEL_SLOT_BITS)   // slots per level, level l covers delays below SLOTS^(l+1) ticks
+
+
+
+/**
+ * one timer, embedded in whatever it times (data points back to the owner)
+ * linked into exactly one slot of the wheel while scheduled
+ */
+typedef struct timerNode{
+  unsigned long expire;        //tick the timer fires at
+  int scheduled;               //1 while linked into the wheel
+  void* data;                  //owner of the timer
+  struct timerNode* prev;
+  struct timerNode* next;      //next slot member, or next expired timer once fired
+}timerNode_t;
+
+
+
+/**
+ * hierarchical timer wheel (no locking, the owner of the wheel serializes access)
+ * scheduling and cancelling are O(1), advancing a tick only touches the slots that come due,
+ * far timers live in coarser levels and cascade down as their time approaches
+ */
+typedef struct timerWheel{
+  unsigned long now;                                       //last tick processed, every timer at or before it has fired
+  timerNode_t slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];  //sentinels of circular lists
+  int count;                                               //number of scheduled timers
+}timerWheel_t;
+
+
+
+
+timerWheel_t* timerwheel_init(unsigned long now);
+
+void timerwheel_initNode(timerNode_t* node, void* data);
+
+void timerwheel_schedule(timerWheel_t* wheel, timerNode_t* node, unsigned long expire);
+
+void timerwheel_cancel(timerWheel_t* wheel, timerNode_t* node);
+
+timerNode_t* timerwheel_advance(timerWheel_t* wheel, unsigned long now);
+
+void timerwheel_destroy(timerWheel_t* wheel);
+
+
+#endif
@@ -34,8 +34,10 @@ void *fileMonitorThread(void* arg) {
 	localFileAlerts* funcs = (localFileAlerts*)arg;
 
 	blockList = NULL;
-	//read the config file for necessary information
-	readConfigFile("./config");
+	//read the config file for necessary information, unless the client did already
+	if(!directory) {
+		readConfigFile("./config");
+	}
 
 	//check that directory was set
 	if(!directory) {
@@ -80,6 +82,14 @@ void FileMonitor_close() {
 	running = 0;
 }
 /*
+*Gets the directory watched, as read from the config file
+*
+*Returns the path, ending with '/', or NULL if no config was read
+*/
+char* FileMonitor_getDirectory() {
+	return directory;
+}
+/*
 *Gets the file info for a given filename
 *
 *@filename:the filename to return info for
@@ -129,7 +139,7 @@ int FileInfo_table_SubdirectoryFileCount(char* subdirectory_path) {
 			if(S_ISREG(entinfo.st_mode)) {
 				extension = strrchr(ent->d_name, '.');
 				if(extension) {
-					if(strcmp(extension, ".swp") == 0) {
+					if(strcmp(extension, ".swp") == 0 || strcmp(extension, PARTIAL_FILE_EXT) == 0) {
 						free(filepath);
 						continue;
 					}
@@ -174,7 +184,7 @@ int FileInfo_table_Subdirectory(FileInfo_table* allfiles, char* subdirectory_pat
 			if(S_ISREG(entinfo.st_mode)) {
 				extension = strrchr(ent->d_name, '.');
 				if(extension) {
-					if(strcmp(extension, ".swp") == 0) {
+					if(strcmp(extension, ".swp") == 0 || strcmp(extension, PARTIAL_FILE_EXT) == 0) {
 						free(filepath);
 						continue;
 					}
@@ -223,7 +233,7 @@ FileInfo_table* getAllFilesInfo() {
 			if(S_ISREG(entinfo.st_mode)) {
 				extension = strrchr(ent->d_name, '.');
 				if(extension) {
-					if(strcmp(extension, ".swp") == 0) {
+					if(strcmp(extension, ".swp") == 0 || strcmp(extension, PARTIAL_FILE_EXT) == 0) {
 						free(filepath);
 						continue;
 					}
@@ -257,7 +267,7 @@ FileInfo_table* getAllFilesInfo() {
 			if(S_ISREG(entinfo.st_mode)) {
 				extension = strrchr(ent->d_name, '.');
 				if(extension) {
-					if(strcmp(extension, ".swp") == 0) {
+					if(strcmp(extension, ".swp") == 0 || strcmp(extension, PARTIAL_FILE_EXT) == 0) {
 						free(filepath);
 						continue;
 					}
@@ -319,13 +329,12 @@ void FilesInfo_UpdateAlerts(FileInfo_table* newtable, localFileAlerts* funcs) {
 		filepath = calloc(1, (strlen(directory) + strlen(filename) + 1) * sizeof(char));
 		sprintf(filepath, "%s%s", directory, filename);
 
+		//the callbacks get the name relative to the directory, like the first table's files
 		if(FilesInfo_table_search(filename, newtable) == -1 && !FileBlockList_Search(filepath, EVENT_DELETED)) {
 			printf("File deleted: %s\n",filename);
-			funcs->fileDeleted(filepath);
-		}
-		else {
-			free(filepath);
+			funcs->fileDeleted(filename);
 		}
+		free(filepath);
 	}
 
 	for(i = 0; i < newtable->num_files; i++) {
@@ -337,15 +346,13 @@ void FilesInfo_UpdateAlerts(FileInfo_table* newtable, localFileAlerts* funcs) {
 		idx = FilesInfo_table_search(filename, ftable);
 		if(idx == -1 && !FileBlockList_Search(filepath, EVENT_ADDED)) {
 			printf("File added: %s\n",filename);
-			funcs->fileAdded(filepath);
+			funcs->fileAdded(filename);
 		}
-		else if (ftable->table[idx].lastModifyTime != newtable->table[i].lastModifyTime  && !FileBlockList_Search(filepath, EVENT_MODIFIED)) {
+		else if (idx != -1 && ftable->table[idx].lastModifyTime != newtable->table[i].lastModifyTime  && !FileBlockList_Search(filepath, EVENT_MODIFIED)) {
 			printf("File updated: %s\n",filename);
-			funcs->fileModified(filepath);
-		}
-		else {
-			free(filepath);
+			funcs->fileModified(filename);
 		}
+		free(filepath);
 	}
 
 }
@@ -366,9 +373,11 @@ void readConfigFile(char* filename) {
 	}
 	if (fgets(buf, 79, config) == NULL) {
 		printf("No line read from config file\n");
+		fclose(config);
 		return;
 	}
-	directory = calloc(1, strlen(buf) * sizeof(char));
+	buf[strcspn(buf, "\r\n")] = '\0';
+	directory = calloc(1, (strlen(buf) + 1) * sizeof(char));
 	strcpy(directory, buf);
 	fclose(config);
 }
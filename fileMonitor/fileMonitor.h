@@ -42,6 +42,12 @@ void *fileMonitorThread(void* arg);
 */
 void FileMonitor_close();
 /*
+*Gets the directory watched, as read from the config file
+*
+*Returns the path, ending with '/', or NULL if no config was read
+*/
+char* FileMonitor_getDirectory();
+/*
 *Gets the file info for a given filename
 *
 *@filename:the filename to return info for
@@ -0,0 +1,325 @@
+/* File: connpool.c
+   Description: Connections to other peers kept open between downloads, so that syncing many small files
+   		does not pay a TCP handshake and a slow start ramp for each.  A connection is leased to one
+   		download at a time, at most CONNPOOL_PER_PEER are open to a peer, idle ones are closed after
+   		a while and probed with TCP keepalive meanwhile.  Unit tested in the testing directory with
+   		connpool_test.c
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <assert.h>
+
+#include "connpool.h"
+
+
+/* monotonic time in ms */
+static unsigned long connpool_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* the connections to a peer, a new empty entry if there were none yet; entries stay until the pool is freed
+   @param  pool [the pool, its mutex held]
+   @param  ip   [the peer's address]
+   @param  port [its port]
+   @return      [the entry] */
+static poolPeer_t* connpool_peerLocked(connPool_t* pool, const char* ip, int port) {
+  poolPeer_t* peer;
+  for (peer = pool -> peers; peer != NULL; peer = peer -> next) {
+    if (peer -> port == port && strcmp(peer -> ip, ip) == 0) return peer;
+  }
+  peer = (poolPeer_t*) calloc(1, sizeof(poolPeer_t));
+  snprintf(peer -> ip, IP_LEN, "%s", ip);
+  peer -> port = port;
+  peer -> next = pool -> peers;
+  pool -> peers = peer;
+  return peer;
+}
+
+/* close a connection and free its slot
+   @param pool [the pool, its mutex held]
+   @param conn [the connection, off any idle list] */
+static void connpool_closeLocked(connPool_t* pool, poolConn_t* conn) {
+  close(conn -> fd);
+  conn -> peer -> openNum--;
+  free(conn);
+}
+
+/* whether an idle connection is still usable: the other end has not closed it, nor sent anything unasked
+   @param  fd [the connection]
+   @return    [1 if so, 0 otherwise] */
+static int connpool_alive(int fd) {
+  char c;
+  ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+/* a new connection to a peer, with the pool's timeouts, keepalive and no Nagle delay
+   @param  pool [the pool, its mutex not held]
+   @param  ip   [the peer's address]
+   @param  port [its port]
+   @return      [the socket, -1 on failure] */
+static int connpool_connect(connPool_t* pool, const char* ip, int port) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, ip, &(addr.sin_addr)) != 1) {
+    printf("%s: error: bad address %s\n", __func__, ip);
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+
+  struct timeval tv;
+  tv.tv_sec = pool -> ioTimeoutMs / 1000;
+  tv.tv_usec = (pool -> ioTimeoutMs % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  int on = 1;
+  int idle = CONNPOOL_KEEPALIVE_S;
+  int count = 3;
+  setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &idle, sizeof(idle));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+  //requests of a window go out back to back, none waits for the ack of the one before
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+  if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* close the connections idle for idleMs or more
+   @param  pool [the pool, its mutex held]
+   @param  now  [the time, in ms]
+   @return      [how many were closed] */
+static int connpool_evictLocked(connPool_t* pool, unsigned long now) {
+  int num = 0;
+  poolPeer_t* peer;
+  for (peer = pool -> peers; peer != NULL; peer = peer -> next) {
+    //most recently used first, so the ones to close are at the end
+    poolConn_t** link = &(peer -> idle);
+    while (*link != NULL && now - (*link) -> lastUsed < pool -> idleMs) {
+      link = &((*link) -> next);
+    }
+    while (*link != NULL) {
+      poolConn_t* conn = *link;
+      *link = conn -> next;
+      peer -> idleNum--;
+      connpool_closeLocked(pool, conn);
+      num++;
+    }
+  }
+  pool -> evicted += num;
+  if (num > 0) {
+    pthread_cond_broadcast(pool -> freed);
+  }
+  return num;
+}
+
+
+
+/**
+ * an empty pool
+ * @param  perPeer     [most connections open to one peer at once]
+ * @param  idleMs      [an idle connection is closed after this long, 0 to close every connection given back]
+ * @param  ioTimeoutMs [send and recv timeout of the connections]
+ * @return             [the pool, freed with connpool_destroy]
+ */
+connPool_t* connpool_init(int perPeer, unsigned long idleMs, unsigned long ioTimeoutMs) {
+  assert(perPeer > 0);
+  connPool_t* pool = (connPool_t*) calloc(1, sizeof(connPool_t));
+  pool -> perPeer = perPeer;
+  pool -> idleMs = idleMs;
+  pool -> ioTimeoutMs = ioTimeoutMs;
+  pool -> mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(pool -> mutex, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pool -> freed = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
+  pthread_cond_init(pool -> freed, &attr);
+  pthread_condattr_destroy(&attr);
+  return pool;
+}
+
+/**
+ * lease a connection to a peer: the most recently used idle one still open, a new one if there is none and
+ * fewer than perPeer are open, otherwise the first one given back within waitMs
+ * @param  pool   [the pool]
+ * @param  ip     [the peer's address]
+ * @param  port   [its port]
+ * @param  waitMs [longest wait for a connection when perPeer are leased]
+ * @param  cancel [the wait ends as soon as it is set and connpool_wake is called, atomic; NULL for none]
+ * @return        [the connection, given back with connpool_put; NULL on failure, time out or cancel]
+ */
+poolConn_t* connpool_get(connPool_t* pool, const char* ip, int port, unsigned long waitMs, const int* cancel) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += waitMs / 1000;
+  deadline.tv_nsec += (waitMs % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  pthread_mutex_lock(pool -> mutex);
+  connpool_evictLocked(pool, connpool_now());
+  poolPeer_t* peer = connpool_peerLocked(pool, ip, port);
+  while (1) {
+    while (peer -> idle != NULL) {
+      poolConn_t* conn = peer -> idle;
+      peer -> idle = conn -> next;
+      peer -> idleNum--;
+      if (!connpool_alive(conn -> fd)) {
+        pool -> broken++;
+        connpool_closeLocked(pool, conn);
+        continue;
+      }
+      conn -> next = NULL;
+      conn -> uses++;
+      pool -> reused++;
+      pool -> leased++;
+      pthread_mutex_unlock(pool -> mutex);
+      return conn;
+    }
+    if (peer -> openNum < pool -> perPeer) break;
+    if ((cancel != NULL && __atomic_load_n(cancel, __ATOMIC_ACQUIRE)) || pthread_cond_timedwait(pool -> freed, pool -> mutex, &deadline) == ETIMEDOUT) {
+      pthread_mutex_unlock(pool -> mutex);
+      return NULL;
+    }
+  }
+  //the slot is taken before connecting, outside the mutex
+  peer -> openNum++;
+  pthread_mutex_unlock(pool -> mutex);
+
+  int fd = connpool_connect(pool, ip, port);
+  pthread_mutex_lock(pool -> mutex);
+  if (fd < 0) {
+    peer -> openNum--;
+    pthread_cond_broadcast(pool -> freed);
+    pthread_mutex_unlock(pool -> mutex);
+    return NULL;
+  }
+  poolConn_t* conn = (poolConn_t*) calloc(1, sizeof(poolConn_t));
+  conn -> fd = fd;
+  conn -> peer = peer;
+  conn -> uses = 1;
+  pool -> opened++;
+  pool -> leased++;
+  pthread_mutex_unlock(pool -> mutex);
+  return conn;
+}
+
+/**
+ * give a leased connection back
+ * @param pool     [the pool]
+ * @param conn     [the connection, NULL for none]
+ * @param reusable [1 if nothing is left to read on it and it can carry the next exchange, 0 to close it]
+ */
+void connpool_put(connPool_t* pool, poolConn_t* conn, int reusable) {
+  if (conn == NULL) return;
+  pthread_mutex_lock(pool -> mutex);
+  if (reusable && pool -> idleMs > 0) {
+    conn -> lastUsed = connpool_now();
+    conn -> next = conn -> peer -> idle;
+    conn -> peer -> idle = conn;
+    conn -> peer -> idleNum++;
+  } else {
+    connpool_closeLocked(pool, conn);
+  }
+  connpool_evictLocked(pool, connpool_now());
+  pthread_cond_broadcast(pool -> freed);
+  pthread_mutex_unlock(pool -> mutex);
+}
+
+/**
+ * close the connections idle for idleMs or more; done on every connpool_get and connpool_put as well
+ * @param  pool [the pool]
+ * @param  now  [the time, monotonic in ms]
+ * @return      [how many were closed]
+ */
+int connpool_evictIdle(connPool_t* pool, unsigned long now) {
+  pthread_mutex_lock(pool -> mutex);
+  int num = connpool_evictLocked(pool, now);
+  pthread_mutex_unlock(pool -> mutex);
+  return num;
+}
+
+/**
+ * wake whoever waits in connpool_get, to see its cancel flag
+ * @param pool [the pool]
+ */
+void connpool_wake(connPool_t* pool) {
+  pthread_mutex_lock(pool -> mutex);
+  pthread_cond_broadcast(pool -> freed);
+  pthread_mutex_unlock(pool -> mutex);
+}
+
+/**
+ * the pool's counters as text, a "counter name value" or "gauge name value" line each
+ * @param  pool [the pool]
+ * @param  buf  [filled]
+ * @param  cap  [bytes in buf]
+ * @return      [length of the text, -1 if it does not fit]
+ */
+int connpool_format(connPool_t* pool, char* buf, int cap) {
+  pthread_mutex_lock(pool -> mutex);
+  int open = 0;
+  int idle = 0;
+  poolPeer_t* peer;
+  for (peer = pool -> peers; peer != NULL; peer = peer -> next) {
+    open += peer -> openNum;
+    idle += peer -> idleNum;
+  }
+  int len = snprintf(buf, cap,
+    "counter connections_opened %ld\ncounter connections_leased %ld\ncounter connections_reused %ld\n"
+    "counter connections_evicted %ld\ncounter connections_broken %ld\n"
+    "gauge connections_open %d\ngauge connections_idle %d\ngauge connection_reuse_pct %ld\n",
+    pool -> opened, pool -> leased, pool -> reused, pool -> evicted, pool -> broken,
+    open, idle, (pool -> leased > 0) ? pool -> reused * 100 / pool -> leased : 0);
+  pthread_mutex_unlock(pool -> mutex);
+  return len < cap ? len : -1;
+}
+
+/**
+ * close every idle connection and free the pool, no connection may be leased
+ * @param pool [the pool, may be NULL]
+ */
+void connpool_destroy(connPool_t* pool) {
+  if (pool == NULL) return;
+  while (pool -> peers != NULL) {
+    poolPeer_t* peer = pool -> peers;
+    while (peer -> idle != NULL) {
+      poolConn_t* conn = peer -> idle;
+      peer -> idle = conn -> next;
+      close(conn -> fd);
+      free(conn);
+    }
+    pool -> peers = peer -> next;
+    free(peer);
+  }
+  pthread_mutex_destroy(pool -> mutex);
+  free(pool -> mutex);
+  pthread_cond_destroy(pool -> freed);
+  free(pool -> freed);
+  free(pool);
+}
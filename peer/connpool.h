@@ -0,0 +1,72 @@
+#ifndef CONNPOOL_H
+#define CONNPOOL_H
+
+#include "../common/constants.h"
+#include <pthread.h>
+
+
+#define CONNPOOL_PER_PEER 4          // most connections open to one peer at once
+#define CONNPOOL_IDLE_MS 10000       // an idle connection is closed after this long, before the other end gives up on it
+#define CONNPOOL_KEEPALIVE_S 5       // TCP keepalive probes go out on a connection quiet for this long
+
+
+/* a connection to a peer, leased to one user at a time */
+typedef struct poolConn{
+  int fd;
+  struct poolPeer* peer;
+  unsigned long lastUsed;      // in ms, when it was last given back
+  long uses;                   // times it was leased
+  struct poolConn* next;       // in its peer's idle list
+}poolConn_t;
+
+
+/* the connections to one peer */
+typedef struct poolPeer{
+  char ip[IP_LEN];
+  int port;
+  poolConn_t* idle;            // the ones not leased, most recently used first
+  int idleNum;
+  int openNum;                 // idle, leased, or being connected
+  struct poolPeer* next;
+}poolPeer_t;
+
+
+/**
+ * connections to other peers kept open between uses, at most perPeer to each
+ * A connection is leased whole (every message of a download goes over it in order), then given back and
+ * leased again for the next file to that peer, which skips the handshake and the slow start ramp.  One idle
+ * for longer than idleMs, or closed by the other end meanwhile, is closed instead of leased
+ */
+typedef struct connPool{
+  poolPeer_t* peers;
+  int perPeer;
+  unsigned long idleMs;
+  unsigned long ioTimeoutMs;   // send and recv timeout set on every connection
+  pthread_mutex_t* mutex;
+  pthread_cond_t* freed;       // signalled when a connection is given back or closed
+  long opened;                 // connections made
+  long leased;                 // leases, connections made or reused
+  long reused;                 // leases of an idle connection
+  long evicted;                // idle connections closed for being idle too long
+  long broken;                 // idle connections found closed by the other end
+}connPool_t;
+
+
+
+
+connPool_t* connpool_init(int perPeer, unsigned long idleMs, unsigned long ioTimeoutMs);
+
+poolConn_t* connpool_get(connPool_t* pool, const char* ip, int port, unsigned long waitMs, const int* cancel);
+
+void connpool_put(connPool_t* pool, poolConn_t* conn, int reusable);
+
+int connpool_evictIdle(connPool_t* pool, unsigned long now);
+
+void connpool_wake(connPool_t* pool);
+
+int connpool_format(connPool_t* pool, char* buf, int cap);
+
+void connpool_destroy(connPool_t* pool);
+
+
+#endif
@@ -0,0 +1,252 @@
+/* File: filecache.c
+   Description: Files kept open for serving their pieces to other peers, so that a piece costs one sendfile or
+   		pread at its offset rather than an open, a stat and a close.  A file is cached under its path
+   		and its last modification time, and dropped when the file monitor reports it changed or when
+   		its path is found to name something else.  At most FILECACHE_MAX_FILES are kept, the least
+   		recently used is closed first.  Unit tested in the testing directory with filecache_test.c
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "filecache.h"
+
+
+/* monotonic time in ms */
+static unsigned long filecache_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* whether a stat of the path names the file opened, unmodified
+   @param  file [the file]
+   @param  st   [the path's stat]
+   @return      [1 if so, 0 otherwise] */
+static int filecache_same(cachedFile_t* file, struct stat* st) {
+  return file -> dev == st -> st_dev && file -> ino == st -> st_ino && file -> size == st -> st_size
+    && file -> mtime.tv_sec == st -> st_mtim.tv_sec && file -> mtime.tv_nsec == st -> st_mtim.tv_nsec;
+}
+
+/* close a file and free it
+   @param file [the file, out of the cache, no lease out] */
+static void filecache_free(cachedFile_t* file) {
+  close(file -> fd);
+  free(file -> path);
+  free(file);
+}
+
+/* unlink a file from the cache's list
+   @param cache [the cache, its mutex held]
+   @param file  [the file, in the list] */
+static void filecache_unlinkLocked(fileCache_t* cache, cachedFile_t* file) {
+  if (file -> prev != NULL) file -> prev -> next = file -> next;
+  else cache -> files = file -> next;
+  if (file -> next != NULL) file -> next -> prev = file -> prev;
+  else cache -> last = file -> prev;
+  file -> prev = file -> next = NULL;
+}
+
+/* link a file first in the cache's list
+   @param cache [the cache, its mutex held]
+   @param file  [the file, out of the list] */
+static void filecache_pushLocked(fileCache_t* cache, cachedFile_t* file) {
+  file -> next = cache -> files;
+  if (cache -> files != NULL) cache -> files -> prev = file;
+  else cache -> last = file;
+  cache -> files = file;
+}
+
+/* take a file out of the cache, closing it unless a lease is out
+   @param cache [the cache, its mutex held]
+   @param file  [the file, in the cache] */
+static void filecache_dropLocked(fileCache_t* cache, cachedFile_t* file) {
+  filecache_unlinkLocked(cache, file);
+  file -> cached = 0;
+  cache -> num--;
+  if (file -> refs == 0) {
+    filecache_free(file);
+  }
+}
+
+/* the file cached under a path
+   @param  cache [the cache, its mutex held]
+   @param  path  [the path]
+   @return       [the file, NULL if none is] */
+static cachedFile_t* filecache_findLocked(fileCache_t* cache, const char* path) {
+  cachedFile_t* file;
+  for (file = cache -> files; file != NULL; file = file -> next) {
+    if (strcmp(file -> path, path) == 0) return file;
+  }
+  return NULL;
+}
+
+
+
+/**
+ * an empty cache
+ * @param  maxFiles [most files kept open]
+ * @param  checkMs  [a file kept open is checked against its path at most this often, 0 for on every lease]
+ * @return          [the cache, freed with filecache_destroy]
+ */
+fileCache_t* filecache_init(int maxFiles, unsigned long checkMs) {
+  assert(maxFiles > 0);
+  fileCache_t* cache = (fileCache_t*) calloc(1, sizeof(fileCache_t));
+  cache -> maxFiles = maxFiles;
+  cache -> checkMs = checkMs;
+  cache -> mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(cache -> mutex, NULL);
+  return cache;
+}
+
+/**
+ * lease a regular file open for reading: the one cached under its path if it is still what the path names,
+ * otherwise the path opened now, and cached
+ * @param  cache [the cache]
+ * @param  path  [the file]
+ * @return       [the file, its fd read with pread or sendfile only, given back with filecache_release;
+ *                NULL if it cannot be opened or is not a regular file]
+ */
+cachedFile_t* filecache_open(fileCache_t* cache, const char* path) {
+  pthread_mutex_lock(cache -> mutex);
+  cachedFile_t* file = filecache_findLocked(cache, path);
+  if (file != NULL) {
+    unsigned long now = filecache_now();
+    struct stat st;
+    if (now - file -> checked >= cache -> checkMs) {
+      if (stat(path, &st) == 0 && filecache_same(file, &st)) {
+        file -> checked = now;
+      } else {
+        cache -> invalidated++;
+        cache -> generation++;
+        filecache_dropLocked(cache, file);
+        file = NULL;
+      }
+    }
+  }
+  if (file != NULL) {
+    filecache_unlinkLocked(cache, file);
+    filecache_pushLocked(cache, file);
+    file -> refs++;
+    cache -> hits++;
+    pthread_mutex_unlock(cache -> mutex);
+    return file;
+  }
+  long generation = cache -> generation;
+  pthread_mutex_unlock(cache -> mutex);
+
+  //opened outside the mutex, leases of other files go on meanwhile
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return NULL;
+  }
+  file = (cachedFile_t*) calloc(1, sizeof(cachedFile_t));
+  file -> path = strdup(path);
+  file -> fd = fd;
+  file -> size = st.st_size;
+  file -> mtime = st.st_mtim;
+  file -> dev = st.st_dev;
+  file -> ino = st.st_ino;
+  file -> checked = filecache_now();
+  file -> refs = 1;
+
+  pthread_mutex_lock(cache -> mutex);
+  cache -> misses++;
+  //a change reported while it was being opened may be to this very file: it is leased once, not cached
+  if (cache -> generation == generation) {
+    cachedFile_t* other = filecache_findLocked(cache, path);
+    if (other != NULL) {
+      filecache_dropLocked(cache, other);
+    }
+    filecache_pushLocked(cache, file);
+    file -> cached = 1;
+    cache -> num++;
+    while (cache -> num > cache -> maxFiles) {
+      cache -> evicted++;
+      filecache_dropLocked(cache, cache -> last);
+    }
+  }
+  pthread_mutex_unlock(cache -> mutex);
+  return file;
+}
+
+/**
+ * give a leased file back
+ * @param cache [the cache]
+ * @param file  [the file, NULL for none]
+ */
+void filecache_release(fileCache_t* cache, cachedFile_t* file) {
+  if (file == NULL) return;
+  pthread_mutex_lock(cache -> mutex);
+  assert(file -> refs > 0);
+  file -> refs--;
+  if (file -> refs == 0 && !file -> cached) {
+    filecache_free(file);
+  }
+  pthread_mutex_unlock(cache -> mutex);
+}
+
+/**
+ * drop the file cached under a path, the file at the path having changed or gone; leases out keep it open
+ * @param  cache [the cache]
+ * @param  path  [the path]
+ * @return       [1 if a file was cached under it, 0 otherwise]
+ */
+int filecache_invalidate(fileCache_t* cache, const char* path) {
+  pthread_mutex_lock(cache -> mutex);
+  cache -> generation++;
+  cachedFile_t* file = filecache_findLocked(cache, path);
+  if (file != NULL) {
+    cache -> invalidated++;
+    filecache_dropLocked(cache, file);
+  }
+  pthread_mutex_unlock(cache -> mutex);
+  return file != NULL;
+}
+
+/**
+ * the cache's counters as text, a "counter name value" or "gauge name value" line each
+ * @param  cache [the cache]
+ * @param  buf   [filled]
+ * @param  cap   [bytes in buf]
+ * @return       [length of the text, -1 if it does not fit]
+ */
+int filecache_format(fileCache_t* cache, char* buf, int cap) {
+  pthread_mutex_lock(cache -> mutex);
+  int len = snprintf(buf, cap,
+    "counter open_file_hits %ld\ncounter open_file_misses %ld\ncounter open_files_invalidated %ld\n"
+    "counter open_files_evicted %ld\ngauge open_files %d\n",
+    cache -> hits, cache -> misses, cache -> invalidated, cache -> evicted, cache -> num);
+  pthread_mutex_unlock(cache -> mutex);
+  return len < cap ? len : -1;
+}
+
+/**
+ * close every file and free the cache, no file may be leased
+ * @param cache [the cache, may be NULL]
+ */
+void filecache_destroy(fileCache_t* cache) {
+  if (cache == NULL) return;
+  while (cache -> files != NULL) {
+    cachedFile_t* file = cache -> files;
+    assert(file -> refs == 0);
+    cache -> files = file -> next;
+    filecache_free(file);
+  }
+  pthread_mutex_destroy(cache -> mutex);
+  free(cache -> mutex);
+  free(cache);
+}
@@ -0,0 +1,66 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+
+
+#define FILECACHE_MAX_FILES 64       // most files kept open
+#define FILECACHE_CHECK_MS 1000      // a file kept open is checked against its path at most this often, between file monitor alerts
+
+
+/* a file kept open for reading, leased to any number of users at once */
+typedef struct cachedFile{
+  char* path;
+  int fd;
+  long size;                   // when opened
+  struct timespec mtime;       // when opened: with the path, what the file is cached under
+  dev_t dev;
+  ino_t ino;
+  unsigned long checked;       // in ms, when it was last found to still be what the path names
+  int refs;                    // leases out
+  int cached;                  // still in the cache: closed once it is not and no lease is out
+  struct cachedFile* prev;
+  struct cachedFile* next;     // in the cache, most recently used first
+}cachedFile_t;
+
+
+/**
+ * files kept open for serving their pieces, at most maxFiles
+ * A piece is read with a single sendfile or pread at its offset in a file leased from here, instead of opening
+ * the file for every piece.  A file is cached under its path and its last modification time: it is dropped
+ * when transfer_fileChanged is told of a change (by the file monitor), or once the path is found to name
+ * another file, or the same one modified, checked at most every checkMs.  Leases out keep a dropped file open
+ */
+typedef struct fileCache{
+  cachedFile_t* files;
+  cachedFile_t* last;          // least recently used
+  int num;
+  int maxFiles;
+  unsigned long checkMs;
+  pthread_mutex_t* mutex;
+  long hits;                   // leases of a file open already
+  long misses;                 // leases that opened the file
+  long invalidated;            // files dropped for being changed
+  long evicted;                // files dropped for being the least recently used of maxFiles
+  long generation;             // bumped on every invalidation, a file opened across one is not cached
+}fileCache_t;
+
+
+
+
+fileCache_t* filecache_init(int maxFiles, unsigned long checkMs);
+
+cachedFile_t* filecache_open(fileCache_t* cache, const char* path);
+
+void filecache_release(fileCache_t* cache, cachedFile_t* file);
+
+int filecache_invalidate(fileCache_t* cache, const char* path);
+
+int filecache_format(fileCache_t* cache, char* buf, int cap);
+
+void filecache_destroy(fileCache_t* cache);
+
+
+#endif
@@ -4,6 +4,8 @@
 //
 //Date: May 22, 2015
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -17,36 +19,44 @@
 #include <sys/utsname.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <limits.h>
 
 #include "../common/constants.h"
 #include "../common/pkt.h"
 #include "../common/filetable.h"
-#include "../commom/peertable.h"
+#include "../common/filedelta.h"
+#include "../common/shardmap.h"
+#include "../fileMonitor/fileMonitor.h"
+#include "peer.h"
 #include "peer_helpers.h"
+#include "transfer.h"
 
 
 
 // Globals Variables
-int tracker_connection;     // socket connection between peer and tracker so can send / receive between the two
+int* tracker_connections;   // socket connection between peer and each tracker shard so can send / receive between the two
+shardMap_t* shardMap;       // which tracker shard owns each file, its shardNum is the number of shards
 int keep_alive_interval;
 int piece_length;
+char* shared_dir;           // the directory synced, from the config file, ending with '/'
 
 fileTable_t* filetable;     //local file table to keep track of files in the directory
-peerTable_t* peertable;     //peer table to keep track of ongoing downloading tasks
+fileDeltaLog_t** filetableLogs; //changes to the local files each shard owns it has not acknowledged yet
+fileTable_t* trackerFiletable; //our copy of the tracker's file table, merged from every shard's snapshots and deltas
+pthread_mutex_t tracker_view_mutex = PTHREAD_MUTEX_INITIALIZER; //held while a shard's update is applied to trackerFiletable and acted on
+unsigned long* trackerEpochs; //epoch of each shard's table trackerFiletable reflects
+peerIdMap_t* peerIds;       //ids of ourselves and of the peers the tracker lists as holders
+transfer_t* transfer;       //downloads files from every peer holding them, serves ours to the others
 
 
-//Function to connect the peer to the tracker on the HANDSHAKE Port.
+//Function to connect the peer to a tracker shard on its port (basePort + shard, see main).
 // Returns -1 if it failed to connect.  Otherwise, returns the sockfd
-int connect_to_tracker() {
+int connect_to_tracker(char* hostname, int port) {
   int tracker_connection;
   struct sockaddr_in servaddr;
   struct hostent *hostInfo;
 
-  //Get the host name by requesting user input and check if valid
-  char hostname[MAX_HOSTNAME_SIZE];
-  printf("Enter hostname of the tracker to connect to:");
-  scanf("%s",hostname);
-
   hostInfo = gethostbyname(hostname);
   if (!hostInfo) {
     printf("Error with the hostname of the tracker!\n");
@@ -56,7 +66,7 @@ int connect_to_tracker() {
   // Set up the tracker address info so we can connect to it
   servaddr.sin_family = hostInfo->h_addrtype;  
   memcpy((char *) &servaddr.sin_addr.s_addr, hostInfo->h_addr_list[0], hostInfo->h_length);
-  servaddr.sin_port = htons(TRACKER_PEER_PORT);
+  servaddr.sin_port = htons(port);
 
   // Create socket on local host to connect to the tracker
   tracker_connection = socket(AF_INET, SOCK_STREAM, 0);  
@@ -73,187 +83,278 @@ int connect_to_tracker() {
   return tracker_connection; 
 }
 
-//Thread to listen for messages from the tracker.  Upon receiving messages from the tracker, it looks
-// to sync the local files with the tracker file knowledge, creating download threads as necessary.
-void* tracker_listening(void* arg) {
-
-  ptp_tracker_t* pkt = malloc(sizeof(ptp_tracker_t));
+//Function to check that the tracker answering on a shard's port is that shard of a tracker split into as many
+// shards as we split our files into, any other one would be sent files it does not own.
+// Returns 1 if it is, 0 otherwise
+int tracker_is_shard(int shard, ptp_tracker_t* pkt) {
+  if (pkt -> shard == shard && pkt -> shardNum == shardMap -> shardNum) return 1;
+  printf("Tracker on the port of shard %d of %d is shard %d of %d\n", shard, shardMap -> shardNum, pkt -> shard, pkt -> shardNum);
+  return 0;
+}
 
-  //continuously receive packets from the tracker
-  while(pkt_peer_recvPkt(tracker_connection, pkt) < 0) {
+//Function to bring our copy of the tracker's file table up to date with a TRACKER_FILETABLE snapshot
+// or a TRACKER_DELTA from one shard, then acknowledge the shard's epoch so its later broadcasts only carry newer changes.
+// The shards own disjoint sets of files, so each one's update only touches its own part of the view.
+// The packet's lists are consumed.  Returns the shard's files the update took out of the view, as they were
+// listed before (NULL if none), to be freed with filetable_freeList
+fileEntry_t* apply_tracker_update(int shard, ptp_tracker_t* pkt) {
+  if (pkt -> type != TRACKER_FILETABLE && pkt -> type != TRACKER_DELTA) return NULL;
+
+  int num;
+  pthread_mutex_lock(trackerFiletable -> filetable_mutex);
+  fileEntry_t* before = shardmap_selectEntries(shardMap, shard, trackerFiletable -> head, &num);
+  pthread_mutex_unlock(trackerFiletable -> filetable_mutex);
+
+  if (pkt -> type == TRACKER_FILETABLE) {
+    //a snapshot replaces the shard's part of the view
+    shardmap_mergeTable(shardMap, shard, trackerFiletable, pkt -> filetableHeadPtr);
+    pkt -> filetableHeadPtr = NULL;
+  }
+  else {
+    filedelta_apply(trackerFiletable, pkt -> deltaHeadPtr);
+    filedelta_freeList(pkt -> deltaHeadPtr);
+    pkt -> deltaHeadPtr = NULL;
+  }
 
-    //extract the file table from the packet from the tracker
-    fileTable_t* master_ft = pkt -> file_table;
+  //keep only the files no longer there
+  fileEntry_t dummy;
+  dummy.next = NULL;
+  fileEntry_t* tail = &dummy;
+  fileEntry_t* iter = before;
+  while (iter != NULL) {
+    fileEntry_t* next = iter -> next;
+    if (filetable_searchFileByName(trackerFiletable, iter -> file_name) == NULL) {
+      iter -> next = NULL;
+      tail -> next = iter;
+      tail = iter;
+    } else {
+      filetable_freeEntry(iter);
+    }
+    iter = next;
+  }
 
-    //loop through the master file table to see which files need to be synchronized locally
-    fileEntry_t* file = master_ft -> head;
-    while (file != NULL) {
+  if (pkt -> epoch > trackerEpochs[shard]) trackerEpochs[shard] = pkt -> epoch;
+  send_epoch_ack_packet(tracker_connections[shard], trackerEpochs[shard]);
+  return dummy.next;
+}
 
-      //check to see if the file exists locally
-      fileEntry_t* local_file = filetable_searchFileByName(filetable, file -> name); 
-      
-      // download the updated file if the local file does not exist or the local file is outdated
-      if(local_file == NULL || (file -> timestamp) > (local_file -> timestamp) ) { 
-        //TODO make sure that the file is not already being downloaded and if not, add to the peer table
-        pthread_t p2p_download_thread;
-        pthread_create(&p2p_download_thread, NULL, p2p_download, file);
+//Function to bring the local directory in line with our copy of the tracker's file table: files the tracker has
+// a newer version of, or that we lack, are downloaded; files it stopped listing (in gone) are deleted, unless ours
+// is newer than the version it listed, which the tracker has yet to hear about.  The file monitor then reports
+// what changed, which updates the local file table and tells the tracker.  The caller holds tracker_view_mutex
+void sync_with_tracker(fileEntry_t* gone) {
+  //loop through the master file table to see which files need to be synchronized locally
+  fileEntry_t* file = trackerFiletable -> head;
+  while (file != NULL) {
+
+    //check to see if the file exists locally
+    fileEntry_t* local_file = filetable_searchFileByName(filetable, file -> file_name);
+
+    // download the updated file if the local file does not exist or the local file is outdated
+    if (local_file == NULL || (file -> timestamp) > (local_file -> timestamp)) {
+      //the download gets a copy, the table may change under it; the same file twice at a time is refused
+      fileEntry_t* copy = malloc(sizeof(fileEntry_t));
+      memcpy(copy, file, sizeof(fileEntry_t));
+      filetable_retainHolders(copy);
+      copy -> next = NULL;
+      pthread_t p2p_download_thread;
+      if (pthread_create(&p2p_download_thread, NULL, p2p_download, copy) == 0) {
+        pthread_detach(p2p_download_thread);
+      } else {
+        filetable_freeEntry(copy);
       }
-
-      file = file -> next;  //move to next item in file table from tracker
     }
 
-    //Delete files that are in local table, but not in the file table from the tracker
-    file = filetable -> head;
-    while (file != NULL) {
-
-      //check to see if the local file exists in the tracker table
-      fileEntry_t* master_file = filetable_searchFileByName(master_ft, file -> name);
+    file = file -> next;  //move to next item in file table from tracker
+  }
 
-      //if the file is not in the master file table and is locally, then delete it
-      if (master_file == NULL) {
+  //Delete the files the tracker stopped listing
+  for (file = gone; file != NULL; file = file -> next) {
+    fileEntry_t* local_file = filetable_searchFileByName(filetable, file -> file_name);
+    if (local_file == NULL || local_file -> timestamp > file -> timestamp) continue;
 
-         if( remove(file -> name) == 0) {
-          printf("Successfully removed the file in filesystem: %s \n", file -> name);
-          file = file -> next;
-          filetable_deleteFileEntryByName(filetable, char* filename);
-         }
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", shared_dir, file -> file_name);
+    if (remove(path) == 0) {
+      printf("Successfully removed the file in filesystem: %s \n", file -> file_name);
+    }
+    else {
+      printf("Error in removing the file from the file system.\n");
+    }
+  }
+}
 
-         else{
-          file = file -> next;
-          printf("Error in removing the file from the file system.\n");
-         }
+//Function to register with a shard when we already have files it owns (e.g. after a restart).  Rather than
+// receiving the shard's whole table and sending ours back, the two compare Merkle trees of their tables and only
+// exchange the files under the subtrees that differ (see merkle.h).  Our copy of the shard's table starts out as
+// our own files, the parts we settle are replaced by what the shard has there.
+// Returns 1 once the exchange is over, 0 if we have no files the shard owns (plain REGISTER), -1 on failure
+int merkle_join(int shard) {
+  int size;
+  pthread_mutex_lock(filetable -> filetable_mutex);
+  fileEntry_t* owned = shardmap_selectEntries(shardMap, shard, filetable -> head, &size);
+  unsigned long version = filetableLogs[shard] -> version;
+  pthread_mutex_unlock(filetable -> filetable_mutex);
+  if (size == 0) return 0;
+
+  int copies;
+  shardmap_mergeTable(shardMap, shard, trackerFiletable, shardmap_selectEntries(shardMap, shard, owned, &copies));
+  merkleTree_t* tree = merkle_build(owned);
+  merkleNode_t* nodes = malloc(sizeof(merkleNode_t));
+  merkle_node(tree, MERKLE_ROOT, &nodes[0]);
+  int num = 1;
+  int type = REGISTER;
+  int ret = 1;
+
+  ptp_tracker_t* reply = calloc(1, sizeof(ptp_tracker_t));
+  while (num > 0) {
+    if (send_merkle_sync_packet(tracker_connections[shard], type, shard, shardMap -> shardNum, version, tree, nodes, num, peerIds) < 0
+        || pkt_peer_recvPkt(tracker_connections[shard], reply, peerIds) < 0 || reply -> type != TRACKER_MERKLE
+        || !tracker_is_shard(shard, reply)) {
+      ret = -1;
+      break;
+    }
+    keep_alive_interval = reply -> heartbeatinterval;
+    piece_length = reply -> piece_len;
+    trackerEpochs[shard] = reply -> epoch;
+
+    //the shard's files under the settled nodes replace ours
+    int i, j;
+    for (i = 0; i < reply -> nodesize; i++) {
+      if (reply -> nodes[i].count != MERKLE_SETTLE) continue;
+      int entryNum;
+      fileEntry_t** entries = merkle_nodeEntries(tree, reply -> nodes[i].id, &entryNum);
+      for (j = 0; j < entryNum; j++) {
+        filetable_deleteFileEntryByName(trackerFiletable, entries[j] -> file_name);
       }
     }
+    fileEntry_t* iter = reply -> filetableHeadPtr;
+    while (iter != NULL) {
+      fileEntry_t* next = iter -> next;
+      filetable_deleteFileEntryByName(trackerFiletable, iter -> file_name);
+      filetable_appendFileEntry(trackerFiletable, iter);
+      iter = next;
+    }
+    reply -> filetableHeadPtr = NULL;
+
+    //what still differs is asked about in the next round, nothing left means the shard is done as well
+    int settled;
+    merkleNode_t* next = malloc((reply -> nodesize * MERKLE_FANOUT + 1) * sizeof(merkleNode_t));
+    num = merkle_step(tree, reply -> nodes, reply -> nodesize, next, &settled);
+    free(nodes);
+    nodes = next;
+    free(reply -> nodes);
+    reply -> nodes = NULL;
+    type = MERKLE_SYNC;
   }
 
-  free(pkt);
-  pthread_exit(NULL);
+  //the shard acknowledges our version once it is done, and broadcasts what changed since we registered
+  free(reply);
+  free(nodes);
+  merkle_destroy(tree);
+  filetable_freeList(owned);
+  return ret;
 }
 
+//Thread to listen for messages from one tracker shard (the shard number is the argument).  Upon receiving
+// messages from the shard, it looks to sync the local files with the tracker file knowledge, creating
+// download threads as necessary.
+void* tracker_listening(void* arg) {
+  int shard = (int) (intptr_t) arg;
 
-// Thread to listen on the P2P port for download requests from other peers to spawn upload threads.
-// First initializes a port to listen for requests to connect to it and then listens.
-void* p2p_listening(void* arg) {
-  
-  //Set up the socket for listening
-  int peer_sockfd;
-  struct sockaddr_in local_peer_addr;
-
-  struct sockaddr_in other_peer_addr;
-  socklen_t other_peer_addr_len;
-
-  peer_sockfd = socket(AF_INET, SOCK_STREAM, 0); 
-  if (peer_sockfd < 0) {
-    pthread_exit(NULL);
-  }
+  ptp_tracker_t* pkt = pkt_create_trackerPkt();
 
-  //Set up the local addr info
-  memset(&local_peer_addr, 0, sizeof(local_peer_addr));
-  local_peer_addr.sin_family = AF_INET;
-  local_peer_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-  local_peer_addr.sin_port = htons(P2P_PORT);
+  //continuously receive packets from the shard
+  while(pkt_peer_recvPkt(tracker_connections[shard], pkt, peerIds) > 0) {
 
-  //Attempt to bind the socket
-  if (bind (peer_sockfd, (struct sockaddr *)&local_peer_addr, sizeof(local_peer_addr)) < 0){
-    printf("Failed to bind.\n");
-    pthread_exit(NULL);
-  }
-
-  //Attempt to set up socket for listening
-  if (listen (peer_sockfd, MAX_NUM_PEERS) < 0) {
-    printf("Failed to listen.\n");
-    pthread_exit(NULL);
-  }
-  
-  //Start infinite loop waiting to accept connections from peers.
-  //When a peer connects, we create a upload thread to handle that connection.  
-  while(1) {
-    int peer_conn;
+    //the shard applied our changes up to ackVersion, they no longer need to be sent
+    if (pkt -> type == TRACKER_ACK) {
+      filedelta_ack(filetableLogs[shard], pkt -> ackVersion);
+      continue;
+    }
 
-    peer_conn = accept(peer_sockfd, (struct sockaddr*) &other_peer_addr, &other_peer_addr_len);
-    printf("Established a connection to a peer. Starting a P2PDownload Thread.\n");
+    //the shard missed some of our changes, send the files it owns once
+    if (pkt -> type == TRACKER_RESYNC) {
+      send_file_update_packet(tracker_connections[shard], shardMap, shard, filetable, filetableLogs[shard], peerIds, 1);
+      continue;
+    }
 
-    //start the p2p_download_thread
-    pthread_t p2p_upload_thread;
-    pthread_create(&p2p_upload_thread, NULL, p2p_upload, &peer_conn);
+    //bring our copy of the tracker's file table up to date, and the local files with it
+    pthread_mutex_lock(&tracker_view_mutex);
+    fileEntry_t* gone = apply_tracker_update(shard, pkt);
+    sync_with_tracker(gone);
+    pthread_mutex_unlock(&tracker_view_mutex);
+    filetable_freeList(gone);
+    filetable_freeList(pkt -> filetableHeadPtr);
+    pkt -> filetableHeadPtr = NULL;
+    free(pkt -> nodes);
+    pkt -> nodes = NULL;
   }
 
+  printf("Lost the connection to tracker shard %d.\n", shard);
+  free(pkt);
   pthread_exit(NULL);
 }
 
 
-/* Thread to download a file from a peer.  First establishes the connecting with a peer.
-   Then, sends a file_metadata_t to the peer to let it know the name of the file it needs to download.
-   Next, it receives a file_metadata_t from the peer to let it know its about to receive the data and containing 
-   information about the start and send_size as well as the file name.  Then, it receives the file and closes
-   the connection */
+/* Thread to download a file from the peers holding it.  Every holder but ourselves is a provider, the pieces
+   come from all of them at once (see transfer.h); the argument is a copy of the tracker's entry, freed here.
+   The file is written with the tracker's timestamp, so once the file monitor reports it, the tracker takes us
+   as one more holder of that version */
 void* p2p_download(void* arg) {
   fileEntry_t* file = (fileEntry_t*) arg;
 
-  struct sockaddr_in servaddr;
-  servaddr.sin_family = AF_INET;
-  servaddr.sin_addr.s_addr = inet_addr(file -> iplist[0]);      //just use the first ip in the list
-  servaddr.sin_port = htons(PTP_PORT);
-
-  int peer_conn = socket(AF_INET, SOCK_STREAM, 0);  
-
-  if(peer_conn < 0) {
-    printf("Error creating socket in p2p download.\n");
-    return -1;
+  char my_ip[IP_LEN];
+  get_my_ip(my_ip);
+  transferProvider_t providers[TRANSFER_MAX_PROVIDERS];
+  int num = 0;
+  int id;
+  for (id = filetable_nextHolder(file, 0); id >= 0 && num < TRANSFER_MAX_PROVIDERS; id = filetable_nextHolder(file, id + 1)) {
+    if (peerid_getIp(peerIds, id, providers[num].ip) < 0 || strcmp(providers[num].ip, my_ip) == 0) continue;
+    providers[num].port = P2P_PORT;
+    num++;
   }
 
-  if( connect(peer_conn, (struct sockaddr*)&servaddr, sizeof(servaddr)) < 0){
-    printf("Failed to connect ot local ON process.\n");
-    return -1;
+  //only we hold it: deleted here, and the tracker has not heard yet
+  if (num == 0) {
+    filetable_freeEntry(file);
+    pthread_exit(NULL);
   }
 
-  printf("Connected to a peer upload thread.\n");
-
-  //Download data from the peer
-  //Send the name of the file you need to download
-  file_metadata_t* meta_info  = send_meta_data_info(peer_conn, file -> name, 0, 0);
-  free(metadata);
-
-  //Recv the file
-  file_metadata_t* metadata = calloc(1, sizeof(file_metadata_t));
-  int ret1 = receive_meta_data_info(connfd, metadata);
-  int ret2 = receive_data_p2p(connfd, metadata);
-  printf("Ret1: %d    Ret2: %d \n", ret1, ret2);
-  free(metadata);
-
-  //TODO
-  //handshake with the tracker
-  //send the filetable so that I can be added to the iplist[0]
-
-  //TODO
-  //remove this from the peer table so know that the download is completed
-  //close the connection
+  if (transfer_download(transfer, file -> file_name, file -> size, file -> timestamp, providers, num) > 0) {
+    printf("Downloaded %s from %d peers.\n", file -> file_name, num);
+  } else {
+    printf("Failed to download %s.\n", file -> file_name);
+  }
 
-  close(peer_conn);
+  filetable_freeEntry(file);
   pthread_exit(NULL);
 }
 
 
-/* Thread to upload a file to a peer. First accepts the connection from a peer.
-   Then, receives a file_metadata_t from the peer to let it know the name of the file it needs to upload.
-   Next, it sends a file_metadata_t to the peer to let it know its about to send the data and containing 
-   information about the start and send_size as well as the file name.  Then, it sends the file and closes
-   the connection */
-void* p2p_upload(void* arg) {
-  int peer_conn = *(int*) arg;  //gonna be casting issue here
-  
-  //get the filename of the file to send  
-  file_metadata_t* recv_metadata = malloc(sizeof(file_metadata_t));
-  receive_meta_data_info(peer_conn, recv_metadata);
-
-  //Sending a file p2p 
-  printf("Sending a File: %s \n"recv_metadata -> filename);
-  file_metadata_t* metadata = send_meta_data_info(peer_conn, recv_metadata -> filename, 0, get_file_size(recv_metadata -> filename));
-  send_data_p2p(tracker_connection, metadata);
-  free(metadata);
-  free(recv_metadata);
-  close(peer_conn);
-  pthread_exit(NULL);
+//Function to fill the local file table with the files in the directory, before we register: a tracker
+// that knows some of them already only needs the ones that differ.  Returns the number of files
+int load_local_files() {
+  FileInfo_table* files = getAllFilesInfo();
+  if (files == NULL) return 0;
+
+  char my_ip[IP_LEN];
+  get_my_ip(my_ip);
+  int myId = peerid_intern(peerIds, my_ip);
+  int i;
+  for (i = 0; i < files -> num_files; i++) {
+    fileEntry_t* newEntryPtr = calloc(1, sizeof(fileEntry_t));
+    snprintf(newEntryPtr -> file_name, FILE_NAME_MAX_LEN, "%s", files -> table[i].filepath);
+    newEntryPtr -> size = files -> table[i].size;
+    newEntryPtr -> timestamp = files -> table[i].lastModifyTime;
+    filetable_addHolder(newEntryPtr, myId, filetable -> filetable_mutex);
+    filetable_appendFileEntry(filetable, newEntryPtr);
+    free(files -> table[i].filepath);
+  }
+  int num = files -> num_files;
+  free(files -> table);
+  free(files);
+  return num;
 }
 
 
@@ -267,7 +368,7 @@ fileEntry_t* FileEntry_create(char* name) {
   FileInfo myInfo = getFileInfo(name);
 
   fileEntry_t* newEntryPtr = calloc(1, sizeof(fileEntry_t));
-  strcpy(newEntryPtr->file_name, name);
+  snprintf(newEntryPtr->file_name, FILE_NAME_MAX_LEN, "%s", name);
   newEntryPtr->size = myInfo.size;
   newEntryPtr->timestamp = myInfo.lastModifyTime;
 
@@ -278,76 +379,196 @@ fileEntry_t* FileEntry_create(char* name) {
 }
 /* 
 * Callback methods for the File Monitor
-*@name: name of the file to modify
+*@name: name of the file to modify, relative to the directory
 */
 void Filetable_peerAdd(char* name) {
+  //already in the table when it was there as we started: only a newer version is news
+  fileEntry_t* oldEntryPtr = filetable_searchFileByName(filetable, name);
+  if (oldEntryPtr != NULL) {
+    FileInfo myInfo = getFileInfo(name);
+    free(myInfo.filepath);
+    if (myInfo.lastModifyTime != oldEntryPtr -> timestamp) {
+      Filetable_peerModify(name);
+    }
+    return;
+  }
+
+  transfer_fileChanged(transfer, name);
+
   //create a new file entry for the updated file
+  fileEntry_t* newEntryPtr = FileEntry_create(name);
+  char my_ip[IP_LEN];
+  get_my_ip(my_ip);
+  filetable_addHolder(newEntryPtr, peerid_intern(peerIds, my_ip), filetable -> filetable_mutex);
   filetable_appendFileEntry(filetable, newEntryPtr);
+
+  //tell the shard owning the file about this file only
+  int shard = shardmap_owner(shardMap, name);
+  filedelta_record(filetableLogs[shard], DELTA_ADD, newEntryPtr);
+  send_file_update_packet(tracker_connections[shard], shardMap, shard, filetable, filetableLogs[shard], peerIds, 0);
 }
 void Filetable_peerModify(char* name) {
+  //pieces of the new version are not served from the old one kept open
+  transfer_fileChanged(transfer, name);
+
   fileEntry_t* oldEntryPtr = filetable_searchFileByName(filetable, name);
+  if (oldEntryPtr == NULL) {
+    printf("Update failed: File entry for %s not found\n", name);
+    return;
+  }
+
   //create a new entry for the updated file
-  int ret = filetable_updateFile(oldEntryPtr, newEntryPtr, pthread_mutex_t* tablemutex);
+  fileEntry_t* newEntryPtr = FileEntry_create(name);
+  int ret = filetable_updateFile(oldEntryPtr, newEntryPtr, filetable -> filetable_mutex);
+  free(newEntryPtr);
 
-  if (ret) {
+  if (ret > 0) {
     printf("File entry for %s modified\n", name);
+    int shard = shardmap_owner(shardMap, name);
+    filedelta_record(filetableLogs[shard], DELTA_MODIFY, oldEntryPtr);
+    send_file_update_packet(tracker_connections[shard], shardMap, shard, filetable, filetableLogs[shard], peerIds, 0);
   }
   else {
-    printf("Update failed: File entry for %s not found\n", name)
+    printf("Update failed: File entry for %s not found\n", name);
   }
 }
 void Filetable_peerDelete(char* name) {
+  transfer_fileChanged(transfer, name);
+
+  //the log only needs the name of a deleted file
+  fileEntry_t deleted;
+  memset(&deleted, 0, sizeof(fileEntry_t));
+  strncpy(deleted.file_name, name, FILE_NAME_MAX_LEN - 1);
+
   int ret = filetable_deleteFileEntryByName(filetable, name);
-  if (ret) {
+  if (ret > 0) {
     printf("File entry for %s deleted\n", name);
+    int shard = shardmap_owner(shardMap, name);
+    filedelta_record(filetableLogs[shard], DELTA_DELETE, &deleted);
+    send_file_update_packet(tracker_connections[shard], shardMap, shard, filetable, filetableLogs[shard], peerIds, 0);
   }
   else {
-    printf("File entry for %s not found\n", name)
+    printf("File entry for %s not found\n", name);
   }
 }
 //--------------------File Monitor Callbacks-------------------------
+//Thread to tell every tracker shard we are alive, every interval seconds (the argument points to the interval)
 void* keep_alive(void* arg) {
   int interval = *(int*) arg;
   while(1) {
     sleep(interval);
-    //TODO
-    //send the keep alive message
+    int shard;
+    for (shard = 0; shard < shardMap -> shardNum; shard++) {
+      send_keep_alive_packet(tracker_connections[shard]);
+    }
   }
 
   pthread_exit(NULL);
 }
 
-int main(){
-  
+//usage: peer [hostname [shardNum [basePort]]]
+// the tracker is split into shardNum shards listening on basePort + shard (default: TRACKER_SHARD_NUM on HANDSHAKE_PORT),
+// the same numbers every shard of the tracker was started with.  The hostname is asked for when not given.
+int main(int argc, char* argv[]){
+
+  int shardNum = TRACKER_SHARD_NUM;
+  int basePort = HANDSHAKE_PORT;
+  if (argc > 4) {
+    printf("usage: %s [hostname [shardNum [basePort]]]\n", argv[0]);
+    return -1;
+  }
+  if (argc > 2) shardNum = atoi(argv[2]);
+  if (argc > 3) basePort = atoi(argv[3]);
+  if (shardNum <= 0) {
+    printf("Invalid number of shards: %d\n", shardNum);
+    return -1;
+  }
+
+  //the directory synced, the file monitor watches the same one
+  readConfigFile("./config");
+  shared_dir = FileMonitor_getDirectory();
+  if (shared_dir == NULL) {
+    printf("No directory to sync in ./config. Exiting\n");
+    return -1;
+  }
+
   //Initialize the filetable
-  fileTable_t* filetable = malloc(sizeof(fileTable_t));
-  //TODO
-  //load the local directory into the file table
+  filetable = filetable_init();
+  trackerFiletable = filetable_init();
+  shardMap = shardmap_init(shardNum);
+  tracker_connections = malloc(shardNum * sizeof(int));
+  filetableLogs = malloc(shardNum * sizeof(fileDeltaLog_t*));
+  trackerEpochs = malloc(shardNum * sizeof(unsigned long));
+  int shard;
+  for (shard = 0; shard < shardNum; shard++) {
+    filetableLogs[shard] = filedelta_initLog();
+    trackerEpochs[shard] = 0;
+  }
+  peerIds = peerid_init();
+  piece_length = PIECE_LENGTH;
+  keep_alive_interval = HEARTBEAT_INTERVAL;
 
-  //Initialize the peer table
-  peerTable_t* peertable = malloc(sizeof(peerTable_t)); 
+  //load the local directory into the file table
+  printf("%d files in %s\n", load_local_files(), shared_dir);
 
-  //Attempt to establish connection with tracker
-  if ( (tracker_connection = connect_to_tracker()) < 0) {
-    printf("Failed to connect to tracker. Exiting\n");
-    exit(0);
+  //Get the host name by requesting user input, every shard runs there on its own port
+  char hostname[MAX_HOSTNAME_SIZE];
+  if (argc > 1) {
+    snprintf(hostname, MAX_HOSTNAME_SIZE, "%s", argv[1]);
+  } else {
+    printf("Enter hostname of the tracker to connect to:");
+    if (scanf("%255s", hostname) != 1) {
+      return -1;
+    }
   }
 
-  printf("Connected\n");
+  for (shard = 0; shard < shardNum; shard++) {
+    //Attempt to establish connection with the tracker shard
+    if ( (tracker_connections[shard] = connect_to_tracker(hostname, basePort + shard)) < 0) {
+      printf("Failed to connect to tracker shard %d. Exiting\n", shard);
+      exit(0);
+    }
+
+    printf("Connected to shard %d\n", shard);
+
+    //with files the shard owns already, only the parts of the tables that differ are exchanged
+    int joined = merkle_join(shard);
+    if (joined < 0) {
+      printf("Failed to sync with shard %d\n", shard);
+      return -1;
+    }
+    if (joined > 0) continue;
+
+    //Send a register packet to the shard
+    if (send_register_packet(tracker_connections[shard], filetableLogs[shard] -> version, shard, shardNum) < 0) {
+      printf("Failed to send register packet\n");
+      return -1; // maybe exit();
+    }
 
-  //Send a register packet to the tracker
-  if (send_register_packet(tracker_connection) < 0) {
-    printf("Failed to send register packet\n");
-    return -1; // maybe exit();
+    //Receive the acknowledgement of the register packet from the shard
+    ptp_tracker_t* packet = pkt_create_trackerPkt();
+    if (pkt_peer_recvPkt(tracker_connections[shard], packet, peerIds) < 0 || packet -> type != TRACKER_FILETABLE) {
+      printf("Failed to receive the setup packet of shard %d\n", shard);
+      return -1;
+    }
+    if (!tracker_is_shard(shard, packet)) {
+      return -1;
+    }
+    keep_alive_interval = packet -> heartbeatinterval;
+    piece_length = packet -> piece_len;
+    printf("Receiving packet from the tracker.\n");
+    printf("Inteval: %d  Piece Len: %d   FT-Size: %d \n", packet -> heartbeatinterval, packet -> piece_len, packet -> filetablesize);
+    //the setup packet carries the shard's table and its epoch
+    filetable_freeList(apply_tracker_update(shard, packet));
+    free(packet);
   }
 
-  //Receive the acknowledgement of the register packet from the tracker
-  ptp_tracker_t* packet = calloc(1, sizeof(ptp_tracker_t));
-  recv_pkt_from_tracker(packet, tracker_connection);
-  keep_alive_interval = packet -> interval;
-  printf("Receiving packet from the tracker.\n");
-  printf("Inteval: %d  Piece Len: %d   FT-Size: %d \n", packet -> interval, packet -> piece_len, packet -> file_table_size);
-  free(packet);
+  //files are downloaded in the pieces the tracker told us of, and ours served to the other peers on the p2p port
+  transfer = transfer_init(shared_dir, piece_length, 0);
+  if (transfer_listen(transfer, P2P_PORT) < 0) {
+    printf("Failed to listen on the p2p port\n");
+    return -1;
+  }
 
   //--------------------File Monitor Thread-------------------------
   void (*Add)(char *);
@@ -372,142 +593,21 @@ int main(){
 
   //Start the keep alive thread
   pthread_t keep_alive_thread;
-  pthread_create(&keep_alive_thread, NULL, keep_alive, keep_alive_interval);
-
-  //start the thread to listen for data from the tracker
-  pthread_t tracker_listening_thread;
-  pthread_create(&tracker_listening_thread, NULL, tracker_listening, (void*)0);
-
-  //start the thread to listen on the p2p port for connections from other peers
-  pthread_t p2p_listening_thread;
-  pthread_create(&p2p_listening_thread, NULL, p2p_listening, &tracker_connection);
-}
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-/**** added by Yuan ******/
-
-
-
-//Need
-//  downloadlist -- peer's download list to keep track of all the files that are currently being downloaded
-//  fileTable -- peer side file Table
-//  
-//  
-//
-//
-//
-//
-//
-
-
-
-
-/* Thread to download a file from all available peers.  First establishes the connecting with a peer.
-   Then, sends a file_metadata_t to the peer to let it know the name of the file it needs to download.
-   Next, it receives a file_metadata_t from the peer to let it know its about to receive the data and containing 
-   information about the start and send_size as well as the file name.  Then, it receives the file and closes
-   the connection */
-void* p2p_download(void* arg) {
-  fileEntry_t* file = (fileEntry_t*) arg;
-
-  struct sockaddr_in servaddr;
-  servaddr.sin_family = FIlAF_INET;
-  servaddr.sin_addr.s_addr = inet_addr(file -> iplist[0]);      //just use the first ip in the list
-  servaddr.sin_port = htons(PTP_PORT);
-
-  int peer_conn = socket(AF_INET, SOCK_STREAM, 0);  
-
-  if(peer_conn < 0) {
-    printf("Error creating socket in p2p download.\n");
-    return -1;
+  pthread_create(&keep_alive_thread, NULL, keep_alive, &keep_alive_interval);
+
+  //fetch what the tracker has that we lack, then a thread per shard listens for data from the tracker
+  pthread_mutex_lock(&tracker_view_mutex);
+  sync_with_tracker(NULL);
+  pthread_mutex_unlock(&tracker_view_mutex);
+  pthread_t tracker_listening_threads[shardNum];
+  for (shard = 0; shard < shardNum; shard++) {
+    pthread_create(&tracker_listening_threads[shard], NULL, tracker_listening, (void*) (intptr_t) shard);
   }
 
-  if( connect(peer_conn, (struct sockaddr*)&servaddr, sizeof(servaddr)) < 0){
-    printf("Failed to connect ot local ON process.\n");
-    return -1;
+  //we are no use to the others once a shard is gone
+  for (shard = 0; shard < shardNum; shard++) {
+    pthread_join(tracker_listening_threads[shard], NULL);
   }
-
-  printf("Connected to a peer upload thread.\n");
-
-
-  //for this file, Need to create and manage:
-  //      1. @providerList (file specific): keep track of active providers online
-  //      2. @pieceList (file specific): keep track of still-need pieces
-
-
-
-
-  //check if the filename is already in the @downloadFileList, if it is already being downloaded, then wait for a while and check again
-  
-
-  //if it is not yet being downloaded, then start to download it
-  // 1. add the file to the @downloadlist
-  // 2. create a pieceList to keep track of all the pieces needed for this particular file
-  // 
-         // query the fileTable to find the particular file (find by filename), fetch the iplist, and obtain one available (not in the providerList) ip (source peer) to download file from...
-         // if successfully picked one available source (sourceIP in the iplist ):
-         //   1. add it to the providerList
-         //   2. try to start a thead managing downloading this file from a particular peer (given IP address)
-         //   3. 
-
-
-
-
+  FileMonitor_close();
+  return 0;
 }
-
-
-
-
-
-// need to know: 
-// 1. @filename to be downloaded
-// 2. the filesize of the file to be downloaded
-// 3  IP of the provider 
-// 4. master thread's: 
-//              1. @providerList
-//              2. @pieceList
-void* p2p_ManageDownloadFileFromOnePeer(){
-    // 1. parse the arg to get all the info we want
-    // 2. connect to the uploader (@sourceip)
-   
-    
-    // while(@pieceList is not empty):{
-    //     1. get the next piece (peek at the head of @pieceList), this is the piece we want to download now  (Node: 许多这层thread都可以 query 同一个@pieceList, 全都是从左到右)
-    //     
-    //     
-    //     1. request the piece from @sourceip (1.filename, 2. which piece to download )
-    //     2. recv the requested piece from the @sourceip into a small buffer
-    //          if SUCCESS, then write to the @tempFile (copy buffer --> @tempFile)
-    //          if FAILURE, then TODO:
-    //          
-    //          
-    //     3. remove this piece from @pieceList (update @pieceList)
-    // 
-    // 
-    //      
-    // 
-    // 
-    // }
-    // 
-
-}
-
-
-
-
-
-
-
-
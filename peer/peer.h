@@ -2,28 +2,35 @@
 #define PEER_H
 
 #include "../common/constants.h"
+#include "../common/pkt.h"
+#include "../common/filetable.h"
 
 
+int connect_to_tracker(char* hostname, int port);
 
-/* The packet data structure sending from peer to tracker */
-typedef struct segment_peer {
-// protocol length
-int protocol_len;
-// protocol name
-char protocol_name[PROTOCOL_LEN + 1];
-// packet type : register, keep alive, update file table
-int type;
-// reserved space, you could use this space for your convenient, 8 bytes by default
-char reserved[RESERVED_LEN];
-// the peer ip address sending this packet
-char peer_ip[IP_LEN];
-// listening port number in p2p
-int port;
-// the number of files in the local file table -- optional
-int file_table_size;
-// file table of the client -- your own design
-file_t file_table;
-}ptp_peer_t;
-
-
-#endif
\ No newline at end of file
+int tracker_is_shard(int shard, ptp_tracker_t* pkt);
+
+fileEntry_t* apply_tracker_update(int shard, ptp_tracker_t* pkt);
+
+void sync_with_tracker(fileEntry_t* gone);
+
+int merkle_join(int shard);
+
+void* tracker_listening(void* arg);
+
+void* p2p_download(void* arg);
+
+int load_local_files();
+
+fileEntry_t* FileEntry_create(char* name);
+
+void Filetable_peerAdd(char* name);
+
+void Filetable_peerModify(char* name);
+
+void Filetable_peerDelete(char* name);
+
+void* keep_alive(void* arg);
+
+
+#endif
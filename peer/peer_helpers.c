@@ -1,9 +1,11 @@
-//FILE: peer/peer.c
+//FILE: peer/peer_helpers.c
 //
-//Description: This file implements a peer in the DartSync project.
+//Description: This file implements the packets a peer in the DartSync project sends to the tracker.
 //
 //Date: May 22, 2015
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -25,63 +27,200 @@
 #define BUFFER_SIZE 1500
 
 // Function that gets the ip address for the local machine and saves it in the char * passed as a parameter.
-// Parameters: char* ip_address   -> char pointer where the ip address will be memcpy'ed to 
+// The lookup is done once, every thread sending packets asks for it and gethostbyname is not reentrant.
+// Parameters: char* ip_address   -> char pointer where the ip address will be copied to, IP_LEN bytes
 // Returns: 1 if success, -1 if fails.
 int get_my_ip(char* ip_address) {
-  char hostname[MAX_HOSTNAME_SIZE];   
-  gethostname(hostname, MAX_HOSTNAME_SIZE); 
-  
-  struct hostent *host;
-  if ( (host = gethostbyname(hostname)) == NULL){
-    printf("Error! Could not get the ip address from the hostname.\n");
-    return -1;
-  }
+  static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  static char my_ip[IP_LEN];
+
+  pthread_mutex_lock(&mutex);
+  if (my_ip[0] == '\0') {
+    char hostname[MAX_HOSTNAME_SIZE];
+    gethostname(hostname, MAX_HOSTNAME_SIZE);
+
+    struct hostent *host;
+    if ( (host = gethostbyname(hostname)) == NULL){
+      pthread_mutex_unlock(&mutex);
+      printf("Error! Could not get the ip address from the hostname.\n");
+      return -1;
+    }
 
-  //extract the ip address as a string from the hostent struct and memcpy into parameter
-  char* ip = inet_ntoa( *(struct in_addr *) host -> h_addr);
-  memcpy(ip_address, ip, IP_LEN);
+    //extract the ip address as a string from the hostent struct
+    snprintf(my_ip, IP_LEN, "%s", inet_ntoa( *(struct in_addr *) host -> h_addr));
+  }
+  memcpy(ip_address, my_ip, IP_LEN);
+  pthread_mutex_unlock(&mutex);
 
   return 1;
 }
 
 // Function that sends a register packet upon first login.
-int send_register_packet(int tracker_conn) {
-  ptp_peer_t* packet = calloc(1, sizeof(ptp_peer_t));
-  packet -> protocol_len = sizeof(ptp_peer_t);
-  memcpy(packet -> protocol_name, "P2T Protocol", 30);
-  packet -> type = REGISTER;
-  get_my_ip(packet-> peer_ip);
-  packet -> port = P2P_PORT;
-  packet -> file_table_size = 21;
-
-  if (send_pkt_peer_to_tracker(packet, tracker_conn) < 0){
-    free(packet);
+// tableVersion is the current version of the local table: a tracker that still has it applied
+// (e.g. it restarted from its state store) confirms it with a TRACKER_ACK instead of needing the whole table again.
+// shard and shardNum say which shard we take the tracker on the other end for, it refuses us if it is another one.
+int send_register_packet(int tracker_conn, unsigned long tableVersion, int shard, int shardNum) {
+  ptp_peer_t* packet = pkt_create_peerPkt();
+  char my_ip[IP_LEN];
+  get_my_ip(my_ip);
+
+  pkt_config_peerPkt(packet, REGISTER, my_ip, P2P_PORT, 0, NULL);
+  pkt_config_peerDelta(packet, tableVersion, 0, 0, NULL);
+  pkt_config_peerShard(packet, shard, shardNum);
+  int ret = pkt_peer_sendPkt(tracker_conn, packet, NULL);
+  free(packet);
+  if (ret < 0) {
     printf("Error sending the register packet\n");
     return -1;
   }
+  return 1;
+}
+
+
+
+/* Function that tells a tracker shard about changes to the local files it owns.
+   Normally only the changes the shard has not acknowledged yet are sent (FILEUPDATE_DELTA),
+   on first sync or when the shard asks for a resync the part of the table it owns is sent (FILEUPDATE).
+   Input: int tracker_conn - connection to the tracker shard
+          shardMap_t* map - file paths -> tracker shards
+          int shard - the shard on the other end of tracker_conn
+          fileTable_t* filetable - local file table
+          fileDeltaLog_t* log - pending changes of the local files the shard owns
+          peerIdMap_t* ids - peer ids the holders of the local entries refer to
+          int full - 1 to send the whole table
+   Returns 1 on success, -1 on failure
+  */
+int send_file_update_packet(int tracker_conn, shardMap_t* map, int shard, fileTable_t* filetable, fileDeltaLog_t* log, peerIdMap_t* ids, int full) {
+  ptp_peer_t* packet = pkt_create_peerPkt();
+  char my_ip[IP_LEN];
+  get_my_ip(my_ip);
+
+  int num;
+  unsigned long base, version;
+  fileDelta_t* pending = filedelta_getPending(log, &num, &base, &version);
+
+  int ret;
+  if (full) {
+    //the full table is the state at the current version, nothing is left pending once it is acked
+    int size;
+    pthread_mutex_lock(filetable -> filetable_mutex);
+    fileEntry_t* owned = shardmap_selectEntries(map, shard, filetable -> head, &size);
+    pthread_mutex_unlock(filetable -> filetable_mutex);
+    pkt_config_peerPkt(packet, FILEUPDATE, my_ip, P2P_PORT, size, owned);
+    pkt_config_peerDelta(packet, version, 0, 0, NULL);
+    ret = pkt_peer_sendPkt(tracker_conn, packet, ids);
+    filetable_freeList(owned);
+  }
+  else {
+    pkt_config_peerPkt(packet, FILEUPDATE_DELTA, my_ip, P2P_PORT, 0, NULL);
+    pkt_config_peerDelta(packet, version, base, num, pending);
+    ret = pkt_peer_sendPkt(tracker_conn, packet, ids);
+  }
+
+  filedelta_freeList(pending);
   free(packet);
+  if (ret < 0) {
+    printf("Error sending the file update packet\n");
+    return -1;
+  }
   return 1;
 }
 
 
+/* Function that tells the tracker its table has been applied up to epoch, so the next
+   broadcast only carries the files changed after it.
+   Input: int tracker_conn - connection to the tracker
+          unsigned long epoch - epoch of the tracker's table now applied locally
+   Returns 1 on success, -1 on failure
+  */
+int send_epoch_ack_packet(int tracker_conn, unsigned long epoch) {
+  ptp_peer_t* packet = pkt_create_peerPkt();
+  char my_ip[IP_LEN];
+  get_my_ip(my_ip);
+
+  pkt_config_peerPkt(packet, EPOCH_ACK, my_ip, P2P_PORT, 0, NULL);
+  packet -> ackedEpoch = epoch;
+  int ret = pkt_peer_sendPkt(tracker_conn, packet, NULL);
+  free(packet);
+  if (ret < 0) {
+    printf("Error sending the epoch ack packet\n");
+    return -1;
+  }
+  return 1;
+}
 
-int send_keep_alive_packet(int file_table_size) { //need a table size as well
-  ptp_peer_t* packet = calloc(1, sizeof(ptp_peer_t));
-  packet -> protocol_len = sizeof(ptp_peer_t);
-  memcpy(packet -> protocol_name, "P2T Protocol", 30);
-  packet -> type = KEEP_ALIVE;
-  get_my_ip(packet-> peer_ip);
-  packet -> port = P2P_PORT;
-  packet -> file_table_size = 21;
-  //peer table file table
 
-  if (send_pkt_peer_to_tracker(packet, tracker_conn) < 0){
-    free(packet);
-    printf("Error sending the register packet\n");
+/* Function that sends one round of a Merkle exchange with a tracker shard (see merkle.h): the REGISTER
+   carrying the root of our tree first, then a MERKLE_SYNC for every answer of the shard that opened subtrees.
+   The nodes to settle go out with our files under them, the shard's files there replace ours in its answer.
+   Input: int tracker_conn - connection to the tracker shard
+          int type - REGISTER or MERKLE_SYNC
+          int shard, int shardNum - the shard we take the tracker for and the number of shards (see send_register_packet)
+          unsigned long tableVersion - version of the local table the tree was built at
+          merkleTree_t* tree - tree over the local files the shard owns
+          merkleNode_t* nodes - nodes to compare or settle (see merkle_step)
+          int num - number of nodes
+          peerIdMap_t* ids - peer ids the holders of the local entries refer to
+   Returns 1 on success, -1 on failure
+  */
+int send_merkle_sync_packet(int tracker_conn, int type, int shard, int shardNum, unsigned long tableVersion, merkleTree_t* tree, merkleNode_t* nodes, int num, peerIdMap_t* ids) {
+  ptp_peer_t* packet = pkt_create_peerPkt();
+  char my_ip[IP_LEN];
+  get_my_ip(my_ip);
+
+  //copies of our files under the settled nodes, linked for the encoder
+  fileEntry_t dummy;
+  dummy.next = NULL;
+  fileEntry_t* tail = &dummy;
+  int size = 0;
+  int i, j;
+  for (i = 0; i < num; i++) {
+    if (nodes[i].count != MERKLE_SETTLE) continue;
+    int entryNum;
+    fileEntry_t** entries = merkle_nodeEntries(tree, nodes[i].id, &entryNum);
+    for (j = 0; j < entryNum; j++) {
+      fileEntry_t* copy = (fileEntry_t*) malloc(sizeof(fileEntry_t));
+      memcpy(copy, entries[j], sizeof(fileEntry_t));
+      filetable_retainHolders(copy);
+      copy -> next = NULL;
+      tail -> next = copy;
+      tail = copy;
+      size++;
+    }
+  }
+
+  pkt_config_peerPkt(packet, type, my_ip, P2P_PORT, size, dummy.next);
+  pkt_config_peerDelta(packet, tableVersion, 0, 0, NULL);
+  pkt_config_peerNodes(packet, num, nodes);
+  pkt_config_peerShard(packet, shard, shardNum);
+  int ret = pkt_peer_sendPkt(tracker_conn, packet, ids);
+
+  filetable_freeList(dummy.next);
+  free(packet);
+  if (ret < 0) {
+    printf("Error sending the Merkle sync packet\n");
     return -1;
   }
+  return 1;
+}
+
 
+/* Function that tells a tracker shard we are alive, so it keeps us in its peer table.
+   Input: int tracker_conn - connection to the tracker shard
+   Returns 1 on success, -1 on failure
+  */
+int send_keep_alive_packet(int tracker_conn) {
+  ptp_peer_t* packet = pkt_create_peerPkt();
+  char my_ip[IP_LEN];
+  get_my_ip(my_ip);
+
+  pkt_config_peerPkt(packet, KEEPALIVE, my_ip, P2P_PORT, 0, NULL);
+  int ret = pkt_peer_sendPkt(tracker_conn, packet, NULL);
   free(packet);
+  if (ret < 0) {
+    printf("Error sending the keep alive packet\n");
+    return -1;
+  }
   return 1;
 }
 
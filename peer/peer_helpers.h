@@ -2,6 +2,11 @@
 #define PEER_HELPERS_H
 
 #include "../common/constants.h"
+#include "../common/filetable.h"
+#include "../common/filedelta.h"
+#include "../common/peerid.h"
+#include "../common/shardmap.h"
+#include "../common/merkle.h"
 
 //Struct used in helping peer to peer file transfer.  Initially sent to
 //the receiving peer before receviing any other information. 
@@ -14,7 +19,15 @@ int start;                  //the location of the first byte of data for the fil
 
 int get_my_ip(char* ip_address);
 
-int send_register_packet(int tracker_conn);
+int send_register_packet(int tracker_conn, unsigned long tableVersion, int shard, int shardNum);
+
+int send_file_update_packet(int tracker_conn, shardMap_t* map, int shard, fileTable_t* filetable, fileDeltaLog_t* log, peerIdMap_t* ids, int full);
+
+int send_keep_alive_packet(int tracker_conn);
+
+int send_epoch_ack_packet(int tracker_conn, unsigned long epoch);
+
+int send_merkle_sync_packet(int tracker_conn, int type, int shard, int shardNum, unsigned long tableVersion, merkleTree_t* tree, merkleNode_t* nodes, int num, peerIdMap_t* ids);
 
 int get_file_size(char* filepath);
 
@@ -0,0 +1,148 @@
+/* File: piecejournal.c
+   Description: On-disk journal of the pieces of a partial file already written, next to it, so that a
+   		download cut short (the peer stopped, every provider gone) fetches only the pieces missing when
+   		it is tried again.  A header names the version of the file it is for, the bitmap of the pieces
+   		follows.  Unit tested in the testing directory with piecejournal_test.c
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "piecejournal.h"
+#include "piecesched.h"
+
+
+/* write all of a buffer at an offset
+   @param  fd     [the file]
+   @param  buf    [the bytes]
+   @param  len    [how many]
+   @param  offset [where]
+   @return        [1 on success, -1 on failure] */
+static int piecejournal_pwriteAll(int fd, const void* buf, long len, off_t offset) {
+  const char* p = (const char*) buf;
+  while (len > 0) {
+    ssize_t n = pwrite(fd, p, len, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    p += n;
+    len -= n;
+    offset += n;
+  }
+  return 1;
+}
+
+/* read all of a buffer at an offset
+   @param  fd     [the file]
+   @param  buf    [filled]
+   @param  len    [how many]
+   @param  offset [where]
+   @return        [1 on success, -1 on failure or if the file is shorter] */
+static int piecejournal_preadAll(int fd, void* buf, long len, off_t offset) {
+  char* p = (char*) buf;
+  while (len > 0) {
+    ssize_t n = pread(fd, p, len, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    p += n;
+    len -= n;
+    offset += n;
+  }
+  return 1;
+}
+
+
+
+/**
+ * open the journal of a version of a file, the pieces it recorded if it is for that version, a new one otherwise
+ * @param  path      [the journal]
+ * @param  name      [the file]
+ * @param  size      [its size]
+ * @param  timestamp [the tracker's timestamp of it]
+ * @param  pieceLen  [bytes in its pieces]
+ * @param  done      [set to the pieces recorded, malloced, PIECESCHED_WORDS(pieceNum) words; NULL if the
+ *                    journal was for another version, or was not there.  NULL to start a new journal anyway]
+ * @return           [the journal, closed with piecejournal_close; NULL if it cannot be written]
+ */
+pieceJournal_t* piecejournal_open(const char* path, const char* name, long size, unsigned long timestamp, int pieceLen, unsigned long** done) {
+  assert(pieceLen > 0);
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    printf("%s: error: cannot open %s: %s\n", __func__, path, strerror(errno));
+    return NULL;
+  }
+  pieceJournal_t* journal = (pieceJournal_t*) calloc(1, sizeof(pieceJournal_t));
+  journal -> fd = fd;
+  journal -> path = strdup(path);
+  memcpy(journal -> header.magic, PIECEJOURNAL_MAGIC, sizeof(journal -> header.magic));
+  journal -> header.size = size;
+  journal -> header.timestamp = timestamp;
+  journal -> header.pieceLen = pieceLen;
+  journal -> header.pieceNum = (int) ((size + pieceLen - 1) / pieceLen);
+  snprintf(journal -> header.file_name, FILE_NAME_MAX_LEN, "%s", name);
+  journal -> words = PIECESCHED_WORDS(journal -> header.pieceNum);
+
+  //the one there is kept only if it is for this very version
+  if (done != NULL) {
+    *done = NULL;
+    pieceJournalHeader_t header;
+    unsigned long* bitmap = (unsigned long*) calloc(journal -> words + 1, sizeof(unsigned long));
+    if (piecejournal_preadAll(fd, &header, sizeof(header), 0) > 0 && memcmp(&header, &(journal -> header), sizeof(header)) == 0
+        && piecejournal_preadAll(fd, bitmap, journal -> words * sizeof(unsigned long), sizeof(header)) > 0) {
+      *done = bitmap;
+      return journal;
+    }
+    free(bitmap);
+  }
+
+  //a new one: nothing recorded, and the header of the version before gone before anything else is written
+  unsigned long* empty = (unsigned long*) calloc(journal -> words + 1, sizeof(unsigned long));
+  int ret = (ftruncate(fd, 0) == 0) ? 1 : -1;
+  if (ret > 0) ret = piecejournal_pwriteAll(fd, &(journal -> header), sizeof(journal -> header), 0);
+  if (ret > 0) ret = piecejournal_pwriteAll(fd, empty, journal -> words * sizeof(unsigned long), sizeof(journal -> header));
+  free(empty);
+  if (ret < 0) {
+    printf("%s: error: cannot write %s: %s\n", __func__, path, strerror(errno));
+    piecejournal_close(journal, 1);
+    return NULL;
+  }
+  return journal;
+}
+
+/**
+ * record the pieces written, the partial file synced first so that all of them are on disk
+ * @param  journal [the journal]
+ * @param  bitmap  [the pieces, a superset of the ones recorded before]
+ * @return         [1 on success, -1 on failure]
+ */
+int piecejournal_record(pieceJournal_t* journal, const unsigned long* bitmap) {
+  if (piecejournal_pwriteAll(journal -> fd, bitmap, journal -> words * sizeof(unsigned long), sizeof(journal -> header)) < 0) {
+    printf("%s: error: cannot write %s: %s\n", __func__, journal -> path, strerror(errno));
+    return -1;
+  }
+  journal -> records++;
+  return 1;
+}
+
+/**
+ * close a journal
+ * @param journal [the journal, may be NULL]
+ * @param remove  [1 to delete it, the download being complete or abandoned]
+ */
+void piecejournal_close(pieceJournal_t* journal, int remove) {
+  if (journal == NULL) return;
+  close(journal -> fd);
+  if (remove) {
+    unlink(journal -> path);
+  }
+  free(journal -> path);
+  free(journal);
+}
@@ -0,0 +1,47 @@
+#ifndef PIECEJOURNAL_H
+#define PIECEJOURNAL_H
+
+#include "../common/constants.h"
+
+
+#define PIECEJOURNAL_EXT ".journal"     // after the file's name, before PARTIAL_FILE_EXT: the journal of a partial file
+#define PIECEJOURNAL_MAGIC "PIECEJ1"
+
+
+/* what a journal is about, at its start; the bitmap of the pieces written follows */
+typedef struct pieceJournalHeader{
+  char magic[8];
+  long size;
+  unsigned long timestamp;
+  int pieceLen;
+  int pieceNum;
+  char file_name[FILE_NAME_MAX_LEN];
+}pieceJournalHeader_t;
+
+
+/**
+ * the pieces of a partial file known to be on disk, kept next to it so that a download cut short goes on
+ * where it stopped instead of from the start
+ * A journal is for one version of one file: its name, its size and the tracker's timestamp of it.  Bits only
+ * ever go from 0 to 1, and are recorded after the partial file is synced, so a journal cut short in the middle
+ * of a write still names only pieces that are there
+ */
+typedef struct pieceJournal{
+  int fd;
+  char* path;
+  pieceJournalHeader_t header;
+  int words;
+  long records;             // bitmaps written
+}pieceJournal_t;
+
+
+
+
+pieceJournal_t* piecejournal_open(const char* path, const char* name, long size, unsigned long timestamp, int pieceLen, unsigned long** done);
+
+int piecejournal_record(pieceJournal_t* journal, const unsigned long* bitmap);
+
+void piecejournal_close(pieceJournal_t* journal, int remove);
+
+
+#endif
@@ -0,0 +1,592 @@
+/* File: piecesched.c
+   Description: Decides which piece of a file to ask which provider for, when a peer downloads it from every
+   		peer holding it at once: rarest piece first, a bounded number of requests per provider, and pieces
+   		stuck with a slow provider handed to another.  The provider threads claim and complete pieces
+   		without a lock and without allocating anything per piece.  Unit tested in the testing directory
+   		with piecesched_test.c, claims timed with piecesched_bench.c
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "piecesched.h"
+
+
+#define PIECESCHED_LOW 0xffffffffULL
+
+
+/* the pieces sorted by availability, rarest first (a counting sort, availability is at most providerCap), as a
+   new version of the order.  The shared cursor starts over in it, and the providers going through it on
+   their own do on their next claim: what is rarest changed
+   @param sched [the scheduler, its mutex held] */
+static void piecesched_reorder(pieceSched_t* sched) {
+  pieceOrder_t* order = (pieceOrder_t*) malloc(sizeof(pieceOrder_t));
+  order -> pieces = (int*) malloc((sched -> pieceNum + 1) * sizeof(int));
+  order -> prev = sched -> order;
+  order -> version = sched -> order -> version + 1;
+
+  int* starts = (int*) calloc(sched -> providerCap + 2, sizeof(int));
+  int i;
+  for (i = 0; i < sched -> pieceNum; i++) {
+    starts[sched -> availability[i] + 1]++;
+  }
+  for (i = 0; i <= sched -> providerCap; i++) {
+    starts[i + 1] += starts[i];
+  }
+  for (i = 0; i < sched -> pieceNum; i++) {
+    order -> pieces[starts[sched -> availability[i]]++] = i;
+  }
+  free(starts);
+
+  //the order is out before any claim can land in it
+  __atomic_store_n(&(sched -> order), order, __ATOMIC_RELEASE);
+  __atomic_store_n(&(sched -> next), (uint64_t) order -> version << 32, __ATOMIC_RELEASE);
+}
+
+/* the order of a version, the current one or an older one
+   @param  sched   [the scheduler]
+   @param  version [the version]
+   @return         [its order] */
+static pieceOrder_t* piecesched_orderOf(pieceSched_t* sched, unsigned long version) {
+  pieceOrder_t* order = __atomic_load_n(&(sched -> order), __ATOMIC_ACQUIRE);
+  while (order -> version != version) {
+    order = order -> prev;
+  }
+  return order;
+}
+
+/* count a provider's pieces in or out of the availability of each
+   @param sched    [the scheduler, its mutex held]
+   @param provider [the provider]
+   @param delta    [1 when it joins, -1 when it leaves] */
+static void piecesched_count(pieceSched_t* sched, pieceProvider_t* provider, int delta) {
+  int i;
+  for (i = 0; i < sched -> pieceNum; i++) {
+    if (PIECESCHED_HAS(provider -> bitmap, i)) {
+      sched -> availability[i] += delta;
+    }
+  }
+}
+
+/* take a piece off the provider's list of requests
+   @param provider [the provider]
+   @param piece    [the piece]
+   @return         [1 if it was there, 0 otherwise] */
+static int piecesched_forget(pieceProvider_t* provider, int piece) {
+  int i;
+  for (i = 0; provider -> pieces != NULL && i < provider -> outstanding; i++) {
+    if (provider -> pieces[i] == piece) {
+      provider -> pieces[i] = provider -> pieces[--provider -> outstanding];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* push a piece on the retry stack
+   @param sched [the scheduler]
+   @param piece [the piece] */
+static void piecesched_push(pieceSched_t* sched, int piece) {
+  uint64_t top = __atomic_load_n(&(sched -> retryTop), __ATOMIC_RELAXED);
+  uint64_t next;
+  do {
+    __atomic_store_n(&(sched -> retryNext[piece]), (int) (top & PIECESCHED_LOW) - 1, __ATOMIC_RELAXED);
+    next = (((top >> 32) + 1) << 32) | (uint64_t) (piece + 1);
+  } while (!__atomic_compare_exchange_n(&(sched -> retryTop), &top, next, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* pop the piece on top of the retry stack; the tag changes with every push and pop, so a top that was popped
+   and pushed again meanwhile fails the compare-and-swap
+   @param  sched [the scheduler]
+   @return       [the piece, -1 if the stack is empty] */
+static int piecesched_pop(pieceSched_t* sched) {
+  uint64_t top = __atomic_load_n(&(sched -> retryTop), __ATOMIC_ACQUIRE);
+  while ((top & PIECESCHED_LOW) != 0) {
+    int piece = (int) (top & PIECESCHED_LOW) - 1;
+    int under = __atomic_load_n(&(sched -> retryNext[piece]), __ATOMIC_RELAXED);
+    uint64_t next = (((top >> 32) + 1) << 32) | (uint64_t) (under + 1);
+    if (__atomic_compare_exchange_n(&(sched -> retryTop), &top, next, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return piece;
+    }
+  }
+  return -1;
+}
+
+/* hand a piece back, to be taken again before anything else; nothing is done unless it was the owner's
+   @param  sched [the scheduler]
+   @param  piece [the piece]
+   @param  owner [the provider it is assigned to]
+   @return       [1 if it was handed back, 0 otherwise] */
+static int piecesched_handBack(pieceSched_t* sched, int piece, int owner) {
+  if (!__atomic_compare_exchange_n(&(sched -> owner[piece]), &owner, PIECESCHED_MISSING, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    return 0;
+  }
+  //a piece is on the stack once at most: if it is there already, it is taken as missing when popped
+  unsigned char no = 0;
+  if (__atomic_compare_exchange_n(&(sched -> retrying[piece]), &no, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    piecesched_push(sched, piece);
+  }
+  return 1;
+}
+
+/* make a missing piece the provider's
+   The time is set before the owner, so a reaper seeing the owner sees it.  Should the piece turn out to be
+   someone else's, their time is only moved a little later
+   @param  sched [the scheduler]
+   @param  slot  [the provider]
+   @param  piece [the piece]
+   @return       [1 if the provider has it now, 0 if it was not missing] */
+static int piecesched_take(pieceSched_t* sched, int slot, int piece) {
+  int missing = PIECESCHED_MISSING;
+  if (__atomic_load_n(&(sched -> owner[piece]), __ATOMIC_RELAXED) != missing) return 0;
+  __atomic_store_n(&(sched -> assignedAt[piece]), piecesched_now(), __ATOMIC_RELAXED);
+  return __atomic_compare_exchange_n(&(sched -> owner[piece]), &missing, slot, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+/* a handed back piece the provider has, the others it pops on the way are put back
+   @param  sched [the scheduler]
+   @param  slot  [the provider]
+   @return       [the piece, -1 if there is none] */
+static int piecesched_pickRetry(pieceSched_t* sched, int slot) {
+  pieceProvider_t* provider = &(sched -> providers[slot]);
+  int stashed = 0;
+  int piece;
+  while ((piece = piecesched_pop(sched)) >= 0) {
+    if (!provider -> whole && !PIECESCHED_HAS(provider -> bitmap, piece)) {
+      provider -> stash[stashed++] = piece;
+      continue;
+    }
+    //off the stack: a hand back from now on pushes it again
+    __atomic_store_n(&(sched -> retrying[piece]), 0, __ATOMIC_SEQ_CST);
+    if (piecesched_take(sched, slot, piece)) break;
+  }
+  while (stashed > 0) {
+    piecesched_push(sched, provider -> stash[--stashed]);
+  }
+  return piece;
+}
+
+/* the next piece in the order nobody is fetching, through the cursor shared by the providers having every piece
+   @param  sched [the scheduler]
+   @param  slot  [the provider]
+   @return       [the piece, -1 if the cursor is past the last one] */
+static int piecesched_pickShared(pieceSched_t* sched, int slot) {
+  while (1) {
+    //once past the end, the cursor is left alone
+    uint64_t next = __atomic_load_n(&(sched -> next), __ATOMIC_ACQUIRE);
+    if ((next & PIECESCHED_LOW) >= (uint64_t) sched -> pieceNum) return -1;
+    next = __atomic_fetch_add(&(sched -> next), 1, __ATOMIC_ACQ_REL);
+    if ((next & PIECESCHED_LOW) >= (uint64_t) sched -> pieceNum) return -1;
+    pieceOrder_t* order = piecesched_orderOf(sched, (unsigned long) (next >> 32));
+    int piece = order -> pieces[next & PIECESCHED_LOW];
+    if (piecesched_take(sched, slot, piece)) return piece;
+  }
+}
+
+/* the next piece in the order the provider has and nobody is fetching, for one without every piece
+   pieces only go back to missing through the retry stack, so its cursor never has to move back in an order
+   @param  sched [the scheduler]
+   @param  slot  [the provider]
+   @return       [the piece, -1 if there is none] */
+static int piecesched_pickOwn(pieceSched_t* sched, int slot) {
+  pieceProvider_t* provider = &(sched -> providers[slot]);
+  pieceOrder_t* order = __atomic_load_n(&(sched -> order), __ATOMIC_ACQUIRE);
+  if (order -> version != provider -> version) {
+    provider -> version = order -> version;
+    provider -> cursor = 0;
+  }
+  while (provider -> cursor < sched -> pieceNum) {
+    int piece = order -> pieces[provider -> cursor++];
+    if (PIECESCHED_HAS(provider -> bitmap, piece) && piecesched_take(sched, slot, piece)) {
+      return piece;
+    }
+  }
+  return -1;
+}
+
+/* claim a piece for the provider without waiting
+   @param  sched [the scheduler]
+   @param  slot  [the provider]
+   @return       [the piece, PIECESCHED_WAIT or PIECESCHED_FINISHED] */
+static int piecesched_tryClaim(pieceSched_t* sched, int slot) {
+  pieceProvider_t* provider = &(sched -> providers[slot]);
+  if (__atomic_load_n(&(sched -> doneNum), __ATOMIC_ACQUIRE) == sched -> pieceNum) return PIECESCHED_FINISHED;
+  if (!provider -> active || provider -> outstanding >= sched -> maxOutstanding) return PIECESCHED_WAIT;
+
+  int piece = piecesched_pickRetry(sched, slot);
+  if (piece < 0) {
+    piece = provider -> whole ? piecesched_pickShared(sched, slot) : piecesched_pickOwn(sched, slot);
+  }
+  if (piece < 0) return PIECESCHED_WAIT;
+  provider -> pieces[provider -> outstanding++] = piece;
+  return piece;
+}
+
+/* wake everyone waiting on the scheduler; with nobody waiting, the mutex is not even taken
+   A waiter counts itself in before it looks for a piece a last time, so either it sees what changed or this
+   sees it
+   @param sched [the scheduler, its mutex not held] */
+static void piecesched_broadcast(pieceSched_t* sched) {
+  if (__atomic_load_n(&(sched -> waiting), __ATOMIC_SEQ_CST) == 0) return;
+  pthread_mutex_lock(sched -> mutex);
+  pthread_cond_broadcast(sched -> cond);
+  pthread_mutex_unlock(sched -> mutex);
+}
+
+/* absolute deadline for pthread_cond_timedwait on the scheduler's monotonic clock
+   @param ts [set to now + ms]
+   @param ms [from now] */
+static void piecesched_deadline(struct timespec* ts, unsigned long ms) {
+  clock_gettime(CLOCK_MONOTONIC, ts);
+  ts -> tv_sec += ms / 1000;
+  ts -> tv_nsec += (ms % 1000) * 1000000L;
+  if (ts -> tv_nsec >= 1000000000L) {
+    ts -> tv_sec++;
+    ts -> tv_nsec -= 1000000000L;
+  }
+}
+
+
+
+/**
+ * the scheduler's clock
+ * @return [monotonic time in ms]
+ */
+unsigned long piecesched_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * a scheduler for a file with no piece done and no provider yet
+ * @param  fileSize       [bytes in the file]
+ * @param  pieceLen       [bytes in a piece, the last one may be shorter]
+ * @param  providerCap    [most providers at once]
+ * @param  maxOutstanding [most requests a provider has at a time]
+ * @param  stallMs        [a piece assigned for longer is handed to another provider]
+ * @return                [the scheduler, freed with piecesched_destroy]
+ */
+pieceSched_t* piecesched_init(long fileSize, int pieceLen, int providerCap, int maxOutstanding, unsigned long stallMs) {
+  assert(pieceLen > 0 && providerCap > 0 && maxOutstanding > 0);
+  assert((fileSize + pieceLen - 1) / pieceLen < (long) (PIECESCHED_LOW / 2));
+  pieceSched_t* sched = (pieceSched_t*) calloc(1, sizeof(pieceSched_t));
+  sched -> fileSize = fileSize;
+  sched -> pieceLen = pieceLen;
+  sched -> pieceNum = (int) ((fileSize + pieceLen - 1) / pieceLen);
+  sched -> owner = (int*) malloc((sched -> pieceNum + 1) * sizeof(int));
+  sched -> have = (unsigned long*) calloc(PIECESCHED_WORDS(sched -> pieceNum) + 1, sizeof(unsigned long));
+  sched -> assignedAt = (unsigned long*) calloc(sched -> pieceNum + 1, sizeof(unsigned long));
+  sched -> availability = (int*) calloc(sched -> pieceNum + 1, sizeof(int));
+  sched -> retryNext = (int*) malloc((sched -> pieceNum + 1) * sizeof(int));
+  sched -> retrying = (unsigned char*) calloc(sched -> pieceNum + 1, sizeof(unsigned char));
+  sched -> order = (pieceOrder_t*) calloc(1, sizeof(pieceOrder_t));
+  sched -> order -> pieces = (int*) malloc((sched -> pieceNum + 1) * sizeof(int));
+  int i;
+  for (i = 0; i < sched -> pieceNum; i++) {
+    sched -> owner[i] = PIECESCHED_MISSING;
+    sched -> order -> pieces[i] = i;
+  }
+  sched -> providers = (pieceProvider_t*) calloc(providerCap, sizeof(pieceProvider_t));
+  sched -> providerCap = providerCap;
+  sched -> maxOutstanding = maxOutstanding;
+  sched -> stallMs = stallMs;
+
+  sched -> mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(sched -> mutex, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  sched -> cond = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
+  pthread_cond_init(sched -> cond, &attr);
+  pthread_condattr_destroy(&attr);
+  return sched;
+}
+
+/**
+ * mark pieces already in the file, from an earlier attempt at the download, before any provider joins
+ * @param  sched  [the scheduler]
+ * @param  bitmap [the pieces, PIECESCHED_WORDS(pieceNum) words]
+ * @return        [how many are done now]
+ */
+int piecesched_markDone(pieceSched_t* sched, const unsigned long* bitmap) {
+  assert(sched -> activeNum == 0);
+  int piece;
+  for (piece = 0; piece < sched -> pieceNum; piece++) {
+    if (PIECESCHED_HAS(bitmap, piece) && sched -> owner[piece] != PIECESCHED_DONE) {
+      sched -> owner[piece] = PIECESCHED_DONE;
+      sched -> have[piece / PIECESCHED_BITS] |= 1UL << (piece % PIECESCHED_BITS);
+      sched -> doneNum++;
+    }
+  }
+  return sched -> doneNum;
+}
+
+/**
+ * the size of a piece
+ * @param  sched [the scheduler]
+ * @param  piece [the piece]
+ * @return       [bytes in it]
+ */
+int piecesched_pieceSize(pieceSched_t* sched, int piece) {
+  long left = sched -> fileSize - (long) piece * sched -> pieceLen;
+  return (left < sched -> pieceLen) ? (int) left : sched -> pieceLen;
+}
+
+/**
+ * a provider joins, the pieces it has become less rare
+ * one with the whole file is only counted, it leaves the order as it is: every piece stays as rare as before
+ * next to the others
+ * @param  sched  [the scheduler]
+ * @param  bitmap [the pieces it has (PIECESCHED_WORDS(pieceNum) words, copied), NULL if it has the whole file]
+ * @return        [its slot, -1 if every slot is taken]
+ */
+int piecesched_addProvider(pieceSched_t* sched, const unsigned long* bitmap) {
+  pthread_mutex_lock(sched -> mutex);
+  int slot;
+  for (slot = 0; slot < sched -> providerCap && sched -> providers[slot].active; slot++);
+  if (slot == sched -> providerCap) {
+    pthread_mutex_unlock(sched -> mutex);
+    return -1;
+  }
+
+  pieceProvider_t* provider = &(sched -> providers[slot]);
+  int words = PIECESCHED_WORDS(sched -> pieceNum);
+  free(provider -> bitmap);
+  free(provider -> pieces);
+  free(provider -> stash);
+  memset(provider, 0, sizeof(pieceProvider_t));
+  provider -> bitmap = (unsigned long*) malloc((words + 1) * sizeof(unsigned long));
+  if (bitmap != NULL) {
+    memcpy(provider -> bitmap, bitmap, words * sizeof(unsigned long));
+  } else {
+    memset(provider -> bitmap, 0xff, words * sizeof(unsigned long));
+  }
+  //no bits past the last piece
+  if (sched -> pieceNum % PIECESCHED_BITS != 0) {
+    provider -> bitmap[words - 1] &= (1UL << (sched -> pieceNum % PIECESCHED_BITS)) - 1;
+  }
+  //bits past the last piece are clear, so only the last word can be short of all ones
+  provider -> whole = 1;
+  int i;
+  for (i = 0; i < words && provider -> whole; i++) {
+    unsigned long all = (i == words - 1 && sched -> pieceNum % PIECESCHED_BITS != 0) ?
+                        (1UL << (sched -> pieceNum % PIECESCHED_BITS)) - 1 : ~0UL;
+    provider -> whole = (provider -> bitmap[i] == all);
+  }
+  provider -> pieces = (int*) malloc(sched -> maxOutstanding * sizeof(int));
+  if (!provider -> whole) {
+    provider -> stash = (int*) malloc((sched -> pieceNum + 1) * sizeof(int));
+  }
+  provider -> version = sched -> order -> version;
+  provider -> active = 1;
+  sched -> activeNum++;
+
+  if (provider -> whole) {
+    sched -> wholeNum++;
+  } else {
+    piecesched_count(sched, provider, 1);
+    piecesched_reorder(sched);
+  }
+  pthread_cond_broadcast(sched -> cond);
+  pthread_mutex_unlock(sched -> mutex);
+  return slot;
+}
+
+/**
+ * a provider leaves, what it was asked for and had not delivered is handed back
+ * called by the provider's thread, or once nobody claims for the provider any more
+ * @param sched [the scheduler]
+ * @param slot  [the provider]
+ */
+void piecesched_removeProvider(pieceSched_t* sched, int slot) {
+  pthread_mutex_lock(sched -> mutex);
+  pieceProvider_t* provider = &(sched -> providers[slot]);
+  if (!provider -> active) {
+    pthread_mutex_unlock(sched -> mutex);
+    return;
+  }
+  int i;
+  for (i = 0; i < provider -> outstanding; i++) {
+    piecesched_handBack(sched, provider -> pieces[i], slot);
+  }
+  provider -> outstanding = 0;
+  provider -> active = 0;
+  sched -> activeNum--;
+
+  if (provider -> whole) {
+    sched -> wholeNum--;
+  } else {
+    piecesched_count(sched, provider, -1);
+    piecesched_reorder(sched);
+  }
+  pthread_cond_broadcast(sched -> cond);
+  pthread_mutex_unlock(sched -> mutex);
+}
+
+/**
+ * the piece to ask a provider for next, rarest first; called by the provider's thread, takes no lock unless it waits
+ * @param  sched  [the scheduler]
+ * @param  slot   [the provider]
+ * @param  waitMs [how long to wait for one when the provider has nothing left to take (or is at its limit), 0 = not at all]
+ * @return        [the piece, PIECESCHED_WAIT if there is none for now, PIECESCHED_FINISHED once every piece is done]
+ */
+int piecesched_claim(pieceSched_t* sched, int slot, unsigned long waitMs) {
+  int piece = piecesched_tryClaim(sched, slot);
+  if (piece != PIECESCHED_WAIT || waitMs == 0) return piece;
+
+  //whatever makes a piece available again takes the mutex to signal it, after the fact
+  struct timespec deadline;
+  piecesched_deadline(&deadline, waitMs);
+  __atomic_add_fetch(&(sched -> waiting), 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_lock(sched -> mutex);
+  while ((piece = piecesched_tryClaim(sched, slot)) == PIECESCHED_WAIT) {
+    if (pthread_cond_timedwait(sched -> cond, sched -> mutex, &deadline) != 0) {
+      piece = piecesched_tryClaim(sched, slot);
+      break;
+    }
+  }
+  pthread_mutex_unlock(sched -> mutex);
+  __atomic_sub_fetch(&(sched -> waiting), 1, __ATOMIC_SEQ_CST);
+  return piece;
+}
+
+/**
+ * a provider delivered a piece, and it is written to the file
+ * another provider may have been given the piece as well (this one was slow), the first to deliver it wins
+ * @param  sched [the scheduler]
+ * @param  slot  [the provider]
+ * @param  piece [the piece, claimed by the provider]
+ * @return       [1 if the piece is done now, 0 if it was already]
+ */
+int piecesched_complete(pieceSched_t* sched, int slot, int piece) {
+  pieceProvider_t* provider = &(sched -> providers[slot]);
+  piecesched_forget(provider, piece);
+  provider -> received++;
+  if (__atomic_exchange_n(&(sched -> owner[piece]), PIECESCHED_DONE, __ATOMIC_ACQ_REL) == PIECESCHED_DONE) {
+    return 0;
+  }
+  __atomic_or_fetch(&(sched -> have[piece / PIECESCHED_BITS]), 1UL << (piece % PIECESCHED_BITS), __ATOMIC_RELEASE);
+  if (__atomic_add_fetch(&(sched -> doneNum), 1, __ATOMIC_ACQ_REL) == sched -> pieceNum) {
+    piecesched_broadcast(sched);
+  }
+  return 1;
+}
+
+/**
+ * a provider could not deliver a piece, it is handed back unless someone else has it already
+ * @param sched [the scheduler]
+ * @param slot  [the provider]
+ * @param piece [the piece, claimed by the provider]
+ */
+void piecesched_fail(pieceSched_t* sched, int slot, int piece) {
+  piecesched_forget(&(sched -> providers[slot]), piece);
+  if (piecesched_handBack(sched, piece, slot)) {
+    piecesched_broadcast(sched);
+  }
+}
+
+/**
+ * hand the pieces assigned for longer than stallMs to other providers
+ * the slow provider's requests stay outstanding, they count against its limit until it answers or leaves
+ * @param  sched [the scheduler]
+ * @param  now   [the time, piecesched_now()]
+ * @return       [number of pieces handed back]
+ */
+int piecesched_reapStalled(pieceSched_t* sched, unsigned long now) {
+  int num = 0;
+  int i;
+  for (i = 0; i < sched -> pieceNum; i++) {
+    int owner = __atomic_load_n(&(sched -> owner[i]), __ATOMIC_ACQUIRE);
+    if (owner < 0) continue;
+    unsigned long assignedAt = __atomic_load_n(&(sched -> assignedAt[i]), __ATOMIC_RELAXED);
+    if (now > assignedAt && now - assignedAt > sched -> stallMs && piecesched_handBack(sched, i, owner)) {
+      __atomic_add_fetch(&(sched -> providers[owner].stalls), 1, __ATOMIC_RELAXED);
+      num++;
+    }
+  }
+  if (num > 0) {
+    piecesched_broadcast(sched);
+  }
+  return num;
+}
+
+/**
+ * wait until every piece is done, a piece is handed back, or a provider joins or leaves
+ * @param  sched [the scheduler]
+ * @param  ms    [longest wait]
+ * @return       [PIECESCHED_FINISHED once every piece is done, the number of active providers otherwise]
+ */
+int piecesched_wait(pieceSched_t* sched, unsigned long ms) {
+  struct timespec deadline;
+  piecesched_deadline(&deadline, ms);
+  __atomic_add_fetch(&(sched -> waiting), 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_lock(sched -> mutex);
+  if (__atomic_load_n(&(sched -> doneNum), __ATOMIC_SEQ_CST) < sched -> pieceNum) {
+    pthread_cond_timedwait(sched -> cond, sched -> mutex, &deadline);
+  }
+  int ret = (__atomic_load_n(&(sched -> doneNum), __ATOMIC_ACQUIRE) == sched -> pieceNum) ? PIECESCHED_FINISHED : sched -> activeNum;
+  pthread_mutex_unlock(sched -> mutex);
+  __atomic_sub_fetch(&(sched -> waiting), 1, __ATOMIC_SEQ_CST);
+  return ret;
+}
+
+/**
+ * wake whoever waits in piecesched_wait, e.g. for a provider that gave up before it could join
+ * @param sched [the scheduler]
+ */
+void piecesched_wake(pieceSched_t* sched) {
+  piecesched_broadcast(sched);
+}
+
+/**
+ * the pieces done so far, e.g. to offer them to other peers
+ * @param  sched [the scheduler]
+ * @return       [a copy of the bitmap, PIECESCHED_WORDS(pieceNum) words, freed by the caller]
+ */
+unsigned long* piecesched_copyHave(pieceSched_t* sched) {
+  int words = PIECESCHED_WORDS(sched -> pieceNum);
+  unsigned long* copy = (unsigned long*) malloc((words + 1) * sizeof(unsigned long));
+  int i;
+  for (i = 0; i < words; i++) {
+    copy[i] = __atomic_load_n(&(sched -> have[i]), __ATOMIC_ACQUIRE);
+  }
+  return copy;
+}
+
+/**
+ * free the scheduler
+ * @param sched [the scheduler, may be NULL]
+ */
+void piecesched_destroy(pieceSched_t* sched) {
+  if (sched == NULL) return;
+  int i;
+  for (i = 0; i < sched -> providerCap; i++) {
+    free(sched -> providers[i].bitmap);
+    free(sched -> providers[i].pieces);
+    free(sched -> providers[i].stash);
+  }
+  while (sched -> order != NULL) {
+    pieceOrder_t* prev = sched -> order -> prev;
+    free(sched -> order -> pieces);
+    free(sched -> order);
+    sched -> order = prev;
+  }
+  free(sched -> providers);
+  free(sched -> owner);
+  free(sched -> have);
+  free(sched -> assignedAt);
+  free(sched -> availability);
+  free(sched -> retryNext);
+  free(sched -> retrying);
+  pthread_mutex_destroy(sched -> mutex);
+  free(sched -> mutex);
+  pthread_cond_destroy(sched -> cond);
+  free(sched -> cond);
+  free(sched);
+}
@@ -0,0 +1,114 @@
+#ifndef PIECESCHED_H
+#define PIECESCHED_H
+
+#include "../common/constants.h"
+#include <pthread.h>
+#include <stdint.h>
+
+
+#define PIECESCHED_BITS (8 * sizeof(unsigned long))
+#define PIECESCHED_WORDS(pieceNum) (((pieceNum) + PIECESCHED_BITS - 1) / PIECESCHED_BITS)
+#define PIECESCHED_HAS(bitmap, piece) (((bitmap)[(piece) / PIECESCHED_BITS] >> ((piece) % PIECESCHED_BITS)) & 1)
+
+#define PIECESCHED_MISSING -1   // owner of a piece nobody is fetching
+#define PIECESCHED_DONE -2      // owner of a piece written to the file
+
+#define PIECESCHED_WAIT -1      // nothing the provider has is left to take, for now
+#define PIECESCHED_FINISHED -2  // every piece is done
+
+
+/**
+ * one provider of a download, in a slot of its own
+ * but for stalls, only the thread fetching from the provider touches it between piecesched_addProvider and
+ * piecesched_removeProvider
+ */
+typedef struct pieceProvider{
+  int active;
+  int whole;               // it has every piece, and takes them through the shared cursor
+  unsigned long* bitmap;   // the pieces it has
+  int* pieces;             // the ones it was asked for and has not answered yet, maxOutstanding places
+  int outstanding;
+  int cursor;              // position in the order before which it has nothing left to take, if not whole
+  unsigned long version;   // of that order
+  int* stash;              // pieces of the retry stack it does not have, put back after each claim
+  long received;           // pieces it delivered
+  int stalls;              // pieces handed to others for taking it too long, atomic
+}pieceProvider_t;
+
+
+/* the pieces by availability, rarest first; replaced when a provider without the whole file joins or leaves,
+   the older ones stay until the scheduler is freed for claims still going through them */
+typedef struct pieceOrder{
+  unsigned long version;
+  int* pieces;
+  struct pieceOrder* prev;
+}pieceOrder_t;
+
+
+/**
+ * which piece of a file to ask which provider for next
+ * pieces are handed out rarest first (fewest active providers having them), at most maxOutstanding to a provider
+ * at a time.  A piece a provider fails, sits on for longer than stallMs, or leaves behind goes on a retry stack
+ * taken from before anything else.
+ * Claiming, completing and failing pieces take no lock: a piece is claimed by a compare-and-swap of its owner,
+ * providers with the whole file share one atomic cursor over the order, and the retry stack is a lock-free
+ * stack of piece indices.  The mutex only guards providers joining and leaving, and waiting
+ */
+typedef struct pieceSched{
+  long fileSize;
+  int pieceLen;
+  int pieceNum;
+  int doneNum;                 // atomic
+  int* owner;                  // provider each piece is assigned to, PIECESCHED_MISSING or DONE, atomic
+  unsigned long* have;         // bitmap of the pieces done, what the download offers to other peers, atomic
+  unsigned long* assignedAt;   // in ms, when the piece was assigned, atomic
+  int* availability;           // active providers without the whole file having the piece
+  int wholeNum;                // active providers with the whole file, having every piece on top of that
+  pieceOrder_t* order;         // the current order, atomic
+  uint64_t next;               // version of the order << 32 | position of the shared cursor in it, atomic
+  int* retryNext;              // the piece under each one on the retry stack, atomic
+  uint64_t retryTop;           // tag against ABA << 32 | piece on top + 1 (0 when empty), atomic
+  unsigned char* retrying;     // whether a piece is on the stack, or taken off to be put back, atomic
+  pieceProvider_t* providers;
+  int providerCap;
+  int activeNum;
+  int maxOutstanding;
+  unsigned long stallMs;
+  int waiting;                 // threads about to wait on the cond or waiting, atomic
+  pthread_mutex_t* mutex;
+  pthread_cond_t* cond;        // signalled when every piece is done, a piece is handed back, or a provider joins or leaves
+}pieceSched_t;
+
+
+
+
+pieceSched_t* piecesched_init(long fileSize, int pieceLen, int providerCap, int maxOutstanding, unsigned long stallMs);
+
+int piecesched_markDone(pieceSched_t* sched, const unsigned long* bitmap);
+
+int piecesched_pieceSize(pieceSched_t* sched, int piece);
+
+int piecesched_addProvider(pieceSched_t* sched, const unsigned long* bitmap);
+
+void piecesched_removeProvider(pieceSched_t* sched, int slot);
+
+int piecesched_claim(pieceSched_t* sched, int slot, unsigned long waitMs);
+
+int piecesched_complete(pieceSched_t* sched, int slot, int piece);
+
+void piecesched_fail(pieceSched_t* sched, int slot, int piece);
+
+int piecesched_reapStalled(pieceSched_t* sched, unsigned long now);
+
+int piecesched_wait(pieceSched_t* sched, unsigned long ms);
+
+void piecesched_wake(pieceSched_t* sched);
+
+unsigned long piecesched_now();
+
+unsigned long* piecesched_copyHave(pieceSched_t* sched);
+
+void piecesched_destroy(pieceSched_t* sched);
+
+
+#endif
@@ -0,0 +1,1118 @@
+/* File: transfer.c
+   Description: File transfers between peers.  A file is downloaded from every peer holding it at once: one
+   		thread per provider keeps a window of piece requests outstanding on a connection leased from
+   		the connPool_t, which keeps it open for the next file from that provider.  The window is sized
+   		to the provider's rate so that the link, not its round trip, bounds the download.  The pieces to
+   		ask for are chosen by a piecesched_t (rarest first, stalled pieces handed to another
+   		provider).  Each thread writes its pieces where they belong in a partial file allocated at
+   		the full size, renamed over the file once every piece is there; a piecejournal_t next to it
+   		lets a download cut short go on from where it stopped.  Files under the root, and
+   		the pieces done of files still being downloaded, are served to other peers by a thread per
+   		connection, for as long as the other end keeps it, straight from the page cache to the
+   		socket with sendfile, from files kept open in a fileCache_t.
+   		Tested in the testing directory with transfer_test.c, throughput measured with transfer_bench.c
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <assert.h>
+
+#include "transfer.h"
+
+
+#define TRANSFER_BACKLOG 64
+#define TRANSFER_MAX_PIECE_LEN (64 * 1024 * 1024)   // largest piece a peer may ask for
+
+
+/* one download from all its providers */
+typedef struct transferJob{
+  transfer_t* transfer;
+  transferDownload_t* download;
+  int fileFd;                   // the partial file, PARTIAL_FILE_EXT after the name, written by every provider's thread
+  pieceJournal_t* journal;      // the pieces of it on disk, NULL when the version is not known
+  int connecting;               // providers not yet joined to the scheduler, nor given up, atomic
+  int stop;                     // set once the download is over, atomic
+  long done;                    // pieces done, atomic
+}transferJob_t;
+
+/* one provider of a download, what its thread is handed */
+typedef struct transferFetch{
+  transferJob_t* job;
+  transferProvider_t provider;
+  poolConn_t* conn;             // the connection leased, given back by the coordinator once the thread is done
+  int busy;                     // 1 while an exchange is going on, 2 once the coordinator cut the connection, atomic
+  int reusable;                 // the thread left nothing to read on the connection
+}transferFetch_t;
+
+/* one connection served */
+typedef struct transferConn{
+  transfer_t* transfer;
+  int fd;
+}transferConn_t;
+
+
+/* send all of a buffer, with flags
+   @param  fd    [the socket]
+   @param  buf   [the bytes]
+   @param  len   [how many]
+   @param  flags [for send, MSG_MORE when more follows at once]
+   @return       [1 on success, -1 on failure] */
+static int transfer_sendAllFlags(int fd, const void* buf, long len, int flags) {
+  const char* p = (const char*) buf;
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, flags | MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    p += n;
+    len -= n;
+  }
+  return 1;
+}
+
+/* send all of a buffer
+   @param  fd  [the socket]
+   @param  buf [the bytes]
+   @param  len [how many]
+   @return     [1 on success, -1 on failure] */
+static int transfer_sendAll(int fd, const void* buf, long len) {
+  return transfer_sendAllFlags(fd, buf, len, 0);
+}
+
+/* receive exactly len bytes
+   @param  fd  [the socket]
+   @param  buf [filled]
+   @param  len [how many]
+   @return     [1 on success, -1 on failure or when the other end closed] */
+static int transfer_recvAll(int fd, void* buf, long len) {
+  char* p = (char*) buf;
+  while (len > 0) {
+    ssize_t n = recv(fd, p, len, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    p += n;
+    len -= n;
+  }
+  return 1;
+}
+
+/* send a message with nothing after it
+   @param  fd    [the socket]
+   @param  type  [TRANSFER_...]
+   @param  name  [the file it is about]
+   @param  piece [the piece it is about, -1 for none]
+   @return       [1 on success, -1 on failure] */
+static int transfer_sendMsg(int fd, int type, const char* name, int piece) {
+  transferMsg_t msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.type = type;
+  msg.piece = piece;
+  snprintf(msg.file_name, FILE_NAME_MAX_LEN, "%s", name);
+  return transfer_sendAll(fd, &msg, sizeof(msg));
+}
+
+/* a blocked send or recv on the socket gives up after ms
+   @param fd [the socket]
+   @param ms [the timeout] */
+static void transfer_setTimeout(int fd, unsigned long ms) {
+  struct timeval tv;
+  tv.tv_sec = ms / 1000;
+  tv.tv_usec = (ms % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/* whether a name is that of a file under the root, maybe in a subdirectory ("dir/name" as the file monitor
+   reports it): names come from other peers and the tracker, joined to the root they must not lead out of it
+   @param  name [the name]
+   @return      [1 if it is, 0 if it is absolute, or one of its components is empty, "." or ".."] */
+static int transfer_validName(const char* name) {
+  if (name[0] == '/') return 0;
+  const char* component = name;
+  while (1) {
+    const char* end = strchr(component, '/');
+    size_t len = (end != NULL) ? (size_t) (end - component) : strlen(component);
+    if (len == 0 || (len == 1 && component[0] == '.') || (len == 2 && component[0] == '.' && component[1] == '.')) {
+      return 0;
+    }
+    if (end == NULL) return 1;
+    component = end + 1;
+  }
+}
+
+/* create the directories a file under the root is in, those already there are left as they are
+   @param  transfer [the transfer end]
+   @param  name     [the file, a valid name]
+   @return          [1 if they are all there, -1 otherwise] */
+static int transfer_makeParents(transfer_t* transfer, const char* name) {
+  char path[PATH_MAX];
+  int rootLen = snprintf(path, PATH_MAX, "%s/", transfer -> root);
+  const char* slash = name;
+  while ((slash = strchr(slash, '/')) != NULL) {
+    snprintf(path + rootLen, PATH_MAX - rootLen, "%.*s", (int) (slash - name), name);
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+      printf("%s: error: cannot create %s: %s\n", __func__, path, strerror(errno));
+      return -1;
+    }
+    slash++;
+  }
+  return 1;
+}
+
+/* the path of a file under the root
+   @param transfer [the transfer end]
+   @param name     [the file]
+   @param path     [filled, PATH_MAX bytes] */
+static void transfer_path(transfer_t* transfer, const char* name, char* path) {
+  snprintf(path, PATH_MAX, "%s/%s", transfer -> root, name);
+}
+
+/* the path of a file under the root while it is being downloaded, renamed to its own once complete
+   @param transfer [the transfer end]
+   @param name     [the file]
+   @param path     [filled, PATH_MAX bytes] */
+static void transfer_partPath(transfer_t* transfer, const char* name, char* path) {
+  snprintf(path, PATH_MAX, "%s/%s%s", transfer -> root, name, PARTIAL_FILE_EXT);
+}
+
+/* the path of the journal of a partial file, ignored by the file monitor like it
+   @param transfer [the transfer end]
+   @param name     [the file]
+   @param path     [filled, PATH_MAX bytes] */
+static void transfer_journalPath(transfer_t* transfer, const char* name, char* path) {
+  snprintf(path, PATH_MAX, "%s/%s%s%s", transfer -> root, name, PIECEJOURNAL_EXT, PARTIAL_FILE_EXT);
+}
+
+/* the download of a file going on
+   @param  transfer [the transfer end, its mutex held]
+   @param  name     [the file]
+   @return          [the download, NULL if there is none] */
+static transferDownload_t* transfer_findDownloadLocked(transfer_t* transfer, const char* name) {
+  transferDownload_t* iter;
+  for (iter = transfer -> downloads; iter != NULL; iter = iter -> next) {
+    if (strcmp(iter -> file_name, name) == 0) return iter;
+  }
+  return NULL;
+}
+
+/* hold back sending on a connection to keep it to uploadRate
+   A connection behind the rate sat idle (it is kept open between downloads): it starts over from now, the
+   time it was idle earns it no burst
+   @param transfer [the transfer end]
+   @param start    [when the connection was opened or last started over, piecesched_now()]
+   @param sent     [bytes sent on it since, added to]
+   @param len      [bytes about to be sent] */
+static void transfer_throttle(transfer_t* transfer, unsigned long* start, long* sent, long len) {
+  if (transfer -> uploadRate <= 0) return;
+  unsigned long now = piecesched_now();
+  if (*start + (unsigned long) (*sent * 1000 / transfer -> uploadRate) < now) {
+    *start = now;
+    *sent = 0;
+  }
+  *sent += len;
+  unsigned long due = *start + (unsigned long) (*sent * 1000 / transfer -> uploadRate);
+  if (due > now) {
+    usleep((due - now) * 1000);
+  }
+}
+
+
+
+/*------------------------------------ serving ------------------------------------*/
+
+
+/* answer a TRANSFER_HAVE_REQ: the whole file if it is here complete, the pieces done if it is being downloaded
+   @param  transfer [the transfer end]
+   @param  fd       [the connection]
+   @param  req      [the request]
+   @return          [1 on success, -1 if the connection failed] */
+static int transfer_serveHave(transfer_t* transfer, int fd, transferMsg_t* req) {
+  transferMsg_t msg;
+  memset(&msg, 0, sizeof(msg));
+  memcpy(msg.file_name, req -> file_name, FILE_NAME_MAX_LEN);
+  msg.type = TRANSFER_ERROR;
+  msg.size = req -> size;
+  msg.pieceLen = req -> pieceLen;
+  unsigned long* bitmap = NULL;
+
+  pthread_mutex_lock(transfer -> mutex);
+  transferDownload_t* download = transfer_findDownloadLocked(transfer, req -> file_name);
+  if (download != NULL) {
+    if (download -> size == req -> size && download -> sched -> pieceLen == req -> pieceLen) {
+      msg.type = TRANSFER_HAVE;
+      msg.len = PIECESCHED_WORDS(download -> sched -> pieceNum) * sizeof(unsigned long);
+      bitmap = piecesched_copyHave(download -> sched);
+    }
+  }
+  pthread_mutex_unlock(transfer -> mutex);
+
+  if (download == NULL) {
+    char path[PATH_MAX];
+    struct stat st;
+    transfer_path(transfer, req -> file_name, path);
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && st.st_size == req -> size) {
+      msg.type = TRANSFER_HAVE;
+    }
+  }
+
+  int ret = transfer_sendAll(fd, &msg, sizeof(msg));
+  if (ret > 0 && msg.len > 0) {
+    ret = transfer_sendAll(fd, bitmap, msg.len);
+  }
+  free(bitmap);
+  return ret;
+}
+
+/* open the file of a piece, if the file is here complete or the piece is done
+   A complete file is leased from the file cache, the partial file of one being downloaded is opened for the
+   piece: the cache would find it modified at every check.  It may just have been renamed complete
+   @param  transfer [the transfer end]
+   @param  req      [the TRANSFER_REQUEST]
+   @param  len      [filled, bytes in the piece]
+   @param  cached   [filled, the lease to give back with filecache_release, NULL for a file to close]
+   @return          [the file open for reading, -1 if the piece cannot be read] */
+static int transfer_openPiece(transfer_t* transfer, transferMsg_t* req, int* len, cachedFile_t** cached) {
+  long offset = (long) req -> piece * req -> pieceLen;
+  if (req -> piece < 0 || offset >= req -> size) return -1;
+  *len = (req -> size - offset < req -> pieceLen) ? (int) (req -> size - offset) : req -> pieceLen;
+
+  int partial = 0;
+  pthread_mutex_lock(transfer -> mutex);
+  transferDownload_t* download = transfer_findDownloadLocked(transfer, req -> file_name);
+  if (download != NULL) {
+    partial = 1;
+    pieceSched_t* sched = download -> sched;
+    int done = download -> size == req -> size && sched -> pieceLen == req -> pieceLen
+      && __atomic_load_n(&(sched -> owner[req -> piece]), __ATOMIC_ACQUIRE) == PIECESCHED_DONE;
+    if (!done) {
+      pthread_mutex_unlock(transfer -> mutex);
+      return -1;
+    }
+  }
+  pthread_mutex_unlock(transfer -> mutex);
+
+  char path[PATH_MAX];
+  transfer_path(transfer, req -> file_name, path);
+  *cached = NULL;
+  if (!partial) {
+    *cached = filecache_open(transfer -> files, path);
+    if (*cached == NULL) return -1;
+    if ((*cached) -> size != req -> size) {
+      filecache_release(transfer -> files, *cached);
+      return -1;
+    }
+    return (*cached) -> fd;
+  }
+  char partPath[PATH_MAX];
+  transfer_partPath(transfer, req -> file_name, partPath);
+  int fileFd = open(partPath, O_RDONLY);
+  if (fileFd < 0) fileFd = open(path, O_RDONLY);
+  if (fileFd < 0) return -1;
+  struct stat st;
+  if (fstat(fileFd, &st) < 0 || st.st_size < offset + *len) {
+    close(fileFd);
+    return -1;
+  }
+  return fileFd;
+}
+
+/* send a TRANSFER_PIECE and the bytes of its piece
+   The bytes go from the page cache to the socket with sendfile, without being copied through a buffer here;
+   they are read into buf and sent from there only with zeroCopy off, or for a file sendfile cannot read
+   (EINVAL, as on some FUSE file systems).  The message goes with MSG_MORE, in the same segment as the first bytes
+   @param  transfer [the transfer end]
+   @param  fd       [the connection]
+   @param  msg      [the TRANSFER_PIECE, len bytes long]
+   @param  fileFd   [the file, of at least offset + len bytes]
+   @param  offset   [where the piece starts in it]
+   @param  buf      [a buffer of bufLen bytes, grown to the piece length if it is used]
+   @param  bufLen   [its length]
+   @return          [1 on success, -1 if the connection failed, or the file was cut short meanwhile] */
+static int transfer_sendPiece(transfer_t* transfer, int fd, transferMsg_t* msg, int fileFd, off_t offset, char** buf, int* bufLen) {
+  long left = msg -> len;
+  if (transfer_sendAllFlags(fd, msg, sizeof(*msg), (left > 0) ? MSG_MORE : 0) < 0) return -1;
+
+  int zeroCopy = __atomic_load_n(&(transfer -> zeroCopy), __ATOMIC_RELAXED);
+  while (left > 0 && zeroCopy) {
+    ssize_t n = sendfile(fd, fileFd, &offset, left);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+      zeroCopy = 0;
+      break;
+    }
+    if (n <= 0) return -1;
+    left -= n;
+    __atomic_add_fetch(&(transfer -> zeroCopied), n, __ATOMIC_RELAXED);
+  }
+  if (left == 0) return 1;
+
+  if (left > *bufLen) {
+    free(*buf);
+    *bufLen = left;
+    *buf = (char*) malloc(*bufLen);
+  }
+  long got = 0;
+  while (got < left) {
+    ssize_t n = pread(fileFd, *buf + got, left - got, offset + got);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    got += n;
+  }
+  return transfer_sendAll(fd, *buf, left);
+}
+
+/* Thread serving one connection from another peer: TRANSFER_HAVE_REQ and TRANSFER_REQUEST messages, in the
+   order they come, until it closes */
+static void* transfer_serve(void* arg) {
+  transferConn_t* conn = (transferConn_t*) arg;
+  transfer_t* transfer = conn -> transfer;
+  int fd = conn -> fd;
+  free(conn);
+
+  //sendfile has no MSG_NOSIGNAL: a connection the other end closed must not kill the peer
+  sigset_t pipeSet;
+  sigemptyset(&pipeSet);
+  sigaddset(&pipeSet, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipeSet, NULL);
+
+  unsigned long start = piecesched_now();
+  long sent = 0;
+  char* buf = NULL;
+  int bufLen = 0;
+  transferMsg_t req;
+  while (transfer_recvAll(fd, &req, sizeof(req)) > 0) {
+    req.file_name[FILE_NAME_MAX_LEN - 1] = '\0';
+    if ((req.type == TRANSFER_HAVE_REQ || req.type == TRANSFER_REQUEST) && !transfer_validName(req.file_name)) {
+      printf("%s: error: refused to serve %s, not a file in the shared directory\n", __func__, req.file_name);
+      if (transfer_sendMsg(fd, TRANSFER_ERROR, req.file_name, req.piece) < 0) break;
+      continue;
+    }
+    if (req.type == TRANSFER_HAVE_REQ) {
+      if (transfer_serveHave(transfer, fd, &req) < 0) break;
+      continue;
+    }
+    if (req.type != TRANSFER_REQUEST || req.pieceLen <= 0 || req.pieceLen > TRANSFER_MAX_PIECE_LEN) {
+      if (transfer_sendMsg(fd, TRANSFER_ERROR, req.file_name, req.piece) < 0) break;
+      continue;
+    }
+
+    int len;
+    cachedFile_t* cached;
+    int fileFd = transfer_openPiece(transfer, &req, &len, &cached);
+    if (fileFd < 0) {
+      if (transfer_sendMsg(fd, TRANSFER_ERROR, req.file_name, req.piece) < 0) break;
+      continue;
+    }
+    transferMsg_t msg = req;
+    msg.type = TRANSFER_PIECE;
+    msg.len = len;
+    int ret = transfer_sendPiece(transfer, fd, &msg, fileFd, (off_t) req.piece * req.pieceLen, &buf, &bufLen);
+    if (cached != NULL) filecache_release(transfer -> files, cached);
+    else close(fileFd);
+    if (ret < 0) break;
+    __atomic_add_fetch(&(transfer -> uploaded), len, __ATOMIC_RELAXED);
+    transfer_throttle(transfer, &start, &sent, sizeof(msg) + len);
+  }
+  free(buf);
+
+  pthread_mutex_lock(transfer -> mutex);
+  int i;
+  for (i = 0; i < transfer -> servingNum; i++) {
+    if (transfer -> serving[i] == fd) {
+      transfer -> serving[i] = transfer -> serving[--transfer -> servingNum];
+      break;
+    }
+  }
+  close(fd);
+  pthread_cond_broadcast(transfer -> idle);
+  pthread_mutex_unlock(transfer -> mutex);
+  return NULL;
+}
+
+/* Thread accepting connections from other peers, a transfer_serve thread each, until transfer_destroy */
+static void* transfer_listening(void* arg) {
+  transfer_t* transfer = (transfer_t*) arg;
+  while (1) {
+    int fd = accept(transfer -> listenfd, NULL, NULL);
+    if (__atomic_load_n(&(transfer -> stopping), __ATOMIC_ACQUIRE)) {
+      if (fd >= 0) close(fd);
+      break;
+    }
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      printf("%s: error: accept failed: %s\n", __func__, strerror(errno));
+      break;
+    }
+    transfer_setTimeout(fd, transfer -> ioTimeoutMs);
+    //a piece goes out right after its header, not an ack of the header later
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    pthread_mutex_lock(transfer -> mutex);
+    if (transfer -> servingNum == transfer -> servingCap) {
+      transfer -> servingCap *= 2;
+      transfer -> serving = (int*) realloc(transfer -> serving, transfer -> servingCap * sizeof(int));
+    }
+    transfer -> serving[transfer -> servingNum++] = fd;
+    pthread_mutex_unlock(transfer -> mutex);
+
+    transferConn_t* conn = (transferConn_t*) malloc(sizeof(transferConn_t));
+    conn -> transfer = transfer;
+    conn -> fd = fd;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, transfer_serve, conn) != 0) {
+      printf("%s: error: no thread for a connection\n", __func__);
+      conn -> fd = -1;
+      free(conn);
+      pthread_mutex_lock(transfer -> mutex);
+      transfer -> servingNum--;
+      pthread_mutex_unlock(transfer -> mutex);
+      close(fd);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+  return NULL;
+}
+
+
+
+/*------------------------------------ downloading ------------------------------------*/
+
+
+/* an exchange is about to start on the provider's connection, unless the download is over
+   The coordinator only cuts a connection it sees busy, and only the fetching thread gives it back
+   @param  fetch [the provider]
+   @return       [1 if it may start, 0 if nothing should be sent any more] */
+static int transfer_busy(transferFetch_t* fetch) {
+  int idle = 0;
+  if (!__atomic_compare_exchange_n(&(fetch -> busy), &idle, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    return 0;
+  }
+  if (__atomic_load_n(&(fetch -> job -> stop), __ATOMIC_SEQ_CST)) {
+    idle = 1;
+    __atomic_compare_exchange_n(&(fetch -> busy), &idle, 0, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return 0;
+  }
+  return 1;
+}
+
+/* nothing is left to read on the provider's connection for now
+   @param  fetch [the provider]
+   @return       [1 if it is still good, 0 if the coordinator cut it meanwhile] */
+static int transfer_idle(transferFetch_t* fetch) {
+  int busy = 1;
+  return __atomic_compare_exchange_n(&(fetch -> busy), &busy, 0, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+/* the provider's thread is done with its connection, the coordinator may be draining
+   @param fetch [the provider] */
+static void transfer_fetchDone(transferFetch_t* fetch) {
+  transfer_t* transfer = fetch -> job -> transfer;
+  pthread_mutex_lock(transfer -> mutex);
+  pthread_cond_broadcast(transfer -> idle);
+  pthread_mutex_unlock(transfer -> mutex);
+}
+
+/* ask a provider which pieces it has, over a connection from the pool; a pooled connection the provider
+   closed meanwhile is given up for another one
+   @param  fetch  [the provider, its conn set to the connection when there is one]
+   @param  sched  [the download's scheduler]
+   @param  bitmap [set to the pieces it has, malloced, NULL if it has the whole file]
+   @return        [1 if it has the file, 0 if it does not or the download is over (the connection is left idle),
+                   -1 on failure] */
+static int transfer_connect(transferFetch_t* fetch, pieceSched_t* sched, unsigned long** bitmap) {
+  transferJob_t* job = fetch -> job;
+  connPool_t* pool = job -> transfer -> pool;
+  *bitmap = NULL;
+  transferMsg_t msg;
+  while (1) {
+    fetch -> conn = connpool_get(pool, fetch -> provider.ip, fetch -> provider.port, job -> transfer -> ioTimeoutMs, &(job -> stop));
+    if (fetch -> conn == NULL) return -1;
+    if (!transfer_busy(fetch)) return 0;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = TRANSFER_HAVE_REQ;
+    msg.piece = -1;
+    msg.size = sched -> fileSize;
+    msg.pieceLen = sched -> pieceLen;
+    memcpy(msg.file_name, job -> download -> file_name, FILE_NAME_MAX_LEN);
+    if (transfer_sendAll(fetch -> conn -> fd, &msg, sizeof(msg)) > 0 && transfer_recvAll(fetch -> conn -> fd, &msg, sizeof(msg)) > 0) {
+      break;
+    }
+    //only a connection that served before is worth another try
+    int reused = fetch -> conn -> uses > 1;
+    if (!transfer_idle(fetch)) return -1;
+    connpool_put(pool, fetch -> conn, 0);
+    fetch -> conn = NULL;
+    if (!reused) return -1;
+  }
+
+  int fd = fetch -> conn -> fd;
+  if (msg.type != TRANSFER_HAVE) return transfer_idle(fetch) ? 0 : -1;
+  if (msg.len == 0) return 1;
+  int words = PIECESCHED_WORDS(sched -> pieceNum);
+  if (msg.len != words * (int) sizeof(unsigned long)) return -1;
+  *bitmap = (unsigned long*) malloc(msg.len);
+  if (transfer_recvAll(fd, *bitmap, msg.len) < 0) {
+    free(*bitmap);
+    *bitmap = NULL;
+    return -1;
+  }
+  return 1;
+}
+
+/* write a piece received where it belongs in the file, concurrently with the other providers' threads
+   @param  job   [the download]
+   @param  piece [the piece]
+   @param  buf   [its bytes]
+   @param  len   [how many]
+   @return       [1 on success, -1 on failure] */
+static int transfer_writePiece(transferJob_t* job, int piece, const char* buf, int len) {
+  off_t offset = (off_t) piece * job -> download -> sched -> pieceLen;
+  int written = 0;
+  while (written < len) {
+    ssize_t n = pwrite(job -> fileFd, buf + written, len - written, offset + written);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    written += n;
+  }
+  return 1;
+}
+
+/* make room for the whole file at once, so that pieces written in any order do not fragment it, and a full
+   disk shows before anything is downloaded.  File systems without fallocate get a sparse file
+   @param  fd   [the partial file, empty]
+   @param  size [the file's size]
+   @return      [1 on success, -1 on failure] */
+static int transfer_allocate(int fd, long size) {
+  if (size == 0) return 1;
+  if (fallocate(fd, 0, 0, size) == 0) return 1;
+  if (errno != EOPNOTSUPP && errno != ENOSYS) return -1;
+  return (ftruncate(fd, size) == 0) ? 1 : -1;
+}
+
+/* open the partial file of a download: the pieces of it an earlier attempt at the same version left are
+   kept if its journal says which they are, it starts over empty otherwise
+   @param  job       [the download, its fileFd and journal set]
+   @param  partPath  [the partial file]
+   @param  timestamp [the tracker's timestamp of the file, 0 if unknown: nothing is resumed nor journalled]
+   @return           [the pieces kept, -1 on failure] */
+static int transfer_openPart(transferJob_t* job, const char* partPath, unsigned long timestamp) {
+  transferDownload_t* download = job -> download;
+  job -> fileFd = open(partPath, O_WRONLY | O_CREAT, 0644);
+  if (job -> fileFd < 0) {
+    printf("%s: error: cannot write %s: %s\n", __func__, partPath, strerror(errno));
+    return -1;
+  }
+  unsigned long* done = NULL;
+  if (timestamp != 0) {
+    char journalPath[PATH_MAX];
+    transfer_journalPath(job -> transfer, download -> file_name, journalPath);
+    struct stat st;
+    int there = fstat(job -> fileFd, &st) == 0 && st.st_size == download -> size;
+    job -> journal = piecejournal_open(journalPath, download -> file_name, download -> size, timestamp, download -> sched -> pieceLen, there ? &done : NULL);
+  }
+  if (done != NULL) {
+    int kept = piecesched_markDone(download -> sched, done);
+    free(done);
+    return kept;
+  }
+  if (ftruncate(job -> fileFd, 0) < 0 || transfer_allocate(job -> fileFd, download -> size) < 0) {
+    printf("%s: error: no room for %ld bytes of %s: %s\n", __func__, download -> size, download -> file_name, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+/* record the pieces done in the journal, once they are on disk: a piece is done only after it is written
+   @param  job [the download, with a journal]
+   @return     [1 on success, -1 on failure] */
+static int transfer_journal(transferJob_t* job) {
+  unsigned long* have = piecesched_copyHave(job -> download -> sched);
+  int ret = (fdatasync(job -> fileFd) == 0) ? piecejournal_record(job -> journal, have) : -1;
+  free(have);
+  return ret;
+}
+
+/* requests to keep outstanding on a connection for TRANSFER_QUEUE_MS of its rate to be always asked for: a
+   bandwidth-delay product for any round trip shorter than that.  While the window is what limits the rate,
+   the rate grows with it, and so does the window, until the link is the limit
+   @param  bytes    [received on the connection]
+   @param  ms       [over how long]
+   @param  pieceLen [bytes in a piece]
+   @param  most     [largest window]
+   @return          [the window, TRANSFER_WINDOW to most] */
+static int transfer_window(long bytes, unsigned long ms, int pieceLen, int most) {
+  long window = (long) ((double) bytes * TRANSFER_QUEUE_MS / ((double) ms * pieceLen)) + 1;
+  if (window < TRANSFER_WINDOW) window = TRANSFER_WINDOW;
+  return (window > most) ? most : (int) window;
+}
+
+/* Thread downloading pieces from one provider for as long as it has some nobody else is fetching.  It keeps a
+   window of requests outstanding, the answers say which piece they carry; a quarter of the window answered,
+   the requests topping it up go out together in one send.  The connection is busy from the first request
+   sent until the last answer is read, it is left reusable only when it ends idle */
+static void* transfer_fetch(void* arg) {
+  transferFetch_t* fetch = (transferFetch_t*) arg;
+  transferJob_t* job = fetch -> job;
+  pieceSched_t* sched = job -> download -> sched;
+
+  unsigned long* bitmap;
+  int has = transfer_connect(fetch, sched, &bitmap);
+  int slot = (has > 0) ? piecesched_addProvider(sched, bitmap) : -1;
+  free(bitmap);
+  __atomic_sub_fetch(&(job -> connecting), 1, __ATOMIC_ACQ_REL);
+  if (slot < 0) {
+    //one without the file, or without a slot, leaves the connection as good as it was
+    fetch -> reusable = (has == 0 || (has > 0 && transfer_idle(fetch)));
+    piecesched_wake(sched);
+    transfer_fetchDone(fetch);
+    return NULL;
+  }
+  int fd = fetch -> conn -> fd;
+  int broken = 0;
+
+  int most = job -> transfer -> maxWindow;
+  if (most < 1 || most > TRANSFER_MAX_WINDOW) most = TRANSFER_MAX_WINDOW;
+  int target = (most < TRANSFER_WINDOW) ? most : TRANSFER_WINDOW;
+  int* window = (int*) malloc(TRANSFER_MAX_WINDOW * sizeof(int));
+  int inflight = 0;
+  unsigned long rateStart = piecesched_now();
+  long rateBytes = 0;
+  char* buf = (char*) malloc(sched -> pieceLen);
+  transferMsg_t msg;
+  memset(&msg, 0, sizeof(msg));
+  memcpy(msg.file_name, job -> download -> file_name, FILE_NAME_MAX_LEN);
+  msg.type = TRANSFER_REQUEST;
+  msg.size = sched -> fileSize;
+  msg.pieceLen = sched -> pieceLen;
+  transferMsg_t* batch = (transferMsg_t*) malloc(TRANSFER_MAX_WINDOW * sizeof(transferMsg_t));
+
+  //busy since the HAVE_REQ
+  if (!transfer_idle(fetch)) broken = 1;
+  while (!broken && !__atomic_load_n(&(job -> stop), __ATOMIC_ACQUIRE)) {
+    //top the window up once a quarter of it is free, waiting for a piece only when nothing is on the way
+    int piece = PIECESCHED_WAIT;
+    int batchNum = 0;
+    if (inflight == 0 || target - inflight >= (target + 3) / 4) {
+      while (inflight + batchNum < target) {
+        piece = piecesched_claim(sched, slot, (inflight + batchNum == 0) ? job -> transfer -> stallMs / 4 : 0);
+        if (piece < 0) break;
+        batch[batchNum] = msg;
+        batch[batchNum].piece = piece;
+        window[inflight + batchNum++] = piece;
+      }
+    }
+    if (batchNum > 0) {
+      if (piece == PIECESCHED_FINISHED || (inflight == 0 && !transfer_busy(fetch))) {
+        piece = PIECESCHED_FINISHED;
+      } else if (transfer_sendAll(fd, batch, batchNum * sizeof(transferMsg_t)) < 0) {
+        broken = 1;
+      } else {
+        inflight += batchNum;
+        __atomic_add_fetch(&(job -> transfer -> requests), batchNum, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&(job -> transfer -> requestBatches), 1, __ATOMIC_RELAXED);
+        batchNum = 0;
+      }
+      //a batch not sent is handed back
+      while (batchNum > 0) {
+        piecesched_fail(sched, slot, batch[--batchNum].piece);
+      }
+    }
+    if (broken || piece == PIECESCHED_FINISHED) break;
+    if (inflight == 0) continue;
+
+    //one answer, to any of the requests
+    transferMsg_t answer;
+    if (transfer_recvAll(fd, &answer, sizeof(answer)) < 0) {
+      broken = 1;
+      break;
+    }
+    int i;
+    for (i = 0; i < inflight && window[i] != answer.piece; i++);
+    if (i == inflight) {
+      broken = 1;
+      break;
+    }
+    window[i] = window[--inflight];
+    if (answer.type != TRANSFER_PIECE || answer.len != piecesched_pieceSize(sched, answer.piece)) {
+      //it no longer has the file, or not this version of it
+      piecesched_fail(sched, slot, answer.piece);
+      if (inflight == 0 && !transfer_idle(fetch)) broken = 1;
+      break;
+    }
+    if (transfer_recvAll(fd, buf, answer.len) < 0) {
+      piecesched_fail(sched, slot, answer.piece);
+      broken = 1;
+      break;
+    }
+    if (inflight == 0 && !transfer_idle(fetch)) broken = 1;
+    __atomic_add_fetch(&(job -> transfer -> downloaded), answer.len, __ATOMIC_RELAXED);
+    rateBytes += answer.len;
+    unsigned long now = piecesched_now();
+    if (now - rateStart >= TRANSFER_RATE_MS) {
+      target = transfer_window(rateBytes, now - rateStart, sched -> pieceLen, most);
+      rateStart = now;
+      rateBytes = 0;
+    }
+    if (transfer_writePiece(job, answer.piece, buf, answer.len) < 0) {
+      printf("%s: error: cannot write piece %d of %s\n", __func__, answer.piece, job -> download -> file_name);
+      piecesched_fail(sched, slot, answer.piece);
+      break;
+    }
+    if (piecesched_complete(sched, slot, answer.piece) > 0) {
+      __atomic_add_fetch(&(job -> done), 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  //whatever is still asked of it goes to the others, answers still on the way make the connection useless
+  fetch -> reusable = !broken && inflight == 0 && __atomic_load_n(&(fetch -> busy), __ATOMIC_SEQ_CST) == 0;
+  free(window);
+  free(batch);
+  free(buf);
+  piecesched_removeProvider(sched, slot);
+  transfer_fetchDone(fetch);
+  return NULL;
+}
+
+
+
+/* give the providers of a download still exchanging with it up to TRANSFER_DRAIN_MS to finish, their stop set
+   @param transfer [the transfer end]
+   @param fetches  [the providers]
+   @param num      [how many] */
+static void transfer_drain(transfer_t* transfer, transferFetch_t* fetches, int num) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_nsec += TRANSFER_DRAIN_MS * 1000000L;
+  deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+  deadline.tv_nsec %= 1000000000L;
+  pthread_mutex_lock(transfer -> mutex);
+  while (1) {
+    int i;
+    for (i = 0; i < num && __atomic_load_n(&(fetches[i].busy), __ATOMIC_SEQ_CST) != 1; i++);
+    if (i == num || pthread_cond_timedwait(transfer -> idle, transfer -> mutex, &deadline) == ETIMEDOUT) break;
+  }
+  pthread_mutex_unlock(transfer -> mutex);
+}
+
+
+
+/**
+ * a transfer end serving the files under root, not listening yet
+ * @param  root       [the directory]
+ * @param  pieceLen   [bytes in the pieces files are downloaded in]
+ * @param  uploadRate [bytes per second sent on one connection, 0 for no limit]
+ * @return            [the transfer end, freed with transfer_destroy]
+ */
+transfer_t* transfer_init(const char* root, int pieceLen, long uploadRate) {
+  assert(pieceLen > 0 && pieceLen <= TRANSFER_MAX_PIECE_LEN);
+  transfer_t* transfer = (transfer_t*) calloc(1, sizeof(transfer_t));
+  transfer -> root = strdup(root);
+  transfer -> pieceLen = pieceLen;
+  transfer -> uploadRate = uploadRate;
+  transfer -> stallMs = TRANSFER_STALL_MS;
+  transfer -> ioTimeoutMs = TRANSFER_IO_TIMEOUT_MS;
+  transfer -> maxWindow = TRANSFER_MAX_WINDOW;
+  transfer -> zeroCopy = 1;
+  transfer -> pool = connpool_init(CONNPOOL_PER_PEER, CONNPOOL_IDLE_MS, TRANSFER_IO_TIMEOUT_MS);
+  transfer -> files = filecache_init(FILECACHE_MAX_FILES, FILECACHE_CHECK_MS);
+  transfer -> listenfd = -1;
+  transfer -> servingCap = 16;
+  transfer -> serving = (int*) malloc(transfer -> servingCap * sizeof(int));
+  transfer -> mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(transfer -> mutex, NULL);
+  transfer -> idle = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
+  pthread_cond_init(transfer -> idle, NULL);
+  return transfer;
+}
+
+/**
+ * start serving other peers
+ * @param  transfer [the transfer end]
+ * @param  port     [the port to listen on, 0 for any]
+ * @return          [the port listened on, -1 on failure]
+ */
+int transfer_listen(transfer_t* transfer, int port) {
+  assert(transfer -> listenfd < 0);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    printf("%s: error: no socket\n", __func__);
+    return -1;
+  }
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  socklen_t addrLen = sizeof(addr);
+  if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(fd, TRANSFER_BACKLOG) < 0
+      || getsockname(fd, (struct sockaddr*) &addr, &addrLen) < 0) {
+    printf("%s: error: cannot listen on port %d: %s\n", __func__, port, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  transfer -> listenfd = fd;
+  if (pthread_create(&(transfer -> listener), NULL, transfer_listening, transfer) != 0) {
+    printf("%s: error: no listening thread\n", __func__);
+    transfer -> listenfd = -1;
+    close(fd);
+    return -1;
+  }
+  return ntohs(addr.sin_port);
+}
+
+/**
+ * download a file from every provider at once, into the file of that name under the root
+ * Returns once every piece is written, or once no provider is left that has the missing ones or sends
+ * anything for ioTimeoutMs.  Pieces already written are served to other peers meanwhile.  With the version
+ * of the file known, the pieces written are journalled: a download of that version cut short, by a failure
+ * or by the peer stopping, fetches only the pieces still missing when it is called again, from any providers
+ * @param  transfer  [the transfer end]
+ * @param  name      [the file, a name under the root (relative, no empty, "." or ".." component)]
+ * @param  size      [its size]
+ * @param  timestamp [the tracker's timestamp of this version of it, 0 if unknown]
+ * @param  providers [peers holding it, at most TRANSFER_MAX_PROVIDERS are used]
+ * @param  num       [how many]
+ * @return           [1 once it is downloaded, -1 on failure]
+ */
+int transfer_download(transfer_t* transfer, const char* name, long size, unsigned long timestamp, transferProvider_t* providers, int num) {
+  if (!transfer_validName(name)) {
+    printf("%s: error: refused to download %s, not a file in the shared directory\n", __func__, name);
+    return -1;
+  }
+  char path[PATH_MAX];
+  transfer_path(transfer, name, path);
+  if (num > TRANSFER_MAX_PROVIDERS) num = TRANSFER_MAX_PROVIDERS;
+  if (size > 0 && num <= 0) {
+    printf("%s: error: nobody to download %s from\n", __func__, name);
+    return -1;
+  }
+
+  transferDownload_t* download = (transferDownload_t*) calloc(1, sizeof(transferDownload_t));
+  snprintf(download -> file_name, FILE_NAME_MAX_LEN, "%s", name);
+  download -> size = size;
+  download -> sched = piecesched_init(size, transfer -> pieceLen, TRANSFER_MAX_PROVIDERS, TRANSFER_MAX_WINDOW, transfer -> stallMs);
+  pthread_mutex_lock(transfer -> mutex);
+  if (transfer_findDownloadLocked(transfer, name) != NULL) {
+    pthread_mutex_unlock(transfer -> mutex);
+    printf("%s: error: %s is being downloaded already\n", __func__, name);
+    piecesched_destroy(download -> sched);
+    free(download);
+    return -1;
+  }
+  download -> next = transfer -> downloads;
+  transfer -> downloads = download;
+  pthread_mutex_unlock(transfer -> mutex);
+
+  //written under another name, the file monitor and anyone reading the file see the version before until it is complete
+  //a file of a subdirectory we do not have yet gets it first
+  char partPath[PATH_MAX];
+  transfer_partPath(transfer, name, partPath);
+  transferJob_t job;
+  memset(&job, 0, sizeof(job));
+  job.transfer = transfer;
+  job.download = download;
+  job.fileFd = -1;
+  int kept = (transfer_makeParents(transfer, name) > 0) ? transfer_openPart(&job, partPath, timestamp) : -1;
+  if (kept > 0) {
+    __atomic_add_fetch(&(transfer -> resumed), kept, __ATOMIC_RELAXED);
+  }
+  job.connecting = num;
+
+  int finished = 0;
+  transferFetch_t* fetches = (transferFetch_t*) calloc(num + 1, sizeof(transferFetch_t));
+  pthread_t* threads = (pthread_t*) calloc(num + 1, sizeof(pthread_t));
+  int* started = (int*) calloc(num + 1, sizeof(int));
+  int i;
+  if (kept >= 0) {
+    for (i = 0; i < num; i++) {
+      fetches[i].job = &job;
+      fetches[i].provider = providers[i];
+      if (pthread_create(&threads[i], NULL, transfer_fetch, &fetches[i]) == 0) {
+        started[i] = 1;
+      } else {
+        __atomic_sub_fetch(&(job.connecting), 1, __ATOMIC_ACQ_REL);
+      }
+    }
+
+    //until done or hopeless, with stalled pieces handed to other providers every stallMs / 4
+    pieceSched_t* sched = download -> sched;
+    unsigned long tick = transfer -> stallMs / 4 + 1;
+    unsigned long lastReap = piecesched_now();
+    unsigned long lastProgress = lastReap;
+    unsigned long lastJournal = lastReap;
+    long lastDone = 0;
+    long lastJournalled = 0;
+    while (1) {
+      int active = piecesched_wait(sched, tick);
+      if (active == PIECESCHED_FINISHED) {
+        finished = 1;
+        break;
+      }
+      unsigned long now = piecesched_now();
+      if (now - lastReap >= tick) {
+        int reaped = piecesched_reapStalled(sched, now);
+        __atomic_add_fetch(&(transfer -> reassigned), reaped, __ATOMIC_RELAXED);
+        lastReap = now;
+      }
+      long done = __atomic_load_n(&(job.done), __ATOMIC_RELAXED);
+      if (done != lastDone) {
+        lastDone = done;
+        lastProgress = now;
+      }
+      if (job.journal != NULL && done != lastJournalled && now - lastJournal >= TRANSFER_JOURNAL_MS) {
+        transfer_journal(&job);
+        lastJournalled = done;
+        lastJournal = now;
+      }
+      if (active == 0 && __atomic_load_n(&(job.connecting), __ATOMIC_ACQUIRE) == 0) {
+        printf("%s: error: no provider left for %s\n", __func__, name);
+        break;
+      }
+      if (now - lastProgress > transfer -> ioTimeoutMs) {
+        printf("%s: error: no progress on %s for %lums\n", __func__, name, now - lastProgress);
+        break;
+      }
+    }
+
+    //providers still waiting for answers after the drain are cut off, the other connections go back to the pool
+    __atomic_store_n(&(job.stop), 1, __ATOMIC_SEQ_CST);
+    connpool_wake(transfer -> pool);
+    transfer_drain(transfer, fetches, num);
+    for (i = 0; i < num; i++) {
+      int busy = 1;
+      if (__atomic_compare_exchange_n(&(fetches[i].busy), &busy, 2, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        shutdown(fetches[i].conn -> fd, SHUT_RDWR);
+      }
+    }
+    for (i = 0; i < num; i++) {
+      if (started[i]) pthread_join(threads[i], NULL);
+      connpool_put(transfer -> pool, fetches[i].conn, fetches[i].reusable);
+    }
+  }
+
+  //dated like the version the tracker lists, so the file monitor does not report it as a newer one of ours
+  if (finished && timestamp != 0) {
+    struct timespec times[2];
+    times[0].tv_sec = times[1].tv_sec = (time_t) timestamp;
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    if (futimens(job.fileFd, times) < 0) {
+      printf("%s: error: cannot date %s: %s\n", __func__, partPath, strerror(errno));
+    }
+  }
+  //on disk before it takes the place of the version before, which a crash then cannot leave half replaced
+  if (finished && (fsync(job.fileFd) < 0 || rename(partPath, path) < 0)) {
+    printf("%s: error: cannot put %s in place: %s\n", __func__, path, strerror(errno));
+    finished = 0;
+  }
+  //a download cut short keeps what it got for the next attempt at the same version
+  int keep = !finished && job.journal != NULL && __atomic_load_n(&(download -> sched -> doneNum), __ATOMIC_ACQUIRE) > 0
+    && transfer_journal(&job) > 0;
+  if (job.fileFd >= 0) close(job.fileFd);
+  if (!finished && !keep) unlink(partPath);
+  piecejournal_close(job.journal, !keep);
+  filecache_invalidate(transfer -> files, path);
+
+  pthread_mutex_lock(transfer -> mutex);
+  transferDownload_t** link = &(transfer -> downloads);
+  while (*link != download) link = &((*link) -> next);
+  *link = download -> next;
+  pthread_mutex_unlock(transfer -> mutex);
+
+  free(fetches);
+  free(threads);
+  free(started);
+  piecesched_destroy(download -> sched);
+  free(download);
+  return finished ? 1 : -1;
+}
+
+/**
+ * a file under the root changed or went away: the next piece of it served is read from what is there now
+ * Called from the file monitor's alerts
+ * @param transfer [the transfer end]
+ * @param name     [the file]
+ */
+void transfer_fileChanged(transfer_t* transfer, const char* name) {
+  char path[PATH_MAX];
+  transfer_path(transfer, name, path);
+  filecache_invalidate(transfer -> files, path);
+}
+
+/**
+ * the transfer end's counters, and its pool's and file cache's, as text: a "counter name value" or "gauge name value" line each
+ * @param  transfer [the transfer end]
+ * @param  buf      [filled]
+ * @param  cap      [bytes in buf]
+ * @return          [length of the text, -1 if it does not fit]
+ */
+int transfer_format(transfer_t* transfer, char* buf, int cap) {
+  int len = snprintf(buf, cap, "counter downloaded_bytes %ld\ncounter uploaded_bytes %ld\ncounter pieces_reassigned %ld\n"
+    "counter piece_requests %ld\ncounter request_batches %ld\ncounter zero_copy_bytes %ld\ncounter pieces_resumed %ld\n",
+    __atomic_load_n(&(transfer -> downloaded), __ATOMIC_RELAXED), __atomic_load_n(&(transfer -> uploaded), __ATOMIC_RELAXED),
+    __atomic_load_n(&(transfer -> reassigned), __ATOMIC_RELAXED), __atomic_load_n(&(transfer -> requests), __ATOMIC_RELAXED),
+    __atomic_load_n(&(transfer -> requestBatches), __ATOMIC_RELAXED), __atomic_load_n(&(transfer -> zeroCopied), __ATOMIC_RELAXED),
+    __atomic_load_n(&(transfer -> resumed), __ATOMIC_RELAXED));
+  if (len >= cap) return -1;
+  int poolLen = connpool_format(transfer -> pool, buf + len, cap - len);
+  if (poolLen < 0) return -1;
+  len += poolLen;
+  int filesLen = filecache_format(transfer -> files, buf + len, cap - len);
+  return (filesLen < 0) ? -1 : len + filesLen;
+}
+
+/**
+ * stop serving, close every connection served and free the transfer end, no download may be going on
+ * @param transfer [the transfer end, may be NULL]
+ */
+void transfer_destroy(transfer_t* transfer) {
+  if (transfer == NULL) return;
+  if (transfer -> listenfd >= 0) {
+    __atomic_store_n(&(transfer -> stopping), 1, __ATOMIC_RELEASE);
+    shutdown(transfer -> listenfd, SHUT_RDWR);
+    pthread_join(transfer -> listener, NULL);
+    close(transfer -> listenfd);
+  }
+
+  pthread_mutex_lock(transfer -> mutex);
+  int i;
+  for (i = 0; i < transfer -> servingNum; i++) {
+    shutdown(transfer -> serving[i], SHUT_RDWR);
+  }
+  while (transfer -> servingNum > 0) {
+    pthread_cond_wait(transfer -> idle, transfer -> mutex);
+  }
+  pthread_mutex_unlock(transfer -> mutex);
+
+  connpool_destroy(transfer -> pool);
+  filecache_destroy(transfer -> files);
+  pthread_mutex_destroy(transfer -> mutex);
+  free(transfer -> mutex);
+  pthread_cond_destroy(transfer -> idle);
+  free(transfer -> idle);
+  free(transfer -> serving);
+  free(transfer -> root);
+  free(transfer);
+}
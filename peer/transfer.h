@@ -0,0 +1,106 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include "../common/constants.h"
+#include "piecesched.h"
+#include "connpool.h"
+#include "filecache.h"
+#include "piecejournal.h"
+#include <pthread.h>
+
+
+// message types between peers, a transferMsg_t each
+#define TRANSFER_HAVE_REQ 1   // which pieces of file_name (of size bytes, pieces of pieceLen) do you have
+#define TRANSFER_HAVE 2       // these: len bytes of piece bitmap follow, len 0 for the whole file
+#define TRANSFER_REQUEST 3    // send piece of file_name
+#define TRANSFER_PIECE 4      // piece of file_name: len bytes of it follow
+#define TRANSFER_ERROR 5      // no such file, or not of that size, or not that piece, or a name outside the shared directory
+
+#define TRANSFER_MAX_PROVIDERS 16    // most peers a file is downloaded from at once
+#define TRANSFER_WINDOW 4            // requests outstanding on a connection before its rate is known, and the fewest after
+#define TRANSFER_MAX_WINDOW 64       // most requests outstanding on a connection
+#define TRANSFER_QUEUE_MS 500        // the requests outstanding cover this long at the provider's rate, more than a round trip
+#define TRANSFER_RATE_MS 200         // a provider's rate is measured over this long
+#define TRANSFER_STALL_MS 5000       // a piece asked for longer ago is asked of another provider too
+#define TRANSFER_IO_TIMEOUT_MS 15000 // a provider not sending anything for this long is dropped
+#define TRANSFER_JOURNAL_MS 1000     // the pieces of a partial file on disk are journalled at most this often
+#define TRANSFER_DRAIN_MS 100        // a provider still answering when a download ends has this long to finish, and keeps its connection
+
+
+/* Every message between peers, followed by len bytes of bitmap or piece. Both ends are the same program,
+   so it goes over the wire as is, like the file_metadata_t it replaces */
+typedef struct transferMsg{
+  int type;
+  int piece;
+  int len;
+  int pieceLen;
+  long size;
+  char file_name[FILE_NAME_MAX_LEN];
+}transferMsg_t;
+
+
+/* a peer holding the file */
+typedef struct transferProvider{
+  char ip[IP_LEN];
+  int port;
+}transferProvider_t;
+
+
+/* a file being downloaded, whose pieces done are served to other peers too */
+typedef struct transferDownload{
+  char file_name[FILE_NAME_MAX_LEN];
+  long size;
+  pieceSched_t* sched;
+  struct transferDownload* next;
+}transferDownload_t;
+
+
+/**
+ * a peer's end of file transfers with other peers: it downloads a file from every peer holding it at once
+ * (see piecesched.h), and serves the files under root, and the pieces of the ones it is downloading, to them
+ */
+typedef struct transfer{
+  char* root;                     // directory the files are in
+  int pieceLen;
+  long uploadRate;                // bytes per second sent on one connection, 0 for no limit
+  unsigned long stallMs;
+  unsigned long ioTimeoutMs;
+  int maxWindow;                  // most requests outstanding on a connection, up to TRANSFER_MAX_WINDOW
+  int zeroCopy;                   // pieces are sent with sendfile, not read into a buffer first, atomic
+  transferDownload_t* downloads;
+  connPool_t* pool;               // connections to providers, kept open from one download to the next
+  fileCache_t* files;             // files served, kept open from one piece to the next
+  int listenfd;                   // -1 until transfer_listen
+  pthread_t listener;
+  int stopping;
+  int* serving;                   // connections served, shut down on destroy
+  int servingNum;
+  int servingCap;
+  pthread_mutex_t* mutex;
+  pthread_cond_t* idle;           // signalled when a served connection closes, or a download's provider is done
+  long downloaded;                // bytes of pieces received, atomic
+  long uploaded;                  // bytes of pieces sent, atomic
+  long reassigned;                // pieces asked of another provider after the first stalled, atomic
+  long requests;                  // piece requests sent, atomic
+  long requestBatches;            // sends they went out in, atomic
+  long zeroCopied;                // bytes of pieces sent with sendfile, atomic
+  long resumed;                   // pieces found in partial files from earlier attempts, not downloaded again, atomic
+}transfer_t;
+
+
+
+
+transfer_t* transfer_init(const char* root, int pieceLen, long uploadRate);
+
+int transfer_listen(transfer_t* transfer, int port);
+
+int transfer_download(transfer_t* transfer, const char* name, long size, unsigned long timestamp, transferProvider_t* providers, int num);
+
+void transfer_fileChanged(transfer_t* transfer, const char* name);
+
+int transfer_format(transfer_t* transfer, char* buf, int cap);
+
+void transfer_destroy(transfer_t* transfer);
+
+
+#endif
@@ -0,0 +1,161 @@
+/* File: broadcastsched.c
+   Description: debounces the tracker's table broadcasts.  Changes arriving close together
+   		(many peers saving files at once) are broadcast once, as one merged update per peer,
+   		instead of once per FILEUPDATE.  The window trades propagation latency for throughput,
+   		the max delay bounds how late a change goes out under constant load.  Unit tested in the
+   		testing directory with broadcastsched_test.c
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "broadcastsched.h"
+#include "metrics.h"
+
+
+/* flush the open batch, mutex held on entry and exit */
+static void broadcastsched_flushLocked(broadcastSched_t* sched){
+	unsigned long waited = metrics_now() - sched->firstRequest;
+	unsigned long batch = sched->batchRequests;
+	sched->pending = 0;
+	sched->batchRequests = 0;
+	sched->flushes ++;
+
+	//requests during the flush open the next batch, the broadcast may have missed their changes
+	pthread_mutex_unlock(&(sched->mutex));
+	sched->flush();
+	metrics_record(METRIC_HIST_BROADCAST_DELAY, waited);
+	metrics_record(METRIC_HIST_BROADCAST_BATCH, batch);
+	pthread_mutex_lock(&(sched->mutex));
+}
+
+/* waits for each batch to end and flushes it, until stopped */
+static void* broadcastsched_loop(void* arg){
+	broadcastSched_t* sched = (broadcastSched_t*) arg;
+	pthread_mutex_lock(&(sched->mutex));
+	while(!sched->stop){
+		if(!sched->pending){
+			pthread_cond_wait(&(sched->cond), &(sched->mutex));
+			continue;
+		}
+
+		//later requests push the end of the batch back, up to the max delay
+		unsigned long deadline = sched->lastRequest + sched->windowMs * 1000000UL;
+		unsigned long bound = sched->firstRequest + sched->maxDelayMs * 1000000UL;
+		if(bound < deadline) deadline = bound;
+		unsigned long now = metrics_now();
+		if(now < deadline){
+			struct timespec ts;
+			ts.tv_sec = deadline / 1000000000UL;
+			ts.tv_nsec = deadline % 1000000000UL;
+			pthread_cond_timedwait(&(sched->cond), &(sched->mutex), &ts);
+			continue;
+		}
+		broadcastsched_flushLocked(sched);
+	}
+
+	//what is still open goes out before the scheduler ends
+	if(sched->pending){
+		broadcastsched_flushLocked(sched);
+	}
+	pthread_mutex_unlock(&(sched->mutex));
+	return NULL;
+}
+
+
+
+/**
+ * create a scheduler and start its thread (none for a window of 0)
+ * @param  windowMs   [quiet time in ms that ends a batch, 0 to flush every request at once]
+ * @param  maxDelayMs [longest a request waits for its flush, in ms, at least windowMs]
+ * @param  flush      [broadcasts the current state to every peer]
+ * @return            [the scheduler, NULL if the parameters are invalid]
+ */
+broadcastSched_t* broadcastsched_init(long windowMs, long maxDelayMs, broadcastsched_flushHandler flush){
+	if(windowMs < 0 || maxDelayMs < windowMs || flush == NULL){
+		printf("%s: error: window %ldms, max delay %ldms\n", __func__, windowMs, maxDelayMs);
+		return NULL;
+	}
+
+	broadcastSched_t* sched = (broadcastSched_t*) calloc(1, sizeof(broadcastSched_t));
+	sched->windowMs = windowMs;
+	sched->maxDelayMs = maxDelayMs;
+	sched->flush = flush;
+	pthread_mutex_init(&(sched->mutex), NULL);
+
+	//deadlines are on the monotonic clock (see metrics_now)
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&(sched->cond), &attr);
+	pthread_condattr_destroy(&attr);
+
+	if(windowMs > 0){
+		pthread_create(&(sched->thread), NULL, broadcastsched_loop, sched);
+	}
+	return sched;
+}
+
+/**
+ * ask for a broadcast of the changes made so far, returns at once unless the window is 0
+ * @param sched [the scheduler]
+ */
+void broadcastsched_request(broadcastSched_t* sched){
+	metrics_count(METRIC_BROADCAST_REQUESTS, 1);
+
+	pthread_mutex_lock(&(sched->mutex));
+	unsigned long now = metrics_now();
+	sched->requests ++;
+	sched->batchRequests ++;
+	sched->lastRequest = now;
+	if(sched->windowMs == 0){
+		sched->firstRequest = now;
+		broadcastsched_flushLocked(sched);
+		pthread_mutex_unlock(&(sched->mutex));
+		return;
+	}
+
+	//only a new batch needs the thread, for an open one it wakes at the old deadline and looks again
+	if(!sched->pending){
+		sched->pending = 1;
+		sched->firstRequest = now;
+		pthread_cond_signal(&(sched->cond));
+	}
+	pthread_mutex_unlock(&(sched->mutex));
+}
+
+/**
+ * how well requests are coalesced
+ * @param sched    [the scheduler]
+ * @param requests [set to the requests so far]
+ * @param flushes  [set to the broadcasts they led to]
+ */
+void broadcastsched_stats(broadcastSched_t* sched, unsigned long* requests, unsigned long* flushes){
+	pthread_mutex_lock(&(sched->mutex));
+	*requests = sched->requests;
+	*flushes = sched->flushes;
+	pthread_mutex_unlock(&(sched->mutex));
+}
+
+/**
+ * flush what is pending, stop the thread and free the scheduler
+ * @param sched [the scheduler]
+ */
+void broadcastsched_destroy(broadcastSched_t* sched){
+	if(sched == NULL) return;
+	pthread_mutex_lock(&(sched->mutex));
+	sched->stop = 1;
+	pthread_cond_signal(&(sched->cond));
+	pthread_mutex_unlock(&(sched->mutex));
+	if(sched->windowMs > 0){
+		pthread_join(sched->thread, NULL);
+	}
+	pthread_cond_destroy(&(sched->cond));
+	pthread_mutex_destroy(&(sched->mutex));
+	free(sched);
+}
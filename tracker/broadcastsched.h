@@ -0,0 +1,45 @@
+#ifndef BROADCASTSCHED_H
+#define BROADCASTSCHED_H
+
+#include <pthread.h>
+#include "../common/constants.h"
+
+
+typedef void (*broadcastsched_flushHandler)(void);
+
+
+/**
+ * coalesces broadcast requests: the first request opens a batch, the batch is flushed (one broadcast)
+ * once no request came for windowMs, or maxDelayMs after it opened, whichever comes first.
+ * Every peer then gets one update carrying all the changes of the batch.
+ * A window of 0 flushes every request right away in the requesting thread
+ */
+typedef struct broadcastSched{
+	long windowMs;              // quiet time that ends a batch
+	long maxDelayMs;            // longest a request waits for its broadcast
+	broadcastsched_flushHandler flush;
+	int pending;                // a batch is open
+	unsigned long firstRequest; // when the open batch started, in ns
+	unsigned long lastRequest;  // latest request of the open batch, in ns
+	unsigned long batchRequests;// requests in the open batch
+	unsigned long requests;     // every request so far
+	unsigned long flushes;      // every flush so far
+	int stop;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;        // signaled when a batch opens or on stop
+}broadcastSched_t;
+
+
+
+
+broadcastSched_t* broadcastsched_init(long windowMs, long maxDelayMs, broadcastsched_flushHandler flush);
+
+void broadcastsched_request(broadcastSched_t* sched);
+
+void broadcastsched_stats(broadcastSched_t* sched, unsigned long* requests, unsigned long* flushes);
+
+void broadcastsched_destroy(broadcastSched_t* sched);
+
+
+#endif
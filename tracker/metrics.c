@@ -0,0 +1,285 @@
+/* File: metrics.c
+   Description: counters, latency histograms and gauges of the tracker.  Every thread records into
+   		a slot of its own with relaxed atomic adds, so the hot paths never share a cache line or
+   		take a lock; a dump sums the slots up and writes them as text.  Unit tested in the testing
+   		directory with metrics_test.c
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "metrics.h"
+
+
+static metrics_t* metricsPtr;                       // NULL until metrics_init, nothing is recorded then
+static __thread metricsSlot_t* metricsMySlot;  // the calling thread's slot
+static __thread metrics_t* metricsMyOwner;     // metrics the slot belongs to, a new init hands out new slots
+
+static const char* metricsCounterNames[METRIC_COUNTER_NUM] = {
+	"pkt_register", "pkt_keepalive", "pkt_fileupdate", "pkt_fileupdate_delta", "pkt_epoch_ack",
+	"files_synced", "broadcasts", "broadcast_peers", "encoded_pkts", "encoded_bytes",
+	"send_calls", "sent_bytes", "send_superseded", "send_overflow", "resyncs",
+	"peers_timed_out", "peers_removed", "broadcast_requests", "pkt_merkle_sync"
+};
+
+static const char* metricsHistNames[METRIC_HIST_NUM] = {
+	"reconcile_ns", "publish_ns", "broadcast_ns", "encode_ns", "send_ns", "monitor_ns",
+	"broadcast_delay_ns", "broadcast_batch"
+};
+
+static const char* metricsGaugeNames[METRIC_GAUGE_NUM] = {
+	"files", "peers", "epoch"
+};
+
+
+
+/**
+ * bucket of a value: the value itself below METRICS_HIST_SUB, above that the power of two it falls in
+ * and the top METRICS_HIST_SUB_BITS bits below its highest one
+ */
+static int metrics_bucket(unsigned long value){
+	if(value < METRICS_HIST_SUB) return (int) value;
+	int exp = 63 - __builtin_clzl(value);
+	if(exp > METRICS_HIST_MAX_EXP) return METRICS_HIST_BUCKETS - 1;
+	return ((exp - METRICS_HIST_SUB_BITS + 1) << METRICS_HIST_SUB_BITS)
+		+ (int) ((value >> (exp - METRICS_HIST_SUB_BITS)) & (METRICS_HIST_SUB - 1));
+}
+
+/* largest value that falls in a bucket */
+static unsigned long metrics_bucketTop(int bucket){
+	if(bucket < METRICS_HIST_SUB) return bucket;
+	int exp = (bucket >> METRICS_HIST_SUB_BITS) + METRICS_HIST_SUB_BITS - 1;
+	unsigned long sub = bucket & (METRICS_HIST_SUB - 1);
+	return ((METRICS_HIST_SUB + sub + 1) << (exp - METRICS_HIST_SUB_BITS)) - 1;
+}
+
+/* the calling thread's slot, handed out on its first record, NULL before metrics_init */
+static metricsSlot_t* metrics_mySlot(){
+	metrics_t* metrics = __atomic_load_n(&metricsPtr, __ATOMIC_ACQUIRE);
+	if(metrics == NULL) return NULL;
+	if(metricsMyOwner != metrics){
+		int slot = __atomic_fetch_add(&(metrics->slotNum), 1, __ATOMIC_RELAXED);
+		if(slot > METRICS_MAX_THREADS) slot = METRICS_MAX_THREADS;
+		metricsMySlot = &(metrics->slots[slot]);
+		metricsMyOwner = metrics;
+	}
+	return metricsMySlot;
+}
+
+
+
+/**
+ * start recording
+ * @return [1 if success, -1 if metrics are already recorded]
+ */
+int metrics_init(){
+	if(metricsPtr != NULL){
+		printf("%s: error: already initialized\n", __func__);
+		return -1;
+	}
+	metrics_t* metrics = (metrics_t*) calloc(1, sizeof(metrics_t));
+	metrics->slots = (metricsSlot_t*) calloc(METRICS_MAX_THREADS + 1, sizeof(metricsSlot_t));
+	metrics->startTime = metrics_now();
+	__atomic_store_n(&metricsPtr, metrics, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/**
+ * @return [monotonic time in ns, for measuring latencies]
+ */
+unsigned long metrics_now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/**
+ * add to a counter
+ * @param counter [METRIC_*]
+ * @param n       [amount]
+ */
+void metrics_count(int counter, unsigned long n){
+	metricsSlot_t* slot = metrics_mySlot();
+	if(slot == NULL) return;
+	__atomic_add_fetch(&(slot->counters[counter]), n, __ATOMIC_RELAXED);
+}
+
+/**
+ * record one latency
+ * @param hist [METRIC_HIST_*]
+ * @param ns   [the latency, in ns]
+ */
+void metrics_record(int hist, unsigned long ns){
+	metricsSlot_t* slot = metrics_mySlot();
+	if(slot == NULL) return;
+	metrics_histAdd(&(slot->hists[hist]), ns);
+}
+
+/**
+ * add one value to a histogram of the caller's own, e.g. one per thread of a load generator
+ * works without metrics_init, safe against other threads adding to the same histogram
+ * @param hist  [the histogram, zeroed before the first value]
+ * @param value [the value]
+ */
+void metrics_histAdd(metricsHist_t* hist, unsigned long value){
+	__atomic_add_fetch(&(hist->buckets[metrics_bucket(value)]), 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&(hist->count), 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&(hist->sum), value, __ATOMIC_RELAXED);
+	//a histogram normally has one writer, the loop is for the shared slot and the like
+	unsigned long max = __atomic_load_n(&(hist->max), __ATOMIC_RELAXED);
+	while(value > max && !__atomic_compare_exchange_n(&(hist->max), &max, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/**
+ * add every value of one histogram to another
+ * @param total [the sum]
+ * @param hist  [the histogram added, left unchanged]
+ */
+void metrics_histMerge(metricsHist_t* total, metricsHist_t* hist){
+	total->count += __atomic_load_n(&(hist->count), __ATOMIC_RELAXED);
+	total->sum += __atomic_load_n(&(hist->sum), __ATOMIC_RELAXED);
+	unsigned long max = __atomic_load_n(&(hist->max), __ATOMIC_RELAXED);
+	if(max > total->max) total->max = max;
+	int b;
+	for(b = 0; b < METRICS_HIST_BUCKETS; b++){
+		total->buckets[b] += __atomic_load_n(&(hist->buckets[b]), __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * set a gauge
+ * @param gauge [METRIC_GAUGE_*]
+ * @param value [its current value]
+ */
+void metrics_setGauge(int gauge, long value){
+	metrics_t* metrics = __atomic_load_n(&metricsPtr, __ATOMIC_ACQUIRE);
+	if(metrics == NULL) return;
+	__atomic_store_n(&(metrics->gauges[gauge]), value, __ATOMIC_RELAXED);
+}
+
+/**
+ * sum every thread's slot up, recording goes on meanwhile so the sum is a moment's approximation
+ * @param  total [set to the sums]
+ * @return       [number of threads that recorded, -1 before metrics_init]
+ */
+int metrics_collect(metricsSlot_t* total){
+	memset(total, 0, sizeof(metricsSlot_t));
+	metrics_t* metrics = __atomic_load_n(&metricsPtr, __ATOMIC_ACQUIRE);
+	if(metrics == NULL) return -1;
+
+	int threads = __atomic_load_n(&(metrics->slotNum), __ATOMIC_RELAXED);
+	int slotNum = threads > METRICS_MAX_THREADS ? METRICS_MAX_THREADS + 1 : threads;
+	int s, i;
+	for(s = 0; s < slotNum; s++){
+		metricsSlot_t* slot = &(metrics->slots[s]);
+		for(i = 0; i < METRIC_COUNTER_NUM; i++){
+			total->counters[i] += __atomic_load_n(&(slot->counters[i]), __ATOMIC_RELAXED);
+		}
+		for(i = 0; i < METRIC_HIST_NUM; i++){
+			metrics_histMerge(&(total->hists[i]), &(slot->hists[i]));
+		}
+	}
+	return threads;
+}
+
+/**
+ * value below which a fraction q of a histogram's values lie, rounded up to the top of its bucket
+ * @param  hist [the histogram]
+ * @param  q    [0 .. 1]
+ * @return      [the value, never above the largest recorded; 0 if nothing was recorded]
+ */
+unsigned long metrics_percentile(metricsHist_t* hist, double q){
+	//the buckets are read one by one, go by their own total rather than count
+	unsigned long count = 0;
+	int b;
+	for(b = 0; b < METRICS_HIST_BUCKETS; b++){
+		count += hist->buckets[b];
+	}
+	if(count == 0) return 0;
+
+	unsigned long rank = (unsigned long) (q * count + 0.999999);
+	if(rank < 1) rank = 1;
+	if(rank > count) rank = count;
+	unsigned long seen = 0;
+	for(b = 0; b < METRICS_HIST_BUCKETS; b++){
+		seen += hist->buckets[b];
+		if(seen >= rank) break;
+	}
+	//the last bucket has no top, it takes everything too large for the others
+	unsigned long top = metrics_bucketTop(b);
+	return (b == METRICS_HIST_BUCKETS - 1 || top > hist->max) ? hist->max : top;
+}
+
+/**
+ * write every counter, histogram and gauge as text, one per line
+ * @param  buf [buffer to write into]
+ * @param  cap [its size]
+ * @return     [length written, -1 if it does not fit or before metrics_init]
+ */
+int metrics_format(char* buf, int cap){
+	metricsSlot_t* total = (metricsSlot_t*) malloc(sizeof(metricsSlot_t));
+	int threads = metrics_collect(total);
+	if(threads < 0){
+		free(total);
+		return -1;
+	}
+
+	int len = snprintf(buf, cap, "uptime_s %lu\nthreads %d\n", (metrics_now() - metricsPtr->startTime) / 1000000000UL, threads);
+	int i;
+	for(i = 0; i < METRIC_COUNTER_NUM && len < cap; i++){
+		len += snprintf(buf + len, cap - len, "counter %s %lu\n", metricsCounterNames[i], total->counters[i]);
+	}
+	for(i = 0; i < METRIC_GAUGE_NUM && len < cap; i++){
+		len += snprintf(buf + len, cap - len, "gauge %s %ld\n", metricsGaugeNames[i], __atomic_load_n(&(metricsPtr->gauges[i]), __ATOMIC_RELAXED));
+	}
+	for(i = 0; i < METRIC_HIST_NUM && len < cap; i++){
+		metricsHist_t* h = &(total->hists[i]);
+		len += snprintf(buf + len, cap - len, "hist %s count %lu mean %lu p50 %lu p90 %lu p99 %lu p999 %lu max %lu\n",
+			metricsHistNames[i], h->count, h->count > 0 ? h->sum / h->count : 0,
+			metrics_percentile(h, 0.5), metrics_percentile(h, 0.9), metrics_percentile(h, 0.99),
+			metrics_percentile(h, 0.999), h->max);
+	}
+	free(total);
+	return len < cap ? len : -1;
+}
+
+/**
+ * write the metrics to a file, replaced whole so readers never see half of it
+ * @param  path [the file]
+ * @return      [1 if success, -1 otherwise]
+ */
+int metrics_dump(const char* path){
+	char buf[8192];
+	int len = metrics_format(buf, sizeof(buf));
+	if(len < 0) return -1;
+
+	char tmpPath[512];
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+	FILE* file = fopen(tmpPath, "w");
+	if(file == NULL){
+		printf("%s: error: cannot open %s\n", __func__, tmpPath);
+		return -1;
+	}
+	int written = (int) fwrite(buf, 1, len, file);
+	if(fclose(file) != 0 || written != len || rename(tmpPath, path) < 0){
+		printf("%s: error: cannot write %s\n", __func__, path);
+		remove(tmpPath);
+		return -1;
+	}
+	return 1;
+}
+
+/**
+ * stop recording and free everything, no thread may be recording at the time
+ */
+void metrics_destroy(){
+	metrics_t* metrics = __atomic_exchange_n(&metricsPtr, NULL, __ATOMIC_ACQ_REL);
+	if(metrics == NULL) return;
+	free(metrics->slots);
+	free(metrics);
+}
@@ -0,0 +1,109 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "../common/constants.h"
+
+
+#define METRICS_MAX_THREADS 32       // threads recording into slots of their own, later ones share one more slot
+#define METRICS_HIST_SUB_BITS 5      // 32 linear sub-buckets per power of two, values are kept within ~3%
+#define METRICS_HIST_SUB (1 << METRICS_HIST_SUB_BITS)
+#define METRICS_HIST_MAX_EXP 40      // values from 2^41 ns (~36 minutes) on land in the last bucket
+#define METRICS_HIST_BUCKETS ((METRICS_HIST_MAX_EXP - METRICS_HIST_SUB_BITS + 2) << METRICS_HIST_SUB_BITS)
+
+
+//counters, summed over every thread's slot
+#define METRIC_PKT_REGISTER 0
+#define METRIC_PKT_KEEPALIVE 1
+#define METRIC_PKT_FILEUPDATE 2
+#define METRIC_PKT_FILEUPDATE_DELTA 3
+#define METRIC_PKT_EPOCH_ACK 4
+#define METRIC_FILES_SYNCED 5        // entries and deltas reconciled into the file table
+#define METRIC_BROADCASTS 6
+#define METRIC_BROADCAST_PEERS 7     // peers a broadcast was queued for
+#define METRIC_ENCODED_PKTS 8
+#define METRIC_ENCODED_BYTES 9
+#define METRIC_SEND_CALLS 10         // writev calls
+#define METRIC_SENT_BYTES 11
+#define METRIC_SEND_SUPERSEDED 12    // queued broadcasts replaced by a newer one before they were sent
+#define METRIC_SEND_OVERFLOW 13      // broadcasts dropped, the peer was over its budget
+#define METRIC_RESYNCS 14            // TRACKER_RESYNC sent to peers
+#define METRIC_PEERS_TIMED_OUT 15
+#define METRIC_PEERS_REMOVED 16
+#define METRIC_BROADCAST_REQUESTS 17 // broadcasts asked for, over METRIC_BROADCASTS is the coalescing ratio
+#define METRIC_PKT_MERKLE_SYNC 18    // rounds of Merkle exchanges after the first (which comes with the REGISTER)
+#define METRIC_COUNTER_NUM 19
+
+//histograms, latencies in nanoseconds
+#define METRIC_HIST_RECONCILE 0      // applying one FILEUPDATE / FILEUPDATE_DELTA to the file table
+#define METRIC_HIST_PUBLISH 1        // publishing a snapshot of the file table
+#define METRIC_HIST_BROADCAST 2      // one broadcastFileTable, encoding and queueing included
+#define METRIC_HIST_ENCODE 3         // serializing one packet
+#define METRIC_HIST_SEND 4           // one writev to a peer
+#define METRIC_HIST_MONITOR 5        // one pass of monitorAlive
+#define METRIC_HIST_BROADCAST_DELAY 6  // from the first request of a coalesced batch to its broadcast
+#define METRIC_HIST_BROADCAST_BATCH 7  // requests coalesced into one broadcast (a count)
+#define METRIC_HIST_NUM 8
+
+//gauges, set by whoever changes the value
+#define METRIC_GAUGE_FILES 0
+#define METRIC_GAUGE_PEERS 1
+#define METRIC_GAUGE_EPOCH 2
+#define METRIC_GAUGE_NUM 3
+
+
+
+/* log-linear (HDR style) histogram: exact below METRICS_HIST_SUB, then METRICS_HIST_SUB buckets per power of two */
+typedef struct metricsHist{
+  unsigned long count;
+  unsigned long sum;
+  unsigned long max;
+  unsigned long buckets[METRICS_HIST_BUCKETS];
+}metricsHist_t;
+
+/* what one thread recorded, only it writes there so increments never contend */
+typedef struct metricsSlot{
+  unsigned long counters[METRIC_COUNTER_NUM];
+  metricsHist_t hists[METRIC_HIST_NUM];
+}metricsSlot_t;
+
+/**
+ * the tracker's counters, latency histograms and gauges
+ * recording is a few relaxed atomic adds into the calling thread's own slot; readers sum the slots up.
+ * Nothing is recorded before metrics_init, so code shared with tests needs no setup
+ */
+typedef struct metrics{
+  metricsSlot_t* slots;        // METRICS_MAX_THREADS + 1, the last one shared by threads beyond the others
+  int slotNum;                 // slots handed out
+  long gauges[METRIC_GAUGE_NUM];
+  unsigned long startTime;     // when metrics_init ran, in ns
+}metrics_t;
+
+
+
+
+int metrics_init();
+
+unsigned long metrics_now();
+
+void metrics_count(int counter, unsigned long n);
+
+void metrics_record(int hist, unsigned long ns);
+
+void metrics_histAdd(metricsHist_t* hist, unsigned long value);
+
+void metrics_histMerge(metricsHist_t* total, metricsHist_t* hist);
+
+void metrics_setGauge(int gauge, long value);
+
+int metrics_collect(metricsSlot_t* total);
+
+unsigned long metrics_percentile(metricsHist_t* hist, double q);
+
+int metrics_format(char* buf, int cap);
+
+int metrics_dump(const char* path);
+
+void metrics_destroy();
+
+
+#endif
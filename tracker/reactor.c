@@ -0,0 +1,551 @@
+/* File: reactor.c
+   Description: epoll based event loop owning all peer connections of the tracker.  A small,
+   		fixed number of workers (TRACKER_WORKER_NUM) each run an epoll loop over their share
+   		of the connections, parse peer packets incrementally as bytes arrive and dispatch
+   		every complete packet to the tracker's handler.  Replaces one handshake thread per peer.
+   		Sends never block: every connection has an outbound queue of shared, encoded packets,
+   		written as far as the socket takes them and drained by the worker on EPOLLOUT.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <assert.h>
+
+#include "reactor.h"
+#include "metrics.h"
+
+
+/**
+ * free a connection and everything it buffered or still had to send
+ * @param conn [connection to be freed]
+ */
+static void reactor_freeConn(peerConn_t* conn){
+	outMsg_t* msg = conn->outHead;
+	while(msg != NULL){
+		outMsg_t* next = msg->next;
+		pkt_buf_release(msg->buf);
+		free(msg);
+		msg = next;
+	}
+	pthread_mutex_destroy(&(conn->outMutex));
+	free(conn->buf);
+	free(conn);
+}
+
+/**
+ * the remote side went away (or sent garbage): tell the tracker, stop watching and close the socket
+ * the connection leaves the descriptor map first, so no sender can reach it once it is freed
+ * @param worker [worker owning the connection]
+ * @param conn   [the connection]
+ */
+static void reactor_closeConn(reactorWorker_t* worker, peerConn_t* conn){
+	reactor_t* reactor = worker->reactor;
+
+	pthread_mutex_lock(&(reactor->connsMutex));
+	reactor->conns[conn->connfd] = NULL;
+	pthread_mutex_unlock(&(reactor->connsMutex));
+
+	//wait for a sender that found the connection before it left the map
+	pthread_mutex_lock(&(conn->outMutex));
+	pthread_mutex_unlock(&(conn->outMutex));
+
+	epoll_ctl(worker->epfd, EPOLL_CTL_DEL, conn->connfd, NULL);
+	if(reactor->onClose) reactor->onClose(conn->connfd);
+	close(conn->connfd);
+	reactor_freeConn(conn);
+}
+
+/**
+ * watch the connection for writability only while something is queued
+ * @param conn     [the connection, caller holds outMutex]
+ * @param writable [1 to add EPOLLOUT, 0 to remove it]
+ */
+static void reactor_watchWritable(peerConn_t* conn, int writable){
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLRDHUP | (writable ? EPOLLOUT : 0);
+	ev.data.ptr = conn;
+	epoll_ctl(conn->worker->epfd, EPOLL_CTL_MOD, conn->connfd, &ev);
+}
+
+/**
+ * write as much of the queue as the socket takes without blocking, several messages per writev
+ * @param  conn [the connection, caller holds outMutex]
+ * @return      [1 if the queue is now empty, 0 if the socket is full, -1 if the connection is broken]
+ */
+static int reactor_flushLocked(peerConn_t* conn){
+	while(conn->outHead != NULL){
+		struct iovec iov[REACTOR_MAX_IOV];
+		int iovNum = 0;
+		outMsg_t* msg = conn->outHead;
+		while(msg != NULL && iovNum < REACTOR_MAX_IOV){
+			int skip = (iovNum == 0) ? conn->outOffset : 0;
+			iov[iovNum].iov_base = msg->buf->data + skip;
+			iov[iovNum].iov_len = msg->buf->len - skip;
+			iovNum ++;
+			msg = msg->next;
+		}
+
+		unsigned long start = metrics_now();
+		ssize_t n = writev(conn->connfd, iov, iovNum);
+		metrics_record(METRIC_HIST_SEND, metrics_now() - start);
+		metrics_count(METRIC_SEND_CALLS, 1);
+		if(n < 0){
+			if(errno == EINTR) continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+			conn->broken = 1;
+			return -1;
+		}
+
+		//retire every message written completely
+		metrics_count(METRIC_SENT_BYTES, n);
+		conn->outBytes -= n;
+		while(n > 0){
+			outMsg_t* head = conn->outHead;
+			int left = head->buf->len - conn->outOffset;
+			if(n < left){
+				conn->outOffset += n;
+				break;
+			}
+			n -= left;
+			conn->outOffset = 0;
+			conn->outHead = head->next;
+			if(conn->outHead == NULL) conn->outTail = NULL;
+			pkt_buf_release(head->buf);
+			free(head);
+		}
+	}
+	return 1;
+}
+
+/**
+ * the socket became writable: keep draining, stop watching EPOLLOUT once the queue is empty
+ * @param  worker [worker owning the connection]
+ * @param  conn   [writable connection]
+ * @return        [1 if the connection is still usable, -1 if it is broken]
+ */
+static int reactor_writeConn(reactorWorker_t* worker, peerConn_t* conn){
+	pthread_mutex_lock(&(conn->outMutex));
+	int ret = reactor_flushLocked(conn);
+	int drained = 0;
+	if(ret > 0){
+		reactor_watchWritable(conn, 0);
+		drained = conn->overflowed;
+		conn->overflowed = 0;
+	}
+	pthread_mutex_unlock(&(conn->outMutex));
+
+	if(ret < 0) return -1;
+	//the peer dropped messages while it was behind, now it can take a full table
+	if(drained && worker->reactor->onDrained) worker->reactor->onDrained(conn->connfd);
+	return 1;
+}
+
+/**
+ * hand every complete packet sitting at the front of conn->buf to the tracker, keep the remaining partial bytes
+ * @param  worker [worker owning the connection]
+ * @param  conn   [the connection]
+ * @return        [1 if success, -1 if the stream is malformed]
+ */
+static int reactor_dispatchFrames(reactorWorker_t* worker, peerConn_t* conn){
+
+	int offset = 0;
+	while(1){
+		int frameLen = pkt_peer_frameLen(conn->buf + offset, conn->len - offset);
+		if(frameLen < 0) return -1;
+		if(frameLen == 0 || conn->len - offset < frameLen) break;
+
+		ptp_peer_t pkt;
+		memset(&pkt, 0, sizeof(ptp_peer_t));
+		if(pkt_peer_decodePkt(conn->buf + offset, &pkt) < 0) return -1;
+		worker->reactor->onPacket(conn->connfd, &pkt);
+		offset += frameLen;
+	}
+
+	//shift the partial packet (if any) to the front of the buffer
+	if(offset > 0){
+		memmove(conn->buf, conn->buf + offset, conn->len - offset);
+		conn->len -= offset;
+	}
+	return 1;
+}
+
+/**
+ * drain everything the kernel has for this connection without blocking, then parse
+ * @param  worker [worker owning the connection]
+ * @param  conn   [readable connection]
+ * @return        [1 if the connection is still usable, -1 if it is closed or broken]
+ */
+static int reactor_readConn(reactorWorker_t* worker, peerConn_t* conn){
+
+	int closed = 0;
+	while(!closed){
+		//make sure there is room for at least one more chunk
+		if(conn->cap - conn->len < REACTOR_RECV_CHUNK){
+			int newCap = conn->cap * 2;
+			if(newCap < conn->len + REACTOR_RECV_CHUNK) newCap = conn->len + REACTOR_RECV_CHUNK;
+			char* newBuf = (char*) realloc(conn->buf, newCap);
+			if(newBuf == NULL) return -1;
+			conn->buf = newBuf;
+			conn->cap = newCap;
+		}
+
+		ssize_t n = recv(conn->connfd, conn->buf + conn->len, conn->cap - conn->len, MSG_DONTWAIT);
+		if(n > 0){
+			conn->len += n;
+			continue;
+		}
+		if(n == 0){
+			closed = 1; //peer closed the connection, still deliver what it sent before
+			break;
+		}
+		if(errno == EINTR) continue;
+		if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+		return -1;
+	}
+
+	if(reactor_dispatchFrames(worker, conn) < 0) return -1;
+	return closed ? -1 : 1;
+}
+
+/**
+ * worker thread: wait for readable connections and dispatch their packets
+ * @param  arg [the reactorWorker_t this thread runs]
+ */
+static void* reactor_workerLoop(void* arg){
+	reactorWorker_t* worker = (reactorWorker_t*) arg;
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+
+	while(1){
+		int n = epoll_wait(worker->epfd, events, REACTOR_MAX_EVENTS, -1);
+		if(n < 0){
+			if(errno == EINTR) continue;
+			printf("err in %s: epoll_wait failed\n", __func__);
+			break;
+		}
+
+		int i;
+		for(i = 0; i < n; i++){
+			peerConn_t* conn = (peerConn_t*) events[i].data.ptr;
+			//the stop event, left readable so that every worker sees it
+			if(conn == NULL) return NULL;
+			int ok = 1;
+			if(events[i].events & EPOLLOUT){
+				ok = reactor_writeConn(worker, conn);
+			}
+			if(ok > 0 && (events[i].events & ~EPOLLOUT)){
+				ok = reactor_readConn(worker, conn);
+			}
+			if(ok < 0){
+				reactor_closeConn(worker, conn);
+			}
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Create a reactor over an already listening socket.  Workers are not started yet (see reactor_start).
+ * @param  listenfd  [socket binded with HANDSHAKE_PORT]
+ * @param  workerNum [number of epoll worker threads]
+ * @param  onPacket  [called for every complete packet]
+ * @param  onClose   [called when a connection goes away, may be NULL]
+ * @param  onDrained [called when a connection that overflowed its budget has sent everything, may be NULL]
+ * @return           [the reactor, NULL if fails]
+ */
+reactor_t* reactor_init(int listenfd, int workerNum, reactor_pktHandler onPacket, reactor_closeHandler onClose, reactor_drainHandler onDrained){
+	assert(workerNum > 0 && onPacket != NULL);
+
+	reactor_t* reactor = (reactor_t*) malloc(sizeof(reactor_t));
+	reactor->listenfd = listenfd;
+	reactor->workerNum = workerNum;
+	reactor->nextWorker = 0;
+	reactor->onPacket = onPacket;
+	reactor->onClose = onClose;
+	reactor->onDrained = onDrained;
+	reactor->outBudget = TRACKER_PEER_OUT_BUDGET;
+	pthread_mutex_init(&(reactor->connsMutex), NULL);
+	reactor->connsCap = 1024;
+	reactor->conns = (peerConn_t**) calloc(reactor->connsCap, sizeof(peerConn_t*));
+	reactor->workers = (reactorWorker_t*) calloc(workerNum, sizeof(reactorWorker_t));
+	reactor->started = 0;
+
+	int i;
+	for(i = 0; i < workerNum; i++){
+		reactor->workers[i].epfd = -1;
+	}
+	reactor->stopfd = eventfd(0, EFD_NONBLOCK);
+	if(reactor->stopfd < 0){
+		printf("err in %s: eventfd failed\n", __func__);
+		reactor_destroy(reactor);
+		return NULL;
+	}
+	for(i = 0; i < workerNum; i++){
+		reactor->workers[i].reactor = reactor;
+		reactor->workers[i].epfd = epoll_create1(0);
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;
+		if(reactor->workers[i].epfd < 0 || epoll_ctl(reactor->workers[i].epfd, EPOLL_CTL_ADD, reactor->stopfd, &ev) < 0){
+			printf("err in %s: epoll_create1 failed\n", __func__);
+			reactor_destroy(reactor);
+			return NULL;
+		}
+	}
+	return reactor;
+}
+
+/**
+ * start the worker threads
+ * @param  reactor [the reactor]
+ * @return         [1 if success, -1 if fails]
+ */
+int reactor_start(reactor_t* reactor){
+	int i;
+	for(i = 0; i < reactor->workerNum; i++){
+		if(pthread_create(&(reactor->workers[i].thread), NULL, reactor_workerLoop, &(reactor->workers[i])) != 0){
+			printf("err in %s: failed to create worker %d\n", __func__, i);
+			reactor->started = i;
+			return -1;
+		}
+	}
+	reactor->started = reactor->workerNum;
+	return 1;
+}
+
+/* wait for the workers started to return, once stopped
+   @param reactor [the reactor] */
+static void reactor_joinWorkers(reactor_t* reactor){
+	int i;
+	for(i = 0; i < reactor->started; i++){
+		pthread_join(reactor->workers[i].thread, NULL);
+	}
+	reactor->started = 0;
+}
+
+/**
+ * hand a connected peer socket to one of the workers (round robin), which owns it from now on
+ * @param  reactor [the reactor]
+ * @param  connfd  [connected socket]
+ * @return         [1 if success, -1 if fails]
+ */
+int reactor_addConnection(reactor_t* reactor, int connfd){
+
+	peerConn_t* conn = (peerConn_t*) calloc(1, sizeof(peerConn_t));
+	conn->connfd = connfd;
+	pthread_mutex_init(&(conn->outMutex), NULL);
+
+	int one = 1;
+	setsockopt(connfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	//sends go through the outbound queue, a full socket must never block the caller
+	fcntl(connfd, F_SETFL, fcntl(connfd, F_GETFL, 0) | O_NONBLOCK);
+
+	reactorWorker_t* worker = &(reactor->workers[reactor->nextWorker]);
+	reactor->nextWorker = (reactor->nextWorker + 1) % reactor->workerNum;
+	conn->worker = worker;
+
+	//make the connection reachable by reactor_send before any packet of it is handled
+	pthread_mutex_lock(&(reactor->connsMutex));
+	if(connfd >= reactor->connsCap){
+		int newCap = reactor->connsCap;
+		while(connfd >= newCap) newCap *= 2;
+		reactor->conns = (peerConn_t**) realloc(reactor->conns, newCap * sizeof(peerConn_t*));
+		memset(reactor->conns + reactor->connsCap, 0, (newCap - reactor->connsCap) * sizeof(peerConn_t*));
+		reactor->connsCap = newCap;
+	}
+	reactor->conns[connfd] = conn;
+	pthread_mutex_unlock(&(reactor->connsMutex));
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.ptr = conn;
+	if(epoll_ctl(worker->epfd, EPOLL_CTL_ADD, connfd, &ev) < 0){
+		printf("err in %s: epoll_ctl failed\n", __func__);
+		pthread_mutex_lock(&(reactor->connsMutex));
+		reactor->conns[connfd] = NULL;
+		pthread_mutex_unlock(&(reactor->connsMutex));
+		reactor_freeConn(conn);
+		return -1;
+	}
+	return 1;
+}
+
+/**
+ * Queue an encoded packet for a connection and write as much of it as the socket takes right away,
+ * the owning worker sends the rest when the socket becomes writable.  Never blocks, callable from any thread.
+ * A new table broadcast supersedes the ones still waiting unsent.  A table broadcast that would take the
+ * queue over the budget is dropped and the connection reports REACTOR_SEND_OVERFLOW (and later onDrained).
+ * @param  reactor [the reactor]
+ * @param  connfd  [connection to send on]
+ * @param  buf     [encoded packet, the queue takes its own reference]
+ * @param  kind    [REACTOR_MSG_CONTROL or REACTOR_MSG_TABLE]
+ * @return         [REACTOR_SEND_OK, REACTOR_SEND_OVERFLOW or REACTOR_SEND_FAIL]
+ */
+int reactor_send(reactor_t* reactor, int connfd, pktBuf_t* buf, int kind){
+
+	pthread_mutex_lock(&(reactor->connsMutex));
+	peerConn_t* conn = (connfd >= 0 && connfd < reactor->connsCap) ? reactor->conns[connfd] : NULL;
+	if(conn == NULL){
+		pthread_mutex_unlock(&(reactor->connsMutex));
+		return REACTOR_SEND_FAIL;
+	}
+	pthread_mutex_lock(&(conn->outMutex));
+	pthread_mutex_unlock(&(reactor->connsMutex));
+
+	if(conn->broken){
+		pthread_mutex_unlock(&(conn->outMutex));
+		return REACTOR_SEND_FAIL;
+	}
+
+	if(kind == REACTOR_MSG_TABLE){
+		//drop superseded broadcasts, except one already partly on the wire
+		outMsg_t* prev = NULL;
+		outMsg_t* msg = conn->outHead;
+		while(msg != NULL){
+			outMsg_t* next = msg->next;
+			if(msg->kind == REACTOR_MSG_TABLE && !(msg == conn->outHead && conn->outOffset > 0)){
+				if(prev == NULL) conn->outHead = next;
+				else prev->next = next;
+				if(conn->outTail == msg) conn->outTail = prev;
+				conn->outBytes -= msg->buf->len;
+				pkt_buf_release(msg->buf);
+				free(msg);
+				metrics_count(METRIC_SEND_SUPERSEDED, 1);
+			} else {
+				prev = msg;
+			}
+			msg = next;
+		}
+
+		//an empty queue always takes the message, otherwise a table larger than the budget could never be sent
+		if(conn->outHead != NULL && conn->outBytes + buf->len > reactor->outBudget){
+			conn->overflowed = 1;
+			pthread_mutex_unlock(&(conn->outMutex));
+			metrics_count(METRIC_SEND_OVERFLOW, 1);
+			return REACTOR_SEND_OVERFLOW;
+		}
+	}
+
+	outMsg_t* msg = (outMsg_t*) malloc(sizeof(outMsg_t));
+	pkt_buf_retain(buf);
+	msg->buf = buf;
+	msg->kind = kind;
+	msg->next = NULL;
+	int wasEmpty = (conn->outHead == NULL);
+	if(wasEmpty) conn->outHead = msg;
+	else conn->outTail->next = msg;
+	conn->outTail = msg;
+	conn->outBytes += buf->len;
+
+	//only the caller that finds the queue empty writes, otherwise the worker is already waiting for EPOLLOUT
+	int ret = REACTOR_SEND_OK;
+	if(wasEmpty){
+		int flushed = reactor_flushLocked(conn);
+		if(flushed == 0){
+			reactor_watchWritable(conn, 1);
+		} else if(flushed < 0){
+			//let the worker notice the failure and close the connection
+			reactor_watchWritable(conn, 1);
+			ret = REACTOR_SEND_FAIL;
+		}
+	}
+	pthread_mutex_unlock(&(conn->outMutex));
+	return ret;
+}
+
+/**
+ * accept loop, runs in the calling thread until reactor_stop: every accepted peer is handed to a worker
+ * returns once every worker has returned as well
+ * @param reactor [the reactor, workers already started]
+ */
+void reactor_run(reactor_t* reactor){
+	struct pollfd fds[2];
+	fds[0].fd = reactor->listenfd;
+	fds[0].events = POLLIN;
+	fds[1].fd = reactor->stopfd;
+	fds[1].events = POLLIN;
+	while(1){
+		if(poll(fds, 2, -1) < 0){
+			if(errno == EINTR) continue;
+			printf("err in %s: poll failed\n", __func__);
+			break;
+		}
+		if(fds[1].revents & POLLIN) break;
+		if(!(fds[0].revents & POLLIN)) continue;
+
+		struct sockaddr_in client_addr;
+		socklen_t length = sizeof(client_addr);
+		int connfd = accept(reactor->listenfd, (struct sockaddr*) &client_addr, &length);
+		if(connfd < 0){
+			if(errno == EINTR || errno == ECONNABORTED) continue;
+			printf("err in %s: accept failed\n", __func__);
+			if(errno == EMFILE || errno == ENFILE){
+				sleep(1);
+				continue;
+			}
+			break;
+		}
+
+		if(reactor_addConnection(reactor, connfd) < 0){
+			close(connfd);
+		}
+	}
+
+	//no packet is handled any more once this returns
+	reactor_stop(reactor);
+	reactor_joinWorkers(reactor);
+}
+
+/**
+ * make reactor_run and every worker return, without waiting for them
+ * only writes to an eventfd, so it may be called from a signal handler
+ * @param reactor [the reactor]
+ */
+void reactor_stop(reactor_t* reactor){
+	uint64_t one = 1;
+	ssize_t n = write(reactor->stopfd, &one, sizeof(one));
+	(void) n;
+}
+
+/**
+ * stop the workers if still running, close the connections still open and the epoll instances, and free the reactor
+ * @param reactor [the reactor]
+ */
+void reactor_destroy(reactor_t* reactor){
+	if(reactor->started > 0){
+		reactor_stop(reactor);
+		reactor_joinWorkers(reactor);
+	}
+	if(reactor->stopfd >= 0) close(reactor->stopfd);
+	int i;
+	//no worker is left to close the connections still open, whatever they had queued is dropped
+	for(i = 0; i < reactor->connsCap; i++){
+		if(reactor->conns[i] != NULL){
+			close(reactor->conns[i]->connfd);
+			reactor_freeConn(reactor->conns[i]);
+		}
+	}
+	for(i = 0; i < reactor->workerNum; i++){
+		if(reactor->workers[i].epfd >= 0) close(reactor->workers[i].epfd);
+	}
+	pthread_mutex_destroy(&(reactor->connsMutex));
+	free(reactor->conns);
+	free(reactor->workers);
+	free(reactor);
+}
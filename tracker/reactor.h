@@ -0,0 +1,112 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <pthread.h>
+#include "../common/constants.h"
+#include "../common/pkt.h"
+
+#define REACTOR_MAX_EVENTS 64
+#define REACTOR_RECV_CHUNK 4096
+#define REACTOR_MAX_IOV 64           // queued messages written by one writev
+
+//kinds of outbound messages
+#define REACTOR_MSG_CONTROL 1        // setup, acks: always delivered, in order
+#define REACTOR_MSG_TABLE 2          // table broadcast: superseded by the next one, dropped if still unsent
+
+//results of reactor_send
+#define REACTOR_SEND_OK 1
+#define REACTOR_SEND_OVERFLOW 0      // over the connection's budget, message dropped, peer needs a full resync
+#define REACTOR_SEND_FAIL -1
+
+
+/* called by a worker for every complete packet, pkt->filetableHeadPtr belongs to the handler */
+typedef void (*reactor_pktHandler)(int connfd, ptp_peer_t* pkt);
+
+/* called by a worker once a connection is closed by the remote side or fails, before close(connfd) */
+typedef void (*reactor_closeHandler)(int connfd);
+
+/* called by a worker once the outbound queue of a connection that overflowed has been fully sent */
+typedef void (*reactor_drainHandler)(int connfd);
+
+
+
+/* one message waiting to be sent, the buffer is shared with other connections */
+typedef struct outMsg{
+	pktBuf_t* buf;
+	int kind;                  // REACTOR_MSG_CONTROL or REACTOR_MSG_TABLE
+	struct outMsg* next;
+}outMsg_t;
+
+
+
+/**
+ * one peer connection owned by a worker
+ * bytes are accumulated in buf until a whole packet (see pkt_peer_frameLen) has arrived
+ * outbound messages wait in a queue drained by the worker whenever the socket is writable
+ */
+typedef struct peerConn{
+	int connfd;
+	char* buf;      // received bytes not yet parsed into packets
+	int len;        // number of valid bytes in buf
+	int cap;        // allocated size of buf
+
+	struct reactorWorker* worker; // worker whose epoll set watches connfd
+	pthread_mutex_t outMutex;     // guards everything below, senders run on any thread
+	outMsg_t* outHead;            // oldest message, possibly partly written
+	outMsg_t* outTail;
+	int outOffset;                // bytes of outHead already written
+	long outBytes;                // unsent bytes queued
+	int overflowed;               // a message was dropped for the budget, report once drained
+	int broken;                   // a write failed, the worker closes the connection
+}peerConn_t;
+
+
+
+struct reactor;
+
+/* each worker runs its own epoll loop over the connections handed to it */
+typedef struct reactorWorker{
+	int epfd;
+	pthread_t thread;
+	struct reactor* reactor;
+}reactorWorker_t;
+
+
+
+typedef struct reactor{
+	int listenfd;                  // socket binded with HANDSHAKE_PORT
+	int workerNum;
+	reactorWorker_t* workers;
+	int nextWorker;                // round robin assignment of new connections
+	reactor_pktHandler onPacket;
+	reactor_closeHandler onClose;
+	reactor_drainHandler onDrained;
+	long outBudget;                // unsent bytes allowed per connection before table broadcasts are dropped
+
+	pthread_mutex_t connsMutex;    // guards conns, senders look connections up by descriptor
+	peerConn_t** conns;            // indexed by connfd
+	int connsCap;
+
+	int stopfd;                    // eventfd in every worker's epoll set, readable once reactor_stop is called
+	int started;                   // workers running, joined by reactor_run or reactor_destroy once stopped
+}reactor_t;
+
+
+
+
+reactor_t* reactor_init(int listenfd, int workerNum, reactor_pktHandler onPacket, reactor_closeHandler onClose, reactor_drainHandler onDrained);
+
+int reactor_start(reactor_t* reactor);
+
+int reactor_addConnection(reactor_t* reactor, int connfd);
+
+int reactor_send(reactor_t* reactor, int connfd, pktBuf_t* buf, int kind);
+
+void reactor_run(reactor_t* reactor);
+
+void reactor_stop(reactor_t* reactor);
+
+void reactor_destroy(reactor_t* reactor);
+
+
+#endif
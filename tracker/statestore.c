@@ -0,0 +1,633 @@
+/* File: statestore.c
+   Description: Crash-safe copy of the tracker's file and peer tables on disk.  A snapshot of both
+   		tables, laid out to be mapped and read in place, is written every TRACKER_SNAPSHOT_INTERVAL
+   		(or once the change log passes TRACKER_LOG_MAX_BYTES); every published batch of changes and
+   		every table version acknowledged to a peer is appended to a change log in between.  On boot
+   		the snapshot is mapped and the log replayed, peers come back as entries without a connection
+   		that keep their files and table version until they reconnect or time out.  Unit tested in the
+   		testing directory with statestore_test.c
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <assert.h>
+
+#include "statestore.h"
+#include "../common/filedelta.h"
+#include "../common/filecodec.h"
+#include "../common/utils.h"
+
+
+/**
+ * FNV-1a over len bytes, continuing from hash (2166136261u to start)
+ */
+static unsigned int statestore_checksum(unsigned int hash, const void* data, long len){
+	const unsigned char* iter = (const unsigned char*) data;
+	long i;
+	for(i = 0; i < len; i++){
+		hash ^= iter[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * write all of len bytes, retrying short writes
+ * @return [1 if success, -1 if failure]
+ */
+static int statestore_writeAll(int fd, const char* data, long len){
+	while(len > 0){
+		ssize_t n = write(fd, data, len);
+		if(n < 0){
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		data += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/**
+ * empty the change log and start it over on top of the snapshot of generation
+ * @param  store      [the store, mutex held]
+ * @param  generation [generation of the snapshot on disk, 0 = none]
+ * @return            [1 if success, -1 if failure]
+ */
+static int statestore_resetLog(stateStore_t* store, unsigned long generation){
+	stateLogHeader_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, STATESTORE_LOG_MAGIC, STATESTORE_MAGIC_LEN);
+	header.generation = generation;
+
+	if(ftruncate(store->logfd, 0) < 0 || statestore_writeAll(store->logfd, (char*) &header, sizeof(header)) < 0){
+		printf("%s: error: cannot reset %s: %s\n", __func__, store->logPath, strerror(errno));
+		return -1;
+	}
+	fdatasync(store->logfd);
+	store->logBytes = 0;
+	store->dirty = 0;
+	return 1;
+}
+
+/**
+ * append one record to the change log, a failed append is cut off again so it cannot hide later records
+ * @param  store [the store, mutex held]
+ * @param  type  [STATESTORE_CHANGES, STATESTORE_PEER or STATESTORE_PEER_GONE]
+ * @param  num   [number of deltas in body]
+ * @param  value [epoch or table version, see stateRecord_t]
+ * @param  body  [the body]
+ * @param  len   [bytes of body]
+ * @return       [1 if success, -1 if failure]
+ */
+static int statestore_writeRecord(stateStore_t* store, int type, int num, unsigned long value, char* body, int len){
+	char* buf = (char*) malloc(sizeof(stateRecord_t) + len);
+	stateRecord_t record;
+	memset(&record, 0, sizeof(record));
+	record.type = type;
+	record.num = num;
+	record.len = len;
+	record.value = value;
+	unsigned int checksum = statestore_checksum(2166136261u, &record, sizeof(record));
+	record.checksum = statestore_checksum(checksum, body, len);
+	memcpy(buf, &record, sizeof(record));
+	memcpy(buf + sizeof(record), body, len);
+
+	int ret = statestore_writeAll(store->logfd, buf, sizeof(record) + len);
+	free(buf);
+	if(ret < 0){
+		printf("%s: error: cannot append to %s: %s\n", __func__, store->logPath, strerror(errno));
+		if(ftruncate(store->logfd, sizeof(stateLogHeader_t) + store->logBytes) < 0){
+			printf("%s: error: cannot cut off the failed record: %s\n", __func__, strerror(errno));
+		}
+		return -1;
+	}
+	store->logBytes += sizeof(record) + len;
+	store->dirty = 1;
+	return 1;
+}
+
+/**
+ * write a snapshot of the table and the peers, then start an empty change log on top of it
+ * written to a temporary file, synced and renamed over the old snapshot, so a crash leaves one or the other whole
+ * @param  store    [the store, mutex held]
+ * @param  snapshot [snapshot of the file table, at least as new as store->epoch]
+ * @param  peers    [the peer table, its mutex is taken to copy the peers]
+ * @return          [1 if success, -1 if failure]
+ */
+static int statestore_writeSnapshotLocked(stateStore_t* store, fileSnapshot_t* snapshot, peerTable_t* peers){
+	FILE* file = fopen(store->tmpPath, "w");
+	if(file == NULL){
+		printf("%s: error: cannot create %s: %s\n", __func__, store->tmpPath, strerror(errno));
+		return -1;
+	}
+
+	//the peers as they are now, later changes to them go to the new log
+	pthread_mutex_lock(peers->peertable_mutex);
+	int peerNum = peers->size;
+	statePeer_t* peerList = (statePeer_t*) calloc(peerNum + 1, sizeof(statePeer_t));
+	peerEntry_t* peer = peers->head;
+	int i = 0;
+	while(peer != NULL && i < peerNum){
+		memcpy(peerList[i].ip, peer->ip, IP_LEN);
+		peerList[i].ip[IP_LEN - 1] = '\0';
+		peerList[i].tableVersion = peer->tableVersion;
+		peer = peer->next;
+		i ++;
+	}
+	pthread_mutex_unlock(peers->peertable_mutex);
+
+	//the holders are ids, the dictionary makes them mean the same after a restart
+	//every id in the snapshot was handed out before it was taken, so it is below the bound
+	int ipNum = peerid_bound(peers->ids);
+	char (*ips)[IP_LEN] = calloc(ipNum > 0 ? ipNum : 1, IP_LEN);
+	for(i = 0; i < ipNum; i++){
+		peerid_getIp(peers->ids, i, ips[i]);
+	}
+
+	stateSnapshotHeader_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, STATESTORE_SNAPSHOT_MAGIC, STATESTORE_MAGIC_LEN);
+	header.generation = store->generation + 1;
+	header.epoch = snapshot->epoch;
+	header.entryNum = snapshot->size;
+	header.peerNum = peerNum;
+	header.ipNum = ipNum;
+
+	unsigned int checksum = 2166136261u;
+	int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(peerList, sizeof(statePeer_t), peerNum, file) == (size_t) peerNum;
+	checksum = statestore_checksum(checksum, peerList, peerNum * sizeof(statePeer_t));
+
+	fileEntry_t* entry = snapshot->head;
+	stateEntry_t record;
+	while(ok && entry != NULL){
+		//zeroed first, so the padding does not change the checksum
+		memset(&record, 0, sizeof(record));
+		memcpy(record.file_name, entry->file_name, FILE_NAME_MAX_LEN);
+		record.size = entry->size;
+		record.timestamp = entry->timestamp;
+		int id;
+		for(id = filetable_nextHolder(entry, 0); id >= 0 && id < ipNum; id = filetable_nextHolder(entry, id + 1)){
+			record.holderNum ++;
+		}
+		header.holderNum += record.holderNum;
+		ok = fwrite(&record, sizeof(record), 1, file) == 1;
+		checksum = statestore_checksum(checksum, &record, sizeof(record));
+		entry = entry->next;
+	}
+
+	entry = snapshot->head;
+	while(ok && entry != NULL){
+		int id;
+		for(id = filetable_nextHolder(entry, 0); ok && id >= 0 && id < ipNum; id = filetable_nextHolder(entry, id + 1)){
+			ok = fwrite(&id, sizeof(int), 1, file) == 1;
+			checksum = statestore_checksum(checksum, &id, sizeof(int));
+		}
+		entry = entry->next;
+	}
+
+	ok = ok && fwrite(ips, IP_LEN, ipNum, file) == (size_t) ipNum;
+	checksum = statestore_checksum(checksum, ips, (long) ipNum * IP_LEN);
+	free(peerList);
+	free(ips);
+
+	header.checksum = checksum;
+	ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+	ok = (fclose(file) == 0) && ok;
+	if(!ok || rename(store->tmpPath, store->snapshotPath) < 0){
+		printf("%s: error: cannot write %s: %s\n", __func__, store->snapshotPath, strerror(errno));
+		unlink(store->tmpPath);
+		return -1;
+	}
+
+	//make the rename itself durable before the log it replaces is emptied
+	int dirfd = open(store->dir, O_RDONLY);
+	if(dirfd >= 0){
+		fsync(dirfd);
+		close(dirfd);
+	}
+
+	store->generation = header.generation;
+	__atomic_store_n(&(store->epoch), snapshot->epoch, __ATOMIC_RELEASE);
+	store->snapshotTime = getCurrentTime();
+	return statestore_resetLog(store, store->generation);
+}
+
+/**
+ * the peer with ip, added without a connection (sockfd -1) if the table does not have it
+ * its alive timer starts now, it has DEAD_PEER_TIMEOUT to reconnect
+ * @param  peers        [the peer table]
+ * @param  ip           [the ip, IP_LEN bytes]
+ * @param  tableVersion [the peer's table version the tracker applied]
+ */
+static void statestore_restorePeer(peerTable_t* peers, const char* ip, unsigned long tableVersion){
+	char peerIp[IP_LEN];
+	memcpy(peerIp, ip, IP_LEN);
+	peerIp[IP_LEN - 1] = '\0';
+
+	peerEntry_t* peer = peertable_searchEntryByIp(peers, peerIp);
+	if(peer == NULL){
+		peer = peertable_createEntry(peerIp, -1);
+		peertable_addEntry(peers, peer);
+	}
+	peer->tableVersion = tableVersion;
+}
+
+/**
+ * map the snapshot and load its peers and files into the (empty) tables
+ * @param  store [the store]
+ * @param  table [the file table]
+ * @param  peers [the peer table]
+ * @return       [1 if loaded, 0 if there is no snapshot, -1 if it is unreadable]
+ */
+static int statestore_loadSnapshot(stateStore_t* store, fileTable_t* table, peerTable_t* peers){
+	int fd = open(store->snapshotPath, O_RDONLY);
+	if(fd < 0){
+		if(errno == ENOENT) return 0;
+		printf("%s: error: cannot open %s: %s\n", __func__, store->snapshotPath, strerror(errno));
+		return -1;
+	}
+	struct stat st;
+	if(fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(stateSnapshotHeader_t)){
+		printf("%s: error: %s is truncated\n", __func__, store->snapshotPath);
+		close(fd);
+		return -1;
+	}
+	char* map = (char*) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED){
+		printf("%s: error: cannot map %s: %s\n", __func__, store->snapshotPath, strerror(errno));
+		return -1;
+	}
+
+	stateSnapshotHeader_t* header = (stateSnapshotHeader_t*) map;
+	statePeer_t* peerList = (statePeer_t*) (map + sizeof(stateSnapshotHeader_t));
+	int bad = header->peerNum < 0 || header->entryNum < 0 || header->holderNum < 0 || header->ipNum < 0;
+	stateEntry_t* entries = (stateEntry_t*) (peerList + (bad ? 0 : header->peerNum));
+	int* holders = (int*) (entries + (bad ? 0 : header->entryNum));
+	char (*ips)[IP_LEN] = (char (*)[IP_LEN]) (holders + (bad ? 0 : header->holderNum));
+	long expected = bad ? -1 :
+		(long) sizeof(stateSnapshotHeader_t) + (long) header->peerNum * sizeof(statePeer_t)
+		+ (long) header->entryNum * sizeof(stateEntry_t) + (long) header->holderNum * sizeof(int) + (long) header->ipNum * IP_LEN;
+	if(memcmp(header->magic, STATESTORE_SNAPSHOT_MAGIC, STATESTORE_MAGIC_LEN) != 0){
+		printf("%s: error: %s is not a snapshot of this version\n", __func__, store->snapshotPath);
+		munmap(map, st.st_size);
+		return -1;
+	}
+	if(expected != (long) st.st_size
+		|| statestore_checksum(2166136261u, peerList, st.st_size - sizeof(stateSnapshotHeader_t)) != header->checksum){
+		printf("%s: error: %s is corrupt\n", __func__, store->snapshotPath);
+		munmap(map, st.st_size);
+		return -1;
+	}
+
+	int i;
+	for(i = 0; i < header->peerNum; i++){
+		statestore_restorePeer(peers, peerList[i].ip, peerList[i].tableVersion);
+	}
+
+	//snapshot id -> id of the restored peer, holders that were not peers any more are dropped
+	int* remap = (int*) malloc((header->ipNum > 0 ? header->ipNum : 1) * sizeof(int));
+	for(i = 0; i < header->ipNum; i++){
+		char ip[IP_LEN];
+		memcpy(ip, ips[i], IP_LEN);
+		ip[IP_LEN - 1] = '\0';
+		remap[i] = (ip[0] != '\0') ? peerid_lookup(peers->ids, ip) : PEERID_NONE;
+	}
+
+	int holder = 0;
+	for(i = 0; i < header->entryNum; i++){
+		fileEntry_t* entry = (fileEntry_t*) calloc(1, sizeof(fileEntry_t));
+		memcpy(entry->file_name, entries[i].file_name, FILE_NAME_MAX_LEN);
+		entry->file_name[FILE_NAME_MAX_LEN - 1] = '\0';
+		entry->size = entries[i].size;
+		entry->timestamp = entries[i].timestamp;
+		//a count that runs past the holder list is cut at its end, the checksum vouches for the rest
+		int j;
+		for(j = 0; j < entries[i].holderNum && holder < header->holderNum; j++, holder++){
+			int id = holders[holder];
+			if(id >= 0 && id < header->ipNum){
+				filetable_addHolderLocked(entry, remap[id]);
+			}
+		}
+		filetable_appendFileEntry(table, entry);
+	}
+	free(remap);
+
+	store->generation = header->generation;
+	store->epoch = header->epoch;
+	munmap(map, st.st_size);
+	return 1;
+}
+
+/**
+ * apply one change log record to the tables
+ * @param  store  [the store]
+ * @param  record [the record]
+ * @param  body   [its body]
+ * @param  table  [the file table]
+ * @param  peers  [the peer table]
+ * @return        [1 if applied or skipped, -1 if the body is malformed]
+ */
+static int statestore_replayRecord(stateStore_t* store, stateRecord_t* record, char* body, fileTable_t* table, peerTable_t* peers){
+	if(record->type == STATESTORE_CHANGES){
+		//already in the snapshot
+		if(record->value <= store->epoch) return 1;
+		fileEntry_t* entries;
+		fileDelta_t* deltas;
+		if(filecodec_decode(body, record->len, 0, &entries, record->num, &deltas, peers->ids) < 0) return -1;
+		filedelta_apply(table, deltas);
+		filedelta_freeList(deltas);
+		store->epoch = record->value;
+		return 1;
+	}
+
+	if(record->len != IP_LEN) return -1;
+	if(record->type == STATESTORE_PEER){
+		statestore_restorePeer(peers, body, record->value);
+		return 1;
+	}
+	if(record->type == STATESTORE_PEER_GONE){
+		char ip[IP_LEN];
+		memcpy(ip, body, IP_LEN);
+		ip[IP_LEN - 1] = '\0';
+		peerEntry_t* peer = peertable_searchEntryByIp(peers, ip);
+		if(peer != NULL){
+			filetable_deleteHolderFromAllEntries(table, peer->id);
+			peertable_deleteEntryByIp(peers, ip);
+		}
+		return 1;
+	}
+	return -1;
+}
+
+/**
+ * replay the change log on top of the loaded snapshot, a log written for another snapshot is discarded
+ * the log is cut at the first record that is torn or corrupt, later appends go right after the last good one
+ * @return [number of records replayed]
+ */
+static int statestore_replayLog(stateStore_t* store, fileTable_t* table, peerTable_t* peers){
+	struct stat st;
+	if(fstat(store->logfd, &st) < 0) st.st_size = 0;
+	long size = st.st_size;
+
+	char* data = NULL;
+	if(size > 0){
+		data = (char*) mmap(NULL, size, PROT_READ, MAP_PRIVATE, store->logfd, 0);
+		if(data == MAP_FAILED){
+			printf("%s: error: cannot map %s: %s\n", __func__, store->logPath, strerror(errno));
+			data = NULL;
+		}
+	}
+
+	stateLogHeader_t header;
+	if(data == NULL || size < (long) sizeof(header)){
+		if(data != NULL) munmap(data, size);
+		statestore_resetLog(store, store->generation);
+		return 0;
+	}
+	memcpy(&header, data, sizeof(header));
+	if(memcmp(header.magic, STATESTORE_LOG_MAGIC, STATESTORE_MAGIC_LEN) != 0 || header.generation != store->generation){
+		//left over from before the snapshot was written (or garbage), the snapshot already has all of it
+		munmap(data, size);
+		statestore_resetLog(store, store->generation);
+		return 0;
+	}
+
+	int replayed = 0;
+	long offset = sizeof(header);
+	while(offset + (long) sizeof(stateRecord_t) <= size){
+		stateRecord_t record;
+		memcpy(&record, data + offset, sizeof(record));
+		if(record.len < 0 || record.len > size - offset - (long) sizeof(record)) break;
+		char* body = data + offset + sizeof(record);
+
+		unsigned int checksum = record.checksum;
+		record.checksum = 0;
+		unsigned int expected = statestore_checksum(statestore_checksum(2166136261u, &record, sizeof(record)), body, record.len);
+		if(checksum != expected) break;
+		if(statestore_replayRecord(store, &record, body, table, peers) < 0) break;
+
+		offset += sizeof(record) + record.len;
+		replayed ++;
+	}
+	munmap(data, size);
+
+	if(offset < size){
+		printf("%s: dropping %ld bytes of torn or corrupt records at the end of %s\n", __func__, size - offset, store->logPath);
+		if(ftruncate(store->logfd, offset) < 0){
+			printf("%s: error: cannot truncate %s: %s\n", __func__, store->logPath, strerror(errno));
+		}
+	}
+	store->logBytes = offset - sizeof(header);
+	return replayed;
+}
+
+/**
+ * holder ids the replayed changes interned for ips no peer entry has: take them off every file and free them
+ * (the decoder takes one reference for every ip it did not know)
+ */
+static void statestore_dropUnknownHolders(fileTable_t* table, peerTable_t* peers){
+	int bound = peerid_bound(peers->ids);
+	char* owned = (char*) calloc(bound > 0 ? bound : 1, 1);
+	peerEntry_t* peer = peers->head;
+	while(peer != NULL){
+		if(peer->id >= 0 && peer->id < bound) owned[peer->id] = 1;
+		peer = peer->next;
+	}
+
+	int id;
+	char ip[IP_LEN];
+	for(id = 0; id < bound; id++){
+		if(!owned[id] && peerid_getIp(peers->ids, id, ip) > 0){
+			filetable_deleteHolderFromAllEntries(table, id);
+			peerid_release(peers->ids, id);
+		}
+	}
+	free(owned);
+}
+
+/* Function to open the store kept in dir, which is created if missing.  Nothing is read
+	until statestore_load.
+
+	@return the pointer to the stateStore_t that is created, NULL if dir cannot be used.
+*/
+stateStore_t* statestore_open(const char* dir){
+	if(mkdir(dir, 0755) < 0 && errno != EEXIST){
+		printf("%s: error: cannot create %s: %s\n", __func__, dir, strerror(errno));
+		return NULL;
+	}
+
+	stateStore_t* store = (stateStore_t*) calloc(1, sizeof(stateStore_t));
+	snprintf(store->dir, STATESTORE_PATH_LEN, "%s", dir);
+	snprintf(store->snapshotPath, STATESTORE_PATH_LEN, "%s/tables.snap", dir);
+	snprintf(store->tmpPath, STATESTORE_PATH_LEN, "%s/tables.snap.tmp", dir);
+	snprintf(store->logPath, STATESTORE_PATH_LEN, "%s/tables.log", dir);
+
+	store->logfd = open(store->logPath, O_RDWR | O_CREAT | O_APPEND, 0644);
+	if(store->logfd < 0){
+		printf("%s: error: cannot open %s: %s\n", __func__, store->logPath, strerror(errno));
+		free(store);
+		return NULL;
+	}
+	pthread_mutex_init(&(store->mutex), NULL);
+	store->snapshotTime = getCurrentTime();
+	return store;
+}
+
+/**
+ * restore the tables from the snapshot and the change log, before any peer connects
+ * the peers come back without a connection (sockfd -1), holding their files and table versions
+ * @param  store [the store]
+ * @param  table [an empty file table]
+ * @param  peers [an empty peer table]
+ * @return       [1 if success (store->epoch is the epoch of the restored table), -1 if the snapshot is unreadable and the tables are left empty]
+ */
+int statestore_load(stateStore_t* store, fileTable_t* table, peerTable_t* peers){
+	pthread_mutex_lock(&(store->mutex));
+	int ret = statestore_loadSnapshot(store, table, peers);
+	if(ret < 0){
+		//start over, the next snapshot replaces the unreadable one
+		store->generation = 0;
+		store->epoch = 0;
+		statestore_resetLog(store, 0);
+		pthread_mutex_unlock(&(store->mutex));
+		return -1;
+	}
+	statestore_replayLog(store, table, peers);
+	statestore_dropUnknownHolders(table, peers);
+	store->snapshotTime = getCurrentTime();
+	pthread_mutex_unlock(&(store->mutex));
+	return 1;
+}
+
+/**
+ * append the files changed since what the store has, up to the latest published snapshot of the table
+ * called after every publish; if the changelog no longer reaches back that far a new snapshot is written instead
+ * @param  store [the store]
+ * @param  table [the file table]
+ * @param  log   [the table's changelog]
+ * @param  peers [the peer table, resolves the holders]
+ * @return       [1 if success, -1 if failure]
+ */
+int statestore_appendChanges(stateStore_t* store, fileTable_t* table, changeLog_t* log, peerTable_t* peers){
+	pthread_mutex_lock(&(store->mutex));
+	fileSnapshot_t* snapshot = filetable_acquireSnapshot(table);
+	int ret = 1;
+	if(snapshot->epoch > store->epoch){
+		int num;
+		changeRecord_t* changes = changelog_between(log, store->epoch, snapshot->epoch, &num);
+		if(num < 0){
+			ret = statestore_writeSnapshotLocked(store, snapshot, peers);
+		} else {
+			fileDelta_t* deltas = filedelta_fromChanges(snapshot, changes, num);
+			fileCodec_t* codec = filecodec_init(peers->ids);
+			int len = filecodec_measure(codec, NULL, 0, deltas, num);
+			char* body = (char*) malloc(len + 1);
+			filecodec_encode(codec, body, NULL, 0, deltas, num);
+			filecodec_destroy(codec);
+
+			ret = statestore_writeRecord(store, STATESTORE_CHANGES, num, snapshot->epoch, body, len);
+			if(ret > 0) __atomic_store_n(&(store->epoch), snapshot->epoch, __ATOMIC_RELEASE);
+			free(body);
+			filedelta_freeList(deltas);
+		}
+		free(changes);
+	}
+	filetable_releaseSnapshot(snapshot);
+	pthread_mutex_unlock(&(store->mutex));
+	return ret;
+}
+
+/**
+ * the epoch of the file table the store reaches, changes up to it survive a crash
+ * read without the store's mutex, so it may be asked with the peer table's mutex held
+ * @param  store [the store]
+ * @return       [the epoch]
+ */
+unsigned long statestore_getEpoch(stateStore_t* store){
+	return __atomic_load_n(&(store->epoch), __ATOMIC_ACQUIRE);
+}
+
+/**
+ * append a change to a peer
+ * @param  store        [the store]
+ * @param  type         [STATESTORE_PEER: the peer's table version was applied, STATESTORE_PEER_GONE: the peer left]
+ * @param  ip           [the peer's ip]
+ * @param  tableVersion [STATESTORE_PEER: the version]
+ * @return              [1 if success, -1 if failure]
+ */
+int statestore_appendPeer(stateStore_t* store, int type, char* ip, unsigned long tableVersion){
+	char body[IP_LEN];
+	memset(body, 0, IP_LEN);
+	strncpy(body, ip, IP_LEN - 1);
+
+	pthread_mutex_lock(&(store->mutex));
+	int ret = statestore_writeRecord(store, type, 0, type == STATESTORE_PEER ? tableVersion : 0, body, IP_LEN);
+	pthread_mutex_unlock(&(store->mutex));
+	return ret;
+}
+
+/**
+ * fold everything into a new snapshot of the latest published table and the peers, the change log starts over
+ * @param  store [the store]
+ * @param  table [the file table]
+ * @param  peers [the peer table]
+ * @return       [1 if success, -1 if failure]
+ */
+int statestore_writeSnapshot(stateStore_t* store, fileTable_t* table, peerTable_t* peers){
+	pthread_mutex_lock(&(store->mutex));
+	fileSnapshot_t* snapshot = filetable_acquireSnapshot(table);
+	int ret = statestore_writeSnapshotLocked(store, snapshot, peers);
+	filetable_releaseSnapshot(snapshot);
+	pthread_mutex_unlock(&(store->mutex));
+	return ret;
+}
+
+/**
+ * called periodically: sync the records appended since the last call to disk, and write a new
+ * snapshot once the log is past TRACKER_LOG_MAX_BYTES or TRACKER_SNAPSHOT_INTERVAL has gone by
+ * @param  store [the store]
+ * @param  table [the file table]
+ * @param  peers [the peer table]
+ * @param  now   [current time, in seconds]
+ * @return       [1 if a snapshot was written, 0 if not needed, -1 if failure]
+ */
+int statestore_maintain(stateStore_t* store, fileTable_t* table, peerTable_t* peers, unsigned long now){
+	pthread_mutex_lock(&(store->mutex));
+	if(store->dirty){
+		fdatasync(store->logfd);
+		store->dirty = 0;
+	}
+
+	int ret = 0;
+	if(store->logBytes > TRACKER_LOG_MAX_BYTES || (store->logBytes > 0 && now >= store->snapshotTime + TRACKER_SNAPSHOT_INTERVAL)){
+		fileSnapshot_t* snapshot = filetable_acquireSnapshot(table);
+		ret = statestore_writeSnapshotLocked(store, snapshot, peers);
+		filetable_releaseSnapshot(snapshot);
+	}
+	pthread_mutex_unlock(&(store->mutex));
+	return ret;
+}
+
+/**
+ * sync and close the change log, free the store
+ * @param store [the store]
+ */
+void statestore_close(stateStore_t* store){
+	fdatasync(store->logfd);
+	close(store->logfd);
+	pthread_mutex_destroy(&(store->mutex));
+	free(store);
+}
@@ -0,0 +1,109 @@
+#ifndef STATESTORE_H
+#define STATESTORE_H
+
+#include <pthread.h>
+#include "../common/constants.h"
+#include "../common/filetable.h"
+#include "../common/peertable.h"
+#include "../common/changelog.h"
+
+#define STATESTORE_PATH_LEN 256
+#define STATESTORE_MAGIC_LEN 8
+#define STATESTORE_SNAPSHOT_MAGIC "DSSNAP02"
+#define STATESTORE_LOG_MAGIC "DSLOG001"
+
+//kinds of change log records
+#define STATESTORE_CHANGES 1         // files changed up to an epoch, the body is encoded deltas (see filecodec.h)
+#define STATESTORE_PEER 2            // the table version of a peer the tracker has applied, the body is its ip
+#define STATESTORE_PEER_GONE 3       // the peer left, the body is its ip
+
+
+
+/* a peer as kept in the snapshot, restored as an entry without a connection */
+typedef struct statePeer{
+	char ip[IP_LEN];
+	unsigned long tableVersion;
+}statePeer_t;
+
+/* a file as kept in the snapshot, its holders are the next holderNum ids of the snapshot's holder list */
+typedef struct stateEntry{
+	char file_name[FILE_NAME_MAX_LEN];
+	int size;
+	unsigned long timestamp;
+	int holderNum;
+}stateEntry_t;
+
+/**
+ * the snapshot file is laid out to be mapped and read in place:
+ * header, peerNum statePeer_t, entryNum stateEntry_t, holderNum int (the holders of each entry in turn,
+ * ids into the ip dictionary), ipNum ips (the dictionary: id -> ip of the holders, empty if unused)
+ */
+typedef struct stateSnapshotHeader{
+	char magic[STATESTORE_MAGIC_LEN];
+	unsigned long generation;    // bumped by every snapshot, the change log names the one it continues
+	unsigned long epoch;         // epoch of the tracker's file table
+	int entryNum;
+	int peerNum;
+	int holderNum;
+	int ipNum;
+	unsigned int checksum;       // of everything after the header
+}stateSnapshotHeader_t;
+
+/* the change log file starts with this, records follow back to back */
+typedef struct stateLogHeader{
+	char magic[STATESTORE_MAGIC_LEN];
+	unsigned long generation;    // snapshot the records apply on top of, 0 = none
+}stateLogHeader_t;
+
+/* one change log record, followed by len bytes of body */
+typedef struct stateRecord{
+	unsigned int checksum;       // of the record (with checksum 0) and its body, a torn last record fails it
+	int type;                    // STATESTORE_CHANGES, STATESTORE_PEER or STATESTORE_PEER_GONE
+	int num;                     // STATESTORE_CHANGES: number of deltas
+	int len;
+	unsigned long value;         // STATESTORE_CHANGES: epoch the changes bring the table to, STATESTORE_PEER: the table version
+}stateRecord_t;
+
+
+
+/**
+ * the tracker's file and peer tables on disk, so a restarted tracker picks up where it stopped
+ * a snapshot of both tables is written now and then, every change after it is appended to a change log;
+ * on boot the snapshot is mapped and the log replayed on top of it
+ * appended records reach the kernel at once (they survive the tracker crashing), statestore_maintain syncs them to disk
+ */
+typedef struct stateStore{
+	char snapshotPath[STATESTORE_PATH_LEN];
+	char tmpPath[STATESTORE_PATH_LEN];       // the next snapshot, renamed over snapshotPath once complete
+	char logPath[STATESTORE_PATH_LEN];
+	char dir[STATESTORE_PATH_LEN];
+	int logfd;                   // opened for appending
+	long logBytes;               // bytes of records in the change log
+	unsigned long generation;    // of the snapshot on disk
+	unsigned long epoch;         // epoch of the file table the snapshot and the log reach
+	unsigned long snapshotTime;  // when the snapshot was written (or the store loaded)
+	int dirty;                   // records appended since the last sync
+	pthread_mutex_t mutex;       // serializes writers, taken before the peer table's mutex
+}stateStore_t;
+
+
+
+
+stateStore_t* statestore_open(const char* dir);
+
+int statestore_load(stateStore_t* store, fileTable_t* table, peerTable_t* peers);
+
+int statestore_appendChanges(stateStore_t* store, fileTable_t* table, changeLog_t* log, peerTable_t* peers);
+
+unsigned long statestore_getEpoch(stateStore_t* store);
+
+int statestore_appendPeer(stateStore_t* store, int type, char* ip, unsigned long tableVersion);
+
+int statestore_writeSnapshot(stateStore_t* store, fileTable_t* table, peerTable_t* peers);
+
+int statestore_maintain(stateStore_t* store, fileTable_t* table, peerTable_t* peers, unsigned long now);
+
+void statestore_close(stateStore_t* store);
+
+
+#endif
@@ -20,7 +20,16 @@
 #include "../common/pkt.h"
 #include "../common/filetable.h"
 #include "../common/peertable.h"
+#include "../common/changelog.h"
 #include "../common/utils.h"
+#include "../common/shardmap.h"
+#include "../common/merkle.h"
+#include "../common/filemerge.h"
+#include "tracker.h"
+#include "reactor.h"
+#include "statestore.h"
+#include "metrics.h"
+#include "broadcastsched.h"
 
 
 
@@ -28,197 +37,1010 @@
 
 fileTable_t* myFileTablePtr;
 peerTable_t* myPeerTablePtr;
+changeLog_t* myChangeLogPtr; // recent changes to myFileTable, numbered by epoch
 
-int svr_sd; // trakcer side socket binded with HANDSHAKE_PORT
+reactor_t* myReactorPtr; // epoll workers owning all peer connections
+
+broadcastSched_t* myBroadcastSchedPtr; // coalesces the broadcasts asked for by table changes
+
+stateStore_t* myStateStorePtr; // snapshot and change log of myFileTable and myPeerTable, replayed on restart
+
+char myMetricsPath[2 * STATESTORE_PATH_LEN]; // where monitorAlive dumps the metrics (see metrics.h)
+
+shardMap_t* myShardMapPtr; // file paths -> tracker shards, this tracker only keeps the files of myShard
+int myShard;
+
+merkleTree_t* myMerkleTreePtr;        // Merkle tree of myMerkleSnapshotPtr, answers the peers reconnecting with a table of their own
+fileSnapshot_t* myMerkleSnapshotPtr;  // the snapshot the tree was built from, held so its entries stay valid
+pthread_mutex_t myMerkleMutex = PTHREAD_MUTEX_INITIALIZER; // guards the two above
+
+int svr_sd; // trakcer side socket binded with HANDSHAKE_PORT + myShard
+
+int myStopping; // set by main once SIGINT stopped the reactor, monitorAlive returns
+pthread_mutex_t myStopMutex = PTHREAD_MUTEX_INITIALIZER; // guards myStopping
+pthread_cond_t myStopCond = PTHREAD_COND_INITIALIZER;    // signalled when myStopping is set
 
 /**
- * construct a broadcast packet and send fileTable updates to all peers
+ * whether a file belongs to this tracker's shard, peers send each file to its owner only
+ * @param  file_name [the file]
+ * @return           [1 if this tracker keeps the file, 0 otherwise]
  */
-void broadcastFileTable(){
- 	
-	//create a pkt to broadcast
- 	ptp_tracker_t* broadcast = pkt_create_trackerPkt(); 
- 	// config reponse
- 	pkt_config_trackerPkt(broadcast, HEARTBEAT_INTERVAL, PIECE_LENGTH, myFileTablePtr->size, myFileTablePtr->head);
+int ownsFile(char* file_name){
+	return shardmap_owner(myShardMapPtr, file_name) == myShard;
+}
 
+/**
+ * delete the files this shard does not own, left over from a run with a different number of shards
+ * their new owners learn about them from the peers holding them
+ * @return [number of files deleted]
+ */
+int dropForeignFiles(){
+	int num = 0;
+	char (*names)[FILE_NAME_MAX_LEN] = NULL;
+	pthread_mutex_lock(myFileTablePtr->filetable_mutex);
+	fileEntry_t* iter = myFileTablePtr->head;
+	while(iter != NULL){
+		if(!ownsFile(iter->file_name)){
+			names = realloc(names, (num + 1) * FILE_NAME_MAX_LEN);
+			memcpy(names[num ++], iter->file_name, FILE_NAME_MAX_LEN);
+		}
+		iter = iter->next;
+	}
+	pthread_mutex_unlock(myFileTablePtr->filetable_mutex);
+
+	int i;
+	for(i = 0; i < num; i++){
+		if(filetable_deleteFileEntryByName(myFileTablePtr, names[i]) > 0){
+			changelog_record(myChangeLogPtr, DELTA_DELETE, names[i]);
+		}
+	}
+	free(names);
+	return num;
+}
 
-	//send the pkt_response to all peers (braodcasting)
+/**
+ * publish the current state of tracker's fileTable for readers (broadcast, setup packets), which never lock it
+ * a publish copies the whole table, so writers do not publish: they request a broadcast, which publishes once for
+ * every change of its window.  Readers in between get the table as of the last broadcast, which the next one
+ * brings up to date.  The published changes are appended to the state store as well, so they survive a restart
+ */
+void publishFileTable(){
+	unsigned long start = metrics_now();
+	pthread_mutex_lock(myFileTablePtr->filetable_mutex);
+	//every change up to this epoch is already in the table, changes are recorded after they are made
+	unsigned long epoch = changelog_getEpoch(myChangeLogPtr);
+	if(epoch > 0 && myFileTablePtr->snapshot->epoch >= epoch){
+		//nothing changed since the last publish, which already went to the state store
+		pthread_mutex_unlock(myFileTablePtr->filetable_mutex);
+		return;
+	}
+	filetable_publishSnapshotLocked(myFileTablePtr, epoch);
+	int size = myFileTablePtr->size;
+	pthread_mutex_unlock(myFileTablePtr->filetable_mutex);
+	metrics_record(METRIC_HIST_PUBLISH, metrics_now() - start);
+	metrics_setGauge(METRIC_GAUGE_FILES, size);
+	metrics_setGauge(METRIC_GAUGE_EPOCH, epoch);
+
+	statestore_appendChanges(myStateStorePtr, myFileTablePtr, myChangeLogPtr, myPeerTablePtr);
+}
+
+
+
+/**
+ * encode a packet for the peers, stamped with this tracker's shard, timed and counted in the metrics
+ * @param  pkt [configured packet]
+ * @return     [buffer holding one reference for the caller]
+ */
+pktBuf_t* encodeTrackerPkt(ptp_tracker_t* pkt){
+	unsigned long start = metrics_now();
+	pkt_config_trackerShard(pkt, myShard, myShardMapPtr->shardNum);
+	pktBuf_t* buf = pkt_tracker_encodePkt(pkt, myPeerTablePtr->ids);
+	metrics_record(METRIC_HIST_ENCODE, metrics_now() - start);
+	metrics_count(METRIC_ENCODED_PKTS, 1);
+	metrics_count(METRIC_ENCODED_BYTES, buf->len);
+	return buf;
+}
+
+
+
+/**
+ * encode the full table of a snapshot
+ * @param  snapshot [the snapshot]
+ * @return          [buffer holding one reference for the caller]
+ */
+pktBuf_t* encodeSnapshot(fileSnapshot_t* snapshot){
+	ptp_tracker_t update;
+	pkt_config_trackerPkt(&update, HEARTBEAT_INTERVAL, PIECE_LENGTH, snapshot->size, snapshot->head);
+	update.epoch = snapshot->epoch;
+	return encodeTrackerPkt(&update);
+}
+
+
+
+/**
+ * encode what changed in tracker's fileTable since baseEpoch, ready to be sent to every peer that acknowledged baseEpoch
+ * a full snapshot is encoded instead when the changelog no longer reaches back that far,
+ * or when the changes would be no smaller than the table itself
+ * @param  table     [snapshot of tracker's fileTable the update brings the peers to]
+ * @param  baseEpoch [epoch the receiving peers acknowledged]
+ * @param  snapshot  [full table already encoded during this broadcast (or NULL), set when one is encoded here]
+ * @return           [buffer holding one reference for the caller, NULL if the peers are up to date]
+ */
+pktBuf_t* encodeTableUpdate(fileSnapshot_t* table, unsigned long baseEpoch, pktBuf_t** snapshot){
+	if(baseEpoch >= table->epoch){
+		//the peers are up to date with what has been published
+		return NULL;
+	}
+
+	//changes recorded after the snapshot was published go out with the next one
+	int num;
+	changeRecord_t* changes = changelog_between(myChangeLogPtr, baseEpoch, table->epoch, &num);
+
+	pktBuf_t* buf;
+	if(num < 0 || num >= table->size){
+		if(*snapshot == NULL){
+			*snapshot = encodeSnapshot(table);
+		}
+		free(changes);
+		buf = *snapshot;
+		pkt_buf_retain(buf);
+		return buf;
+	}
+
+	//every changed file goes out with its state in the snapshot, or as a delete if it left the table
+	fileDelta_t* deltas = filedelta_fromChanges(table, changes, num);
+
+	ptp_tracker_t update;
+	pkt_config_trackerDelta(&update, baseEpoch, table->epoch, num, deltas);
+	buf = encodeTrackerPkt(&update);
+	filedelta_freeList(deltas);
+	free(changes);
+	return buf;
+}
+
+
+
+/**
+ * send fileTable updates to all peers, each one only gets what it has not acknowledged yet
+ * every distinct update is encoded once and the same buffer is queued for all peers it applies to,
+ * sends never block so a slow peer cannot hold up the ones behind it
+ */
+void broadcastFileTable(){
+	unsigned long start = metrics_now();
+	int queued = 0;
+
+	//one encoded update per acknowledged epoch seen in this broadcast, plus at most one snapshot
+	int groupNum = 0;
+	int groupCap = 8;
+	unsigned long* groupEpochs = (unsigned long*) malloc(groupCap * sizeof(unsigned long));
+	pktBuf_t** groupBufs = (pktBuf_t**) malloc(groupCap * sizeof(pktBuf_t*));
+	pktBuf_t* snapshot = NULL;
+
+	//every peer is brought to the same published state of the table, with every change of the window in it
+	//the window's changes are in the state store now, the peer tables they came from can be acknowledged
+	publishFileTable();
+	sendPendingAcks();
+	fileSnapshot_t* table = filetable_acquireSnapshot(myFileTablePtr);
+
+	//send the update to all peers (braodcasting)
+	pthread_mutex_lock(myPeerTablePtr->peertable_mutex);
 	peerEntry_t* iter = myPeerTablePtr->head;
  	while(iter != NULL){
- 		pkt_tracker_sendPkt(iter->sockfd, broadcast);
+ 		//the peer is over its budget, it gets a full table once its queue drains
+ 		//a peer restored from the state store has no connection until it registers again
+ 		//a peer in the middle of a Merkle exchange gets everything since its registration once it is over
+ 		if(iter->needResync || iter->sockfd < 0 || iter->merkleSync){
+ 			iter = iter->next;
+ 			continue;
+ 		}
+ 		int i;
+ 		for(i = 0; i < groupNum; i++){
+ 			if(groupEpochs[i] == iter->ackedEpoch) break;
+ 		}
+ 		if(i == groupNum){
+ 			if(groupNum == groupCap){
+ 				groupCap *= 2;
+ 				groupEpochs = (unsigned long*) realloc(groupEpochs, groupCap * sizeof(unsigned long));
+ 				groupBufs = (pktBuf_t**) realloc(groupBufs, groupCap * sizeof(pktBuf_t*));
+ 			}
+ 			groupEpochs[i] = iter->ackedEpoch;
+ 			groupBufs[i] = encodeTableUpdate(table, iter->ackedEpoch, &snapshot);
+ 			groupNum ++;
+ 		}
+ 		if(groupBufs[i] != NULL){
+ 			if(reactor_send(myReactorPtr, iter->sockfd, groupBufs[i], REACTOR_MSG_TABLE) == REACTOR_SEND_OVERFLOW){
+ 				iter->needResync = 1;
+ 			}
+ 			queued ++;
+ 		}
  		iter = iter->next;
  	}
- 	//the actual linkedlist of Entries belongs to myFileTable, do not free
- 	//only free broadcast
- 	free(broadcast);
+	pthread_mutex_unlock(myPeerTablePtr->peertable_mutex);
+
+	int i;
+	for(i = 0; i < groupNum; i++){
+		pkt_buf_release(groupBufs[i]);
+	}
+	pkt_buf_release(snapshot);
+	filetable_releaseSnapshot(table);
+	free(groupEpochs);
+	free(groupBufs);
+
+	metrics_record(METRIC_HIST_BROADCAST, metrics_now() - start);
+	metrics_count(METRIC_BROADCASTS, 1);
+	metrics_count(METRIC_BROADCAST_PEERS, queued);
  }
 
 
 
 /**
- * handshake thread: to consistently receive messages from peers, respond if needed, by using tracker-peer handshake protocal defined in pkt.c
- * @param  arg [the TCP connection identifier between a specific peer and the centralized trakcer ]
- * @return     [void]
+ * called by the reactor once a peer that went over its outbound budget has sent everything queued
+ * the broadcasts it missed may have left the changelog, so it gets a full table
+ * @param connfd [the TCP connection of the peer]
+ */
+void resyncPeer(int connfd){
+	pthread_mutex_lock(myPeerTablePtr->peertable_mutex);
+	peerEntry_t* peer = myPeerTablePtr->head;
+	while(peer != NULL && peer->sockfd != connfd){
+		peer = peer->next;
+	}
+	if(peer == NULL || !peer->needResync){
+		pthread_mutex_unlock(myPeerTablePtr->peertable_mutex);
+		return;
+	}
+	peer->needResync = 0;
+
+	fileSnapshot_t* table = filetable_acquireSnapshot(myFileTablePtr);
+	pktBuf_t* buf = encodeSnapshot(table);
+	filetable_releaseSnapshot(table);
+
+	//an empty queue always takes it, whatever its size
+	if(reactor_send(myReactorPtr, connfd, buf, REACTOR_MSG_TABLE) == REACTOR_SEND_OVERFLOW){
+		peer->needResync = 1;
+	}
+	pthread_mutex_unlock(myPeerTablePtr->peertable_mutex);
+	pkt_buf_release(buf);
+}
+
+
+
+/**
+ * sync one file entry reported by a peer into tracker's fileTable
+ * @param  entry  [the peer's fileEntry; copied if it has to be added]
+ * @param  peerId [id of the reporting peer in myPeerTable, the only holder the entry is credited with]
+ * @return        [1 if tracker's fileTable changed or the peer is outdated (broadcast needed), -1 otherwise]
+ */
+int syncFileEntry(fileEntry_t* entry, int peerId){
+	//tracker's fileEntry found with same name(NULL if not found)
+	fileEntry_t* res = filetable_searchFileByName(myFileTablePtr, entry->file_name);
+	if(res == NULL){
+		//if it is a new file: 
+		//add a copy of the file to file table, the packet's list is freed by handshake
+		fileEntry_t* newEntry = (fileEntry_t*) malloc(sizeof(fileEntry_t));
+		memcpy(newEntry, entry, sizeof(fileEntry_t));
+		newEntry->next = NULL;
+		newEntry->holders = NULL;
+		newEntry->peerNum = 0;
+		filetable_addHolder(newEntry, peerId, myFileTablePtr->filetable_mutex);
+		filetable_appendFileEntry(myFileTablePtr, newEntry);
+		changelog_record(myChangeLogPtr, DELTA_ADD, entry->file_name);
+		return 1;
+	}
+
+	//the entry exists already
+	if(entry->timestamp > res->timestamp){
+		//if peer has a newer version
+		//update tracker's fileEntry by peer's fileEntry 
+		filetable_updateFile(res, entry, myFileTablePtr->filetable_mutex);
+		changelog_record(myChangeLogPtr, DELTA_MODIFY, entry->file_name);
+		return 1;
+	}
+
+	if (entry->timestamp == res->timestamp){
+		// if peer and tracker has the same version of the file 
+		// add the peer to the fileEntry's holders
+		//only when it is already there, we do not need to broadcast, meaning every entry's every fileld are unchanged
+		if(filetable_addHolder(res, peerId, myFileTablePtr->filetable_mutex) > 0){
+			changelog_record(myChangeLogPtr, DELTA_MODIFY, entry->file_name);
+			return 1;
+		}
+		return -1;
+	}
+
+	// peer has an older version
+	// send the current entry again with the next broadcast, so the peer notices it is outdated
+	changelog_record(myChangeLogPtr, DELTA_MODIFY, entry->file_name);
+	return 1;
+}
+
+
+
+/**
+ * apply the changes a peer's table calls for (see filemerge.h) and record them, so they go out with the next broadcast
+ * every change is checked against tracker's fileTable as it is now, it may have moved on since the tree was built
+ * @param  set    [the changes, the tracker's entries they point to stay valid meanwhile]
+ * @param  peerId [id of the peer]
+ * @return        [1 if tracker's fileTable changed or the peer is outdated (broadcast needed), 0 otherwise]
+ */
+int applyChangeSet(fileChangeSet_t* set, int peerId){
+	int needBroadCast = 0;
+	int i;
+	for(i = 0; i < set->size; i++){
+		fileEntry_t* entry = set->changes[i].entry;
+		if(set->changes[i].op == FILEMERGE_DELETED){
+			//record after the change, so a broadcast never pairs the new epoch with the old table
+			if(filetable_deleteFileEntryByName(myFileTablePtr, entry->file_name) > 0){
+				changelog_record(myChangeLogPtr, DELTA_DELETE, entry->file_name);
+				needBroadCast = 1;
+			}
+		} else if(syncFileEntry(entry, peerId) > 0){
+			needBroadCast = 1;
+		}
+	}
+	return needBroadCast;
+}
+
+
+
+/**
+ * take the entries of a packet this tracker keeps, the others were sent here by mistake and are freed
+ * @param  pkt     [the packet, its list is consumed]
+ * @param  foreign [set to the number of entries of other shards]
+ * @return         [the list of this shard's entries, in packet order]
+ */
+fileEntry_t* takeOwnedFiles(ptp_peer_t* pkt, int* foreign){
+	fileEntry_t dummy;
+	dummy.next = NULL;
+	fileEntry_t* tail = &dummy;
+	*foreign = 0;
+	fileEntry_t* iter = pkt->filetableHeadPtr;
+	while(iter != NULL){
+		fileEntry_t* next = iter->next;
+		if(ownsFile(iter->file_name)){
+			iter->next = NULL;
+			tail->next = iter;
+			tail = iter;
+		} else {
+			(*foreign) ++;
+			filetable_freeEntry(iter);
+		}
+		iter = next;
+	}
+	pkt->filetableHeadPtr = NULL;
+	return dummy.next;
+}
+
+
+
+/**
+ * record that the peer's table is applied up to version and tell the peer, so it can drop those changes
+ * @param connfd  [the TCP connection of the peer]
+ * @param ip      [the peer's ip]
+ * @param version [the peer's table version, its changes already in the state store]
+ */
+void sendVersionAck(int connfd, char* ip, unsigned long version){
+	statestore_appendPeer(myStateStorePtr, STATESTORE_PEER, ip, version);
+
+	ptp_tracker_t ack;
+	pkt_config_trackerAck(&ack, TRACKER_ACK, version);
+	pktBuf_t* buf = encodeTrackerPkt(&ack);
+	reactor_send(myReactorPtr, connfd, buf, REACTOR_MSG_CONTROL);
+	pkt_buf_release(buf);
+}
+
+
+
+/**
+ * acknowledge the peer's table version once tracker's fileTable reflects it
+ * the peer drops the changes acknowledged, so the ack waits until every change recorded so far is in the state store:
+ * the changes go there with the next publish (one per broadcast window), which then sends the acks held back
+ * @param connfd  [the TCP connection of the peer]
+ * @param version [the peer's table version now reflected in tracker's fileTable]
+ */
+void acknowledgeVersion(int connfd, unsigned long version){
+	//changes are recorded after they are made, the peer's are no later than this
+	unsigned long epoch = changelog_getEpoch(myChangeLogPtr);
+	char ip[IP_LEN];
+	pthread_mutex_lock(myPeerTablePtr->peertable_mutex);
+	peerEntry_t* peer = myPeerTablePtr->head;
+	while(peer != NULL && peer->sockfd != connfd){
+		peer = peer->next;
+	}
+	if(peer == NULL){
+		pthread_mutex_unlock(myPeerTablePtr->peertable_mutex);
+		return;
+	}
+	peer->tableVersion = version;
+	//a publish appending them reads the peer table only after it is done, it cannot be missed in between
+	if(statestore_getEpoch(myStateStorePtr) < epoch){
+		peer->pendingEpoch = epoch;
+		pthread_mutex_unlock(myPeerTablePtr->peertable_mutex);
+		return;
+	}
+	peer->pendingEpoch = 0;
+	memcpy(ip, peer->ip, IP_LEN);
+	pthread_mutex_unlock(myPeerTablePtr->peertable_mutex);
+	sendVersionAck(connfd, ip, version);
+}
+
+
+
+/**
+ * send the acks acknowledgeVersion held back whose changes are now in the state store
+ * the store's mutex is taken before the peer table's, so the acks are collected first and sent after
+ */
+void sendPendingAcks(){
+	unsigned long durable = statestore_getEpoch(myStateStorePtr);
+	int num = 0;
+	int* fds = NULL;
+	unsigned long* versions = NULL;
+	char (*ips)[IP_LEN] = NULL;
+	pthread_mutex_lock(myPeerTablePtr->peertable_mutex);
+	peerEntry_t* iter = myPeerTablePtr->head;
+	while(iter != NULL){
+		if(iter->pendingEpoch > 0 && iter->pendingEpoch <= durable && iter->sockfd >= 0){
+			fds = realloc(fds, (num + 1) * sizeof(int));
+			versions = realloc(versions, (num + 1) * sizeof(unsigned long));
+			ips = realloc(ips, (num + 1) * IP_LEN);
+			fds[num] = iter->sockfd;
+			versions[num] = iter->tableVersion;
+			memcpy(ips[num], iter->ip, IP_LEN);
+			num ++;
+			iter->pendingEpoch = 0;
+		}
+		iter = iter->next;
+	}
+	pthread_mutex_unlock(myPeerTablePtr->peertable_mutex);
+
+	int i;
+	for(i = 0; i < num; i++){
+		sendVersionAck(fds[i], ips[i], versions[i]);
+	}
+	free(fds);
+	free(versions);
+	free(ips);
+}
+
+
+/**
+ * the Merkle tree of the current table, rebuilt only once a newer snapshot is out
+ * a merge against it must see every change already applied, so changes not yet broadcast are published first;
+ * the rebuild walks the whole table anyway
+ * myMerkleMutex is held by the caller, the tree stays valid until it lets go of it
+ * @return [the tree]
+ */
+merkleTree_t* acquireMerkleTreeLocked(){
+	publishFileTable();
+	fileSnapshot_t* table = filetable_acquireSnapshot(myFileTablePtr);
+	if(table == myMerkleSnapshotPtr){
+		filetable_releaseSnapshot(table);
+		return myMerkleTreePtr;
+	}
+
+	merkle_destroy(myMerkleTreePtr);
+	if(myMerkleSnapshotPtr != NULL){
+		filetable_releaseSnapshot(myMerkleSnapshotPtr);
+	}
+	myMerkleSnapshotPtr = table;
+	myMerkleTreePtr = merkle_build(table->head);
+	myMerkleTreePtr->epoch = table->epoch;
+	return myMerkleTreePtr;
+}
+
+
+
+/**
+ * one round of a Merkle exchange with a peer that reconnected with a table of its own (see merkle.h)
+ * the nodes the peer settled are reconciled like a FILEUPDATE limited to them: the peer's entries are synced
+ * and the tracker's entries of those nodes the peer does not list are deleted.  The peer is made a holder of every
+ * entry under the nodes both sides agree on, a peer that reconnects with unchanged files is listed again that way.
+ * The answer carries the tracker's side of the nodes the peer asked about and its entries of the settled ones.
+ * Once no node the peer compared differs the exchange is over: the peer's table version is acknowledged and
+ * broadcasts to it resume from the epoch it registered at
+ * @param connfd [the TCP connection of the peer]
+ * @param peer   [the peer, merkleSync set]
+ * @param pkt    [REGISTER with the root of the peer's tree, or MERKLE_SYNC; its entries are consumed]
+ */
+void merkleRound(int connfd, peerEntry_t* peer, ptp_peer_t* pkt){
+	unsigned long start = metrics_now();
+
+	//the peer's entries, placed in a tree of their own to find those of each settled node
+	int foreign;
+	fileEntry_t* mine = takeOwnedFiles(pkt, &foreign);
+	merkleTree_t* pktTree = merkle_build(mine);
+
+	//the tracker's side of every node asked about, and the settled nodes reconciled like a FILEUPDATE would, only within them
+	//the changes to delete point into the tree, they are applied before anyone can replace it
+	merkleNode_t* answer = (merkleNode_t*) malloc((pkt->nodesize * (1 + MERKLE_FANOUT) + 1) * sizeof(merkleNode_t));
+	fileChangeSet_t* changes = filemerge_init();
+	int synced = 0;
+	int i, j;
+	pthread_mutex_lock(&myMerkleMutex);
+	merkleTree_t* tree = acquireMerkleTreeLocked();
+	int answerNum = merkle_expand(tree, pkt->nodes, pkt->nodesize, answer);
+	int open = 0;
+	for(i = 0; i < pkt->nodesize; i++){
+		if(pkt->nodes[i].count != MERKLE_SETTLE){
+			//digests leave holders out: the peer has the tracker's entries of a node they agree on, it may no longer be listed for them
+			if(merkle_agrees(tree, &(pkt->nodes[i]))){
+				filemerge_held(changes, tree, pkt->nodes[i].id, peer->id);
+			} else {
+				open ++;
+			}
+			continue;
+		}
+		filemerge_diff(changes, pktTree, tree, pkt->nodes[i].id, peer->id);
+		int num;
+		merkle_nodeEntries(pktTree, pkt->nodes[i].id, &num);
+		synced += num;
+	}
+	int needBroadCast = applyChangeSet(changes, peer->id);
+	pthread_mutex_unlock(&myMerkleMutex);
+	filemerge_destroy(changes);
+
+	if(foreign > 0 || synced < pktTree->size){
+		printf("%s: error: MERKLE_SYNC from %s has %d files outside the settled nodes\n", __func__, pkt->peer_ip, foreign + pktTree->size - synced);
+	}
+	metrics_count(METRIC_FILES_SYNCED, synced);
+	metrics_record(METRIC_HIST_RECONCILE, metrics_now() - start);
+	if(needBroadCast){
+		broadcastsched_request(myBroadcastSchedPtr);
+	}
+
+	//what the tracker has for the settled nodes now: the peer's files, with every holder
+	fileEntry_t dummy;
+	dummy.next = NULL;
+	fileEntry_t* tail = &dummy;
+	int replyNum = 0;
+	pthread_mutex_lock(myFileTablePtr->filetable_mutex);
+	for(i = 0; i < pkt->nodesize; i++){
+		if(pkt->nodes[i].count != MERKLE_SETTLE) continue;
+		int num;
+		fileEntry_t** entries = merkle_nodeEntries(pktTree, pkt->nodes[i].id, &num);
+		for(j = 0; j < num; j++){
+			fileEntry_t* res = filetable_searchFileByNameLocked(myFileTablePtr, entries[j]->file_name);
+			if(res == NULL) continue;
+			fileEntry_t* copy = (fileEntry_t*) malloc(sizeof(fileEntry_t));
+			memcpy(copy, res, sizeof(fileEntry_t));
+			filetable_retainHolders(copy);
+			copy->next = NULL;
+			copy->prev = NULL;
+			tail->next = copy;
+			tail = copy;
+			replyNum ++;
+		}
+	}
+	pthread_mutex_unlock(myFileTablePtr->filetable_mutex);
+	merkle_destroy(pktTree);
+	filetable_freeList(mine);
+
+	ptp_tracker_t reply;
+	pkt_config_trackerMerkle(&reply, peer->ackedEpoch, answerNum, answer, replyNum, dummy.next);
+	pktBuf_t* buf = encodeTrackerPkt(&reply);
+	reactor_send(myReactorPtr, connfd, buf, REACTOR_MSG_CONTROL);
+	pkt_buf_release(buf);
+	filetable_freeList(dummy.next);
+	free(answer);
+
+	//once no node compared differs, the peer has nothing left to ask next
+	if(open == 0){
+		peer->merkleSync = 0;
+		acknowledgeVersion(connfd, pkt->tableVersion);
+		//the changes since the peer registered, or made while the exchange went on, go out with the next broadcast
+		if(changelog_getEpoch(myChangeLogPtr) > peer->ackedEpoch){
+			broadcastsched_request(myBroadcastSchedPtr);
+		}
+	}
+}
+
+
+
+/**
+ * handshake: handle one message from a peer, respond if needed, by using tracker-peer handshake protocal defined in pkt.c
+ * called by the reactor worker owning the peer's connection, one packet at a time per connection
+ * @param  connfd [the TCP connection identifier between a specific peer and the centralized trakcer ]
+ * @param  pkt    [the received packet, its list of fileEntries is freed here]
  *
  * sudo code:
  *
- * keep receiving message on the TCP conection
+ * 		case REGISTER:
+ * 			0. a peer that takes the tracker for another shard, or for one split into another number of shards,
+ * 			   would send files this shard does not own: it is refused and its connection shut down
+ * 			1. create a new peerEntry using REGISTER's ip, REGISTER's sockfd, and currentTime;
+ * 			2. insert the new peerEntry into table (a reconnecting peer replaces its old entry: a restored one is deleted,
+ * 			   the connection of a live one is shut down and the entry goes with it, the ip keeps its id and holders)
+ * 			3. send a response (with: HEARTBEAT_INTERVAL, FILEPIECE_LEN, filetable, epoch) back to peer for setup
+ * 			4. if the tracker still knows the peer's table (reconnect, or restored after a restart) and the peer's
+ * 			   tableVersion is not older, confirm the known version (TRACKER_ACK): the peer sends only what came after
+ * 			a REGISTER carrying the root of the peer's Merkle tree (a peer with files of its own) skips 3. and 4.:
+ * 			   the first round of the Merkle exchange is answered instead (see MERKLE_SYNC), broadcasts to the peer
+ * 			   wait until the exchange is over and then start from the epoch it registered at
+ *
  * 		case KEEPALIVE:
  *   		find the peer entry in tracker's peerTable (must be exactly only one entry)
  *   		update the peer's timestamp to current time
  *
  * 		case FILEUPDATE:
- * 			for each file entry in packet's fileTable:
- * 				search through tracker's fileTable
- * 				if it is a new file: 
- * 					add file to file table	
- * 				elif the file exists in tracker's fileTable:
+ * 			(the packet carries the files of this tracker's shard only, others are dropped)
+ * 			sort packet's fileTable by name hash (in a Merkle tree), tracker's fileTable is kept that way already
+ * 			merge the two in one pass into a change set, for each name:
+ * 				only in packet's fileTable: 
+ * 					ADDED, add file to file table
+ * 				in both:
  * 					if (peer has a newer version):
- * 						update tracker's fileEntry by peer's fileEntry (update timestamp, size)
- * 						
- *
+ * 						UPDATED, update tracker's fileEntry by peer's fileEntry (update timestamp, size)
  * 					elif (peer has an older version):
- * 						do nothing (becasue the new table would be eventaully broadcast later)
- * 							
+ * 						STALE, the current entry goes out with the next broadcast so the peer notices
+ * 					elif (peer is not a holder yet):
+ * 						HOLDER, add peer to the fileEntry's holders
+ * 					else:
+ * 						nothing to do, the table is not touched
+ * 				only in tracker's fileTable:
+ * 					DELETED, delete the entry from tracker's fileTable
+ * 			apply the change set, recording every change for the next broadcast
+ * 			remember the peer's tableVersion and acknowledge it (TRACKER_ACK) once the changes are in the state store
  *
+ * 		case FILEUPDATE_DELTA:
+ * 			if baseVersion is newer than the last version applied for this peer:
+ * 				changes are missing, send TRACKER_RESYNC so the peer sends a full FILEUPDATE
+ * 			else for each delta of a file in this tracker's shard:
+ * 				DELTA_ADD / DELTA_MODIFY: sync the entry exactly like a FILEUPDATE entry
+ * 				DELTA_DELETE: delete the entry from tracker's fileTable
+ * 			remember the peer's tableVersion and acknowledge it (TRACKER_ACK) once the changes are in the state store
  *
- * 					else (same version)
- * 						add peer to the fileEntry's iplist if possible
+ * 		case EPOCH_ACK:
+ * 			remember the epoch of tracker's fileTable the peer has applied, the next broadcast to it starts there
  *
- * 			for each file entry in tracker's fileTable:
- * 				search through packet's fileTable:
- * 					if packet's fileTable does not have it: (search by name)
- * 						delete the entry from tracker's fileTable
- * 					elif packet's fileTable HAVE it: (search by name)
- * 						do nothing, becasue it must be synced in the upper loops
+ * 		case MERKLE_SYNC:
+ * 			sync the entries of the nodes the peer settled, deleting the tracker's entries of those nodes it lacks
+ * 			make the peer a holder of the entries of the nodes it compared that agree
+ * 			answer with tracker's side of every node and the children of those that differ, plus its entries of the settled nodes
+ * 			if no node differed, the exchange is over: acknowledge the peer's tableVersion (TRACKER_ACK) and resume broadcasts
  * 
  */
-void *handshake(void* arg){
- 	
- 	ptp_peer_t pkt_recv;
- 	memset(&pkt_recv, 0, sizeof(ptp_peer_t));
-
-	int connfd = *(int*) arg;
-
-	while(1) {
-		pkt_tracker_recvPkt(connfd, &pkt_recv);
-
-		int type = pkt_recv.type;
-		switch(type) {
-			case KEEPALIVE:
-			{
-				peerEntry_t* tobeRefreshed = peertable_searchEntryByIp(myPeerTablePtr, pkt_recv.peer_ip);
-				peertable_refreshTimestamp(tobeRefreshed);
+void handshake(int connfd, ptp_peer_t* pkt){
+	unsigned long start = metrics_now();
+
+	switch(pkt->type) {
+		case REGISTER:
+		{
+			metrics_count(METRIC_PKT_REGISTER, 1);
+			if(pkt->shard != myShard || pkt->shardNum != myShardMapPtr->shardNum){
+				printf("%s: error: peer %s registered with shard %d of %d, this is shard %d of %d\n", __func__, pkt->peer_ip, pkt->shard, pkt->shardNum, myShard, myShardMapPtr->shardNum);
+				shutdown(connfd, SHUT_RDWR);
 				break;
 			}
-			case FILEUPDATE:
-			{
-				int needBroadCast = -1; 
-				int i;
-				//for each file entry in packet's fileTable:
-				fileEntry_t* iter = pkt_recv.filetableHeadPtr;
-				while(iter != NULL){
-					//tracker's fileEntry found with same name(NULL if not found)
-					fileEntry_t* res = filetable_searchFileByName(myFileTablePtr->head, iter->name);
-					if(res == NULL){
-						//if it is a new file: 
- 						//add file to file table	
-						filetable_appendFileEntry(myFileTablePtr, iter);
-						needBroadCast = 1;
-
-					} else {
-						//the entry exists already
-						if(iter->timestamp > res->timestamp){
-							//if peer has a newer version
-							//update tracker's fileEntry by peer's fileEntry 
-							filetable_updateFile(res, iter, myFileTablePtr->filetable_mutex);
-							
-						} else if (iter->timestamp == res->timestamp){
+			//create a new peerEntry using 1. REGISTER's ip, 2. connfd: denoting the TCP connection between this peer and tracker;
+			peerEntry_t* peerEntry = peertable_createEntry(pkt->peer_ip, connfd);
+
+			//a reconnecting peer replaces whatever was left of its previous connection
+			//the new entry comes first, so the ip keeps its id and the files still list it as a holder
+			//its applied table version carries over, unless the peer's table is older (it restarted and counts from 0 again)
+			//an entry restored without a connection goes now, one with a connection once the reactor has closed it:
+			//the worker handling that connection may still be using it
+			unsigned long knownVersion = 0;
+			pthread_mutex_lock(myPeerTablePtr->peertable_mutex);
+			peerEntry_t* old = peertable_searchEntryByIpLocked(myPeerTablePtr, pkt->peer_ip);
+			peertable_addEntryLocked(myPeerTablePtr, peerEntry);
+			if(old != NULL){
+				if(pkt->tableVersion >= old->tableVersion){
+					knownVersion = old->tableVersion;
+				}
+				if(old->sockfd >= 0){
+					shutdown(old->sockfd, SHUT_RDWR);
+				} else {
+					peertable_freeEntry(myPeerTablePtr, peertable_removeEntryLocked(myPeerTablePtr, old, NULL));
+				}
+			}
+			pthread_mutex_unlock(myPeerTablePtr->peertable_mutex);
+			metrics_setGauge(METRIC_GAUGE_PEERS, myPeerTablePtr->size);
 
-							// if peer and tracker has the same version of the file 
-							// add peerip to the fileEntry's iplist if possible
-							if(filetable_AddIp2Iplist(res, iter->iplist[0], myFileTablePtr->filetable_mutex) > 0){
-								needBroadCast = 1;
-							}
-							//only when case falls here, we do not need to broadcast, meaning every entry's every fileld are unchanged
+			//create a pkt to send back to peer, for peer to set up itself
+			//the pkt contains info: 1. HEATBEAT_INTERVAL 2. PIECE_LENGTH 3. trakcer's fileTable(including size and the linkedlist)
+			//the table comes from the latest published snapshot, so writers are not held up while it is encoded
+			fileSnapshot_t* table = filetable_acquireSnapshot(myFileTablePtr);
+
+			//the snapshot is the table at least as of its epoch, later broadcasts start from it
+			peerEntry->ackedEpoch = table->epoch;
+
+			//a peer with files of its own only exchanges the parts of the tables that differ
+			if(pkt->nodesize > 0){
+				filetable_releaseSnapshot(table);
+				peerEntry->merkleSync = 1;
+				statestore_appendPeer(myStateStorePtr, STATESTORE_PEER, peerEntry->ip, 0);
+				merkleRound(connfd, peerEntry, pkt);
+				break;
+			}
 
-						} else {
-							// peer has an older version
-							// wait for later broadcast
-							needBroadCast = 1;
+			//the setup packet must arrive whole and before any broadcast, so it is never dropped
+			pktBuf_t* buf = encodeSnapshot(table);
+			filetable_releaseSnapshot(table);
+			reactor_send(myReactorPtr, connfd, buf, REACTOR_MSG_CONTROL);
+			pkt_buf_release(buf);
+
+			//the tracker already has the peer's table up to knownVersion, the peer need not send it again
+			if(knownVersion > 0){
+				acknowledgeVersion(connfd, knownVersion);
+			} else {
+				statestore_appendPeer(myStateStorePtr, STATESTORE_PEER, peerEntry->ip, 0);
+			}
+			break;
+		}
+		case KEEPALIVE:
+		{
+			metrics_count(METRIC_PKT_KEEPALIVE, 1);
+			peerEntry_t* tobeRefreshed = peertable_searchEntryBySockfd(myPeerTablePtr, connfd);
+			if(tobeRefreshed != NULL){
+				peertable_refreshTimestamp(myPeerTablePtr, tobeRefreshed);
+			}
+			break;
+		}
+		case FILEUPDATE:
+		{
+			metrics_count(METRIC_PKT_FILEUPDATE, 1);
+			metrics_count(METRIC_FILES_SYNCED, pkt->filetablesize);
+			int needBroadCast = 0; 
+			peerEntry_t* peer = peertable_searchEntryBySockfd(myPeerTablePtr, connfd);
+			int peerId = (peer != NULL) ? peer->id : PEERID_NONE;
+
+			//the packet's entries of this shard, in a tree of their own to have them in name hash order
+			int foreign;
+			fileEntry_t* mine = takeOwnedFiles(pkt, &foreign);
+			if(foreign > 0){
+				printf("%s: error: FILEUPDATE from %s has %d files of other shards\n", __func__, pkt->peer_ip, foreign);
+			}
+			merkleTree_t* pktTree = merkle_build(mine);
+
+			//one merge against tracker's fileTable (as last published, in the same order in its tree) finds every change,
+			//only those touch the table: files the peer added, updated or now holds, files it is outdated on, files it deleted
+			fileChangeSet_t* changes = filemerge_init();
+			pthread_mutex_lock(&myMerkleMutex);
+			merkleTree_t* tree = acquireMerkleTreeLocked();
+			filemerge_diff(changes, pktTree, tree, MERKLE_ROOT, peerId);
+			needBroadCast = applyChangeSet(changes, peerId);
+			pthread_mutex_unlock(&myMerkleMutex);
+			metrics_record(METRIC_HIST_RECONCILE, metrics_now() - start);
+			filemerge_destroy(changes);
+			merkle_destroy(pktTree);
+
+
+			//at this time we finish sync fileTables between trakcer and server
+			//trakcer's new fileTable is published and broadcast together with whatever changes come in the same window
+			if(needBroadCast){
+				broadcastsched_request(myBroadcastSchedPtr);
+			}
 
-						}
+			filetable_freeList(mine);
 
+			//a full table resets whatever versions came before
+			acknowledgeVersion(connfd, pkt->tableVersion);
+			break;
 
-					}
+		}
+		case FILEUPDATE_DELTA:
+		{
+			metrics_count(METRIC_PKT_FILEUPDATE_DELTA, 1);
+			peerEntry_t* peer = peertable_searchEntryBySockfd(myPeerTablePtr, connfd);
+			if(peer == NULL){
+				printf("%s: error: FILEUPDATE_DELTA from unregistered peer %s\n", __func__, pkt->peer_ip);
+				break;
+			}
 
-					iter = iter -> next;
-				}
+			//the changes build on a version we never applied: some changes are missing, ask for the full table
+			if(pkt->baseVersion > peer->tableVersion){
+				ptp_tracker_t resync;
+				pkt_config_trackerAck(&resync, TRACKER_RESYNC, peer->tableVersion);
+				pktBuf_t* buf = encodeTrackerPkt(&resync);
+				metrics_count(METRIC_RESYNCS, 1);
+				reactor_send(myReactorPtr, connfd, buf, REACTOR_MSG_CONTROL);
+				pkt_buf_release(buf);
+				break;
+			}
 
-				//for each file entry in tracker's fileTable
-				iter = myFileTablePtr->head;
-				while(iter != NULL){
-					//search through packet's fileTable (by name)
-					fileEntry_t* res = filetable_searchFileByName(pkt_recv.filetableHeadPtr, iter->name);
-					if(res != NULL){
-						// if packet's fileTable does not have it
-						// delete the entry from tracker's fileTable
-						filetable_deleteFileEntryByName(myFileTablePtr, iter->name);
+			//every delta carries the latest state of its file, so re-applying one we already have is harmless
+			int needBroadCast = 0;
+			int foreign = 0;
+			fileDelta_t* delta = pkt->deltaHeadPtr;
+			while(delta != NULL){
+				if(!ownsFile(delta->entry.file_name)){
+					foreign ++;
+				} else if(delta->op == DELTA_DELETE){
+					// the peer no longer has the file, the same as it missing from a full table
+					if(filetable_deleteFileEntryByName(myFileTablePtr, delta->entry.file_name) > 0){
+						changelog_record(myChangeLogPtr, DELTA_DELETE, delta->entry.file_name);
 						needBroadCast = 1;
 					}
-
-					iter = iter -> next;
-				}
-
-
-				//at this time we finish sync fileTables between trakcer and server
-				//begin to broadcast trakcer's new fileTable
-				if(needBroadCast){
-					broadcastFileTable();
+				} else if(syncFileEntry(&(delta->entry), peer->id) > 0){
+					needBroadCast = 1;
 				}
+				delta = delta -> next;
+			}
+			if(foreign > 0){
+				printf("%s: error: FILEUPDATE_DELTA from %s has %d files of other shards\n", __func__, pkt->peer_ip, foreign);
+			}
+			metrics_count(METRIC_FILES_SYNCED, pkt->deltasize);
+			metrics_record(METRIC_HIST_RECONCILE, metrics_now() - start);
 
-				break;
+			if(needBroadCast){
+				broadcastsched_request(myBroadcastSchedPtr);
+			}
 
+			acknowledgeVersion(connfd, pkt->tableVersion);
+			break;
+		}
+		case EPOCH_ACK:
+		{
+			metrics_count(METRIC_PKT_EPOCH_ACK, 1);
+			peerEntry_t* peer = peertable_searchEntryBySockfd(myPeerTablePtr, connfd);
+			//acks may cross a newer snapshot on the wire, never move backwards
+			if(peer != NULL && pkt->ackedEpoch > peer->ackedEpoch){
+				peer->ackedEpoch = pkt->ackedEpoch;
 			}
-			case REGISTER:
-				printf("%s: error: aren't suppposed to receive REGISTER here\n", __func__);
+			break;
+		}
+		case MERKLE_SYNC:
+		{
+			metrics_count(METRIC_PKT_MERKLE_SYNC, 1);
+			peerEntry_t* peer = peertable_searchEntryBySockfd(myPeerTablePtr, connfd);
+			if(peer == NULL || !peer->merkleSync){
+				printf("%s: error: MERKLE_SYNC from %s outside of an exchange\n", __func__, pkt->peer_ip);
 				break;
+			}
+			merkleRound(connfd, peer, pkt);
+			break;
+		}
+		default:
+			printf("%s: error: unknown packet type %d\n", __func__, pkt->type);
+			break;
+	}
+
+	//the packet's list of entries was malloced by the decoder
+	filetable_freeList(pkt->filetableHeadPtr);
+	pkt->filetableHeadPtr = NULL;
+	filedelta_freeList(pkt->deltaHeadPtr);
+	pkt->deltaHeadPtr = NULL;
+	free(pkt->nodes);
+	pkt->nodes = NULL;
+}
+
+
+
+/**
+ * remove the peer from the holders of every file in tracker's fileTable, recording each file it held
+ * one bit test per file
+ * @param id [the peer's id]
+ */
+void removeHolder(int id){
+	pthread_mutex_lock(myFileTablePtr->filetable_mutex);
+	fileEntry_t* iter = myFileTablePtr->head;
+	while(iter != NULL){
+		if(filetable_deleteHolderLocked(iter, id) > 0){
+			changelog_record(myChangeLogPtr, DELTA_MODIFY, iter->file_name);
 		}
+		iter = iter->next;
+	}
+	pthread_mutex_unlock(myFileTablePtr->filetable_mutex);
+}
+
+
+
+/**
+ * take a peer out of peerTable, and out of fileTable's holders unless another entry of its ip is left (they share its id)
+ * the peerTable's mutex is held throughout, so the ip cannot register again in between and lose the holders it announces
+ * @param  peer [the peer's entry, in peerTable whose mutex the caller holds, freed here]
+ * @return      [1 if the ip left peerTable, 0 if another entry of it is still there]
+ */
+int removePeerLocked(peerEntry_t* peer){
+	int shared;
+	peertable_removeEntryLocked(myPeerTablePtr, peer, &shared);
+	if(!shared){
+		removeHolder(peer->id);
+	}
+	peertable_freeEntry(myPeerTablePtr, peer);
+	return !shared;
+}
+
+
+
+/**
+ * record that a peer taken out by removePeerLocked left, once the peerTable's mutex is released (the state store's comes first)
+ * @param ip   [the peer's ip]
+ * @param gone [what removePeerLocked returned, an ip still in peerTable is not gone]
+ */
+void peerRemoved(char* ip, int gone){
+	if(gone){
+		statestore_appendPeer(myStateStorePtr, STATESTORE_PEER_GONE, ip, 0);
+		broadcastsched_request(myBroadcastSchedPtr);
 	}
+	metrics_count(METRIC_PEERS_REMOVED, 1);
+	metrics_setGauge(METRIC_GAUGE_PEERS, myPeerTablePtr->size);
+	printf("%s: peer %s removed\n", __func__, ip);
 }
 
 
 
+/**
+ * called by the reactor when a peer's connection is closed or broken
+ * @param connfd [the TCP connection that went away]
+ */
+void peerDisconnected(int connfd){
+	char ip[IP_LEN];
+	pthread_mutex_lock(myPeerTablePtr->peertable_mutex);
+	peerEntry_t* peer = peertable_searchEntryBySockfdLocked(myPeerTablePtr, connfd);
+	if(peer == NULL){
+		pthread_mutex_unlock(myPeerTablePtr->peertable_mutex);
+		return;
+	}
+	memcpy(ip, peer->ip, IP_LEN);
+	int gone = removePeerLocked(peer);
+	pthread_mutex_unlock(myPeerTablePtr->peertable_mutex);
+	peerRemoved(ip, gone);
+}
+
 
 
 /**
  * Periodically check if some peer is dead (DEAD_PEER_TIMEOUT)
- * remove dead peer from peerTable, remove peerip from fileTable
+ * every peer has a timer in the peerTable's wheel that each KEEPALIVE pushes back, so a check only visits
+ * the peers whose timer fired.  A dead peer's connection is shut down, the reactor then notices and calls
+ * peerDisconnected, which removes the dead peer from peerTable and its peerip from fileTable.
+ * A peer restored from the state store that never registered again has no connection, it is removed here,
+ * while the peerTable's mutex is still held so a REGISTER of the ip cannot take it over in between.
+ * The same thread keeps the state store synced and snapshotted, and dumps the metrics now and then.
  */
 void* monitorAlive(void* arg){
+	unsigned long lastDump = getCurrentTime();
 	while(1){
-		//check periodically to prevent CPU burning...
-		sleep(MINITOR_ALIVE_INTERVAL);
+		//check periodically to prevent CPU burning, until the tracker stops
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += MONITOR_ALIVE_INTERVAL;
+		pthread_mutex_lock(&myStopMutex);
+		while(!myStopping && pthread_cond_timedwait(&myStopCond, &myStopMutex, &deadline) != ETIMEDOUT);
+		int stopping = myStopping;
+		pthread_mutex_unlock(&myStopMutex);
+		if(stopping) break;
+		unsigned long start = metrics_now();
 		
-		//check the peerTable and remove all the dead peers 
-		if (myPeerTablePtr->size > 0) {
-			peerEntry_t* iter = myPeerTablePtr->head;
-
-			//obtain current Time
-			unsigned long currentTime = getCurrentTime();
-			while(iter != NULL){
-			//loop through peerTable
-			//check each peer if dead or alive
-				if(currentTime - iter->timestamp > DEAD_PEER_TIMEOUT){
-					//if dead, delete this peer from table
-					peerTable_deleteEntryByIp(iter->ip);
-					//if dead, also remove this peerip from any entry's iplist in the table
-					filetable_deleteIpfromAllEntries(myPeerTablePtr, iter->ip);
-				}
+		//shut down the peers whose timers fired
+		int restoredNum = 0;
+		char (*restored)[IP_LEN] = NULL;
+		int* gone = NULL;
+		pthread_mutex_lock(myPeerTablePtr->peertable_mutex);
+		timerNode_t* node = peertable_expireDead(myPeerTablePtr, getCurrentTime());
+		while(node != NULL){
+			timerNode_t* next = node->next;
+			peerEntry_t* dead = (peerEntry_t*) node->data;
+			printf("%s: peer %s timed out\n", __func__, dead->ip);
+			metrics_count(METRIC_PEERS_TIMED_OUT, 1);
+			if(dead->sockfd >= 0){
+				shutdown(dead->sockfd, SHUT_RDWR);
+			} else {
+				restored = realloc(restored, (restoredNum + 1) * IP_LEN);
+				gone = realloc(gone, (restoredNum + 1) * sizeof(int));
+				memcpy(restored[restoredNum], dead->ip, IP_LEN);
+				gone[restoredNum ++] = removePeerLocked(dead);
 			}
+			node = next;
+		}
+		pthread_mutex_unlock(myPeerTablePtr->peertable_mutex);
+
+		int i;
+		for(i = 0; i < restoredNum; i++){
+			peerRemoved(restored[i], gone[i]);
 		}
+		free(restored);
+		free(gone);
+
+		statestore_maintain(myStateStorePtr, myFileTablePtr, myPeerTablePtr, getCurrentTime());
+		metrics_record(METRIC_HIST_MONITOR, metrics_now() - start);
 
+		if(getCurrentTime() - lastDump >= TRACKER_METRICS_INTERVAL){
+			metrics_dump(myMetricsPath);
+			lastDump = getCurrentTime();
+		}
 	}
+	return NULL;
 }
 
 
@@ -242,10 +1064,13 @@ int create_server_socket(int portNum) {
 	tcpserv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
 	tcpserv_addr.sin_port = htons(portNum);
 
+	int reuse = 1;
+	setsockopt(tcpserv_sd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
 
 	if(bind(tcpserv_sd, (struct sockaddr *)&tcpserv_addr, sizeof(tcpserv_addr))< 0)
 		return -1; 
-	if(listen(tcpserv_sd, 1) < 0) 
+	if(listen(tcpserv_sd, TRACKER_LISTEN_BACKLOG) < 0) 
 		return -1;
 
 	printf("%s finished successfully\n", __func__);
@@ -253,42 +1078,135 @@ int create_server_socket(int portNum) {
 }
 
 
-// Cleanup data structures and any other memory allocations
-// Register with SIGINT, so called when iterrupt the program
-// see main loop 
-void trackerStop() {
-    // Free peer table and filetable
-    peertable_destroy(myPeerTablePtr);
-    filetable_destroy(myFileTablePtr);
-    //close the socket binded with HANDSHAKE_PORT
-    close(svr_sd);
+/**
+ * SIGINT handler: only wakes the reactor (a write to its eventfd), main does the rest once reactor_run returns
+ * @param signum [SIGINT]
+ */
+void trackerInterrupt(int signum){
+	reactor_stop(myReactorPtr);
+}
+
+
+
+/**
+ * cleanup data structures and any other memory allocations, called by main once SIGINT stopped the reactor
+ * no worker handles a packet any more; the monitor thread is stopped first, then the last broadcast goes out
+ * @param monitorThread [the monitorAlive thread]
+ */
+void trackerStop(pthread_t monitorThread){
+	pthread_mutex_lock(&myStopMutex);
+	myStopping = 1;
+	pthread_cond_broadcast(&myStopCond);
+	pthread_mutex_unlock(&myStopMutex);
+	pthread_join(monitorThread, NULL);
+
+	//changes still waiting for their broadcast go out first, and into the state store with it
+	broadcastsched_destroy(myBroadcastSchedPtr);
+	metrics_dump(myMetricsPath);
+	reactor_destroy(myReactorPtr);
+	// Free peer table and filetable
+	peertable_destroy(myPeerTablePtr);
+	filetable_destroy(myFileTablePtr);
+	changelog_destroy(myChangeLogPtr);
+	statestore_close(myStateStorePtr);
+	shardmap_destroy(myShardMapPtr);
+	merkle_destroy(myMerkleTreePtr);
+	if(myMerkleSnapshotPtr != NULL){
+		filetable_releaseSnapshot(myMerkleSnapshotPtr);
+	}
+	//close the socket binded with HANDSHAKE_PORT
+	close(svr_sd);
 }
 
 
 
 /**
- * 1. initialize a peertable and a filetable
- * 2. create a socket binded with HANDSHAKE_PORT 
+ * usage: tracker [-w windowMs] [-m maxDelayMs] [shard shardNum [basePort]]
+ * runs shard shardNum of a tracker split into shardNum shards (default: the only one of TRACKER_SHARD_NUM),
+ * listening on basePort + shard (default HANDSHAKE_PORT) and keeping its state in its own directory
+ * table changes are broadcast once no change came for windowMs, at most maxDelayMs after the first one
+ * (default TRACKER_BROADCAST_WINDOW_MS and TRACKER_BROADCAST_MAX_DELAY_MS, -w 0 broadcasts every change at once)
+ *
+ * 1. initialize a peertable, a filetable and its changelog, restored from the state store if the tracker ran before
+ * 2. create a socket binded with HANDSHAKE_PORT + shard
  * 3. create a MonitorAlive thread to periodically check the last alive timestamp of peers, remove those timeout peers
- * 4. register cleanup method when interrupt (SIGINT)
- * 5. keep listen to the socket binded with HANDSHAKE_PORT
- * 			if receive RESIGSTER pkt:
- * 				1. create a new peerEntry using REGISTER's ip, REGISTER's sockfd, and currentTime;
- * 				2. insert the new peerEntry into table (assert: no peer has same ip as this new peer before insertion)
- * 				3. send a response (with: HEARTBEAT_INTERVAL, FILEPIECE_LEN, filetable) back to peer for setup
- * 				4. create a handshake thread to handle messages from this particular peer
+ * 4. start the reactor workers, every peer packet (REGISTER, KEEPALIVE, FILEUPDATE) is handled by handshake()
+ * 5. stop the reactor on interrupt (SIGINT)
+ * 6. keep accepting on the socket binded with HANDSHAKE_PORT, handing each new peer connection to a worker
+ * 7. once interrupted and the workers are done, flush the last broadcast and clean up
  */
 
 
- int main() {
+ int main(int argc, char* argv[]) {
+
+ 	int shardNum = TRACKER_SHARD_NUM;
+ 	int basePort = HANDSHAKE_PORT;
+ 	long windowMs = TRACKER_BROADCAST_WINDOW_MS;
+ 	long maxDelayMs = TRACKER_BROADCAST_MAX_DELAY_MS;
+ 	myShard = 0;
+
+ 	//options first, then the shard
+ 	int argi = 1;
+ 	while(argi + 1 < argc && argv[argi][0] == '-'){
+ 		if(strcmp(argv[argi], "-w") == 0){
+ 			windowMs = atol(argv[argi + 1]);
+ 		} else if(strcmp(argv[argi], "-m") == 0){
+ 			maxDelayMs = atol(argv[argi + 1]);
+ 		} else {
+ 			break;
+ 		}
+ 		argi += 2;
+ 	}
+ 	int rest = argc - argi;
+ 	if((rest != 0 && rest != 2 && rest != 3) || (rest > 0 && argv[argi][0] == '-')){
+ 		printf("usage: %s [-w windowMs] [-m maxDelayMs] [shard shardNum [basePort]]\n", argv[0]);
+ 		return 1;
+ 	}
+ 	if(rest >= 2){
+ 		myShard = atoi(argv[argi]);
+ 		shardNum = atoi(argv[argi + 1]);
+ 	}
+ 	if(rest == 3){
+ 		basePort = atoi(argv[argi + 2]);
+ 	}
+ 	//a window longer than the max delay would never be waited for
+ 	if(maxDelayMs < windowMs){
+ 		maxDelayMs = windowMs;
+ 	}
+ 	if(shardNum <= 0 || myShard < 0 || myShard >= shardNum){
+ 		printf("%s: error: shard %d of %d\n", __func__, myShard, shardNum);
+ 		return 1;
+ 	}
+ 	myShardMapPtr = shardmap_init(shardNum);
 
-	//1. initialize a peertable and a filetable
+	//1. initialize a peertable, a filetable and its changelog
  	myPeerTablePtr = peertable_init();
  	myFileTablePtr = filetable_init();
+ 	myChangeLogPtr = changelog_init(CHANGELOG_CAPACITY);
+
+ 	//every shard keeps its own tables
+ 	char stateDir[STATESTORE_PATH_LEN];
+ 	if(shardNum == 1){
+ 		snprintf(stateDir, sizeof(stateDir), "%s", TRACKER_STATE_DIR);
+ 	} else {
+ 		snprintf(stateDir, sizeof(stateDir), "%s.%d", TRACKER_STATE_DIR, myShard);
+ 	}
+ 	myStateStorePtr = statestore_open(stateDir);
+ 	snprintf(myMetricsPath, sizeof(myMetricsPath), "%s/%s", stateDir, TRACKER_METRICS_FILE);
+ 	metrics_init();
+ 	assert(myStateStorePtr != NULL);
+ 	if(statestore_load(myStateStorePtr, myFileTablePtr, myPeerTablePtr) < 0){
+ 		printf("%s: starting with empty tables\n", __func__);
+ 	}
+ 	//epochs go on from the restored table, so the epochs peers acknowledged before stay meaningful
+ 	changelog_restore(myChangeLogPtr, myStateStorePtr->epoch);
+ 	int dropped = dropForeignFiles();
+ 	publishFileTable();
+ 	printf("%s: shard %d of %d restored %d files and %d peers at epoch %lu, dropped %d files of other shards\n", __func__, myShard, shardNum, myFileTablePtr->size, myPeerTablePtr->size, myStateStorePtr->epoch, dropped);
 
 
- 	//2. create a socket on HANDSHAKE_PORT
- 	svr_sd = create_server_socket(HANDSHAKE_PORT);
+ 	//2. create a socket on HANDSHAKE_PORT + shard
+ 	svr_sd = create_server_socket(basePort + myShard);
  	assert(svr_sd >= 0);
 
 
@@ -298,62 +1216,31 @@ void trackerStop() {
  	pthread_create(&minitorAlive_thread, NULL, monitorAlive, NULL);
 
 
- 	//4. register cleanup method when stop
- 	signal(SIGINT, trackerStop);
-
-
-
-	ptp_peer_t pkt_recv;// the packet received on HANDSHAKE_PORT
-
-	//5. keeps listening on the socket binded with HANDSHAKE_PORT
-	while(1) {
-
-		//receive the REGISTER pkt if any
-		struct sockaddr_in client_addr;
-		socklen_t length = sizeof(client_addr);
-		int connfd = accept(svr_sd, (struct sockaddr*) &client_addr, &length);
-		assert(connfd >= 0);
-
-
-		pkt_tracker_recvPkt(connfd, &pkt_recv);
-
-
-		if(pkt_recv.type == REGISTER) {
-
-			//create a new peerEntry using 1. REGISTER's ip, 2. connfd: denoting the TCP connection between this peer and tracker;
-			peerEntry_t* peerEntry = peertable_createEntry(pkt_recv.peer_ip, connfd);
-
-			// insert the new peerEntry into table (assert: no peer has same ip as this new peer before insertion)
-			assert(peertable_searchEntryByIp(myPeerTablePtr, peerEntry -> ip) == NULL);
-			peertable_addEntry(myPeerTablePtr, peerEntry);
-
-			//create a pkt to send back to peer, for peer to set up itself
-			//the pkt contains info: 1. HEATBEAT_INTERVAL 2. PIECE_LENGTH 3. trakcer's fileTable(including size and the linkedlist)
-			ptp_tracker_t* setup = pkt_create_trackerPkt();
-			pkt_config_trackerPkt(setup, HEARTBEAT_INTERVAL, PIECE_LENGTH, myFileTablePtr->size, myFileTablePtr->head);
-
-			//send the configured pkt --> peer
-			pkt_tracker_sendPkt(connfd, setup);
-			
-
- 			//create a handshake thread to handle messages from this particular peer
-			//receive messages from this peer and respond if needed
-			//by using the peer-tracker handshake protocal
-			pthread_t handshake_thread;
-			pthread_create(&handshake_thread, NULL, handshake, &connfd);
-			
-		}
+ 	//a peer vanishing while we send to it must not kill the tracker
+ 	signal(SIGPIPE, SIG_IGN);
 
 
+	//4. start the broadcast scheduler and the workers owning the peer connections
+	myBroadcastSchedPtr = broadcastsched_init(windowMs, maxDelayMs, broadcastFileTable);
+	assert(myBroadcastSchedPtr != NULL);
+	myReactorPtr = reactor_init(svr_sd, TRACKER_WORKER_NUM, handshake, peerDisconnected, resyncPeer);
+	assert(myReactorPtr != NULL);
+	if(reactor_start(myReactorPtr) < 0){
+		printf("%s: error: cannot start the reactor workers\n", __func__);
+		return 1;
 	}
-}
-
-
-
-
 
 
+	//5. the handler only stops the reactor, everything else is done here once it has
+	signal(SIGINT, trackerInterrupt);
 
 
+	//6. keeps accepting on the socket binded with HANDSHAKE_PORT, until interrupted
+	reactor_run(myReactorPtr);
 
 
+	//7. the workers are done, nothing uses the tables but the cleanup
+	printf("%s: stopping\n", __func__);
+	trackerStop(minitorAlive_thread);
+	return 0;
+}
@@ -3,6 +3,7 @@
 #include "../common/constants.h"
 
 #include "../common/pkt.h"
+#include "../common/filemerge.h"
 /*
 init peer table, return failed? -1:1
 */
@@ -13,15 +14,53 @@ init file table, return failed? -1:1
 */
 void initFileTable();
 
+int ownsFile(char* file_name);
+
+int dropForeignFiles();
+
 void updateFileTable(ptp_peer_t * pkt);
 
+void publishFileTable();
+
+pktBuf_t* encodeTrackerPkt(ptp_tracker_t* pkt);
+
+pktBuf_t* encodeSnapshot(fileSnapshot_t* snapshot);
+
+pktBuf_t* encodeTableUpdate(fileSnapshot_t* table, unsigned long baseEpoch, pktBuf_t** snapshot);
+
 void broadcastFileTable();
 
+void resyncPeer(int connfd);
+
+
+
+
+int syncFileEntry(fileEntry_t* entry, int peerId);
+
+int applyChangeSet(fileChangeSet_t* set, int peerId);
+
+fileEntry_t* takeOwnedFiles(ptp_peer_t* pkt, int* foreign);
+
+void sendVersionAck(int connfd, char* ip, unsigned long version);
+
+void acknowledgeVersion(int connfd, unsigned long version);
+
+void sendPendingAcks();
+
+merkleTree_t* acquireMerkleTreeLocked();
+
+void merkleRound(int connfd, peerEntry_t* peer, ptp_peer_t* pkt);
+
+void handshake(int connfd, ptp_peer_t* pkt);
+
+void removeHolder(int id);
 
+int removePeerLocked(peerEntry_t* peer);
 
+void peerRemoved(char* ip, int gone);
 
-void *handshake(void* arg);
+void peerDisconnected(int connfd);
 
-void *monitor_alive(void* arg);
+void *monitorAlive(void* arg);
 
 #endif